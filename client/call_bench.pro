@@ -0,0 +1,31 @@
+#
+# call_bench — офлайн-бенчмарк аудиотракта звонка.
+#
+# Прогоняет capture -> encode -> packetize и depacketize -> jitter ->
+# decode -> playout на записанном PCM под симулированными трассами
+# потерь/джиттера и печатает CPU по ступеням, сквозную алгоритмическую
+# задержку и счетчики heap-аллокаций. Собирается независимо от
+# клиентского проекта (устройства и сеть не нужны):
+#
+#   qmake call_bench.pro && make
+#
+
+QT += core
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = call_bench
+
+INCLUDEPATH += "$$PWD/opus-1.5.2/include"
+LIBS += -L"$$PWD/opus-1.5.2/.libs" -lopus
+
+SOURCES += \
+    call_bench_main.cpp \
+    core/audiodsp.cpp \
+    core/jitterbuffer.cpp
+
+HEADERS += \
+    core/audiodsp.h \
+    core/jitterbuffer.h
@@ -0,0 +1,347 @@
+/**
+ * @file call_bench_main.cpp
+ * @brief Офлайн-бенчмарк аудиотракта звонка (call_bench).
+ *
+ * @details Прогоняет обе половины медиатракта без устройств и сети:
+ * передающая сторона — DSP захвата (AEC/гейт) -> opus_encode ->
+ * упаковка заголовка; сеть — симулятор потерь/джиттера/переупорядочивания;
+ * приемная сторона — джиттер-буфер -> opus_decode (FEC/PLC) -> опора AEC.
+ * Те же классы (AudioDsp, JitterBuffer) и те же константы, что и в
+ * AudioEngine, так что числа бенчмарка переносимы на реальный звонок.
+ *
+ * По завершении печатается отчет: CPU каждой ступени (всего и на кадр,
+ * доля одного ядра относительно реального времени звука), сквозная
+ * алгоритмическая задержка тракта и счетчики heap-аллокаций по ступеням —
+ * установившийся режим тракта обязан держать ноль.
+ *
+ * Запуск:
+ * @code
+ *   call_bench [--pcm fixture.raw] [--seconds 30] [--loss 5] [--jitter 30]
+ * @endcode
+ * Фикстура — сырой PCM s16le mono 48 кГц; без нее синтезируется
+ * речеподобный сигнал (огибающая + гармоники).
+ *
+ * Бенчмарк нужен, чтобы каждое изменение кодека или DSP доказывало себя
+ * числами, а не прослушиванием тестового тона.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QVector>
+#include <QDebug>
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <opus.h>
+
+#include "core/audiodsp.h"
+#include "core/jitterbuffer.h"
+
+namespace {
+
+/// Частота тракта бенчмарка: fullband, как в AudioEngine на 48к-устройствах
+constexpr int SampleRate = 48000;
+
+/// Сэмплов в 20-мс кадре
+constexpr int FrameSamples = 960;
+
+/// Размер RTP-подобного заголовка AudioEngine, байт
+constexpr int HeaderBytes = 9;
+
+// ───────────────────────────────────────────────────────────────────────
+// Счетчик heap-аллокаций: глобальные new/delete инструментируются, чтобы
+// ловить аллокации на горячем пути тракта. Установившийся режим после
+// прогрева обязан давать ноль — это и проверяет отчет.
+// ───────────────────────────────────────────────────────────────────────
+std::atomic<qint64> g_allocCount{0};
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+/** @brief Накопители одной ступени: время и аллокации. */
+struct StageStats {
+    const char* name;
+    qint64 elapsedNs = 0;   ///< Суммарное время ступени
+    qint64 allocs = 0;      ///< Heap-аллокаций внутри ступени
+    qint64 frames = 0;      ///< Обработано кадров
+};
+
+/** @brief Замер одного вызова ступени (время + дельта аллокаций). */
+class StageScope {
+public:
+    explicit StageScope(StageStats& stats)
+        : m_stats(stats),
+          m_allocsBefore(g_allocCount.load(std::memory_order_relaxed))
+    {
+        m_timer.start();
+    }
+    ~StageScope()
+    {
+        m_stats.elapsedNs += m_timer.nsecsElapsed();
+        m_stats.allocs += g_allocCount.load(std::memory_order_relaxed) - m_allocsBefore;
+        ++m_stats.frames;
+    }
+private:
+    StageStats& m_stats;
+    qint64 m_allocsBefore;
+    QElapsedTimer m_timer;
+};
+
+/** @brief Детерминированный LCG: трассы потерь/джиттера воспроизводимы. */
+quint32 nextRandom(quint32& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state;
+}
+
+/**
+ * @brief Загружает PCM фикстуру или синтезирует речеподобный сигнал.
+ *
+ * Синтез — основной тон с гармониками под медленной огибающей и паузами:
+ * дает энкодеру и DTX, и активную речь, в отличие от чистого синуса.
+ */
+QVector<short> loadFixture(const QString& path, int seconds)
+{
+    if (!path.isEmpty()) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "[BENCH] Cannot open fixture" << path;
+            return {};
+        }
+        const QByteArray raw = file.readAll();
+        QVector<short> pcm(int(raw.size() / 2));
+        memcpy(pcm.data(), raw.constData(), size_t(pcm.size()) * 2);
+        return pcm;
+    }
+
+    QVector<short> pcm(seconds * SampleRate);
+    for (int i = 0; i < pcm.size(); ++i) {
+        const double t = double(i) / SampleRate;
+        // Огибающая: ~2 "фразы" в секунду с паузами между ними
+        const double envelope = qMax(0.0, std::sin(2.0 * M_PI * 2.0 * t));
+        const double voice = 0.6 * std::sin(2.0 * M_PI * 180.0 * t)
+                           + 0.3 * std::sin(2.0 * M_PI * 360.0 * t)
+                           + 0.1 * std::sin(2.0 * M_PI * 720.0 * t);
+        pcm[i] = short(12000.0 * envelope * voice);
+    }
+    return pcm;
+}
+
+/** @brief Пакет "в полете" в симуляторе сети. */
+struct FlightPacket {
+    quint64 seq = 0;
+    int len = 0;
+    int deliverAtTick = 0;  ///< Такт, на котором пакет "прибывает"
+    unsigned char data[JitterBuffer::MaxPacketBytes];
+};
+
+/** @brief Строка отчета по ступени. */
+void printStage(const StageStats& s, double audioSeconds)
+{
+    const double totalMs = double(s.elapsedNs) / 1e6;
+    const double perFrameUs = s.frames ? double(s.elapsedNs) / 1e3 / double(s.frames) : 0.0;
+    const double corePct = audioSeconds > 0.0 ? totalMs / (audioSeconds * 1000.0) * 100.0 : 0.0;
+    qInfo().noquote() << QString("  %1: %2 ms total, %3 us/frame, %4% of one core, %5 allocs")
+                             .arg(QString::fromLatin1(s.name), -22)
+                             .arg(totalMs, 8, 'f', 2)
+                             .arg(perFrameUs, 7, 'f', 2)
+                             .arg(corePct, 5, 'f', 2)
+                             .arg(s.allocs);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("call_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Офлайн-бенчмарк аудиотракта звонка");
+    parser.addHelpOption();
+    parser.addOption({"pcm", "PCM фикстура (s16le mono 48 кГц)", "file", ""});
+    parser.addOption({"seconds", "Длительность синтезированного сигнала", "n", "30"});
+    parser.addOption({"loss", "Потери пакетов, %", "pct", "5"});
+    parser.addOption({"jitter", "Разброс задержки доставки, мс", "ms", "30"});
+    parser.process(app);
+
+    const QVector<short> pcm = loadFixture(parser.value("pcm"),
+                                           parser.value("seconds").toInt());
+    if (pcm.size() < FrameSamples) {
+        qWarning() << "[BENCH] Fixture too short";
+        return 1;
+    }
+    const int totalFrames = pcm.size() / FrameSamples;
+    const double audioSeconds = double(totalFrames) * 0.02;
+    const int lossPercent = parser.value("loss").toInt();
+    const int jitterSpreadMs = parser.value("jitter").toInt();
+
+    // Тракт: те же компоненты и настройки, что в AudioEngine
+    int error = OPUS_OK;
+    OpusEncoder* encoder = opus_encoder_create(SampleRate, 1, OPUS_APPLICATION_VOIP, &error);
+    OpusDecoder* decoder = opus_decoder_create(SampleRate, 1, &error);
+    if (!encoder || !decoder || error != OPUS_OK) {
+        qWarning() << "[BENCH] Opus codec creation failed";
+        return 1;
+    }
+    opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(1));
+    opus_encoder_ctl(encoder, OPUS_SET_DTX(1));
+    opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(lossPercent));
+
+    AudioDsp dsp;
+    dsp.configure(SampleRate, SampleRate, FrameSamples);
+    JitterBuffer jitterBuffer;
+
+    StageStats stCapture{"dsp capture (AEC+gate)"};
+    StageStats stEncode{"opus_encode"};
+    StageStats stPacketize{"packetize"};
+    StageStats stJitterPush{"jitter push"};
+    StageStats stDecode{"jitter pull + decode"};
+    StageStats stPlayout{"playout (AEC ref)"};
+
+    // Предвыделенный "эфир": максимум пакетов в полете при заданном джиттере
+    QVector<FlightPacket> flight(jitterSpreadMs / 20 + 4);
+    for (FlightPacket& p : flight) p.len = -1;
+
+    quint32 rng = 0xC0FFEEu;
+    QVector<short> frame(FrameSamples);
+    QVector<short> decoded(FrameSamples);
+    unsigned char packet[JitterBuffer::MaxPacketBytes];
+    qint64 concealed = 0;
+    qint64 dropped = 0;
+
+    for (int tick = 0; tick < totalFrames; ++tick) {
+        memcpy(frame.data(), pcm.constData() + tick * FrameSamples,
+               size_t(FrameSamples) * 2);
+
+        // ── Передающая сторона ────────────────────────────────────────
+        {
+            StageScope scope(stCapture);
+            dsp.processCaptureFrame(frame.data(), FrameSamples);
+        }
+
+        int opusLen = 0;
+        {
+            StageScope scope(stEncode);
+            opusLen = opus_encode(encoder, frame.constData(), FrameSamples,
+                                  packet + HeaderBytes,
+                                  int(sizeof(packet)) - HeaderBytes);
+        }
+
+        {
+            StageScope scope(stPacketize);
+            packet[0] = 0; // PayloadAudio
+            const quint32 seq = quint32(tick);
+            const quint32 ts = quint32(tick) * FrameSamples;
+            for (int b = 0; b < 4; ++b) {
+                packet[1 + b] = (seq >> (24 - 8 * b)) & 0xFF;
+                packet[5 + b] = (ts >> (24 - 8 * b)) & 0xFF;
+            }
+        }
+
+        // ── Симулятор сети: потери, задержка, переупорядочивание ──────
+        if (opusLen > 0) {
+            if (int(nextRandom(rng) % 100) < lossPercent) {
+                ++dropped;
+            } else {
+                const int delayTicks =
+                    jitterSpreadMs > 0 ? int(nextRandom(rng) % quint32(jitterSpreadMs)) / 20 : 0;
+                for (FlightPacket& p : flight) {
+                    if (p.len < 0) {
+                        p.seq = quint64(tick);
+                        p.len = HeaderBytes + opusLen;
+                        p.deliverAtTick = tick + delayTicks;
+                        memcpy(p.data, packet, size_t(p.len));
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Доставка всего, что "долетело" к этому такту (порядок прибытия
+        // определяется задержками — переупорядочивание получается само)
+        for (FlightPacket& p : flight) {
+            if (p.len >= 0 && p.deliverAtTick <= tick) {
+                StageScope scope(stJitterPush);
+                jitterBuffer.push(p.seq,
+                                  reinterpret_cast<const char*>(p.data) + HeaderBytes,
+                                  p.len - HeaderBytes);
+                p.len = -1;
+            }
+        }
+
+        // ── Приемная сторона: такт воспроизведения ────────────────────
+        {
+            StageScope scope(stDecode);
+            if (jitterBuffer.hasNext()) {
+                const int len = jitterBuffer.takeNext(packet, int(sizeof(packet)));
+                opus_decode(decoder, packet, len, decoded.data(), FrameSamples, 0);
+            } else if (jitterBuffer.depth() > 0) {
+                // Пропуск: FEC из следующего пакета либо PLC — как в
+                // AudioEngine::processJitterBuffer
+                const int nextLen = jitterBuffer.peek(jitterBuffer.nextSeq() + 1,
+                                                      packet, int(sizeof(packet)));
+                if (nextLen > 0) {
+                    opus_decode(decoder, packet, nextLen, decoded.data(), FrameSamples, 1);
+                } else {
+                    opus_decode(decoder, nullptr, 0, decoded.data(), FrameSamples, 0);
+                }
+                jitterBuffer.skipNext();
+                ++concealed;
+            }
+        }
+
+        {
+            StageScope scope(stPlayout);
+            dsp.pushPlayoutFrame(decoded.constData(), FrameSamples);
+        }
+    }
+
+    // ── Отчет ─────────────────────────────────────────────────────────
+    qInfo().noquote() << "";
+    qInfo().noquote() << QString("[BENCH] %1 s audio, %2 frames, loss %3%, jitter %4 ms")
+                             .arg(audioSeconds, 0, 'f', 1)
+                             .arg(totalFrames)
+                             .arg(lossPercent)
+                             .arg(jitterSpreadMs);
+    printStage(stCapture, audioSeconds);
+    printStage(stEncode, audioSeconds);
+    printStage(stPacketize, audioSeconds);
+    printStage(stJitterPush, audioSeconds);
+    printStage(stDecode, audioSeconds);
+    printStage(stPlayout, audioSeconds);
+
+    // Сквозная алгоритмическая задержка тракта: кадр захвата + глубина
+    // джиттер-буфера, к которой он пришел на этой трассе
+    const int latencyMs = JitterBuffer::FramePeriodMs
+                          + jitterBuffer.targetDepth() * JitterBuffer::FramePeriodMs;
+    qInfo().noquote() << QString("  end-to-end algorithmic latency: %1 ms "
+                                 "(frame + %2 buffered)")
+                             .arg(latencyMs)
+                             .arg(jitterBuffer.targetDepth());
+    qInfo().noquote() << QString("  concealed %1, dropped by trace %2, "
+                                 "late %3, reordered %4")
+                             .arg(concealed)
+                             .arg(dropped)
+                             .arg(jitterBuffer.lateCount())
+                             .arg(jitterBuffer.reorderCount());
+
+    opus_encoder_destroy(encoder);
+    opus_decoder_destroy(decoder);
+    return 0;
+}
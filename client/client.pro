@@ -1,12 +1,13 @@
 QT += core gui
 QT += network sql svg httpserver
 QT += multimedia network
+QT += openglwidgets
 QT += sql
 
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++17
+CONFIG += c++20
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
@@ -24,16 +25,37 @@ LIBS += -L"$$PWD/opus-1.5.2/.libs" -lopus
 
 
 SOURCES += \
+    core/accountmanager.cpp \
+    core/audioengine.cpp \
+    core/audiodsp.cpp \
+    core/asyncapi.cpp \
     core/avatarcache.cpp \
     core/callservice.cpp \
+    core/fileuploadservice.cpp \
+    core/binarycodec.cpp \
+    core/compression.cpp \
     core/cryptoutils.cpp \
+    core/databasefacade.cpp \
     core/databaseservice.cpp \
+    core/jitterbuffer.cpp \
+    core/startupclock.cpp \
+    core/perfmetrics.cpp \
+    core/wakeaudit.cpp \
+    core/stringpool.cpp \
+    core/thumbnailcache.cpp \
+    core/timerhub.cpp \
     core/tokenmanager.cpp \
     core/monocypher.c \
     main.cpp \
     mainwindow.cpp \
     core/dataservice.cpp \
+    core/e2esession.cpp \
+    core/fasthash.cpp \
+    core/framebuffer.cpp \
+    core/httpclient.cpp \
+    core/networkdecoder.cpp \
     core/networkservice.cpp \
+    core/netsim.cpp \
     models/chatmessagemodel.cpp \
     models/contactlistmodel.cpp \
     models/chatfilterproxymodel.cpp \
@@ -42,6 +64,7 @@ SOURCES += \
     widgets/callwidget.cpp \
     ui/chatviewwidget.cpp \
     ui/loginwidget.cpp \
+    widgets/perfhudwidget.cpp \
     widgets/profileviewwidget.cpp \
     widgets/incomingrequestswidget.cpp \
     widgets/searchresultspopup.cpp \
@@ -53,14 +76,39 @@ SOURCES += \
 
 
 HEADERS += \
+    core/accountmanager.h \
+    core/audioengine.h \
+    core/audiodsp.h \
+    core/asyncapi.h \
     core/avatarcache.h \
     core/callservice.h \
+    core/fileuploadservice.h \
+    core/compactstring.h \
+    core/threadcheck.h \
+    core/statssnapshot.h \
+    core/netsim.h \
+    core/binarycodec.h \
+    core/compression.h \
     core/cryptoutils.h \
+    core/databasefacade.h \
     core/databaseservice.h \
+    core/jitterbuffer.h \
+    core/startupclock.h \
+    core/perfmetrics.h \
+    core/wakeaudit.h \
+    core/protocolschema.h \
+    core/stringpool.h \
+    core/thumbnailcache.h \
+    core/timerhub.h \
     core/tokenmanager.h \
     core/monocypher.h \
     mainwindow.h \
     core/dataservice.h \
+    core/e2esession.h \
+    core/fasthash.h \
+    core/framebuffer.h \
+    core/httpclient.h \
+    core/networkdecoder.h \
     core/networkservice.h \
     core/structures.h \
     models/chatmessagemodel.h \
@@ -71,6 +119,7 @@ HEADERS += \
     widgets/callwidget.h \
     ui/chatviewwidget.h \
     ui/loginwidget.h \
+    widgets/perfhudwidget.h \
     widgets/profileviewwidget.h \
     widgets/incomingrequestswidget.h \
     widgets/searchresultspopup.h \
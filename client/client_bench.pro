@@ -0,0 +1,86 @@
+#
+# client_bench — офлайн-бенчмарк стека отрисовки клиента.
+#
+# Headless-прогон (платформа offscreen) настоящих моделей, делегатов и
+# вью: синтетическая история через ChatMessageModel + ChatMessageDelegate
+# + SmoothListView, оборот списка контактов через DataService +
+# ContactListModel + ContactListDelegate. Печатает времена кадра
+# прокрутки, стоимость prepend, хит-рейты кэшей делегата и счетчики
+# heap-аллокаций. Собирается независимо от клиентского проекта
+# (дисплей и сервер не нужны):
+#
+#   qmake client_bench.pro && make
+#
+
+QT += core gui widgets network sql svg openglwidgets
+
+CONFIG += c++20 console
+CONFIG -= app_bundle
+
+TARGET = client_bench
+
+INCLUDEPATH += \
+    $$PWD/core \
+    $$PWD/models \
+    $$PWD/delegates \
+    $$PWD/ui \
+    $$PWD/widgets \
+    $$PWD/utils \
+    $$PWD/resources
+INCLUDEPATH += "$$PWD/opus-1.5.2/include"
+
+SOURCES += \
+    client_bench_main.cpp \
+    core/asyncapi.cpp \
+    core/avatarcache.cpp \
+    core/binarycodec.cpp \
+    core/compression.cpp \
+    core/cryptoutils.cpp \
+    core/databasefacade.cpp \
+    core/databaseservice.cpp \
+    core/dataservice.cpp \
+    core/e2esession.cpp \
+    core/fasthash.cpp \
+    core/httpclient.cpp \
+    core/monocypher.c \
+    core/perfmetrics.cpp \
+    core/stringpool.cpp \
+    core/thumbnailcache.cpp \
+    core/timerhub.cpp \
+    core/tokenmanager.cpp \
+    delegates/chatmessagedelegate.cpp \
+    delegates/contactlistdelegate.cpp \
+    models/chatmessagemodel.cpp \
+    models/contactlistmodel.cpp \
+    ui/smoothlistview.cpp
+
+HEADERS += \
+    core/asyncapi.h \
+    core/avatarcache.h \
+    core/binarycodec.h \
+    core/compactstring.h \
+    core/compression.h \
+    core/cryptoutils.h \
+    core/databasefacade.h \
+    core/databaseservice.h \
+    core/dataservice.h \
+    core/e2esession.h \
+    core/fasthash.h \
+    core/httpclient.h \
+    core/monocypher.h \
+    core/perfmetrics.h \
+    core/stringpool.h \
+    core/structures.h \
+    core/threadcheck.h \
+    core/thumbnailcache.h \
+    core/timerhub.h \
+    core/tokenmanager.h \
+    delegates/chatmessagedelegate.h \
+    delegates/contactlistdelegate.h \
+    models/chatmessagemodel.h \
+    models/contactlistmodel.h \
+    ui/smoothlistview.h
+
+# Иконки статусов и SVG делегатов — те же ресурсы, что в клиенте
+RESOURCES += \
+    resources/resources.qrc
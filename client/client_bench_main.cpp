@@ -0,0 +1,428 @@
+/**
+ * @file client_bench_main.cpp
+ * @brief Офлайн-бенчмарк стека отрисовки клиента (client_bench).
+ *
+ * @details Headless-прогон (платформа offscreen) настоящих классов
+ * модель/вью: синтетическая история прокачивается через ChatMessageModel +
+ * ChatMessageDelegate + SmoothListView, список контактов — через
+ * DataService + ContactListModel + ContactListDelegate. Никаких моков:
+ * те же кэши, те же фоновые потоки верстки, тот же paint, что и в живом
+ * клиенте, поэтому числа бенчмарка переносимы на реальную прокрутку.
+ *
+ * Сценарии и отчет:
+ * - ingest: добавление истории в конец пачками (окно модели вытесняет
+ *   старые строки) — строк в секунду и heap-аллокации;
+ * - prepend: пагинация вверх страницами — p50/p95/p99 стоимости страницы;
+ * - scroll: покадровая прокрутка вьюпорта с отрисовкой в QImage —
+ *   времена кадра холодного и прогретого прохода плюс хит-рейты кэшей
+ *   QTextDocument и пузырей из PerfMetrics;
+ * - churn: оборот списка контактов (новое сообщение -> пересортировка
+ *   строки -> перерисовка) — p50/p95/p99 стоимости события.
+ *
+ * Запуск:
+ * @code
+ *   client_bench [--messages 100000] [--contacts 2000] [--churn 5000]
+ * @endcode
+ *
+ * Бенчмарк — регрессионные ворота для оптимизаций делегатов и моделей:
+ * каждое изменение обязано доказывать себя этими числами, а не
+ * прокруткой на глаз.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QListView>
+#include <QPainter>
+#include <QScrollBar>
+#include <QVector>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "core/dataservice.h"
+#include "core/perfmetrics.h"
+#include "core/structures.h"
+#include "delegates/chatmessagedelegate.h"
+#include "delegates/contactlistdelegate.h"
+#include "models/chatmessagemodel.h"
+#include "models/contactlistmodel.h"
+#include "ui/smoothlistview.h"
+
+namespace {
+
+// ───────────────────────────────────────────────────────────────────────
+// Счетчик heap-аллокаций: глобальные new/delete инструментируются, как в
+// call_bench — ingest и прокрутка прогретого окна обязаны показывать
+// стоимость аллокаций явно, а не прятать ее в усредненном времени.
+// ───────────────────────────────────────────────────────────────────────
+std::atomic<qint64> g_allocCount{0};
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+/// Размеры вьюпорта бенчмарка: типичное окно чата
+constexpr int ViewportWidth = 480;
+constexpr int ViewportHeight = 720;
+
+/// Шаг прокрутки на кадр, пикселей (порядок колесика мыши)
+constexpr int ScrollStepPx = 48;
+
+/** @brief Детерминированный LCG: синтетическая история воспроизводима. */
+quint32 nextRandom(quint32& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state;
+}
+
+/** @brief Перцентиль по выборке (копия подхода server_bench). */
+double percentile(QVector<double> samples, double p)
+{
+    if (samples.isEmpty()) return 0.0;
+    std::sort(samples.begin(), samples.end());
+    const int index = qMin<int>(samples.size() - 1,
+                                int(p / 100.0 * double(samples.size())));
+    return samples.at(index);
+}
+
+/**
+ * @brief Синтезирует сообщение с реалистичным миксом содержимого.
+ *
+ * Распределение подобрано под живой трафик: большинство — короткий и
+ * средний текст, заметная доля длинных абзацев (полная верстка
+ * QTextDocument), ~15% стикероподобных эмодзи (быстрый путь делегата)
+ * и немного файлов. Однородный текст спрятал бы худшие строки.
+ */
+ChatMessage makeMessage(qint64 id, quint32& rng)
+{
+    ChatMessage msg;
+    msg.id = id;
+    msg.timestamp = 1700000000000ll + id * 1500;
+    msg.isOutgoing = (nextRandom(rng) % 2) == 0;
+    msg.fromUser = msg.isOutgoing ? QStringLiteral("bench_self")
+                                  : QStringLiteral("bench_peer");
+    msg.toUser = msg.isOutgoing ? QStringLiteral("bench_peer")
+                                : QStringLiteral("bench_self");
+    msg.status = ChatMessage::Read;
+    msg.messageType = ChatMessage::Text;
+
+    const quint32 roll = nextRandom(rng) % 100;
+    if (roll < 40) {
+        msg.payload = QStringLiteral("Сообщение номер %1").arg(id);
+    } else if (roll < 70) {
+        msg.payload = QStringLiteral(
+            "Средней длины сообщение %1: пара предложений, которые уже "
+            "переносятся на вторую строку пузыря.").arg(id);
+    } else if (roll < 85) {
+        // Длинный абзац: полная верстка документа, худшие строки чата
+        QString longText = QStringLiteral("Длинное сообщение %1. ").arg(id);
+        for (int i = 0; i < 6; ++i) {
+            longText += QStringLiteral(
+                "Абзац текста, который делегат обязан сверстать и "
+                "закэшировать, чтобы прокрутка не верстала его заново. ");
+        }
+        msg.payload = longText;
+    } else if (roll < 97) {
+        // Быстрый путь стикеров/эмодзи (~20% живого трафика)
+        msg.payload = QStringLiteral("😀🎉");
+    } else {
+        msg.messageType = ChatMessage::File;
+        msg.fileId = QStringLiteral("bench-file-%1").arg(id);
+        msg.fileName = QStringLiteral("report_%1.pdf").arg(id);
+        msg.payload = QStringLiteral("");
+    }
+    return msg;
+}
+
+/** @brief Страница истории подряд идущих id, от oldest включительно. */
+QList<ChatMessage> makePage(qint64 oldestId, int count, quint32& rng)
+{
+    QList<ChatMessage> page;
+    page.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        page.append(makeMessage(oldestId + i, rng));
+    }
+    return page;
+}
+
+/**
+ * @brief Сценарий ingest: история течет в конец модели пачками.
+ *
+ * Окно модели ограничено, так что сценарий меряет не рост памяти, а
+ * установившийся режим: вставка + вытеснение сверху + переиндексация.
+ */
+void runIngest(int totalMessages)
+{
+    constexpr int BatchSize = 256;
+
+    ChatMessageModel model;
+    quint32 rng = 0xBEEF01u;
+
+    const qint64 allocsBefore = g_allocCount.load(std::memory_order_relaxed);
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 nextId = 1;
+    while (nextId <= totalMessages) {
+        const int count = int(qMin<qint64>(BatchSize, totalMessages - nextId + 1));
+        model.addMessages(makePage(nextId, count, rng));
+        nextId += count;
+    }
+
+    const double seconds = double(timer.nsecsElapsed()) / 1e9;
+    const qint64 allocs = g_allocCount.load(std::memory_order_relaxed) - allocsBefore;
+    qInfo().noquote() << QString("[BENCH] ingest: %1 msgs in %2 s (%3 msg/s), "
+                                 "window %4 rows, %5 allocs (%6 per msg)")
+                             .arg(totalMessages)
+                             .arg(seconds, 0, 'f', 2)
+                             .arg(double(totalMessages) / seconds, 0, 'f', 0)
+                             .arg(model.rowCount())
+                             .arg(allocs)
+                             .arg(double(allocs) / double(totalMessages), 0, 'f', 1);
+}
+
+/**
+ * @brief Сценарий prepend: пагинация вверх страницами по 50.
+ *
+ * Исторически это был квадратичный путь (QList::prepend со сдвигом);
+ * сценарий держит его под присмотром: стоимость страницы обязана
+ * оставаться плоской независимо от глубины прокрутки.
+ */
+void runPrepend(int pages)
+{
+    constexpr int PageSize = 50;
+
+    ChatMessageModel model;
+    quint32 rng = 0xBEEF02u;
+
+    // Свежий хвост чата, как при открытии диалога
+    qint64 oldestId = 1000000;
+    model.addMessages(makePage(oldestId, PageSize, rng));
+
+    QVector<double> pageUs;
+    pageUs.reserve(pages);
+    QElapsedTimer timer;
+
+    for (int p = 0; p < pages; ++p) {
+        oldestId -= PageSize;
+        const QList<ChatMessage> page = makePage(oldestId, PageSize, rng);
+        timer.start();
+        model.prependMessages(page);
+        pageUs.append(double(timer.nsecsElapsed()) / 1e3);
+    }
+
+    qInfo().noquote() << QString("[BENCH] prepend: %1 pages x %2 msgs, page us  "
+                                 "p50: %3  p95: %4  p99: %5")
+                             .arg(pages)
+                             .arg(PageSize)
+                             .arg(percentile(pageUs, 50), 0, 'f', 0)
+                             .arg(percentile(pageUs, 95), 0, 'f', 0)
+                             .arg(percentile(pageUs, 99), 0, 'f', 0);
+}
+
+/** @brief Один проход прокрутки с отрисовкой каждого кадра в QImage. */
+QVector<double> scrollPass(SmoothListView& view, QImage& frame, bool downward)
+{
+    QScrollBar* sb = view.verticalScrollBar();
+    QVector<double> frameMs;
+    QElapsedTimer timer;
+
+    int value = downward ? sb->minimum() : sb->maximum();
+    const int step = downward ? ScrollStepPx : -ScrollStepPx;
+    while (downward ? value < sb->maximum() : value > sb->minimum()) {
+        timer.start();
+        sb->setValue(value);
+        // Фоновая верстка и сигналы перерисовки доезжают между кадрами,
+        // как в живом событийном цикле
+        QCoreApplication::processEvents();
+        {
+            QPainter painter(&frame);
+            view.viewport()->render(&painter);
+        }
+        frameMs.append(double(timer.nsecsElapsed()) / 1e6);
+        value += step;
+    }
+    return frameMs;
+}
+
+/**
+ * @brief Сценарий scroll: покадровая прокрутка окна истории.
+ *
+ * Холодный проход верстает и кэширует по пути (худший случай первого
+ * пролистывания), прогретый — чистый blit из кэшей. Разрыв между ними
+ * и есть цена промаха; хит-рейты кэшей делегата печатаются из
+ * PerfMetrics.
+ */
+void runScroll()
+{
+    ChatMessageModel model;
+    quint32 rng = 0xBEEF03u;
+    // Полное окно модели — как чат после глубокой прокрутки
+    model.addMessages(makePage(1, 600, rng));
+
+    SmoothListView view;
+    auto* delegate = new ChatMessageDelegate(&model, &view);
+    view.setItemDelegate(delegate);
+    view.setModel(&model);
+    view.setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    view.resize(ViewportWidth, ViewportHeight);
+    view.show();
+    QCoreApplication::processEvents();
+
+    QImage frame(ViewportWidth, ViewportHeight, QImage::Format_ARGB32_Premultiplied);
+
+    const PerfMetrics::Snapshot before = PerfMetrics::snapshot();
+    const QVector<double> cold = scrollPass(view, frame, false);
+    const QVector<double> warm = scrollPass(view, frame, true);
+    const PerfMetrics::Snapshot after = PerfMetrics::snapshot();
+
+    const auto report = [](const char* name, const QVector<double>& frames) {
+        qInfo().noquote() << QString("[BENCH] scroll %1: %2 frames, ms  "
+                                     "p50: %3  p95: %4  p99: %5")
+                                 .arg(QString::fromLatin1(name), -4)
+                                 .arg(frames.size())
+                                 .arg(percentile(frames, 50), 0, 'f', 2)
+                                 .arg(percentile(frames, 95), 0, 'f', 2)
+                                 .arg(percentile(frames, 99), 0, 'f', 2);
+    };
+    report("cold", cold);
+    report("warm", warm);
+
+    const quint64 docTotal = (after.docHits - before.docHits)
+                           + (after.docMisses - before.docMisses);
+    const quint64 bubbleTotal = (after.bubbleHits - before.bubbleHits)
+                              + (after.bubbleMisses - before.bubbleMisses);
+    qInfo().noquote() << QString("[BENCH] scroll caches: doc hit %1% (%2), "
+                                 "bubble hit %3% (%4), paints %5")
+                             .arg(docTotal ? 100.0 * double(after.docHits - before.docHits)
+                                                 / double(docTotal) : 0.0, 0, 'f', 1)
+                             .arg(docTotal)
+                             .arg(bubbleTotal ? 100.0 * double(after.bubbleHits - before.bubbleHits)
+                                                    / double(bubbleTotal) : 0.0, 0, 'f', 1)
+                             .arg(bubbleTotal)
+                             .arg(after.paintCount - before.paintCount);
+}
+
+/**
+ * @brief Сценарий churn: оборот списка контактов под штормом сообщений.
+ *
+ * Каждое событие — новое "последнее сообщение" случайного чата: правка
+ * метаданных в DataService, пересортировка строки точечным move и
+ * перерисовка; кадр списка рендерится раз на 16 событий, как при
+ * реальном шторме между vsync.
+ */
+void runContactChurn(int contacts, int churnEvents)
+{
+    DataService data(QStringLiteral("client_bench.db"), nullptr);
+    ContactListModel model(&data);
+    QObject::connect(&data, &DataService::chatMetadataChanged,
+                     &model, &ContactListModel::onChatMetadataChanged);
+
+    quint32 rng = 0xBEEF04u;
+    for (int i = 0; i < contacts; ++i) {
+        User user;
+        user.id = i + 1;
+        user.username = QStringLiteral("bench_user_%1").arg(i);
+        user.displayName = QStringLiteral("Контакт %1").arg(i);
+        user.isOnline = (nextRandom(rng) % 4) == 0;
+        data.updateOrAddUser(std::move(user));
+
+        Chat chat(QStringLiteral("bench_user_%1").arg(i));
+        chat.lastMessagePayload = QStringLiteral("Начальное сообщение");
+        chat.lastMessageTimestamp = 1700000000000ll + i;
+        chat.isPinned = (i % 97) == 0;
+        data.updateOrAddChatMetadata(std::move(chat));
+    }
+    model.updateContacts(data.getSortedChatList());
+    QCoreApplication::processEvents();
+
+    QListView view;
+    view.setItemDelegate(new ContactListDelegate(data.getAvatarCache(), &view));
+    view.setModel(&model);
+    view.resize(ViewportWidth, ViewportHeight);
+    view.show();
+    QCoreApplication::processEvents();
+    QImage frame(ViewportWidth, ViewportHeight, QImage::Format_ARGB32_Premultiplied);
+
+    QVector<double> eventUs;
+    eventUs.reserve(churnEvents);
+    QElapsedTimer timer;
+    QElapsedTimer wall;
+    wall.start();
+
+    for (int e = 0; e < churnEvents; ++e) {
+        const int target = int(nextRandom(rng) % quint32(contacts));
+        ChatMessage msg = makeMessage(2000000 + e, rng);
+        msg.timestamp = 1710000000000ll + e;
+
+        timer.start();
+        data.updateLastMessage(QStringLiteral("bench_user_%1").arg(target), msg);
+        if ((nextRandom(rng) % 3) == 0) {
+            data.incrementUnreadCount(QStringLiteral("bench_user_%1").arg(target));
+        }
+        eventUs.append(double(timer.nsecsElapsed()) / 1e3);
+
+        if ((e & 15) == 0) {
+            QCoreApplication::processEvents();
+            QPainter painter(&frame);
+            view.viewport()->render(&painter);
+        }
+    }
+
+    const double seconds = double(wall.nsecsElapsed()) / 1e9;
+    qInfo().noquote() << QString("[BENCH] churn: %1 contacts, %2 events in %3 s "
+                                 "(%4 ev/s), event us  p50: %5  p95: %6  p99: %7")
+                             .arg(contacts)
+                             .arg(churnEvents)
+                             .arg(seconds, 0, 'f', 2)
+                             .arg(double(churnEvents) / seconds, 0, 'f', 0)
+                             .arg(percentile(eventUs, 50), 0, 'f', 0)
+                             .arg(percentile(eventUs, 95), 0, 'f', 0)
+                             .arg(percentile(eventUs, 99), 0, 'f', 0);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Рендер без дисплея: та же отрисовка, но в offscreen-поверхность
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("client_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Офлайн-бенчмарк стека отрисовки клиента");
+    parser.addHelpOption();
+    parser.addOption({"messages", "Сообщений в сценарии ingest", "n", "100000"});
+    parser.addOption({"pages", "Страниц пагинации в сценарии prepend", "n", "200"});
+    parser.addOption({"contacts", "Контактов в сценарии churn", "n", "2000"});
+    parser.addOption({"churn", "Событий в сценарии churn", "n", "5000"});
+    parser.process(app);
+
+    runIngest(parser.value("messages").toInt());
+    runPrepend(parser.value("pages").toInt());
+    runScroll();
+    runContactChurn(parser.value("contacts").toInt(),
+                    parser.value("churn").toInt());
+
+    PerfMetrics::dump();
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "accountmanager.h"
+#include "dataservice.h"
+#include "networkservice.h"
+#include "avatarcache.h"
+
+#include <QDebug>
+
+AccountManager::AccountManager(QObject *parent)
+    : QObject(parent)
+{
+    // Общие ресурсы процесса создаются один раз и переживают любые
+    // переключения: кеш миниатюр со своим потоком масштабирования
+    // и поток декодеров входящего трафика всех соединений
+    m_avatarCache = new AvatarCache(this);
+
+    m_decoderThread.setObjectName(QStringLiteral("client-net-decode"));
+    m_decoderThread.start();
+}
+
+AccountManager::~AccountManager()
+{
+    // Аккаунты закрываются явно до остановки общего потока: деструкторы
+    // NetworkService ставят деструкции декодеров в его очередь событий
+    const QStringList ids = m_accounts.keys();
+    for (const QString& id : ids) {
+        removeAccount(id);
+    }
+
+    m_decoderThread.quit();
+    m_decoderThread.wait();
+}
+
+AccountManager::Account* AccountManager::addAccount(const QString& accountId)
+{
+    auto it = m_accounts.find(accountId);
+    if (it != m_accounts.end()) {
+        return &it.value();
+    }
+
+    Account acc;
+    acc.id = accountId;
+
+    // Свой файл базы на аккаунт: истории и контакты не смешиваются,
+    // соединение Qt SQL именуется по файлу и не конфликтует с соседями
+    acc.dataService = new DataService(
+        QStringLiteral("database_%1.db").arg(accountId), m_avatarCache, this);
+
+    // Соединение свое, декодер — в общем потоке процесса
+    acc.networkService = new NetworkService(&m_decoderThread, this);
+
+    // Криптографические ключи аккаунта — в его сервис данных
+    acc.dataService->updateOrAddCurrentUserCrypto(
+        acc.networkService->getCurrentUserCrypto());
+
+    it = m_accounts.insert(accountId, acc);
+
+    // Первый аккаунт сразу активен — без отдельного вызова переключения
+    if (m_activeId.isEmpty()) {
+        m_activeId = accountId;
+    }
+
+    qInfo() << "[AccountManager] Account added:" << accountId
+            << "(" << m_accounts.size() << "total )";
+    emit accountAdded(accountId);
+    return &it.value();
+}
+
+AccountManager::Account* AccountManager::account(const QString& accountId)
+{
+    auto it = m_accounts.find(accountId);
+    return it != m_accounts.end() ? &it.value() : nullptr;
+}
+
+void AccountManager::removeAccount(const QString& accountId)
+{
+    auto it = m_accounts.find(accountId);
+    if (it == m_accounts.end()) {
+        return;
+    }
+
+    // Дожимаем грязное состояние аккаунта в его базу и останавливаем
+    // поток фасада; сетевой сервис рвет соединение в своем деструкторе
+    it.value().dataService->shutdown();
+    delete it.value().networkService;
+    delete it.value().dataService;
+    m_accounts.erase(it);
+
+    if (m_activeId == accountId) {
+        m_activeId = m_accounts.isEmpty() ? QString() : m_accounts.firstKey();
+    }
+
+    qInfo() << "[AccountManager] Account removed:" << accountId;
+    emit accountRemoved(accountId);
+}
+
+bool AccountManager::setActiveAccount(const QString& accountId)
+{
+    if (!m_accounts.contains(accountId)) {
+        qWarning() << "[AccountManager] Unknown account:" << accountId;
+        return false;
+    }
+    if (m_activeId == accountId) {
+        return true;
+    }
+
+    m_activeId = accountId;
+
+    // Остальные аккаунты уходят в фон: страницы историй и кеши файлов
+    // им не нужны до следующего переключения, бейджи остаются живыми
+    for (auto it = m_accounts.begin(); it != m_accounts.end(); ++it) {
+        if (it.key() != accountId) {
+            it.value().dataService->compactForBackground();
+        }
+    }
+
+    qInfo() << "[AccountManager] Active account:" << accountId;
+    emit activeAccountChanged(accountId);
+    return true;
+}
+
+DataService* AccountManager::activeDataService() const
+{
+    auto it = m_accounts.constFind(m_activeId);
+    return it != m_accounts.constEnd() ? it.value().dataService : nullptr;
+}
+
+NetworkService* AccountManager::activeNetworkService() const
+{
+    auto it = m_accounts.constFind(m_activeId);
+    return it != m_accounts.constEnd() ? it.value().networkService : nullptr;
+}
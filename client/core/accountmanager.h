@@ -0,0 +1,122 @@
+#ifndef ACCOUNTMANAGER_H
+#define ACCOUNTMANAGER_H
+
+#include <QObject>
+#include <QMap>
+#include <QThread>
+#include <QString>
+#include <QStringList>
+
+class DataService;
+class NetworkService;
+class AvatarCache;
+
+/**
+ * @brief Менеджер аккаунтов: несколько учетных записей в одном процессе.
+ *
+ * Раньше три аккаунта означали три процесса клиента — тройная память,
+ * тройные пулы потоков, тройной кеш аватаров. Менеджер держит по связке
+ * сервисов на аккаунт (DataService со своим файлом базы + NetworkService
+ * со своим соединением), а тяжелые ресурсы процесса делает общими:
+ *
+ *  - кеш миниатюр аватаров и его поток масштабирования — один на всех
+ *    (аватары контактов у аккаунтов одной команды во многом пересекаются);
+ *  - поток декодеров входящего трафика — один на все соединения
+ *    (расшифровка — редкие короткие всплески, потоку хватает запаса).
+ *
+ * Активен в каждый момент один аккаунт; при переключении кеши остальных
+ * ужимаются (DataService::compactForBackground) — фоновые аккаунты
+ * продолжают принимать входящие события и держать бейджи, но не держат
+ * в памяти страницы историй чатов. Три аккаунта стоят примерно треть
+ * сверх одного, а не втрое.
+ *
+ * База каждого аккаунта — отдельный файл database_<id>.db рядом с
+ * исполняемым; соединения Qt SQL именуются по файлу и не конфликтуют.
+ */
+class AccountManager : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Связка сервисов одного аккаунта. */
+    struct Account {
+        QString id;                              ///< Идентификатор (имя пользователя)
+        DataService* dataService = nullptr;      ///< Данные и кеши аккаунта
+        NetworkService* networkService = nullptr; ///< Соединение аккаунта
+    };
+
+    /**
+     * @brief Конструктор. Создает общие ресурсы процесса.
+     * @param parent Родительский объект.
+     */
+    explicit AccountManager(QObject *parent = nullptr);
+
+    /** @brief Деструктор: закрывает все аккаунты и общий поток декодеров. */
+    ~AccountManager() override;
+
+    /**
+     * @brief Добавляет аккаунт и создает его связку сервисов.
+     *
+     * Первый добавленный аккаунт становится активным. Повторный вызов с
+     * тем же идентификатором возвращает существующую связку.
+     *
+     * @param accountId Идентификатор аккаунта (имя пользователя)
+     * @return Связка сервисов аккаунта
+     */
+    Account* addAccount(const QString& accountId);
+
+    /**
+     * @brief Возвращает связку сервисов аккаунта.
+     * @param accountId Идентификатор аккаунта
+     * @return Связка или nullptr, если аккаунт не добавлен
+     */
+    Account* account(const QString& accountId);
+
+    /**
+     * @brief Закрывает аккаунт: дожимает его БД и удаляет сервисы.
+     * @param accountId Идентификатор аккаунта
+     */
+    void removeAccount(const QString& accountId);
+
+    /**
+     * @brief Переключает активный аккаунт.
+     *
+     * Кеши всех остальных аккаунтов ужимаются до фонового минимума.
+     *
+     * @param accountId Идентификатор аккаунта
+     * @return false, если такой аккаунт не добавлен
+     */
+    bool setActiveAccount(const QString& accountId);
+
+    /** @brief Идентификатор активного аккаунта (пустой — аккаунтов нет). */
+    QString activeAccountId() const { return m_activeId; }
+
+    /** @brief Сервис данных активного аккаунта (nullptr — аккаунтов нет). */
+    DataService* activeDataService() const;
+
+    /** @brief Сетевой сервис активного аккаунта (nullptr — аккаунтов нет). */
+    NetworkService* activeNetworkService() const;
+
+    /** @brief Общий кеш аватаров процесса. */
+    AvatarCache* sharedAvatarCache() const { return m_avatarCache; }
+
+    /** @brief Идентификаторы всех добавленных аккаунтов. */
+    QStringList accountIds() const { return m_accounts.keys(); }
+
+signals:
+    /** @brief Активный аккаунт сменился; UI перепривязывает сервисы. */
+    void activeAccountChanged(const QString& accountId);
+
+    /** @brief Аккаунт добавлен и его сервисы созданы. */
+    void accountAdded(const QString& accountId);
+
+    /** @brief Аккаунт закрыт, его сервисы удалены. */
+    void accountRemoved(const QString& accountId);
+
+private:
+    AvatarCache* m_avatarCache = nullptr; ///< Общий кеш миниатюр аватаров
+    QThread m_decoderThread;              ///< Общий поток декодеров трафика
+    QMap<QString, Account> m_accounts;    ///< Связки сервисов по аккаунтам
+    QString m_activeId;                   ///< Идентификатор активного аккаунта
+};
+
+#endif // ACCOUNTMANAGER_H
@@ -0,0 +1,105 @@
+#include "asyncapi.h"
+#include <QTimer>
+#include <QDebug>
+
+AsyncApi::AsyncApi(QObject *parent)
+    : QObject(parent)
+{
+}
+
+bool AsyncApi::deliver(const QString &type, const QJsonObject &response)
+{
+    auto it = m_pending.find(type);
+    if (it == m_pending.end() || it->isEmpty()) {
+        return false;
+    }
+
+    // FIFO по типу: ответы одного типа приходят в порядке запросов
+    // (упорядоченный TCP-поток, однопоточный разбор на обеих сторонах)
+    RequestAwaiter *awaiter = it->takeFirst();
+    if (it->isEmpty()) {
+        m_pending.erase(it);
+    }
+    awaiter->m_registered = false;
+    awaiter->resolve(response);
+    return true;
+}
+
+void AsyncApi::unregister(RequestAwaiter *awaiter)
+{
+    auto it = m_pending.find(awaiter->m_responseType);
+    if (it == m_pending.end()) {
+        return;
+    }
+    it->removeOne(awaiter);
+    if (it->isEmpty()) {
+        m_pending.erase(it);
+    }
+}
+
+bool AsyncApi::isRegistered(const RequestAwaiter *awaiter) const
+{
+    auto it = m_pending.constFind(awaiter->m_responseType);
+    return it != m_pending.constEnd()
+           && it->contains(const_cast<RequestAwaiter*>(awaiter));
+}
+
+void AsyncApi::onTimeout(RequestAwaiter *awaiter)
+{
+    // Ожидание могло разрешиться (или кадр корутины — умереть) раньше
+    // срабатывания таймера: трогаем awaiter только пока он стоит в очереди
+    if (!isRegistered(awaiter)) {
+        return;
+    }
+    unregister(awaiter);
+    awaiter->m_registered = false;
+
+    qWarning() << "[AsyncApi] Request timed out waiting for"
+               << awaiter->m_responseType;
+    awaiter->resolve({{QStringLiteral("type"), awaiter->m_responseType},
+                      {QStringLiteral("timeout"), true}});
+}
+
+AsyncApi::RequestAwaiter::RequestAwaiter(AsyncApi *api, QJsonObject request,
+                                         QString responseType, int timeoutMs)
+    : m_api(api)
+    , m_request(std::move(request))
+    , m_responseType(std::move(responseType))
+    , m_timeoutMs(timeoutMs)
+{
+}
+
+AsyncApi::RequestAwaiter::~RequestAwaiter()
+{
+    // Кадр корутины уничтожен до ответа — снимаем регистрацию, чтобы
+    // доставка или тайм-аут не резюмировали мертвый кадр
+    if (m_registered) {
+        m_api->unregister(this);
+    }
+}
+
+void AsyncApi::RequestAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    m_handle = handle;
+    m_api->m_pending[m_responseType].append(this);
+    m_registered = true;
+
+    emit m_api->sendJson(m_request);
+
+    // Таймер переживает awaiter: по срабатыванию фасад сперва проверяет,
+    // что ожидание еще стоит в очереди
+    AsyncApi *api = m_api;
+    RequestAwaiter *self = this;
+    QTimer::singleShot(m_timeoutMs, api, [api, self] { api->onTimeout(self); });
+}
+
+QJsonObject AsyncApi::RequestAwaiter::await_resume()
+{
+    return std::move(m_response);
+}
+
+void AsyncApi::RequestAwaiter::resolve(const QJsonObject &response)
+{
+    m_response = response;
+    m_handle.resume();
+}
@@ -0,0 +1,276 @@
+#ifndef ASYNCAPI_H
+#define ASYNCAPI_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <coroutine>
+#include <utility>
+
+/**
+ * @brief Корутинные примитивы асинхронных потоков клиента (C++20).
+ *
+ * Запрос-ответные сценарии поверх NetworkService исторически писались
+ * цепочками обработчиков из таблицы m_responseHandlers с неявным порядком
+ * шагов. Task и AsyncApi::request() позволяют записывать тот же сценарий
+ * линейно: `ответ = co_await api->request(запрос, "тип_ответа")`.
+ *
+ * Task жадный: тело стартует сразу при вызове корутины и доезжает до
+ * первого co_await. Поэтому параллелизм независимых запросов получается
+ * без комбинаторов — достаточно создать несколько Task подряд (все
+ * запросы уже в полете) и co_await'ить их по очереди:
+ *
+ * @code
+ * auto contacts = fetchContacts();   // запрос ушел
+ * auto unread   = fetchUnread();     // и этот ушел — параллельно
+ * useContacts(co_await contacts);
+ * useUnread(co_await unread);
+ * @endcode
+ *
+ * Брошенный вызывающим незавершенный Task не отменяется, а доживает в
+ * фоне и сам освобождает кадр (семантика fire-and-forget для корневых
+ * сценариев). Уничтожение кадра самой корутины (деструкторы локалов)
+ * снимает регистрацию ожидания в AsyncApi — висячих резюме не остается.
+ */
+namespace Async {
+
+template <typename T>
+class [[nodiscard]] Task
+{
+public:
+    struct promise_type {
+        T result{};                             ///< Значение co_return
+        std::coroutine_handle<> continuation;   ///< Кого резюмировать по завершении
+        bool detached = false;                  ///< Task брошен — кадр удаляет себя сам
+
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        // Жадный старт: тело бежит до первого co_await еще в вызове
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> h) noexcept
+            {
+                if (h.promise().continuation)
+                    return h.promise().continuation;
+                if (h.promise().detached)
+                    h.destroy();
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T value) { result = std::move(value); }
+        // Кодовая база живет без исключений — утечка исключения из
+        // корутины означает ошибку программирования
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (!m_handle)
+            return;
+        if (m_handle.done())
+            m_handle.destroy();
+        else
+            m_handle.promise().detached = true; // доживет и удалит кадр сам
+    }
+
+    bool await_ready() const noexcept { return m_handle.done(); }
+    void await_suspend(std::coroutine_handle<> continuation) noexcept
+    {
+        m_handle.promise().continuation = continuation;
+    }
+    T await_resume() { return std::move(m_handle.promise().result); }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+/** @brief Task без значения (корневые сценарии; бросить результат — норма). */
+template <>
+class Task<void>
+{
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+        bool detached = false;
+
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> h) noexcept
+            {
+                if (h.promise().continuation)
+                    return h.promise().continuation;
+                if (h.promise().detached)
+                    h.destroy();
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (!m_handle)
+            return;
+        if (m_handle.done())
+            m_handle.destroy();
+        else
+            m_handle.promise().detached = true;
+    }
+
+    bool await_ready() const noexcept { return m_handle.done(); }
+    void await_suspend(std::coroutine_handle<> continuation) noexcept
+    {
+        m_handle.promise().continuation = continuation;
+    }
+    void await_resume() {}
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+} // namespace Async
+
+/**
+ * @brief Awaitable-фасад над запрос-ответным протоколом сервера.
+ *
+ * Корреляция идет по типу ожидаемого ответа в порядке FIFO: проводной
+ * протокол не эхо-копирует идентификаторы запросов (ответы диспетчеризуются
+ * по полю "type"), а TCP-поток и однопоточный разбор гарантируют, что
+ * ответы одного типа приходят в порядке запросов. Ответ, на который есть
+ * ожидающая корутина, поглощается фасадом и до таблицы статических
+ * обработчиков DataService не доходит; пуш-события без ожидающих идут
+ * обычным путем.
+ *
+ * Каждое ожидание ограничено тайм-аутом: по его истечении корутина
+ * резюмируется ответом-маркером (см. timedOut()), чтобы сценарий не
+ * зависал навсегда на потерянном сервером ответе.
+ */
+class AsyncApi : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Тайм-аут ожидания ответа по умолчанию, мс. */
+    static constexpr int DefaultTimeoutMs = 15000;
+
+    /**
+     * @brief Конструктор фасада.
+     * @param parent Родительский объект (обычно DataService).
+     */
+    explicit AsyncApi(QObject *parent = nullptr);
+
+    /**
+     * @brief Awaitable одного запроса: отправка + ожидание типизированного ответа.
+     *
+     * Запрос уходит в момент приостановки корутины (co_await); регистрация
+     * ожидания снимается деструктором — уничтожение кадра корутины
+     * автоматически отменяет ожидание.
+     */
+    class RequestAwaiter
+    {
+    public:
+        RequestAwaiter(AsyncApi *api, QJsonObject request,
+                       QString responseType, int timeoutMs);
+        ~RequestAwaiter();
+        RequestAwaiter(const RequestAwaiter&) = delete;
+        RequestAwaiter& operator=(const RequestAwaiter&) = delete;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        QJsonObject await_resume();
+
+    private:
+        friend class AsyncApi;
+
+        /** @brief Ответ пришел: сохраняет его и резюмирует корутину. */
+        void resolve(const QJsonObject &response);
+
+        AsyncApi *m_api;                  ///< Фасад-владелец регистрации
+        QJsonObject m_request;            ///< Запрос к отправке
+        QString m_responseType;           ///< Ожидаемое значение поля "type"
+        int m_timeoutMs;                  ///< Потолок ожидания, мс
+        std::coroutine_handle<> m_handle; ///< Приостановленная корутина
+        QJsonObject m_response;           ///< Пришедший ответ (или маркер тайм-аута)
+        bool m_registered = false;        ///< Ожидание стоит в m_pending
+    };
+
+    /**
+     * @brief Создает awaitable: `co_await api->request(req, "тип_ответа")`.
+     * @param request Запрос к серверу (поле "type" уже заполнено).
+     * @param responseType Значение "type" ответа, которым завершится ожидание.
+     * @param timeoutMs Потолок ожидания, мс.
+     */
+    RequestAwaiter request(const QJsonObject &request, const QString &responseType,
+                           int timeoutMs = DefaultTimeoutMs)
+    {
+        return RequestAwaiter(this, request, responseType, timeoutMs);
+    }
+
+    /**
+     * @brief Пробует отдать входящий ответ ожидающей корутине.
+     *
+     * Вызывается из диспетчера DataService до таблицы статических
+     * обработчиков.
+     * @param type Значение поля "type" ответа.
+     * @param response Сам ответ.
+     * @return true — ответ поглощен корутиной, статический обработчик не нужен.
+     */
+    bool deliver(const QString &type, const QJsonObject &response);
+
+    /**
+     * @brief Ответ является маркером тайм-аута (сервер не ответил вовремя).
+     * @param response Результат await_resume.
+     */
+    static bool timedOut(const QJsonObject &response)
+    {
+        return response.value(QStringLiteral("timeout")).toBool();
+    }
+
+signals:
+    /** @brief Исходящий запрос (прокидывается в NetworkService). */
+    void sendJson(const QJsonObject &request);
+
+private:
+    /** @brief Снимает регистрацию ожидания (отмена или доставка). */
+    void unregister(RequestAwaiter *awaiter);
+
+    /** @brief Тайм-аут ожидания: резюмирует корутину ответом-маркером. */
+    void onTimeout(RequestAwaiter *awaiter);
+
+    /** @brief Ожидание еще зарегистрировано (страховка для тайм-аута). */
+    bool isRegistered(const RequestAwaiter *awaiter) const;
+
+    QHash<QString, QList<RequestAwaiter*>> m_pending; ///< Очереди ожиданий по типу ответа
+};
+
+#endif // ASYNCAPI_H
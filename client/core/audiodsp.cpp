@@ -0,0 +1,158 @@
+#include "audiodsp.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+//См. "audiodsp.h"
+
+void AudioDsp::configure(int captureRate, int playbackRate, int frameSamples)
+{
+    m_frameSamples = frameSamples;
+
+    // NLMS вычитает опору посэмплно — частоты захвата и воспроизведения
+    // должны совпадать. На разнородных устройствах остаемся без AEC.
+    m_aecEnabled = (captureRate == playbackRate);
+    if (!m_aecEnabled) {
+        qDebug() << "[DSP] AEC отключен: частоты захвата/воспроизведения"
+                 << captureRate << "/" << playbackRate << "не совпадают";
+    }
+
+    // Хвост фильтра — один 20-мс кадр эхо-тракта
+    m_taps = frameSamples;
+
+    m_refHist.assign(size_t(m_taps) * 2, 0.0f);
+    m_weights.assign(size_t(m_taps), 0.0f);
+    m_histPos = 0;
+    m_refPower = 0.0f;
+
+    // FIFO на 4 кадра: переживает неравномерность тактов воспроизведения
+    m_refFifo.assign(size_t(frameSamples) * 4, 0.0f);
+    m_fifoRead = 0;
+    m_fifoWrite = 0;
+    m_fifoCount = 0;
+
+    m_noiseFloor = 0.0f;
+    m_gateGain = 1.0f;
+}
+
+void AudioDsp::pushPlayoutFrame(const short* pcm, int samples)
+{
+    if (!m_aecEnabled || m_refFifo.empty()) {
+        return;
+    }
+
+    const int fifoSize = int(m_refFifo.size());
+    for (int i = 0; i < samples; ++i) {
+        // Переполнение: захват отстал, старая опора уже бесполезна —
+        // затираем по кольцу, читающая сторона сама догонит
+        if (m_fifoCount == fifoSize) {
+            m_fifoRead = (m_fifoRead + 1) % fifoSize;
+            --m_fifoCount;
+        }
+        m_refFifo[size_t(m_fifoWrite)] = float(pcm[i]);
+        m_fifoWrite = (m_fifoWrite + 1) % fifoSize;
+        ++m_fifoCount;
+    }
+}
+
+void AudioDsp::processCaptureFrame(short* pcm, int samples)
+{
+    if (m_frameSamples == 0) {
+        return;
+    }
+
+    // ── 1. Эхоподавление (NLMS) ────────────────────────────────────────
+    if (m_aecEnabled) {
+        const int fifoSize = int(m_refFifo.size());
+        for (int i = 0; i < samples; ++i) {
+            // Следующий опорный сэмпл; при недоборе (sink еще молчит)
+            // опора нулевая — фильтр просто не адаптируется
+            float ref = 0.0f;
+            if (m_fifoCount > 0) {
+                ref = m_refFifo[size_t(m_fifoRead)];
+                m_fifoRead = (m_fifoRead + 1) % fifoSize;
+                --m_fifoCount;
+            }
+
+            // Двойная запись: окно последних taps сэмплов непрерывно
+            // начинается с m_histPos + 1. Вытесняемый сэмпл уходит и из
+            // скользящей энергии окна.
+            const float evicted = m_refHist[size_t(m_histPos)];
+            m_refPower += ref * ref - evicted * evicted;
+            if (m_refPower < 0.0f)
+                m_refPower = 0.0f;
+            m_refHist[size_t(m_histPos)] = ref;
+            m_refHist[size_t(m_histPos) + size_t(m_taps)] = ref;
+            m_histPos = (m_histPos + 1) % m_taps;
+
+            const float* window = m_refHist.data() + m_histPos;
+
+            // Предсказание эха: свертка окна опоры с весами
+            float echo = 0.0f;
+            for (int k = 0; k < m_taps; ++k) {
+                echo += m_weights[size_t(k)] * window[k];
+            }
+
+            const float mic = float(pcm[i]);
+            const float err = mic - echo;
+
+            // Нормированный шаг: адаптация не зависит от громкости опоры
+            const float mu = NlmsStep * err / (m_refPower + NlmsEps);
+            for (int k = 0; k < m_taps; ++k) {
+                m_weights[size_t(k)] += mu * window[k];
+            }
+
+            pcm[i] = short(qBound(-32768.0f, err, 32767.0f));
+        }
+    }
+
+    // ── 2. Шумоподавление (энергетический гейт) ───────────────────────
+    // Средняя мощность кадра после вычитания эха
+    float power = 0.0f;
+    for (int i = 0; i < samples; ++i) {
+        const float s = float(pcm[i]);
+        power += s * s;
+    }
+    power /= float(samples);
+
+    // Min-tracking: пол мгновенно падает до тихого кадра и медленно
+    // всплывает — так он следит за фоном, не цепляясь за речь
+    if (m_noiseFloor <= 0.0f || power < m_noiseFloor) {
+        m_noiseFloor = power;
+    } else {
+        m_noiseFloor *= FloorRise;
+    }
+
+    // Кадр едва громче пола — фон без речи, приглушаем (не в ноль:
+    // полная тишина в паузах звучит как обрыв связи)
+    const float target =
+        (power < m_noiseFloor * 4.0f) ? GateFloorGain : 1.0f;
+    const float prevGain = m_gateGain;
+    m_gateGain = GateSmooth * m_gateGain + (1.0f - GateSmooth) * target;
+
+    if (prevGain >= 0.999f && m_gateGain >= 0.999f) {
+        return; // Гейт открыт, кадр не трогаем
+    }
+
+    // Линейная интерполяция усиления по кадру — без щелчков на границах
+    const float step = (m_gateGain - prevGain) / float(samples);
+    float gain = prevGain;
+    for (int i = 0; i < samples; ++i) {
+        gain += step;
+        pcm[i] = short(float(pcm[i]) * gain);
+    }
+}
+
+void AudioDsp::reset()
+{
+    std::fill(m_refHist.begin(), m_refHist.end(), 0.0f);
+    std::fill(m_weights.begin(), m_weights.end(), 0.0f);
+    m_histPos = 0;
+    m_refPower = 0.0f;
+    m_fifoRead = 0;
+    m_fifoWrite = 0;
+    m_fifoCount = 0;
+    m_noiseFloor = 0.0f;
+    m_gateGain = 1.0f;
+}
@@ -0,0 +1,108 @@
+#ifndef AUDIODSP_H
+#define AUDIODSP_H
+
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * @brief DSP-ступень захвата: эхоподавление (AEC) и шумоподавление.
+ *
+ * Сидит между микрофоном и opus_encode на аудиопотоке. Без нее звук
+ * динамиков прилетает в микрофон и возвращается собеседнику эхом —
+ * звонить без гарнитуры было невозможно.
+ *
+ * Эхоподавление — адаптивный NLMS-фильтр во временной области:
+ * опорный сигнал (то, что ушло в динамики) пишется из тракта
+ * воспроизведения в кольцо истории, фильтр оценивает эхо-тракт
+ * "динамик → комната → микрофон" и вычитает предсказанное эхо из
+ * захвата. Хвост фильтра — один 20-мс кадр: покрывает прямой
+ * акустический путь и буферизацию устройств на типичном ноутбуке.
+ *
+ * Шумоподавление — энергетический гейт с min-tracking оценкой шумового
+ * пола: кадры без речи плавно приглушаются, вентиляторы и гул не
+ * уходят в эфир (и не мешают DTX энкодера распознавать паузы).
+ *
+ * Бюджет: NLMS стоит ~2 умножения на тап на сэмпл; при хвосте в кадр
+ * на 48 кГц это ~90 МФлопс — порядка процента одного ядра. Циклы
+ * написаны по непрерывным массивам float, компилятор их векторизует.
+ *
+ * Класс не потокобезопасен: все вызовы — с аудиопотока звонка.
+ */
+class AudioDsp
+{
+public:
+    /**
+     * @brief Настройка под параметры звонка (сбрасывает состояние).
+     *
+     * AEC требует, чтобы опора и захват шли на одной частоте; если
+     * устройства работают на разных (48к динамики, 16к микрофон),
+     * эхоподавление отключается и остается только шумоподавление.
+     *
+     * @param captureRate Частота захвата, Гц
+     * @param playbackRate Частота воспроизведения, Гц
+     * @param frameSamples Сэмплов в 20-мс кадре захвата
+     */
+    void configure(int captureRate, int playbackRate, int frameSamples);
+
+    /**
+     * @brief Опорный сигнал: кадр, ушедший в динамики.
+     *
+     * Вызывается трактом воспроизведения на каждый записанный в sink
+     * кадр (включая кадры PLC — они тоже звучат из динамиков).
+     *
+     * @param pcm Декодированный PCM кадра
+     * @param samples Число сэмплов
+     */
+    void pushPlayoutFrame(const short* pcm, int samples);
+
+    /**
+     * @brief Обрабатывает кадр микрофона на месте: AEC, затем гейт.
+     * @param pcm Кадр захвата (модифицируется)
+     * @param samples Число сэмплов
+     */
+    void processCaptureFrame(short* pcm, int samples);
+
+    /** @brief Полный сброс (конец звонка). */
+    void reset();
+
+private:
+    /// Шаг адаптации NLMS: 0.5 — компромисс сходимости и устойчивости
+    static constexpr float NlmsStep = 0.5f;
+
+    /// Регуляризация нормировки: защита от деления на тишину в опоре
+    static constexpr float NlmsEps = 1e3f;
+
+    /// Скорость всплытия шумового пола (~3 дБ/с при 50 кадрах/с)
+    static constexpr float FloorRise = 1.015f;
+
+    /// Ослабление кадров без речи: ~-12 дБ, не полное отключение
+    static constexpr float GateFloorGain = 0.25f;
+
+    /// Сглаживание межкадрового изменения усиления гейта
+    static constexpr float GateSmooth = 0.85f;
+
+    bool m_aecEnabled = false;   ///< Частоты совпали, NLMS активен
+    int m_taps = 0;              ///< Длина эхо-хвоста фильтра, сэмплов
+    int m_frameSamples = 0;      ///< Сэмплов в кадре
+
+    // История опоры хранится с двойной записью (каждый сэмпл кладется в
+    // p и p+taps): окно последних taps сэмплов всегда непрерывно в
+    // памяти, и свертка с весами идет без модульной адресации
+    std::vector<float> m_refHist; ///< Кольцо опоры, 2*taps
+    int m_histPos = 0;            ///< Позиция последней записи [0, taps)
+    float m_refPower = 0.0f;      ///< Скользящая энергия окна опоры
+
+    std::vector<float> m_weights; ///< Веса NLMS (оценка эхо-тракта)
+
+    // Опора из тракта воспроизведения приходит своим темпом; FIFO
+    // выравнивает ее с кадрами захвата посэмплно
+    std::vector<float> m_refFifo; ///< Кольцевой FIFO опорных сэмплов
+    int m_fifoRead = 0;           ///< Курсор чтения FIFO
+    int m_fifoWrite = 0;          ///< Курсор записи FIFO
+    int m_fifoCount = 0;          ///< Сэмплов в FIFO
+
+    float m_noiseFloor = 0.0f;    ///< Оценка мощности шумового пола
+    float m_gateGain = 1.0f;      ///< Текущее усиление гейта (сглаженное)
+};
+
+#endif // AUDIODSP_H
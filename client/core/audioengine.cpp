@@ -0,0 +1,848 @@
+#include "audioengine.h"
+#include "threadcheck.h"
+#include "netsim.h"
+#include <QMediaDevices>
+#include <QAudioFormat>
+#include <QDataStream>
+#include <QtEndian>
+#include <QThread>
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#endif
+
+//См. "audioengine.h"
+
+namespace {
+const int CHANNELS = 1;
+const int FramesPerSecond = 50;  // 20-мс кадры
+}
+
+AudioEngine::AudioEngine(const QString& bindIp, QObject* parent)
+    : QObject(parent),
+      m_bindIp(bindIp)
+{
+}
+
+AudioEngine::~AudioEngine()
+{
+    stopStreaming();
+
+    if (m_udpSocket) {
+        m_udpSocket->close();
+        delete m_udpSocket;
+        m_udpSocket = nullptr;
+    }
+}
+
+void AudioEngine::initialize()
+{
+    // Выполняется на аудиопотоке по QThread::started: сокет и его
+    // readyRead обслуживаются тем же потоком, что декодирует и играет
+    m_udpSocket = new QUdpSocket(this);
+
+    bool ok = m_udpSocket->bind(QHostAddress(m_bindIp), 0,
+                                QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint);
+    if (!ok) {
+        qWarning() << "[UDP] ❌ Failed to bind UDP socket";
+        emit engineError("UDP binding failed");
+        return;
+    }
+
+    qDebug() << "[AudioEngine] [UDP] ✅ Socket bound to port:" << m_udpSocket->localPort()
+             << "on thread" << QThread::currentThread()->objectName();
+    // Контроль сборки кодека: какая именно библиотека слинкована
+    qDebug() << "[AudioEngine] Opus:" << opus_get_version_string();
+    connect(m_udpSocket, &QUdpSocket::readyRead, this, &AudioEngine::onAudioDataReceived);
+
+    // Точный такт воспроизведения: CoarseTimer гуляет на ±5%, для
+    // 20-мс аудиокадров нужен PreciseTimer
+    m_jitterTimer = new QTimer(this);
+    m_jitterTimer->setTimerType(Qt::PreciseTimer);
+    m_jitterTimer->setInterval(JitterBuffer::FramePeriodMs);
+    connect(m_jitterTimer, &QTimer::timeout, this, &AudioEngine::processJitterBuffer);
+
+    emit socketBound(m_udpSocket->localPort());
+}
+
+void AudioEngine::prewarmStreaming()
+{
+    if (m_streaming || m_mediaReady) {
+        return;
+    }
+
+    // Прогрев на время рингтона: раскрутка устройств (сотни миллисекунд)
+    // выполняется, пока пользователь решает, принимать ли звонок, —
+    // startStreaming после принятия застает тракт готовым
+    qDebug() << "[AudioEngine] [AUDIO] Pre-warming media path...";
+    if (openMediaPath()) {
+        qDebug() << "[AudioEngine] [AUDIO] ✅ Media path pre-warmed";
+    }
+}
+
+bool AudioEngine::openMediaPath()
+{
+    // Проверяем наличие аудио устройств
+    QList<QAudioDevice> inputs = QMediaDevices::audioInputs();
+    QList<QAudioDevice> outputs = QMediaDevices::audioOutputs();
+    if (inputs.isEmpty() || outputs.isEmpty()) {
+        qWarning() << "[AUDIO] ❌ No audio devices found";
+        emit engineError("No audio devices");
+        return false;
+    }
+
+    // Используем устройства по умолчанию
+    QAudioDevice defaultInputDevice = QMediaDevices::defaultAudioInput();
+    QAudioDevice defaultOutputDevice = QMediaDevices::defaultAudioOutput();
+
+    // Частоты подбираются независимо для захвата и воспроизведения:
+    // fullband 48 кГц там, где устройство его умеет, иначе 16 кГц.
+    // Битстрим Opus от частоты не зависит, ресемплинг внутри кодека
+    QAudioFormat captureFormat;
+    QAudioFormat playbackFormat;
+    m_captureRate = pickSupportedRate(defaultInputDevice, captureFormat);
+    m_playbackRate = pickSupportedRate(defaultOutputDevice, playbackFormat);
+    m_captureFrameSamples = m_captureRate / FramesPerSecond;
+    m_playbackFrameSamples = m_playbackRate / FramesPerSecond;
+    qDebug() << "[AudioEngine] [AUDIO] Rates: capture" << m_captureRate
+             << "playback" << m_playbackRate;
+
+    // DSP-ступень захвата: эхоподавление по опоре воспроизведения
+    // и шумовой гейт — до энкодера (см. audiodsp.h)
+    m_dsp.configure(m_captureRate, m_playbackRate, m_captureFrameSamples);
+
+    // Создаем кодеки Opus на выбранных частотах: энкодер на частоте
+    // захвата, декодер на частоте воспроизведения
+    int error;
+    m_opusEncoder = opus_encoder_create(m_captureRate, CHANNELS, OPUS_APPLICATION_VOIP, &error);
+    m_opusDecoder = opus_decoder_create(m_playbackRate, CHANNELS, &error);
+    if (error != OPUS_OK) {
+        qWarning() << "[AudioEngine] Error with opus";
+    }
+
+    // Устойчивость к потерям: in-band FEC дублирует кадр в следующем
+    // пакете (приемник восстановит пропуск без перезапроса), DTX почти
+    // обнуляет битрейт в паузах речи. Ожидаемый процент потерь энкодер
+    // узнает из отчетов приемника (sendLossFeedback на той стороне)
+    if (m_opusEncoder) {
+        opus_encoder_ctl(m_opusEncoder, OPUS_SET_INBAND_FEC(1));
+        opus_encoder_ctl(m_opusEncoder, OPUS_SET_DTX(1));
+        opus_encoder_ctl(m_opusEncoder, OPUS_SET_PACKET_LOSS_PERC(m_reportedLossPercent));
+
+        // Стартовая рабочая точка: максимум качества; тюнер по
+        // измеренному времени кодирования опустит ее, если машина
+        // не тянет (tuneEncoder)
+        m_complexity = 9;
+        m_bitrateBps = 32000;
+        m_encodeUsEwma = 0.0;
+        m_tuneCountdown = TuneIntervalFrames;
+        opus_encoder_ctl(m_opusEncoder, OPUS_SET_COMPLEXITY(m_complexity));
+        opus_encoder_ctl(m_opusEncoder, OPUS_SET_BITRATE(m_bitrateBps));
+    }
+
+    // Инициализируем источник звука (микрофон)
+    m_audioSource = new QAudioSource(defaultInputDevice, captureFormat, this);
+    m_audioInput = m_audioSource->start();
+    if (!m_audioInput) {
+        qWarning() << "[AUDIO] ❌ Failed to start audio input";
+        delete m_audioSource;
+        m_audioSource = nullptr;
+        return false;
+    }
+
+    // Обработчик данных микрофона срабатывает на аудиопотоке. До запуска
+    // передачи (прогрев) он лишь дренирует буфер устройства
+    connect(m_audioInput, &QIODevice::readyRead, this, &AudioEngine::onAudioInputReady);
+
+    // Инициализируем приемник звука (динамики/наушники)
+    m_audioSink = new QAudioSink(defaultOutputDevice, playbackFormat, this);
+    m_audioSink->setVolume(1.0);
+    m_audioOutput = m_audioSink->start();
+    if (!m_audioOutput) {
+        qWarning() << "[AUDIO] ❌ Failed to start audio output";
+        delete m_audioSink;
+        m_audioSink = nullptr;
+        closeMediaPath();
+        return false;
+    }
+
+    m_mediaReady = true;
+    return true;
+}
+
+void AudioEngine::startStreaming(const QString& remoteIp, quint16 remotePort)
+{
+    THREAD_AFFINITY_ASSERT(this);
+    qDebug() << "[AudioEngine] [AUDIO] >>> STARTING AUDIO STREAMING";
+
+    if (!m_udpSocket) {
+        qWarning() << "[AUDIO] ❌ UDP socket not initialized";
+        return;
+    }
+    if (remotePort == 0) {
+        qWarning() << "[AUDIO] ❌ Not ready - remotePort:" << remotePort;
+        return;
+    }
+
+    m_remoteIp = remoteIp;
+    m_remoteAddress = QHostAddress(remoteIp);
+    m_remotePort = remotePort;
+
+    // Сброс счетчиков и буферов для нового звонка
+    m_sequenceNumber = 0;
+    m_sendTimestamp = 0;
+    m_mediaClock.start();
+    m_driftSynced = false;
+    m_baseDelayMs = 0.0;
+    m_delayMs = 0.0;
+    m_jitterBuffer.clear();
+    m_pcmFill = 0;
+    m_playedFrames = 0;
+    m_concealedFrames = 0;
+    m_totalConcealed = 0;
+    m_feedbackCountdown = FeedbackIntervalTicks;
+    m_statsCountdown = StatsIntervalTicks;
+    m_lastLossPercent = 0;
+    m_rttMs = -1;
+    m_reportedLossPercent = 0;
+    m_audioBytesSent = 0;
+    m_audioPacketsSent = 0;
+    m_audioBytesReceived = 0;
+    m_audioPacketsReceived = 0;
+
+    // Тракт мог быть прогрет на этапе сигнала вызова (prewarmStreaming):
+    // устройства и кодеки уже готовы, старт сводится к включению передачи
+    if (!m_mediaReady) {
+        if (!openMediaPath()) {
+            return;
+        }
+    } else if (m_opusEncoder) {
+        // Кодеки созданы до сброса счетчиков выше — возвращаем энкодеру
+        // стартовую оценку потерь для нового звонка
+        opus_encoder_ctl(m_opusEncoder, OPUS_SET_PACKET_LOSS_PERC(m_reportedLossPercent));
+    }
+
+    m_streaming = true;
+    m_jitterTimer->start();
+
+    qDebug() << "[AudioEngine] [AUDIO] ✅ AUDIO STREAMING STARTED";
+    qDebug() << "[AudioEngine] [AUDIO] Remote:" << m_remoteAddress.toString() << ":" << m_remotePort;
+}
+
+void AudioEngine::stopStreaming()
+{
+    THREAD_AFFINITY_ASSERT(this);
+    qDebug() << "[AudioEngine] [AUDIO] Stopping audio streaming...";
+
+    m_streaming = false;
+    if (m_jitterTimer) {
+        m_jitterTimer->stop();
+    }
+
+    // Финальный снимок счетчиков: итоговые байты и пакеты звонка нужны
+    // GUI-потоку для телеметрии call_end уже после остановки тракта
+    publishSnapshot();
+
+    // Закрывает и прогретый без принятия тракт (отклоненный звонок)
+    closeMediaPath();
+
+    m_jitterBuffer.clear();
+    m_pcmFill = 0;
+    m_dsp.reset();
+    m_toneFramesLeft = 0;
+    if (m_toneTimer) {
+        m_toneTimer->stop();
+    }
+    m_remotePort = 0;
+
+    qDebug() << "[AudioEngine] [AUDIO] ✅ Audio streaming stopped";
+}
+
+void AudioEngine::closeMediaPath()
+{
+    // Останавливаем и очищаем источник звука (микрофон)
+    if (m_audioInput) {
+        disconnect(m_audioInput, nullptr, this, nullptr);
+        delete m_audioSource;
+        m_audioSource = nullptr;
+        m_audioInput = nullptr;
+    }
+
+    // Останавливаем и очищаем приемник звука (динамики)
+    if (m_audioOutput) {
+        disconnect(m_audioOutput, nullptr, this, nullptr);
+        delete m_audioSink;
+        m_audioSink = nullptr;
+        m_audioOutput = nullptr;
+    }
+
+    // Освобождаем кодеки: каждый звонок создает свежую пару
+    if (m_opusEncoder) {
+        opus_encoder_destroy(m_opusEncoder);
+        m_opusEncoder = nullptr;
+    }
+    if (m_opusDecoder) {
+        opus_decoder_destroy(m_opusDecoder);
+        m_opusDecoder = nullptr;
+    }
+
+    m_mediaReady = false;
+}
+
+void AudioEngine::sendUdp(int len)
+{
+    // Симулятор плохой сети (MESSENGER_NETSIM): дейтаграмма может быть
+    // выброшена или придержана — джиттер-буфер и FEC приемника
+    // прогоняются в воспроизводимых условиях
+    if (Q_UNLIKELY(NetSim::enabled())) {
+        if (NetSim::udpShouldDrop()) {
+            return;
+        }
+        const int delayMs = NetSim::udpDelayMs();
+        if (delayMs > 0) {
+            // Буфер передачи переиспользуется следующим пакетом —
+            // задержанная дейтаграмма уходит копией
+            QByteArray copy(m_txPacket.data(), len);
+            QTimer::singleShot(delayMs, this, [this, copy]() {
+                if (m_udpSocket && m_remotePort != 0) {
+                    m_udpSocket->writeDatagram(copy, m_remoteAddress, m_remotePort);
+                }
+            });
+            return;
+        }
+    }
+
+    const qint64 sent = m_udpSocket->writeDatagram(m_txPacket.data(), len,
+                                                   m_remoteAddress, m_remotePort);
+    if (sent < 0) {
+        qWarning() << "UDP write failure:" << m_udpSocket->errorString();
+    }
+}
+
+void AudioEngine::onAudioInputReady()
+{
+    THREAD_AFFINITY_ASSERT(this);
+
+    if (!m_audioInput) {
+        return;
+    }
+    if (!m_streaming || m_remotePort == 0) {
+        // Прогретый тракт до принятия звонка: буфер устройства дренируется,
+        // чтобы при старте передачи не ушел залп лежалых кадров, но
+        // ничего не кодируется и не отправляется
+        while (m_audioInput->read(m_pcmFrame.data(), qint64(m_pcmFrame.size())) > 0) {}
+        m_pcmFill = 0;
+        return;
+    }
+
+    // Читаем данные микрофона прямо в буфер сборки кадра: ни readAll(),
+    // ни промежуточных QByteArray — кадр копится до 20 мс и уходит
+    const int frameBytes = m_captureFrameSamples * int(sizeof(short));
+    while (true) {
+        const qint64 got = m_audioInput->read(m_pcmFrame.data() + m_pcmFill,
+                                              frameBytes - m_pcmFill);
+        if (got <= 0)
+            break;
+        m_pcmFill += int(got);
+        if (m_pcmFill < frameBytes)
+            continue;
+        m_pcmFill = 0;
+
+        // Пока идет тестовый тон, кадры микрофона читаются (буфер
+        // устройства не должен переполняться), но не кодируются: два
+        // источника в одном энкодере ломали бы и звук, и seq-метки
+        if (m_toneFramesLeft > 0) {
+            continue;
+        }
+
+        // Приводим байты к массиву 16-битных сэмплов
+        short* pcm = reinterpret_cast<short*>(m_pcmFrame.data());
+
+        // Вычитаем эхо динамиков и приглушаем фоновый шум до кодека
+        m_dsp.processCaptureFrame(pcm, m_captureFrameSamples);
+
+        // Кодируем PCM в Opus сразу в буфер передачи, после заголовка.
+        // Время кодирования меряется на каждом кадре: по нему тюнер
+        // держит энкодер в CPU-бюджете (tuneEncoder)
+        unsigned char* payload =
+            reinterpret_cast<unsigned char*>(m_txPacket.data()) + HeaderBytes;
+        QElapsedTimer encodeTimer;
+        encodeTimer.start();
+        int opusLen = opus_encode(m_opusEncoder, pcm, m_captureFrameSamples,
+                                  payload, int(m_txPacket.size()) - HeaderBytes);
+        const double encodeUs = double(encodeTimer.nsecsElapsed()) / 1000.0;
+        m_encodeUsEwma += (encodeUs - m_encodeUsEwma) / 16.0;
+        if (--m_tuneCountdown <= 0) {
+            m_tuneCountdown = TuneIntervalFrames;
+            tuneEncoder();
+        }
+        if (opusLen > 0) {
+            // RTP-подобный заголовок пишется в тот же переиспользуемый буфер
+            writeHeader(m_txPacket.data(), PayloadAudio, m_sequenceNumber, m_sendTimestamp);
+            m_sequenceNumber++;
+            m_sendTimestamp += TimestampPerFrame;
+
+            const qint64 packetLen = HeaderBytes + opusLen;
+            m_audioBytesSent += packetLen;
+
+            // Отправляем пакет по UDP на адрес и порт собеседника
+            sendUdp(int(packetLen));
+            ++m_audioPacketsSent;
+
+            // Периодически логируем статистику отправки (каждые 50 пакетов)
+            if (m_audioPacketsSent % 50 == 0) {
+                qDebug() << "[AudioEngine] [AUDIO] Sent" << m_audioPacketsSent << "packets"
+                         << "(" << m_audioBytesSent / 1024 << "KB) from" << m_udpSocket->localPort()
+                         << " to " << m_remotePort;
+            }
+        } else {
+            qWarning() << "OPUS encode Error";
+        }
+    }
+}
+
+void AudioEngine::onAudioDataReceived()
+{
+#ifdef Q_OS_LINUX
+    // Пакетный прием: recvmmsg забирает до BatchSize дейтаграмм одним
+    // системным вызовом. Когда поток был занят и пакеты скопились в
+    // ядре, это один syscall вместо одного на пакет
+    const int fd = int(m_udpSocket->socketDescriptor());
+    if (fd >= 0) {
+        constexpr int BatchSize = 16;
+        static thread_local std::array<
+            std::array<char, JitterBuffer::MaxPacketBytes>, BatchSize> buffers;
+
+        mmsghdr msgs[BatchSize];
+        iovec iovs[BatchSize];
+        while (true) {
+            memset(msgs, 0, sizeof(msgs));
+            for (int i = 0; i < BatchSize; ++i) {
+                iovs[i].iov_base = buffers[i].data();
+                iovs[i].iov_len = buffers[i].size();
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            const int received = ::recvmmsg(fd, msgs, BatchSize, MSG_DONTWAIT, nullptr);
+            if (received <= 0)
+                break;
+
+            for (int i = 0; i < received; ++i) {
+                handleDatagram(buffers[i].data(), int(msgs[i].msg_len));
+            }
+
+            // Недобранная партия означает пустую очередь ядра
+            if (received < BatchSize)
+                break;
+        }
+        return;
+    }
+#endif
+
+    // Поштучный путь: обрабатываем все UDP дейтаграммы из очереди приема
+    while (m_udpSocket->hasPendingDatagrams()) {
+        // Читаем дейтаграмму в переиспользуемый буфер приема — без
+        // QByteArray на каждый пакет. Нестандартно большие дейтаграммы
+        // этому тракту не принадлежат, пропускаем их чтением в никуда
+        const qint64 pending = m_udpSocket->pendingDatagramSize();
+        if (pending > qint64(m_rxDatagram.size())) {
+            m_udpSocket->readDatagram(m_rxDatagram.data(), m_rxDatagram.size());
+            continue;
+        }
+
+        const qint64 len = m_udpSocket->readDatagram(m_rxDatagram.data(),
+                                                     m_rxDatagram.size());
+        handleDatagram(m_rxDatagram.data(), int(len));
+    }
+}
+
+void AudioEngine::handleDatagram(const char* data, int len)
+{
+    if (len < HeaderBytes)
+        return;
+
+    // Обновляем статистику приема
+    m_audioBytesReceived += len;
+    m_audioPacketsReceived++;
+
+    // Проверяем готовность декодера и устройства воспроизведения
+    if (!m_opusDecoder || !m_audioOutput)
+        return;
+
+    // Разбираем RTP-подобный заголовок: тип, seq, временная метка
+    const uchar* raw = reinterpret_cast<const uchar*>(data);
+    PacketHeader header;
+    header.payloadType = raw[0];
+    header.seq = qFromBigEndian<quint32>(raw + 1);
+    header.timestamp = qFromBigEndian<quint32>(raw + 5);
+
+    // Служебный пакет обратной связи: приемник сообщает свой процент
+    // потерь, мы подстраиваем FEC энкодера
+    if (header.payloadType == PayloadFeedback) {
+        if (len > HeaderBytes)
+            applyLossPercent(raw[HeaderBytes]);
+        return;
+    }
+
+    // RTT-зонд: возвращаем эхо с нетронутой меткой отправителя
+    if (header.payloadType == PayloadRttProbe) {
+        if (m_streaming && m_remotePort != 0) {
+            writeHeader(m_txPacket.data(), PayloadRttEcho, 0, header.timestamp);
+            sendUdp(HeaderBytes);
+        }
+        return;
+    }
+
+    // Эхо нашего зонда: метка — наши локальные мс на момент отправки
+    if (header.payloadType == PayloadRttEcho) {
+        m_rttMs = int(quint32(m_mediaClock.elapsed()) - header.timestamp);
+        return;
+    }
+
+    if (header.payloadType != PayloadAudio)
+        return;
+
+    // Метка пакета против локальных часов: копим оценку дрейфа
+    // часов отправителя для планировщика воспроизведения
+    updateDrift(header.timestamp);
+
+    // Периодически логируем статистику приема (каждые 50 пакетов)
+    if (m_audioPacketsReceived % 50 == 0) {
+        qDebug() << "[AudioEngine] [AUDIO] Received" << m_audioPacketsReceived << "packets"
+                 << "(" << m_audioBytesReceived / 1024 << "KB)"
+                 << "jitter:" << m_jitterBuffer.jitterMs() << "ms"
+                 << "late:" << m_jitterBuffer.lateCount()
+                 << "dup:" << m_jitterBuffer.duplicateCount();
+    }
+
+    // Помещаем пакет в кольцо джиттер-буфера — копия идет в
+    // предвыделенный слот кольца
+    m_jitterBuffer.push(header.seq, data + HeaderBytes, len - HeaderBytes);
+}
+
+void AudioEngine::processJitterBuffer()
+{
+    THREAD_AFFINITY_ASSERT(this);
+
+    if (!m_opusDecoder || !m_audioOutput)
+        return;
+
+    short decodedPcm[MaxFrameSamples];
+    unsigned char opusData[JitterBuffer::MaxPacketBytes];
+
+    if (m_jitterBuffer.depth() == 0) {
+        return;
+    }
+
+    // 0. Компенсация дрейфа часов. Сглаженная задержка local-sender
+    // уходит от базовой больше чем на кадр — часы разъехались:
+    //  - отрицательный дрейф: отправитель опережает наш такт, буфер
+    //    пухнет — проигрываем один лишний кадр за такт;
+    //  - положительный: отправитель отстает, буфер сохнет — пропускаем
+    //    такт, давая пакетам накопиться.
+    const double driftMs = m_delayMs - m_baseDelayMs;
+    if (m_driftSynced && driftMs > JitterBuffer::FramePeriodMs) {
+        m_baseDelayMs += JitterBuffer::FramePeriodMs;
+        qDebug() << "[AudioEngine] [DRIFT] Sender slow, holding one tick"
+                 << "(drift:" << driftMs << "ms)";
+        return;
+    }
+    bool playExtraFrame = false;
+    if (m_driftSynced && driftMs < -JitterBuffer::FramePeriodMs) {
+        m_baseDelayMs -= JitterBuffer::FramePeriodMs;
+        playExtraFrame = true;
+        qDebug() << "[AudioEngine] [DRIFT] Sender fast, playing extra frame"
+                 << "(drift:" << driftMs << "ms)";
+    }
+
+    // 1. Режим "догонялки" (catch-up): накопили больше целевой глубины —
+    // отстаем. Целевая глубина адаптивная: растет с измеренным джиттером
+    // сети и ужимается до минимума на стабильном канале
+    while ((m_jitterBuffer.depth() > m_jitterBuffer.targetDepth() || playExtraFrame)
+           && m_jitterBuffer.hasNext()) {
+        playExtraFrame = false;
+        int len = m_jitterBuffer.takeNext(opusData, JitterBuffer::MaxPacketBytes);
+        int samples = opus_decode(m_opusDecoder, opusData, len, decodedPcm, m_playbackFrameSamples, 0);
+        if (m_audioOutput->isWritable()) {
+            m_audioOutput->write(reinterpret_cast<char*>(decodedPcm),
+                                 samples * sizeof(short));
+            m_dsp.pushPlayoutFrame(decodedPcm, samples);
+        }
+    }
+
+    // 2. Обычный режим: если следующий ожидаемый пакет есть в кольце — проигрываем его
+    if (m_jitterBuffer.hasNext()) {
+        int len = m_jitterBuffer.takeNext(opusData, JitterBuffer::MaxPacketBytes);
+        int samples = opus_decode(m_opusDecoder, opusData, len, decodedPcm, m_playbackFrameSamples, 0);
+        m_audioOutput->write(reinterpret_cast<char*>(decodedPcm),
+                             samples * sizeof(short));
+        m_dsp.pushPlayoutFrame(decodedPcm, samples);
+        ++m_playedFrames;
+    } else {
+        // 3. Кадр потерян. Если следующий пакет уже лежит в кольце, в нем
+        // есть FEC-копия пропавшего кадра (энкодер шлет с OPUS_SET_INBAND_FEC):
+        // декодируем его с флагом fec=1 и получаем настоящий звук, а не
+        // синтетический заполнитель
+        const int nextLen = m_jitterBuffer.peek(m_jitterBuffer.nextSeq() + 1,
+                                                opusData, JitterBuffer::MaxPacketBytes);
+        if (nextLen > 0) {
+            opus_decode(m_opusDecoder, opusData, nextLen, decodedPcm, m_playbackFrameSamples, 1);
+        } else {
+            // Packet Loss Concealment (PLC): соседей нет, Opus генерирует
+            // заполнитель на основе предыдущих данных (передаем nullptr, 0)
+            opus_decode(m_opusDecoder, nullptr, 0, decodedPcm, m_playbackFrameSamples, 0);
+        }
+        m_audioOutput->write(reinterpret_cast<char*>(decodedPcm),
+                             m_playbackFrameSamples * sizeof(short));
+        // Скрытый кадр тоже звучит из динамиков — он тоже опора для AEC
+        m_dsp.pushPlayoutFrame(decodedPcm, m_playbackFrameSamples);
+        ++m_concealedFrames;
+        ++m_totalConcealed;
+        // Курсор уходит дальше: опоздавшая копия этого кадра будет отброшена
+        m_jitterBuffer.skipNext();
+    }
+
+    // Посекундная телеметрия: окно потерь, RTT-зонд, сигнал в UI
+    if (--m_statsCountdown <= 0) {
+        m_statsCountdown = StatsIntervalTicks;
+        publishStats();
+    }
+
+    // Периодический отчет о потерях в сторону отправителя
+    if (--m_feedbackCountdown <= 0) {
+        m_feedbackCountdown = FeedbackIntervalTicks;
+        sendLossFeedback();
+    }
+}
+
+void AudioEngine::publishStats()
+{
+    // Потери за окно секунды: скрытые кадры против всех проигранных
+    const quint64 total = m_playedFrames + m_concealedFrames;
+    m_lastLossPercent = total > 0 ? int((m_concealedFrames * 100) / total) : 0;
+    m_playedFrames = 0;
+    m_concealedFrames = 0;
+
+    // RTT-зонд: метка — наши локальные мс, вернется эхом нетронутой
+    if (m_streaming && m_udpSocket && m_remotePort != 0) {
+        writeHeader(m_txPacket.data(), PayloadRttProbe, 0,
+                    quint32(m_mediaClock.elapsed()));
+        sendUdp(HeaderBytes);
+    }
+
+    publishSnapshot();
+
+    emit statsUpdated(m_jitterBuffer.jitterMs(), m_lastLossPercent,
+                      int(m_jitterBuffer.reorderCount()), m_rttMs,
+                      qlonglong(m_totalConcealed));
+}
+
+void AudioEngine::publishSnapshot()
+{
+    // Счетчики тракта — обычные члены аудиопотока; наружу они уходят
+    // только этим снимком, читаемым другими потоками без блокировок
+    CallStats stats;
+    stats.bytesSent = m_audioBytesSent;
+    stats.packetsSent = m_audioPacketsSent;
+    stats.bytesReceived = m_audioBytesReceived;
+    stats.packetsReceived = m_audioPacketsReceived;
+    stats.concealedFrames = qint64(m_totalConcealed);
+    stats.jitterMs = m_jitterBuffer.jitterMs();
+    stats.lossPercent = m_lastLossPercent;
+    stats.reorderCount = int(m_jitterBuffer.reorderCount());
+    stats.rttMs = m_rttMs;
+    m_statsSnapshot.publish(stats);
+}
+
+void AudioEngine::sendLossFeedback()
+{
+    if (!m_streaming || !m_udpSocket || m_remotePort == 0)
+        return;
+
+    // Окно считает publishStats: здесь только доставка последнего значения
+    const int lossPercent = m_lastLossPercent;
+
+    // Компактный служебный пакет по тому же UDP каналу: заголовок
+    // с типом PayloadFeedback + процент потерь (тот же буфер передачи)
+    writeHeader(m_txPacket.data(), PayloadFeedback, 0, 0);
+    m_txPacket[HeaderBytes] = char(qBound(0, lossPercent, 100));
+    sendUdp(HeaderBytes + 1);
+
+    qDebug() << "[AudioEngine] [FEC] Reported loss to sender:" << lossPercent << "%";
+}
+
+void AudioEngine::applyLossPercent(int lossPercent)
+{
+    lossPercent = qBound(0, lossPercent, 50);
+    if (lossPercent == m_reportedLossPercent || !m_opusEncoder)
+        return;
+
+    m_reportedLossPercent = lossPercent;
+    opus_encoder_ctl(m_opusEncoder, OPUS_SET_PACKET_LOSS_PERC(lossPercent));
+    qDebug() << "[AudioEngine] [FEC] Encoder expected loss set to:" << lossPercent << "%";
+}
+
+//См. описание в заголовке: тюнер рабочей точки энкодера
+void AudioEngine::tuneEncoder()
+{
+    if (!m_opusEncoder) {
+        return;
+    }
+
+    int complexity = m_complexity;
+    if (m_encodeUsEwma > double(EncodeBudgetUs) && complexity > 0) {
+        // Не влезаем в бюджет (слабая машина или начался троттлинг)
+        --complexity;
+    } else if (m_encodeUsEwma < double(EncodeBudgetUs) * 0.5 && complexity < 9) {
+        // Стабильный двукратный запас: можно вернуть качество
+        ++complexity;
+    }
+    if (complexity == m_complexity) {
+        return;
+    }
+
+    m_complexity = complexity;
+
+    // Битрейт следует за сложностью: биты, которые дешевый режим
+    // энкодера не отработает, только греют канал
+    int bitrate = 32000;
+    if (m_complexity < 5) {
+        bitrate = 16000;
+    } else if (m_complexity < 8) {
+        bitrate = 24000;
+    }
+    m_bitrateBps = bitrate;
+
+    opus_encoder_ctl(m_opusEncoder, OPUS_SET_COMPLEXITY(m_complexity));
+    opus_encoder_ctl(m_opusEncoder, OPUS_SET_BITRATE(m_bitrateBps));
+
+    qDebug() << "[AudioEngine] [TUNE] Operating point: complexity" << m_complexity
+             << "bitrate" << m_bitrateBps << "bps"
+             << "(encode" << m_encodeUsEwma << "us/frame, budget"
+             << EncodeBudgetUs << "us)";
+    emit operatingPointChanged(m_complexity, m_bitrateBps);
+}
+
+void AudioEngine::updateDrift(quint32 timestamp)
+{
+    // Задержка = локальное время прихода минус время отправителя по его
+    // метке. Абсолютное значение неважно (часы не синхронизированы) —
+    // важен уход от базовой задержки: он и есть дрейф часов
+    const double senderMs = double(timestamp) / SamplesPerMs;
+    const double delay = double(m_mediaClock.elapsed()) - senderMs;
+
+    if (!m_driftSynced) {
+        m_baseDelayMs = delay;
+        m_delayMs = delay;
+        m_driftSynced = true;
+        return;
+    }
+
+    // Сглаживание 1/16 отсекает сетевой джиттер от систематического дрейфа
+    m_delayMs += (delay - m_delayMs) / 16.0;
+}
+
+int AudioEngine::writeHeader(char* dst, quint8 payloadType, quint32 seq, quint32 timestamp) const
+{
+    // Сетевая (big-endian) байтовая последовательность, как у QDataStream
+    uchar* raw = reinterpret_cast<uchar*>(dst);
+    raw[0] = payloadType;
+    qToBigEndian(seq, raw + 1);
+    qToBigEndian(timestamp, raw + 5);
+    return HeaderBytes;
+}
+
+int AudioEngine::pickSupportedRate(const QAudioDevice& device, QAudioFormat& format)
+{
+    format.setChannelCount(CHANNELS);
+    format.setSampleFormat(QAudioFormat::Int16);
+
+    // Fullband 48 кГц — если устройство поддерживает формат нативно
+    format.setSampleRate(48000);
+    if (device.isFormatSupported(format))
+        return 48000;
+
+    // Откат на узкую полосу 16 кГц
+    format.setSampleRate(16000);
+    return 16000;
+}
+
+void AudioEngine::sendSineWaveTone(int frequencyHz, int durationMs)
+{
+    // Проверяем готовность к отправке тестового сигнала
+    if (!m_streaming || m_remotePort == 0 || !m_udpSocket || !m_opusEncoder) {
+        qWarning() << "[SINE] ❌ Not ready";
+        return;
+    }
+
+    // Тон уходит не блокирующим циклом, а тактами реального времени:
+    // по кадру каждые 20 мс, как шел бы живой звук. Приемная сторона
+    // видит корректный темп пакетов, а поток не зависает на весь клип
+    m_toneFramesLeft = (durationMs / JitterBuffer::FramePeriodMs);
+
+    // Рекуррентный осциллятор: s[n] = 2cos(w)*s[n-1] - s[n-2].
+    // Одно умножение и вычитание на сэмпл вместо sin(); генерация кадра
+    // идет по непрерывному массиву без обращений к libm
+    const double w = 2.0 * M_PI * double(frequencyHz) / double(m_captureRate);
+    m_toneCoeff = 2.0 * std::cos(w);
+    m_toneS1 = std::sin(-w);        // s[-1]
+    m_toneS2 = std::sin(-2.0 * w);  // s[-2]
+
+    if (!m_toneTimer) {
+        m_toneTimer = new QTimer(this);
+        m_toneTimer->setTimerType(Qt::PreciseTimer);
+        connect(m_toneTimer, &QTimer::timeout, this, &AudioEngine::onToneTick);
+    }
+    m_toneTimer->start(JitterBuffer::FramePeriodMs);
+
+    qDebug() << "[AudioEngine] [SINE] Tone scheduled:" << frequencyHz << "Hz,"
+             << durationMs << "ms (" << m_toneFramesLeft << "frames )";
+}
+
+void AudioEngine::onToneTick()
+{
+    if (m_toneFramesLeft <= 0 || !m_streaming || !m_opusEncoder) {
+        if (m_toneTimer) {
+            m_toneTimer->stop();
+        }
+        qDebug() << "[AudioEngine] [SINE] ✅ Tone finished";
+        return;
+    }
+    --m_toneFramesLeft;
+
+    // Амплитуда 30% от максимума (чтобы избежать перегрузки/клиппинга)
+    const double amplitude = 32767.0 * 0.3;
+
+    // Один кадр синуса рекуррентным осциллятором
+    double s1 = m_toneS1;
+    double s2 = m_toneS2;
+    const double coeff = m_toneCoeff;
+    for (int i = 0; i < m_captureFrameSamples; ++i) {
+        const double sample = coeff * s1 - s2;
+        s2 = s1;
+        s1 = sample;
+        m_toneFrame[size_t(i)] = short(sample * amplitude);
+    }
+    m_toneS1 = s1;
+    m_toneS2 = s2;
+
+    // Кодирование и отправка — тем же путем и с теми же seq/метками,
+    // что и кадры микрофона
+    unsigned char* payload =
+        reinterpret_cast<unsigned char*>(m_txPacket.data()) + HeaderBytes;
+    const int opusLen = opus_encode(m_opusEncoder, m_toneFrame.data(),
+                                    m_captureFrameSamples, payload,
+                                    int(m_txPacket.size()) - HeaderBytes);
+    if (opusLen > 0) {
+        writeHeader(m_txPacket.data(), PayloadAudio, m_sequenceNumber, m_sendTimestamp);
+        m_sequenceNumber++;
+        m_sendTimestamp += TimestampPerFrame;
+
+        sendUdp(HeaderBytes + opusLen);
+        m_audioBytesSent += HeaderBytes + opusLen;
+        m_audioPacketsSent++;
+    }
+}
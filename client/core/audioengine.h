@@ -0,0 +1,349 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QAudioSource>
+#include <QAudioSink>
+#include <QAudioFormat>
+#include <QAudioDevice>
+#include <QTimer>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <array>
+#include <opus.h>
+#include "jitterbuffer.h"
+#include "audiodsp.h"
+#include "statssnapshot.h"
+
+/**
+ * @brief Медиа-тракт звонка, живущий на выделенном аудиопотоке.
+ *
+ * Захват с микрофона, кодирование Opus, UDP прием/передача, джиттер-буфер
+ * и воспроизведение выполняются целиком на потоке "call-audio" с
+ * приоритетом TimeCriticalPriority. Раньше все это крутилось на GUI-потоке
+ * через 20-мс QTimer: любой затык интерфейса (открытие чата, ресайз)
+ * срывал дедлайн кадра и давал слышимые провалы.
+ *
+ * CallService (GUI-поток) общается с движком только асинхронно:
+ * команды — очередными вызовами слотов, состояние и статистика — сигналами
+ * через очередь событий. Общих данных между потоками нет.
+ *
+ * Объект создается на GUI-потоке, переезжает moveToThread и биндит UDP
+ * сокет уже на аудиопотоке (initialize по QThread::started) — сокет и
+ * аудиоустройства принадлежат тому потоку, который их обслуживает.
+ */
+class AudioEngine : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Конструктор движка.
+     * @param bindIp IP для bind UDP сокета (из config.ini)
+     * @param parent Родительский QObject (обычно nullptr: объект переезжает в поток)
+     */
+    explicit AudioEngine(const QString& bindIp, QObject* parent = nullptr);
+
+    /** @brief Останавливает тракт и освобождает кодеки/сокет. */
+    ~AudioEngine();
+
+    /**
+     * @brief Накопленная статистика звонка: счетчики тракта одним снимком.
+     *
+     * Счетчики ведутся обычными членами на аудиопотоке и публикуются
+     * в StatsSnapshot раз в секунду (и финально при stopStreaming) —
+     * другие потоки читают их без блокировок и без влияния на тракт.
+     */
+    struct CallStats {
+        qint64 bytesSent = 0;       ///< Отправлено байт аудиоданных
+        qint64 packetsSent = 0;     ///< Отправлено аудиопакетов
+        qint64 bytesReceived = 0;   ///< Принято байт аудиоданных
+        qint64 packetsReceived = 0; ///< Принято аудиопакетов
+        qint64 concealedFrames = 0; ///< Скрытых кадров (FEC+PLC) с начала звонка
+        double jitterMs = 0.0;      ///< Сглаженный межпакетный джиттер
+        int lossPercent = 0;        ///< Потери за последнее окно секунды (%)
+        int reorderCount = 0;       ///< Пакетов вне порядка с начала звонка
+        int rttMs = -1;             ///< Последний измеренный RTT, мс
+    };
+
+    /**
+     * @brief Последний опубликованный снимок статистики. Любой поток.
+     *
+     * CallService читает его при формировании call_end (итоговые байты
+     * и пакеты звонка), UI может опрашивать по таймеру — без ожидания.
+     */
+    CallStats readStats() const { return m_statsSnapshot.read(); }
+
+public slots:
+    /**
+     * @brief Инициализация на аудиопотоке: bind UDP сокета.
+     *
+     * Вызывается по QThread::started. Назначенный ОС порт уходит
+     * сигналом socketBound — он нужен GUI-потоку для сигнализации.
+     */
+    void initialize();
+
+    /**
+     * @brief Прогрев медиа-тракта на время сигнала вызова.
+     *
+     * Создает кодеки Opus и открывает аудиоустройства заранее — пока
+     * звонит рингтон и пользователь решает, принимать ли звонок. Раскрутка
+     * устройств занимает сотни миллисекунд; сделанная здесь, она не ложится
+     * паузой тишины после принятия — startStreaming застает тракт готовым
+     * и лишь включает передачу. Микрофон при этом читается и
+     * отбрасывается, в сеть ничего не уходит.
+     *
+     * Если звонок отклонен, прогретый тракт закрывает stopStreaming.
+     */
+    void prewarmStreaming();
+
+    /**
+     * @brief Запуск аудиопотока звонка.
+     *
+     * Переиспользует тракт, открытый prewarmStreaming; без прогрева
+     * открывает устройства и создает кодеки сам.
+     * @param remoteIp IP собеседника
+     * @param remotePort UDP порт собеседника
+     */
+    void startStreaming(const QString& remoteIp, quint16 remotePort);
+
+    /** @brief Остановка захвата, воспроизведения и таймера джиттера. */
+    void stopStreaming();
+
+    /**
+     * @brief Тестовый синус в сторону собеседника (отладка тракта).
+     * @param frequencyHz Частота тона
+     * @param durationMs Длительность тона
+     */
+    void sendSineWaveTone(int frequencyHz, int durationMs);
+
+signals:
+    /** @brief UDP сокет привязан. @param localPort Назначенный ОС порт */
+    void socketBound(quint16 localPort);
+
+    /** @brief Ошибка медиа-тракта. @param error Описание для UI */
+    void engineError(const QString& error);
+
+    /**
+     * @brief Рабочая точка энкодера изменилась (тюнер CPU-бюджета).
+     * @param complexity Выбранная OPUS_SET_COMPLEXITY (0-10)
+     * @param bitrateBps Выбранный битрейт, бит/с
+     */
+    void operatingPointChanged(int complexity, int bitrateBps);
+
+    /**
+     * @brief Посекундная телеметрия качества звонка.
+     * @param jitterMs Сглаженный межпакетный джиттер
+     * @param lossPercent Потери за секунду (скрытые кадры / всего)
+     * @param reorderCount Пакетов вне порядка с начала звонка
+     * @param rttMs Последний измеренный RTT (-1, пока эха не было)
+     * @param concealedFrames Скрытых кадров (FEC+PLC) с начала звонка
+     */
+    void statsUpdated(double jitterMs, int lossPercent, int reorderCount,
+                      int rttMs, qlonglong concealedFrames);
+
+private slots:
+    /** @brief Данные микрофона готовы: нарезка на кадры, Opus, UDP. */
+    void onAudioInputReady();
+
+    /** @brief Прием UDP дейтаграмм в кольцо джиттер-буфера. */
+    void onAudioDataReceived();
+
+    /** @brief Такт воспроизведения: дренаж кольца, декод, PLC. */
+    void processJitterBuffer();
+
+    /** @brief Такт генератора тона: один кадр синуса, кодирование, UDP. */
+    void onToneTick();
+
+private:
+    /**
+     * @brief Компактный RTP-подобный заголовок медиапакета.
+     *
+     * 9 байт перед полезной нагрузкой: тип (аудио/служебный), 32-битный
+     * seq и 32-битная временная метка в сэмплах (16 на миллисекунду).
+     * Метка позволяет приемнику отличать дрейф часов отправителя от
+     * сетевого джиттера и планировать воспроизведение по своим часам.
+     */
+    struct PacketHeader {
+        quint8 payloadType;   ///< PayloadAudio или PayloadFeedback
+        quint32 seq;          ///< Номер последовательности
+        quint32 timestamp;    ///< Метка в сэмплах от начала потока
+    };
+
+    /// Типы полезной нагрузки в заголовке
+    enum PayloadType : quint8 {
+        PayloadAudio = 0,     ///< Opus кадр
+        PayloadFeedback = 1,  ///< Отчет приемника о потерях
+        PayloadRttProbe = 2,  ///< Зонд RTT (метка — локальные мс отправителя)
+        PayloadRttEcho = 3    ///< Эхо зонда с той же меткой
+    };
+
+    /// Размер сериализованного заголовка, байт
+    static constexpr int HeaderBytes = 9;
+
+    /// Период отчета о потерях: 100 тактов по 20 мс = раз в 2 секунды
+    static constexpr int FeedbackIntervalTicks = 100;
+
+    /// Период телеметрии: 50 тактов по 20 мс = раз в секунду
+    static constexpr int StatsIntervalTicks = 50;
+
+    /// Бюджет CPU на кодирование кадра: 1 мс из 20 (5% ядра). На слабых
+    /// машинах тюнер снижает сложность, пока кодирование не уложится
+    static constexpr int EncodeBudgetUs = 1000;
+
+    /// Период переоценки рабочей точки энкодера: 100 кадров = 2 секунды.
+    /// Сглаженное время кодирования продолжает меряться всегда, поэтому
+    /// тепловой троттлинг по ходу звонка тоже будет отработан
+    static constexpr int TuneIntervalFrames = 100;
+
+    /// Часы временных меток: 48 кГц, как у RTP для Opus, независимо
+    /// от фактической частоты захвата на конкретной машине
+    static constexpr int SamplesPerMs = 48;
+
+    /// Сэмплов 48-кГц часов в одном 20-мс кадре
+    static constexpr int TimestampPerFrame = 960;
+
+    /// Максимум сэмплов в 20-мс кадре (fullband 48 кГц)
+    static constexpr int MaxFrameSamples = 960;
+
+    /**
+     * @brief Отправка m_txPacket собеседнику через шим симулятора сети.
+     *
+     * В обычном режиме — прямой writeDatagram; при MESSENGER_NETSIM
+     * дейтаграмма может быть выброшена или придержана (см. netsim.h).
+     * @param len Длина пакета в буфере передачи
+     */
+    void sendUdp(int len);
+
+    /** @brief Отправляет приемную статистику потерь отправителю. */
+    void sendLossFeedback();
+
+    /** @brief Считает окно секунды, шлет RTT-зонд, эмитит statsUpdated. */
+    void publishStats();
+
+    /** @brief Копирует счетчики тракта в снимок для других потоков. */
+    void publishSnapshot();
+
+    /**
+     * @brief Подстройка рабочей точки энкодера под бюджет CPU.
+     *
+     * По сглаженному времени кодирования кадра: не влезаем в бюджет —
+     * снижаем OPUS_SET_COMPLEXITY, стабильно влезаем с запасом —
+     * поднимаем. Битрейт следует ступенью за сложностью: на слабой
+     * машине нет смысла тратить биты, которые энкодер не отработает.
+     */
+    void tuneEncoder();
+
+    /** @brief Применяет сообщенный процент потерь к энкодеру (FEC). */
+    void applyLossPercent(int lossPercent);
+
+    /** @brief Обновляет оценку дрейфа часов по метке принятого пакета. */
+    void updateDrift(quint32 timestamp);
+
+    /**
+     * @brief Сериализует заголовок в начало буфера передачи.
+     * @return Смещение полезной нагрузки (HeaderBytes)
+     */
+    int writeHeader(char* dst, quint8 payloadType, quint32 seq, quint32 timestamp) const;
+
+    /**
+     * @brief Обработка одной дейтаграммы: заголовок, статистика, кольцо.
+     *
+     * Общая точка для обоих путей приема — пакетного recvmmsg на Linux
+     * и поштучного readDatagram на остальных платформах.
+     */
+    void handleDatagram(const char* data, int len);
+
+    /**
+     * @brief Открывает аудиоустройства и создает кодеки Opus.
+     *
+     * Общая часть прогрева и холодного старта: подбор частот, настройка
+     * DSP, энкодер/декодер с рабочей точкой по умолчанию, запуск
+     * QAudioSource/QAudioSink. Именно этот этап стоит сотен миллисекунд.
+     * @return false, если устройства недоступны или не стартовали
+     */
+    bool openMediaPath();
+
+    /** @brief Закрывает устройства и освобождает кодеки (обратно openMediaPath). */
+    void closeMediaPath();
+
+    /**
+     * @brief Подбирает частоту дискретизации для устройства.
+     *
+     * Предпочитаем fullband 48 кГц; если устройство его не умеет —
+     * узкая полоса 16 кГц. Битстрим Opus не зависит от частоты, поэтому
+     * стороны звонка могут работать на разных частотах без согласования:
+     * ресемплинг делает сам кодек своими SIMD-ядрами.
+     *
+     * @param device Аудиоустройство
+     * @param format [out] Заполненный формат с выбранной частотой
+     * @return Выбранная частота (48000 или 16000)
+     */
+    static int pickSupportedRate(const QAudioDevice& device, QAudioFormat& format);
+
+    QString m_bindIp;                 /*!< IP для bind UDP сокета */
+    QString m_remoteIp;               /*!< IP собеседника (строка) */
+    QHostAddress m_remoteAddress;     /*!< IP собеседника */
+    quint16 m_remotePort = 0;         /*!< UDP порт собеседника */
+    bool m_streaming = false;         /*!< Тракт запущен */
+    bool m_mediaReady = false;        /*!< Устройства открыты, кодеки созданы (прогрев) */
+
+    QUdpSocket* m_udpSocket = nullptr;   /*!< UDP сокет (живет на аудиопотоке) */
+    QAudioSource* m_audioSource = nullptr; /*!< Захват устройства (микрофон) */
+    QAudioSink* m_audioSink = nullptr;     /*!< Воспроизведение (динамик) */
+    QIODevice* m_audioInput = nullptr;     /*!< Входной поток аудио */
+    QIODevice* m_audioOutput = nullptr;    /*!< Выходной поток аудио */
+    QTimer* m_jitterTimer = nullptr;       /*!< Точный 20-мс такт воспроизведения */
+    QTimer* m_toneTimer = nullptr;         /*!< 20-мс такт генератора тестового тона */
+
+    OpusEncoder* m_opusEncoder = nullptr;  /*!< Кодирование PCM->Opus */
+    OpusDecoder* m_opusDecoder = nullptr;  /*!< Декодирование Opus->PCM */
+    JitterBuffer m_jitterBuffer;           /*!< Адаптивное кольцо приема */
+    AudioDsp m_dsp;                        /*!< AEC и шумоподавление захвата */
+
+    // Пул фиксированных буферов тракта: каждый этап (прием, кадр
+    // микрофона, пакет передачи) переиспользует свой буфер — в
+    // установившемся режиме звонок не делает ни одной heap-аллокации
+    std::array<char, JitterBuffer::MaxPacketBytes> m_rxDatagram;       /*!< Прием дейтаграммы */
+    std::array<char, MaxFrameSamples * int(sizeof(short))> m_pcmFrame; /*!< Сборка кадра микрофона */
+    int m_pcmFill = 0;                                                 /*!< Заполнено байт кадра */
+    std::array<char, JitterBuffer::MaxPacketBytes> m_txPacket;         /*!< Пакет на отправку */
+    std::array<short, MaxFrameSamples> m_toneFrame;                    /*!< Кадр генератора тона */
+
+    int m_captureRate = 16000;        /*!< Частота захвата (48к при поддержке) */
+    int m_playbackRate = 16000;       /*!< Частота воспроизведения */
+    int m_captureFrameSamples = 320;  /*!< Сэмплов в 20-мс кадре захвата */
+    int m_playbackFrameSamples = 320; /*!< Сэмплов в 20-мс кадре воспроизведения */
+
+    quint32 m_sequenceNumber = 0;     /*!< Следующий seq номер для передачи */
+    quint32 m_sendTimestamp = 0;      /*!< Метка передачи (сэмплы от старта) */
+
+    QElapsedTimer m_mediaClock;       /*!< Локальные часы приема/воспроизведения */
+    bool m_driftSynced = false;       /*!< Базовая задержка зафиксирована */
+    double m_baseDelayMs = 0.0;       /*!< Задержка local-sender на старте */
+    double m_delayMs = 0.0;           /*!< Сглаженная текущая задержка */
+    quint64 m_playedFrames = 0;       /*!< Кадров воспроизведено за окно секунды */
+    quint64 m_concealedFrames = 0;    /*!< Кадров скрыто за окно секунды */
+    quint64 m_totalConcealed = 0;     /*!< Скрытых кадров с начала звонка */
+    int m_feedbackCountdown = 0;      /*!< Тактов до следующего отчета о потерях */
+    int m_statsCountdown = 0;         /*!< Тактов до следующей публикации телеметрии */
+    int m_lastLossPercent = 0;        /*!< Потери за последнее окно (%) */
+    int m_rttMs = -1;                 /*!< Последний измеренный RTT, мс */
+    int m_reportedLossPercent = 0;    /*!< Потери, о которых сообщил приемник (%) */
+    double m_encodeUsEwma = 0.0;      /*!< Сглаженное время кодирования кадра, мкс */
+    int m_toneFramesLeft = 0;         /*!< Кадров тона осталось сгенерировать */
+    double m_toneCoeff = 0.0;         /*!< Коэффициент рекуррентного осциллятора */
+    double m_toneS1 = 0.0;            /*!< Состояние осциллятора: s[n-1] */
+    double m_toneS2 = 0.0;            /*!< Состояние осциллятора: s[n-2] */
+    int m_tuneCountdown = 0;          /*!< Кадров до переоценки рабочей точки */
+    int m_complexity = 9;             /*!< Текущая OPUS_SET_COMPLEXITY */
+    int m_bitrateBps = 32000;         /*!< Текущий битрейт энкодера */
+    qint64 m_audioBytesSent = 0;      /*!< Отправлено байт аудиоданных */
+    qint64 m_audioPacketsSent = 0;    /*!< Отправлено аудиопакетов */
+    qint64 m_audioBytesReceived = 0;  /*!< Принято байт аудиоданных */
+    qint64 m_audioPacketsReceived = 0;/*!< Принято аудиопакетов */
+
+    StatsSnapshot<CallStats> m_statsSnapshot; /*!< Снимок счетчиков для других потоков */
+};
+
+#endif // AUDIOENGINE_H
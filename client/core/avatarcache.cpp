@@ -1,3 +1,267 @@
 #include "avatarcache.h"
+#include "httpclient.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <QDateTime>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 //См. "avatarcache.h"
+
+void AvatarScaleWorker::makeThumbnail(const QString& username,
+                                      const QString& sourcePath,
+                                      int size,
+                                      const QString& thumbPath)
+{
+    QImage original(sourcePath);
+    if (original.isNull()) {
+        qDebug() << "[AvatarCache] Не удалось декодировать оригинал для"
+                 << username << sourcePath;
+        return;
+    }
+
+    // Уменьшаем с запасом по меньшей стороне и обрезаем в круг
+    QImage scaled = original.scaled(size, size,
+                                    Qt::KeepAspectRatioByExpanding,
+                                    Qt::SmoothTransformation);
+
+    QImage thumb(size, size, QImage::Format_ARGB32_Premultiplied);
+    thumb.fill(Qt::transparent);
+    {
+        QPainter p(&thumb);
+        p.setRenderHint(QPainter::Antialiasing);
+        QPainterPath path;
+        path.addEllipse(0, 0, size, size);
+        p.setClipPath(path);
+        p.drawImage(QPoint((size - scaled.width()) / 2,
+                           (size - scaled.height()) / 2),
+                    scaled);
+    }
+
+    // Персистентный ярус: повторный запуск приложения декод не повторяет
+    if (!thumb.save(thumbPath, "PNG")) {
+        qDebug() << "[AvatarCache] Не удалось сохранить миниатюру" << thumbPath;
+    }
+
+    emit thumbnailReady(username, size, thumb);
+}
+
+QPixmap AvatarCache::thumbnail(const QString& username,
+                               const QString& sourcePath,
+                               int size)
+{
+    if (username.isEmpty() || size <= 0)
+        return QPixmap();
+
+    const QPair<QString, int> key(username, size);
+
+    // 1. Кеш в памяти
+    auto it = m_thumbCache.constFind(key);
+    if (it != m_thumbCache.constEnd()) {
+        m_thumbLru.removeOne(key);
+        m_thumbLru.append(key);
+        return it.value();
+    }
+
+    // 2. Готовый PNG на диске (дешевый декод маленького файла)
+    const QString thumbPath =
+        m_thumbDir.filePath(username + "_" + QString::number(size) + ".png");
+    QFile thumbFile(thumbPath);
+    if (thumbFile.exists() && thumbFile.size() > 0) {
+        QPixmap pm(thumbPath);
+        if (!pm.isNull()) {
+            insertThumbnail(key, pm);
+            return pm;
+        }
+    }
+
+    // 3. Промах: изготовление уходит в рабочий поток (один раз на ключ)
+    const QString pendingKey = username + ":" + QString::number(size);
+    if (!sourcePath.isEmpty() && !m_pendingThumbs.contains(pendingKey)) {
+        m_pendingThumbs.insert(pendingKey);
+        QMetaObject::invokeMethod(m_scaleWorker, "makeThumbnail",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QString, username),
+                                  Q_ARG(QString, sourcePath),
+                                  Q_ARG(int, size),
+                                  Q_ARG(QString, thumbPath));
+    }
+    return QPixmap();
+}
+
+void AvatarCache::onThumbnailReady(const QString& username, int size,
+                                   const QImage& image)
+{
+    m_pendingThumbs.remove(username + ":" + QString::number(size));
+    insertThumbnail({ username, size }, QPixmap::fromImage(image));
+    emit avatarThumbnailReady(username, size);
+}
+
+void AvatarCache::insertThumbnail(const QPair<QString, int>& key,
+                                  const QPixmap& pixmap)
+{
+    m_thumbCache.insert(key, pixmap);
+    m_thumbLru.removeOne(key);
+    m_thumbLru.append(key);
+
+    // Вытесняем самые давние миниатюры сверх лимита (диск не трогаем)
+    while (m_thumbLru.size() > MaxThumbnails) {
+        m_thumbCache.remove(m_thumbLru.takeFirst());
+    }
+}
+
+void AvatarCache::invalidateThumbnails(const QString& username)
+{
+    // Память: убираем все размеры этого пользователя
+    for (auto it = m_thumbCache.begin(); it != m_thumbCache.end();) {
+        if (it.key().first == username) {
+            m_thumbLru.removeOne(it.key());
+            it = m_thumbCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Диск: файлы вида <username>_<size>.png
+    const QStringList stale =
+        m_thumbDir.entryList({ username + "_*.png" }, QDir::Files);
+    for (const QString& name : stale) {
+        m_thumbDir.remove(name);
+    }
+}
+
+void AvatarCache::ensureAvatar(const QString& username, const QString& avatarUrl)
+{
+    // Проверяем валидность входных данных
+    if (username.isEmpty() || avatarUrl.isEmpty())
+        return;
+
+    const QString localPath = m_avatarDir.filePath(username + ".jpg");
+
+    QFile localFile(localPath);
+    if (localFile.exists() && localFile.size() > 0) {
+        // Аватар уже есть в кеше - возвращаем немедленно
+        emit avatarDownloaded(username, localPath);
+        return;
+    }
+
+    // Негативный кэш: URL уже не разрешался — ждем окончания бэкоффа
+    const auto negIt = m_negativeCache.constFind(username);
+    if (negIt != m_negativeCache.constEnd()
+        && negIt->nextAttemptMs > QDateTime::currentMSecsSinceEpoch()) {
+        return;
+    }
+
+    // Дедупликация: загрузка уже в очереди или в полете
+    if (m_queuedOrActive.contains(username))
+        return;
+
+    m_queuedOrActive.insert(username);
+    m_downloadQueue.append({ username, avatarUrl });
+    startNextDownload();
+}
+
+void AvatarCache::prioritize(const QString& username)
+{
+    // Поднимаем в голову очереди; уже активную загрузку не трогаем
+    for (int i = 1; i < m_downloadQueue.size(); ++i) {
+        if (m_downloadQueue.at(i).first == username) {
+            m_downloadQueue.move(i, 0);
+            return;
+        }
+    }
+}
+
+void AvatarCache::startNextDownload()
+{
+    // Держим в полете не больше MaxConcurrentDownloads запросов: залп
+    // из сотен аватаров при логине не должен душить сокет сообщений
+    while (m_activeDownloads < MaxConcurrentDownloads
+           && !m_downloadQueue.isEmpty()) {
+        const QPair<QString, QString> next = m_downloadQueue.takeFirst();
+        const QString username = next.first;
+        const QString localPath = m_avatarDir.filePath(username + ".jpg");
+
+        // Общий HTTP-слой: keep-alive соединения, кэш DNS, запись на диск
+        // по мере прихода и докачка хвоста после обрыва
+        QUrl fileUrl("http://localhost:9090/files/download/" + next.second);
+        ++m_activeDownloads;
+        HttpClient::instance()->download(
+            fileUrl, localPath, HttpClient::Lane::Background,
+            [this, username](bool ok, const QString& error) {
+                onDownloadFinished(username, ok, error);
+            });
+    }
+}
+
+void AvatarCache::onDownloadFinished(const QString& username, bool ok,
+                                     const QString& error)
+{
+    --m_activeDownloads;
+    m_queuedOrActive.remove(username);
+
+    if (ok) {
+        const QString localPath = m_avatarDir.filePath(username + ".jpg");
+        // Старые миниатюры сделаны с прежнего оригинала
+        invalidateThumbnails(username);
+        emit avatarDownloaded(username, localPath);
+        qDebug() << "[AvatarCache] Скачан аватар для" << username << localPath;
+
+        // Успех снимает историю неудач
+        if (m_negativeCache.remove(username) > 0) {
+            saveNegativeCache();
+        }
+    } else {
+        // Неудача: удваиваем паузу до следующей попытки (минута -> час)
+        NegativeEntry& entry = m_negativeCache[username];
+        entry.failures += 1;
+        const qint64 backoff =
+            qMin(BackoffCapMs, BackoffBaseMs << qMin(entry.failures - 1, 10));
+        entry.nextAttemptMs = QDateTime::currentMSecsSinceEpoch() + backoff;
+        saveNegativeCache();
+        qDebug() << "[AvatarCache] Аватар" << username << "не скачался ("
+                 << error << "), следующая попытка через"
+                 << backoff / 1000 << "с";
+    }
+
+    startNextDownload();
+}
+
+void AvatarCache::loadNegativeCache()
+{
+    QFile file(m_avatarDir.filePath("negative_cache.json"));
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    for (auto it = root.constBegin(); it != root.constEnd(); ++it) {
+        const QJsonObject entryObj = it.value().toObject();
+        NegativeEntry entry;
+        entry.failures = entryObj["failures"].toInt();
+        entry.nextAttemptMs = qint64(entryObj["next_attempt_ms"].toDouble());
+        m_negativeCache.insert(it.key(), entry);
+    }
+
+    if (!m_negativeCache.isEmpty()) {
+        qDebug() << "[AvatarCache] Негативный кэш:" << m_negativeCache.size()
+                 << "записей из прошлых сессий";
+    }
+}
+
+void AvatarCache::saveNegativeCache() const
+{
+    QJsonObject root;
+    for (auto it = m_negativeCache.constBegin();
+         it != m_negativeCache.constEnd(); ++it) {
+        QJsonObject entryObj;
+        entryObj["failures"] = it->failures;
+        entryObj["next_attempt_ms"] = double(it->nextAttemptMs);
+        root.insert(it.key(), entryObj);
+    }
+
+    QFile file(m_avatarDir.filePath("negative_cache.json"));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    }
+}
@@ -2,10 +2,40 @@
 #define AVATARCACHE_H
 
 #include <QObject>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
 #include <QFile>
 #include <QDir>
+#include <QImage>
+#include <QPixmap>
+#include <QSet>
+#include <QThread>
+
+/**
+ * @brief Фоновое изготовление миниатюр аватаров.
+ *
+ * Живет в отдельном потоке: декодирует оригинал, уменьшает до точного
+ * экранного размера, скругляет в круг и сохраняет PNG на диск, чтобы
+ * ни декодирование, ни масштабирование не выполнялись в paint().
+ */
+class AvatarScaleWorker : public QObject {
+    Q_OBJECT
+
+public slots:
+    /**
+     * @brief Делает круглую миниатюру заданного размера.
+     * @param username Имя пользователя (ключ кеша)
+     * @param sourcePath Путь к оригиналу аватара
+     * @param size Сторона миниатюры в пикселях
+     * @param thumbPath Путь для сохранения готового PNG
+     */
+    void makeThumbnail(const QString& username, const QString& sourcePath,
+                       int size, const QString& thumbPath);
+
+signals:
+    /**
+     * @brief Готовая миниатюра (QImage безопасен между потоками).
+     */
+    void thumbnailReady(const QString& username, int size, const QImage& image);
+};
 
 /**
  * @brief Класс для кеширования аватаров пользователей
@@ -27,15 +57,54 @@ public:
      * @param parent Родительский QObject для управления временем жизни
      */
     explicit AvatarCache(QObject* parent = nullptr)
-        : QObject(parent),
-        m_networkManager(new QNetworkAccessManager(this))
+        : QObject(parent)
     {
         // Создаем директорию для кеша в текущей рабочей директории
         m_avatarDir = QDir(QDir::currentPath() + "/avatars_cache");
         if (!m_avatarDir.exists())
             QDir().mkpath(m_avatarDir.path());
+
+        // Отдельный ярус миниатюр: <avatars_cache>/thumbs/<user>_<size>.png
+        m_thumbDir = QDir(m_avatarDir.filePath("thumbs"));
+        if (!m_thumbDir.exists())
+            QDir().mkpath(m_thumbDir.path());
+
+        // Поток изготовления миниатюр (декод + уменьшение вне GUI)
+        m_scaleWorker = new AvatarScaleWorker();
+        m_scaleWorker->moveToThread(&m_scaleThread);
+        connect(&m_scaleThread, &QThread::finished, m_scaleWorker, &QObject::deleteLater);
+        connect(m_scaleWorker, &AvatarScaleWorker::thumbnailReady,
+                this, &AvatarCache::onThumbnailReady);
+        m_scaleThread.setObjectName("avatar-scale");
+        m_scaleThread.start();
+
+        // Негативный кэш прошлых сессий: не долбить сервер по URL,
+        // которые уже не разрешались
+        loadNegativeCache();
     }
 
+    /** @brief Деструктор. Останавливает поток миниатюр. */
+    ~AvatarCache() override {
+        m_scaleThread.quit();
+        m_scaleThread.wait();
+    }
+
+    /**
+     * @brief Возвращает круглую миниатюру аватара точного экранного размера.
+     *
+     * Сначала проверяется ограниченный кеш QPixmap в памяти (ключ —
+     * пара имя/размер), затем PNG на диске; при промахе изготовление
+     * уходит в рабочий поток, а вызывающий получает пустой QPixmap и
+     * рисует запасной аватар. О готовности сообщает сигнал
+     * avatarThumbnailReady — достаточно перерисовать вьюпорт.
+     *
+     * @param username Имя пользователя
+     * @param sourcePath Путь к локальному оригиналу аватара
+     * @param size Сторона миниатюры в пикселях
+     * @return Готовая миниатюра или пустой QPixmap, если она еще делается
+     */
+    QPixmap thumbnail(const QString& username, const QString& sourcePath, int size);
+
     /**
      * @brief Получает аватар пользователя из кеша или скачивает с сервера
      *
@@ -48,48 +117,25 @@ public:
      *
      * @note Функция асинхронная - результат возвращается через сигнал avatarDownloaded
      * @note Пустые параметры игнорируются без генерации сигнала
+     *
+     * Загрузки идут через планировщик: одновременно не более
+     * MaxConcurrentDownloads запросов (залп из сотен аватаров при логине
+     * не душит сокет сообщений), остальные ждут в очереди. URL, которые
+     * не разрешились, попадают в негативный кэш с экспоненциальным
+     * бэкоффом, переживающим перезапуск приложения.
      */
-    void ensureAvatar(const QString& username, const QString& avatarUrl) {
-        // Проверяем валидность входных данных
-        if (username.isEmpty() || avatarUrl.isEmpty())
-            return;
-
-        QString localPath = m_avatarDir.filePath(username + ".jpg");
-
-        QFile localFile(localPath);
-        if (localFile.exists() && localFile.size() > 0) {
-            // Аватар уже есть в кеше - возвращаем немедленно
-            emit avatarDownloaded(username, localPath);
-            return;
-        }
-
-        // Формируем полный URL для загрузки с локального сервера
-        QUrl fileUrl(avatarUrl);
-        fileUrl = "http://localhost:9090/files/download/" + avatarUrl;
-        QNetworkRequest req(fileUrl);
-        QNetworkReply* reply = m_networkManager->get(req);
-
-        // Обрабатываем завершение загрузки асинхронно
-        connect(reply, &QNetworkReply::finished, this, [=]() {
-            QByteArray data = reply->readAll();
-            if (!data.isEmpty()) {
-                QFile outFile(localPath);
-                if (outFile.open(QIODevice::WriteOnly)) {
-                    // Записываем скачанные данные в файл кеша
-                    outFile.write(data);
-                    outFile.close();
-                    emit avatarDownloaded(username, localPath);
-                    qDebug() << "[AvatarCache] Скачан аватар для" << username << localPath;
-                } else {
-                    qDebug() << "[AvatarCache] Не удалось создать файл для" << username;
-                }
-            } else {
-                qDebug() << "[AvatarCache] Пустой ответ при скачивании аватара" << username;
-            }
-            // Освобождаем память reply после обработки
-            reply->deleteLater();
-        });
-    }
+    void ensureAvatar(const QString& username, const QString& avatarUrl);
+
+    /**
+     * @brief Поднимает запрошенный аватар в голову очереди загрузки.
+     *
+     * Вызывается делегатом списка контактов при отрисовке видимой строки
+     * без миниатюры: видимые пользователи качаются раньше тех, что ниже
+     * по списку.
+     *
+     * @param username Имя пользователя из очереди загрузки
+     */
+    void prioritize(const QString& username);
 
 signals:
     /**
@@ -103,14 +149,29 @@ signals:
      */
     void avatarDownloaded(QString username, QString localPath);
 
-private:
     /**
-     * @brief Менеджер для выполнения HTTP-запросов
+     * @brief Миниатюра аватара готова к отрисовке.
      *
-     * Используется для асинхронной загрузки аватаров с сервера.
-     * Владение передано QObject через parent, автоматически удаляется.
+     * Следующий вызов thumbnail() с теми же параметрами вернет ее из
+     * кеша в памяти; получателю достаточно перерисовать вьюпорт.
+     * @param username Имя пользователя
+     * @param size Сторона миниатюры в пикселях
      */
-    QNetworkAccessManager* m_networkManager;
+    void avatarThumbnailReady(const QString& username, int size);
+
+private slots:
+    /** @brief Принимает готовую миниатюру из рабочего потока. */
+    void onThumbnailReady(const QString& username, int size, const QImage& image);
+
+private:
+    /** @brief Кладет миниатюру в кеш памяти, вытесняя давние сверх лимита. */
+    void insertThumbnail(const QPair<QString, int>& key, const QPixmap& pixmap);
+
+    /** @brief Сбрасывает миниатюры пользователя (память и диск). */
+    void invalidateThumbnails(const QString& username);
+
+    // Предел кеша миниатюр в памяти
+    static constexpr int MaxThumbnails = 256;
 
     /**
      * @brief Директория для хранения кешированных аватаров
@@ -119,6 +180,52 @@ private:
      * Файлы именуются как <username>.jpg
      */
     QDir m_avatarDir;
+
+    QDir m_thumbDir;                 ///< Директория миниатюр (thumbs/)
+    QThread m_scaleThread;           ///< Поток изготовления миниатюр
+    AvatarScaleWorker* m_scaleWorker;///< Работник (живет в m_scaleThread)
+
+    /** @brief Кеш миниатюр в памяти. Ключ: пара <имя, размер>. */
+    QMap<QPair<QString, int>, QPixmap> m_thumbCache;
+
+    /** @brief Порядок использования ключей миниатюр (конец — свежие). */
+    QList<QPair<QString, int>> m_thumbLru;
+
+    /** @brief Миниатюры, уже отданные в работу (ключ "<имя>:<размер>"). */
+    QSet<QString> m_pendingThumbs;
+
+    /** @brief Запускает загрузки из головы очереди до предела параллелизма. */
+    void startNextDownload();
+
+    /** @brief Разбирает завершенную загрузку (успех/негативный кэш). */
+    void onDownloadFinished(const QString& username, bool ok,
+                            const QString& error);
+
+    /** @brief Читает негативный кэш из negative_cache.json. */
+    void loadNegativeCache();
+
+    /** @brief Сохраняет негативный кэш на диск. */
+    void saveNegativeCache() const;
+
+    /** @brief Запись негативного кэша: число неудач и момент следующей попытки. */
+    struct NegativeEntry {
+        int failures = 0;        ///< Подряд неудачных попыток
+        qint64 nextAttemptMs = 0;///< Раньше этого момента (мс epoch) не пробовать
+    };
+
+    // Предел одновременных HTTP-загрузок аватаров
+    static constexpr int MaxConcurrentDownloads = 4;
+
+    // Бэкофф негативного кэша: минута, удваивается до часа
+    static constexpr qint64 BackoffBaseMs = 60 * 1000;
+    static constexpr qint64 BackoffCapMs  = 60 * 60 * 1000;
+
+    QList<QPair<QString, QString>> m_downloadQueue; ///< Очередь <имя, URL>, голова — следующая
+    QSet<QString> m_queuedOrActive;                 ///< Имена в очереди или в полете
+    int m_activeDownloads = 0;                      ///< Загрузок в полете сейчас
+
+    /** @brief Негативный кэш: имя -> история неудач (персистентен). */
+    QHash<QString, NegativeEntry> m_negativeCache;
 };
 
 #endif // AVATARCACHE_H
@@ -0,0 +1,108 @@
+/**
+ * @file binarycodec.cpp
+ * @brief Реализация компактного бинарного кодека.
+ *
+ * @details Поля записей сериализуются через QDataStream (версия Qt_6_2 —
+ * та же, что у фрейминга TCP-канала), поэтому представление строк и целых
+ * гарантированно одинаково на клиенте и сервере. Состав записей кодек не
+ * знает: и кодирование, и декодирование — циклы по дескриптору из
+ * реестра ProtocolSchema, единому для обеих сторон.
+ */
+
+#include <QDataStream>
+#include <QIODevice>
+#include <QDebug>
+
+#include "binarycodec.h"
+#include "protocolschema.h"
+
+bool BinaryCodec::isBinary(const QByteArray& payload)
+{
+    return !payload.isEmpty()
+           && static_cast<quint8>(payload.at(0)) == Magic;
+}
+
+
+QByteArray BinaryCodec::encode(const QJsonObject& json)
+{
+    // Дескриптор выбирается по типу и составу полей: у статусов две формы
+    // (одиночная с id и диапазонная с from/up_to_id), пакетные варианты
+    // (массив ids) не подходят под плоскую запись и уходят как JSON
+    const ProtocolSchema::MessageDescriptor* desc =
+        ProtocolSchema::byJson(json);
+    if (!desc) {
+        return QByteArray();
+    }
+
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_2);
+    out << Magic << desc->tag;
+
+    for (int i = 0; i < desc->fieldCount; ++i) {
+        const ProtocolSchema::Field& field = desc->fields[i];
+        const QJsonValue value = json[QLatin1String(field.name)];
+        switch (field.kind) {
+        case ProtocolSchema::FieldKind::String:
+            out << value.toString();
+            break;
+        case ProtocolSchema::FieldKind::MessageId:
+            out << quint64(value.toDouble());
+            break;
+        }
+    }
+
+    return record;
+}
+
+
+QJsonObject BinaryCodec::decode(const QByteArray& payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_6_2);
+
+    quint8 magic = 0;
+    quint8 tag = 0;
+    in >> magic >> tag;
+
+    if (magic != Magic) {
+        qWarning() << "[CODEC] Not a binary record (magic:" << magic << ")";
+        return QJsonObject();
+    }
+
+    const ProtocolSchema::MessageDescriptor* desc = ProtocolSchema::byTag(tag);
+    if (!desc) {
+        qWarning() << "[CODEC] Unknown binary record tag:" << tag;
+        return QJsonObject();
+    }
+
+    // Восстанавливаем ровно то JSON-представление, что отправитель передал
+    // бы в JSON-режиме: дальнейшая маршрутизация по "type" не меняется
+    QJsonObject json;
+    json["type"] = QLatin1String(desc->type);
+
+    for (int i = 0; i < desc->fieldCount; ++i) {
+        const ProtocolSchema::Field& field = desc->fields[i];
+        switch (field.kind) {
+        case ProtocolSchema::FieldKind::String: {
+            QString value;
+            in >> value;
+            json[QLatin1String(field.name)] = value;
+            break;
+        }
+        case ProtocolSchema::FieldKind::MessageId: {
+            quint64 value = 0;
+            in >> value;
+            json[QLatin1String(field.name)] = static_cast<double>(value);
+            break;
+        }
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "[CODEC] Truncated binary record (tag:" << tag << ")";
+        return QJsonObject();
+    }
+
+    return json;
+}
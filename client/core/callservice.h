@@ -2,15 +2,12 @@
 #define CALLSERVICE_H
 
 #include <QObject>
-#include <QUdpSocket>
-#include <QAudioSource>
-#include <QAudioSink>
+#include <QHostAddress>
 #include <QTimer>
-#include <opus.h>
-#include <QByteArray>
-#include <QMap>
+#include <QThread>
 class NetworkService;
 class DataService;
+class AudioEngine;
 
 /**
  * @brief Сервис управления P2P аудиозвонком с потоковой обработкой аудио
@@ -105,23 +102,33 @@ signals:
     void callError(const QString& error);
     /** @brief Обновление длительности звонка (сек). @param seconds Длительность */
     void callDurationUpdated(int seconds);
+    /**
+     * @brief Посекундная телеметрия качества звонка (ретрансляция из AudioEngine).
+     * @param jitterMs Джиттер, мс
+     * @param lossPercent Потери за секунду, %
+     * @param reorderCount Пакетов вне порядка
+     * @param rttMs RTT, мс (-1 — еще не измерен)
+     * @param concealedFrames Скрытых кадров с начала звонка
+     */
+    void callStatsUpdated(double jitterMs, int lossPercent, int reorderCount,
+                          int rttMs, qlonglong concealedFrames);
+    /**
+     * @brief Тюнер энкодера сменил рабочую точку (ретрансляция из AudioEngine).
+     * @param complexity Сложность Opus (0-10)
+     * @param bitrateBps Битрейт, бит/с
+     */
+    void callOperatingPointChanged(int complexity, int bitrateBps);
 
 private slots:
-    /** @brief Готовность входных аудиоданных к обработке и отправке. */
-    void onAudioInputReady();
-    /** @brief Приём и обработка поступающих аудиоданных. */
-    void onAudioDataReceived();
     /** @brief Таймер контроля событий вызова (длительность и переотправка). */
     void onCallTimerTimeout();
-    /** @brief Обработка пакетов в jitter buffer. */
-    void processJitterBuffer();
 
 private:
-    /** @brief Инициализация UDP сокета для обмена медиа. */
-    void initializeUdpSocket();
-    /** @brief Запуск аудиопотока. */
+    /** @brief Запуск выделенного аудиопотока и движка медиа-тракта. */
+    void initializeAudioEngine();
+    /** @brief Запуск аудиопотока (команда движку). */
     void startAudioStreaming();
-    /** @brief Остановка аудиопотока. */
+    /** @brief Остановка аудиопотока (команда движку). */
     void stopAudioStreaming();
     /** @brief Отправка инициирующего запроса вызова. */
     void sendCallRequest(const QString& toUser);
@@ -140,26 +147,19 @@ private:
     QString m_remoteIp;               /*!< Строка IP для peer */
     quint16 m_remotePort;             /*!< UDP порт peer */
     QHostAddress m_remoteAddress;     /*!< IP адрес peer в виде QHostAddress */
-    QUdpSocket* m_udpSocket;          /*!< UDP сокет передачи аудио данных */
-    quint16 m_localPort;              /*!< Локальный UDP порт */
-    QAudioSource* m_audioSource;      /*!< Захват устройства (микрофон) */
-    QAudioSink* m_audioSink;          /*!< Воспроизведение (динамик) */
-    QIODevice* m_audioInput;          /*!< Входной поток аудио */
-    QIODevice* m_audioOutput;         /*!< Выходной поток аудио */
+    quint16 m_localPort;              /*!< Локальный UDP порт (сообщает AudioEngine) */
     QTimer* m_callTimer;              /*!< Таймер длительности вызова */
     int m_callDuration;               /*!< Текущая длительность вызова */
-    qint64 m_audioBytesSent;          /*!< Отправлено байт аудиоданных */
-    qint64 m_audioPacketsSent;        /*!< Отправлено аудиопакетов */
-    qint64 m_audioBytesReceived;      /*!< Принято байт аудиоданных */
-    qint64 m_audioPacketsReceived;    /*!< Принято аудиопакетов */
     QString m_myIp;                   /*!< IP адрес этого клиента */
-    OpusEncoder* m_opusEncoder;       /*!< Экземпляр Opus-энкодера (кодирование PCM->Opus) */
-    OpusDecoder* m_opusDecoder;       /*!< Экземпляр Opus-декодера (Opus->PCM) */
-    quint64 m_lastSeqNum = 0;         /*!< Последний обработанный seq номер */
-    quint64 m_sequenceNumber = 0;     /*!< Следующий seq номер для передачи */
-    QMap<quint64, QByteArray> m_jitterBuffer; /*!< Jitter buffer для сглаживания сети */
-    quint64 m_nextSeqToPlay = 0;              /*!< seq номер следующего буфера на воспроизведение */
-    QTimer* m_jitterTimer = nullptr;          /*!< Таймер обслуживания jitter buffer */
+    QThread* m_audioThread = nullptr; /*!< Выделенный поток "call-audio" */
+    AudioEngine* m_audioEngine = nullptr; /*!< Медиа-тракт на аудиопотоке */
+
+    // Последняя телеметрия качества: уходит на сервер вместе с call_end
+    double m_statJitterMs = 0.0;      /*!< Джиттер на момент последнего отчета */
+    int m_statLossPercent = 0;        /*!< Потери за последнее окно, % */
+    int m_statReorderCount = 0;       /*!< Пакетов вне порядка */
+    int m_statRttMs = -1;             /*!< Последний RTT, мс */
+    qlonglong m_statConcealed = 0;    /*!< Скрытых кадров за звонок */
 };
 
 #endif
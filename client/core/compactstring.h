@@ -0,0 +1,205 @@
+#ifndef COMPACTSTRING_H
+#define COMPACTSTRING_H
+
+#include <QString>
+#include <QByteArray>
+#include <QDebug>
+#include <QtGlobal>
+#include <cstring>
+
+/**
+ * @brief Компактное UTF-8 хранилище коротких строк кэша сообщений.
+ *
+ * Текст типичного сообщения — пара десятков символов, но QString хранит
+ * его в UTF-16 и всегда в куче: в кэше из тысяч ChatMessage именно эти
+ * аллокации доминируют, а буферы разбросаны по памяти и портят
+ * локальность проходов (поиск, пересборка модели). CompactString держит
+ * до InlineCapacity байт UTF-8 прямо в теле объекта (без единой
+ * аллокации) и уходит в кучу только для длинных строк.
+ *
+ * Это хранилище кэша, а не замена QString: в QString (UTF-16 для
+ * отрисовки и API Qt) значение конвертируется на границе отображения —
+ * неявным operator QString() или явным toString(). Горячие операции
+ * кэша (сравнение, хеш, проверка пустоты) работают по UTF-8 байтам
+ * без конвертации.
+ *
+ * Используется для полей ChatMessage payload/fileName/tempId
+ * (см. structures.h); имена пользователей с малой кардинальностью
+ * по-прежнему интернируются через StringPool.
+ */
+class CompactString
+{
+public:
+    /** @brief Байт UTF-8 в теле объекта (выше — строка уходит в кучу). */
+    static constexpr int InlineCapacity = 23;
+
+    CompactString() = default;
+
+    /** @brief Конвертация из QString (UTF-16 -> UTF-8), неявная намеренно. */
+    CompactString(const QString& value)
+    {
+        const QByteArray utf8 = value.toUtf8();
+        assign(utf8.constData(), utf8.size());
+    }
+
+    /** @brief Конвертация из литерала (исходники в UTF-8). */
+    CompactString(const char* utf8)
+    {
+        assign(utf8, int(qstrlen(utf8)));
+    }
+
+    CompactString(const CompactString& other)
+    {
+        assign(other.constData(), other.size());
+    }
+
+    CompactString(CompactString&& other) noexcept
+    {
+        // Куча переезжает указателем; inline-байты копируются
+        stealFrom(other);
+    }
+
+    ~CompactString()
+    {
+        if (m_len == HeapTag) {
+            delete[] m_heap.data;
+        }
+    }
+
+    CompactString& operator=(const CompactString& other)
+    {
+        if (this != &other) {
+            assign(other.constData(), other.size());
+        }
+        return *this;
+    }
+
+    CompactString& operator=(CompactString&& other) noexcept
+    {
+        if (this != &other) {
+            if (m_len == HeapTag) {
+                delete[] m_heap.data;
+            }
+            stealFrom(other);
+        }
+        return *this;
+    }
+
+    CompactString& operator=(const QString& value)
+    {
+        const QByteArray utf8 = value.toUtf8();
+        assign(utf8.constData(), utf8.size());
+        return *this;
+    }
+
+    /** @brief Длина в байтах UTF-8 (не в символах). */
+    int size() const { return m_len == HeapTag ? m_heap.size : int(m_len); }
+
+    bool isEmpty() const { return size() == 0; }
+
+    /** @brief Сырые UTF-8 байты (без завершающего нуля). */
+    const char* constData() const
+    {
+        return m_len == HeapTag ? m_heap.data : m_inlineBytes;
+    }
+
+    void clear()
+    {
+        if (m_len == HeapTag) {
+            delete[] m_heap.data;
+        }
+        m_len = 0;
+    }
+
+    /** @brief Конвертация в QString — граница отображения. */
+    QString toString() const
+    {
+        return QString::fromUtf8(constData(), size());
+    }
+
+    operator QString() const { return toString(); }
+
+    bool operator==(const CompactString& other) const
+    {
+        return size() == other.size()
+            && std::memcmp(constData(), other.constData(), size_t(size())) == 0;
+    }
+    bool operator!=(const CompactString& other) const { return !(*this == other); }
+
+    bool operator==(const char* utf8) const
+    {
+        const int n = int(qstrlen(utf8));
+        return size() == n && std::memcmp(constData(), utf8, size_t(n)) == 0;
+    }
+    bool operator!=(const char* utf8) const { return !(*this == utf8); }
+
+    bool operator==(const QString& value) const { return toString() == value; }
+    bool operator!=(const QString& value) const { return !(*this == value); }
+
+private:
+    /** @brief Метка в байте длины: данные лежат в куче. */
+    static constexpr quint8 HeapTag = 0xFF;
+
+    struct HeapData {
+        char* data;
+        qint32 size;
+    };
+
+    void stealFrom(CompactString& other) noexcept
+    {
+        if (other.m_len == HeapTag) {
+            m_heap = other.m_heap;
+        } else {
+            std::memcpy(m_inlineBytes, other.m_inlineBytes, sizeof(m_inlineBytes));
+        }
+        m_len = other.m_len;
+        other.m_len = 0;
+    }
+
+    void assign(const char* bytes, int n)
+    {
+        if (n <= InlineCapacity) {
+            if (m_len == HeapTag) {
+                // Источник может указывать в освобождаемый буфер —
+                // копия снимается до удаления
+                char tmp[InlineCapacity];
+                std::memcpy(tmp, bytes, size_t(n));
+                delete[] m_heap.data;
+                std::memcpy(m_inlineBytes, tmp, size_t(n));
+            } else {
+                std::memmove(m_inlineBytes, bytes, size_t(n));
+            }
+            m_len = quint8(n);
+            return;
+        }
+
+        char* data = new char[size_t(n)];
+        std::memcpy(data, bytes, size_t(n));
+        if (m_len == HeapTag) {
+            delete[] m_heap.data;
+        }
+        m_heap.data = data;
+        m_heap.size = n;
+        m_len = HeapTag;
+    }
+
+    union {
+        char m_inlineBytes[InlineCapacity] = {};
+        HeapData m_heap;
+    };
+    quint8 m_len = 0; ///< Длина inline-данных либо HeapTag
+};
+
+/** @brief Хеш по UTF-8 байтам без конвертации (кэши делегата и пр.). */
+inline size_t qHash(const CompactString& key, size_t seed = 0)
+{
+    return qHash(QByteArray::fromRawData(key.constData(), key.size()), seed);
+}
+
+/** @brief Вывод в журнал наравне с QString. */
+inline QDebug operator<<(QDebug dbg, const CompactString& value)
+{
+    return dbg << value.toString();
+}
+
+#endif // COMPACTSTRING_H
@@ -0,0 +1,72 @@
+/**
+ * @file compression.cpp
+ * @brief Реализация сжатия крупных полезных нагрузок.
+ */
+
+#include "compression.h"
+
+bool Compression::isCompressed(const QByteArray &payload)
+{
+    return !payload.isEmpty() && quint8(payload.at(0)) == Magic;
+}
+
+
+QByteArray Compression::wrap(const QByteArray &payload)
+{
+    if (payload.size() < MinSize) {
+        return QByteArray();
+    }
+
+    // Уровень по умолчанию (zlib 6) — лучший баланс для JSON: максимальный
+    // уровень дает единицы процентов выигрыша при кратном росте CPU.
+    const QByteArray compressed = qCompress(payload);
+
+    // Несжимаемая нагрузка (например, уже сжатые вложения внутри JSON):
+    // отправка исходных байт дешевле и для сервера, и для клиента.
+    if (compressed.size() + 1 >= payload.size()) {
+        return QByteArray();
+    }
+
+    QByteArray record;
+    record.reserve(1 + compressed.size());
+    record.append(char(Magic));
+    record.append(compressed);
+    return record;
+}
+
+
+QByteArray Compression::unwrap(const QByteArray &payload)
+{
+    if (!isCompressed(payload)) {
+        return QByteArray();
+    }
+
+    // qUncompress проверяет согласованность заголовка размера сам:
+    // при порче данных вернется пустой QByteArray.
+    return qUncompress(payload.mid(1));
+}
+
+
+QVariant Compression::packText(const QString &text)
+{
+    const QByteArray packed = wrap(text.toUtf8());
+    if (packed.isEmpty()) {
+        return text; // Короткий или несжимаемый текст хранится как есть
+    }
+    return packed;
+}
+
+
+QString Compression::unpackText(const QVariant &value)
+{
+    // BLOB приходит из курсора как QByteArray, текст — как QString;
+    // сжатую запись выдает первый байт Magic
+    if (value.userType() == QMetaType::QByteArray) {
+        const QByteArray raw = value.toByteArray();
+        if (isCompressed(raw)) {
+            return QString::fromUtf8(unwrap(raw));
+        }
+        return QString::fromUtf8(raw);
+    }
+    return value.toString();
+}
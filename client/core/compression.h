@@ -0,0 +1,83 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+
+/**
+ * @class Compression
+ * @brief Сжатие крупных полезных нагрузок перед шифрованием.
+ *
+ * @details Страница истории на 500 сообщений — это ~200 КБ несжатого JSON
+ * на проводе; на мобильном канале такая выдача занимает секунды. Сжатие
+ * согласовывается на соединение (по образцу binary_mode): клиент присылает
+ * `{"type":"compression","algorithm":"deflate"}`, сервер отвечает
+ * `compression_ack`, и с этого момента полезные нагрузки крупнее MinSize
+ * сжимаются ПЕРЕД шифрованием (шифротекст несжимаем по построению).
+ *
+ * Формат сжатой записи:
+ *
+ *     [Magic 0xC7 (1 байт)] [вывод qCompress (4 байта размера + deflate)]
+ *
+ * Приемник различает содержимое расшифрованного кадра по первому байту:
+ * JSON начинается с '{' (0x7B), бинарная запись BinaryCodec — с 0xB1,
+ * сжатая запись — с 0xC7. После распаковки первый байт проверяется снова
+ * (внутри может лежать и JSON, и бинарная запись).
+ *
+ * Алгоритм — deflate через qCompress: он встроен в Qt и не тянет новую
+ * зависимость; типовые JSON-нагрузки (повторяющиеся имена полей) он
+ * ужимает в 5-8 раз. Словарные кодеки дали бы больше на мелких ответах,
+ * но мелкие ответы и не сжимаются — порог MinSize отсекает их целиком.
+ */
+class Compression
+{
+public:
+    /** @brief Первый байт сжатой записи. Не совпадает с '{' и Magic BinaryCodec. */
+    static constexpr quint8 Magic = 0xC7;
+
+    /** @brief Порог сжатия, байт: ниже него выигрыш не окупает CPU. */
+    static constexpr int MinSize = 1024;
+
+    /**
+     * @brief Проверяет, является ли расшифрованный кадр сжатой записью.
+     */
+    static bool isCompressed(const QByteArray &payload);
+
+    /**
+     * @brief Сжимает полезную нагрузку в запись с Magic-префиксом.
+     * @return Сжатая запись или пустой QByteArray, если нагрузка меньше
+     *         порога либо сжатие не дало выигрыша (тогда слать исходную).
+     */
+    static QByteArray wrap(const QByteArray &payload);
+
+    /**
+     * @brief Распаковывает сжатую запись.
+     * @return Исходная полезная нагрузка или пустой QByteArray при порче данных.
+     */
+    static QByteArray unwrap(const QByteArray &payload);
+
+    /**
+     * @brief Упаковывает текст для хранения в БД (сжатие "в покое").
+     *
+     * Длинные тексты сообщений лежат в таблицах несжатыми и составляют
+     * основную массу файла БД. Значение крупнее MinSize сжимается той же
+     * записью wrap() и хранится BLOB'ом; короткое или несжимаемое —
+     * исходной строкой. Читатель различает форматы по первому байту
+     * (Magic против текста), поэтому старые несжатые строки читаются
+     * без миграции.
+     *
+     * @param text Текст колонки.
+     * @return BLOB сжатой записи либо исходная строка.
+     */
+    static QVariant packText(const QString &text);
+
+    /**
+     * @brief Распаковывает значение колонки, записанное packText().
+     * @param value Значение из курсора запроса (строка или BLOB).
+     * @return Исходный текст.
+     */
+    static QString unpackText(const QVariant &value);
+};
+
+#endif // COMPRESSION_H
@@ -5,6 +5,9 @@
 #include <QByteArray>
 #include <QDebug>
 #include <QRandomGenerator>
+#include <QtEndian> // Сборка кадров потокового AEAD (big-endian префикс длины)
+#include <atomic>
+#include <cstring> // memcpy для нонсов направлений потокового AEAD
 #include "monocypher.h"
 
 /**
@@ -60,8 +63,12 @@ public:
 class CryptoManager {
     uint8_t secretKey[32];  ///< Собственный приватный ключ (должен храниться в секрете)
     uint8_t publicKey[32];  ///< Собственный публичный ключ (передается собеседнику)
-    uint8_t sharedKey[32];  ///< Вычисленный общий ключ сессии
-    bool ready = false;     ///< Флаг готовности шифрования (ключ вычислен)
+    uint8_t sharedKey[32];          ///< Вычисленный общий ключ сессии
+    std::atomic<bool> ready{false}; ///< Флаг готовности (читается из GUI-потока и потока декодера)
+
+    bool streamMode = false; ///< Потоковый AEAD согласован (только поток декодера)
+    crypto_aead_ctx txCtx;   ///< Контекст исходящего направления (подключ и счетчик)
+    crypto_aead_ctx rxCtx;   ///< Контекст входящего направления (подключ и счетчик)
 
 public:
     /**
@@ -106,6 +113,150 @@ public:
         qDebug() << "Shared Secret Hex:" << QByteArray((char*)sharedKey, 32).toHex();
     }
 
+    /**
+     * @brief Запечатывает 0-RTT пакет возобновления сессии.
+     *
+     * Вычисляет одноразовый ключ X25519(наш секрет, резюм-ключ сервера) и
+     * шифрует им данные (XChaCha20-Poly1305), не трогая состояние сессии:
+     * общий ключ соединения по-прежнему устанавливается ответным
+     * рукопожатием сервера.
+     *
+     * @param serverResumeKey Кэшированный резюм-ключ сервера (32 байта)
+     * @param plaintext Сериализованный token_login для кадра рукопожатия
+     * @return nonce(24) + MAC(16) + шифртекст; пустой массив при неверном ключе
+     */
+    QByteArray sealResumeTicket(const QByteArray& serverResumeKey,
+                                const QByteArray& plaintext) const {
+        if (serverResumeKey.size() != 32) return QByteArray();
+
+        // Одноразовый ключ: обе стороны выведут его независимо
+        uint8_t resumeShared[32];
+        crypto_x25519(resumeShared, secretKey,
+                      (const uint8_t*)serverResumeKey.constData());
+
+        QByteArray out(24 + 16 + plaintext.size(), Qt::Uninitialized);
+        uint8_t* nonce = reinterpret_cast<uint8_t*>(out.data());
+        QRandomGenerator::system()->fillRange(
+            reinterpret_cast<quint32*>(nonce), 24 / 4);
+
+        crypto_aead_lock(
+            reinterpret_cast<uint8_t*>(out.data()) + 24 + 16, // Ciphertext (выход)
+            reinterpret_cast<uint8_t*>(out.data()) + 24,      // MAC (выход)
+            resumeShared,                                     // Key (32 байта)
+            nonce,                                            // Nonce (24 байта)
+            nullptr, 0,                                       // Associated Data (нет)
+            reinterpret_cast<const uint8_t*>(plaintext.constData()),
+            plaintext.size());
+
+        crypto_wipe(resumeShared, 32);
+        return out;
+    }
+
+    /**
+     * @brief Включает потоковый режим AEAD после рукопожатия.
+     *
+     * Сервер подтвердил флаг `aead: 2`: подключи обоих направлений
+     * развертываются один раз здесь (HChaCha20 от ключа сессии и
+     * фиксированного нонса направления — ключ эфемерный, повторения нет),
+     * дальше кадры нумеруются внутренним счетчиком контекста и ратчетят
+     * ключ. Вызывается только в потоке декодера, до первого
+     * зашифрованного кадра; там же выполняются sealStreamFrame и
+     * openStreamBody.
+     *
+     * @param isServer false на клиенте: исходящее направление — c2s
+     */
+    void enableStreamMode(bool isServer) {
+        if (!ready) return;
+
+        uint8_t nonce[24] = {0};
+        memcpy(nonce, isServer ? "s2c" : "c2s", 3);
+        crypto_aead_init_x(&txCtx, sharedKey, nonce);
+        memcpy(nonce, isServer ? "c2s" : "s2c", 3);
+        crypto_aead_init_x(&rxCtx, sharedKey, nonce);
+
+        streamMode = true;
+    }
+
+    /**
+     * @brief Согласован ли потоковый режим AEAD для текущей сессии.
+     * @return true после enableStreamMode
+     */
+    bool isStreamMode() const { return streamMode; }
+
+    /**
+     * @brief Сбрасывает состояние сессии при разрыве соединения.
+     *
+     * Ключ и режим принадлежали мертвой сессии: до нового рукопожатия
+     * кадры снова идут открытым текстом, и ответ сервера на следующее
+     * рукопожатие не должен попасть в ветку расшифровки.
+     */
+    void resetSession() {
+        streamMode = false;
+        ready = false;
+    }
+
+    /**
+     * @brief Запечатывает кадр в потоковом режиме AEAD.
+     *
+     * Раскладка: `[4: длина кадра][16: MAC][N: шифртекст]` — nonce не
+     * передается (неявный счетчик контекста), подключ не развертывается
+     * заново, а префикс длины аутентифицируется как associated data:
+     * подмена длины кадра на проводе ломает MAC, а не парсер.
+     *
+     * @param plaintext Сериализованный пакет (JSON или бинарная запись)
+     * @return Готовый к записи в сокет кадр
+     */
+    QByteArray sealStreamFrame(const QByteArray& plaintext) {
+        constexpr int MacSize = 16;
+
+        const quint32 frameSize = quint32(MacSize + plaintext.size());
+        QByteArray frame(qsizetype(4 + frameSize), Qt::Uninitialized);
+        uint8_t* p = reinterpret_cast<uint8_t*>(frame.data());
+        qToBigEndian<quint32>(frameSize, p);
+
+        crypto_aead_write(
+            &txCtx,
+            p + 4 + MacSize,                                        // шифртекст (выход)
+            p + 4,                                                  // MAC (выход)
+            p, 4,                                                   // AD: префикс длины
+            reinterpret_cast<const uint8_t*>(plaintext.constData()),
+            plaintext.size());
+
+        return frame;
+    }
+
+    /**
+     * @brief Расшифровывает тело кадра потокового режима.
+     *
+     * Тело — `[16: MAC][шифртекст]` (префикс длины транспорт уже снял);
+     * associated data восстанавливается из размера тела.
+     *
+     * @param body Тело кадра без префикса длины
+     * @param plaintext Выход: расшифрованные данные
+     * @return true при успехе; false — битый кадр или подделка MAC
+     */
+    bool openStreamBody(const QByteArray& body, QByteArray& plaintext) {
+        constexpr int MacSize = 16;
+        if (body.size() < MacSize) return false;
+
+        const int textLen = int(body.size()) - MacSize;
+        plaintext.resize(textLen);
+
+        uint8_t lengthPrefix[4];
+        qToBigEndian<quint32>(quint32(body.size()), lengthPrefix);
+
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(body.constData());
+        const int status = crypto_aead_read(
+            &rxCtx,
+            reinterpret_cast<uint8_t*>(plaintext.data()),
+            base,                                         // MAC
+            lengthPrefix, 4,                              // AD: префикс длины
+            base + MacSize,                               // шифртекст
+            textLen);
+
+        return status == 0;
+    }
+
     /**
      * @brief Проверяет, установлен ли общий ключ шифрования.
      * @return true, если handshake завершен и ключ вычислен
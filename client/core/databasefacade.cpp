@@ -0,0 +1,164 @@
+#include "databasefacade.h"
+#include "perfmetrics.h"
+#include <QDebug>
+
+/**
+ * Реализация асинхронного фасада локальной базы данных.
+ *
+ * Рабочий объект DatabaseService создается без родителя и переезжает в
+ * выделенный поток; все задачи выполняются в нем через очередь событий Qt
+ * (QMetaObject::invokeMethod с функтором) строго в порядке постановки.
+ */
+
+DatabaseFacade::DatabaseFacade(QObject *parent)
+    : QObject(parent)
+{
+    // Рабочий объект без родителя: объект с родителем нельзя перенести
+    // в другой поток. Удаляется вместе с остановкой потока (deleteLater).
+    m_worker = new DatabaseService();
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+
+    // Ошибки SQL пробрасываются наружу как есть (доставка через очередь)
+    connect(m_worker, &DatabaseService::databaseError,
+            this, &DatabaseFacade::databaseError);
+
+    m_thread.setObjectName(QStringLiteral("client-db"));
+    m_thread.start();
+}
+
+DatabaseFacade::~DatabaseFacade()
+{
+    // Поток обрабатывает deleteLater рабочего объекта при завершении;
+    // деструктор DatabaseService закрывает соединение в потоке-владельце.
+    shutdown();
+}
+
+void DatabaseFacade::shutdown(int deadlineMs)
+{
+    if (!m_thread.isRunning()) return;
+
+    // Финальный аккорд очереди: все поставленные до этого момента записи
+    // выполняются, затем один fsync чекпойнта — и поток свободен
+    post([](DatabaseService &db) {
+        db.checkpoint();
+    });
+
+    m_thread.quit();
+    if (m_thread.wait(deadlineMs)) {
+        qDebug() << "[DatabaseFacade] Поток БД завершен штатно";
+        return;
+    }
+
+    // Дедлайн вышел: обрываем поток. Это безопасно ценой последних
+    // незакоммиченных записей — WAL-журнал сохраняет целостность базы
+    // и все закоммиченные транзакции (как и при kill -9).
+    qWarning() << "[DatabaseFacade] Очередь БД не доработала за" << deadlineMs
+               << "мс, поток обрывается";
+    m_thread.terminate();
+    m_thread.wait();
+}
+
+void DatabaseFacade::open(const QString &dbPath)
+{
+    DatabaseService *worker = m_worker;
+    QMetaObject::invokeMethod(worker, [this, worker, dbPath]() {
+        const bool ok = worker->initialize(dbPath);
+        m_ready.store(ok, std::memory_order_relaxed);
+
+        if (!ok) {
+            qDebug() << "[DatabaseFacade] WARNING: Database initialization failed";
+        }
+
+        // Сигнал уходит из рабочего потока; получатели в GUI-потоке
+        // получат его через очередь событий (авто-соединение Qt)
+        emit ready(ok);
+    }, Qt::QueuedConnection);
+}
+
+void DatabaseFacade::post(Job job)
+{
+    DatabaseService *worker = m_worker;
+    PerfMetrics::dbJobQueued();
+    QMetaObject::invokeMethod(worker, [worker, job = std::move(job)]() {
+        job(*worker);
+        PerfMetrics::dbJobFinished();
+    }, Qt::QueuedConnection);
+}
+
+void DatabaseFacade::saveMessage(const ChatMessage &msg, const QString &currentUsername)
+{
+    post([msg, currentUsername](DatabaseService &db) {
+        db.saveMessage(msg, currentUsername);
+    });
+}
+
+void DatabaseFacade::updateMessageStatus(qint64 messageId, ChatMessage::MessageStatus status)
+{
+    post([messageId, status](DatabaseService &db) {
+        db.updateMessageStatus(messageId, status);
+    });
+}
+
+void DatabaseFacade::addOrUpdateChat(const Chat &chat)
+{
+    post([chat](DatabaseService &db) {
+        db.addOrUpdateChat(chat);
+    });
+}
+
+void DatabaseFacade::addOrUpdateUser(const User &user)
+{
+    post([user](DatabaseService &db) {
+        db.addOrUpdateUser(user);
+    });
+}
+
+void DatabaseFacade::removeContact(const QString &username)
+{
+    post([username](DatabaseService &db) {
+        db.removeContact(username);
+    });
+}
+
+void DatabaseFacade::setContactsRev(const QString &account, qint64 rev)
+{
+    post([account, rev](DatabaseService &db) {
+        db.setContactsRev(account, rev);
+    });
+}
+
+void DatabaseFacade::recordChatOpen(const QString &ownerUsername, const QString &chatUsername)
+{
+    post([ownerUsername, chatUsername](DatabaseService &db) {
+        db.recordChatOpen(ownerUsername, chatUsername);
+    });
+}
+
+void DatabaseFacade::confirmSentMessageByTempId(const QString &tempId, const ChatMessage &confirmedMsg)
+{
+    post([tempId, confirmedMsg](DatabaseService &db) {
+        db.confirmSentMessageByTempId(tempId, confirmedMsg);
+    });
+}
+
+void DatabaseFacade::editMessage(qint64 messageId, const QString &newPayload)
+{
+    post([messageId, newPayload](DatabaseService &db) {
+        db.editMessage(messageId, newPayload);
+    });
+}
+
+void DatabaseFacade::deleteMessage(qint64 messageId)
+{
+    post([messageId](DatabaseService &db) {
+        db.deleteMessage(messageId);
+    });
+}
+
+void DatabaseFacade::upsertMessages(const QList<ChatMessage> &messages, const QString &chatPartner)
+{
+    post([messages, chatPartner](DatabaseService &db) {
+        db.upsertMessages(messages, chatPartner);
+    });
+}
@@ -0,0 +1,182 @@
+#ifndef DATABASEFACADE_H
+#define DATABASEFACADE_H
+
+#include <QObject>
+#include <QThread>
+#include <QPointer>
+
+#include <functional>
+#include <atomic>
+
+#include "databaseservice.h"
+#include "perfmetrics.h"
+
+/**
+ * @brief Асинхронный фасад локальной базы данных.
+ *
+ * Все методы DatabaseService выполняют синхронные SQL-запросы, и пока они
+ * жили в GUI-потоке, пачка входящих сообщений (вставка + пересчет
+ * непрочитанных на каждое) заметно подмораживала ввод текста. Фасад выносит
+ * DatabaseService в собственный рабочий поток и повторяет серверную модель
+ * "запрос/завершение":
+ *
+ * - post() — задача записи без результата (fire-and-forget);
+ * - query() — задача с результатом: коллбэк вызывается в потоке
+ *   объекта-контекста через очередь событий Qt;
+ * - типизированные обертки (saveMessage(), updateMessageStatus() и т.д.) —
+ *   однострочные постановки горячих операций записи в очередь.
+ *
+ * Соединение SQLite открывается в рабочем потоке (требование Qt SQL:
+ * соединение можно использовать только из потока-создателя), поэтому
+ * GUI-поток к базе не прикасается вообще. Задачи выполняются строго в
+ * порядке постановки: чтение, поставленное после записи, видит ее результат.
+ *
+ * Если объект-контекст уничтожен к моменту завершения задачи, коллбэк
+ * не вызывается — это защищает от обращений к висячим указателям.
+ */
+class DatabaseFacade : public QObject {
+    Q_OBJECT
+public:
+    /** @brief Задача записи, выполняемая в потоке БД. */
+    using Job = std::function<void(DatabaseService&)>;
+
+    /**
+     * @brief Конструктор. Запускает рабочий поток базы данных.
+     * @param parent Родительский объект.
+     */
+    explicit DatabaseFacade(QObject *parent = nullptr);
+
+    /**
+     * @brief Деструктор. Останавливает рабочий поток и закрывает базу.
+     */
+    ~DatabaseFacade() override;
+
+    /**
+     * @brief Открывает базу в рабочем потоке (создание/миграция таблиц).
+     *
+     * Выполняется асинхронно; по завершении испускается сигнал ready().
+     *
+     * @param dbPath Путь к файлу базы данных (по умолчанию "messenger.sqlite")
+     */
+    void open(const QString &dbPath = "messenger.sqlite");
+
+    /**
+     * @brief Проверяет готовность базы данных.
+     * @return true, если база открыта и принимает задачи
+     */
+    bool isReady() const { return m_ready.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Ставит в очередь задачу записи без результата.
+     * @param job Задача, выполняемая в потоке БД
+     */
+    void post(Job job);
+
+    /**
+     * @brief Упорядоченно останавливает поток БД с жестким дедлайном.
+     *
+     * В хвост очереди встает WAL-чекпойнт (один fsync на все записи),
+     * затем поток завершается. Если очередь не дорабатывает за
+     * deadlineMs, поток обрывается: WAL-журнал гарантирует, что все
+     * закоммиченные транзакции переживут и такой обрыв, и kill -9.
+     *
+     * Повторный вызов (и последующий деструктор) — безопасный no-op.
+     *
+     * @param deadlineMs Максимум ожидания доработки очереди
+     */
+    void shutdown(int deadlineMs = ShutdownDeadlineMs);
+
+    /**
+     * @brief Ставит в очередь задачу с доставкой результата.
+     *
+     * @param job Задача, выполняемая в потоке БД; возвращает результат
+     * @param context Объект, в потоке которого будет вызван коллбэк.
+     *        Если контекст уничтожен до завершения — коллбэк не вызывается.
+     * @param completion Коллбэк с результатом задачи
+     */
+    template <typename Result>
+    void query(std::function<Result(DatabaseService&)> job, QObject *context,
+               std::function<void(const Result&)> completion)
+    {
+        DatabaseService *worker = m_worker;
+
+        // QPointer отслеживает время жизни контекста: если получатель
+        // уничтожен к моменту завершения задачи, коллбэк молча пропускается.
+        QPointer<QObject> guard(context);
+
+        PerfMetrics::dbJobQueued();
+        QMetaObject::invokeMethod(worker,
+                                  [worker, job = std::move(job), guard,
+                                   completion = std::move(completion)]() {
+            Result result = job(*worker);
+            PerfMetrics::dbJobFinished();
+
+            if (!guard) return; // Контекст уже уничтожен
+
+            // Доставляем результат в поток контекста через очередь событий.
+            QMetaObject::invokeMethod(guard.data(),
+                                      [completion = std::move(completion),
+                                       result = std::move(result)]() {
+                completion(result);
+            }, Qt::QueuedConnection);
+        }, Qt::QueuedConnection);
+    }
+
+    // --- Типизированные обертки записи (fire-and-forget) ---
+
+    /** @brief Сохраняет сообщение в историю. */
+    void saveMessage(const ChatMessage &msg, const QString &currentUsername);
+
+    /** @brief Обновляет статус сообщения (доставлено/прочитано). */
+    void updateMessageStatus(qint64 messageId, ChatMessage::MessageStatus status);
+
+    /** @brief Добавляет новый чат или обновляет существующий. */
+    void addOrUpdateChat(const Chat &chat);
+
+    /** @brief Добавляет или обновляет информацию о пользователе. */
+    void addOrUpdateUser(const User &user);
+
+    /** @brief Удаляет контакт из локальной таблицы (дельта-синхронизация). */
+    void removeContact(const QString &username);
+
+    /** @brief Сохраняет подтвержденную сервером версию списка контактов. */
+    void setContactsRev(const QString &account, qint64 rev);
+
+    /** @brief Фиксирует открытие чата для статистики префетча. */
+    void recordChatOpen(const QString &ownerUsername, const QString &chatUsername);
+
+    /** @brief Подтверждает отправку сообщения, заменяя временный ID на постоянный. */
+    void confirmSentMessageByTempId(const QString &tempId, const ChatMessage &confirmedMsg);
+
+    /** @brief Редактирует текст сообщения. */
+    void editMessage(qint64 messageId, const QString &newPayload);
+
+    /** @brief Удаляет сообщение по ID. */
+    void deleteMessage(qint64 messageId);
+
+    /** @brief Пакетно вставляет сообщения с фильтрацией дубликатов. */
+    void upsertMessages(const QList<ChatMessage> &messages, const QString &chatPartner);
+
+signals:
+    /**
+     * @brief База открыта (или не открылась) в рабочем потоке.
+     * @param ok true при успешной инициализации
+     */
+    void ready(bool ok);
+
+    /**
+     * @brief Сигнал ошибки базы данных (проброс из рабочего объекта).
+     * @param error Текст ошибки
+     */
+    void databaseError(const QString &error);
+
+private:
+    /// Жесткий дедлайн доработки очереди при завершении приложения
+    static constexpr int ShutdownDeadlineMs = 1500;
+
+    QThread m_thread;                     ///< Рабочий поток базы данных
+    DatabaseService *m_worker = nullptr;  ///< Сервис БД, живет в m_thread
+    std::atomic<bool> m_ready{false};     ///< База открыта и готова
+};
+
+#endif // DATABASEFACADE_H
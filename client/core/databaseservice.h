@@ -5,6 +5,9 @@
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QFile>
+#include <QHash>
+#include <QTimer>
 #include "structures.h"
 
 /**
@@ -49,6 +52,14 @@ public:
      */
     void close();
 
+    /**
+     * @brief Принудительно переносит WAL-журнал в основной файл БД.
+     *
+     * Один fsync на все накопленные записи; вызывается при завершении
+     * приложения, чтобы закрытие было быстрым, а файл БД — самодостаточным.
+     */
+    void checkpoint();
+
     /**
      * @brief Сохраняет сообщение в историю.
      * @param msg Объект сообщения для сохранения
@@ -58,10 +69,16 @@ public:
     bool saveMessage(const ChatMessage &msg, const QString &currentUsername);
 
     /**
-     * @brief Обновляет статус конкретного сообщения.
+     * @brief Обновляет статус конкретного сообщения через оп-лог.
+     *
+     * Статусы капают по одному, и каждый прямой UPDATE — отдельная
+     * транзакция со своей записью страниц B-дерева. Правка дописывается
+     * в последовательный журнал (дешевый append) и копится в памяти;
+     * в базу пачка сливается одной транзакцией по таймеру или порогу
+     * (flushStatusLog), после сбоя журнал доигрывается при открытии.
      * @param messageId ID сообщения
      * @param status Новый статус (например, Read или Delivered)
-     * @return true при успешном обновлении
+     * @return true, если правка записана в журнал (или напрямую в базу)
      */
     bool updateMessageStatus(qint64 messageId, ChatMessage::MessageStatus status);
 
@@ -75,8 +92,26 @@ public:
     bool updateAllMessagesStatusForChat(const QString &withUser, const QString &currentUsername,
                                         ChatMessage::MessageStatus status);
 
+    /**
+     * @brief Помечает исходящие сообщения диалога статусом вплоть до id включительно.
+     * @details Диапазонная форма серверных уведомлений {from, up_to_id}:
+     *          один UPDATE вместо обновления по каждому id.
+     * @param toUser Собеседник-получатель наших сообщений
+     * @param currentUsername Имя текущего пользователя (автор сообщений)
+     * @param upToId Верхняя граница server_id (включительно)
+     * @param status Статус, который нужно установить
+     * @return true при успехе
+     */
+    bool updateSentMessagesStatusUpTo(const QString &toUser, const QString &currentUsername,
+                                      qint64 upToId, ChatMessage::MessageStatus status);
+
     /**
      * @brief Загружает последние сообщения чата (для инициализации UI).
+     *
+     * Отдает горячую проекцию строк (см. readHotRow): только колонки,
+     * которые читает отрисовка списка; to_user восстанавливается по
+     * отправителю, file_url остается пустым. Полная строка при
+     * необходимости поднимается getMessageById.
      * @param fromUser Имя отправителя
      * @param toUser Имя получателя
      * @param limit Количество сообщений (по умолчанию 20)
@@ -84,6 +119,18 @@ public:
      */
     QList<ChatMessage> loadRecentMessages(const QString &fromUser, const QString &toUser, int limit = 20);
 
+    /**
+     * @brief Точечно поднимает одно сообщение по серверному ID.
+     *
+     * Полный ярус двухъярусного формата: единственный путь, читающий
+     * все колонки строки (включая file_url). Используется для резолва
+     * целей реплаев, вытесненных из окна модели, и других редких
+     * операций, которым мало горячей проекции страниц истории.
+     * @param serverId Серверный ID сообщения
+     * @return Сообщение или пустой объект (id == 0), если записи нет
+     */
+    ChatMessage getMessageById(qint64 serverId);
+
     /**
      * @brief Обновляет метаданные чата (имя, аватар и т.д.).
      * @param chat Объект с обновленными данными чата
@@ -105,6 +152,8 @@ public:
 
     /**
      * @brief Загружает более старые сообщения (пагинация вверх).
+     *
+     * Как и loadRecentMessages, отдает горячую проекцию строк.
      * @param fromUser Имя собеседника 1
      * @param toUser Имя собеседника 2
      * @param beforeId ID сообщения, до которого нужно загружать историю
@@ -121,6 +170,91 @@ public:
      */
     QList<ChatMessage> loadMessagesForUser(const QString &currentUsername);
 
+    /**
+     * @brief Пакетно вставляет сообщения, пропуская уже известные server_id.
+     * @param messages Сообщения для вставки
+     * @param chatPartner Собеседник (для выборки существующих server_id)
+     * @return Количество фактически вставленных строк
+     */
+    int upsertMessages(const QList<ChatMessage> &messages, const QString &chatPartner);
+
+    /**
+     * @brief Экспортирует историю аккаунта в потоковый бинарный архив.
+     *
+     * Формат файла: 8-байтовая сигнатура "SLAVARC1", байт флагов, далее
+     * поток записей `[тип (1 байт)][длина (4 байта BE)][тело]`. Тело —
+     * компактный JSON строки таблицы; крупные тела сжимаются записью
+     * Compression (deflate, magic 0xC7 в первом байте тела — читатель
+     * различает их так же, как сетевой приемник). Типы записей:
+     * контакты, чаты, сообщения (включая ссылки на вложения file_id/
+     * file_name/file_url).
+     *
+     * Пишется инкрементально: сообщения выбираются страницами по
+     * ArchivePageRows строк, в памяти одновременно живет одна страница —
+     * экспорт аккаунта на 100 тысяч сообщений не раздувает процесс.
+     * Вызывается на потоке БД (через фасад), GUI не блокируется.
+     *
+     * @param filePath Путь файла архива (перезаписывается)
+     * @return Количество экспортированных сообщений, -1 при ошибке
+     */
+    qint64 exportHistoryArchive(const QString &filePath);
+
+    /**
+     * @brief Импортирует архив, созданный exportHistoryArchive().
+     *
+     * Читает поток записей и вставляет их пачками по ArchivePageRows
+     * строк в одной транзакции на пачку: сообщения — INSERT OR IGNORE
+     * (UNIQUE по server_id отсекает дубликаты при повторном импорте),
+     * контакты и чаты — upsert. Неизвестные типы записей пропускаются
+     * по префиксу длины — старый клиент переживает архив нового формата.
+     *
+     * @param filePath Путь файла архива
+     * @return Количество вставленных сообщений, -1 при ошибке формата
+     */
+    qint64 importHistoryArchive(const QString &filePath);
+
+    /** @brief Строк на страницу экспорта и на транзакцию импорта. */
+    static constexpr int ArchivePageRows = 500;
+
+    /**
+     * @brief Полнотекстовый поиск по тексту всех сохраненных сообщений.
+     *
+     * Использует FTS5-индекс messages_fts (поддерживается триггерами
+     * инкрементально при каждой вставке/правке/удалении); если FTS5
+     * недоступен в сборке SQLite — откатывается на медленный LIKE.
+     *
+     * @param text Поисковый запрос (каждое слово ищется как префикс)
+     * @param currentUsername Имя текущего пользователя (для определения чата)
+     * @param limit Максимум результатов
+     * @return Результаты, отсортированные по релевантности bm25
+     */
+    QList<MessageSearchHit> searchMessages(const QString &text, const QString &currentUsername,
+                                           int limit = 50);
+
+    /**
+     * @brief Фиксирует открытие чата для статистики префетча.
+     *
+     * Счетчик открытий и время последнего открытия питают
+     * topOpenedChats(): по ним прогреваются кэши горячих чатов.
+     *
+     * @param ownerUsername Текущий пользователь
+     * @param chatUsername Собеседник открытого чата
+     */
+    void recordChatOpen(const QString &ownerUsername, const QString &chatUsername);
+
+    /**
+     * @brief Самые "горячие" чаты пользователя для префетча.
+     *
+     * Сортировка — частота открытий, затухающая с давностью последнего
+     * открытия: вчерашний активный чат выигрывает у чата, который был
+     * популярен месяц назад.
+     *
+     * @param ownerUsername Текущий пользователь
+     * @param limit Сколько чатов вернуть
+     * @return Логины собеседников, самые горячие первыми
+     */
+    QStringList topOpenedChats(const QString &ownerUsername, int limit);
+
     /**
      * @brief Получает ID самого старого сообщения в переписке.
      * @param fromUser Собеседник 1
@@ -136,6 +270,18 @@ public:
      */
     bool deleteMessage(qint64 messageId);
 
+    /**
+     * @brief Удаляет сообщения с истекшим сроком хранения.
+     *
+     * Один проход по всем чатам с политикой chats.retention_seconds
+     * (исчезающие сообщения): строки старше срока вырезаются JOIN-запросом
+     * по индексу idx_from_to. Серверную копию диалога чистит сам сервер;
+     * этот метод держит в рамках локальную базу.
+     *
+     * @return Число удаленных сообщений (0 — чистить нечего)
+     */
+    int pruneExpiredMessages();
+
     /**
      * @brief Редактирует текст сообщения.
      * @param messageId ID редактируемого сообщения
@@ -202,6 +348,62 @@ public:
      */
     void deleteDraft(const QString& username, const QString& ownerUsername);
 
+    /**
+     * @brief Сохраняет позицию прокрутки чата (якорь + пиксельный сдвиг).
+     *
+     * Нулевой messageId означает "чат был внизу" — запись удаляется,
+     * и следующее открытие идет обычным путем (к непрочитанным/вниз).
+     *
+     * @param ownerUsername Аккаунт-владелец
+     * @param chatUsername Собеседник чата
+     * @param anchor Якорное сообщение и смещение (см. ChatScrollAnchor)
+     */
+    void saveScrollAnchor(const QString& ownerUsername, const QString& chatUsername,
+                          const ChatScrollAnchor& anchor);
+
+    /**
+     * @brief Загружает все сохраненные позиции прокрутки аккаунта.
+     *
+     * Читается один раз при логине в память DataService: решение
+     * "откуда открывать чат" принимается без похода в БД.
+     *
+     * @param ownerUsername Аккаунт-владелец
+     * @return Словарь "собеседник -> якорь"
+     */
+    QHash<QString, ChatScrollAnchor> loadScrollAnchors(const QString& ownerUsername);
+
+    /**
+     * @brief Загружает окно истории, накрывающее якорное сообщение.
+     *
+     * Возвращает непрерывный диапазон от небольшого запаса над якорем
+     * (AnchorHeadroom сообщений — чтобы сразу был контекст при прокрутке
+     * вверх) до самого свежего сообщения чата: кэш истории остается
+     * привязанным к хвосту, и догрузка новых с сервера не оставляет
+     * разрывов. Если якорь так далеко, что окно превысило бы
+     * windowSize * AnchorWindowFactor строк (или сообщения уже нет),
+     * возвращается обычное хвостовое окно loadRecentMessages.
+     *
+     * @param fromUser Аккаунт-владелец
+     * @param toUser Собеседник чата
+     * @param anchorId ID якорного сообщения
+     * @param windowSize Базовый размер окна истории
+     * @return Окно сообщений в хронологическом порядке
+     */
+    QList<ChatMessage> loadMessagesAnchored(const QString &fromUser, const QString &toUser,
+                                            qint64 anchorId, int windowSize);
+
+    /** @brief Запас сообщений над якорем при восстановлении позиции. */
+    static constexpr int AnchorHeadroom = 20;
+
+    /** @brief Во сколько раз якорное окно может превысить базовое. */
+    static constexpr int AnchorWindowFactor = 4;
+
+    /** @brief Задержка слива пачки статусов из оп-лога в базу, мс. */
+    static constexpr int StatusFlushDelayMs = 500;
+
+    /** @brief Порог немедленного слива пачки статусов. */
+    static constexpr int StatusFlushThreshold = 64;
+
     /**
      * @brief Загружает последнее сообщение чата для отображения в списке контактов.
      * @param username Имя собеседника
@@ -216,6 +418,27 @@ public:
      */
     QList<Chat> loadAllChats();
 
+    /**
+     * @brief Загружает список чатов одним индексированным запросом.
+     *
+     * Объединяет chats с таблицей черновиков и агрегатом непрочитанных:
+     * каждая строка приходит уже со всем, что нужно списку диалогов
+     * (черновик, счетчик), — вместо N+1 одиночных запросов на чат.
+     * Результат отсортирован по ключам Chat::operator< (закрепленные,
+     * затем по времени последнего сообщения) по покрывающему индексу.
+     *
+     * @param ownerUsername Текущий пользователь (владелец черновиков).
+     * @return Список Chat с заполненными draftText и unreadCount.
+     */
+    QList<Chat> loadChatList(const QString& ownerUsername);
+
+    /**
+     * @brief Загружает все черновики владельца одним запросом.
+     * @param ownerUsername Владелец черновиков.
+     * @return Карта: имя собеседника -> текст черновика.
+     */
+    QMap<QString, QString> loadAllDrafts(const QString& ownerUsername);
+
     /**
      * @brief Загружает всех известных пользователей.
      * @return Список объектов User
@@ -235,6 +458,26 @@ public:
      */
     void addOrUpdateUser(const User& user);
 
+    /**
+     * @brief Удаляет контакт из локальной таблицы (дельта-синхронизация).
+     * @param username Имя удаляемого контакта
+     */
+    void removeContact(const QString& username);
+
+    /**
+     * @brief Возвращает последнюю подтвержденную версию списка контактов.
+     * @param account Аккаунт-владелец локального кэша
+     * @return Версия (0, если синхронизации еще не было)
+     */
+    qint64 contactsRev(const QString& account);
+
+    /**
+     * @brief Сохраняет подтвержденную сервером версию списка контактов.
+     * @param account Аккаунт-владелец локального кэша
+     * @param rev Версия из ответа contact_list
+     */
+    void setContactsRev(const QString& account, qint64 rev);
+
 signals:
     /**
      * @brief Сигнал ошибки базы данных.
@@ -245,6 +488,52 @@ signals:
 private:
     QSqlDatabase m_db;          ///< Объект подключения Qt SQL
     bool m_initialized = false; ///< Флаг успешной инициализации
+    bool m_ftsAvailable = false;///< Флаг: FTS5-индекс создан и поддерживается триггерами
+
+    QFile m_statusLog;                   ///< Последовательный оп-лог правок статусов
+    QHash<qint64, int> m_pendingStatus;  ///< Недослитая пачка: server_id -> статус
+    QTimer* m_statusFlushTimer = nullptr;///< Ленивый таймер слива (поток БД)
+
+    /**
+     * @brief Читает строку горячей проекции истории в ChatMessage.
+     *
+     * Горячий ярус формата строк: страницы истории выбирают только
+     * колонки, нужные отрисовке списка. Получатель восстанавливается по
+     * отправителю (диалог двух участников), file_url не читается —
+     * скачивание строит URL по file_id, полную строку отдает
+     * getMessageById.
+     * @param query Курсор на текущей строке hot-проекции
+     * @param user1 Первый участник диалога
+     * @param user2 Второй участник диалога
+     */
+    static ChatMessage readHotRow(const QSqlQuery& query,
+                                  const QString& user1, const QString& user2);
+
+    /**
+     * @brief Прямой UPDATE статуса одной строки (минуя оп-лог).
+     *
+     * Используется пачечным сливом и как запасной путь, когда журнал
+     * не открылся.
+     */
+    bool applyStatusUpdate(qint64 messageId, int status);
+
+    /**
+     * @brief Доигрывает недослитый оп-лог статусов при открытии базы.
+     *
+     * Непустой журнал означает, что прошлый сеанс оборвался до слива
+     * пачки: записи применяются одной транзакцией, журнал обнуляется.
+     * Оборванная последняя строка молча пропускается.
+     */
+    void replayStatusLog();
+
+    /**
+     * @brief Сливает накопленную пачку статусов в базу одной транзакцией.
+     *
+     * После успешного COMMIT журнал обнуляется; при ошибке пачка и
+     * журнал сохраняются до следующей попытки. Вызывается по таймеру,
+     * по порогу, перед чтениями истории и при закрытии базы.
+     */
+    void flushStatusLog();
 
     /**
      * @brief Создает структуру таблиц (messages, chats, users, drafts).
@@ -252,6 +541,12 @@ private:
      */
     bool createTables();
 
+    /**
+     * @brief Создает FTS5-индекс по тексту сообщений и триггеры его поддержки.
+     * @return true, если индекс доступен (FTS5 может отсутствовать в сборке SQLite)
+     */
+    bool createSearchIndex();
+
     /**
      * @brief Выполняет миграцию схемы БД при обновлении версии приложения.
      * @return true при успехе
@@ -1,24 +1,65 @@
 #include "dataservice.h"
+#include "threadcheck.h"
 #include <QJsonArray>
 #include <algorithm>
+#include <QDateTime>
 #include <QDebug>
 #include <QTimer>
 #include <QListView>
 #include <QScrollBar>
 #include "tokenmanager.h"
 #include "cryptoutils.h"
+#include "perfmetrics.h"
+#include "stringpool.h"
+#include "binarycodec.h"
+#include "httpclient.h"
 
 class MainWindow;
 
-DataService::DataService(QObject *parent) : QObject(parent)
+// Снимок локального состояния контактов, снимаемый одной задачей в потоке БД
+// (см. handleContactList): вместо серии одиночных запросов на каждый контакт
+struct ContactsSnapshot {
+    QList<User> users;          ///< Все контакты (нужны только при дельте)
+    QList<Chat> chats;          ///< Все чаты (с черновиками и непрочитанными)
+};
+
+// Снимок всего, что нужно initLoad(): пользователи, чаты, непрочитанные
+// и последние сообщения каждого чата — одной задачей в потоке БД
+struct StartupSnapshot {
+    QList<User> users;                        ///< Все контакты
+    QList<Chat> chats;                        ///< Все чаты (с черновиками и непрочитанными)
+    QMap<QString, QList<ChatMessage>> recent; ///< Последние сообщения чатов
+    QHash<QString, ChatScrollAnchor> anchors; ///< Сохраненные позиции прокрутки
+};
+
+// Снимок префетчера: горячие чаты по статистике открытий и их полные
+// окна истории — одной задачей в потоке БД
+struct PrefetchSnapshot {
+    QStringList order;                        ///< Чаты, самые горячие первыми
+    QMap<QString, QList<ChatMessage>> pages;  ///< Окно истории каждого
+};
+
+DataService::DataService(QObject *parent)
+    : DataService(QStringLiteral("database.db"), nullptr, parent)
 {
-    // Создаем сервис работы с базой данных и делаем его дочерним объектом
-    m_dbService = new DatabaseService(this);
+}
 
-    // Инициализируем БД (создание/миграция таблиц)
-    if (!m_dbService->initialize("database.db")) {
-        qDebug() << "[DataService] WARNING: Database initialization failed";
-    }
+DataService::DataService(const QString& dbFile, AvatarCache* sharedAvatars,
+                         QObject *parent)
+    : QObject(parent)
+{
+    // Создаем асинхронный фасад базы данных: SQL выполняется в его рабочем
+    // потоке, GUI-поток только ставит задачи и получает коллбэки
+    m_dbService = new DatabaseFacade(this);
+    connect(m_dbService, &DatabaseFacade::ready, this, [](bool ok) {
+        if (!ok) {
+            qDebug() << "[DataService] WARNING: Database initialization failed";
+        }
+    });
+
+    // Инициализируем БД (создание/миграция таблиц) в рабочем потоке.
+    // Файл свой у каждого аккаунта — соединение именуется по нему.
+    m_dbService->open(dbFile);
 
     // Таймер для глобального поиска (debounce 300 мс)
     // Запускается при вводе текста, чтобы не дергать поиск на каждый символ
@@ -26,20 +67,119 @@ DataService::DataService(QObject *parent) : QObject(parent)
     m_globalSearchTimer->setSingleShot(true);  // Срабатывает один раз после паузы
     m_globalSearchTimer->setInterval(300);     // 300 мс задержки
 
+    // Таймер коалесценции черновиков: пока пользователь печатает,
+    // черновики копятся в dirty-наборе и уходят в БД одной пакетной
+    // задачей не чаще раза в несколько секунд
+    m_draftFlushTimer = new CoalescedTimer(this);
+    m_draftFlushTimer->setSingleShot(true);
+    m_draftFlushTimer->setInterval(DraftFlushIntervalMs);
+    connect(m_draftFlushTimer, &CoalescedTimer::timeout, this, &DataService::flushDirtyDrafts);
+
+    // Движок непрочитанных: события сообщений правят счетчики в памяти
+    // за O(1), БД получает их лениво пачкой, а UI — один сигнал бейджей
+    // на оборот событийного цикла, каким бы ни был шторм сообщений
+    m_unreadFlushTimer = new CoalescedTimer(this);
+    m_unreadFlushTimer->setSingleShot(true);
+    m_unreadFlushTimer->setInterval(UnreadFlushIntervalMs);
+    connect(m_unreadFlushTimer, &CoalescedTimer::timeout, this, &DataService::flushUnreadCounts);
+
+    m_badgeCoalesceTimer = new QTimer(this);
+    m_badgeCoalesceTimer->setSingleShot(true);
+    m_badgeCoalesceTimer->setInterval(0);
+    connect(m_badgeCoalesceTimer, &QTimer::timeout, this, &DataService::emitCoalescedBadges);
+
+    // Ленивые профили: имена из видимых строк списка копятся и уходят
+    // одной пачкой get_profiles на оборот цикла событий
+    m_profileBatchTimer = new QTimer(this);
+    m_profileBatchTimer->setSingleShot(true);
+    m_profileBatchTimer->setInterval(0);
+    connect(m_profileBatchTimer, &QTimer::timeout, this, &DataService::flushProfileRequests);
+
+    // Окно коалесценции логин-залпа: пока оно открыто, широкие сигналы
+    // (список контактов, статусы, счетчики) копятся и уходят в UI
+    // консолидированно раз в такт, а не на каждый ответ сервера
+    m_burstFlushTimer = new QTimer(this);
+    m_burstFlushTimer->setInterval(BurstFlushIntervalMs);
+    connect(m_burstFlushTimer, &QTimer::timeout, this, &DataService::flushBurstUpdates);
+
+    m_burstEndTimer = new QTimer(this);
+    m_burstEndTimer->setSingleShot(true);
+    m_burstEndTimer->setInterval(LoginBurstWindowMs);
+    connect(m_burstEndTimer, &QTimer::timeout, this, &DataService::endLoginBurst);
+
     // Таймер для отправки статуса "печатает..." (typing)
     m_typingSendTimer = new QTimer(this);
     m_typingSendTimer->setSingleShot(true);    // Один раз после последнего ввода
     m_typingSendTimer->setInterval(2000);      // 2 секунды тишины => перестали печатать
 
-    // Кэш аватаров пользователей (загрузка и хранение локальных путей)
-    m_avatarCache = new AvatarCache(this);
+    // Единый таймер сброса входящих статусов "печатает...": взводится на
+    // ближайший дедлайн из m_typingDeadlines, точность до кадра не нужна
+    m_typingExpiryTimer = new CoalescedTimer(this);
+    m_typingExpiryTimer->setSingleShot(true);
+    connect(m_typingExpiryTimer, &CoalescedTimer::timeout,
+            this, &DataService::expireTypingStatuses);
+
+    // Кэш аватаров пользователей (загрузка и хранение локальных путей).
+    // В мультиаккаунтном процессе кеш общий: один дисковый ярус и один
+    // поток миниатюр на все аккаунты, сигналы слушает каждый сервис
+    m_avatarCache = sharedAvatars ? sharedAvatars : new AvatarCache(this);
     connect(m_avatarCache, &AvatarCache::avatarDownloaded,
             this, &DataService::onAvatarDownloaded);
-    
+
+    // Сквозное шифрование диалогов: ключи и сессии на аккаунт,
+    // активируется при установке текущего пользователя
+    m_e2e = new E2ESessionManager(this);
+
+    // Корутинный фасад запрос-ответных сценариев: линейные co_await-потоки
+    // поверх той же пары sendJson/processResponse
+    m_asyncApi = new AsyncApi(this);
+    connect(m_asyncApi, &AsyncApi::sendJson, this, &DataService::sendJson);
+
     // Регистрируем обработчики ответов от сервера (маршрутизация JSON-сообщений)
     initResponseHandlers();
 }
 
+DataService::~DataService()
+{
+    // Недописанные черновики и счетчики не должны пропасть: последние
+    // пакетные записи встают в очередь фасада до остановки его потока
+    flushDirtyDrafts();
+    flushUnreadCounts();
+}
+
+void DataService::shutdown()
+{
+    // Дожимаем все, что копили коалесцирующие таймеры: обе записи встают
+    // в очередь фасада одним пакетом (повторный вызов из деструктора
+    // будет no-op — грязные флаги уже сняты)
+    flushDirtyDrafts();
+    flushUnreadCounts();
+
+    // Поток БД дорабатывает очередь, делает WAL-чекпойнт и завершается
+    // с жестким дедлайном
+    if (m_dbService) {
+        m_dbService->shutdown();
+    }
+    qDebug() << "[DataService] Shutdown flush complete";
+}
+
+void DataService::compactForBackground()
+{
+    // Грязное состояние — в базу до сброса кешей: при переключении
+    // обратно история и счетчики поднимутся уже с этими записями
+    flushDirtyDrafts();
+    flushUnreadCounts();
+
+    // Самые тяжелые кеши фонового аккаунта: страницы истории чатов
+    // и метаданные загруженных файлов. Контакты, метаданные чатов и
+    // непрочитанные остаются в памяти — они дешевые и держат бейджи
+    m_chatHistoryCache.clear();
+    m_uploadedFilesCache.clear();
+    m_typingDeadlines.clear();
+
+    qDebug() << "[DataService] Background compaction: history/file caches dropped";
+}
+
 void DataService::onAvatarDownloaded(const QString& username, const QString& localPath) {
     qDebug() << "[DataService] Avatar downloaded for:" << username << "at path:" << localPath;
 
@@ -150,6 +290,20 @@ void DataService::loginProcess(const QString& username, const QString& password)
     request["username"] = username;
     request["password"] = password;
 
+    // Версия локального кэша контактов: если кэш не слишком устарел,
+    // сервер ответит дельтой вместо полного списка (см. handleContactList).
+    // Версия читается в потоке БД; запрос уходит из коллбэка.
+    if (m_dbService && m_dbService->isReady()) {
+        m_dbService->query<qint64>(
+            [username](DatabaseService &db) { return db.contactsRev(username); },
+            this,
+            [this, request](const qint64 &rev) mutable {
+                request["contacts_rev"] = static_cast<double>(rev);
+                emit sendJson(request);
+            });
+        return;
+    }
+
     // Отправляем запрос наружу (например, в NetworkService через сигнал)
     emit sendJson(request);
 }
@@ -173,9 +327,20 @@ void DataService::registerProcess(const QString& username, const QString& displa
 
 void DataService::processResponse(const QJsonObject& response)
 {
+    THREAD_AFFINITY_ASSERT(this);
+    // Обработчики меняют кеши не атомарно: повторный вход через вложенный
+    // цикл событий (модальный диалог из обработчика) недопустим
+    REENTRANCY_GUARD(m_inProcessResponse);
+
     // Определяем тип пришедшего сообщения от сервера
     QString type = response["type"].toString();
 
+    // Сначала — ожидающие корутины: ответ на co_await-запрос поглощается
+    // фасадом и до статического обработчика не доходит
+    if (m_asyncApi->deliver(type, response)) {
+        return;
+    }
+
     // Ищем соответствующий обработчик в карте
     if (m_responseHandlers.contains(type)) {
         ResponseHandler handler = m_responseHandlers[type];    
@@ -200,12 +365,17 @@ void DataService::initResponseHandlers()
 
     // Контакты и поиск пользователей
     m_responseHandlers["contact_list"]           = &DataService::handleContactList;
+    m_responseHandlers["profiles"]               = &DataService::handleProfiles;
     m_responseHandlers["user_list"]              = &DataService::handleUserList;
+    m_responseHandlers["presence"]               = &DataService::handlePresence;
+    m_responseHandlers["profile_delta"]          = &DataService::handleProfileDelta;
+    m_responseHandlers["retention_changed"]      = &DataService::handleRetentionChanged;
     m_responseHandlers["search_results"]         = &DataService::handleSearchResults;
     m_responseHandlers["add_contact_success"]    = &DataService::handleAddContactSuccess;
     m_responseHandlers["add_contact_failure"]    = &DataService::handleAddContactFailure;
     m_responseHandlers["incoming_contact_request"] = &DataService::handleIncomingContactRequest;
     m_responseHandlers["pending_requests_list"]  = &DataService::handlePendingRequestsList;
+    m_responseHandlers["contact_accepted"]       = &DataService::handleContactAccepted;
 
     // История сообщений и события чата
     m_responseHandlers["history_data"]       = &DataService::handleHistoryData;
@@ -235,6 +405,7 @@ void DataService::initResponseHandlers()
 
     // Рукопожатие/инициализация соединения
     m_responseHandlers["handshake"]         = &DataService::handleHandshake;
+    m_responseHandlers["ping"]              = &DataService::handlePing;
 
     qDebug() << "[DataService] Response handlers initialized:" << m_responseHandlers.size();
 }
@@ -258,79 +429,247 @@ const Chat& DataService::getChatMetadata(const QString& username) const
     return it.value();      // Возвращаем найденные метаданные
 }
 
-void DataService::updateOrAddChatMetadata(const Chat& chat)
+Chat& DataService::chatMetadataEntry(const QString& username)
 {
-    // Если чат уже есть в кэше — просто обновляем запись
-    if (m_chatMetadataCache.contains(chat.username)) {
-        m_chatMetadataCache[chat.username] = chat;
-    } else {
-        // Если чата нет, создаем новую запись на основе переданных данных
-        Chat newChat = chat;
+    auto it = m_chatMetadataCache.find(username);
+    if (it == m_chatMetadataCache.end()) {
+        it = m_chatMetadataCache.insert(username, Chat(username));
 
-        // Если displayName пустой, но есть данные в кэше пользователей — подставляем оттуда
-        if (newChat.displayName.isEmpty() && m_userCache.contains(chat.username)) {
-            newChat.displayName = m_userCache[chat.username].displayName;
+        // Если есть данные в кэше пользователей — подставляем имя оттуда
+        if (m_userCache.contains(username)) {
+            it->displayName = m_userCache[username].displayName;
         }
-
-        m_chatMetadataCache[chat.username] = newChat;
     }
+    return it.value();
+}
 
+void DataService::syncChatMetadata(const Chat& chat)
+{
     // Синхронизируем метаданные чата с базой, если она доступна
-    if (m_dbService && m_dbService->isConnected()) {
-        m_dbService->addOrUpdateChat(m_chatMetadataCache[chat.username]);
+    if (m_dbService && m_dbService->isReady()) {
+        m_dbService->addOrUpdateChat(chat);
     }
 
     // Уведомляем UI о том, что метаданные чата изменились (для обновления списка чатов)
-    emit chatMetadataChanged(chat.username);
+    notifyChatMetadataChanged(chat.username);
 }
 
-void DataService::updateLastMessage(const QString& username, const ChatMessage& message)
+void DataService::updateOrAddChatMetadata(const Chat& chat)
 {
-    // Получаем текущие метаданные чата для пользователя
-    const Chat& existingChat = getChatMetadata(username);
+    updateOrAddChatMetadata(Chat(chat));
+}
+
+void DataService::updateOrAddChatMetadata(Chat&& chat)
+{
+    Chat& entry = chatMetadataEntry(chat.username);
 
-    // Создаем изменяемую копию
-    Chat updatedChat = existingChat;
+    // Пустое имя не затирает уже известное (запись могла быть создана
+    // с именем из кэша пользователей)
+    if (chat.displayName.isEmpty()) {
+        chat.displayName = entry.displayName;
+    }
+    entry = std::move(chat);
+
+    syncChatMetadata(entry);
+}
+
+void DataService::updateLastMessage(const QString& username, const ChatMessage& message)
+{
+    // Правка по месту: раньше запись копировалась в локальный Chat и
+    // целиком обратно — две глубокие копии метаданных на каждое
+    // входящее сообщение.
+    Chat& chat = chatMetadataEntry(username);
 
-    // Гарантируем, что username в метаданных заполнен
-    updatedChat.username = username;
     // Если текст сообщения пуст (вероятно, файл), показываем имя файла как превью
-    updatedChat.lastMessagePayload = (message.payload == "" ? message.fileName : message.payload);
-    updatedChat.lastMessageTimestamp = message.timestamp;
-    updatedChat.lastMessageId = message.id;
-    updatedChat.isLastMessageOutgoing = message.isOutgoing;
+    chat.lastMessagePayload = (message.payload == "" ? message.fileName : message.payload);
+    chat.lastMessageTimestamp = message.timestamp;
+    chat.lastMessageId = message.id;
+    chat.isLastMessageOutgoing = message.isOutgoing;
 
-    // Обновляем/добавляем метаданные и синхронизируем с БД/UI
-    updateOrAddChatMetadata(updatedChat);
+    // Синхронизируем с БД/UI
+    syncChatMetadata(chat);
 }
 
 void DataService::incrementUnreadCount(const QString& username)
 {
-    // Получаем текущие метаданные чата
-    const Chat& existingChat = getChatMetadata(username);
+    // O(1): только счетчики в памяти; БД и UI получат изменение
+    // лениво/коалесцированно (noteUnreadChanged)
+    const int fresh = m_unreadCounts.value(username, 0) + 1;
+    m_unreadCounts[username] = fresh;
+    m_chatMetadataCache[username].unreadCount = fresh;
+    noteUnreadChanged(username);
+}
 
-    // Делаем копию, чтобы изменить счетчик
-    Chat updatedChat = existingChat;
+void DataService::resetUnreadCount(const QString& username)
+{
+    // Сбрасываем счетчик непрочитанных, только если он был > 0
+    if (m_unreadCounts.value(username, 0) == 0 &&
+        m_chatMetadataCache.value(username).unreadCount == 0) {
+        return;
+    }
+    m_unreadCounts[username] = 0;
+    m_chatMetadataCache[username].unreadCount = 0;
+    noteUnreadChanged(username);
+}
 
-    // Увеличиваем число непрочитанных сообщений для этого чата
-    updatedChat.unreadCount++;
+void DataService::noteUnreadChanged(const QString& username)
+{
+    // Ленивая запись: счетчик попадет в БД пачкой через несколько секунд
+    m_dirtyUnread.insert(username);
+    if (!m_unreadFlushTimer->isActive()) {
+        m_unreadFlushTimer->start();
+    }
 
-    // Сохраняем изменения в кэше и базе, уведомляем UI
-    updateOrAddChatMetadata(updatedChat);
+    // Коалесценция бейджей: сколько бы сообщений ни пришло за оборот
+    // событийного цикла, UI получит ровно один сигнал
+    m_pendingBadgeChats.insert(username);
+    if (!m_badgeCoalesceTimer->isActive()) {
+        m_badgeCoalesceTimer->start();
+    }
 }
 
-void DataService::resetUnreadCount(const QString& username)
+void DataService::emitCoalescedBadges()
+{
+    if (m_pendingBadgeChats.isEmpty()) {
+        return;
+    }
+    const QSet<QString> pending = m_pendingBadgeChats;
+    m_pendingBadgeChats.clear();
+
+    for (const QString& username : pending) {
+        emit unreadCountUpdated(username);
+        notifyChatMetadataChanged(username);
+    }
+    // Одно общее обновление списка на всю пачку
+    notifyUnreadCountChanged();
+}
+
+void DataService::flushUnreadCounts()
 {
-    // Получаем текущие метаданные чата
-    const Chat& existingChat = getChatMetadata(username);
+    if (m_dirtyUnread.isEmpty()) {
+        return;
+    }
+    if (!m_dbService || !m_dbService->isReady()) {
+        return; // dirty-набор остается до следующей попытки
+    }
 
-    Chat updatedChat = existingChat;
+    m_unreadFlushTimer->stop();
 
-    // Сбрасываем счетчик непрочитанных, только если он был > 0
-    if (existingChat.unreadCount > 0) {
-        updatedChat.unreadCount = 0;
-        updateOrAddChatMetadata(updatedChat);
+    // Снимок пар (чат, счетчик) — одной задачей в поток БД
+    QHash<QString, int> pending;
+    for (const QString& username : std::as_const(m_dirtyUnread)) {
+        pending[username] = m_unreadCounts.value(username, 0);
+    }
+    m_dirtyUnread.clear();
+
+    m_dbService->post([pending](DatabaseService &db) {
+        for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+            db.updateOrAddUnreadCount(it.key(), it.value());
+        }
+    });
+}
+
+void DataService::beginLoginBurst()
+{
+    m_loginBurstActive = true;
+    m_burstFlushTimer->start();
+    m_burstEndTimer->start();
+
+    // Фоновые HTTP-загрузки (аватары, медиа) на время залпа встают в
+    // очередь: полоса для истории и списка контактов остается свободной
+    HttpClient::instance()->setBackgroundPaused(true);
+
+    qDebug() << "[DataService] Окно коалесценции логин-залпа открыто ("
+             << LoginBurstWindowMs << "мс )";
+}
+
+void DataService::endLoginBurst()
+{
+    if (!m_loginBurstActive) {
+        return;
     }
+    m_burstFlushTimer->stop();
+    m_loginBurstActive = false;
+
+    // Финальный сброс: все, что пришло после последнего такта
+    flushBurstUpdates();
+
+    // Возвращаем фоновую полосу HTTP-загрузок в строй
+    HttpClient::instance()->setBackgroundPaused(false);
+
+    // Плановая чистка исчезающих сообщений: срок мог истечь, пока клиент
+    // был закрыт; вход — естественная точка одного прохода по всем чатам
+    if (m_dbService && m_dbService->isReady()) {
+        m_dbService->post([](DatabaseService& db) { db.pruneExpiredMessages(); });
+    }
+
+    qDebug() << "[DataService] Окно логин-залпа закрыто, сигналы идут напрямую";
+}
+
+void DataService::flushBurstUpdates()
+{
+    // Порядок имеет значение: сначала состав списка, затем метаданные
+    // строк, затем общие счетчики и статусы
+    if (m_burstContactsDirty) {
+        m_burstContactsDirty = false;
+        emit contactsUpdated(m_burstContacts);
+    }
+
+    if (!m_burstMetadataChats.isEmpty()) {
+        const QSet<QString> pending = m_burstMetadataChats;
+        m_burstMetadataChats.clear();
+        for (const QString& username : pending) {
+            emit chatMetadataChanged(username);
+        }
+    }
+
+    if (m_burstUnreadDirty) {
+        m_burstUnreadDirty = false;
+        emit unreadCountChanged();
+    }
+
+    if (m_burstOnlineDirty) {
+        m_burstOnlineDirty = false;
+        emit onlineStatusUpdated();
+    }
+}
+
+void DataService::notifyContactsUpdated(const QStringList& sortedUsernames)
+{
+    if (!m_loginBurstActive) {
+        emit contactsUpdated(sortedUsernames);
+        return;
+    }
+    // Достаточно последнего списка: каждый новый полнее предыдущего
+    m_burstContacts = sortedUsernames;
+    m_burstContactsDirty = true;
+}
+
+void DataService::notifyOnlineStatusUpdated()
+{
+    if (!m_loginBurstActive) {
+        emit onlineStatusUpdated();
+        return;
+    }
+    m_burstOnlineDirty = true;
+}
+
+void DataService::notifyUnreadCountChanged()
+{
+    if (!m_loginBurstActive) {
+        emit unreadCountChanged();
+        return;
+    }
+    m_burstUnreadDirty = true;
+}
+
+void DataService::notifyChatMetadataChanged(const QString& username)
+{
+    if (!m_loginBurstActive) {
+        emit chatMetadataChanged(username);
+        return;
+    }
+    m_burstMetadataChats.insert(username);
 }
 
 QStringList DataService::getSortedChatList() const
@@ -360,44 +699,128 @@ QStringList DataService::getSortedChatList() const
 
 void DataService::setPinned(const QString& username, bool pinned)
 {
-    // Получаем текущие метаданные чата
-    const Chat& existingChat = getChatMetadata(username);
+    // Правим флаг закрепления по месту и синхронизируем
+    Chat& chat = chatMetadataEntry(username);
+    chat.isPinned = pinned;
+    syncChatMetadata(chat);
+}
 
-    Chat updatedChat = existingChat;
+void DataService::setArchived(const QString& username, bool archived)
+{
+    // Правим флаг архивирования по месту и синхронизируем
+    Chat& chat = chatMetadataEntry(username);
+    chat.isArchived = archived;
+    syncChatMetadata(chat);
+}
 
-    // Обновляем флаг закрепления
-    updatedChat.isPinned = pinned;
+void DataService::setRetention(const QString& username, qint64 seconds)
+{
+    seconds = qMax<qint64>(0, seconds);
+    Chat& chat = chatMetadataEntry(username);
+    if (chat.retentionSeconds == seconds) {
+        return;
+    }
+    chat.retentionSeconds = seconds;
+    syncChatMetadata(chat);
 
-    // Сохраняем и синхронизируем изменения
-    updateOrAddChatMetadata(updatedChat);
+    // Сервер применяет политику к своей копии диалога и уведомляет
+    // собеседника событием retention_changed
+    QJsonObject request;
+    request["type"] = "set_retention";
+    request["with"] = username;
+    request["ttl_seconds"] = static_cast<double>(seconds);
+    emit sendJson(request);
+
+    // Локальная история старше нового срока вырезается сразу
+    if (seconds > 0 && m_dbService && m_dbService->isReady()) {
+        m_dbService->post([](DatabaseService& db) { db.pruneExpiredMessages(); });
+    }
 }
 
-void DataService::setArchived(const QString& username, bool archived)
+qint64 DataService::retentionSeconds(const QString& username) const
 {
-    // Получаем текущие метаданные чата
-    const Chat& existingChat = getChatMetadata(username);
+    const auto it = m_chatMetadataCache.constFind(username);
+    return it != m_chatMetadataCache.constEnd() ? it->retentionSeconds : 0;
+}
 
-    Chat updatedChat = existingChat;
+void DataService::saveDraft(const QString& username, const QString& draftText)
+{
+    // Смена чата/явное сохранение: кэш обновляется и dirty-набор
+    // сбрасывается в БД сразу, не дожидаясь таймера коалесценции
+    updateDraft(username, draftText);
+    flushDirtyDrafts();
+}
 
-    // Обновляем флаг архивирования
-    updatedChat.isArchived = archived;
+void DataService::saveScrollAnchor(const QString& username, const ChatScrollAnchor& anchor)
+{
+    // Кэш — источник решения при открытии чата; БД переживает перезапуск
+    if (anchor.messageId > 0) {
+        m_scrollAnchors.insert(username, anchor);
+    } else {
+        m_scrollAnchors.remove(username); // Чат был внизу — позиция не нужна
+    }
 
-    // Сохраняем и синхронизируем изменения
-    updateOrAddChatMetadata(updatedChat);
+    if (m_dbService && m_dbService->isReady()) {
+        const QString owner = m_currentUser.username;
+        m_dbService->post([owner, username, anchor](DatabaseService &db) {
+            db.saveScrollAnchor(owner, username, anchor);
+        });
+    }
 }
 
-void DataService::saveDraft(const QString& username, const QString& draftText)
+ChatScrollAnchor DataService::scrollAnchor(const QString& username) const
 {
-    // Получаем текущие метаданные чата
-    const Chat& existingChat = getChatMetadata(username);
+    return m_scrollAnchors.value(username);
+}
 
-    Chat updatedChat = existingChat;
+void DataService::updateDraft(const QString& username, const QString& draftText)
+{
+    // Кэш метаданных — единственное, что трогается на каждый символ;
+    // запись в БД коалесцируется таймером
+    Chat& chat = m_chatMetadataCache[username];
+    if (chat.username.isEmpty()) {
+        chat.username = username;
+        if (m_userCache.contains(username)) {
+            chat.displayName = m_userCache[username].displayName;
+        }
+    }
+    if (chat.draftText == draftText) {
+        return;
+    }
+    chat.draftText = draftText;
 
-    // Сохраняем текст черновика в метаданные
-    updatedChat.draftText = draftText;
+    m_dirtyDrafts[username] = draftText;
+    if (!m_draftFlushTimer->isActive()) {
+        m_draftFlushTimer->start();
+    }
 
-    // Обновляем кэш и базу
-    updateOrAddChatMetadata(updatedChat);
+    // Список чатов показывает превью черновика — обновляем UI без БД
+    notifyChatMetadataChanged(username);
+}
+
+void DataService::flushDirtyDrafts()
+{
+    if (m_dirtyDrafts.isEmpty()) {
+        return;
+    }
+    if (!m_dbService || !m_dbService->isReady()) {
+        return; // dirty-набор остается: сброс повторится позже
+    }
+
+    m_draftFlushTimer->stop();
+
+    // Весь накопленный набор уходит одной задачей в поток БД: одна
+    // постановка в очередь фасада на пачку черновиков, а не на каждый
+    const QHash<QString, QString> pending = m_dirtyDrafts;
+    m_dirtyDrafts.clear();
+    const QString owner = m_currentUser.username;
+
+    m_dbService->post([pending, owner](DatabaseService &db) {
+        for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+            // Пустой текст удаляет запись черновика (saveDraft сам решает)
+            db.saveDraft(it.key(), owner, it.value());
+        }
+    });
 }
 
 QString DataService::getDraft(const QString& username) const
@@ -415,21 +838,33 @@ QString DataService::getDraft(const QString& username) const
 void DataService::loadDraftsFromDatabase()
 {
     // Проверяем доступность БД
-    if (!m_dbService || !m_dbService->isConnected()) {
+    if (!m_dbService || !m_dbService->isReady()) {
         return;
     }
 
-    // Для каждого чата пытаемся загрузить черновик из БД
-    for (const QString& username : m_chatMetadataCache.keys()) {
-        QString draft = m_dbService->loadDraft(username, m_currentUser.username);
-
-        // Если черновик не пустой — сохраняем его в метаданные чата
-        if (!draft.isEmpty()) {
-            saveDraft(username, draft);
-        }
-    }
-
-    qDebug() << "[DataService] Drafts loaded from database";
+    // Черновики всех чатов читаются одним запросом в потоке БД;
+    // применяются к метаданным в коллбэке
+    const QString owner = m_currentUser.username;
+
+    m_dbService->query<QMap<QString, QString>>(
+        [owner](DatabaseService &db) {
+            return db.loadAllDrafts(owner);
+        },
+        this,
+        [this](const QMap<QString, QString> &drafts) {
+            // Таблица drafts авторитетна: применяем ее к кэшу метаданных
+            // целиком (в т.ч. стираем черновики, которых в ней больше
+            // нет), ничего не записывая обратно в БД
+            for (auto it = m_chatMetadataCache.begin();
+                 it != m_chatMetadataCache.end(); ++it) {
+                const QString fresh = drafts.value(it.key());
+                if (it.value().draftText != fresh) {
+                    it.value().draftText = fresh;
+                    notifyChatMetadataChanged(it.key());
+                }
+            }
+            qDebug() << "[DataService] Drafts loaded from database";
+        });
 }
 
 void DataService::handleTokenLoginFailure(const QJsonObject& response)
@@ -477,26 +912,91 @@ void DataService::handleCallHistory(const QJsonObject& response){
     // Извлекаем массив звонков из ответа
     QJsonArray calls = response["calls"].toArray();
 
-    qDebug() << "[DataService] Received call history:" << calls.size() << "calls";
-
-    // Логируем краткую информацию по каждому звонку
-    for (const QJsonValue& val : calls) {
-        QJsonObject call = val.toObject();
-        qDebug() << "[DataService] CALL HISTORY:"
-                 << (call["call_type"].toString() == "outgoing" ? "OUT" : "IN")
-                 << call["caller"].toString() << "→" << call["callee"].toString()
-                 << "| Status:" << call["status"].toString()
-                 << "| Duration:" << call["duration_seconds"].toInt() << "s";
+    // Составной курсор следующей страницы — (start_time, call_id) последней
+    // строки этой: call_id добирает звонки той же секунды на стыке страниц
+    m_callHistoryHasMore = response["has_more"].toBool();
+    if (!calls.isEmpty()) {
+        const QJsonObject lastCall = calls.last().toObject();
+        m_callHistoryCursor = lastCall["start_time"].toString();
+        m_callHistoryCursorId = lastCall["call_id"].toString();
     }
 
-    // Передаем историю дальше (например, в UI)
-    emit callHistoryReceived(calls);
+    qDebug() << "[DataService] Received call history page:" << calls.size()
+             << "calls, has_more =" << m_callHistoryHasMore;
+
+    // Передаем страницу дальше (например, в UI)
+    emit callHistoryReceived(calls, m_callHistoryHasMore);
 }
 
 void DataService::requestCallHistory()
 {
-    // Здесь можно сформировать JSON-запрос и отправить его через sendJson
     qDebug() << "[DataService] Requesting call history from server";
+    m_callHistoryCursor.clear();
+    m_callHistoryCursorId.clear();
+    m_callHistoryHasMore = false;
+    // Корневой сценарий fire-and-forget: Task доживает в фоне сам
+    fetchCallHistoryFlow(QString(), QString());
+}
+
+void DataService::requestMoreCallHistory()
+{
+    if (!m_callHistoryHasMore || m_callHistoryCursor.isEmpty()) {
+        return;
+    }
+    fetchCallHistoryFlow(m_callHistoryCursor, m_callHistoryCursorId);
+}
+
+Async::Task<QJsonObject> DataService::fetchResponse(QJsonObject request,
+                                                    const QString& responseType)
+{
+    co_return co_await m_asyncApi->request(std::move(request), responseType);
+}
+
+Async::Task<void> DataService::fetchCallHistoryFlow(const QString& before,
+                                                    const QString& beforeId)
+{
+    QJsonObject pageRequest;
+    pageRequest["type"] = "get_call_history";
+    pageRequest["username"] = m_currentUser.username;
+    pageRequest["limit"] = CallHistoryPageSize;
+    if (!before.isEmpty()) {
+        pageRequest["before"] = before;
+        pageRequest["before_id"] = beforeId;
+    }
+
+    if (before.isEmpty()) {
+        // Первая страница: сводка rollup'а и страница — независимые
+        // запросы; оба Task жадные и уже в полете, ответы ждем по очереди
+        QJsonObject statsRequest;
+        statsRequest["type"] = "get_call_stats";
+        statsRequest["username"] = m_currentUser.username;
+
+        auto stats = fetchResponse(statsRequest, "call_stats");
+        auto page = fetchResponse(pageRequest, "call_history");
+
+        const QJsonObject statsResponse = co_await stats;
+        if (!AsyncApi::timedOut(statsResponse)) {
+            handleCallStats(statsResponse);
+        }
+
+        const QJsonObject pageResponse = co_await page;
+        if (AsyncApi::timedOut(pageResponse)) {
+            qWarning() << "[DataService] Call history request timed out";
+            co_return;
+        }
+        handleCallHistory(pageResponse);
+        co_return;
+    }
+
+    const QJsonObject response =
+        co_await m_asyncApi->request(pageRequest, "call_history");
+    if (AsyncApi::timedOut(response)) {
+        qWarning() << "[DataService] Call history page request timed out";
+        co_return;
+    }
+
+    // Дальше — тот же путь, что у пуш-ответа
+    handleCallHistory(response);
 }
 
 void DataService::handleCallRequestSent(const QJsonObject& response)
@@ -588,16 +1088,23 @@ const User* DataService::getUserFromCache(const QString& username) {
 
 void DataService::updateOrAddUser(const User& user)
 {
-    // Обновляем или добавляем пользователя в локальный кэш
-    m_userCache[user.username] = user;
+    updateOrAddUser(User(user));
+}
+
+void DataService::updateOrAddUser(User&& user)
+{
+    // Пользователь переезжает в локальный кэш без копий строк
+    const QString username = user.username;
+    User& entry = m_userCache[username];
+    entry = std::move(user);
 
     // Синхронизируем с базой данных, если соединение активно
-    if (m_dbService && m_dbService->isConnected()) {
-        m_dbService->addOrUpdateUser(user);
+    if (m_dbService && m_dbService->isReady()) {
+        m_dbService->addOrUpdateUser(entry);
     }
 
     // Уведомляем об изменении кэша пользователей (для обновления UI)
-    emit userCacheChanged(user.username);
+    emit userCacheChanged(username);
 }
 
 const QMap<QString, ChatCache>& DataService::getChatCache() {
@@ -607,12 +1114,13 @@ const QMap<QString, ChatCache>& DataService::getChatCache() {
 
 void DataService::updateOrAddChatCache(const QString& username, const ChatCache& chatCache)
 {
-    // Обновляем существующий кэш для пользователя или вставляем новый
-    if (m_chatHistoryCache.contains(username)) {
-        m_chatHistoryCache[username] = chatCache;
-    } else {
-        m_chatHistoryCache.insert(username, chatCache);
-    }
+    updateOrAddChatCache(username, ChatCache(chatCache));
+}
+
+void DataService::updateOrAddChatCache(const QString& username, ChatCache&& chatCache)
+{
+    // Список сообщений переезжает в кэш без копии (QList — обмен указателей)
+    m_chatHistoryCache[username] = std::move(chatCache);
 
     // Уведомляем, что история чата обновилась
     emit chatCacheUpdated(username);
@@ -625,17 +1133,28 @@ const QMap<QString, int>& DataService::getUnreadCounts() {
 
 void DataService::updateOrAddUnreadCount(const QString& username, int count) {
     Q_UNUSED(count);
-    // Актуализируем значение из БД (источником истины является база)
-    m_unreadCounts[username] = m_dbService->getUnreadCountForChat(username, m_currentUser.username);
-
-    // Обновляем поле unreadCount в метаданных чата
-    m_chatMetadataCache[username].unreadCount = m_unreadCounts[username];
-
-    // Сохраняем изменения и синхронизируем с БД/UI
-    updateOrAddChatMetadata(m_chatMetadataCache[username]);
-
-    // Уведомляем UI о смене количества непрочитанных
-    emit unreadCountUpdated(username);
+    // Актуализируем значение из БД (источником истины является база).
+    // Пересчет выполняется в потоке БД после уже поставленных записей,
+    // поэтому видит свежевставленные сообщения.
+    const QString owner = m_currentUser.username;
+    m_dbService->query<int>(
+        [username, owner](DatabaseService &db) {
+            return db.getUnreadCountForChat(username, owner);
+        },
+        this,
+        [this, username](const int &unread) {
+            m_unreadCounts[username] = unread;
+
+            // Обновляем поле unreadCount в метаданных чата по месту
+            Chat& chat = chatMetadataEntry(username);
+            chat.unreadCount = unread;
+
+            // Сохраняем изменения и синхронизируем с БД/UI
+            syncChatMetadata(chat);
+
+            // Уведомляем UI о смене количества непрочитанных
+            emit unreadCountUpdated(username);
+        });
 }
 
 ChatCache* DataService::getChatCacheForUser(const QString& username) {
@@ -646,6 +1165,71 @@ ChatCache* DataService::getChatCacheForUser(const QString& username) {
     return nullptr;
 }
 
+void DataService::touchChatCache(const QString& username)
+{
+    // Переносим чат в конец LRU-списка (конец — самый свежий)
+    m_chatCacheLru.removeOne(username);
+    m_chatCacheLru.append(username);
+
+    // После каждого обращения проверяем общий бюджет кэша
+    enforceChatCacheBudget();
+}
+
+void DataService::trimChatCacheWindow(const QString& username)
+{
+    // Активный чат не обрезаем: пользователь может как раз листать
+    // его историю вверх, окно ужмется при переключении на другой чат
+    if (username == m_currentChatPartner.username) {
+        return;
+    }
+
+    auto it = m_chatHistoryCache.find(username);
+    if (it == m_chatHistoryCache.end()) {
+        return;
+    }
+
+    ChatCache& cache = it.value();
+    if (cache.messages.size() <= ChatCacheWindow) {
+        return;
+    }
+
+    // Оставляем только хвост окна (самые свежие сообщения); более старые
+    // при необходимости прозрачно перечитываются из локальной БД
+    const int excess = cache.messages.size() - ChatCacheWindow;
+    cache.messages.erase(cache.messages.begin(), cache.messages.begin() + excess);
+    cache.oldestMessageId = cache.messages.first().id;
+    cache.allMessagesLoaded = false;
+}
+
+void DataService::enforceChatCacheBudget()
+{
+    // Суммарный размер кэша по всем чатам
+    int total = 0;
+    for (const auto& cache : m_chatHistoryCache) {
+        total += cache.messages.size();
+    }
+
+    // Вытесняем целиком самые давние чаты, пока не уложимся в бюджет.
+    // Текущий открытый чат не трогаем — его история на экране.
+    int lruIndex = 0;
+    while (total > ChatCacheBudget && lruIndex < m_chatCacheLru.size()) {
+        const QString victim = m_chatCacheLru.at(lruIndex);
+        if (victim == m_currentChatPartner.username) {
+            ++lruIndex;
+            continue;
+        }
+
+        auto it = m_chatHistoryCache.find(victim);
+        if (it != m_chatHistoryCache.end()) {
+            total -= it.value().messages.size();
+            m_chatHistoryCache.erase(it);
+            qDebug() << "[DataService] Chat cache evicted for" << victim
+                     << "(budget" << ChatCacheBudget << "messages exceeded)";
+        }
+        m_chatCacheLru.removeAt(lruIndex);
+    }
+}
+
 const User* DataService::getCurrentChatPartner() {
     // Если выбран собеседник — возвращаем указатель на него
     if (!m_currentChatPartner.username.isEmpty()) {
@@ -655,9 +1239,17 @@ const User* DataService::getCurrentChatPartner() {
 }
 
 void DataService::updateOrAddCurrentChatPartner(const User& user) {
+    // Прежний чат уходит в фон: ужимаем его окно истории, которое могло
+    // разрастись при прокрутке вверх, обратно до ChatCacheWindow
+    const QString previousPartner = m_currentChatPartner.username;
+
     // Обновляем текущего собеседника
     m_currentChatPartner = user;
 
+    if (!previousPartner.isEmpty() && previousPartner != user.username) {
+        trimChatCacheWindow(previousPartner);
+    }
+
     // Уведомляем UI о смене активного чата
     emit currentChatPartnerChanged(user.username);
 }
@@ -672,14 +1264,6 @@ QTimer* DataService::getTypingSendTimer() {
     return m_typingSendTimer;
 }
 
-const QMap<QString, QTimer*>* DataService::getTypingRecieveTimers() {
-    // Возвращаем карту таймеров "печатает" по собеседникам, если она не пуста
-    if (!m_typingReceiveTimers.isEmpty()) {
-        return &m_typingReceiveTimers;
-    }
-    return nullptr;
-}
-
 QMap<QString, User>* DataService::getUserCache() {
     // Возвращаем указатель на кэш пользователей для внешнего доступа/модификации
     return &m_userCache;
@@ -720,8 +1304,12 @@ void DataService::updateOrAddCurrentUser(const User& user)
     // Обновляем данные текущего пользователя
     m_currentUser = user;
 
+    // Поднимаем E2E-состояние аккаунта: идентификационную пару и
+    // кэшированные ключи диалогов из прошлых сессий
+    m_e2e->activate(user.username);
+
     // Синхронизируем пользователя с БД
-    if (m_dbService && m_dbService->isConnected()) {
+    if (m_dbService && m_dbService->isReady()) {
         m_dbService->addOrUpdateUser(user);
     }
 
@@ -756,8 +1344,22 @@ void DataService::handleContactList(const QJsonObject& response)
 {
     qDebug() << "[DataService] Processing contact list.";
 
-    // Массив пользователей, полученный с сервера
-    QJsonArray contactsArray = response.value("users").toArray();
+    // Дельта-синхронизация: если при входе была предъявлена версия кэша
+    // (contacts_rev), сервер присылает только изменения — "upserts" с
+    // новыми/изменившимися контактами и "removed" с исчезнувшими.
+    const bool isDelta = response.value("delta").toBool();
+
+    // Полный список теперь облегченный: сервер не грузит детали профилей
+    // на критическом пути входа, в записях только имена
+    const bool isLite = response.value("lite").toBool();
+
+    // Новый снимок списка — прежние запреты повторного запроса снимаются:
+    // детали могли измениться, пока клиент был оффлайн
+    m_requestedProfileUsers.clear();
+
+    // Массив записей с сервера: полный список или только изменившиеся
+    QJsonArray contactsArray = isDelta ? response.value("upserts").toArray()
+                                       : response.value("users").toArray();
     QStringList usernames;
 
     // Обновляем кэш пользователей и метаданные чатов
@@ -765,6 +1367,20 @@ void DataService::handleContactList(const QJsonObject& response)
         QJsonObject contactObj = val.toObject();
 
         QString username      = contactObj.value("username").toString();
+
+        if (isLite) {
+            // Детали профиля лежат в локальной БД с прошлых сессий либо
+            // будут дозапрошены пачкой get_profiles, когда строка без
+            // профиля попадет в видимую область (см. requestProfile)
+            usernames.append(username);
+
+            Chat chat = Chat(username);
+            if (m_chatMetadataCache.contains(username)) {
+                chat = m_chatMetadataCache[username];
+            }
+            updateOrAddChatMetadata(std::move(chat));
+            continue;
+        }
         QString displayName   = contactObj.value("displayname").toString();
         QString lastSeen      = contactObj.value("last_seen").toString();
         QString statusMessage = contactObj.value("statusmessage").toString();
@@ -789,77 +1405,253 @@ void DataService::handleContactList(const QJsonObject& response)
             chat = m_chatMetadataCache[username];
             chat.displayName = user.displayName;   // Синхронизация имени в чате с контактами
         }
-        updateOrAddChatMetadata(chat);
+        updateOrAddChatMetadata(std::move(chat));
+    }
+
+    if (isDelta && m_dbService && m_dbService->isReady()) {
+        // Исчезнувшие контакты: чистим кэш и локальную таблицу
+        const QJsonArray removedArray = response.value("removed").toArray();
+        for (const QJsonValue& val : removedArray) {
+            const QString removedUser = val.toString();
+            m_userCache.remove(removedUser);
+            m_dbService->removeContact(removedUser);
+            qDebug() << "[DataService] Contact removed by delta sync:" << removedUser;
+        }
     }
 
-    // Дополнительное обогащение: подтягиваем данные по чатам и непрочитанным из БД
-    if (m_dbService && m_dbService->isConnected()) {
-        for (const QString& username : usernames) {
-            Chat dbChat = m_dbService->getChatByUsername(username);
-            if (dbChat.id != 0) {
-                dbChat.unreadCount = m_dbService->getUnreadCountForChat(username, m_currentUser.username);
+    // Версия списка из ответа: следующий вход предъявит ее и получит
+    // дельту вместо полного списка (-1 — сервер версию не прислал)
+    const qint64 rev = response.contains("rev")
+        ? static_cast<qint64>(response["rev"].toDouble()) : -1;
+
+    if (!m_dbService || !m_dbService->isReady()) {
+        // Без БД обходимся тем, что прислал сервер
+        notifyContactsUpdated(usernames);
+
+        QJsonObject subscribeRequest;
+        subscribeRequest["type"] = "presence_subscribe";
+        subscribeRequest["users"] = QJsonArray::fromStringList(usernames);
+        emit sendJson(subscribeRequest);
+        return;
+    }
+
+    // Остальное состояние (полный список при дельте, чаты, непрочитанные)
+    // снимается одной задачей в потоке БД. Записи addOrUpdateUser/Chat выше
+    // уже стоят в очереди раньше снимка, поэтому он их видит.
+    const QString owner = m_currentUser.username;
+    m_dbService->query<ContactsSnapshot>(
+        [owner, isDelta](DatabaseService &db) {
+            ContactsSnapshot snap;
+            if (isDelta) {
+                snap.users = db.loadAllUsers();
+            }
+            // Один индексированный запрос: чаты уже с черновиками и
+            // счетчиками непрочитанных (см. loadChatList)
+            snap.chats = db.loadChatList(owner);
+            return snap;
+        },
+        this,
+        [this, isDelta, usernames, rev](const ContactsSnapshot &snap) mutable {
+            if (isDelta) {
+                // Дельта несет только изменения — остальная часть списка живет
+                // в локальной БД. Достраиваем кэш и общий список имен из нее.
+                for (const User& storedUser : snap.users) {
+                    if (!m_userCache.contains(storedUser.username)) {
+                        m_userCache[storedUser.username] = storedUser;
+                    }
+                    if (!usernames.contains(storedUser.username)) {
+                        usernames.append(storedUser.username);
+                    }
+                }
+            }
+
+            // Данные по чатам из снимка (черновик и счетчик непрочитанных
+            // уже в строке — отдельное обогащение не требуется)
+            for (const Chat& dbChat : snap.chats) {
+                if (dbChat.id == 0 || !usernames.contains(dbChat.username)) {
+                    continue;
+                }
                 updateOrAddChatMetadata(dbChat);
             }
-        }
+
+            // Уведомляем UI, что список контактов обновился
+            notifyContactsUpdated(usernames);
+
+            // Подписываемся на статусы присутствия именно этих контактов: сервер
+            // будет присылать дельта-события "presence" вместо полного списка онлайн.
+            QJsonObject subscribeRequest;
+            subscribeRequest["type"] = "presence_subscribe";
+            subscribeRequest["users"] = QJsonArray::fromStringList(usernames);
+            emit sendJson(subscribeRequest);
+
+            // Запоминаем подтвержденную сервером версию списка. Копия в
+            // session.ini доступна синхронно до открытия БД — она уходит
+            // в 0-RTT пакет возобновления при следующем запуске.
+            if (rev >= 0) {
+                m_dbService->setContactsRev(m_currentUser.username, rev);
+                TokenManager::saveContactsRev(rev);
+            }
+        });
+}
+
+void DataService::requestProfile(const QString& username)
+{
+    if (username.isEmpty() || m_requestedProfileUsers.contains(username)) {
+        return; // Уже запрошен в этой сессии — пачка в пути или профиль пришел
     }
+    m_requestedProfileUsers.insert(username);
+    m_pendingProfileUsers.insert(username);
 
-    // Уведомляем UI, что список контактов обновился
-    emit contactsUpdated(usernames);
+    if (!m_profileBatchTimer->isActive()) {
+        m_profileBatchTimer->start();
+    }
 }
 
-void DataService::loadChatMetadataFromDatabase()
+void DataService::refreshProfile(const QString& username)
 {
-    if (!m_dbService || !m_dbService->isConnected()) {
-        qDebug() << "[DataService] Cannot load chat metadata: DB not connected";
+    if (username.isEmpty()) {
         return;
     }
+    // Дедупликация снимается: пачка get_profiles уйдет и для профиля,
+    // уже полученного в этой сессии — открытой карточке нужен свежий last_seen
+    m_requestedProfileUsers.remove(username);
+    requestProfile(username);
+}
 
-    qDebug() << "[DataService] Loading chat metadata from database...";
+void DataService::flushProfileRequests()
+{
+    if (m_pendingProfileUsers.isEmpty()) {
+        return;
+    }
 
-    // Проходим по всем чатам в кэше и дополняем их данными из БД
-    for (auto it = m_chatMetadataCache.begin(); it != m_chatMetadataCache.end(); ++it) {
-        QString username = it.key();
-        Chat& chat = it.value();
+    // Не больше ProfileBatchLimit имен в одном запросе (потолок сервера);
+    // остаток уходит следующей пачкой
+    QJsonArray users;
+    auto it = m_pendingProfileUsers.begin();
+    while (it != m_pendingProfileUsers.end() && users.count() < ProfileBatchLimit) {
+        users.append(*it);
+        it = m_pendingProfileUsers.erase(it);
+    }
 
-        // Загружаем последнее сообщение для данного собеседника
-        ChatMessage lastMessage = m_dbService->loadLastMessage(username, m_currentUser.username);
+    QJsonObject request;
+    request["type"] = "get_profiles";
+    request["users"] = users;
+    emit sendJson(request);
+    qDebug() << "[DataService] Requested" << users.count() << "profile(s) lazily";
+
+    if (!m_pendingProfileUsers.isEmpty()) {
+        m_profileBatchTimer->start();
+    }
+}
 
-        if (lastMessage.id > 0) {
-            chat.lastMessagePayload   = (lastMessage.payload == "" ? lastMessage.fileName : lastMessage.payload);
-            chat.lastMessageTimestamp = lastMessage.timestamp;
-            chat.lastMessageId        = lastMessage.id;
-            chat.isLastMessageOutgoing = lastMessage.isOutgoing;
+void DataService::handleProfiles(const QJsonObject& response)
+{
+    const QJsonArray profiles = response.value("users").toArray();
 
-            qDebug() << "[DataService] Loaded last message for" << username
-                     << ":" << lastMessage.payload.left(20);
+    for (const QJsonValue& val : profiles) {
+        const QJsonObject obj = val.toObject();
+        const QString username = obj.value("username").toString();
+        if (username.isEmpty()) {
+            continue;
         }
 
-        // Обновляем количество непрочитанных сообщений для чата
-        int unreadCount = m_dbService->getUnreadCountForChat(username, m_currentUser.username);
-        chat.unreadCount = unreadCount;
+        const QString rawName = obj.value("displayname").toString();
+        const QString displayName = rawName.isEmpty() ? username : rawName;
+        const QString avatarUrl = obj.value("avatar_url").toString();
 
-        if (unreadCount > 0) {
-            qDebug() << "[DataService] Chat" << username << "has" << unreadCount << "unread";
+        // Онлайн-статус и "печатает..." приходят другим каналом —
+        // существующие флаги кэша сохраняются
+        User user;
+        bool lastSeenOnly = false;
+        if (const User* cached = getUserFromCache(username)) {
+            user = *cached;
+            // Изменилась только метка визита? Строке списка контактов
+            // перерисовка не нужна: присутствие она берет из дельт
+            // presence, а last_seen показывает только открытая карточка
+            lastSeenOnly = cached->displayName == displayName
+                           && cached->statusMessage == obj.value("statusmessage").toString()
+                           && cached->avatarUrl == avatarUrl;
         }
+        user.username = username;
+        user.displayName = displayName;
+        user.lastSeen = obj.value("last_seen").toString();
+        user.statusMessage = obj.value("statusmessage").toString();
+        user.avatarUrl = avatarUrl;
+
+        if (lastSeenOnly) {
+            // Тихое обновление кэша: без userCacheChanged и перерисовки строки
+            User& entry = m_userCache[username];
+            entry = std::move(user);
+            if (m_dbService && m_dbService->isReady()) {
+                m_dbService->addOrUpdateUser(entry);
+            }
+        } else {
+            updateOrAddUser(std::move(user));
+        }
+        emit profileReceived(username);
+
+        // Имя в метаданных чата синхронизируется с профилем
+        if (m_chatMetadataCache.contains(username)) {
+            Chat chat = m_chatMetadataCache[username];
+            chat.displayName = displayName;
+            updateOrAddChatMetadata(std::move(chat));
+        }
+
+        // Профиль пришел для видимой строки — самое время прогреть аватар
+        m_avatarCache->ensureAvatar(username, avatarUrl);
     }
 
-    qDebug() << "[DataService] Chat metadata loaded";
+    qDebug() << "[DataService] Applied" << profiles.count() << "lazy profile(s)";
 }
 
 void DataService::handleHandshake(const QJsonObject& request){
-    // Если уже работаем в зашифрованном режиме — повторный handshake не нужен
-    if (m_crypto->isEncrypted()) {
+    // Повторный handshake не нужен. Проверяем собственный флаг, а не
+    // isEncrypted(): общий ключ теперь вычисляет поток декодера еще до
+    // доставки этого объекта, чтобы успеть расшифровать следующий кадр.
+    if (m_handshakeDone) {
         return;
     }
+    m_handshakeDone = true;
+
+    // Резюм-ключ сервера кэшируется рядом с токеном: следующее подключение
+    // запечатает им token_login прямо в кадре рукопожатия (0-RTT вход).
+    // После рестарта сервера ключ меняется — кэш просто обновляется.
+    const QString resumeKey = request["resume_key"].toString();
+    if (!resumeKey.isEmpty()) {
+        TokenManager::saveResumeKey(resumeKey);
+    }
+
+    // Сервер принял наш пакет возобновления: вход уже обработан, и
+    // login_success придет этим же полетом — повторный token_login не нужен
+    // (MainWindow::attemptAutoLogin проверяет sessionResumed()).
+    m_sessionResumed = request["resume_ok"].toBool();
 
     // Получаем публичный ключ сервера в base64 и декодируем в бинарный вид
     QString serverKeyBase64 = request["key"].toString();
     QByteArray serverKey = QByteArray::fromBase64(serverKeyBase64.toLatin1());
 
-    // Вычисляем общий секрет (ECDH/X25519) и переключаемся в зашифрованный режим
-    m_crypto->computeSharedSecret(serverKey);
+    // Вычисляем общий секрет (ECDH/X25519), если декодер этого еще не сделал
+    if (!m_crypto->isEncrypted()) {
+        m_crypto->computeSharedSecret(serverKey);
+    }
     qInfo() << "Handshake complete. Switching to encrypted mode.";
 
+    // Предлагаем серверу бинарный протокол для горячих типов сообщений
+    // (typing, подтверждения доставки/прочтения). Ответ binary_mode_ack
+    // обрабатывает NetworkService; при отказе сервера остаемся на JSON.
+    QJsonObject binaryRequest;
+    binaryRequest["type"] = "binary_mode";
+    binaryRequest["version"] = BinaryCodec::Version;
+    emit sendJson(binaryRequest);
+
+    // Предлагаем серверу сжатие крупных ответов (история, списки контактов).
+    // Ответ compression_ack обрабатывает NetworkService; при отказе сервера
+    // ответы приходят несжатыми.
+    QJsonObject compressionRequest;
+    compressionRequest["type"] = "compression";
+    compressionRequest["algorithm"] = "deflate";
+    emit sendJson(compressionRequest);
+
     // Уведомляем остальные компоненты, что шифрование включено
     emit encryptionEnabled();
 }
@@ -880,7 +1672,96 @@ void DataService::handleUserList(const QJsonObject& response) {
     }
 
     // Сообщаем UI, что статусы онлайн/офлайн обновились
-    emit onlineStatusUpdated();
+    notifyOnlineStatusUpdated();
+}
+
+void DataService::handlePing(const QJsonObject& request) {
+    Q_UNUSED(request);
+
+    // Heartbeat сервера: если соединение молчит, сервер присылает ping,
+    // чтобы отличить тихого клиента от полуоткрытого соединения.
+    // Отвечаем немедленно, иначе сервер разорвет соединение.
+    QJsonObject pong;
+    pong["type"] = "pong";
+    emit sendJson(pong);
+}
+
+void DataService::handlePresence(const QJsonObject& response) {
+    // Дельта-событие присутствия: сервер присылает только изменившегося
+    // пользователя вместо полного списка онлайн (см. presence_subscribe).
+    QString username = response["username"].toString();
+    bool online = response["online"].toBool();
+
+    if (!m_userCache.contains(username)) {
+        return; // Не наш контакт — статус не отображаем
+    }
+
+    m_userCache[username].isOnline = online;
+    qDebug() << "[DataService] Presence delta:" << username << (online ? "online" : "offline");
+
+    // Сообщаем UI, что статусы онлайн/офлайн обновились
+    notifyOnlineStatusUpdated();
+}
+
+void DataService::handleProfileDelta(const QJsonObject& response) {
+    // Дельта профиля контакта: сервер присылает только изменившиеся поля
+    // вместо полного пересбора списка контактов (см. update_profile)
+    const QString username = response["username"].toString();
+    if (!m_userCache.contains(username)) {
+        return; // Не наш контакт — его профиль не отображаем
+    }
+
+    User user = m_userCache[username];
+    if (response.contains("display_name"))
+        user.displayName = response["display_name"].toString();
+    if (response.contains("status_message"))
+        user.statusMessage = response["status_message"].toString();
+    if (response.contains("avatar_url"))
+        user.avatarUrl = response["avatar_url"].toString();
+
+    const QString displayName = user.displayName;
+    const QString avatarUrl = user.avatarUrl;
+    updateOrAddUser(std::move(user));
+    emit profileReceived(username);
+
+    // Имя в метаданных чата синхронизируется с профилем
+    if (response.contains("display_name") && m_chatMetadataCache.contains(username)) {
+        Chat chat = m_chatMetadataCache[username];
+        chat.displayName = displayName;
+        updateOrAddChatMetadata(std::move(chat));
+    }
+
+    // Обновившийся аватар прогреваем сразу (тот же путь, что у профилей)
+    if (response.contains("avatar_url")) {
+        m_avatarCache->ensureAvatar(username, avatarUrl);
+    }
+
+    qDebug() << "[DataService] Profile delta for" << username
+             << "fields:" << response.size() - 2;
+}
+
+void DataService::handleRetentionChanged(const QJsonObject& response) {
+    // Срок хранения диалога сменила любая из сторон: политика общая,
+    // локальная база подчиняется ей так же, как серверная
+    const QString username = response["with_user"].toString();
+    if (username.isEmpty()) {
+        return;
+    }
+    const qint64 seconds =
+        qMax<qint64>(0, static_cast<qint64>(response["ttl_seconds"].toDouble()));
+
+    Chat& chat = chatMetadataEntry(username);
+    if (chat.retentionSeconds != seconds) {
+        chat.retentionSeconds = seconds;
+        syncChatMetadata(chat);
+    }
+
+    if (seconds > 0 && m_dbService && m_dbService->isReady()) {
+        m_dbService->post([](DatabaseService& db) { db.pruneExpiredMessages(); });
+    }
+
+    qDebug() << "[DataService] Retention for chat with" << username
+             << "set to" << seconds << "second(s)";
 }
 void DataService::handleOldHistoryData(const QJsonObject& response)
 {
@@ -912,10 +1793,11 @@ void DataService::handleOldHistoryData(const QJsonObject& response)
         QJsonObject msgObj = value.toObject();
 
         msg.id        = msgObj["id"].toDouble();
-        msg.fromUser  = msgObj["fromUser"].toString();
-        msg.toUser    = msgObj["toUser"].toString();
-        msg.payload   = msgObj["payload"].toString();
-        msg.timestamp = msgObj["timestamp"].toString();
+        msg.fromUser  = StringPool::intern(msgObj["fromUser"].toString());
+        msg.toUser    = StringPool::intern(msgObj["toUser"].toString());
+        msg.payload   = m_e2e->openIfSealed(historyForUser,
+                                            msgObj["payload"].toString());
+        msg.timestamp = static_cast<qint64>(msgObj["timestamp"].toDouble());
         msg.replyToId = msgObj["reply_to_id"].toDouble();
         msg.isEdited  = msgObj["is_edited"].toInt();
         msg.isOutgoing = (msg.fromUser == m_currentUser.username);
@@ -937,7 +1819,7 @@ void DataService::handleOldHistoryData(const QJsonObject& response)
     }
 
     // Сохраняем сообщения в БД с upsert-логикой, чтобы не плодить дубликатов
-    insertMessagesWithUpsertFiltered(messages, historyForUser);
+    m_dbService->upsertMessages(messages, historyForUser);
 
     // Добавляем старые сообщения в начало локального кэша и обновляем статус в БД
     for (int i = messages.count() - 1; i >= 0; --i) {
@@ -948,6 +1830,10 @@ void DataService::handleOldHistoryData(const QJsonObject& response)
     // Обновляем ID самого старого сообщения для этого чата
     cache.oldestMessageId = messages.first().id;
 
+    // Отмечаем обращение к чату и ужимаем окно, если чат фоновый
+    touchChatCache(historyForUser);
+    trimChatCacheWindow(historyForUser);
+
     // Если это текущий открытый чат — уведомляем UI о подгрузке истории
     if (historyForUser == m_currentChatPartner.username) {
         qDebug() << "[DataService] Older history is for the current chat. Emitting signal.";
@@ -971,10 +1857,11 @@ void DataService::handleHistoryData(const QJsonObject& response) {
         ChatMessage msg;
 
         msg.id        = msgObj["id"].toDouble();
-        msg.fromUser  = msgObj["fromUser"].toString();
-        msg.toUser    = msgObj["toUser"].toString();
-        msg.payload   = msgObj["payload"].toString();
-        msg.timestamp = msgObj["timestamp"].toString();
+        msg.fromUser  = StringPool::intern(msgObj["fromUser"].toString());
+        msg.toUser    = StringPool::intern(msgObj["toUser"].toString());
+        msg.payload   = m_e2e->openIfSealed(historyForUser,
+                                            msgObj["payload"].toString());
+        msg.timestamp = static_cast<qint64>(msgObj["timestamp"].toDouble());
         msg.replyToId = msgObj["reply_to_id"].toDouble();
         msg.isEdited  = msgObj["is_edited"].toInt();
         msg.isOutgoing = (msg.fromUser == m_currentUser.username);
@@ -996,7 +1883,7 @@ void DataService::handleHistoryData(const QJsonObject& response) {
 
     if (!messages.isEmpty()) {
         // Сначала синхронизируем историю с БД (upsert)
-        insertMessagesWithUpsertFiltered(messages, historyForUser);
+        m_dbService->upsertMessages(messages, historyForUser);
 
         // Обновляем или дополняем кэш истории для данного чата
         ChatCache& cache = m_chatHistoryCache[historyForUser];
@@ -1014,6 +1901,10 @@ void DataService::handleHistoryData(const QJsonObject& response) {
             }
         }
 
+        // Отмечаем обращение к чату и ужимаем окно, если чат фоновый
+        touchChatCache(historyForUser);
+        trimChatCacheWindow(historyForUser);
+
         // Обновляем метаданные чата (последнее сообщение, время, направление, ID)
         const Chat& existingChat = getChatMetadata(historyForUser);
         Chat updatedChat = existingChat;
@@ -1026,11 +1917,14 @@ void DataService::handleHistoryData(const QJsonObject& response) {
             updatedChat.lastMessageId        = last.id;
         }
 
-        // Пересчитываем количество непрочитанных по данным БД
-        updatedChat.unreadCount = m_dbService->getUnreadCountForChat(historyForUser, m_currentUser.username);
+        // Сохраняем обновленные метаданные; количество непрочитанных
+        // уточняется асинхронным пересчетом после вставки (см. ниже)
+        updatedChat.unreadCount = existingChat.unreadCount;
+        updateOrAddChatMetadata(std::move(updatedChat));
 
-        // Сохраняем обновленные метаданные
-        updateOrAddChatMetadata(updatedChat);
+        // Пересчитываем количество непрочитанных по данным БД: задача
+        // встает в очередь после upsert и видит свежие строки
+        updateOrAddUnreadCount(historyForUser, 0);
 
         // Если история для текущего активного чата — обновляем границу и снимаем флаг загрузки
         if (historyForUser == m_currentChatPartner.username) {
@@ -1055,19 +1949,22 @@ void DataService::handleUnreadCounts(const QJsonObject& response)
     // Сбрасываем локальный кэш непрочитанных
     m_unreadCounts.clear();
 
-    // Заполняем кэш только теми чатами, где есть непрочитанные сообщения
+    // Сверка с сервером: его счетчики авторитетны. Локальные значения
+    // замещаются, расхождения уходят в БД лениво той же пачкой
     for (const QJsonValue &value : countsArray) {
         QJsonObject countObj = value.toObject();
         QString username = countObj["username"].toString();
         int count = countObj["count"].toInt();
 
-        if (count > 0) {
+        if (count > 0 || m_unreadCounts.value(username, 0) != 0) {
             m_unreadCounts[username] = count;
+            m_chatMetadataCache[username].unreadCount = count;
+            noteUnreadChanged(username);
         }
     }
 
     // Уведомляем UI, что глобальные счетчики непрочитанных изменились
-    emit unreadCountChanged();
+    notifyUnreadCountChanged();
 }
 
 void DataService::updateMessageStatus(qint64 messageId, ChatMessage::MessageStatus newStatus)
@@ -1087,16 +1984,24 @@ void DataService::updateMessageStatus(qint64 messageId, ChatMessage::MessageStat
     }
 
     // Обновляем статус в базе данных
-    if (m_dbService && m_dbService->isConnected()) {
+    if (m_dbService && m_dbService->isReady()) {
         m_dbService->updateMessageStatus(messageId, newStatus);
     }
 
-    // Пересчитываем непрочитанные и метаданные чата, если удалось найти чат
+    // Пересчитываем непрочитанные и метаданные чата, если удалось найти чат.
+    // Пересчет встает в очередь после записи статуса и видит ее результат.
     if (!chatPartner.isEmpty()) {
-        m_chatMetadataCache[chatPartner].unreadCount =
-            m_dbService->getUnreadCountForChat(chatPartner, m_currentUser.username);
-        emit unreadCountChanged();
-        emit chatMetadataChanged(chatPartner);
+        const QString owner = m_currentUser.username;
+        m_dbService->query<int>(
+            [chatPartner, owner](DatabaseService &db) {
+                return db.getUnreadCountForChat(chatPartner, owner);
+            },
+            this,
+            [this, chatPartner](const int &unread) {
+                m_chatMetadataCache[chatPartner].unreadCount = unread;
+                notifyUnreadCountChanged();
+                notifyChatMetadataChanged(chatPartner);
+            });
     }
 
     // Локальный сигнал о смене статуса конкретного сообщения
@@ -1105,6 +2010,11 @@ void DataService::updateMessageStatus(qint64 messageId, ChatMessage::MessageStat
 
 void DataService::handleLoginSuccess(const QJsonObject& response)
 {
+    // Сразу за login_success сервер шлет залп contact_list / unread_counts /
+    // online_status / офлайн-сообщений — открываем окно коалесценции,
+    // чтобы не перерисовывать список контактов на каждый ответ.
+    beginLoginBurst();
+
     // Проксируем успешный логин дальше (например, для сохранения токена и переключения экрана)
     emit loginSuccess(response);
 }
@@ -1118,50 +2028,142 @@ void DataService::handleLoginFailure(const QJsonObject& response)
 void DataService::initLoad() {
     qDebug() << "[DataService] initialLoad: стартуем загрузку всех данных из БД...";
 
-    // 1. Загружаем всех пользователей и прогреваем кэш аватаров
-    QList<User> users = m_dbService->loadAllUsers();
-    for (const User& user : users) {
-        m_userCache[user.username] = user;
-        m_avatarCache->ensureAvatar(user.username, user.avatarUrl);
+    if (!m_dbService || !m_dbService->isReady()) {
+        qDebug() << "[DataService] initialLoad: БД недоступна, кэш останется пустым";
+        return;
     }
 
-    qDebug() << "[DataService] Загружено пользователей:" << users.size();
+    // Весь стартовый снимок (пользователи, чаты, непрочитанные, последние
+    // сообщения каждого чата) читается одной задачей в потоке БД — GUI-поток
+    // не блокируется на серии SELECT; кэши заполняются в коллбэке
+    const QString owner = m_currentUser.username;
+    const int RECENT_LIMIT = 20;
 
-    // 2. Загружаем все чаты и кладем их в метаданные
-    QList<Chat> chats = m_dbService->loadAllChats();
-    for (const Chat& chat : chats) {
-        m_chatMetadataCache[chat.username] = chat;
-    }
+    m_dbService->query<StartupSnapshot>(
+        [owner, RECENT_LIMIT](DatabaseService &db) {
+            StartupSnapshot snap;
+            snap.users = db.loadAllUsers();
+            // Один индексированный запрос: чаты уже с черновиками и
+            // счетчиками непрочитанных (см. loadChatList)
+            snap.chats = db.loadChatList(owner);
+            for (const Chat& chat : snap.chats) {
+                snap.recent[chat.username] =
+                    db.loadRecentMessages(owner, chat.username, RECENT_LIMIT);
+            }
+            snap.anchors = db.loadScrollAnchors(owner);
+            return snap;
+        },
+        this,
+        [this](const StartupSnapshot &snap) {
+            // Аватары архивных чатов на старте не прогреваются: их строк
+            // нет ни в списке, ни на экране — загрузятся по требованию,
+            // когда чат разархивируют
+            QSet<QString> archivedUsers;
+            for (const Chat& chat : snap.chats) {
+                if (chat.isArchived) {
+                    archivedUsers.insert(chat.username);
+                }
+            }
 
-    // Обогащаем метаданные последними сообщениями и непрочитанными
-    loadChatMetadataFromDatabase();
-    qDebug() << "[DataService] Загружено чатов:" << chats.size();
+            // 1. Пользователи и прогрев кэша аватаров
+            for (const User& user : snap.users) {
+                m_userCache[user.username] = user;
+                if (!archivedUsers.contains(user.username)) {
+                    m_avatarCache->ensureAvatar(user.username, user.avatarUrl);
+                }
+            }
 
-    // 3. Для каждого чата подгружаем последние N сообщений в кэш
-    const int RECENT_LIMIT = 20;
-    for (const Chat& chat : chats) {
-        QList<ChatMessage> history = m_dbService->loadRecentMessages(
-            m_currentUser.username, chat.username, RECENT_LIMIT
-        );
-        m_chatHistoryCache[chat.username].messages = history;
-
-        // Обновляем превью последнего сообщения в метаданных
-        if (!history.isEmpty()) {
-            const ChatMessage& last = history.last();
-            m_chatMetadataCache[chat.username].lastMessagePayload =
-                (last.payload == "" ? last.fileName : last.payload);
-            m_chatMetadataCache[chat.username].lastMessageTimestamp = last.timestamp;
-            m_chatMetadataCache[chat.username].isLastMessageOutgoing = last.isOutgoing;
-            m_chatMetadataCache[chat.username].lastMessageId = last.id;
-        } else {
-            m_chatMetadataCache[chat.username].lastMessagePayload = "";
-            m_chatMetadataCache[chat.username].lastMessageTimestamp = "";
-            m_chatMetadataCache[chat.username].lastMessageId = 0;
-        }
-        emit chatMetadataChanged(chat.username);
+            qDebug() << "[DataService] Загружено пользователей:" << snap.users.size();
+
+            // 2. Чаты (черновик и счетчик непрочитанных уже в строке)
+            for (const Chat& chat : snap.chats) {
+                m_chatMetadataCache[chat.username] = chat;
+            }
+
+            // Позиции прокрутки: решение "откуда открывать чат"
+            // принимается из памяти, без похода в БД
+            m_scrollAnchors = snap.anchors;
+
+            qDebug() << "[DataService] Загружено чатов:" << snap.chats.size();
+
+            // 3. Последние N сообщений каждого чата в кэш истории
+            for (const Chat& chat : snap.chats) {
+                const QList<ChatMessage> history = snap.recent.value(chat.username);
+                m_chatHistoryCache[chat.username].messages = history;
+                if (!history.isEmpty()) {
+                    m_chatHistoryCache[chat.username].oldestMessageId = history.first().id;
+                }
+                touchChatCache(chat.username);
+
+                // Обновляем превью последнего сообщения в метаданных
+                if (!history.isEmpty()) {
+                    const ChatMessage& last = history.last();
+                    m_chatMetadataCache[chat.username].lastMessagePayload =
+                        (last.payload == "" ? last.fileName : last.payload);
+                    m_chatMetadataCache[chat.username].lastMessageTimestamp = last.timestamp;
+                    m_chatMetadataCache[chat.username].isLastMessageOutgoing = last.isOutgoing;
+                    m_chatMetadataCache[chat.username].lastMessageId = last.id;
+                } else {
+                    m_chatMetadataCache[chat.username].lastMessagePayload = "";
+                    m_chatMetadataCache[chat.username].lastMessageTimestamp = 0;
+                    m_chatMetadataCache[chat.username].lastMessageId = 0;
+                }
+                notifyChatMetadataChanged(chat.username);
+            }
+
+            qDebug() << "[DataService] initialLoad завершён! Кэш готов.";
+
+            // Стартовый снимок встал — прогреваем горячие чаты целиком
+            prefetchHotChats();
+        });
+}
+
+void DataService::prefetchHotChats() {
+    if (!m_dbService || !m_dbService->isReady()) {
+        return;
     }
 
-    qDebug() << "[DataService] initialLoad завершён! Кэш готов.";
+    // Top-K по статистике открытий и полное окно каждого — одной
+    // задачей в потоке БД, после стартового снимка (порядок очереди
+    // фасада это гарантирует)
+    const QString owner = m_currentUser.username;
+    m_dbService->query<PrefetchSnapshot>(
+        [owner](DatabaseService &db) {
+            PrefetchSnapshot snap;
+            snap.order = db.topOpenedChats(owner, PrefetchTopChats);
+            for (const QString& chat : snap.order) {
+                snap.pages[chat] = db.loadRecentMessages(owner, chat, ChatCacheWindow);
+            }
+            return snap;
+        },
+        this,
+        [this](const PrefetchSnapshot &snap) {
+            for (const QString& chatPartner : snap.order) {
+                // Активный чат не трогаем: его окно уже живет своей жизнью
+                if (chatPartner == m_currentChatPartner.username) {
+                    continue;
+                }
+                const QList<ChatMessage>& page = snap.pages.value(chatPartner);
+                if (page.isEmpty()) {
+                    continue;
+                }
+
+                ChatCache& cache = m_chatHistoryCache[chatPartner];
+                cache.messages = page;
+                cache.oldestMessageId = page.first().id;
+                cache.allMessagesLoaded = false;
+                cache.prefetched = true;
+                touchChatCache(chatPartner);
+
+                // Фоновая дельта-синхронизация: к моменту клика прогретое
+                // окно уже догнано до серверного хвоста
+                emit requestServerHistory(chatPartner, page.last().id);
+            }
+
+            if (!snap.order.isEmpty()) {
+                qDebug() << "[DataService] Prefetched hot chats:" << snap.order;
+            }
+        });
 }
 
 void DataService::cacheUploadedFile(QString fileId, const QString& fileName, const QString& fileUrl)
@@ -1207,19 +2209,40 @@ void DataService::handleRegisterFailure(const QJsonObject& response)
 
 void DataService::handlePrivateMessage(const QJsonObject& response) {
 
+    // 0. Отладочная трасса сквозной задержки (MESSENGER_TRACE у отправителя).
+    // По echo видна восходящая дорога и полный круг, по доставке — еще и
+    // время маршрутизации на сервере. Дельты между часами двух машин
+    // ориентировочные; надежен полный круг, меренный одними часами.
+    if (response.contains("trace_id")) {
+        const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+        const qint64 sentMs = static_cast<qint64>(response["trace_sent_ms"].toDouble());
+        const qint64 srvReceivedMs =
+            static_cast<qint64>(response["srv_received_ms"].toDouble());
+        qInfo().nospace() << "[TRACE] id=" << response["trace_id"].toString()
+                          << (response.contains("srv_routed_ms") ? " delivery" : " echo")
+                          << " uplink_ms=" << srvReceivedMs - sentMs
+                          << " total_ms=" << nowMs - sentMs;
+    }
+
     // 1. Проверяем, является ли это эхо по temp_id (подтверждение отправки)
     QString tempId = response["temp_id"].toString();
     if (!tempId.isEmpty()) {
         qDebug() << "[DataService] Received ECHO for temp_id:" << tempId;
 
+        // Замыкаем замер круга отправка->echo для счетчиков PerfMetrics
+        PerfMetrics::markEcho(tempId);
+
         // Собираем подтвержденное сообщение
         ChatMessage msg;
         msg.id        = response["id"].toDouble();
         msg.tempId    = tempId;
-        msg.fromUser  = response["fromUser"].toString();
-        msg.toUser    = response["toUser"].toString();
-        msg.payload   = response["payload"].toString();
-        msg.timestamp = response["timestamp"].toString();
+        msg.fromUser  = StringPool::intern(response["fromUser"].toString());
+        msg.toUser    = StringPool::intern(response["toUser"].toString());
+        // Эхо возвращает запечатанную нагрузку — ключ диалога симметричен,
+        // открываем ее обратно для UI и локальной БД
+        msg.payload   = m_e2e->openIfSealed(msg.toUser,
+                                            response["payload"].toString());
+        msg.timestamp = static_cast<qint64>(response["timestamp"].toDouble());
         msg.replyToId = response["reply_to_id"].toDouble();
         msg.isOutgoing = true;
         msg.status    = ChatMessage::MessageStatus::Sent;
@@ -1229,7 +2252,7 @@ void DataService::handlePrivateMessage(const QJsonObject& response) {
         msg.fileUrl   = response["file_url"].toString();
 
         // Обновляем локальную запись в БД по временном ID
-        if (m_dbService && m_dbService->isConnected()) {
+        if (m_dbService && m_dbService->isReady()) {
             m_dbService->confirmSentMessageByTempId(tempId, msg);
             qDebug() << "[DataService] Echo: updated local record by tempId";
         }
@@ -1260,10 +2283,11 @@ void DataService::handlePrivateMessage(const QJsonObject& response) {
     // 2. Обычное входящее сообщение (без temp_id)
     ChatMessage incomingMsg;
     incomingMsg.id        = response["id"].toDouble();
-    incomingMsg.fromUser  = response["fromUser"].toString();
-    incomingMsg.toUser    = response["toUser"].toString();
-    incomingMsg.payload   = response["payload"].toString();
-    incomingMsg.timestamp = response["timestamp"].toString();
+    incomingMsg.fromUser  = StringPool::intern(response["fromUser"].toString());
+    incomingMsg.toUser    = StringPool::intern(response["toUser"].toString());
+    incomingMsg.payload   = m_e2e->openIfSealed(incomingMsg.fromUser,
+                                                response["payload"].toString());
+    incomingMsg.timestamp = static_cast<qint64>(response["timestamp"].toDouble());
     incomingMsg.replyToId = response["reply_to_id"].toDouble();
     incomingMsg.isOutgoing = false;
     incomingMsg.isEdited  = false;
@@ -1288,16 +2312,18 @@ void DataService::handlePrivateMessage(const QJsonObject& response) {
     if (m_chatHistoryCache.contains(chatPartner)) {
         m_chatHistoryCache[chatPartner].messages.append(incomingMsg);
         m_chatHistoryCache[chatPartner].oldestMessageId = incomingMsg.id;
+
+        // Отмечаем обращение к чату и ужимаем окно, если чат фоновый
+        touchChatCache(chatPartner);
+        trimChatCacheWindow(chatPartner);
     }
 
     // Обновляем метаданные чата (последнее сообщение)
     updateLastMessage(incomingMsg.fromUser, incomingMsg);
 
-    // Обновляем unreadCount через БД
-    const Chat& existingChat = getChatMetadata(incomingMsg.fromUser);
-    Chat updatedChat = existingChat;
-    updatedChat.unreadCount = m_dbService->getUnreadCountForChat(incomingMsg.fromUser, m_currentUser.username);
-    updateOrAddChatMetadata(updatedChat);
+    // Горячий путь входящего: счетчик растет за O(1) в памяти,
+    // запись в БД и сигнал бейджа коалесцируются движком непрочитанных
+    incrementUnreadCount(incomingMsg.fromUser);
 
     qDebug() << "[DataService] Emit newMessageReceived for incomingMsg";
 
@@ -1305,8 +2331,8 @@ void DataService::handlePrivateMessage(const QJsonObject& response) {
     emit newMessageReceived(incomingMsg);
 }
 
-DatabaseService* DataService::getDatabaseService() {
-    // Геттер для доступа к DatabaseService
+DatabaseFacade* DataService::getDatabaseService() {
+    // Геттер для доступа к асинхронному фасаду БД
     return m_dbService;
 }
 
@@ -1321,83 +2347,140 @@ void DataService::updateOrAddCurrentUserCrypto(CryptoManager* cryptoManager){
     emit cryptoManagerChanged(m_crypto);
 }
 
-void DataService::handleMessageDelivered(const QJsonObject& response)
-{
-    qint64 messageId = response["id"].toDouble();
-    qDebug() << "[DataService] Message" << messageId << "was delivered.";
+E2ESessionManager* DataService::getE2ESessions() {
+    // Сквозное шифрование диалогов: ключи, сессии, опции чатов
+    return m_e2e;
+}
 
-    // Обновляем статус в БД
-    if (m_dbService && m_dbService->isConnected()) {
-        m_dbService->updateMessageStatus(messageId, ChatMessage::Delivered);
-        qDebug() << "[DataService] Status updated in DB for message" << messageId << "-> Delivered";
+QList<qint64> DataService::extractStatusIds(const QJsonObject& response)
+{
+    // Сервер группирует уведомления о статусах: пакет приходит массивом ids,
+    // одиночное уведомление — полем id (его же дает бинарная запись кодека).
+    QList<qint64> messageIds;
+
+    if (response.contains("ids")) {
+        const QJsonArray idsArray = response["ids"].toArray();
+        messageIds.reserve(idsArray.size());
+        for (const QJsonValue &value : idsArray) {
+            messageIds.append(qint64(value.toDouble()));
+        }
+    } else {
+        messageIds.append(qint64(response["id"].toDouble()));
     }
 
-    // Обновляем статус в кэше истории
-    ChatMessage::MessageStatus newStatus = ChatMessage::Delivered;
+    return messageIds;
+}
+
+void DataService::applyMessageStatuses(const QList<qint64>& messageIds,
+                                       ChatMessage::MessageStatus newStatus)
+{
+    if (messageIds.isEmpty()) return;
+
+    // Один проход по кэшу истории на весь пакет вместо поиска на каждый ID
+    const QSet<qint64> pending(messageIds.begin(), messageIds.end());
+    QList<qint64> currentChatIds;
     for (auto it = m_chatHistoryCache.begin(); it != m_chatHistoryCache.end(); ++it) {
         QList<ChatMessage>& messages = it.value().messages;
-        for (int i = 0; i < messages.size(); ++i) {
-            if (messages[i].id == messageId) {
-                if (messages[i].status == newStatus) return;  // Уже обновлено
-
-                messages[i].status = newStatus;
-                QString foundInChatWith = it.key();
-                qDebug() << "[DataService] Status updated for message" << messageId
-                         << "in chat with" << foundInChatWith;
-
-                // В текущем открытом чате дергаем сигнал для обновления UI
-                if (foundInChatWith == m_currentChatPartner.username) {
-                    emit messageStatusChanged(messageId, newStatus);
-                }
-                return;
+        for (ChatMessage& msg : messages) {
+            if (!pending.contains(msg.id) || msg.status == newStatus) continue;
+
+            msg.status = newStatus;
+            // UI обновляем только для открытого чата — одним батчем ниже
+            if (it.key() == m_currentChatPartner.username) {
+                currentChatIds.append(msg.id);
             }
         }
     }
+
+    if (!currentChatIds.isEmpty()) {
+        emit messageStatusesChanged(currentChatIds, newStatus);
+    }
+
+    // Запись в БД — одной задачей на весь пакет, а не задачей на ID
+    if (m_dbService && m_dbService->isReady()) {
+        m_dbService->post([messageIds, newStatus](DatabaseService &db) {
+            for (qint64 messageId : messageIds) {
+                db.updateMessageStatus(messageId, newStatus);
+            }
+        });
+    }
 }
 
-void DataService::handleMessageRead(const QJsonObject& response)
+void DataService::applyMessageStatusesUpTo(const QString& chatPartner, qint64 upToId,
+                                           ChatMessage::MessageStatus newStatus)
 {
-    qint64 messageId = response["id"].toDouble();
-    qDebug() << "[DataService] Message" << messageId << "was read.";
+    if (chatPartner.isEmpty() || upToId <= 0) return;
+
+    // В кэше истории затрагивается только диалог с этим собеседником;
+    // статус не откатываем (Read не становится Delivered повторной квитанцией)
+    QList<qint64> changedIds;
+    auto it = m_chatHistoryCache.find(chatPartner);
+    if (it != m_chatHistoryCache.end()) {
+        for (ChatMessage& msg : it.value().messages) {
+            if (!msg.isOutgoing || msg.id <= 0 || msg.id > upToId) continue;
+            if (msg.status >= newStatus) continue;
+
+            msg.status = newStatus;
+            changedIds.append(msg.id);
+        }
+    }
 
-    // Обновляем статус в БД
-    if (m_dbService && m_dbService->isConnected()) {
-        m_dbService->updateMessageStatus(messageId, ChatMessage::Read);
-        qDebug() << "[DataService] Status updated in DB for message" << messageId << "-> Read";
+    if (!changedIds.isEmpty() && chatPartner == m_currentChatPartner.username) {
+        emit messageStatusesChanged(changedIds, newStatus);
     }
 
-    // Обновляем статус в кэше истории
-    ChatMessage::MessageStatus newStatus = ChatMessage::Read;
-    for (auto it = m_chatHistoryCache.begin(); it != m_chatHistoryCache.end(); ++it) {
-        QList<ChatMessage>& messages = it.value().messages;
-        for (int i = 0; i < messages.size(); ++i) {
-            if (messages[i].id == messageId) {
-                if (messages[i].status == newStatus) return;  // Уже Read
+    // Запись в БД — одним диапазонным UPDATE на весь пакет
+    if (m_dbService && m_dbService->isReady()) {
+        const QString currentUsername = m_currentUser.username;
+        m_dbService->post([chatPartner, currentUsername, upToId, newStatus](DatabaseService &db) {
+            db.updateSentMessagesStatusUpTo(chatPartner, currentUsername, upToId, newStatus);
+        });
+    }
+}
 
-                messages[i].status = newStatus;
-                QString foundInChatWith = it.key();
-                qDebug() << "[DataService] Status updated for message" << messageId
-                         << "in chat with" << foundInChatWith;
+void DataService::handleMessageDelivered(const QJsonObject& response)
+{
+    // Диапазонная форма: сервер сжал квитанции получателя в верхнюю границу
+    if (response.contains("up_to_id")) {
+        const qint64 upToId = qint64(response["up_to_id"].toDouble());
+        qDebug() << "[DataService] Messages delivered up to id" << upToId;
+        applyMessageStatusesUpTo(response["from"].toString(), upToId, ChatMessage::Delivered);
+        return;
+    }
 
-                if (foundInChatWith == m_currentChatPartner.username) {
-                    emit messageStatusChanged(messageId, newStatus);
-                }
-                return;
-            }
-        }
+    const QList<qint64> messageIds = extractStatusIds(response);
+    qDebug() << "[DataService]" << messageIds.size() << "message(s) delivered.";
+
+    applyMessageStatuses(messageIds, ChatMessage::Delivered);
+}
+
+void DataService::handleMessageRead(const QJsonObject& response)
+{
+    // Диапазонная форма: сервер сжал квитанции получателя в верхнюю границу
+    if (response.contains("up_to_id")) {
+        const qint64 upToId = qint64(response["up_to_id"].toDouble());
+        qDebug() << "[DataService] Messages read up to id" << upToId;
+        applyMessageStatusesUpTo(response["from"].toString(), upToId, ChatMessage::Read);
+        return;
     }
+
+    const QList<qint64> messageIds = extractStatusIds(response);
+    qDebug() << "[DataService]" << messageIds.size() << "message(s) read.";
+
+    applyMessageStatuses(messageIds, ChatMessage::Read);
 }
 
 void DataService::handleEditMessage(const QJsonObject& response)
 {
     QString chatPartner = response["with_user"].toString();
     qint64 messageId = response["id"].toDouble();
-    QString newPayload = response["payload"].toString();
+    QString newPayload =
+        m_e2e->openIfSealed(chatPartner, response["payload"].toString());
 
     qDebug() << "[DataService] Received command to edit message" << messageId;
 
     // Обновляем текст сообщения в БД
-    if (m_dbService && m_dbService->isConnected()) {
+    if (m_dbService && m_dbService->isReady()) {
         m_dbService->editMessage(messageId, newPayload);
         qDebug() << "[DataService] Message" << messageId << "edited in DB";
     }
@@ -1425,7 +2508,7 @@ void DataService::handleDeleteMessage(const QJsonObject& response){
     QString chatUser = response["with_user"].toString();
 
     // Удаляем сообщение из БД
-    if (m_dbService && m_dbService->isConnected()) {
+    if (m_dbService && m_dbService->isReady()) {
         m_dbService->deleteMessage(messageId);
         qDebug() << "[DataService] Message" << messageId << "deleted from DB";
     }
@@ -1454,9 +2537,13 @@ void DataService::handleDeleteMessage(const QJsonObject& response){
 
 void DataService::handleSearchResults(const QJsonObject& response)
 {
-    // Просто прокидываем массив найденных пользователей наверх
+    // Прокидываем чанк найденных пользователей наверх вместе с поколением
+    // запроса. Ответ старого сервера без полей потоковой выдачи выглядит
+    // как единственный первый чанк с нулевым поколением.
     QJsonArray users = response["users"].toArray();
-    emit searchResultsReceived(users);
+    const qint64 generation = response["gen"].toVariant().toLongLong();
+    const bool firstChunk = response.contains("first") ? response["first"].toBool() : true;
+    emit searchResultsReceived(users, generation, firstChunk);
 }
 
 void DataService::handleAddContactSuccess(const QJsonObject& response)
@@ -1473,17 +2560,50 @@ void DataService::handleAddContactFailure(const QJsonObject& response)
 
 void DataService::handleIncomingContactRequest(const QJsonObject& response)
 {
+    // К заявке подвезен публичный ключ E2E отправителя — выводим ключ
+    // диалога сразу: если заявку примут, сессия уже готова (отклоненная
+    // заявка оставляет в кэше неиспользуемый ключ, это безвредно)
+    if (response.contains("e2e_key")) {
+        m_e2e->adoptPeerKey(response["fromUsername"].toString(),
+                            response["e2e_key"].toString());
+    }
+
+    // Кэшируем заявку: по нему заново наполняется пересозданный после
+    // гибернации IncomingRequestsWidget
+    m_pendingRequests.append(response);
+
     // Весь JSON запроса прокидываем дальше (для отображения диалога)
     emit contactRequestReceived(response);
 }
 
+void DataService::handleContactAccepted(const QJsonObject& response)
+{
+    // Вторая половина обмена ключами, подвезенного к принятию контакта:
+    // принявшая сторона вернула свой публичный ключ E2E
+    if (response.contains("e2e_key")) {
+        m_e2e->adoptPeerKey(response["fromUsername"].toString(),
+                            response["e2e_key"].toString());
+    }
+}
+
 void DataService::handlePendingRequestsList(const QJsonObject& response)
 {
     // Список ожидающих заявок в друзья
     QJsonArray requests = response["requests"].toArray();
+    m_pendingRequests = requests;
     emit pendingContactRequestsUpdated(requests);
 }
 
+void DataService::removePendingContactRequest(const QString& fromUsername)
+{
+    for (int i = 0; i < m_pendingRequests.size(); ++i) {
+        if (m_pendingRequests.at(i).toObject()["fromUsername"].toString() == fromUsername) {
+            m_pendingRequests.removeAt(i);
+            return;
+        }
+    }
+}
+
 void DataService::handleLogoutSuccess(const QJsonObject& response)
 {
     Q_UNUSED(response);
@@ -1507,32 +2627,54 @@ void DataService::handleTypingResponse(const QJsonObject& response)
     m_userCache[fromUser].isTyping = true;
     emit typingStatusChanged(fromUser, true);
 
-    // Создаем таймер авто-сброса статуса, если его ещё нет
-    if (!m_typingReceiveTimers.contains(fromUser)) {
-        QTimer* timer = new QTimer(this);
-        timer->setInterval(2500);      // Через 2.5 секунды без новых событий — сбросить "печатает"
-        timer->setSingleShot(true);
+    // Продлеваем дедлайн сброса; таймер один на всех, взводим его только
+    // если он еще не идет — новый дедлайн заведомо не раньше текущего
+    m_typingDeadlines[fromUser] =
+        QDateTime::currentMSecsSinceEpoch() + TypingExpiryMs;
+    if (!m_typingExpiryTimer->isActive()) {
+        m_typingExpiryTimer->start(TypingExpiryMs);
+    }
+}
 
-        connect(timer, &QTimer::timeout, this, [this, fromUser](){
-            if (m_userCache.contains(fromUser)) {
-                m_userCache[fromUser].isTyping = false;
-                emit typingStatusChanged(fromUser, false);
+void DataService::expireTypingStatuses()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 nextDeadline = 0;
+
+    // Пакетный проход: гасим всех просроченных, попутно находим ближайший
+    // оставшийся дедлайн. Печатающих одновременно — единицы, линейный
+    // проход дешевле поддержания сортированной структуры
+    for (auto it = m_typingDeadlines.begin(); it != m_typingDeadlines.end();) {
+        if (it.value() <= now) {
+            const QString username = it.key();
+            it = m_typingDeadlines.erase(it);
+            if (m_userCache.contains(username)) {
+                m_userCache[username].isTyping = false;
+                emit typingStatusChanged(username, false);
             }
-        });
-        m_typingReceiveTimers[fromUser] = timer;
+        } else {
+            if (nextDeadline == 0 || it.value() < nextDeadline) {
+                nextDeadline = it.value();
+            }
+            ++it;
+        }
     }
 
-    // Перезапускаем таймер для этого пользователя
-    m_typingReceiveTimers[fromUser]->start();
+    // Перевзводимся на ближайший из оставшихся дедлайнов
+    if (nextDeadline > 0) {
+        m_typingExpiryTimer->start(int(qMax<qint64>(1, nextDeadline - now)));
+    }
 }
 
 void DataService::clearAllData()
 {
     // Очищаем все кэши и состояния
     m_chatHistoryCache.clear();
+    m_chatCacheLru.clear();
     m_userCache.clear();
     m_unreadCounts.clear();
     m_chatMetadataCache.clear();
+    m_scrollAnchors.clear();
 
     // Сбрасываем текущие сущности и флаги
     m_currentUser = User();
@@ -1543,170 +2685,184 @@ void DataService::clearAllData()
     m_replyToMessageId = 0;
     m_isChatSearchActive = false;
 
-    // Удаляем все таймеры статуса "печатает" и очищаем карту
-    qDeleteAll(m_typingReceiveTimers);
-    m_typingReceiveTimers.clear();
+    // Сбрасываем планировщик статусов "печатает"
+    m_typingExpiryTimer->stop();
+    m_typingDeadlines.clear();
 
     qDebug() << "[DataService] All data and state has been cleared.";
 }
 
-int DataService::getLastServerIdForChat(int chatId) {
-    QSqlQuery query;
-    query.prepare("SELECT MAX(server_id) FROM messages WHERE chat_id = ?");
-    query.addBindValue(chatId);
-
-    // Получаем максимальный server_id для данного чата
-    if (query.exec() && query.next()) {
-        return query.value(0).toInt();
-    }
-    return 0;
-}
-
 void DataService::syncChatHistory(const QString& chatPartner) {
     qDebug() << "[DataService] Starting history sync for chat with:" << chatPartner;
 
-    QList<ChatMessage> localHistory;
-    QSqlQuery query;
-    // Загружаем всю локальную историю для этого собеседника
-    query.prepare(
-        "SELECT server_id, from_user, to_user, payload, timestamp, "
-        "is_edited, reply_to_id, status, file_id, file_name, file_url "
-        "FROM messages WHERE (from_user = :usr2 OR to_user = :usr2) "
-        "ORDER BY server_id ASC"
-    );
-    query.bindValue(":usr2", chatPartner);
-    query.bindValue(":usr2", chatPartner);  // Дубликат, но harmless
-
-    if (query.exec()) {
-        qDebug() << "Queryexec";
-        while (query.next()) {
-            ChatMessage msg;
-            msg.id        = query.value(0).toDouble();
-            msg.fromUser  = query.value(1).toString();
-            msg.toUser    = query.value(2).toString();
-            msg.payload   = query.value(3).toString();
-            msg.timestamp = query.value(4).toString();
-            msg.isEdited  = query.value(5).toInt();
-            msg.replyToId = query.value(6).toInt();
-            msg.isOutgoing = (msg.fromUser == m_currentUser.username);
-            msg.fileId    = query.value(8).toString();
-            msg.fileName  = query.value(9).toString();
-            msg.fileUrl   = query.value(10).toString();
-
-            // Восстанавливаем статус по числовому коду
-            if (query.value(7).toInt() == 1) {
-                msg.status = ChatMessage::Delivered;
-            }
-            if (query.value(7).toInt() == 3) {
-                msg.status = ChatMessage::Read;
-            }
+    const QString owner = m_currentUser.username;
 
-            localHistory.append(msg);
-        }
-    } else {
-        qDebug() << query.lastError();
+    // Каждое открытие пополняет статистику префетчера
+    if (m_dbService && m_dbService->isReady()) {
+        m_dbService->recordChatOpen(owner, chatPartner);
     }
 
-    // Кладем историю в кэш
-    m_chatHistoryCache[chatPartner].messages = localHistory;
-    if (!localHistory.isEmpty()) {
-        m_oldestMessageId = localHistory.first().id;
-    }
+    // Сохраненная позиция прокрутки: если якорь старше прогретого окна,
+    // быстрый путь не подходит — нужно якорное окно из БД
+    const ChatScrollAnchor anchor = m_scrollAnchors.value(chatPartner);
 
-    qDebug() << "[DataService] Loaded" << localHistory.size() << "messages from local cache";
-    emit historyLoaded(chatPartner, localHistory);
+    // Быстрый путь: окно чата прогрето префетчером — контент отдается
+    // из памяти без похода в БД, клик и открытие неразличимы по времени
+    ChatCache& warm = m_chatHistoryCache[chatPartner];
+    const bool anchorOutsideWarm = anchor.messageId > 0 && !warm.messages.isEmpty()
+                                   && warm.messages.first().id > anchor.messageId;
+    if (warm.prefetched && !warm.messages.isEmpty() && !anchorOutsideWarm) {
+        m_oldestMessageId = warm.oldestMessageId;
+        touchChatCache(chatPartner);
 
-    // Определяем lastId для догрузки с сервера
-    int lastId = 0;
-    if (!localHistory.isEmpty()) {
-        lastId = localHistory.last().id;
-        qDebug() << "Last ID" << localHistory.last().id
-                 << "First:" << localHistory.first().id;
+        qDebug() << "[DataService] Serving" << warm.messages.size()
+                 << "messages from prefetched cache";
+        emit historyLoaded(chatPartner, warm.messages);
+        emit requestServerHistory(chatPartner, warm.messages.last().id);
+        return;
     }
 
-    qDebug() << "[DataService] Requesting history from server after id:" << lastId;
+    // Окно истории читается в потоке БД; кэш, UI и запрос догрузки
+    // с сервера обновляются в коллбэке. Загружаем не всю историю,
+    // а только окно последних сообщений — более старые страницы
+    // подтягиваются из БД при прокрутке вверх (loadOlderHistoryChunk)
+    m_dbService->query<QList<ChatMessage>>(
+        [owner, chatPartner, anchorId = anchor.messageId](DatabaseService &db) {
+            // С сохраненной позицией окно накрывает якорь и тянется до
+            // хвоста чата (см. loadMessagesAnchored) — страницы, которые
+            // пользователь уже читал, не перечитываются при прокрутке
+            if (anchorId > 0) {
+                return db.loadMessagesAnchored(owner, chatPartner, anchorId, ChatCacheWindow);
+            }
+            return db.loadRecentMessages(owner, chatPartner, ChatCacheWindow);
+        },
+        this,
+        [this, chatPartner](const QList<ChatMessage> &localHistory) {
+            // Кладем окно истории в кэш и отмечаем обращение к чату
+            ChatCache& cache = m_chatHistoryCache[chatPartner];
+            cache.messages = localHistory;
+            cache.allMessagesLoaded = false;
+            if (!localHistory.isEmpty()) {
+                cache.oldestMessageId = localHistory.first().id;
+                m_oldestMessageId = localHistory.first().id;
+            }
+            touchChatCache(chatPartner);
 
-    // Запрашиваем у сервера историю после lastId
-    emit requestServerHistory(chatPartner, lastId);
-}
+            qDebug() << "[DataService] Loaded" << localHistory.size() << "messages from local cache";
+            emit historyLoaded(chatPartner, localHistory);
 
-QSet<qint64> DataService::fetchExistingServerIds(const QString& chatPartner) {
-    QSet<qint64> serverIds;
-    QSqlQuery query;
+            // Определяем lastId для догрузки с сервера
+            int lastId = 0;
+            if (!localHistory.isEmpty()) {
+                lastId = localHistory.last().id;
+                qDebug() << "Last ID" << localHistory.last().id
+                         << "First:" << localHistory.first().id;
+            }
 
-    // Получаем все server_id для сообщений с этим собеседником (и входящих, и исходящих)
-    query.prepare(
-        "SELECT server_id FROM messages "
-        "WHERE (from_user = ? OR to_user = ?) AND server_id NOT NULL"
-    );
-    query.addBindValue(chatPartner);
-    query.addBindValue(chatPartner);
+            qDebug() << "[DataService] Requesting history from server after id:" << lastId;
 
-    if (query.exec()) {
-        while (query.next()) {
-            serverIds.insert(query.value(0).toLongLong());
-        }
-    }
-    return serverIds;
+            // Запрашиваем у сервера историю после lastId
+            emit requestServerHistory(chatPartner, lastId);
+        });
 }
 
-void DataService::insertMessagesWithUpsertFiltered(const QList<ChatMessage>& messages,
-                                                   const QString& chatPartner) {
-    // Если нет сообщений — делать нечего
-    if (messages.isEmpty())
+void DataService::searchLocalMessages(const QString& queryText)
+{
+    // Без локальной БД поиск недоступен — отдаем пустой результат
+    if (!m_dbService->isReady()) {
+        emit localSearchResults(queryText, QList<MessageSearchHit>());
         return;
+    }
 
-    // Собираем уже существующие server_id, чтобы не вставлять дубликаты
-    QSet<qint64> localServerIds = fetchExistingServerIds(chatPartner);
-    qDebug() << localServerIds.isEmpty();
+    // Поиск выполняется по FTS-индексу в потоке БД, UI не блокируется
+    const QString owner = m_currentUser.username;
+    m_dbService->query<QList<MessageSearchHit>>(
+        [queryText, owner](DatabaseService &db) {
+            return db.searchMessages(queryText, owner);
+        },
+        this,
+        [this, queryText](const QList<MessageSearchHit> &hits) {
+            qDebug() << "[DataService] Local search for" << queryText
+                     << "returned" << hits.size() << "hits";
+            emit localSearchResults(queryText, hits);
+        });
+}
 
-    // Открываем транзакцию для пачечной вставки (быстрее и атомарно)
-    QSqlDatabase::database().transaction();
+void DataService::resolveReplyMessage(qint64 messageId)
+{
+    // Точечный подъем цели реплая из потока БД: окно модели ее уже
+    // вытеснило, но локальная история хранит сообщение целиком
+    m_dbService->query<ChatMessage>(
+        [messageId](DatabaseService &db) {
+            return db.getMessageById(messageId);
+        },
+        this,
+        [this, messageId](const ChatMessage &msg) {
+            if (msg.id > 0) {
+                emit replyMessageResolved(msg);
+            } else {
+                qDebug() << "[DataService] Цель реплая" << messageId
+                         << "не найдена в локальной БД";
+            }
+        });
+}
 
-    QSqlQuery query;
-    query.prepare(
-        "INSERT OR IGNORE INTO messages "
-        "(server_id, temp_id, from_user, to_user, payload, timestamp, status, "
-        " is_edited, reply_to_id, is_outgoing, file_id, file_name, file_url) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
-    );
+void DataService::loadOlderHistoryChunk()
+{
+    const QString chatPartner = m_currentChatPartner.username;
+    const qint64 beforeId = m_oldestMessageId;
 
-    int inserted = 0;
-    for (const ChatMessage& msg : messages) {
-        // Если server_id > 0 и такое сообщение уже есть локально — пропускаем
-        if (msg.id > 0 && localServerIds.contains(msg.id))
-            continue;
+    // Нет открытого чата или границы пагинации — подгружать нечего
+    if (chatPartner.isEmpty() || beforeId <= 0) {
+        return;
+    }
 
-        // Биндим все поля сообщения в инсерт
-        query.addBindValue(msg.id);
-        query.addBindValue(msg.tempId);
-        query.addBindValue(msg.fromUser);
-        query.addBindValue(msg.toUser);
-        query.addBindValue(msg.payload);
-        query.addBindValue(msg.timestamp);
-        query.addBindValue(msg.status);
-        query.addBindValue(msg.isEdited);
-        query.addBindValue(msg.replyToId);
-        query.addBindValue(msg.isOutgoing);
-        query.addBindValue(msg.fileId);
-        query.addBindValue(msg.fileName);
-        query.addBindValue(msg.fileUrl);
-
-        qDebug() << msg.id << msg.tempId << msg.fromUser << msg.toUser
-                 << msg.payload << msg.timestamp << msg.status
-                 << msg.isEdited << msg.replyToId << msg.isOutgoing
-                 << msg.fileId << msg.fileName << msg.fileUrl;
-
-        if (query.exec()){
-            inserted++;
-        } else {
-            qDebug() << "[ERROR] Insert failed:" << query.lastError().text();
-        }
+    // Без локальной БД сразу просим страницу у сервера
+    if (!m_dbService->isReady()) {
+        requestOlderFromServer(chatPartner, beforeId);
+        return;
     }
 
-    // Фиксируем транзакцию
-    QSqlDatabase::database().commit();
+    // Сначала пробуем взять страницу из локальной БД: окно кэша было
+    // обрезано, но сами сообщения лежат на диске и сеть не нужна
+    const QString owner = m_currentUser.username;
+    m_dbService->query<QList<ChatMessage>>(
+        [owner, chatPartner, beforeId](DatabaseService &db) {
+            return db.loadOlderMessages(owner, chatPartner, beforeId, HistoryPageSize);
+        },
+        this,
+        [this, chatPartner, beforeId](const QList<ChatMessage> &older) {
+            // Локальная история исчерпана — догружаем страницу с сервера
+            if (older.isEmpty()) {
+                requestOlderFromServer(chatPartner, beforeId);
+                return;
+            }
+
+            // Расширяем окно кэша вверх; окно активного чата не обрезается
+            // и ужмется обратно при переключении на другой чат
+            ChatCache& cache = m_chatHistoryCache[chatPartner];
+            for (int i = older.count() - 1; i >= 0; --i) {
+                cache.messages.prepend(older.at(i));
+            }
+            cache.oldestMessageId = older.first().id;
+            touchChatCache(chatPartner);
+
+            // Если чат все еще открыт — отдаем страницу в UI тем же
+            // сигналом, что и при догрузке с сервера
+            if (chatPartner == m_currentChatPartner.username) {
+                m_oldestMessageId = cache.oldestMessageId;
+                emit olderHistoryChunkPrepended(chatPartner, older);
+            }
+        });
+}
+
+void DataService::requestOlderFromServer(const QString& chatPartner, qint64 beforeId)
+{
+    qDebug() << "[DataService] Requesting older history from server before id:" << beforeId;
 
-    qDebug() << "[DataService] insertMessagesWithUpsertFiltered: inserted"
-             << inserted << "filtered (was" << messages.size() << ")";
+    QJsonObject request;
+    request["type"] = "get_history";
+    request["with_user"] = chatPartner;
+    request["before_id"] = static_cast<double>(beforeId);
+    emit sendJson(request);
 }
@@ -3,12 +3,17 @@
 
 #include <QObject>
 #include <QMap>
+#include <QStringList>
+#include <QSet>
 #include <QJsonObject>
 #include "structures.h"
 #include "cryptoutils.h"
 #include <QTimer>
-#include <databaseservice.h>
+#include <databasefacade.h>
+#include "asyncapi.h"
 #include "avatarcache.h"
+#include "e2esession.h"
+#include "timerhub.h"
 
 /**
  * @brief Основной сервис управления состоянием приложения и данными.
@@ -28,6 +33,23 @@ public:
      */
     explicit DataService(QObject *parent = nullptr);
 
+    /**
+     * @brief Конструктор для мультиаккаунтного процесса.
+     *
+     * Каждый аккаунт получает собственный файл базы (и свой рабочий поток
+     * фасада), но тяжелые ресурсы процесса — кеш миниатюр аватаров с его
+     * потоком масштабирования — передаются общими (см. AccountManager).
+     *
+     * @param dbFile Имя файла базы данных этого аккаунта
+     * @param sharedAvatars Общий кеш аватаров процесса (nullptr — свой)
+     * @param parent Родительский объект.
+     */
+    DataService(const QString& dbFile, AvatarCache* sharedAvatars,
+                QObject *parent = nullptr);
+
+    /** @brief Деструктор: сбрасывает несохраненные черновики в БД. */
+    ~DataService() override;
+
     // --- Управление файлами ---
 
     /**
@@ -84,12 +106,22 @@ public:
     /** @brief Устанавливает крипто-менеджер для текущей сессии. */
     void updateOrAddCurrentUserCrypto(CryptoManager* cryptoManager);
 
+    /** @brief Менеджер сквозного шифрования диалогов (ключи, сессии). */
+    E2ESessionManager* getE2ESessions();
+
     /** @brief Получает данные пользователя, с которым открыт чат. */
     const User* getCurrentChatPartner();
 
     /** @brief Устанавливает текущего собеседника (при открытии чата). */
     void updateOrAddCurrentChatPartner(const User& user);
 
+    /**
+     * @brief Возвращает true, если сервер принял 0-RTT пакет возобновления.
+     * @details Вход уже обработан сервером из кадра рукопожатия, login_success
+     * придет тем же полетом — повторный token_login не нужен.
+     */
+    bool sessionResumed() const { return m_sessionResumed; }
+
     // --- Состояние UI чата ---
 
     /** @brief Возвращает true, если в данный момент загружается история сообщений. */
@@ -124,23 +156,48 @@ public:
     /** @brief Таймер отправки статуса "печатает...". */
     QTimer* getTypingSendTimer();
 
-    /** @brief Таймеры сброса статуса "печатает..." для входящих событий. */
-    const QMap<QString, QTimer*>* getTypingRecieveTimers();
-
     // --- Кеши ---
 
     /** @brief Ищет пользователя в локальном кеше по имени. */
     const User* getUserFromCache(const QString& username);
 
+    /**
+     * @brief Лениво дозапрашивает профиль контакта у сервера.
+     *
+     * Вход отдает список контактов облегченным (только имена) — детали
+     * профиля (имя для отображения, статус, аватар, последний визит)
+     * запрашиваются отсюда, когда строка без профиля попадает в видимую
+     * область списка. Имена копятся до конца оборота цикла событий и
+     * уходят одной пачкой get_profiles; повторное обращение по тому же
+     * имени стоит одну проверку по множеству.
+     */
+    void requestProfile(const QString& username);
+
+    /**
+     * @brief Принудительно перезапрашивает профиль контакта.
+     *
+     * Снимает сессионную дедупликацию requestProfile() и запрашивает
+     * профиль заново. Вызывается при открытии карточки профиля
+     * (ProfileViewWidget): свежий last_seen приходит только для профиля,
+     * который действительно смотрят, а не со всем списком контактов.
+     */
+    void refreshProfile(const QString& username);
+
     /** @brief Добавляет или обновляет пользователя в кеше. */
     void updateOrAddUser(const User& user);
 
+    /** @brief Перегрузка для rvalue: профиль переезжает в кеш без копий строк. */
+    void updateOrAddUser(User&& user);
+
     /** @brief Возвращает полный кеш чатов. */
     const QMap<QString, ChatCache>& getChatCache();
 
     /** @brief Обновляет кеш чата для конкретного пользователя. */
     void updateOrAddChatCache(const QString& username, const ChatCache& chatCache);
 
+    /** @brief Перегрузка для rvalue: список сообщений переезжает без копии. */
+    void updateOrAddChatCache(const QString& username, ChatCache&& chatCache);
+
     /** @brief Возвращает карту непрочитанных сообщений. */
     const QMap<QString, int>& getUnreadCounts();
 
@@ -153,8 +210,8 @@ public:
     /** @brief Возвращает указатель на кеш пользователей. */
     QMap<QString, User> * getUserCache();
 
-    /** @brief Возвращает доступ к сервису базы данных. */
-    DatabaseService* getDatabaseService();
+    /** @brief Возвращает доступ к асинхронному фасаду базы данных. */
+    DatabaseFacade* getDatabaseService();
 
     /** @brief Получает метаданные чата (настройки, статус). */
     const Chat& getChatMetadata(const QString& username) const;
@@ -162,6 +219,9 @@ public:
     /** @brief Обновляет метаданные чата. */
     void updateOrAddChatMetadata(const Chat& chat);
 
+    /** @brief Перегрузка для rvalue: запись переезжает в кеш без копий строк. */
+    void updateOrAddChatMetadata(Chat&& chat);
+
     /** @brief Обновляет последнее сообщение в списке чатов (для превью). */
     void updateLastMessage(const QString& username, const ChatMessage& message);
 
@@ -180,12 +240,59 @@ public:
     /** @brief Архивирует или разархивирует чат. */
     void setArchived(const QString& username, bool archived);
 
-    /** @brief Сохраняет черновик сообщения. */
+    /**
+     * @brief Устанавливает срок хранения сообщений чата (исчезающие сообщения).
+     *
+     * Политика пишется в метаданные чата и отправляется серверу
+     * (set_retention): тот чистит свою копию диалога и уведомляет
+     * собеседника событием retention_changed. Локальная история старше
+     * срока вырезается сразу.
+     *
+     * @param username Собеседник
+     * @param seconds Срок хранения в секундах (0 — хранить вечно)
+     */
+    void setRetention(const QString& username, qint64 seconds);
+
+    /** @brief Текущий срок хранения сообщений чата, с (0 — вечно). */
+    qint64 retentionSeconds(const QString& username) const;
+
+    /** @brief Сохраняет черновик сообщения (кэш + немедленный сброс в БД). */
     void saveDraft(const QString& username, const QString& draftText);
 
+    /**
+     * @brief Живое обновление черновика при наборе текста.
+     *
+     * Обновляет только кэш и взводит dirty-флаг: в БД накопленные
+     * черновики уходят одной пакетной задачей не чаще, чем раз в
+     * DraftFlushIntervalMs (см. flushDirtyDrafts). Смена чата и
+     * завершение работы сбрасывают немедленно.
+     *
+     * @param username Собеседник чата
+     * @param draftText Текущий текст ввода (пустой — черновик удаляется)
+     */
+    void updateDraft(const QString& username, const QString& draftText);
+
     /** @brief Получает текст черновика. */
     QString getDraft(const QString& username) const;
 
+    /**
+     * @brief Сохраняет позицию прокрутки чата (кэш + запись в БД).
+     *
+     * Вызывается при уходе из чата: нулевой messageId означает "чат был
+     * внизу" и убирает сохраненную позицию.
+     *
+     * @param username Собеседник чата
+     * @param anchor Якорное сообщение и пиксельный сдвиг
+     */
+    void saveScrollAnchor(const QString& username, const ChatScrollAnchor& anchor);
+
+    /**
+     * @brief Сохраненная позиция прокрутки чата.
+     * @param username Собеседник чата
+     * @return Якорь; messageId == 0 — позиции нет, открываем как обычно
+     */
+    ChatScrollAnchor scrollAnchor(const QString& username) const;
+
     /** @brief Инициализирует черновики из БД при запуске. */
     void loadDraftsFromDatabase();
 
@@ -205,12 +312,48 @@ public slots:
     void handleRegisterSuccess(const QJsonObject& response);
     void handleRegisterFailure(const QJsonObject& response);
     void handleContactList(const QJsonObject& response);
+
+    /** @brief Пачка профилей в ответ на get_profiles (см. requestProfile). */
+    void handleProfiles(const QJsonObject& response);
+
+    /** @brief Отправляет накопленные имена одной пачкой get_profiles. */
+    void flushProfileRequests();
     void handleHistoryData(const QJsonObject& response);
     void handleOldHistoryData(const QJsonObject& response);
     void handlePrivateMessage(const QJsonObject& response);
     void handleUserList(const QJsonObject& response);
+    void handlePresence(const QJsonObject& response);
+
+    /** @brief Компактная дельта профиля контакта (только изменившиеся поля). */
+    void handleProfileDelta(const QJsonObject& response);
+
+    /** @brief Смена срока хранения диалога (своя или собеседника). */
+    void handleRetentionChanged(const QJsonObject& response);
     void handleMessageDelivered(const QJsonObject& response);
     void handleMessageRead(const QJsonObject& response);
+
+    /** @brief Извлекает ID из уведомления о статусах (массив `ids` или одиночный `id`). */
+    static QList<qint64> extractStatusIds(const QJsonObject& response);
+
+    /**
+     * @brief Пакетно применяет один статус к набору сообщений.
+     *
+     * Один проход по кэшу истории вместо поиска на каждый ID; по ID,
+     * попавшим в текущий открытый чат, испускается один батч-сигнал
+     * messageStatusesChanged, запись в БД уходит одной задачей.
+     */
+    void applyMessageStatuses(const QList<qint64>& messageIds,
+                              ChatMessage::MessageStatus newStatus);
+
+    /**
+     * @brief Диапазонная форма уведомления о статусах: {from, up_to_id}.
+     *
+     * Применяет статус ко всем нашим исходящим сообщениям собеседнику
+     * с id не больше границы: проход по кэшу одного диалога и один
+     * range-UPDATE в БД вместо обновления по каждому ID.
+     */
+    void applyMessageStatusesUpTo(const QString& chatPartner, qint64 upToId,
+                                  ChatMessage::MessageStatus newStatus);
     void handleEditMessage(const QJsonObject& response);
     void handleDeleteMessage(const QJsonObject& response);
     void handleSearchResults(const QJsonObject& response);
@@ -218,6 +361,25 @@ public slots:
     void handleAddContactFailure(const QJsonObject& response);
     void handleIncomingContactRequest(const QJsonObject& response);
     void handlePendingRequestsList(const QJsonObject& response);
+    void handleContactAccepted(const QJsonObject& response);
+
+public:
+    /**
+     * @brief Текущий список входящих заявок в друзья (зеркало сервера).
+     *
+     * Сервер присылает список один раз при логине и дальше досылает заявки
+     * поштучно; кэш позволяет заново наполнить IncomingRequestsWidget,
+     * если тот был выгружен за неиспользование и пересоздан.
+     */
+    QJsonArray pendingContactRequests() const { return m_pendingRequests; }
+
+    /**
+     * @brief Убирает отвеченную заявку из кэша.
+     * @param fromUsername Автор принятой или отклоненной заявки
+     */
+    void removePendingContactRequest(const QString& fromUsername);
+
+private:
     void handleLogoutSuccess(const QJsonObject& response);
     void handleLogoutFailure(const QJsonObject& response);
     void handleTypingResponse(const QJsonObject& response);
@@ -235,16 +397,98 @@ public slots:
     void handleUpdateProfileResult(const QJsonObject& response);
     void handleTokenLoginFailure(const QJsonObject& response);
     void handleHandshake(const QJsonObject& request);
+    void handlePing(const QJsonObject& request);
 
-    /** @brief Запрашивает историю звонков с сервера. */
+    /** @brief Запрашивает сводку и первую страницу истории звонков. */
     void requestCallHistory();
 
+    /**
+     * @brief Догружает следующую страницу истории звонков.
+     *
+     * Курсор и признак конца берутся из последнего ответа call_history;
+     * после последней страницы — no-op.
+     */
+    void requestMoreCallHistory();
+
+    /**
+     * @brief Корутинный сценарий загрузки истории звонков.
+     *
+     * Линейная запись запрос-ответного потока через co_await. Для первой
+     * страницы (пустой курсор) сводка get_call_stats и страница
+     * get_call_history стартуют параллельно (жадные Task): строка rollup'а
+     * показывается сразу, не дожидаясь страницы. Первый потребитель
+     * AsyncApi — образец для перевода остальных цепочек обработчиков.
+     * @param before Курсор keyset-пагинации, start_time (пусто — первая страница).
+     * @param beforeId Вторая компонента курсора — call_id граничной строки:
+     *        start_time секундной точности, одиночный курсор терял бы
+     *        звонки, разделившие секунду с границей страницы.
+     */
+    Async::Task<void> fetchCallHistoryFlow(const QString& before,
+                                           const QString& beforeId);
+
+    /** @brief Один awaitable-запрос как жадный Task (для параллельных пар). */
+    Async::Task<QJsonObject> fetchResponse(QJsonObject request,
+                                           const QString& responseType);
+
     /** @brief Запускает синхронизацию истории сообщений для чата. */
     void syncChatHistory(const QString& chatPartner);
 
+    /**
+     * @brief Полнотекстовый поиск по локальной истории сообщений.
+     *
+     * Запрос выполняется в потоке БД по FTS-индексу; результаты,
+     * отсортированные по релевантности, приходят сигналом
+     * localSearchResults. Ищет по всем чатам, включая сообщения
+     * за пределами окна кэша.
+     *
+     * @param queryText Текст поискового запроса
+     */
+    void searchLocalMessages(const QString& queryText);
+
+    /**
+     * @brief Подгружает страницу старых сообщений для текущего чата.
+     *
+     * Сначала пытается взять страницу из локальной БД (окно кэша
+     * расширяется вверх прозрачно для UI); если локальная история
+     * исчерпана — запрашивает страницу у сервера.
+     */
+    void loadOlderHistoryChunk();
+
+    /**
+     * @brief Поднимает из локальной БД сообщение — цель реплая вне окна.
+     *
+     * Модель чата излучает replyTargetMissing, когда цитируемое
+     * сообщение вытеснено из ее окна; найденное сообщение возвращается
+     * сигналом replyMessageResolved.
+     * @param messageId Серверный ID цитируемого сообщения
+     */
+    void resolveReplyMessage(qint64 messageId);
+
     /** @brief Очищает все данные при выходе. */
     void clearAllData();
 
+    /**
+     * @brief Быстрое упорядоченное завершение: дожим грязного состояния.
+     *
+     * Одним пакетом сбрасывает все накопленное коалесцирующими таймерами
+     * (черновики, счетчики непрочитанных) в очередь фасада БД и
+     * останавливает его поток с жестким дедлайном (см.
+     * DatabaseFacade::shutdown). После вызова сервис записей не принимает.
+     */
+    void shutdown();
+
+    /**
+     * @brief Ужимает кеши аккаунта, ушедшего в фон.
+     *
+     * Вызывается менеджером аккаунтов при переключении на другой аккаунт:
+     * горячие кеши истории чатов и метаданных файлов сбрасываются (при
+     * возврате страница истории поднимется из БД, как при холодном входе
+     * в чат), а контакты, метаданные чатов и счетчики непрочитанных
+     * остаются — фоновый аккаунт продолжает принимать входящие события
+     * и держать бейджи без обращений к базе.
+     */
+    void compactForBackground();
+
     /** @brief Первоначальная загрузка данных при старте. */
     void initLoad();
 
@@ -255,6 +499,7 @@ signals:
     void currentChatPartnerChanged(const QString& username);
     void currentUserChanged(const QString& username);
     void userCacheChanged(const QString& username);
+    void profileReceived(const QString& username);
     void historyLoadingChanged(bool isLoadingHistory);
     void oldestMessageIdChanged(qint64 oldestMessageId);
     void editingMessageIdChanged(qint64 editingMessageId);
@@ -271,6 +516,7 @@ signals:
 
     // Сигналы для UI
     void olderHistoryChunkPrepended(const QString& chatPartner, const QList<ChatMessage>& messages);
+    void replyMessageResolved(const ChatMessage& message);
     void historyLoaded(const QString& chatPartner, const QList<ChatMessage>& messages);
     void loginSuccess(const QJsonObject& response);
     void loginFailure(const QString& reason);
@@ -279,10 +525,32 @@ signals:
     void registerFailure(const QString& reason);
     void newMessageReceived(const ChatMessage& message);
     void messageStatusChanged(qint64 messageId, ChatMessage::MessageStatus newStatus);
+
+    /**
+     * @brief Пакетная смена статуса сообщений текущего чата.
+     *
+     * Квитанция сервера покрывает до сотен сообщений разом; модель
+     * применяет их одним проходом (см. ChatMessageModel::updateMessageStatuses).
+     */
+    void messageStatusesChanged(const QList<qint64>& messageIds,
+                                ChatMessage::MessageStatus newStatus);
     void unreadCountChanged();
     void messageEdited(const QString& chatPartner, qint64 messageId, const QString& newPayload);
     void messageDeleted(const QString& chatPartner, qint64 messageId);
-    void searchResultsReceived(const QJsonArray& users);
+    /**
+     * @brief Чанк результатов глобального поиска пользователей.
+     *
+     * Сервер отдает выборку потоково: первый чанк (верх ранжирования)
+     * приходит, не дожидаясь хвоста, остальные доезжают следом с тем же
+     * поколением запроса. UI сверяет поколение со своим счетчиком и
+     * отбрасывает чанки устаревших запросов.
+     *
+     * @param users Пользователи этого чанка
+     * @param generation Эхо поколения запроса (0 — сервер без потоковой выдачи)
+     * @param firstChunk Первый чанк: список заменяется, а не дополняется
+     */
+    void searchResultsReceived(const QJsonArray& users, qint64 generation,
+                               bool firstChunk);
     void addContactSuccess(const QString& username);
     void addContactFailure(const QString& reason);
     void contactRequestReceived(const QJsonObject& request);
@@ -298,36 +566,185 @@ signals:
     void callAccepted(const QString& fromUser, const QString& calleeIp, quint16 calleePort);
     void callRejected(const QString& fromUser, const QString& reason);
     void callEnded();
-    void callHistoryReceived(const QJsonArray& calls);
+    /**
+     * @brief Страница истории звонков получена.
+     * @param calls Звонки страницы (новые — первыми)
+     * @param hasMore За последней строкой есть еще звонки
+     */
+    void callHistoryReceived(const QJsonArray& calls, bool hasMore);
     void callStatsReceived(const QJsonObject& stats);
 
+    /** @brief Результаты локального полнотекстового поиска по сообщениям. */
+    void localSearchResults(const QString& queryText, const QList<MessageSearchHit>& hits);
+
     void profileUpdateResult(const QJsonObject& response);
     void requestServerHistory(const QString& chatPartner, int afterId);
     void updateMessageStatus(qint64 messageId, ChatMessage::MessageStatus newStatus, bool isRead);
 
 
 private:
-    /** @brief Загружает сохраненные метаданные чатов из БД. */
-    void loadChatMetadataFromDatabase();
-
     /** @brief Инициализирует таблицу обработчиков ответов. */
     void initResponseHandlers();
 
-    /** @brief Получает последний ID сообщения, известного серверу (для синхронизации). */
-    int getLastServerIdForChat(int chatId);
+    /**
+     * @brief Возвращает запись метаданных чата для правки по месту.
+     * @details try_emplace-стиль: отсутствующая запись создается с
+     * заполненным username и displayName из кэша пользователей. Правка
+     * по месту заменяет прежний паттерн "копия -> правка -> копия
+     * обратно", стоивший две глубокие копии Chat на каждое сообщение.
+     */
+    Chat& chatMetadataEntry(const QString& username);
+
+    /** @brief Синхронизирует уже измененную запись чата с БД и уведомляет UI. */
+    void syncChatMetadata(const Chat& chat);
+
+    /** @brief Отмечает чат как недавно использованный и следит за бюджетом кэша. */
+    void touchChatCache(const QString& username);
+
+    /** @brief Обрезает окно кэша фонового чата до ChatCacheWindow сообщений. */
+    void trimChatCacheWindow(const QString& username);
+
+    /**
+     * @brief Прогревает кэши самых горячих чатов из локальной БД.
+     *
+     * Top-K чатов по статистике открытий (chat_open_stats) получают
+     * полное окно истории в m_chatHistoryCache еще до первого клика,
+     * и для каждого в фоне запускается дельта-синхронизация с сервером.
+     * Открытие прогретого чата отдает контент из памяти мгновенно
+     * (см. syncChatHistory).
+     */
+    void prefetchHotChats();
+
+    /** @brief Пакетно сбрасывает накопленные dirty-черновики в БД. */
+    void flushDirtyDrafts();
+
+    /**
+     * @brief Отмечает изменение счетчика непрочитанных чата.
+     *
+     * O(1): взводит отложенную запись в БД и коалесцированный сигнал
+     * бейджей — сами события сообщений базу и UI не дергают.
+     */
+    void noteUnreadChanged(const QString& username);
+
+    /** @brief Один кадр: отдает UI все накопленные изменения бейджей. */
+    void emitCoalescedBadges();
+
+    /** @brief Пакетно сбрасывает накопленные счетчики непрочитанных в БД. */
+    void flushUnreadCounts();
+
+    /**
+     * @brief Открывает окно коалесценции логин-залпа.
+     *
+     * После login_success сервер шлет залп: список контактов, счетчики,
+     * онлайн-статусы, заявки, офлайн-сообщения. Каждый обработчик раньше
+     * дергал свои широкие сигналы независимо, и список контактов
+     * пересортировывался и перерисовывался десятки раз за секунду.
+     * Пока окно открыто, notify*-обертки копят изменения в dirty-флагах,
+     * а UI получает консолидированные сигналы раз в BurstFlushIntervalMs
+     * и финально при закрытии окна.
+     */
+    void beginLoginBurst();
+
+    /** @brief Закрывает окно залпа: финальный сброс и прямые сигналы дальше. */
+    void endLoginBurst();
+
+    /** @brief Отдает UI все накопленные за такт залпа изменения. */
+    void flushBurstUpdates();
+
+    /** @brief contactsUpdated с коалесценцией на время логин-залпа. */
+    void notifyContactsUpdated(const QStringList& sortedUsernames);
+
+    /** @brief onlineStatusUpdated с коалесценцией на время логин-залпа. */
+    void notifyOnlineStatusUpdated();
+
+    /** @brief unreadCountChanged с коалесценцией на время логин-залпа. */
+    void notifyUnreadCountChanged();
 
-    /** @brief Получает набор всех существующих ID сообщений (для дедупликации). */
-    QSet<qint64> fetchExistingServerIds(const QString& chatPartner);
+    /** @brief chatMetadataChanged с коалесценцией на время логин-залпа. */
+    void notifyChatMetadataChanged(const QString& username);
 
-    /** @brief Вставляет новые сообщения с проверкой на дубликаты. */
-    void insertMessagesWithUpsertFiltered(const QList<ChatMessage>& messages, const QString& chatPartner);
+    /**
+     * @brief Пакетно гасит просроченные статусы "печатает...".
+     *
+     * Обслуживает единый таймер m_typingExpiryTimer: снимает флаг
+     * User::isTyping у всех, чей дедлайн истек, и перевзводит таймер
+     * на ближайший из оставшихся дедлайнов.
+     */
+    void expireTypingStatuses();
+
+    /** @brief Вытесняет наименее используемые чаты при превышении общего бюджета. */
+    void enforceChatCacheBudget();
+
+    /** @brief Запрашивает у сервера страницу истории до указанного ID. */
+    void requestOlderFromServer(const QString& chatPartner, qint64 beforeId);
+
+    // Окно кэша одного чата: сообщения сверх лимита вытесняются из памяти,
+    // при прокрутке вверх страница прозрачно перечитывается из локальной БД
+    static constexpr int ChatCacheWindow = 200;
+
+    // Общий бюджет кэша историй (сообщений суммарно по всем чатам):
+    // при превышении целиком вытесняются давно не открывавшиеся чаты
+    static constexpr int ChatCacheBudget = 2000;
+
+    /// Сколько горячих чатов прогревает префетчер на старте
+
+    /// Пауза коалесценции черновиков: не чаще одной записи в 3 секунды
+    static constexpr int DraftFlushIntervalMs = 3000;
 
+    /// Пауза ленивой записи счетчиков непрочитанных в БД
+    static constexpr int UnreadFlushIntervalMs = 3000;
 
-    DatabaseService* m_dbService = nullptr;             ///< Ссылка на сервис БД
+    /// Длительность окна коалесценции после login_success
+    static constexpr int LoginBurstWindowMs = 1500;
+
+    /// Период консолидированных обновлений UI внутри окна залпа
+    static constexpr int BurstFlushIntervalMs = 100;
+
+    /// Сколько статус "печатает..." живет без новых событий typing
+    static constexpr int TypingExpiryMs = 2500;
+
+    /// Потолок имен в одной пачке get_profiles (зеркало лимита сервера)
+    static constexpr int ProfileBatchLimit = 64;
+    static constexpr int PrefetchTopChats = 5;
+
+    // Размер страницы догрузки старых сообщений при прокрутке вверх
+    static constexpr int HistoryPageSize = 20;
+
+    // Размер страницы истории звонков (зеркало потолка сервера)
+    static constexpr int CallHistoryPageSize = 50;
+
+    DatabaseFacade* m_dbService = nullptr;              ///< Асинхронный фасад БД
+    AsyncApi* m_asyncApi = nullptr;                     ///< Awaitable-фасад запросов к серверу
     using ResponseHandler = void (DataService::*)(const QJsonObject&);
     QMap<QString, ResponseHandler> m_responseHandlers;  ///< Таблица маршрутизации ответов
 
     QMap<QString, ChatCache> m_chatHistoryCache;        ///< Кеш истории чатов
+    QJsonArray m_pendingRequests;                       ///< Входящие заявки в друзья (см. pendingContactRequests)
+    QHash<QString, ChatScrollAnchor> m_scrollAnchors;   ///< Позиции прокрутки чатов (зеркало scroll_anchors)
+    QHash<QString, QString> m_dirtyDrafts;              ///< Черновики, ждущие записи в БД
+    CoalescedTimer* m_draftFlushTimer = nullptr;                ///< Коалесценция записей черновиков
+    QSet<QString> m_dirtyUnread;                        ///< Счетчики, ждущие записи в БД
+    CoalescedTimer* m_unreadFlushTimer = nullptr;               ///< Ленивое сохранение счетчиков
+    QSet<QString> m_pendingBadgeChats;                  ///< Бейджи, ждущие сигнала в UI
+    QTimer* m_badgeCoalesceTimer = nullptr;             ///< Один сигнал бейджей на кадр
+
+    QSet<QString> m_pendingProfileUsers;                ///< Имена, ждущие пачки get_profiles
+    QSet<QString> m_requestedProfileUsers;              ///< Уже запрошенные профили сессии
+    QTimer* m_profileBatchTimer = nullptr;              ///< Одна пачка на оборот цикла событий
+
+    QString m_callHistoryCursor;                        ///< Курсор последней страницы звонков (start_time)
+    QString m_callHistoryCursorId;                      ///< Вторая компонента курсора (call_id)
+    bool m_callHistoryHasMore = false;                  ///< За курсором есть еще звонки
+
+    bool m_loginBurstActive = false;                    ///< Окно логин-залпа открыто
+    QTimer* m_burstFlushTimer = nullptr;                ///< Такт консолидированных сигналов
+    QTimer* m_burstEndTimer = nullptr;                  ///< Закрытие окна залпа
+    QStringList m_burstContacts;                        ///< Последний список контактов залпа
+    bool m_burstContactsDirty = false;                  ///< contactsUpdated накоплен
+    bool m_burstOnlineDirty = false;                    ///< onlineStatusUpdated накоплен
+    bool m_burstUnreadDirty = false;                    ///< unreadCountChanged накоплен
+    QSet<QString> m_burstMetadataChats;                 ///< Чаты с измененными метаданными
+    QStringList m_chatCacheLru;                         ///< Порядок использования чатов (конец — самый свежий)
     QMap<QString, Chat> m_chatMetadataCache;            ///< Кеш настроек чатов
     QMap<QString, User> m_userCache;                    ///< Кеш пользователей
     QMap<QString, int> m_unreadCounts;                  ///< Кеш счетчиков непрочитанных
@@ -335,6 +752,9 @@ private:
     User m_currentUser;                                 ///< Текущий авторизованный пользователь
     User m_currentChatPartner;                          ///< Текущий открытый чат
     bool m_isLoadingHistory = false;                    ///< Флаг процесса загрузки
+    bool m_inProcessResponse = false;                   ///< Страж повторного входа processResponse
+    bool m_handshakeDone = false;                       ///< Флаг: рукопожатие уже обработано
+    bool m_sessionResumed = false;                      ///< Сервер принял 0-RTT пакет возобновления
 
     qint64 m_oldestMessageId = 0;                       ///< ID для пагинации вверх
     qint64 m_editingMessageId = 0;                      ///< ID редактируемого сообщения
@@ -342,12 +762,18 @@ private:
 
     QTimer* m_globalSearchTimer;                        ///< Таймер поиска
     QTimer* m_typingSendTimer;                          ///< Таймер отправки статуса печати
-    QMap<QString, QTimer*> m_typingReceiveTimers;       ///< Таймеры сброса статуса печати собеседников
+
+    // Единый планировщик сброса входящих статусов "печатает...": вместо
+    // QTimer на каждого собеседника — карта дедлайнов и один грубый
+    // таймер, взведенный на ближайший из них (см. expireTypingStatuses)
+    QHash<QString, qint64> m_typingDeadlines;           ///< Кто печатает -> дедлайн, мс epoch
+    CoalescedTimer* m_typingExpiryTimer = nullptr;              ///< Один таймер на все дедлайны
 
     QVector<QString> m_uploadingFilePath;               ///< Очередь загрузки файлов
     bool m_isChatSearchActive = false;                  ///< Флаг активности поиска внутри чата
 
     CryptoManager* m_crypto;                            ///< Менеджер E2E шифрования
+    E2ESessionManager* m_e2e = nullptr;                 ///< Сквозное шифрование диалогов
     QMap<QString, CachedFile> m_uploadedFilesCache;     ///< Временный кеш метаданных файлов
     AvatarCache* m_avatarCache;                         ///< Сервис кеширования аватаров
 };
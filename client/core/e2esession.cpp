@@ -0,0 +1,224 @@
+#include "e2esession.h"
+#include "monocypher.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QRandomGenerator>
+#include <QDebug>
+
+E2ESessionManager::E2ESessionManager(QObject* parent)
+    : QObject(parent)
+{
+}
+
+
+QString E2ESessionManager::storagePath()
+{
+    // Тот же каталог, что у session.ini токенов (TokenManager)
+    return QCoreApplication::applicationDirPath() + "/e2e.ini";
+}
+
+
+void E2ESessionManager::activate(const QString& username)
+{
+    if (username.isEmpty() || username == m_username) {
+        return;
+    }
+
+    m_username = username;
+    m_sessionKeys.clear();
+    m_encryptedChats.clear();
+
+    QSettings settings(storagePath(), QSettings::IniFormat);
+
+    // Идентификационная пара аккаунта: создается один раз и переживает
+    // перезапуски — без этого кэшированные ключи диалогов бесполезны
+    m_secretKey = QByteArray::fromBase64(
+        settings.value("identity/" + username).toString().toLatin1());
+    if (m_secretKey.size() != 32) {
+        m_secretKey.resize(32);
+        QRandomGenerator::system()->fillRange(
+            reinterpret_cast<quint32*>(m_secretKey.data()), 32 / 4);
+        settings.setValue("identity/" + username,
+                          QString::fromLatin1(m_secretKey.toBase64()));
+    }
+
+    m_publicKey.resize(32);
+    crypto_x25519_public_key(
+        reinterpret_cast<uint8_t*>(m_publicKey.data()),
+        reinterpret_cast<const uint8_t*>(m_secretKey.constData()));
+
+    // Кэш ключей диалогов: X25519 уже посчитан в прошлых сессиях
+    settings.beginGroup("sessions-" + username);
+    const QStringList peers = settings.childKeys();
+    for (const QString& peer : peers) {
+        const QByteArray key =
+            QByteArray::fromBase64(settings.value(peer).toString().toLatin1());
+        if (key.size() == 32) {
+            m_sessionKeys.insert(peer, key);
+        }
+    }
+    settings.endGroup();
+
+    settings.beginGroup("encrypted-" + username);
+    const QStringList encrypted = settings.childKeys();
+    for (const QString& peer : encrypted) {
+        if (settings.value(peer).toBool()) {
+            m_encryptedChats.insert(peer);
+        }
+    }
+    settings.endGroup();
+
+    qInfo() << "[E2E] Activated for" << username << ":"
+            << m_sessionKeys.size() << "cached sessions,"
+            << m_encryptedChats.size() << "encrypted chats";
+}
+
+
+QString E2ESessionManager::localPublicKeyBase64() const
+{
+    return QString::fromLatin1(m_publicKey.toBase64());
+}
+
+
+void E2ESessionManager::adoptPeerKey(const QString& peer,
+                                     const QString& publicKeyBase64)
+{
+    if (m_username.isEmpty() || peer.isEmpty()) {
+        return;
+    }
+
+    const QByteArray peerKey =
+        QByteArray::fromBase64(publicKeyBase64.toLatin1());
+    if (peerKey.size() != 32) {
+        qWarning() << "[E2E] Malformed peer key from" << peer << "- ignored";
+        return;
+    }
+
+    // Единственный дорогой шаг — и тот сотни микросекунд: дальше диалог
+    // живет на кэшированном симметричном ключе
+    QByteArray shared(32, Qt::Uninitialized);
+    crypto_x25519(reinterpret_cast<uint8_t*>(shared.data()),
+                  reinterpret_cast<const uint8_t*>(m_secretKey.constData()),
+                  reinterpret_cast<const uint8_t*>(peerKey.constData()));
+
+    m_sessionKeys.insert(peer, shared);
+
+    QSettings settings(storagePath(), QSettings::IniFormat);
+    settings.setValue("sessions-" + m_username + "/" + peer,
+                      QString::fromLatin1(shared.toBase64()));
+
+    qInfo() << "[E2E] Session established with" << peer;
+    emit sessionEstablished(peer);
+}
+
+
+bool E2ESessionManager::hasSession(const QString& peer) const
+{
+    return m_sessionKeys.contains(peer);
+}
+
+
+bool E2ESessionManager::isChatEncrypted(const QString& peer) const
+{
+    return m_encryptedChats.contains(peer) && m_sessionKeys.contains(peer);
+}
+
+
+void E2ESessionManager::setChatEncrypted(const QString& peer, bool encrypted)
+{
+    if (m_username.isEmpty()) {
+        return;
+    }
+
+    if (encrypted) {
+        m_encryptedChats.insert(peer);
+    } else {
+        m_encryptedChats.remove(peer);
+    }
+
+    QSettings settings(storagePath(), QSettings::IniFormat);
+    settings.setValue("encrypted-" + m_username + "/" + peer, encrypted);
+
+    qInfo() << "[E2E] Chat with" << peer
+            << (encrypted ? "encrypted" : "no longer encrypted");
+}
+
+
+QString E2ESessionManager::sealIfEnabled(const QString& peer,
+                                         const QString& plaintext)
+{
+    if (!isChatEncrypted(peer)) {
+        return plaintext;
+    }
+
+    const QByteArray key = m_sessionKeys.value(peer);
+    const QByteArray bytes = plaintext.toUtf8();
+
+    // nonce(24) + MAC(16) + шифртекст — как в sealResumeTicket, но ключом
+    // диалога; случайный nonce у XChaCha достаточно широк для безопасности
+    QByteArray sealed(24 + 16 + bytes.size(), Qt::Uninitialized);
+    uint8_t* nonce = reinterpret_cast<uint8_t*>(sealed.data());
+    QRandomGenerator::system()->fillRange(
+        reinterpret_cast<quint32*>(nonce), 24 / 4);
+
+    crypto_aead_lock(
+        reinterpret_cast<uint8_t*>(sealed.data()) + 24 + 16, // Шифртекст
+        reinterpret_cast<uint8_t*>(sealed.data()) + 24,      // MAC
+        reinterpret_cast<const uint8_t*>(key.constData()),
+        nonce,
+        nullptr, 0,
+        reinterpret_cast<const uint8_t*>(bytes.constData()),
+        bytes.size());
+
+    return QLatin1String(SealedPrefix)
+        + QString::fromLatin1(sealed.toBase64());
+}
+
+
+QString E2ESessionManager::openIfSealed(const QString& peer,
+                                        const QString& payload)
+{
+    if (!isSealed(payload)) {
+        return payload;
+    }
+
+    const QByteArray key = m_sessionKeys.value(peer);
+    if (key.size() != 32) {
+        // Сессии нет (новая установка клиента): сообщение остается в ленте
+        // заглушкой, расшифруется после живого обмена ключами
+        return QStringLiteral("🔒 Зашифрованное сообщение (нет ключа диалога)");
+    }
+
+    const QByteArray sealed = QByteArray::fromBase64(
+        payload.mid(int(qstrlen(SealedPrefix))).toLatin1());
+    if (sealed.size() < 24 + 16) {
+        return QStringLiteral("🔒 Поврежденное зашифрованное сообщение");
+    }
+
+    const int textLen = sealed.size() - 24 - 16;
+    QByteArray plain(textLen, Qt::Uninitialized);
+
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(sealed.constData());
+    const int status = crypto_aead_unlock(
+        reinterpret_cast<uint8_t*>(plain.data()),
+        base + 24,                       // MAC
+        reinterpret_cast<const uint8_t*>(key.constData()),
+        base,                            // nonce
+        nullptr, 0,
+        base + 24 + 16,                  // шифртекст
+        textLen);
+
+    if (status != 0) {
+        qWarning() << "[E2E] Failed to open sealed payload from" << peer;
+        return QStringLiteral("🔒 Поврежденное зашифрованное сообщение");
+    }
+
+    return QString::fromUtf8(plain);
+}
+
+
+bool E2ESessionManager::isSealed(const QString& payload)
+{
+    return payload.startsWith(QLatin1String(SealedPrefix));
+}
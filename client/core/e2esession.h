@@ -0,0 +1,133 @@
+#ifndef E2ESESSION_H
+#define E2ESESSION_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+
+/**
+ * @brief Сквозное шифрование переписки по диалогам (опционально).
+ *
+ * @details Транспортный слой (CryptoManager) шифрует только участок
+ * клиент↔сервер: сервер видит открытый текст. Для чувствительных чатов
+ * этот менеджер добавляет второй, сквозной слой: полезная нагрузка
+ * сообщения шифруется ключом диалога еще на машине отправителя и
+ * расшифровывается только у получателя — сервер хранит и пересылает
+ * непрозрачную строку.
+ *
+ * Устройство подчинено производительности — E2E не должен добавлять
+ * измеримой задержки против обычного чата:
+ *
+ * - Обмен ключами X25519 подвезен к принятию контакта: публичный ключ
+ *   едет полем `e2e_key` в `add_contact_request` и в ответе на него,
+ *   отдельных круговых обменов нет. Сервер ретранслирует поле, не
+ *   заглядывая в него.
+ * - Ключ диалога считается один раз (X25519 — сотни микросекунд) и
+ *   кэшируется: в памяти на время сессии и в e2e.ini между запусками —
+ *   история расшифровывается после рестарта без повторного обмена.
+ * - На само сообщение остается один AEAD-проход XChaCha20-Poly1305
+ *   (единицы микросекунд на типичный текст, SIMD-циклы ChaCha внутри
+ *   Monocypher) — та же шифра, что и на транспорте.
+ * - Двойной работы на сервере нет: его быстрый путь маршрутизации
+ *   обращается с payload как с непрозрачной строкой и не разбирает,
+ *   не индексирует и не пережимает шифртекст.
+ *
+ * Формат запечатанной нагрузки — строка с узнаваемым префиксом, поэтому
+ * она проходит весь конвейер (сервер, история, локальная БД) как обычный
+ * текст: `e2e1:base64(nonce 24 + MAC 16 + шифртекст)`.
+ *
+ * Локальная БД хранит открытый текст (она и так на машине пользователя);
+ * запечатывается только то, что уходит на провод и на сервер.
+ *
+ * Ограничение: обмен ключами происходит вживую — если вторая сторона
+ * офлайн в момент принятия контакта, сессия установится при следующем
+ * живом обмене ключами (сервер ключи не хранит).
+ */
+class E2ESessionManager : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Префикс запечатанной полезной нагрузки. */
+    static constexpr const char* SealedPrefix = "e2e1:";
+
+    explicit E2ESessionManager(QObject* parent = nullptr);
+
+    /**
+     * @brief Включает менеджер для вошедшего аккаунта.
+     *
+     * Загружает (или создает и сохраняет) идентификационную пару X25519
+     * аккаунта и кэшированные ключи диалогов из e2e.ini — файл лежит
+     * рядом с session.ini (см. TokenManager::getConfigPath).
+     * @param username Логин текущего пользователя
+     */
+    void activate(const QString& username);
+
+    /** @brief Публичный ключ аккаунта для поля e2e_key (base64). */
+    QString localPublicKeyBase64() const;
+
+    /**
+     * @brief Принимает публичный ключ собеседника и выводит ключ диалога.
+     *
+     * X25519 выполняется один раз, результат кэшируется в памяти и в
+     * e2e.ini. Повторный ключ того же собеседника просто перезаписывает
+     * сессию (новая пара после переустановки клиента).
+     * @param peer Логин собеседника
+     * @param publicKeyBase64 Его публичный ключ (base64, 32 байта)
+     */
+    void adoptPeerKey(const QString& peer, const QString& publicKeyBase64);
+
+    /** @brief Установлена ли сессия с собеседником. */
+    bool hasSession(const QString& peer) const;
+
+    /** @brief Включено ли сквозное шифрование для чата (и есть ли сессия). */
+    bool isChatEncrypted(const QString& peer) const;
+
+    /**
+     * @brief Включает/выключает сквозное шифрование чата.
+     *
+     * Опция на чат, а не глобально: E2E-история не участвует в серверном
+     * поиске и недоступна с других устройств, поэтому выбор за
+     * пользователем. Сохраняется в e2e.ini.
+     */
+    void setChatEncrypted(const QString& peer, bool encrypted);
+
+    /**
+     * @brief Запечатывает нагрузку, если чат зашифрован; иначе — как есть.
+     * @return Строка для поля payload исходящего запроса
+     */
+    QString sealIfEnabled(const QString& peer, const QString& plaintext);
+
+    /**
+     * @brief Распечатывает нагрузку, если она запечатана; иначе — как есть.
+     *
+     * Работает и для эха собственных сообщений: ключ диалога симметричен.
+     * @return Открытый текст; при отсутствии сессии или порче шифртекста —
+     *         текст-заглушка (сообщение не теряется из ленты)
+     */
+    QString openIfSealed(const QString& peer, const QString& payload);
+
+    /** @brief true, если строка — запечатанная E2E-нагрузка. */
+    static bool isSealed(const QString& payload);
+
+signals:
+    /** @brief Сессия с собеседником установлена (ключи обменяны). */
+    void sessionEstablished(const QString& peer);
+
+private:
+    /** @brief Путь к e2e.ini (рядом с session.ini). */
+    static QString storagePath();
+
+    QString m_username;            ///< Аккаунт, для которого активирован менеджер
+    QByteArray m_secretKey;        ///< Приватный ключ X25519 аккаунта (32 байта)
+    QByteArray m_publicKey;        ///< Публичный ключ аккаунта (32 байта)
+
+    /** @brief Кэш ключей диалогов: собеседник -> 32-байтовый ключ AEAD. */
+    QHash<QString, QByteArray> m_sessionKeys;
+
+    /** @brief Чаты с включенным сквозным шифрованием. */
+    QSet<QString> m_encryptedChats;
+};
+
+#endif // E2ESESSION_H
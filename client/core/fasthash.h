@@ -0,0 +1,68 @@
+#ifndef FASTHASH_H
+#define FASTHASH_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/**
+ * @namespace FastHash
+ * @brief Быстрые некриптографические хеши файлового конвейера.
+ *
+ * @details Файловый канал требует контроля целостности на каждый чанк, а
+ * формат архива — контрольной суммы на каждую запись; считать их
+ * SHA-256 (как контент-адрес блобов) значило бы жечь ядро на каждом
+ * переносе. Здесь два дополняющих друг друга примитива:
+ *
+ *  - crc32c() — CRC-32C (полином Кастаньоли). На x86 диспетчеризуется в
+ *    аппаратную инструкцию SSE4.2 (проверка один раз при старте),
+ *    иначе — табличный slice-by-8; оба дают одинаковые значения.
+ *    Используется чанками файловых передач и записями архива истории.
+ *
+ *  - hash64() — 64-битный XXH64: широкие 8-байтовые полосы, десятки
+ *    гигабайт в секунду на современных ядрах. Для ключей и быстрых
+ *    сравнений, где 32 бит CRC мало, а криптостойкость не нужна.
+ *
+ * Ни один из них не годится для контент-адресации блобов — там остается
+ * SHA-256: дедупликация по подделываемому хешу позволила бы подменить
+ * чужой файл. Эти хеши ловят порчу, а не злой умысел.
+ *
+ * Файл идентичен в client/core/ и server/ (как compression.h):
+ * правки вносятся в обе копии.
+ */
+namespace FastHash {
+
+/**
+ * @brief CRC-32C (Castagnoli) буфера.
+ * @details Аппаратный путь SSE4.2 выбирается один раз при первом вызове;
+ * программный slice-by-8 дает побайтово те же значения.
+ * @param data Указатель на данные
+ * @param len Длина в байтах
+ * @param seed Продолжение подсчета: CRC предыдущей части (0 — с начала)
+ * @return CRC-32C; инкрементальные вызовы эквивалентны одному сплошному
+ */
+quint32 crc32c(const char* data, qsizetype len, quint32 seed = 0);
+
+/** @brief Удобная обертка crc32c() для QByteArray. */
+inline quint32 crc32c(const QByteArray& data, quint32 seed = 0)
+{
+    return crc32c(data.constData(), data.size(), seed);
+}
+
+/**
+ * @brief 64-битный хеш XXH64.
+ * @param data Указатель на данные
+ * @param len Длина в байтах
+ * @param seed Соль (0 — канонический XXH64 без соли)
+ * @return 64-битное значение хеша
+ */
+quint64 hash64(const char* data, qsizetype len, quint64 seed = 0);
+
+/** @brief Удобная обертка hash64() для QByteArray. */
+inline quint64 hash64(const QByteArray& data, quint64 seed = 0)
+{
+    return hash64(data.constData(), data.size(), seed);
+}
+
+} // namespace FastHash
+
+#endif // FASTHASH_H
@@ -0,0 +1,413 @@
+#include "fileuploadservice.h"
+#include "networkservice.h"
+#include "dataservice.h"
+#include "fasthash.h"
+
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+FileUploadService::FileUploadService(NetworkService* networkService,
+                                     DataService* dataService,
+                                     QObject* parent)
+    : QObject(parent), m_network(networkService), m_dataService(dataService)
+{
+    connect(m_network, &NetworkService::jsonReceived,
+            this, &FileUploadService::onJsonReceived);
+    connect(m_network, &NetworkService::disconnected,
+            this, &FileUploadService::onDisconnected);
+
+    // Разгрузка очереди отправки — повод докачать окно: чанки придержаны,
+    // пока сокет занят интерактивным трафиком
+    connect(m_network, &NetworkService::bytesQueuedChanged,
+            this, &FileUploadService::pumpChunks);
+
+    // Восстановление сессии: прерванная передача договаривается заново
+    // тем же хешем и продолжается с resume_offset сервера
+    connect(m_dataService, &DataService::loginSuccess,
+            this, &FileUploadService::onSessionEstablished);
+
+    m_responseTimer.setSingleShot(true);
+    m_responseTimer.setInterval(ResponseTimeoutMs);
+    connect(&m_responseTimer, &QTimer::timeout, this, [this]() {
+        // Старый сервер молча игнорирует незнакомые типы запросов —
+        // по таймауту отдаем файл обратно на прежний HTTP-путь
+        failCurrent(QStringLiteral("File channel response timeout"));
+    });
+
+    // Будильник шейпера: срабатывает, когда ведро накопит кредит под
+    // следующий чанк (см. consumeTokens)
+    m_tokenTimer.setSingleShot(true);
+    connect(&m_tokenTimer, &QTimer::timeout, this, &FileUploadService::pumpChunks);
+}
+
+
+void FileUploadService::setCallActive(bool active)
+{
+    if (m_callActive == active) {
+        return;
+    }
+    m_callActive = active;
+
+    if (active) {
+        // Свежее ведро с полным burst-кредитом: маленькое вложение уйдет
+        // целиком, большой файл упрется в лимит после кредита
+        m_tokens = BurstCreditBytes;
+        m_tokenClock.invalidate();
+        qInfo() << "[FileUpload] Call active: shaping transfers to"
+                << shapingRateBytesPerSec() / 1024 << "KiB/s";
+    } else {
+        m_tokenTimer.stop();
+        qInfo() << "[FileUpload] Call ended: transfer shaping off";
+        // Полоса освободилась — докачиваем окно немедленно
+        pumpChunks();
+    }
+}
+
+
+qint64 FileUploadService::shapingRateBytesPerSec() const
+{
+    if (!m_callActive) {
+        return 0;
+    }
+    // Доля измеренной емкости канала, но не ниже гарантированного
+    // минимума — передача ползет даже на канале без оценки
+    return qMax(CallMinRateBytesPerSec,
+                qint64(m_linkCapacityBps * CallCapacityShare));
+}
+
+
+bool FileUploadService::consumeTokens(qint64 bytes)
+{
+    const qint64 rate = shapingRateBytesPerSec();
+    if (rate <= 0) {
+        return true; // Шейпинг выключен
+    }
+
+    if (!m_tokenClock.isValid()) {
+        m_tokenClock.start();
+    } else {
+        m_tokens = qMin<double>(BurstCreditBytes,
+                                m_tokens + rate * (m_tokenClock.restart() / 1000.0));
+    }
+
+    if (m_tokens >= double(bytes)) {
+        m_tokens -= double(bytes);
+        return true;
+    }
+
+    // Кредита нет: будильник ровно на момент накопления недостающего
+    const int waitMs = int((double(bytes) - m_tokens) * 1000.0 / double(rate)) + 1;
+    m_tokenTimer.start(waitMs);
+    return false;
+}
+
+
+void FileUploadService::enqueueUpload(const QString& filePath)
+{
+    m_pendingPaths.append(filePath);
+    qDebug() << "[FileUpload] Queued" << filePath
+             << "(" << m_pendingPaths.size() << "pending)";
+
+    if (m_state == State::Idle) {
+        startNext();
+    }
+}
+
+
+void FileUploadService::startNext()
+{
+    if (m_pendingPaths.isEmpty()) {
+        return;
+    }
+
+    m_filePath = m_pendingPaths.takeFirst();
+    m_fileName = QFileInfo(m_filePath).fileName();
+
+    m_file.setFileName(m_filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "[FileUpload] Cannot open" << m_filePath
+                   << ":" << m_file.errorString();
+        emit uploadFailed(m_filePath, QStringLiteral("Cannot open file"));
+        startNext();
+        return;
+    }
+
+    m_fileSize = m_file.size();
+    m_contentHash.clear();
+    m_hasher.reset();
+    m_hashedBytes = 0;
+    m_state = State::Hashing;
+
+    qDebug() << "[FileUpload] Hashing" << m_fileName
+             << "(" << m_fileSize << "bytes)";
+
+    // Хеширование идет порциями через цикл событий: между шагами GUI
+    // обрабатывает ввод и перерисовку
+    QTimer::singleShot(0, this, &FileUploadService::hashNextSlice);
+}
+
+
+void FileUploadService::hashNextSlice()
+{
+    if (m_state != State::Hashing) {
+        return; // Передача отменена между шагами
+    }
+
+    const QByteArray slice = m_file.read(HashSliceBytes);
+    if (!slice.isEmpty()) {
+        m_hasher.addData(slice);
+        m_hashedBytes += slice.size();
+    }
+
+    if (m_hashedBytes < m_fileSize && !slice.isEmpty()) {
+        QTimer::singleShot(0, this, &FileUploadService::hashNextSlice);
+        return;
+    }
+
+    m_contentHash = QString::fromLatin1(m_hasher.result().toHex());
+    beginNegotiation();
+}
+
+
+void FileUploadService::beginNegotiation()
+{
+    m_state = State::Negotiating;
+
+    // Хеш в begin включает дедупликацию (сервер может ответить complete
+    // без передачи данных) и точную докачку (resume_offset в ready)
+    QJsonObject begin;
+    begin["type"] = "file_upload_begin";
+    begin["file_name"] = m_fileName;
+    begin["file_size"] = static_cast<double>(m_fileSize);
+    begin["sha256"] = m_contentHash;
+    m_network->sendJson(begin);
+
+    m_responseTimer.start();
+}
+
+
+void FileUploadService::onJsonReceived(const QJsonObject& json)
+{
+    const QString type = json["type"].toString();
+
+    if (type == QLatin1String("file_upload_ready")) {
+        if (m_state != State::Negotiating) {
+            return;
+        }
+        m_responseTimer.stop();
+
+        m_transferId = static_cast<quint32>(json["transfer_id"].toDouble());
+        const int chunkSize = json["chunk_size"].toInt();
+        if (chunkSize > 0) {
+            m_chunkSize = chunkSize;
+        }
+
+        // Докачка: подтвержденные прошлой попыткой байты уже на диске
+        // сервера — продолжаем точно с их конца
+        const qint64 resumeOffset =
+            static_cast<qint64>(json["resume_offset"].toDouble());
+        m_sentBytes = resumeOffset;
+        m_ackedBytes = resumeOffset;
+        m_nextSeq = static_cast<quint32>(resumeOffset / m_chunkSize);
+        m_file.seek(resumeOffset);
+
+        if (resumeOffset > 0) {
+            qInfo() << "[FileUpload] Resuming" << m_fileName
+                    << "from byte" << resumeOffset;
+        }
+
+        m_state = State::Sending;
+        pumpChunks();
+        return;
+    }
+
+    if (type == QLatin1String("file_upload_ack")) {
+        if (m_state != State::Sending
+            || static_cast<quint32>(json["transfer_id"].toDouble()) != m_transferId) {
+            return;
+        }
+        // Подтвержденные байты записаны сервером на диск: окно сдвигается,
+        // а точка докачки после возможного обрыва — ровно здесь
+        m_ackedBytes = qMax(m_ackedBytes,
+                            static_cast<qint64>(json["received"].toDouble()));
+
+        // Оценка емкости канала по скорости ack-прогресса (EWMA). Во время
+        // звонка замер пропускается: передача намеренно идет ниже емкости,
+        // и оценка сползла бы к лимиту шейпера
+        if (!m_callActive) {
+            if (m_ackClock.isValid()) {
+                const qint64 dtMs = m_ackClock.restart();
+                const qint64 delta = m_ackedBytes - m_lastAckedBytes;
+                if (dtMs > 0 && delta > 0) {
+                    const double instantBps = delta * 1000.0 / dtMs;
+                    m_linkCapacityBps = (m_linkCapacityBps == 0.0)
+                        ? instantBps
+                        : m_linkCapacityBps
+                              + CapacityEwmaAlpha * (instantBps - m_linkCapacityBps);
+                }
+            } else {
+                m_ackClock.start();
+            }
+            m_lastAckedBytes = m_ackedBytes;
+        }
+
+        pumpChunks();
+        return;
+    }
+
+    if (type == QLatin1String("file_upload_complete")) {
+        // Приходит из Negotiating (дедупликация: блоб уже в хранилище)
+        // или из Finishing (все чанки приняты и сверены)
+        if (m_state != State::Negotiating && m_state != State::Finishing) {
+            return;
+        }
+        m_responseTimer.stop();
+
+        const QString fileId = json["file_id"].toString();
+        const QString fileName = json["file_name"].toString();
+        const QString fileUrl = json["file_url"].toString();
+
+        // Дальше метаданные подставляются в исходящее сообщение тем же
+        // путем, что и при старом HTTP-пути
+        m_dataService->cacheUploadedFile(fileId, fileName, fileUrl);
+
+        qInfo() << "[FileUpload] Complete:" << fileName << "id" << fileId
+                << (json["deduplicated"].toBool() ? "(deduplicated)" : "");
+
+        const QString path = m_filePath;
+        resetTransfer();
+        emit uploadFinished(path, fileId);
+        startNext();
+        return;
+    }
+
+    if (type == QLatin1String("file_upload_failed")) {
+        if (m_state == State::Idle || m_state == State::Stalled) {
+            return;
+        }
+        failCurrent(json["reason"].toString());
+    }
+}
+
+
+void FileUploadService::pumpChunks()
+{
+    if (m_state != State::Sending) {
+        return;
+    }
+
+    // Скользящее окно: держим до WindowChunks неподтвержденных чанков,
+    // но не затапливаем очередь отправки — интерактивные кадры и так
+    // идут первыми, однако и буферы сокета раздувать незачем
+    const qint64 windowBytes = static_cast<qint64>(WindowChunks) * m_chunkSize;
+    while (m_sentBytes < m_fileSize
+           && m_sentBytes - m_ackedBytes < windowBytes
+           && m_network->bytesQueued() < SendQueueSoftCap) {
+        // Шейпер звонка: без кредита ведра чанк ждет будильника токенов
+        const qint64 nextChunkBytes = qMin<qint64>(m_chunkSize,
+                                                   m_fileSize - m_sentBytes);
+        if (!consumeTokens(nextChunkBytes)) {
+            break;
+        }
+
+        const QByteArray data = m_file.read(m_chunkSize);
+        if (data.isEmpty()) {
+            failCurrent(QStringLiteral("File read failed"));
+            return;
+        }
+
+        m_network->sendFileChunk(encodeChunk(m_nextSeq, data));
+        ++m_nextSeq;
+        m_sentBytes += data.size();
+    }
+
+    emit uploadProgress(m_filePath, m_sentBytes, m_fileSize);
+
+    if (m_sentBytes >= m_fileSize) {
+        // Финиш уходит тем же соединением после последнего чанка — TCP
+        // сохраняет порядок, сервер к этому моменту принял все данные
+        QJsonObject finish;
+        finish["type"] = "file_upload_finish";
+        finish["transfer_id"] = static_cast<double>(m_transferId);
+        m_network->sendJson(finish);
+
+        m_state = State::Finishing;
+        m_responseTimer.start();
+    }
+}
+
+
+void FileUploadService::onDisconnected()
+{
+    if (m_state == State::Idle || m_state == State::Hashing) {
+        return; // Хеширование локально и обрыва не замечает
+    }
+
+    // Передача замирает: хеш и файл сохраняем, после восстановления
+    // сессии begin с тем же хешем вернет точное смещение докачки
+    qInfo() << "[FileUpload] Connection lost, transfer stalled at"
+            << m_ackedBytes << "of" << m_fileSize << "bytes";
+    m_responseTimer.stop();
+    m_state = State::Stalled;
+}
+
+
+void FileUploadService::onSessionEstablished()
+{
+    if (m_state != State::Stalled) {
+        return;
+    }
+
+    qInfo() << "[FileUpload] Session restored, renegotiating" << m_fileName;
+    beginNegotiation();
+}
+
+
+QByteArray FileUploadService::encodeChunk(quint32 seq,
+                                          const QByteArray& data) const
+{
+    // Формат кадра чанка повторяет FileTransfer сервера:
+    // [magic:1][transferId:4 BE][seq:4 BE][crc32c:4 BE][данные]
+    QByteArray chunk(ChunkHeaderSize + data.size(), Qt::Uninitialized);
+    char* p = chunk.data();
+    p[0] = static_cast<char>(ChunkMagic);
+    qToBigEndian(m_transferId, p + 1);
+    qToBigEndian(seq, p + 5);
+    qToBigEndian(FastHash::crc32c(data), p + 9);
+    memcpy(p + ChunkHeaderSize, data.constData(),
+           static_cast<size_t>(data.size()));
+    return chunk;
+}
+
+
+void FileUploadService::failCurrent(const QString& reason)
+{
+    qWarning() << "[FileUpload] Upload failed:" << m_filePath << "-" << reason;
+
+    const QString path = m_filePath;
+    resetTransfer();
+    emit uploadFailed(path, reason);
+    startNext();
+}
+
+
+void FileUploadService::resetTransfer()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_responseTimer.stop();
+    m_state = State::Idle;
+    m_filePath.clear();
+    m_fileName.clear();
+    m_fileSize = 0;
+    m_contentHash.clear();
+    m_hashedBytes = 0;
+    m_transferId = 0;
+    m_chunkSize = DefaultChunkSize;
+    m_nextSeq = 0;
+    m_sentBytes = 0;
+    m_ackedBytes = 0;
+}
@@ -0,0 +1,233 @@
+#ifndef FILEUPLOADSERVICE_H
+#define FILEUPLOADSERVICE_H
+
+#include <QObject>
+#include <QFile>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTimer>
+#include <QList>
+#include <QString>
+
+class NetworkService;
+class DataService;
+
+/**
+ * @brief Загрузчик вложений через шифрованный файловый канал сервера.
+ *
+ * @details Заменяет одноразовый HTTP-POST целого файла конвейерной
+ * передачей чанками по основному TCP-соединению:
+ *
+ * - Перед передачей файл хешируется (SHA-256) порциями через цикл
+ *   событий — GUI не замирает даже на гигабайтном файле. Хеш уходит
+ *   в file_upload_begin: при попадании в блоб-хранилище сервер отвечает
+ *   file_upload_complete сразу, без передачи единого байта данных.
+ * - Данные идут чанками фиксированного размера со скользящим окном:
+ *   в полете держится до WindowChunks неподтвержденных чанков, сервер
+ *   подтверждает прогресс периодическими file_upload_ack. Чанки уходят
+ *   фоновым приоритетом очереди отправки, поэтому сообщения и запросы
+ *   пользователя не ждут хвоста большого файла.
+ * - Подтвержденные байты уже записаны сервером на диск, поэтому обрыв
+ *   соединения не обнуляет передачу: после восстановления сессии тот же
+ *   file_upload_begin с тем же хешем получает resume_offset, и отправка
+ *   продолжается точно с него.
+ * - На время звонка передача дросселируется token bucket'ом (см.
+ *   setCallActive): полоса ограничивается долей измеренной емкости
+ *   канала, burst-кредит пропускает маленькие вложения без задержки —
+ *   аудио не конкурирует с чанками за uplink.
+ *
+ * Завершенная загрузка регистрируется в DataService::cacheUploadedFile —
+ * дальше метаданные файла подставляются в исходящее сообщение тем же
+ * путем, что и при старом HTTP-пути. Если канал недоступен (старый
+ * сервер, ошибка), наружу уходит uploadFailed — MainWindow откатывается
+ * на прежний HTTP-путь.
+ */
+class FileUploadService : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Первый байт кадра чанка (формат канала, см. FileTransfer сервера). */
+    static constexpr quint8 ChunkMagic = 0xF5;
+
+    /** @brief Размер заголовка чанка: magic + transferId + seq + crc32c. */
+    static constexpr int ChunkHeaderSize = 13;
+
+    /** @brief Размер чанка по умолчанию (сервер присылает свой в ready). */
+    static constexpr int DefaultChunkSize = 256 * 1024;
+
+    /** @brief Порция одного шага хеширования: крупно для скорости,
+     *  мелко для отзывчивости цикла событий. */
+    static constexpr qint64 HashSliceBytes = 4LL * 1024 * 1024;
+
+    /** @brief Максимум неподтвержденных чанков в полете. */
+    static constexpr int WindowChunks = 16;
+
+    /** @brief Потолок очереди отправки сокета, выше которого накачка
+     *  чанков приостанавливается (возобновляется по bytesQueuedChanged). */
+    static constexpr qint64 SendQueueSoftCap = 1LL * 1024 * 1024;
+
+    /** @brief Таймаут ответа сервера на управляющие запросы канала:
+     *  старый сервер молча игнорирует незнакомый тип — не ждем вечно. */
+    static constexpr int ResponseTimeoutMs = 15000;
+
+    // --- Шейпинг полосы на время звонка (token bucket) ---
+
+    /** @brief Нижняя граница полосы передачи при активном звонке, байт/с. */
+    static constexpr qint64 CallMinRateBytesPerSec = 32 * 1024;
+
+    /** @brief Доля измеренной емкости канала, отдаваемая чанкам при звонке:
+     *  остальное остается UDP-аудио и интерактивному трафику. */
+    static constexpr double CallCapacityShare = 0.25;
+
+    /** @brief Burst-кредит ведра, байт: файлы меньше кредита уходят сразу
+     *  даже во время звонка — короткий всплеск аудио не ломает. */
+    static constexpr qint64 BurstCreditBytes = 512 * 1024;
+
+    /** @brief Альфа EWMA оценки емкости канала по прогрессу ack'ов. */
+    static constexpr double CapacityEwmaAlpha = 0.2;
+
+    /**
+     * @brief Конструктор загрузчика.
+     * @param networkService Сетевой сервис (канал отправки и ответы сервера)
+     * @param dataService Сервис данных (кэш метаданных загруженных файлов)
+     * @param parent Родительский QObject
+     */
+    explicit FileUploadService(NetworkService* networkService,
+                               DataService* dataService,
+                               QObject* parent = nullptr);
+
+public slots:
+    /**
+     * @brief Ставит файл в очередь загрузки.
+     *
+     * Файлы передаются по одному (чанки одной передачи обязаны идти
+     * по порядку); следующий начинается после завершения текущего.
+     * @param filePath Абсолютный путь к файлу
+     */
+    void enqueueUpload(const QString& filePath);
+
+    /**
+     * @brief Включает/выключает шейпинг на время звонка этого хоста.
+     *
+     * При активном звонке чанки дросселируются token bucket'ом: полоса
+     * передачи ограничивается долей CallCapacityShare от измеренной
+     * емкости канала (не ниже CallMinRateBytesPerSec), чтобы UDP-аудио
+     * не конкурировало с файлом за uplink. Ведро стартует с полным
+     * burst-кредитом — маленькие вложения уходят без задержки.
+     * Подключается к CallService::callConnected / callEnded.
+     * @param active true — звонок установлен, шейпинг включен
+     */
+    void setCallActive(bool active);
+
+signals:
+    /**
+     * @brief Прогресс текущей передачи.
+     * @param filePath Путь загружаемого файла
+     * @param sentBytes Отправлено байт (включая неподтвержденные)
+     * @param totalBytes Размер файла
+     */
+    void uploadProgress(const QString& filePath, qint64 sentBytes,
+                        qint64 totalBytes);
+
+    /**
+     * @brief Загрузка завершена, метаданные уже в кэше DataService.
+     * @param filePath Путь загруженного файла
+     * @param fileId Идентификатор файла на сервере
+     */
+    void uploadFinished(const QString& filePath, const QString& fileId);
+
+    /**
+     * @brief Загрузка не удалась (канал недоступен или ошибка сервера).
+     * @param filePath Путь файла
+     * @param reason Текст причины
+     */
+    void uploadFailed(const QString& filePath, const QString& reason);
+
+private slots:
+    /** @brief Ответы сервера: ready/ack/complete/failed файлового канала. */
+    void onJsonReceived(const QJsonObject& json);
+
+    /** @brief Разрыв соединения: передача замирает до восстановления сессии. */
+    void onDisconnected();
+
+    /** @brief Сессия восстановлена: прерванная передача договаривается заново. */
+    void onSessionEstablished();
+
+    /** @brief Очередной шаг инкрементального хеширования файла. */
+    void hashNextSlice();
+
+    /** @brief Накачивает окно отправки чанками (сколько влезает). */
+    void pumpChunks();
+
+private:
+    /** @brief Фазы передачи одного файла. */
+    enum class State {
+        Idle,        ///< Нет активной передачи
+        Hashing,     ///< Считается SHA-256 содержимого
+        Negotiating, ///< Отправлен file_upload_begin, ждем ready/complete
+        Sending,     ///< Чанки уходят в скользящем окне
+        Finishing,   ///< Отправлен file_upload_finish, ждем complete
+        Stalled      ///< Соединение оборвано, ждем восстановления сессии
+    };
+
+    /** @brief Начинает следующий файл из очереди (если есть). */
+    void startNext();
+
+    /** @brief Отправляет file_upload_begin с посчитанным хешем. */
+    void beginNegotiation();
+
+    /** @brief Собирает кадр чанка: [magic][transferId BE][seq BE][crc32c BE][данные]. */
+    QByteArray encodeChunk(quint32 seq, const QByteArray& data) const;
+
+    /** @brief Завершает текущую передачу ошибкой и берет следующий файл. */
+    void failCurrent(const QString& reason);
+
+    /** @brief Сбрасывает состояние текущей передачи (файл, таймеры). */
+    void resetTransfer();
+
+    /** @brief Текущий потолок полосы, байт/с (0 — шейпинг выключен). */
+    qint64 shapingRateBytesPerSec() const;
+
+    /**
+     * @brief Списывает токены ведра под очередной чанк.
+     * @details При нехватке кредита взводит будильник m_tokenTimer ровно
+     * на момент накопления недостающего и возвращает false.
+     * @param bytes Размер чанка, байт
+     * @return true — чанк можно отправлять сейчас.
+     */
+    bool consumeTokens(qint64 bytes);
+
+    NetworkService* m_network;   ///< Канал отправки и источник ответов сервера
+    DataService* m_dataService;  ///< Кэш метаданных загруженных файлов
+
+    QList<QString> m_pendingPaths; ///< Очередь путей, ждущих передачи
+
+    State m_state = State::Idle; ///< Фаза текущей передачи
+    QString m_filePath;          ///< Путь текущего файла
+    QString m_fileName;          ///< Имя файла (для протокола)
+    qint64 m_fileSize = 0;       ///< Размер файла
+    QString m_contentHash;       ///< SHA-256 содержимого (hex)
+    QFile m_file;                ///< Открытый файл текущей передачи
+
+    QCryptographicHash m_hasher{QCryptographicHash::Sha256}; ///< Инкрементальный хеш
+    qint64 m_hashedBytes = 0;    ///< Прохешировано байт
+
+    quint32 m_transferId = 0;    ///< Идентификатор передачи от сервера
+    int m_chunkSize = DefaultChunkSize; ///< Размер чанка (из ready)
+    quint32 m_nextSeq = 0;       ///< Номер следующего чанка
+    qint64 m_sentBytes = 0;      ///< Отправлено байт
+    qint64 m_ackedBytes = 0;     ///< Подтверждено сервером (лежит на диске)
+
+    bool m_callActive = false;      ///< Звонок этого хоста активен — шейпим
+    double m_linkCapacityBps = 0.0; ///< EWMA емкости канала, байт/с (0 — нет оценки)
+    qint64 m_lastAckedBytes = 0;    ///< Точка прошлого замера ack-прогресса
+    QElapsedTimer m_ackClock;       ///< Часы замера ack-прогресса
+    double m_tokens = 0.0;          ///< Токены ведра, байт
+    QElapsedTimer m_tokenClock;     ///< Часы пополнения ведра
+    QTimer m_tokenTimer;            ///< Будильник возобновления при пустом ведре
+
+    QTimer m_responseTimer;      ///< Таймаут ответа на begin/finish
+};
+
+#endif // FILEUPLOADSERVICE_H
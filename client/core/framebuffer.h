@@ -0,0 +1,117 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <QByteArray>
+
+/**
+ * @class FrameBuffer
+ * @brief Инкрементальный парсер потока пакетов с префиксом длины.
+ *
+ * @details Зеркало одноименного серверного парсера: формат потока общий —
+ * `[длина кадра quint32, big-endian][тело кадра]`, ровно так его пишет
+ * QDataStream на обеих сторонах.
+ *
+ * Исторически NetworkDecoder вырезал кадры парой `left()` + `remove(0, n)`:
+ * копия тела кадра плюс memmove хвоста на каждый кадр. На залпе ответов
+ * при входе (контакты, счетчики, офлайн-сообщения) эти копии складываются
+ * в заметную долю времени потока декодера.
+ *
+ * FrameBuffer владеет растущим буфером, в который дописываются сырые байты
+ * из сокета, и нарезает из него готовые кадры БЕЗ копирования: nextFrame()
+ * возвращает QByteArray::fromRawData-представление, указывающее внутрь
+ * буфера. Емкость буфера переиспользуется между чтениями; сдвиг хвоста
+ * (memmove) происходит только когда накопленный «прочитанный» префикс
+ * превышает порог компактификации.
+ *
+ * @warning Возвращенный кадр действителен только до следующего вызова
+ * append(): обрабатывайте все кадры до следующего чтения из сокета
+ * (именно так устроен цикл NetworkDecoder::processChunk).
+ */
+class FrameBuffer
+{
+public:
+    /**
+     * @brief Дописывает сырые байты из сокета в конец буфера.
+     * @details Перед дописыванием буфер при возможности компактифицируется:
+     * полностью обработанный — обнуляется с сохранением емкости, сильно
+     * «израсходованный» — сдвигается одним memmove.
+     */
+    void append(const QByteArray& chunk);
+
+    /**
+     * @brief Пытается вырезать следующий полный кадр.
+     *
+     * @details Заявленный размер кадра проверяется сразу по префиксу, ДО
+     * накопления тела: сбойный (или подменный) сервер с гигабайтным
+     * префиксом не заставит клиент буферизовать гигабайт. Превышение
+     * лимита — фатальная ошибка протокола: парсер переходит в состояние
+     * overflowed() и кадров больше не выдает, вызывающий рвет соединение
+     * тем же путем, что при подделке MAC.
+     *
+     * @param frame [out] Представление тела кадра внутри буфера (без копии).
+     * @param limit Потолок тела кадра для текущего класса трафика:
+     *        HandshakeFrameLimit до установления шифрования (ответ
+     *        рукопожатия — килобайтный JSON), SessionFrameLimit после.
+     * @return `true`, если полный кадр доступен; `false` — ждать данных
+     *         либо зафиксировано переполнение (см. overflowed()).
+     */
+    bool nextFrame(QByteArray& frame, quint32 limit);
+
+    /**
+     * @brief Префикс длины превысил лимит — соединение подлежит разрыву.
+     */
+    bool overflowed() const { return m_overflowed; }
+
+    /**
+     * @brief Полный сброс состояния (при разрыве соединения).
+     * @details Недособранный полукадр принадлежит разорванному соединению;
+     * после переподключения поток начинается с границы кадра рукопожатия.
+     */
+    void clear();
+
+    /**
+     * @brief Отдает системе разросшуюся емкость после всплеска трафика.
+     * @details Вызывается в конце цикла processChunk, когда все кадры
+     * обработаны. Небольшая емкость (до IdleCapacityBytes) сохраняется под
+     * переиспользование; буфер, раздутый одиночным крупным кадром (аватар,
+     * файловый чанк), освобождается — иначе такой кадр навсегда закрепляет
+     * сотни килобайт за соединением.
+     */
+    void trim();
+
+    /**
+     * @brief Потолок кадра до установления шифрования.
+     * @details Открытым текстом от сервера приходит только ответ
+     * рукопожатия — килобайтный JSON; все крупное легитимным быть не может.
+     */
+    static constexpr quint32 HandshakeFrameLimit = 16 * 1024;
+
+    /**
+     * @brief Потолок кадра шифрованной сессии.
+     * @details Самые крупные легитимные кадры от сервера — страницы истории
+     * и залпы офлайн-доставки при входе; даже сжатые пачки укладываются в
+     * сотни килобайт, потолок оставляет многократный запас.
+     */
+    static constexpr quint32 SessionFrameLimit = 4 * 1024 * 1024;
+
+private:
+    /**
+     * @brief Порог компактификации: буфер сдвигается, когда обработанный
+     * префикс превышает это значение и не может быть просто обнулен.
+     */
+    static constexpr qsizetype CompactThreshold = 64 * 1024;
+
+    /**
+     * @brief Емкость, которую простаивающее соединение может удерживать.
+     * @details Покрывает типичные сообщения с запасом; все сверх этого
+     * возвращается аллокатору в trim().
+     */
+    static constexpr qsizetype IdleCapacityBytes = 8 * 1024;
+
+    QByteArray m_buffer;       ///< Накопленные сырые байты потока.
+    qsizetype m_head = 0;      ///< Смещение первого необработанного байта.
+    quint32 m_pendingSize = 0; ///< Ожидаемый размер тела кадра (0 — ждем заголовок).
+    bool m_overflowed = false; ///< Префикс длины превысил лимит (фатально).
+};
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,163 @@
+#include "httpclient.h"
+
+#include <QNetworkRequest>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+
+HttpClient* HttpClient::instance()
+{
+    // Один пул соединений на процесс; создается в GUI-потоке при первом
+    // обращении и живет до конца процесса
+    static HttpClient* client = new HttpClient();
+    return client;
+}
+
+
+HttpClient::HttpClient(QObject* parent)
+    : QObject(parent)
+{
+    m_audit = qEnvironmentVariableIsSet("MESSENGER_NET_AUDIT");
+}
+
+
+void HttpClient::download(const QUrl& url, const QString& targetPath,
+                          Lane lane,
+                          std::function<void(bool, const QString&)> done)
+{
+    if (lane == Lane::Background
+        && (m_backgroundPaused
+            || m_activeBackground >= MaxBackgroundDownloads)) {
+        // Фоновая полоса занята или придержана логин-залпом: в очередь
+        m_queue.append({ url, targetPath, std::move(done) });
+        return;
+    }
+
+    if (lane == Lane::Background) {
+        ++m_activeBackground;
+    }
+    startDownload(url, targetPath, std::move(done),
+                  lane == Lane::Background);
+}
+
+
+void HttpClient::startDownload(const QUrl& url, const QString& targetPath,
+                               std::function<void(bool, const QString&)> done,
+                               bool background)
+{
+    const QString partPath = targetPath + ".part";
+
+    // Хвост прошлой оборванной попытки: качаем только недостающее
+    auto* file = new QFile(partPath, this);
+    const qint64 resumeOffset = QFileInfo(partPath).size();
+    const bool resuming = resumeOffset > 0;
+
+    if (!file->open(resuming ? QIODevice::Append : QIODevice::WriteOnly)) {
+        file->deleteLater();
+        if (done) done(false, QStringLiteral("Cannot open %1").arg(partPath));
+        return;
+    }
+
+    QNetworkRequest request(url);
+    if (resuming) {
+        request.setRawHeader("Range",
+                             "bytes=" + QByteArray::number(resumeOffset) + "-");
+    }
+
+    ++m_activeDownloads;
+    QNetworkReply* reply = m_manager.get(request);
+
+    // Сервер без поддержки Range отвечает 200 с телом целиком —
+    // дописывать его к хвосту нельзя, начинаем файл заново
+    auto* rangeChecked = new bool(false);
+    connect(reply, &QNetworkReply::readyRead, this,
+            [this, reply, file, resuming, rangeChecked]() {
+        if (!*rangeChecked) {
+            *rangeChecked = true;
+            const int status = reply->attribute(
+                QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if (resuming && status == 200) {
+                file->resize(0);
+            }
+        }
+        const QByteArray chunk = reply->readAll();
+        m_totalBytesReceived += chunk.size();
+        file->write(chunk);
+    });
+
+    connect(reply, &QNetworkReply::finished, this,
+            [this, reply, file, targetPath, partPath, resuming,
+             rangeChecked, background, done = std::move(done)]() {
+        const QByteArray tail = reply->readAll();
+        m_totalBytesReceived += tail.size();
+        file->write(tail);
+        file->close();
+        file->deleteLater();
+
+        --m_activeDownloads;
+        if (background) {
+            --m_activeBackground;
+        }
+
+        bool ok = reply->error() == QNetworkReply::NoError;
+        QString error = ok ? QString() : reply->errorString();
+
+        if (ok && QFileInfo(partPath).size() == 0) {
+            // Пустое тело — не файл (сервер мог ответить без данных)
+            ok = false;
+            error = QStringLiteral("Empty response body");
+            QFile::remove(partPath);
+        }
+
+        if (ok) {
+            // Атомарная публикация: недокачанный файл не сойдет за готовый
+            QFile::remove(targetPath);
+            ok = QFile::rename(partPath, targetPath);
+            if (!ok) error = QStringLiteral("Cannot rename %1").arg(partPath);
+        }
+        // При сетевой ошибке .part сохраняется: следующая попытка
+        // продолжит Range-запросом с его конца
+
+        if (m_audit) {
+            qInfo() << "[HTTP]" << (ok ? "done" : "failed")
+                    << reply->url().toString()
+                    << (resuming ? "(resumed)" : "")
+                    << "total_rx" << m_totalBytesReceived << "bytes";
+        }
+
+        delete rangeChecked;
+        reply->deleteLater();
+
+        if (done) done(ok, error);
+        pumpQueue();
+    });
+}
+
+
+void HttpClient::setBackgroundPaused(bool paused)
+{
+    if (m_backgroundPaused == paused) {
+        return;
+    }
+    m_backgroundPaused = paused;
+
+    qDebug() << "[HTTP] Background lane"
+             << (paused ? "paused" : "resumed")
+             << "(" << m_queue.size() << "queued)";
+
+    if (!paused) {
+        pumpQueue();
+    }
+}
+
+
+void HttpClient::pumpQueue()
+{
+    while (!m_backgroundPaused
+           && m_activeBackground < MaxBackgroundDownloads
+           && !m_queue.isEmpty()) {
+        PendingDownload next = m_queue.takeFirst();
+        ++m_activeBackground;
+        startDownload(next.url, next.targetPath, std::move(next.done), true);
+    }
+}
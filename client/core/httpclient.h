@@ -0,0 +1,117 @@
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QUrl>
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <functional>
+
+/**
+ * @brief Общий HTTP-слой медиа-конвейера (аватары, миниатюры, файлы).
+ *
+ * @details Исторически каждый потребитель заводил собственный
+ * QNetworkAccessManager — а MainWindow и вовсе по менеджеру на скачивание:
+ * каждый файл платил новое TCP-соединение и DNS-резолв, а при обрыве
+ * закачка начиналась с нуля. Здесь все HTTP-загрузки идут через один
+ * менеджер процесса:
+ *
+ * - Один QNetworkAccessManager на процесс: keep-alive соединения и кэш
+ *   DNS переиспользуются между всеми загрузками (у Qt и то и другое
+ *   живет внутри менеджера — по менеджеру на файл они не работали).
+ * - Докачка Range-запросом: тело пишется в `<файл>.part` по мере прихода
+ *   (без накопления в памяти), при повторе после обрыва качается только
+ *   недостающий хвост (`Range: bytes=N-`); сервер без поддержки Range
+ *   прозрачно отдает файл целиком.
+ * - Две полосы и учет трафика: фоновые загрузки (аватары, миниатюры)
+ *   ограничены по параллелизму и приостанавливаются на время
+ *   логин-залпа — полоса канала остается сокету сообщений; загрузки по
+ *   клику пользователя идут интерактивной полосой без очереди.
+ *   Суммарные байты считаются для диагностики (MESSENGER_NET_AUDIT).
+ *
+ * Синглтон по образцу TimerHub: потребители разбросаны по виджетам и
+ * сервисам, а пул соединений должен быть общим на процесс.
+ */
+class HttpClient : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Полоса загрузки: очередь и паузы касаются только фоновой. */
+    enum class Lane {
+        Interactive, ///< По действию пользователя — без очереди
+        Background   ///< Префетч (аватары, миниатюры) — ограничен и паузим
+    };
+
+    /** @brief Одновременных фоновых загрузок (интерактивные вне лимита). */
+    static constexpr int MaxBackgroundDownloads = 3;
+
+    /** @brief Общий экземпляр процесса (создается при первом обращении). */
+    static HttpClient* instance();
+
+    /**
+     * @brief Скачивает URL в файл с докачкой после обрыва.
+     *
+     * Тело пишется в `<targetPath>.part`; при успехе файл атомарно
+     * переименовывается в targetPath, при ошибке .part сохраняется и
+     * следующая попытка продолжает Range-запросом с его конца.
+     * @param url Источник
+     * @param targetPath Абсолютный путь результата
+     * @param lane Полоса (фоновая может подождать в очереди)
+     * @param done Коллбэк завершения: ok и текст ошибки при неудаче
+     */
+    void download(const QUrl& url, const QString& targetPath, Lane lane,
+                  std::function<void(bool ok, const QString& error)> done);
+
+    /**
+     * @brief Общий менеджер для запросов, не укладывающихся в download()
+     * (multipart-загрузка на сервер и т.п.): соединения и DNS — из
+     * общего пула.
+     */
+    QNetworkAccessManager* networkManager() { return &m_manager; }
+
+    /**
+     * @brief Приостанавливает/возобновляет фоновую полосу.
+     *
+     * На время логин-залпа (см. DataService::beginLoginBurst) фоновые
+     * загрузки копятся в очереди: на медленном канале залп аватаров
+     * не отнимает полосу у истории и статусов на сокете сообщений.
+     */
+    void setBackgroundPaused(bool paused);
+
+    /** @brief Всего байт принято по HTTP за процесс (учет трафика). */
+    qint64 totalBytesReceived() const { return m_totalBytesReceived; }
+
+    /** @brief Активных загрузок сейчас (обе полосы). */
+    int activeDownloads() const { return m_activeDownloads; }
+
+private:
+    explicit HttpClient(QObject* parent = nullptr);
+
+    /** @brief Ожидающая фоновая загрузка. */
+    struct PendingDownload {
+        QUrl url;
+        QString targetPath;
+        std::function<void(bool, const QString&)> done;
+    };
+
+    /** @brief Запускает загрузку немедленно (полоса уже пройдена). */
+    void startDownload(const QUrl& url, const QString& targetPath,
+                       std::function<void(bool, const QString&)> done,
+                       bool background);
+
+    /** @brief Выпускает фоновые загрузки из очереди в пределах лимита. */
+    void pumpQueue();
+
+    QNetworkAccessManager m_manager;     ///< Общий пул соединений и DNS
+    QList<PendingDownload> m_queue;      ///< Очередь фоновой полосы
+    int m_activeDownloads = 0;           ///< В полете (обе полосы)
+    int m_activeBackground = 0;          ///< В полете по фоновой полосе
+    bool m_backgroundPaused = false;     ///< Логин-залп: фон придержан
+    qint64 m_totalBytesReceived = 0;     ///< Учет принятого трафика
+    bool m_audit = false;                ///< MESSENGER_NET_AUDIT
+};
+
+#endif // HTTPCLIENT_H
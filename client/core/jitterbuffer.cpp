@@ -0,0 +1,138 @@
+#include "jitterbuffer.h"
+
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+
+//См. "jitterbuffer.h"
+
+JitterBuffer::JitterBuffer()
+    : m_slots(Capacity)
+{
+    m_arrivalClock.start();
+}
+
+bool JitterBuffer::push(quint64 seq, const char* data, int len)
+{
+    if (!data || len <= 0 || len > MaxPacketBytes) {
+        qDebug() << "[JITTER] Отброшен пакет с недопустимой длиной" << len;
+        return false;
+    }
+
+    // Оценка джиттера по межпакетным интервалам: отклонение от номинальных
+    // 20 мс сглаживается с коэффициентом 1/16 (как в RFC 3550)
+    const qint64 now = m_arrivalClock.elapsed();
+    if (m_lastArrivalMs >= 0) {
+        const double d = double(now - m_lastArrivalMs) - FramePeriodMs;
+        m_jitterMs += (std::abs(d) - m_jitterMs) / 16.0;
+    }
+    m_lastArrivalMs = now;
+
+    // Первый пакет потока задает курсор воспроизведения
+    if (!m_synced) {
+        m_nextSeq = seq;
+        m_synced = true;
+    }
+
+    // Опоздавший: его кадр уже проигран (или закрыт PLC)
+    if (seq < m_nextSeq) {
+        ++m_lateCount;
+        return false;
+    }
+
+    // Скачок за пределы кольца: передатчик ушел далеко вперед,
+    // накопленное устарело — ресинхронизируемся на новый поток
+    if (seq >= m_nextSeq + Capacity) {
+        qDebug() << "[JITTER] Ресинхронизация: seq" << seq
+                 << "далеко впереди курсора" << m_nextSeq;
+        const quint64 late = m_lateCount;
+        const quint64 dup = m_duplicateCount;
+        clear();
+        m_lateCount = late;
+        m_duplicateCount = dup;
+        m_nextSeq = seq;
+        m_synced = true;
+        m_lastArrivalMs = now;
+    }
+
+    // Прибыл позже пакета со старшим seq, но кадр еще не проигран:
+    // сеть переупорядочила, кольцо это переживает без последствий
+    if (seq < m_highestSeq) {
+        ++m_reorderCount;
+    } else {
+        m_highestSeq = seq;
+    }
+
+    Slot& slot = slotFor(seq);
+    if (slot.length >= 0 && slot.seq == seq) {
+        ++m_duplicateCount;
+        return false;
+    }
+    if (slot.length < 0) {
+        ++m_count;
+    }
+
+    slot.seq = seq;
+    slot.length = len;
+    std::memcpy(slot.data.data(), data, size_t(len));
+    return true;
+}
+
+bool JitterBuffer::hasNext() const
+{
+    const Slot& slot = m_slots[m_nextSeq % Capacity];
+    return slot.length >= 0 && slot.seq == m_nextSeq;
+}
+
+int JitterBuffer::takeNext(unsigned char* out, int maxLen)
+{
+    Slot& slot = slotFor(m_nextSeq);
+    if (slot.length < 0 || slot.seq != m_nextSeq || slot.length > maxLen) {
+        return -1;
+    }
+
+    const int len = slot.length;
+    std::memcpy(out, slot.data.data(), size_t(len));
+    slot.length = -1;
+    --m_count;
+    ++m_nextSeq;
+    return len;
+}
+
+int JitterBuffer::peek(quint64 seq, unsigned char* out, int maxLen) const
+{
+    const Slot& slot = m_slots[seq % Capacity];
+    if (slot.length < 0 || slot.seq != seq || slot.length > maxLen) {
+        return -1;
+    }
+    std::memcpy(out, slot.data.data(), size_t(slot.length));
+    return slot.length;
+}
+
+void JitterBuffer::skipNext()
+{
+    // Кадр потерян: слот под курсором пуст, просто двигаемся дальше
+    ++m_nextSeq;
+}
+
+int JitterBuffer::targetDepth() const
+{
+    const int fromJitter = 1 + int(std::ceil(m_jitterMs / FramePeriodMs));
+    return qBound(MinTargetDepth, fromJitter, MaxTargetDepth);
+}
+
+void JitterBuffer::clear()
+{
+    for (Slot& slot : m_slots) {
+        slot.length = -1;
+    }
+    m_count = 0;
+    m_nextSeq = 0;
+    m_synced = false;
+    m_lastArrivalMs = -1;
+    m_jitterMs = 0.0;
+    m_lateCount = 0;
+    m_duplicateCount = 0;
+    m_reorderCount = 0;
+    m_highestSeq = 0;
+}
@@ -0,0 +1,139 @@
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include <array>
+#include <vector>
+
+/**
+ * @brief Адаптивный джиттер-буфер аудиозвонка на предвыделенном кольце.
+ *
+ * Хранит Opus-пакеты в кольце, индексируемом номером последовательности
+ * по модулю емкости: ни одной аллокации на пакет, в отличие от прежнего
+ * QMap<quint64, QByteArray> (узел дерева + QByteArray на каждые 20 мс).
+ *
+ * Целевая глубина буфера не фиксирована, а выводится из измеренного
+ * межпакетного джиттера (сглаживание в духе RFC 3550): на хорошей сети
+ * буфер ужимается до пары кадров и сокращает задержку "рот-ухо", при
+ * всплесках джиттера — растет и гасит их.
+ *
+ * Опоздавшие пакеты (seq меньше курсора воспроизведения) и дубликаты
+ * отбрасываются со счетчиком; уход seq далеко вперед (потеря связи,
+ * рестарт передатчика) вызывает ресинхронизацию курсора.
+ */
+class JitterBuffer
+{
+public:
+    /// Длительность одного аудиокадра, мс (Opus 320 сэмплов @ 16 кГц)
+    static constexpr int FramePeriodMs = 20;
+
+    /// Слотов в кольце: 64 кадра = 1.28 с истории
+    static constexpr int Capacity = 64;
+
+    /// Максимальный размер полезной нагрузки пакета (один MTU с запасом)
+    static constexpr int MaxPacketBytes = 1500;
+
+    JitterBuffer();
+
+    /**
+     * @brief Кладет пакет в кольцо и обновляет оценку джиттера.
+     *
+     * Опоздания, дубликаты и переполнение payload отбрасываются.
+     * Скачок seq за пределы емкости кольца ресинхронизирует буфер.
+     *
+     * @param seq Номер последовательности пакета
+     * @param data Указатель на Opus данные
+     * @param len Длина данных в байтах
+     * @return true, если пакет принят в буфер
+     */
+    bool push(quint64 seq, const char* data, int len);
+
+    /** @brief Есть ли в кольце пакет под курсором воспроизведения. */
+    bool hasNext() const;
+
+    /**
+     * @brief Забирает пакет под курсором и сдвигает курсор.
+     * @param out Буфер получателя
+     * @param maxLen Емкость буфера получателя
+     * @return Длина пакета или -1, если пакета нет (курсор не сдвигается)
+     */
+    int takeNext(unsigned char* out, int maxLen);
+
+    /** @brief Сдвигает курсор без пакета (кадр ушел в PLC). */
+    void skipNext();
+
+    /**
+     * @brief Читает пакет с произвольным seq, не трогая кольцо.
+     *
+     * Нужен декодеру для in-band FEC: потерянный кадр восстанавливается
+     * из следующего пакета, который при этом остается в буфере.
+     *
+     * @param seq Номер последовательности
+     * @param out Буфер получателя
+     * @param maxLen Емкость буфера получателя
+     * @return Длина пакета или -1, если пакета нет
+     */
+    int peek(quint64 seq, unsigned char* out, int maxLen) const;
+
+    /** @brief Число пакетов, лежащих в кольце. */
+    int depth() const { return m_count; }
+
+    /**
+     * @brief Текущая целевая глубина (кадров).
+     *
+     * 1 + ceil(джиттер / 20 мс), зажатая в [MinTargetDepth, MaxTargetDepth].
+     * Все, что накапливается сверх нее, дренируется ускоренно.
+     */
+    int targetDepth() const;
+
+    /** @brief seq номер следующего кадра на воспроизведение. */
+    quint64 nextSeq() const { return m_nextSeq; }
+
+    /** @brief Сглаженная оценка межпакетного джиттера, мс. */
+    double jitterMs() const { return m_jitterMs; }
+
+    /** @brief Отброшено опоздавших пакетов. */
+    quint64 lateCount() const { return m_lateCount; }
+
+    /** @brief Отброшено дубликатов. */
+    quint64 duplicateCount() const { return m_duplicateCount; }
+
+    /** @brief Пакетов, пришедших с нарушением порядка (но не опоздавших). */
+    quint64 reorderCount() const { return m_reorderCount; }
+
+    /** @brief Полный сброс (конец звонка, ресинхронизация). */
+    void clear();
+
+private:
+    /// Нижняя граница целевой глубины: один кадр запаса всегда
+    static constexpr int MinTargetDepth = 2;
+
+    /// Верхняя граница: больше половины кольца не накапливаем
+    static constexpr int MaxTargetDepth = Capacity / 2;
+
+    /// Слот кольца: память под payload выделена один раз на весь звонок
+    struct Slot {
+        quint64 seq = 0;
+        int length = -1;                         ///< -1 — слот свободен
+        std::array<char, MaxPacketBytes> data;
+    };
+
+    Slot& slotFor(quint64 seq) { return m_slots[seq % Capacity]; }
+
+    std::vector<Slot> m_slots;      ///< Кольцо предвыделенных слотов
+    int m_count = 0;                ///< Занятых слотов
+    quint64 m_nextSeq = 0;          ///< Курсор воспроизведения
+    bool m_synced = false;          ///< Курсор привязан к потоку отправителя
+
+    QElapsedTimer m_arrivalClock;   ///< Монотонные метки прихода пакетов
+    qint64 m_lastArrivalMs = -1;    ///< Метка прихода предыдущего пакета
+    double m_jitterMs = 0.0;        ///< Сглаженный джиттер (RFC 3550, 1/16)
+
+    quint64 m_lateCount = 0;        ///< Статистика: опоздавшие
+    quint64 m_duplicateCount = 0;   ///< Статистика: дубликаты
+    quint64 m_reorderCount = 0;     ///< Статистика: вне порядка
+    quint64 m_highestSeq = 0;       ///< Максимальный принятый seq
+};
+
+#endif // JITTERBUFFER_H
@@ -0,0 +1,109 @@
+#include "netsim.h"
+#include <QSettings>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QFile>
+#include <QDebug>
+
+//См. "netsim.h"
+
+namespace NetSim {
+
+namespace {
+
+Profile loadProfile()
+{
+    Profile p;
+
+    const QByteArray path = qgetenv("MESSENGER_NETSIM");
+    if (path.isEmpty()) {
+        return p;
+    }
+    if (!QFile::exists(QString::fromLocal8Bit(path))) {
+        qWarning() << "[NetSim] Profile file not found:" << path;
+        return p;
+    }
+
+    QSettings ini(QString::fromLocal8Bit(path), QSettings::IniFormat);
+    p.seed = ini.value("sim/seed", 1).toUInt();
+    p.tcpLatencyMs = ini.value("tcp/latency_ms", 0).toInt();
+    p.tcpJitterMs = ini.value("tcp/jitter_ms", 0).toInt();
+    p.tcpRateKbps = ini.value("tcp/rate_kbps", 0).toInt();
+    p.tcpDisconnectAfterMs = ini.value("tcp/disconnect_after_ms", 0).toInt();
+    p.udpLatencyMs = ini.value("udp/latency_ms", 0).toInt();
+    p.udpJitterMs = ini.value("udp/jitter_ms", 0).toInt();
+    p.udpLossPercent = ini.value("udp/loss_percent", 0).toInt();
+    p.enabled = true;
+
+    qWarning() << "[NetSim] ⚠️ NETWORK SIMULATION ACTIVE:" << path
+               << "tcp" << p.tcpLatencyMs << "+-" << p.tcpJitterMs << "ms"
+               << p.tcpRateKbps << "kbps, drop after" << p.tcpDisconnectAfterMs << "ms;"
+               << "udp" << p.udpLatencyMs << "+-" << p.udpJitterMs << "ms"
+               << "loss" << p.udpLossPercent << "%";
+    return p;
+}
+
+/**
+ * @brief ГСЧ шима: свой на поток, зерно из профиля.
+ *
+ * TCP-врезка живет на GUI-потоке, UDP — на аудиопотоке; отдельные
+ * генераторы с фиксированным зерном делают каждый поток воспроизводимым
+ * независимо от порядка переключений между ними.
+ */
+QRandomGenerator& rng()
+{
+    thread_local QRandomGenerator gen(profile().seed);
+    return gen;
+}
+
+} // namespace
+
+const Profile& profile()
+{
+    // Читается один раз на процесс; до первого обращения из двух потоков
+    // порядок инициализации статика гарантирует язык
+    static const Profile p = loadProfile();
+    return p;
+}
+
+int tcpDelayMs(int bytes, const QElapsedTimer& clock, qint64& busyUntilMs)
+{
+    const Profile& p = profile();
+
+    int delay = p.tcpLatencyMs;
+    if (p.tcpJitterMs > 0) {
+        delay += int(rng().bounded(quint32(p.tcpJitterMs)));
+    }
+
+    // Потолок полосы: блок сериализуется bytes*8/rate миллисекунд после
+    // момента освобождения линии предыдущим блоком — порядок сохраняется
+    if (p.tcpRateKbps > 0) {
+        const qint64 now = clock.elapsed();
+        const qint64 lineFree = qMax(now, busyUntilMs);
+        const qint64 serializeMs = qint64(bytes) * 8 / p.tcpRateKbps;
+        busyUntilMs = lineFree + serializeMs;
+        delay += int(busyUntilMs - now);
+    }
+    return delay;
+}
+
+bool udpShouldDrop()
+{
+    const Profile& p = profile();
+    if (p.udpLossPercent <= 0) {
+        return false;
+    }
+    return int(rng().bounded(100u)) < p.udpLossPercent;
+}
+
+int udpDelayMs()
+{
+    const Profile& p = profile();
+    int delay = p.udpLatencyMs;
+    if (p.udpJitterMs > 0) {
+        delay += int(rng().bounded(quint32(p.udpJitterMs)));
+    }
+    return delay;
+}
+
+} // namespace NetSim
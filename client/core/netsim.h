@@ -0,0 +1,81 @@
+#ifndef NETSIM_H
+#define NETSIM_H
+
+#include <QtGlobal>
+
+class QElapsedTimer;
+
+/**
+ * @brief Симулятор плохой сети для локальных прогонов клиента.
+ *
+ * Жалобу "мессенджер тормозит на отельном Wi-Fi" невозможно воспроизвести
+ * на машине разработчика: нужны сотни миллисекунд задержки, джиттер,
+ * потери и обрывы — причем одинаковые от прогона к прогону, иначе
+ * поведение реконнекта и джиттер-буфера не сравнить до и после правки.
+ *
+ * Шим включается переменной окружения `MESSENGER_NETSIM=<путь к ini>`
+ * (по образцу MESSENGER_TRACE/MESSENGER_WAKE_AUDIT); без нее каждая
+ * точка врезки стоит одну проверку bool. Профиль условий — INI файл:
+ *
+ *     [sim]
+ *     seed = 42                 ; зерно ГСЧ: прогоны воспроизводимы
+ *     [tcp]
+ *     latency_ms = 250          ; базовая задержка записи
+ *     jitter_ms = 80            ; равномерная добавка [0..jitter)
+ *     rate_kbps = 256           ; потолок полосы (сериализация байтов)
+ *     disconnect_after_ms = 30000 ; обрыв через столько после connect
+ *     [udp]
+ *     latency_ms = 120
+ *     jitter_ms = 60
+ *     loss_percent = 15         ; доля выброшенных дейтаграмм
+ *
+ * Врезки: NetworkService придерживает склеенные блоки записи и рвет
+ * сокет по расписанию (реконнект-машина, очередь отправки), AudioEngine
+ * теряет и задерживает исходящие дейтаграммы (джиттер-буфер, FEC).
+ * Задержки моделируются на передаче: для симметричных метрик этого
+ * достаточно, а принимающая сторона остается нетронутой.
+ */
+namespace NetSim {
+
+/** @brief Параметры профиля, прочитанные из MESSENGER_NETSIM. */
+struct Profile {
+    bool enabled = false;      ///< Переменная окружения задана и файл прочитан
+    quint32 seed = 1;          ///< Зерно ГСЧ (детерминизм прогонов)
+    int tcpLatencyMs = 0;      ///< Базовая задержка записи TCP
+    int tcpJitterMs = 0;       ///< Джиттер записи TCP
+    int tcpRateKbps = 0;       ///< Потолок полосы TCP (0 — без ограничения)
+    int tcpDisconnectAfterMs = 0; ///< Обрыв после connect (0 — не рвать)
+    int udpLatencyMs = 0;      ///< Базовая задержка дейтаграмм
+    int udpJitterMs = 0;       ///< Джиттер дейтаграмм
+    int udpLossPercent = 0;    ///< Потери дейтаграмм, %
+};
+
+/** @brief Профиль процесса; грузится из файла при первом обращении. */
+const Profile& profile();
+
+/** @brief Шим включен (MESSENGER_NETSIM задана и файл прочитался). */
+inline bool enabled() { return profile().enabled; }
+
+/**
+ * @brief Задержка выдачи TCP-блока: латентность + джиттер + сериализация.
+ *
+ * Полоса моделируется "занятостью линии": каждый блок освобождает линию
+ * через bytes*8/rate после предыдущего, busyUntilMs накапливает этот
+ * момент по часам clock вызывающего. Порядок блоков сохраняется.
+ *
+ * @param bytes Размер блока
+ * @param clock Монотонные часы вызывающего (его поток)
+ * @param busyUntilMs [in/out] Момент освобождения линии по clock
+ * @return Задержка до фактической записи, мс
+ */
+int tcpDelayMs(int bytes, const QElapsedTimer& clock, qint64& busyUntilMs);
+
+/** @brief Дейтаграмму следует выбросить (потери по профилю). */
+bool udpShouldDrop();
+
+/** @brief Задержка дейтаграммы: латентность + джиттер, мс. */
+int udpDelayMs();
+
+} // namespace NetSim
+
+#endif // NETSIM_H
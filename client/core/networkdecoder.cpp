@@ -0,0 +1,302 @@
+#include "networkdecoder.h"
+#include "threadcheck.h"
+#include "cryptoutils.h"
+#include "binarycodec.h"
+#include "compression.h"
+
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+#include <QDebug>
+
+NetworkDecoder::NetworkDecoder(CryptoManager *crypto, QObject *parent)
+    : QObject(parent), m_crypto(crypto)
+{
+}
+
+void NetworkDecoder::processChunk(const QByteArray &chunk)
+{
+    THREAD_AFFINITY_ASSERT(this);
+
+    // Разбираем все полностью накопленные кадры; остаток ждет следующей
+    // порции. Кадр — представление внутрь буфера парсера (без копии),
+    // действительное до следующего append: decodeFrame потребляет его
+    // синхронно, наружу уходят уже расшифрованные байты
+    m_framer.append(chunk);
+
+    // Лимит кадра зависит от класса трафика и пересчитывается на каждой
+    // итерации: обработка рукопожатия включает шифрование внутри цикла
+    QByteArray frame;
+    while (m_framer.nextFrame(frame, m_crypto->isEncrypted()
+                                         ? FrameBuffer::SessionFrameLimit
+                                         : FrameBuffer::HandshakeFrameLimit)) {
+        decodeFrame(frame);
+    }
+
+    // Префикс длины за пределами лимита — протокол сломан (или сервер
+    // подменен): рвем соединение тем же путем, что при подделке MAC
+    if (m_framer.overflowed()) {
+        emit protocolError("Frame length prefix exceeds limit");
+        reset();
+        return;
+    }
+
+    // Все кадры обработаны — емкость, раздутую всплеском, отдаем системе
+    m_framer.trim();
+}
+
+void NetworkDecoder::reset()
+{
+    // Недособранный кадр принадлежит разорванному соединению
+    m_framer.clear();
+
+    // Ключ и режим сессии тоже: после переподключения рукопожатие идет
+    // заново, и его ответ должен разбираться как открытый текст
+    m_crypto->resetSession();
+}
+
+void NetworkDecoder::sealFrame(const QJsonObject &payload, bool binaryMode,
+                               bool background)
+{
+    // Сериализация объекта в QByteArray.
+    QByteArray jsonData = QJsonDocument(payload).toJson(QJsonDocument::Compact);
+
+    // В бинарном режиме горячие типы (typing, подтверждения доставки/прочтения)
+    // уходят компактной записью BinaryCodec — подмена полезной нагрузки до
+    // шифрования, фрейминг пакета не меняется.
+    if (binaryMode && m_crypto->isEncrypted()) {
+        const QByteArray record = BinaryCodec::encode(payload);
+        if (!record.isEmpty()) {
+            jsonData = record;
+        }
+    }
+
+    if (!m_crypto->isEncrypted()) {
+        QByteArray block;
+        QDataStream out(&block, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_2);
+        // Формируем пакет "размер (4 байта) + данные".
+        out << (quint32)0; // Резервируем место для размера.
+        out << jsonData;
+        out.device()->seek(0); // Возвращаемся в начало.
+        out << (quint32)(block.size() - sizeof(quint32)); // Записываем реальный размер.
+        qWarning() << "[NetworkDecoder] Encryption not ready! Sending plain text (UNSAFE unless handshake)";
+        emit frameSealed(block, background);
+        return;
+    }
+
+    // Потоковый AEAD: подключ направления уже развернут на рукопожатии,
+    // nonce — внутренний счетчик контекста, префикс длины аутентифицирован
+    if (m_crypto->isStreamMode()) {
+        emit frameSealed(m_crypto->sealStreamFrame(jsonData), background);
+        return;
+    }
+
+    emit frameSealed(sealLegacyPacket(jsonData), background);
+}
+
+void NetworkDecoder::sealRawFrame(const QByteArray &payload, bool background)
+{
+    // Чанки файлового канала никогда не ходят открытым текстом: сервер
+    // такой кадр все равно отвергнет, а ронять соединение из-за гонки
+    // с рукопожатием не нужно — загрузчик повторит передачу
+    if (!m_crypto->isEncrypted()) {
+        qWarning() << "[NetworkDecoder] Dropping raw frame: encryption not ready";
+        return;
+    }
+
+    if (m_crypto->isStreamMode()) {
+        emit frameSealed(m_crypto->sealStreamFrame(payload), background);
+        return;
+    }
+
+    emit frameSealed(sealLegacyPacket(payload), background);
+}
+
+QByteArray NetworkDecoder::sealLegacyPacket(const QByteArray &data)
+{
+    // ================= ШИФРОВАНИЕ (XChaCha20) =================
+
+    // Генерируем случайный Nonce (24 байта = 6 штук по 4 байта)
+    uint8_t nonce[24];
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(nonce), 24 / 4);
+
+    // Буфер: MAC (16 байт) + Ciphertext (N байт)
+    QByteArray encryptedData;
+    encryptedData.resize(16 + data.size());
+
+    // crypto_lock(mac, ciphertext, key, nonce, data, size)
+    crypto_aead_lock(
+        reinterpret_cast<uint8_t*>(encryptedData.data()) + 16, // Ciphertext (выход)
+        reinterpret_cast<uint8_t*>(encryptedData.data()),      // MAC (выход, 16 байт)
+        m_crypto->getSessionKey(),                             // Key (32 байта)
+        nonce,                                                 // Nonce (24 байта)
+        nullptr, 0,                                            // Associated Data (нет)
+        reinterpret_cast<const uint8_t*>(data.constData()),    // Message (вход)
+        data.size()                                            // Message length
+        );
+
+    // ================= УПАКОВКА (TCP Framing) =================
+    // Структура: [Length 4b] [Nonce 24b] [MAC 16b + Ciphertext]
+    QByteArray packet;
+    QDataStream out(&packet, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_2);
+    out << (quint32)0; // Резервируем место под длину
+    out << QByteArray(reinterpret_cast<const char*>(nonce), 24);
+    out << encryptedData;
+    out.device()->seek(0);
+    out << (quint32)(packet.size() - sizeof(quint32));
+
+    return packet;
+}
+
+void NetworkDecoder::decodeFrame(const QByteArray &frame)
+{
+    QDataStream in(frame);
+    in.setVersion(QDataStream::Qt_6_2);
+
+    // До рукопожатия кадры идут открытым текстом
+    if (!m_crypto->isEncrypted()) {
+        QByteArray jsonData;
+        in >> jsonData;
+
+        QJsonDocument doc = QJsonDocument::fromJson(jsonData);
+        if (doc.isNull() || !doc.isObject()) {
+            qWarning() << "[NetworkDecoder] Failed to parse plaintext frame";
+            return;
+        }
+
+        QJsonObject object = doc.object();
+
+        // Рукопожатие: вычисляем общий ключ прямо здесь, до выдачи объекта —
+        // следующий кадр в очереди может быть уже зашифрован, и ждать,
+        // пока GUI-поток обработает handshake, нельзя
+        if (object["type"].toString() == "handshake") {
+            const QByteArray serverKey =
+                QByteArray::fromBase64(object["key"].toString().toLatin1());
+            m_crypto->computeSharedSecret(serverKey);
+            qInfo() << "[NetworkDecoder] Session key established, switching to encrypted mode";
+
+            // Сервер подтвердил потоковый AEAD: развертываем подключи
+            // направлений здесь же — следующий кадр уже идет счетчиком
+            if (object["aead"].toInt() == 2) {
+                m_crypto->enableStreamMode(false);
+                qInfo() << "[NetworkDecoder] Stream AEAD enabled (per-direction subkeys, counter nonces)";
+            }
+        }
+
+        emit objectDecoded(object);
+        return;
+    }
+
+    // Потоковый AEAD: тело кадра — [MAC 16b][ciphertext], nonce неявный
+    if (m_crypto->isStreamMode()) {
+        QByteArray decrypted;
+        if (!m_crypto->openStreamBody(frame, decrypted)) {
+            emit protocolError("Decryption failed: MAC mismatch (stream)");
+            reset();
+            return;
+        }
+        dispatchPayload(std::move(decrypted));
+        return;
+    }
+
+    // Зашифрованный кадр: [nonce 24b][MAC 16b + ciphertext]
+    QByteArray nonceArray;
+    QByteArray encryptedData;
+    in >> nonceArray;
+    in >> encryptedData;
+
+    if (nonceArray.size() != 24) {
+        emit protocolError(QString("Invalid nonce size: %1").arg(nonceArray.size()));
+        reset();
+        return;
+    }
+    if (encryptedData.size() < 16) {
+        emit protocolError("Encrypted data too short");
+        reset();
+        return;
+    }
+
+    const uint8_t *nonce = reinterpret_cast<const uint8_t*>(nonceArray.constData());
+    const uint8_t *mac = reinterpret_cast<const uint8_t*>(encryptedData.constData());
+    const uint8_t *cipherText = mac + 16;
+
+    const int textLen = encryptedData.size() - 16;
+    QByteArray decrypted(textLen, Qt::Uninitialized);
+
+    // crypto_unlock(plaintext, key, nonce, mac, ciphertext, size)
+    // Возвращает 0 при успехе, ненулевое при ошибке (подделка)
+    int status = crypto_aead_unlock(
+        reinterpret_cast<uint8_t*>(decrypted.data()),
+        mac,
+        m_crypto->getSessionKey(),
+        nonce,
+        nullptr, 0,
+        cipherText,
+        textLen
+        );
+
+    if (status != 0) {
+        emit protocolError("Decryption failed: MAC mismatch");
+        reset();
+        return;
+    }
+
+    dispatchPayload(std::move(decrypted));
+}
+
+void NetworkDecoder::dispatchPayload(QByteArray decrypted)
+{
+    // Сжатая запись (первый байт — Magic сжатия): распаковываем и дальше
+    // различаем содержимое как обычно — внутри может быть и JSON,
+    // и бинарная запись.
+    if (Compression::isCompressed(decrypted)) {
+        const QByteArray unpacked = Compression::unwrap(decrypted);
+        if (unpacked.isEmpty()) {
+            qCritical() << "[NetworkDecoder] Failed to decompress server payload!";
+            return;
+        }
+        decrypted = unpacked;
+    }
+
+    // Бинарная запись согласованного протокола (первый байт — Magic)
+    // декодируется без JSON-парсера; подписчикам уходит обычный QJsonObject.
+    if (BinaryCodec::isBinary(decrypted)) {
+        QJsonObject record = BinaryCodec::decode(decrypted);
+        if (!record.isEmpty()) {
+            emit objectDecoded(record);
+        }
+        return;
+    }
+
+    // Парсим JSON из расшифрованных байт
+    QJsonDocument doc = QJsonDocument::fromJson(decrypted);
+    if (doc.isNull() || !doc.isObject()) {
+        qDebug() << "[NetworkDecoder] Failed to parse JSON or it's not an object.";
+        return;
+    }
+
+    QJsonObject response = doc.object();
+    const QString type = response["type"].toString();
+
+    // Подтверждение бинарного режима — деталь транспорта: сообщаем
+    // NetworkService (флаг используется на пути отправки) и не пускаем
+    // объект до логики приложения.
+    if (type == "binary_mode_ack") {
+        emit binaryModeEnabled(response["version"].toInt());
+        return;
+    }
+
+    // Подтверждение сжатия тоже деталь транспорта: сжимает только сервер,
+    // клиенту достаточно знать, что распаковка может понадобиться.
+    if (type == "compression_ack") {
+        qInfo() << "[NetworkDecoder] Response compression enabled ("
+                << response["algorithm"].toString() << ", min"
+                << response["min_size"].toInt() << "bytes)";
+        return;
+    }
+
+    // Передаем объект в GUI-поток через очередь событий
+    emit objectDecoded(response);
+}
@@ -0,0 +1,118 @@
+#ifndef NETWORKDECODER_H
+#define NETWORKDECODER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QJsonObject>
+#include "framebuffer.h"
+
+class CryptoManager;
+
+/**
+ * @brief Декодер входящего потока, работающий в отдельном потоке.
+ *
+ * Принимает сырые байты из сокета (NetworkService отдает их сразу после
+ * readAll) и выполняет всю тяжелую часть приема: сборку кадров по длине,
+ * расшифровку XChaCha20, распаковку сжатых ответов, декодирование
+ * бинарных записей и разбор JSON. Раньше все это происходило в GUI-потоке,
+ * и залп ответов при входе (контакты, счетчики, офлайн-сообщения)
+ * замораживал окно на сотни миллисекунд.
+ *
+ * Готовые QJsonObject уходят сигналом objectDecoded через очередь
+ * событий обратно в GUI-поток. Рукопожатие обрабатывается на месте:
+ * общий ключ вычисляется до выдачи объекта наверх, чтобы следующий же
+ * зашифрованный кадр в очереди декодера уже можно было расшифровать.
+ *
+ * Исходящий трафик собирается здесь же (sealFrame): сериализация,
+ * шифрование и фрейминг крупных запросов не занимают GUI-поток, а
+ * единая очередь сигналов сохраняет порядок кадров. Заодно исчезает
+ * гонка с переключением в шифрованный режим: флаг меняется в этом же
+ * потоке при обработке рукопожатия.
+ */
+class NetworkDecoder : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief Конструктор декодера.
+     * @param crypto Менеджер шифрования, общий с NetworkService
+     * @param parent Родительский объект (обычно nullptr: объект переезжает в поток)
+     */
+    explicit NetworkDecoder(CryptoManager *crypto, QObject *parent = nullptr);
+
+public slots:
+    /**
+     * @brief Принимает очередную порцию байтов из сокета.
+     *
+     * Добавляет данные в буфер и разбирает все полностью накопленные кадры.
+     */
+    void processChunk(const QByteArray &chunk);
+
+    /** @brief Сбрасывает состояние сборки кадров (при разрыве соединения). */
+    void reset();
+
+    /**
+     * @brief Собирает готовый к отправке кадр: сериализация, шифрование, фрейминг.
+     *
+     * Выполняется в потоке декодера; готовый пакет возвращается сигналом
+     * frameSealed в GUI-поток, где NetworkService ставит его в очередь записи.
+     *
+     * @param payload JSON-объект (уже с трассировочными полями, если включены)
+     * @param binaryMode Бинарный протокол согласован (горячие типы — BinaryCodec)
+     * @param background Кадр относится к фоновому трафику (квитанции, typing)
+     */
+    void sealFrame(const QJsonObject &payload, bool binaryMode, bool background);
+
+    /**
+     * @brief Запечатывает сырую полезную нагрузку (чанк файлового канала).
+     *
+     * В отличие от sealFrame, нагрузка не сериализуется и не проходит
+     * BinaryCodec — это уже готовая бинарная запись с собственным
+     * magic-байтом. Шифрование и фрейминг те же, и выполнение в потоке
+     * декодера сохраняет порядок кадров относительно sealFrame.
+     * До рукопожатия кадр отбрасывается: файловый канал работает только
+     * по шифрованному соединению.
+     *
+     * @param payload Готовая бинарная запись (заголовок чанка + данные)
+     * @param background Кадр фонового приоритета
+     */
+    void sealRawFrame(const QByteArray &payload, bool background);
+
+signals:
+    /** @brief Разобранный объект протокола (доставляется в GUI-поток очередью). */
+    void objectDecoded(const QJsonObject &object);
+
+    /**
+     * @brief Готовый кадр на отправку (вид [длина][nonce][MAC+ciphertext]).
+     * @param packet Кадр для записи в сокет
+     * @param background Кадр фонового приоритета
+     */
+    void frameSealed(const QByteArray &packet, bool background);
+
+    /** @brief Сервер подтвердил бинарный протокол указанной версии. */
+    void binaryModeEnabled(int version);
+
+    /** @brief Фатальная ошибка протокола (неверный nonce, подделка MAC). */
+    void protocolError(const QString &reason);
+
+private:
+    /** @brief Разбирает один полный кадр (расшифровка, распаковка, парсинг). */
+    void decodeFrame(const QByteArray &frame);
+
+    /** @brief Собирает кадр легаси-режима: случайный nonce, XChaCha20. */
+    QByteArray sealLegacyPacket(const QByteArray &data);
+
+    /**
+     * @brief Разбирает расшифрованную полезную нагрузку кадра.
+     *
+     * Общий хвост обоих режимов шифрования: распаковка сжатия,
+     * декодирование бинарной записи, парсинг JSON и перехват
+     * транспортных подтверждений (binary_mode_ack, compression_ack).
+     */
+    void dispatchPayload(QByteArray decrypted);
+
+    CryptoManager *m_crypto; ///< Общий менеджер шифрования (ключ сессии)
+    FrameBuffer m_framer;    ///< Сборка кадров без копий (общий формат с сервером)
+};
+
+#endif // NETWORKDECODER_H
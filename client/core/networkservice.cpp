@@ -1,102 +1,348 @@
 #include "networkservice.h"
+#include "netsim.h"
+
+#ifdef Q_OS_UNIX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+#include "networkdecoder.h"
 #include <QTcpSocket>
-#include <QDataStream>
-#include <QJsonDocument>
+#include <QDateTime>
 #include <QDebug>
+#include <QJsonDocument>
 #include <QRandomGenerator>
+#include <QTimer>
+#include <QNetworkInformation>
 
 NetworkService::NetworkService(QObject *parent)
-    : QObject(parent), m_socket(new QTcpSocket(this)), m_nextBlockSize(0), m_crypto(new CryptoManager())
+    : NetworkService(nullptr, parent)
+{
+}
+
+NetworkService::NetworkService(QThread* sharedDecoderThread, QObject *parent)
+    : QObject(parent), m_socket(new QTcpSocket(this)), m_crypto(new CryptoManager())
 {
     // Связь: подключение, чтение и отключение сокета — на внутренние обработчики
     connect(m_socket, &QTcpSocket::connected, this, &NetworkService::onConnected);
     connect(m_socket, &QTcpSocket::readyRead, this, &NetworkService::onReadyRead);
     connect(m_socket, &QTcpSocket::disconnected, this, &NetworkService::onDisconnected);
+
+    // Неудачный connect() не порождает disconnected() — ошибки сокета
+    // ведут в ту же точку планирования реконнекта
+    connect(m_socket, &QAbstractSocket::errorOccurred,
+            this, &NetworkService::onSocketError);
+
+    // Таймер очередной попытки реконнекта (одновыстрельный, с джиттером)
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout,
+            this, &NetworkService::attemptReconnect);
+
+    // Смена доступности сети — повод не ждать хвост экспоненциальной
+    // задержки: маршрут вернулся, пробуем сразу. Бэкенд опционален
+    // (на платформах без него реконнект работает по одному таймеру).
+    if (QNetworkInformation::loadBackendByFeatures(
+            QNetworkInformation::Feature::Reachability)) {
+        connect(QNetworkInformation::instance(),
+                &QNetworkInformation::reachabilityChanged,
+                this, &NetworkService::onReachabilityChanged);
+    }
+
+    // Декодер входящего трафика живет в отдельном потоке: сборка кадров,
+    // расшифровка и парсинг JSON не блокируют GUI. Создается без родителя
+    // (иначе moveToThread невозможен) и удаляется при остановке потока.
+    m_decoder = new NetworkDecoder(m_crypto);
+    m_ownsDecoderThread = (sharedDecoderThread == nullptr);
+    QThread* decoderHost = m_ownsDecoderThread ? &m_decoderThread
+                                               : sharedDecoderThread;
+    m_decoder->moveToThread(decoderHost);
+    connect(decoderHost, &QThread::finished, m_decoder, &QObject::deleteLater);
+
+    // Сырые байты уходят декодеру очередью; готовые объекты возвращаются
+    // в GUI-поток и публикуются прежним сигналом jsonReceived
+    connect(this, &NetworkService::rawDataReceived, m_decoder, &NetworkDecoder::processChunk);
+    connect(m_decoder, &NetworkDecoder::objectDecoded, this, &NetworkService::jsonReceived);
+
+    // Исходящие кадры тоже собираются в потоке декодера: сериализация,
+    // шифрование и фрейминг не занимают GUI-поток, готовый пакет
+    // возвращается сюда и встает в очередь записи. Единая очередь
+    // сигналов сохраняет порядок отправки.
+    connect(this, &NetworkService::sealRequested, m_decoder, &NetworkDecoder::sealFrame);
+    connect(this, &NetworkService::sealRawRequested, m_decoder, &NetworkDecoder::sealRawFrame);
+    connect(m_decoder, &NetworkDecoder::frameSealed, this, &NetworkService::onFrameSealed);
+
+    // Подтверждение бинарного режима влияет на путь отправки — флаг живет здесь
+    connect(m_decoder, &NetworkDecoder::binaryModeEnabled, this, [this](int version) {
+        m_binaryMode = true;
+        qInfo() << "[NetworkService] Binary protocol enabled (version" << version << ")";
+    });
+
+    // Ошибка протокола (подделка MAC, битый кадр) — рвем соединение
+    connect(m_decoder, &NetworkDecoder::protocolError, this, [this](const QString& reason) {
+        qCritical() << "[NetworkService] Protocol error:" << reason << "- aborting connection";
+        m_socket->abort();
+    });
+
+    if (m_ownsDecoderThread) {
+        m_decoderThread.setObjectName("client-net-decode");
+        m_decoderThread.start();
+    }
+
+    // Трассировка сквозной задержки: при MESSENGER_TRACE=1 исходящие запросы
+    // получают корреляционный ID и метку отправки (см. sendJson); сервер
+    // возвращает свои метки времени, DataService печатает итоговые дельты.
+    m_traceEnabled = qEnvironmentVariableIntValue("MESSENGER_TRACE") == 1;
+    if (m_traceEnabled) {
+        m_tracePrefix = QString::number(QRandomGenerator::global()->generate(), 16);
+        qInfo() << "[NetworkService] Latency tracing enabled, trace prefix:" << m_tracePrefix;
+    }
+
+    // Симулятор плохой сети (MESSENGER_NETSIM=<профиль.ini>): часы для
+    // модели занятости линии (потолок полосы в NetSim::tcpDelayMs)
+    if (NetSim::enabled()) {
+        m_simClock.start();
+    }
 }
 
 
 void NetworkService::connectToServer(const QString& host, quint16 port) {
     qDebug() << "[NetworkService] Attempting to connect to" << host << ":" << port;
+
+    // Явное подключение (старт, логаут): прежняя офлайн-очередь и счетчик
+    // попыток принадлежат прошлой сессии
+    m_host = host;
+    m_port = port;
+    m_reconnectAttempt = 0;
+    m_reconnectTimer->stop();
+    m_offlinePayloads.clear();
+
+    setState(ConnectionState::Connecting);
     m_socket->connectToHost(host, port);
 }
 
 
+void NetworkService::setState(ConnectionState state)
+{
+    if (m_state == state) return;
+    m_state = state;
+    emit connectionStateChanged(state);
+}
+
+
+void NetworkService::scheduleReconnect()
+{
+    if (m_host.isEmpty()) return;          // connectToServer еще не вызывался
+    if (m_reconnectTimer->isActive()) return; // Попытка уже запланирована
+
+    setState(ConnectionState::Reconnecting);
+
+    // Экспонента с потолком; задержка берется случайно из верхней половины
+    // интервала — сотни клиентов после общего моргания сети расползаются
+    // по времени, а не бьют в сервер синхронной волной
+    const int exponent = qMin(m_reconnectAttempt, 6);
+    const int ceiling = qMin(ReconnectBaseMs << exponent, ReconnectMaxMs);
+    const int delayMs = QRandomGenerator::global()->bounded(ceiling / 2, ceiling + 1);
+    ++m_reconnectAttempt;
+
+    qInfo() << "[NetworkService] Reconnect attempt" << m_reconnectAttempt
+            << "scheduled in" << delayMs << "ms";
+    m_reconnectTimer->start(delayMs);
+}
+
+
+void NetworkService::attemptReconnect()
+{
+    if (m_state != ConnectionState::Reconnecting) return;
+
+    qDebug() << "[NetworkService] Reconnecting to" << m_host << ":" << m_port;
+    m_socket->abort(); // Сбрасываем возможное зависшее состояние сокета
+    m_socket->connectToHost(m_host, m_port);
+}
+
+
+void NetworkService::onSocketError()
+{
+    qWarning() << "[NetworkService] Socket error:" << m_socket->errorString();
+
+    // Ошибка на живом соединении дойдет сюда же через onDisconnected;
+    // здесь важен случай неудачной попытки connect()
+    if (m_state == ConnectionState::Connecting
+        || m_state == ConnectionState::Reconnecting) {
+        scheduleReconnect();
+    }
+}
+
+
+void NetworkService::onReachabilityChanged()
+{
+    if (m_state != ConnectionState::Reconnecting) return;
+    if (QNetworkInformation::instance()->reachability()
+        != QNetworkInformation::Reachability::Online) {
+        return;
+    }
+
+    // Маршрут вернулся: сбрасываем экспоненту и пробуем немедленно
+    qInfo() << "[NetworkService] Network is back, retrying immediately";
+    m_reconnectAttempt = 0;
+    m_reconnectTimer->stop();
+    attemptReconnect();
+}
+
+
+void NetworkService::onSessionEstablished()
+{
+    if (m_offlinePayloads.isEmpty()) return;
+
+    // Сессия восстановлена (вход выполнен, канал зашифрован ключом живой
+    // сессии) — выталкиваем накопленное за время разрыва в исходном порядке
+    qInfo() << "[NetworkService] Session established, flushing"
+            << m_offlinePayloads.size() << "queued message(s)";
+    const QList<QJsonObject> pending = std::move(m_offlinePayloads);
+    m_offlinePayloads.clear();
+    for (const QJsonObject& payload : pending) {
+        sendJson(payload);
+    }
+}
+
+
 void NetworkService::sendJson(const QJsonObject& json)
 {
+    // Соединения нет — удерживаем сообщение до восстановления сессии.
+    // Запечатывать сейчас нельзя: ключ принадлежит мертвой сессии. Статус
+    // печати не переживает паузу и отбрасывается; очередь ограничена,
+    // при переполнении уходит самое старое.
+    if (m_state != ConnectionState::Connected) {
+        const QString type = json["type"].toString();
+        if (type == QLatin1String("typing")) return;
+
+        if (m_offlinePayloads.size() >= OfflineQueueLimit) {
+            qWarning() << "[NetworkService] Offline queue full, dropping oldest message";
+            m_offlinePayloads.removeFirst();
+        }
+        m_offlinePayloads.append(json);
+        qDebug() << "[NetworkService] Queued" << type << "until reconnect ("
+                 << m_offlinePayloads.size() << "pending)";
+        return;
+    }
+
     qDebug() << "---------------------------------";
     qDebug() << "[NetworkService] Preparing to send JSON of type:" << json["type"].toString();
     qDebug() << "[NetworkService]" << json;
     qDebug() << "[NetworkService] Full JSON content:" << json;
     qDebug() << "---------------------------------";
 
-    // Сериализация объекта в QByteArray.
-    QByteArray jsonData = QJsonDocument(json).toJson(QJsonDocument::Compact);
-    if (!m_crypto->isEncrypted()) {
-        QByteArray block;
-        QDataStream out(&block, QIODevice::WriteOnly);
-        out.setVersion(QDataStream::Qt_6_2);
-        // Формируем пакет "размер (4 байта) + данные".
-        out << (quint32)0; // Резервируем место для размера.
-        out << jsonData;
-        out.device()->seek(0); // Возвращаемся в начало.
-        out << (quint32)(block.size() - sizeof(quint32)); // Записываем реальный размер.
-        m_socket->write(block);
-        qDebug() << "JSON send" << jsonData.size();
-        qWarning() << "Encryption not ready! Sending plain text (UNSAFE unless handshake)";
-        return;
+    // Трассировка: корреляционный ID и метка отправки. Копия объекта
+    // неявно разделяема и при выключенной трассировке ничего не стоит.
+    QJsonObject payload = json;
+    if (m_traceEnabled && !payload.contains("trace_id")) {
+        payload["trace_id"] =
+            m_tracePrefix + QLatin1Char('-') + QString::number(++m_traceCounter);
+        payload["trace_sent_ms"] =
+            static_cast<double>(QDateTime::currentMSecsSinceEpoch());
     }
-    // ================= ШИФРОВАНИЕ (XChaCha20) =================
-
-    // 3. Генерируем случайный Nonce (24 байта)
-    uint8_t nonce[24];// Приводим к quint32* (поскольку 24 байта = 6 штук по 4 байта)
-    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(nonce), 24 / 4);
 
+    // Сборка кадра (сериализация, шифрование, фрейминг) уходит в поток
+    // декодера; готовый пакет вернется в onFrameSealed и встанет в
+    // очередь отправки по приоритету
+    emit sealRequested(payload, m_binaryMode,
+                       isBackgroundType(json["type"].toString()));
+}
 
-    // 4. Подготовка буфера: MAC (16 байт) + Ciphertext (N байт)
-    QByteArray encryptedData;
-    encryptedData.resize(16 + jsonData.size());
-
-    // 5. Шифруем
-    // crypto_lock(mac, ciphertext, key, nonce, jsonData, size)
-    crypto_aead_lock(
-        reinterpret_cast<uint8_t*>(encryptedData.data()) + 16, // Ciphertext (выход)
-        reinterpret_cast<uint8_t*>(encryptedData.data()),      // MAC (выход, 16 байт)
-        m_crypto->getSessionKey(),                               // Key (32 байта)
-        nonce,                                                 // Nonce (24 байта)
-        nullptr, 0,                                            // Associated Data (нет)
-        reinterpret_cast<const uint8_t*>(jsonData.constData()), // Message (вход)
-        jsonData.size()                                      // Message length
-        );
-
+void NetworkService::sendFileChunk(const QByteArray& chunk)
+{
+    // Чанки не копятся в офлайн-очереди: после реконнекта сервер выдаст
+    // точное смещение докачки, и загрузчик продолжит с него
+    if (m_state != ConnectionState::Connected) {
+        return;
+    }
 
-    // ================= УПАКОВКА (TCP Framing) =================
+    // Фоновый приоритет: кадры чанков уступают место интерактивному
+    // трафику, и отправка файла не задерживает сообщения
+    emit sealRawRequested(chunk, true);
+}
 
-    QByteArray packet;
-    QDataStream out(&packet, QIODevice::WriteOnly);
-    out.setVersion(QDataStream::Qt_6_2);
+void NetworkService::onFrameSealed(const QByteArray& packet, bool background)
+{
+    // Ставим кадр в очередь по приоритету: фоновый трафик (квитанции,
+    // typing) уступает интерактивному
+    if (background) {
+        m_backgroundQueue.append(packet);
+    } else {
+        m_interactiveQueue.append(packet);
+    }
+    m_queuedBytes += packet.size();
+    emit bytesQueuedChanged(bytesQueued());
+
+    // Откладываем запись до возврата в цикл событий: серия кадров подряд
+    // (например, отметка чата прочитанным) склеивается в один write
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QTimer::singleShot(0, this, &NetworkService::flushSendQueue);
+    }
+}
 
+bool NetworkService::isBackgroundType(const QString& type)
+{
+    // Квитанции и статус печати не критичны к задержке: пользователь
+    // их не ждет, в отличие от собственных сообщений и запросов
+    return type == QLatin1String("message_read")
+        || type == QLatin1String("message_delivered")
+        || type == QLatin1String("typing");
+}
 
-    // Структура: [Length 4b] [Nonce 24b] [MAC 16b + Ciphertext]
+qint64 NetworkService::bytesQueued() const
+{
+    // Очередь отправки плюс то, что сокет еще не вытолкнул в сеть
+    return m_queuedBytes + (m_socket ? m_socket->bytesToWrite() : 0);
+}
 
-    // 1. Резервируем место под длину (4 байта)
-    out << (quint32)0;
+void NetworkService::flushSendQueue()
+{
+    m_flushScheduled = false;
 
-    // 2. Пишем Nonce
-    out << QByteArray(reinterpret_cast<const char*>(nonce), 24);
-    qDebug() << "Client nonce" <<  QByteArray((char*)nonce, 24).toHex();
-    // 3. Пишем зашифрованные данные (включая MAC в начале)
-    out << encryptedData;
+    if (m_interactiveQueue.isEmpty() && m_backgroundQueue.isEmpty()) {
+        return;
+    }
 
-    // 4. Возвращаемся в начало и пишем реальную длину пакета
-    out.device()->seek(0);
-    // Размер = Nonce(24) + MAC(16) + TextLen
-    quint32 totalSize = packet.size() - sizeof(quint32);
-    out << totalSize;
+    // Склеиваем накопленные кадры в один буфер: интерактивные первыми,
+    // фоновые следом — и отдаем сокету единственным write
+    QByteArray block;
+    block.reserve(int(m_queuedBytes));
+    for (const QByteArray& packet : std::as_const(m_interactiveQueue)) {
+        block.append(packet);
+    }
+    for (const QByteArray& packet : std::as_const(m_backgroundQueue)) {
+        block.append(packet);
+    }
 
-    // Отправляем в сеть
-    m_socket->write(packet);
-    qDebug() << totalSize;
+    const int frames = m_interactiveQueue.size() + m_backgroundQueue.size();
+    m_interactiveQueue.clear();
+    m_backgroundQueue.clear();
+    m_queuedBytes = 0;
+
+    if (Q_UNLIKELY(NetSim::enabled())) {
+        // Блок придерживается на смоделированную задержку и сериализацию
+        // полосы; порядок блоков модель сохраняет (занятость линии)
+        const int delayMs = NetSim::tcpDelayMs(block.size(), m_simClock, m_simBusyUntilMs);
+        QTimer::singleShot(delayMs, this, [this, block]() {
+            if (m_socket && m_socket->state() == QAbstractSocket::ConnectedState) {
+                m_socket->write(block);
+            }
+        });
+    } else {
+        m_socket->write(block);
+    }
+    qDebug() << "[NetworkService] Flushed" << frames << "frames in one write,"
+             << block.size() << "bytes";
+    emit bytesQueuedChanged(bytesQueued());
+}
 
+void NetworkService::stageResumeTicket(const QByteArray& serverResumeKey,
+                                       const QJsonObject& loginBundle)
+{
+    m_resumeServerKey = serverResumeKey;
+    m_resumeBundle = loginBundle;
 }
 
 void NetworkService::sendClientPublicKey() {
@@ -104,129 +350,116 @@ void NetworkService::sendClientPublicKey() {
     json["type"] = "handshake";
     // Преобразуем ключ (32 байта) в Base64 или Hex строку для JSON
     json["key"] = QString::fromLatin1(QByteArray((const char*)m_crypto->getMyPublicKey(), 32).toBase64());
+
+    // Предлагаем потоковый AEAD (версия 2): подключи направлений и счетчик
+    // вместо случайного nonce в каждом кадре. Старый сервер поле
+    // игнорирует, и сессия остается на прежнем формате кадров.
+    json["aead"] = 2;
+
+    // 0-RTT возобновление: подготовленный token_login уезжает прямо в кадре
+    // рукопожатия, запечатанный одноразовым ключом от кэшированного
+    // резюм-ключа сервера. Сервер, расшифровав, отвечает рукопожатием и
+    // login_success с дельта-синхронизацией одним полетом — вместо трех
+    // последовательных обменов connect -> handshake -> token_login.
+    if (!m_resumeServerKey.isEmpty() && !m_resumeBundle.isEmpty()) {
+        const QByteArray plaintext =
+            QJsonDocument(m_resumeBundle).toJson(QJsonDocument::Compact);
+        const QByteArray sealed =
+            m_crypto->sealResumeTicket(m_resumeServerKey, plaintext);
+        if (!sealed.isEmpty()) {
+            json["resume"] = QString::fromLatin1(sealed.toBase64());
+            qInfo() << "[NetworkService] Resume ticket attached to handshake (0-RTT login)";
+        }
+        // Пакет одноразовый: при устаревшем ключе сервера обычный вход
+        // обновит кэш для следующего запуска
+        m_resumeServerKey.clear();
+        m_resumeBundle = QJsonObject();
+    }
+
     sendJson(json);
 }
 
 void NetworkService::onConnected() {
     qDebug() << "[NetworkService] Socket connected.";
+    tuneSocket();
+    setState(ConnectionState::Connected);
+    m_reconnectAttempt = 0;
+    m_reconnectTimer->stop();
+
+    // Смоделированный обрыв: через заданное время после установления
+    // соединения сокет рвется — реконнект-машина и возобновление сессии
+    // прогоняются по кругу с воспроизводимым периодом
+    if (Q_UNLIKELY(NetSim::enabled()) && NetSim::profile().tcpDisconnectAfterMs > 0) {
+        QTimer::singleShot(NetSim::profile().tcpDisconnectAfterMs, m_socket, [this]() {
+            qWarning() << "[NetSim] Simulated disconnect";
+            m_socket->abort();
+        });
+    }
+
     sendClientPublicKey();
     emit connected();
 }
 
-
-void NetworkService::onDisconnected() {
-    qDebug() << "[NetworkService] Socket disconnected.";
-    emit disconnected();
+void NetworkService::tuneSocket()
+{
+    // Nagle выключен: интерактивные кадры (typing, квитанции) не ждут ACK
+    // ради доклейки, а батчинг и так делает flushSendQueue одним write
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    // Быстрый keepalive: NAT домашних роутеров забывает простаивающие
+    // соединения за минуты; таймеры зондов уточняются ниже, где ОС
+    // это позволяет
+    m_socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+
+    // Буферы под окно файлового канала: сотни килобайт чанков в полете
+    m_socket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption,
+                              512 * 1024);
+    m_socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption,
+                              512 * 1024);
+
+#ifdef Q_OS_UNIX
+    const int fd = static_cast<int>(m_socket->socketDescriptor());
+    if (fd >= 0) {
+#ifdef TCP_KEEPIDLE
+        const int idle = 60;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#endif
+#ifdef TCP_KEEPINTVL
+        const int interval = 20;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+#endif
+#ifdef TCP_KEEPCNT
+        const int count = 4;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+    }
+#endif
 }
 
 
-void NetworkService::onReadyRead(){
-    QDataStream in(m_socket);
-    in.setVersion(QDataStream::Qt_6_2);
-
-    while(true) {
-
-        // Если пока не знаем размер блока — проверяем его наличие
-        if (m_nextBlockSize == 0) {
-            if (m_socket->bytesAvailable() < (qint64)sizeof(qint32)) {
-                break;  // Ещё не пришёл весь размер блока
-            }
-            // Получаем размер следующего блока
-            in >> m_nextBlockSize;
-        }
-
-        // Ждём появления полного тела сообщения
-        if (m_socket->bytesAvailable() < m_nextBlockSize) {
-            break;  // Данных пока недостаточно — ждём
-        }
-
-        if (!m_crypto->isEncrypted()) {
-            QByteArray jsonData;
-            in >> jsonData;
-            m_nextBlockSize = 0; // Сбрасываем размер для следующей итерации.
-
-            // Фаза 3: Парсинг и маршрутизация.
-            QJsonDocument doc = QJsonDocument::fromJson(jsonData);
-
-            if (!doc.isNull() && doc.isObject()) {
-                emit jsonReceived(doc.object());
-                //processJsonRequest(doc.object(), socket);
-                continue;
-            } else {
-                QString type = doc.object()["type"].toString();
-                qWarning() << "[CLIENT] Unknown request type received:" << type;
-                //sendJson({{"type", "error"}, {"reason", "Unknown command: " + type}});
-            }
-            return;
-            //continue;  // НЕ return! Продолжаем обработку буфера
-        }
-
-
-        //QByteArray data = socket->read(nextBlockSize);
-        QByteArray encryptedData;
-        QByteArray nonceArray;
-        in >> nonceArray;          // Читает [size:4b][24 bytes]
-        in >> encryptedData;                // Читает [size:4b][MAC+cipher]
-
-
-        if (nonceArray.size() != 24) {
-            qCritical() << "Invalid nonce size:" << nonceArray.size();
-            m_socket->abort();
-            return;
-        }
-
-        if (encryptedData.size() < 16) {
-            qCritical() << "Encrypted data too short!";
-            m_socket->abort();
-            return;
-        }
-
-        // Извлекаем части
-        const uint8_t* nonce = reinterpret_cast<const uint8_t*>(nonceArray.constData());
-        const uint8_t* mac   = reinterpret_cast<const uint8_t*>(encryptedData.constData());
-        const uint8_t* cipherText = mac + 16;
-
-        qDebug() << "Server Nonce:" << QByteArray((char*)nonce, 24).toHex();
-
-
-        int textLen = encryptedData.size() - 16;
-        QByteArray decrypted(textLen, Qt::Uninitialized);
-
-        // crypto_unlock(plaintext, key, nonce, mac, ciphertext, size)
-        // Возвращает 0 при успехе, ненулевое при ошибке (подделка)
-        int status = crypto_aead_unlock(
-            reinterpret_cast<uint8_t*>(decrypted.data()), // Plaintext (выход)
-            mac,                                          // MAC (вход, 16 байт)
-            m_crypto->getSessionKey(),                      // Key (32 байта)
-            nonce,                                        // Nonce (24 байта)
-            nullptr, 0,                                   // Associated Data (нет)
-            cipherText,                                   // Ciphertext (вход)
-            textLen                                      // Ciphertext length
-            );
-
-        if (status != 0) {
-            qCritical() << "DECRYPTION FAILED! MAC mismatch. Possible hacking attempt.";
-            m_socket->disconnect();
-            return;
-        }
+void NetworkService::onDisconnected() {
+    qDebug() << "[NetworkService] Socket disconnected.";
+    m_binaryMode = false; // При переподключении режим согласовывается заново
 
+    // Неотправленные кадры адресованы мертвой сессии — сбрасываем очередь
+    m_interactiveQueue.clear();
+    m_backgroundQueue.clear();
+    m_queuedBytes = 0;
+    emit bytesQueuedChanged(bytesQueued());
 
+    // Недособранный входящий кадр тоже принадлежит мертвой сессии
+    QMetaObject::invokeMethod(m_decoder, &NetworkDecoder::reset, Qt::QueuedConnection);
 
-        // Сброс значения размера для следующего сообщения
-        m_nextBlockSize = 0;
+    emit disconnected();
 
-        // Парсим JSON из прочитанных байт
-        QJsonDocument doc = QJsonDocument::fromJson(decrypted);
-        if (doc.isNull() || !doc.isObject()) {
-            qDebug() << "[NetworkService] Failed to parse JSON or it's not an object.";
-            continue;  // Ошибка парсинга, игнорируем фрейм
-        }
+    // Разрыв не по нашей инициативе — поднимаем сессию сами
+    scheduleReconnect();
+}
 
-        QJsonObject response = doc.object();
-        QString type = response["type"].toString();
-        qDebug() << "[NetworkService] Processing message of type" << type;
 
-        // Передаём событие на все подписанные компоненты (логика/слоты)
-        emit jsonReceived(doc.object());
-    }
+void NetworkService::onReadyRead(){
+    // Тяжелая часть приема (сборка кадров, расшифровка, разбор JSON)
+    // выполняется в потоке декодера — здесь только забираем байты из
+    // сокета, чтобы GUI-поток не замирал под залпом ответов при входе
+    emit rawDataReceived(m_socket->readAll());
 }
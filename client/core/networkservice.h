@@ -5,6 +5,11 @@
 #include <QJsonObject>
 #include "cryptoutils.h"
 #include <QTcpSocket>
+#include <QThread>
+#include <QElapsedTimer>
+
+class NetworkDecoder;
+class QTimer;
 
 /**
  * @brief Сервис для управления сетевым TCP-соединением с сервером.
@@ -16,6 +21,30 @@ class NetworkService : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * @brief Состояние соединения с сервером (машина состояний реконнекта).
+     *
+     * Disconnected -> Connecting -> Connected; любой разрыв или ошибка
+     * переводит в Reconnecting, откуда попытки идут по экспоненциальной
+     * задержке с джиттером до успешного Connected.
+     */
+    enum class ConnectionState {
+        Disconnected,  ///< Соединения нет и попыток не ведется
+        Connecting,    ///< Идет первая (явная) попытка подключения
+        Connected,     ///< Сокет установлен, идет или завершено рукопожатие
+        Reconnecting   ///< Разрыв: ждем таймер очередной попытки
+    };
+    Q_ENUM(ConnectionState)
+
+    /** @brief Начальная задержка перед повторным подключением, мс. */
+    static constexpr int ReconnectBaseMs = 1000;
+
+    /** @brief Потолок задержки между попытками подключения, мс. */
+    static constexpr int ReconnectMaxMs = 60000;
+
+    /** @brief Максимум сообщений, удерживаемых в офлайн-очереди отправки. */
+    static constexpr int OfflineQueueLimit = 64;
+
     /**
      * @brief Конструктор сетевого сервиса.
      *
@@ -24,6 +53,19 @@ public:
      */
     explicit NetworkService(QObject *parent = nullptr);
 
+    /**
+     * @brief Конструктор для мультиаккаунтного процесса.
+     *
+     * Декодер входящего трафика переезжает в общий поток процесса вместо
+     * собственного: декодирование — редкие короткие всплески, и один
+     * поток обслуживает соединения всех аккаунтов (см. AccountManager).
+     *
+     * @param sharedDecoderThread Общий запущенный поток декодеров
+     *        (nullptr — собственный поток, как в одноаккаунтном режиме)
+     * @param parent Родительский объект.
+     */
+    NetworkService(QThread* sharedDecoderThread, QObject *parent = nullptr);
+
     /**
      * @brief Деструктор.
      *
@@ -35,6 +77,15 @@ public:
             m_socket->close();
             m_socket->deleteLater();
         }
+        if (m_ownsDecoderThread) {
+            // Декодер удаляется в своем потоке (deleteLater по finished)
+            m_decoderThread.quit();
+            m_decoderThread.wait();
+        } else if (m_decoder) {
+            // Общий поток живет дольше сервиса: декодер удаляется в нем
+            // событием, поток продолжает обслуживать другие аккаунты
+            m_decoder->deleteLater();
+        }
         delete m_crypto;
     }
 
@@ -47,14 +98,51 @@ public slots:
     void connectToServer(const QString& host, quint16 port);
 
     /**
-     * @brief Отправляет JSON-объект на сервер.
+     * @brief Подготавливает 0-RTT пакет возобновления сессии к подключению.
      *
-     * Данные сериализуются в QByteArray, снабжаются заголовком с длиной пакета
-     * и отправляются через сокет.
+     * Вызывается ДО connectToServer(): при установке соединения token_login
+     * уйдет запечатанным прямо в кадре рукопожатия (ключом X25519 от нашего
+     * эфемерного секрета и кэшированного резюм-ключа сервера), и сервер
+     * ответит рукопожатием и login_success одним полетом. Пакет одноразовый:
+     * если сервер не смог его расшифровать (резюм-ключ устарел после
+     * рестарта), вход идет обычным путем через attemptAutoLogin.
+     *
+     * @param serverResumeKey Кэшированный резюм-ключ сервера (32 байта)
+     * @param loginBundle Готовый запрос token_login
+     */
+    void stageResumeTicket(const QByteArray& serverResumeKey,
+                           const QJsonObject& loginBundle);
+
+    /**
+     * @brief Ставит JSON-объект в очередь отправки на сервер.
+     *
+     * Данные сериализуются, шифруются и снабжаются заголовком с длиной
+     * пакета, но пишутся в сокет не сразу: все кадры, накопленные за один
+     * оборот цикла событий, уходят одним write (коалесинг). Фоновый трафик
+     * (квитанции прочтения/доставки, статус печати) отправляется после
+     * интерактивного.
      * @param json JSON-объект для отправки
      */
     void sendJson(const QJsonObject& json);
 
+    /**
+     * @brief Ставит чанк файлового канала в очередь отправки.
+     *
+     * Чанк — готовая бинарная запись (см. FileUploadService); он
+     * шифруется в потоке декодера и уходит фоновым приоритетом, поэтому
+     * сообщения и запросы пользователя не ждут хвоста большого файла.
+     * Без установленного шифрованного соединения чанк отбрасывается:
+     * докачкой после реконнекта управляет загрузчик.
+     * @param chunk Кадр чанка (заголовок + порция данных)
+     */
+    void sendFileChunk(const QByteArray& chunk);
+
+    /**
+     * @brief Суммарный объем неотправленных данных (обратное давление).
+     * @return Байты в очереди отправки плюс невытолкнутый буфер сокета
+     */
+    qint64 bytesQueued() const;
+
     /**
      * @brief Возвращает указатель на менеджер криптографии.
      * @return Указатель на CryptoManager, управляющий ключами сессии
@@ -63,13 +151,70 @@ public slots:
         return m_crypto;
     }
 
+    /**
+     * @brief Текущее состояние машины соединения.
+     * @return Одно из значений ConnectionState
+     */
+    ConnectionState connectionState() const { return m_state; }
+
+    /**
+     * @brief Уведомление о восстановлении сессии (вход выполнен).
+     *
+     * Вызывается по loginSuccess из DataService: только с этого момента
+     * сервер снова знает, кто мы, а кадры запечатываются ключом живой
+     * сессии — офлайн-очередь сообщений выталкивается здесь, а не при
+     * голом TCP connect.
+     */
+    void onSessionEstablished();
+
 signals:
+    /**
+     * @brief Изменился объем неотправленных данных.
+     *
+     * Позволяет верхним слоям придержать массовые операции, пока
+     * очередь отправки не разгрузится.
+     * @param bytesQueued Текущее значение bytesQueued()
+     */
+    void bytesQueuedChanged(qint64 bytesQueued);
+
+    /**
+     * @brief Сырые байты из сокета для потока декодера (внутренний).
+     *
+     * Очередь событий доставляет их в NetworkDecoder: сборка кадров,
+     * расшифровка и разбор JSON выполняются вне GUI-потока.
+     */
+    void rawDataReceived(const QByteArray& chunk);
+
+    /**
+     * @brief Запрос сборки исходящего кадра в потоке декодера (внутренний).
+     *
+     * Сериализация, шифрование и фрейминг выполняются вне GUI-потока;
+     * готовый пакет возвращается в onFrameSealed той же очередью
+     * событий, поэтому порядок отправки сохраняется.
+     */
+    void sealRequested(const QJsonObject& payload, bool binaryMode,
+                       bool background);
+
+    /**
+     * @brief Запрос сборки сырого кадра в потоке декодера (внутренний).
+     *
+     * Путь файловых чанков: без сериализации JSON и BinaryCodec, но с тем
+     * же шифрованием и фреймингом, в общем порядке с sealRequested.
+     */
+    void sealRawRequested(const QByteArray& payload, bool background);
+
     /** @brief Сигнал успешного подключения к серверу. */
     void connected();
 
     /** @brief Сигнал разрыва соединения. */
     void disconnected();
 
+    /**
+     * @brief Изменилось состояние машины соединения.
+     * @param state Новое состояние
+     */
+    void connectionStateChanged(NetworkService::ConnectionState state);
+
     /**
      * @brief Сигнал получения нового валидного JSON-сообщения.
      * @param jsonDoc Десериализованный JSON объект
@@ -112,6 +257,25 @@ private slots:
     /** @brief Внутренний слот обработки disconnect(). */
     void onDisconnected();
 
+    /**
+     * @brief Ошибка сокета (в т.ч. неудачная попытка подключения).
+     *
+     * Неудачный connect() не порождает disconnected(), поэтому планирование
+     * следующей попытки реконнекта живет здесь.
+     */
+    void onSocketError();
+
+    /**
+     * @brief Смена доступности сети (QNetworkInformation).
+     *
+     * Возврат маршрута — повод попробовать немедленно, не дожидаясь
+     * хвоста экспоненциальной задержки.
+     */
+    void onReachabilityChanged();
+
+    /** @brief Очередная попытка подключения по таймеру реконнекта. */
+    void attemptReconnect();
+
     /**
      * @brief Слот чтения поступающих данных из сокета.
      *
@@ -127,10 +291,88 @@ private slots:
      */
     void sendClientPublicKey();
 
+    /**
+     * @brief Выталкивает очередь отправки одним write.
+     *
+     * Вызывается отложенно (нулевой таймер): кадры, поставленные в очередь
+     * за один оборот цикла событий, склеиваются в единый буфер. Сначала
+     * уходит интерактивный трафик, затем фоновый.
+     */
+    void flushSendQueue();
+
+    /**
+     * @brief Принимает собранный в потоке декодера кадр и ставит его
+     *        в очередь отправки по приоритету.
+     * @param packet Готовый пакет (фрейминг уже выполнен)
+     * @param background Кадр относится к фоновому трафику
+     */
+    void onFrameSealed(const QByteArray& packet, bool background);
+
 private:
+    /**
+     * @brief Применяет транспортный профиль к установленному соединению.
+     *
+     * Зеркало серверной настройки (SocketTuning): Nagle выключен — батчинг
+     * мелких кадров выполняет коалесинг очереди отправки, а не ядро;
+     * буферы сокета увеличены под окно файлового канала; keepalive с
+     * короткими таймерами держит NAT-трансляцию живой и обнаруживает
+     * мертвый канал быстрее системных значений.
+     */
+    void tuneSocket();
+
+    /**
+     * @brief Относится ли тип запроса к фоновому трафику.
+     *
+     * Фоновые кадры (квитанции, статус печати) не критичны к задержке
+     * и уступают место сообщениям и запросам пользователя.
+     */
+    static bool isBackgroundType(const QString& type);
+
+    /**
+     * @brief Переводит машину состояний и публикует изменение.
+     * @param state Новое состояние
+     */
+    void setState(ConnectionState state);
+
+    /**
+     * @brief Планирует следующую попытку подключения.
+     *
+     * Задержка растет экспоненциально от ReconnectBaseMs до ReconnectMaxMs
+     * и берется случайно из верхней половины интервала (джиттер): после
+     * сетевого моргания в офисе сотни клиентов не ломятся к серверу
+     * синхронно.
+     */
+    void scheduleReconnect();
+
     QTcpSocket *m_socket;        ///< Основной TCP сокет для связи с сервером
-    quint32 m_nextBlockSize;     ///< Размер ожидаемого блока данных (для парсинга потока)
+
+    QThread m_decoderThread;     ///< Поток декодера входящего трафика
+    bool m_ownsDecoderThread = true; ///< false — декодер в общем потоке процесса
+    NetworkDecoder *m_decoder;   ///< Декодер кадров (живет в m_decoderThread)
+
+    QList<QByteArray> m_interactiveQueue; ///< Очередь интерактивных кадров (сообщения, запросы)
+    QList<QByteArray> m_backgroundQueue;  ///< Очередь фоновых кадров (квитанции, typing)
+    qint64 m_queuedBytes = 0;             ///< Суммарный размер кадров в очередях
+    bool m_flushScheduled = false;        ///< Флаг: отложенный сброс очереди уже назначен
     CryptoManager *m_crypto;     ///< Менеджер шифрования (X25519)
+    bool m_binaryMode = false;   ///< Бинарный протокол согласован (получен binary_mode_ack)
+
+    QByteArray m_resumeServerKey; ///< Кэшированный резюм-ключ сервера (0-RTT вход)
+    QJsonObject m_resumeBundle;   ///< Подготовленный token_login для кадра рукопожатия
+
+    ConnectionState m_state = ConnectionState::Disconnected; ///< Машина состояний соединения
+    QString m_host;               ///< Адрес сервера последнего connectToServer
+    quint16 m_port = 0;           ///< Порт сервера последнего connectToServer
+    int m_reconnectAttempt = 0;   ///< Номер очередной попытки (показатель экспоненты)
+    QTimer *m_reconnectTimer;     ///< Одновыстрельный таймер следующей попытки
+
+    QList<QJsonObject> m_offlinePayloads; ///< Сообщения, отправленные без соединения (до OfflineQueueLimit)
+
+    bool m_traceEnabled = false; ///< Трассировка задержки включена (MESSENGER_TRACE=1)
+    QElapsedTimer m_simClock;    ///< Часы модели полосы симулятора сети (NetSim)
+    qint64 m_simBusyUntilMs = 0; ///< Момент освобождения смоделированной линии
+    QString m_tracePrefix;       ///< Случайный префикс корреляционных ID этой сессии
+    quint64 m_traceCounter = 0;  ///< Счетчик для генерации корреляционных ID
 };
 
 #endif // NETWORKSERVICE_H
@@ -0,0 +1,187 @@
+//См. "perfmetrics.h"
+#include "perfmetrics.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// Все счетчики — relaxed-атомики: нам нужна дешевизна инкремента на
+// горячем пути, а не упорядоченность между счетчиками. Снимок может
+// быть слегка "рваным" (значения из соседних микросекунд) — для
+// диагностики это несущественно.
+std::atomic<quint64> g_paintCount{0};
+std::atomic<quint64> g_frameBuckets[PerfMetrics::FrameBucketCount] = {};
+std::atomic<quint64> g_docHits{0};
+std::atomic<quint64> g_docMisses{0};
+std::atomic<quint64> g_bubbleHits{0};
+std::atomic<quint64> g_bubbleMisses{0};
+std::atomic<int>     g_dbQueueDepth{0};
+std::atomic<quint64> g_dbJobsDone{0};
+std::atomic<qint64>  g_lastRttMs{-1};
+std::atomic<qint64>  g_rttSumMs{0};
+std::atomic<quint64> g_rttCount{0};
+
+// Кольцо последних замеров задержки ввода: p95 считается в snapshot()
+// по копии кольца — запись на горячем пути остается одним store.
+std::atomic<qint64>  g_inputSamples[PerfMetrics::InputSampleCount] = {};
+std::atomic<quint64> g_inputCount{0};
+std::atomic<qint64>  g_inputLastUs{-1};
+
+// Замеры круга: temp_id -> момент отправки. Редкий путь (одна запись
+// на отправленное сообщение), поэтому обычный мьютекс, а не lock-free.
+QMutex g_rttMutex;
+QHash<QString, qint64> g_sentMarks;
+
+// Потолок карты замеров: echo может не прийти (обрыв сети), старые
+// метки не должны копиться бесконечно
+constexpr int MaxSentMarks = 64;
+
+} // namespace
+
+namespace PerfMetrics {
+
+void recordPaint(qint64 paintUs)
+{
+    g_paintCount.fetch_add(1, std::memory_order_relaxed);
+
+    const qint64 ms = paintUs / 1000;
+    int bucket = FrameBucketCount - 1;
+    for (int i = 0; i < FrameBucketCount - 1; ++i) {
+        if (ms < FrameBucketEdgesMs[i]) {
+            bucket = i;
+            break;
+        }
+    }
+    g_frameBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void recordDocCache(bool hit)
+{
+    (hit ? g_docHits : g_docMisses).fetch_add(1, std::memory_order_relaxed);
+}
+
+void recordBubbleCache(bool hit)
+{
+    (hit ? g_bubbleHits : g_bubbleMisses).fetch_add(1, std::memory_order_relaxed);
+}
+
+void dbJobQueued()
+{
+    g_dbQueueDepth.fetch_add(1, std::memory_order_relaxed);
+}
+
+void dbJobFinished()
+{
+    g_dbQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+    g_dbJobsDone.fetch_add(1, std::memory_order_relaxed);
+}
+
+void recordInputLatency(qint64 latencyUs)
+{
+    const quint64 n = g_inputCount.fetch_add(1, std::memory_order_relaxed);
+    g_inputSamples[n % InputSampleCount].store(latencyUs,
+                                               std::memory_order_relaxed);
+    g_inputLastUs.store(latencyUs, std::memory_order_relaxed);
+}
+
+void markSent(const QString& tempId)
+{
+    QMutexLocker locker(&g_rttMutex);
+    if (g_sentMarks.size() >= MaxSentMarks) {
+        // Вытесняем произвольную старую метку: точность важна меньше,
+        // чем ограниченность памяти
+        g_sentMarks.erase(g_sentMarks.begin());
+    }
+    g_sentMarks.insert(tempId, QDateTime::currentMSecsSinceEpoch());
+}
+
+void markEcho(const QString& tempId)
+{
+    qint64 sentMs = 0;
+    {
+        QMutexLocker locker(&g_rttMutex);
+        const auto it = g_sentMarks.constFind(tempId);
+        if (it == g_sentMarks.constEnd()) return;
+        sentMs = it.value();
+        g_sentMarks.erase(it);
+    }
+
+    const qint64 rtt = QDateTime::currentMSecsSinceEpoch() - sentMs;
+    g_lastRttMs.store(rtt, std::memory_order_relaxed);
+    g_rttSumMs.fetch_add(rtt, std::memory_order_relaxed);
+    g_rttCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+Snapshot snapshot()
+{
+    Snapshot s;
+    s.paintCount = g_paintCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < FrameBucketCount; ++i) {
+        s.frameBuckets[i] = g_frameBuckets[i].load(std::memory_order_relaxed);
+    }
+    s.docHits      = g_docHits.load(std::memory_order_relaxed);
+    s.docMisses    = g_docMisses.load(std::memory_order_relaxed);
+    s.bubbleHits   = g_bubbleHits.load(std::memory_order_relaxed);
+    s.bubbleMisses = g_bubbleMisses.load(std::memory_order_relaxed);
+    s.dbQueueDepth = g_dbQueueDepth.load(std::memory_order_relaxed);
+    s.dbJobsDone   = g_dbJobsDone.load(std::memory_order_relaxed);
+    s.lastRttMs    = g_lastRttMs.load(std::memory_order_relaxed);
+    s.rttCount     = g_rttCount.load(std::memory_order_relaxed);
+
+    // p95 задержки ввода по копии кольца: сортировка до 128 значений
+    // на пути снимка (раз в полсекунды для HUD) ничего не стоит
+    s.inputCount  = g_inputCount.load(std::memory_order_relaxed);
+    s.inputLastUs = g_inputLastUs.load(std::memory_order_relaxed);
+    const int filled = int(qMin<quint64>(s.inputCount, InputSampleCount));
+    if (filled > 0) {
+        qint64 window[InputSampleCount];
+        for (int i = 0; i < filled; ++i) {
+            window[i] = g_inputSamples[i].load(std::memory_order_relaxed);
+        }
+        std::sort(window, window + filled);
+        s.inputP95Us = window[(filled * 95) / 100];
+    }
+    s.avgRttMs     = s.rttCount > 0
+        ? g_rttSumMs.load(std::memory_order_relaxed) / qint64(s.rttCount)
+        : -1;
+    return s;
+}
+
+void dump()
+{
+    const Snapshot s = snapshot();
+
+    const auto hitRate = [](quint64 hits, quint64 misses) {
+        const quint64 total = hits + misses;
+        return total > 0 ? 100.0 * double(hits) / double(total) : 0.0;
+    };
+
+    qInfo().nospace() << "[PerfMetrics] paints=" << s.paintCount
+                      << " frame_ms<1/2/4/8/16/inf="
+                      << s.frameBuckets[0] << "/" << s.frameBuckets[1] << "/"
+                      << s.frameBuckets[2] << "/" << s.frameBuckets[3] << "/"
+                      << s.frameBuckets[4] << "/" << s.frameBuckets[5];
+    qInfo().nospace() << "[PerfMetrics] doc_cache="
+                      << s.docHits << "/" << (s.docHits + s.docMisses)
+                      << " (" << qRound(hitRate(s.docHits, s.docMisses)) << "%)"
+                      << " bubble_cache="
+                      << s.bubbleHits << "/" << (s.bubbleHits + s.bubbleMisses)
+                      << " (" << qRound(hitRate(s.bubbleHits, s.bubbleMisses)) << "%)";
+    qInfo().nospace() << "[PerfMetrics] input_last_us=" << s.inputLastUs
+                      << " input_p95_us=" << s.inputP95Us
+                      << " input_n=" << s.inputCount;
+    qInfo().nospace() << "[PerfMetrics] db_queue=" << s.dbQueueDepth
+                      << " db_done=" << s.dbJobsDone
+                      << " rtt_last_ms=" << s.lastRttMs
+                      << " rtt_avg_ms=" << s.avgRttMs
+                      << " rtt_n=" << s.rttCount;
+}
+
+}
@@ -0,0 +1,126 @@
+#ifndef PERFMETRICS_H
+#define PERFMETRICS_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Легковесные счетчики производительности клиента.
+ *
+ * До сих пор у нас не было никакой видимости в подтормаживания UI: ни
+ * времени отрисовки, ни хит-рейта кэшей делегата, ни глубины очереди БД.
+ * Этот модуль — набор всегда включенных счетчиков на расслабленных
+ * атомиках: инкремент стоит единицы наносекунд, поэтому инструментация
+ * остается и в продакшен-сборках — при жалобе на "тормозит" достаточно
+ * попросить дамп, не пересобирая клиент.
+ *
+ * Потребители:
+ * - горячие пути (paint делегата, кэши, очередь БД) зовут record*();
+ * - PerfHudWidget раз в полсекунды снимает snapshot() и рисует оверлей;
+ * - dump() выводит сводку в лог (вызывается при закрытии оверлея).
+ *
+ * Потокобезопасно: счетчики атомарные, карта замеров RTT под мьютексом.
+ */
+namespace PerfMetrics {
+
+/** @brief Число корзин гистограммы времени отрисовки строки. */
+constexpr int FrameBucketCount = 6;
+
+/**
+ * @brief Верхние границы корзин гистограммы, мс (последняя — без границы).
+ *
+ * Ориентир — бюджет кадра 16.6 мс: строка, рисующаяся дольше 8 мс,
+ * уже съедает половину бюджета одним вызовом paint().
+ */
+constexpr int FrameBucketEdgesMs[FrameBucketCount - 1] = { 1, 2, 4, 8, 16 };
+
+/**
+ * @brief Согласованный снимок всех счетчиков для HUD и дампа.
+ */
+/** @brief Размер кольца замеров задержки ввода (хватает на пару секунд
+ *  быстрой печати; p95 по скользящему окну и нужен). */
+constexpr int InputSampleCount = 128;
+
+struct Snapshot {
+    quint64 paintCount = 0;                    ///< Всего вызовов paint() делегата
+    quint64 frameBuckets[FrameBucketCount] = {}; ///< Гистограмма длительностей paint()
+    quint64 docHits = 0;                       ///< Попадания в кэш QTextDocument
+    quint64 docMisses = 0;                     ///< Промахи кэша QTextDocument
+    quint64 bubbleHits = 0;                    ///< Попадания в pixmap-кэш пузырей
+    quint64 bubbleMisses = 0;                  ///< Промахи pixmap-кэша пузырей
+    int dbQueueDepth = 0;                      ///< Задач в очереди потока БД сейчас
+    quint64 dbJobsDone = 0;                    ///< Всего выполненных задач БД
+    qint64 lastRttMs = -1;                     ///< Последний измеренный круг до сервера
+    qint64 avgRttMs = -1;                      ///< Средний круг за сессию
+    quint64 rttCount = 0;                      ///< Число измерений круга
+    qint64 inputLastUs = -1;                   ///< Последняя задержка ввода (клавиша -> глиф), мкс
+    qint64 inputP95Us = -1;                    ///< p95 задержки ввода по скользящему окну, мкс
+    quint64 inputCount = 0;                    ///< Число замеров ввода за сессию
+};
+
+/**
+ * @brief Фиксирует один вызов paint() делегата.
+ * @param paintUs Длительность отрисовки в микросекундах
+ */
+void recordPaint(qint64 paintUs);
+
+/**
+ * @brief Фиксирует обращение к кэшу QTextDocument делегата.
+ * @param hit true — попадание, false — промах
+ */
+void recordDocCache(bool hit);
+
+/**
+ * @brief Фиксирует обращение к pixmap-кэшу отрендеренных пузырей.
+ * @param hit true — попадание, false — промах
+ */
+void recordBubbleCache(bool hit);
+
+/** @brief Задача поставлена в очередь потока БД. */
+void dbJobQueued();
+
+/** @brief Задача потока БД выполнена. */
+void dbJobFinished();
+
+/**
+ * @brief Фиксирует задержку ввода: от нажатия клавиши до отрисовки глифа.
+ *
+ * Замеряется в поле ввода сообщения (SmoothTextEdit); p95 по скользящему
+ * окну — первоклассная метрика отзывчивости печати.
+ * @param latencyUs Задержка в микросекундах
+ */
+void recordInputLatency(qint64 latencyUs);
+
+/**
+ * @brief Запоминает момент отправки сообщения для замера круга.
+ *
+ * Карта замеров ограничена: при переполнении старые метки вытесняются,
+ * чтобы потерянные echo не копили память.
+ *
+ * @param tempId Временный ID отправленного сообщения
+ */
+void markSent(const QString& tempId);
+
+/**
+ * @brief Завершает замер круга по echo сервера.
+ * @param tempId Временный ID из подтверждения
+ */
+void markEcho(const QString& tempId);
+
+/**
+ * @brief Снимает текущие значения всех счетчиков.
+ * @return Снимок для отрисовки HUD или логирования
+ */
+Snapshot snapshot();
+
+/**
+ * @brief Выводит сводку счетчиков в лог (qInfo).
+ *
+ * Работает и в продакшен-сборке — это канал диагностики по жалобам
+ * пользователей без пересборки.
+ */
+void dump();
+
+}
+
+#endif // PERFMETRICS_H
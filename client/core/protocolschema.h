@@ -0,0 +1,267 @@
+#ifndef PROTOCOLSCHEMA_H
+#define PROTOCOLSCHEMA_H
+
+#include <QString>
+#include <QJsonObject>
+#include <QtGlobal>
+
+/**
+ * @brief Реестр схем бинарного протокола: каждый тип описан один раз.
+ *
+ * Раньше поля каждой бинарной записи были захардкожены дважды — в
+ * encode() и decode() кодека на обеих сторонах, и любое расхождение
+ * (порядок полей, пропущенное поле) давало тихую порчу данных. Здесь
+ * каждый горячий тип сообщения описан единственным constexpr-дескриптором:
+ * тег записи, имя типа и упорядоченный список полей с их видами.
+ * Кодек на обеих сторонах — это общие циклы по дескриптору, поэтому
+ * кодирование и декодирование физически не могут разойтись, а новый тип
+ * получает бинарную дорожку одной строкой в таблице Messages.
+ *
+ * @warning Теги и порядок полей — часть wire-протокола; менять нельзя,
+ * только добавлять новые дескрипторы с новыми тегами.
+ *
+ * @note Файл намеренно идентичен в server/ и client/core/ (как
+ * binarycodec и cryptoutils): обе стороны читают одну и ту же таблицу.
+ */
+namespace ProtocolSchema {
+
+/**
+ * @brief Вид поля записи: определяет представление в QDataStream.
+ */
+enum class FieldKind : quint8 {
+    String,   ///< QString (имена пользователей и прочие строки)
+    MessageId ///< quint64 на проводе, double в JSON-представлении
+};
+
+/**
+ * @brief Одно поле бинарной записи.
+ */
+struct Field {
+    const char* name; ///< Имя ключа в JSON-представлении
+    FieldKind kind;   ///< Представление на проводе
+};
+
+/**
+ * @brief Дескриптор одного типа сообщения.
+ */
+struct MessageDescriptor {
+    quint8 tag;          ///< Тег бинарной записи (часть wire-протокола)
+    const char* type;    ///< Значение поля "type" в JSON-представлении
+    const Field* fields; ///< Поля в порядке сериализации
+    int fieldCount;      ///< Число полей
+};
+
+// --- Поля записей (порядок = порядок на проводе) ---
+
+inline constexpr Field TypingFields[] = {
+    { "fromUser", FieldKind::String },
+    { "toUser",   FieldKind::String },
+};
+
+inline constexpr Field StatusFields[] = {
+    { "id", FieldKind::MessageId },
+};
+
+inline constexpr Field StatusRangeFields[] = {
+    { "from",     FieldKind::String },
+    { "up_to_id", FieldKind::MessageId },
+};
+
+/**
+ * @brief Таблица всех бинарных типов: одна строка — одна форма записи.
+ *
+ * У типа может быть несколько форм с разными тегами: статусы существуют
+ * в одиночной форме (поле id) и диапазонной (from + up_to_id, "всё от
+ * автора вплоть до id"). Отправляющая сторона выбирает дескриптор по
+ * составу полей (см. byJson). Пакетные подтверждения (массив ids) сюда
+ * не входят: дескрипторы описывают плоские скалярные поля, а массивы
+ * остаются на JSON.
+ */
+inline constexpr MessageDescriptor Messages[] = {
+    { 0x01, "typing",            TypingFields,      2 },
+    { 0x02, "message_delivered", StatusFields,      1 },
+    { 0x03, "message_read",      StatusFields,      1 },
+    { 0x04, "message_delivered", StatusRangeFields, 2 },
+    { 0x05, "message_read",      StatusRangeFields, 2 },
+};
+
+inline constexpr int MessageCount = int(sizeof(Messages) / sizeof(Messages[0]));
+
+/**
+ * @brief Находит дескриптор по тегу записи (приемная сторона).
+ * @param tag Тег из первого байта после Magic
+ * @return Дескриптор или nullptr для неизвестного тега
+ */
+constexpr const MessageDescriptor* byTag(quint8 tag)
+{
+    for (int i = 0; i < MessageCount; ++i) {
+        if (Messages[i].tag == tag) return &Messages[i];
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Находит дескриптор по типу и составу полей (отправляющая сторона).
+ * @details Перебирает формы типа в порядке таблицы и берет первую, все
+ * поля которой присутствуют в объекте: так одиночная и диапазонная формы
+ * статусов сосуществуют под одним значением "type".
+ * @param json JSON-представление сообщения
+ * @return Дескриптор или nullptr — сообщение остается на JSON
+ */
+inline const MessageDescriptor* byJson(const QJsonObject& json)
+{
+    const QString type = json["type"].toString();
+    for (int i = 0; i < MessageCount; ++i) {
+        const MessageDescriptor& desc = Messages[i];
+        if (type != QLatin1String(desc.type)) continue;
+
+        bool complete = true;
+        for (int f = 0; f < desc.fieldCount; ++f) {
+            if (!json.contains(QLatin1String(desc.fields[f].name))) {
+                complete = false;
+                break;
+            }
+        }
+        if (complete) return &desc;
+    }
+    return nullptr;
+}
+
+
+// ═══════════════════════════════════════════════════════════════════════════
+// Реестр команд запросов (клиент -> сервер)
+// ═══════════════════════════════════════════════════════════════════════════
+
+/**
+ * @brief Реестр команд запросов: имя -> плотный целочисленный id.
+ *
+ * Диспетчер сервера раньше искал обработчик в QMap<QString, Handler> —
+ * дерево строковых сравнений на каждый входящий запрос. Здесь каждой
+ * команде присвоен плотный id (ее индекс в Commands), а перевод имени
+ * в id идет через замороженную хеш-таблицу, построенную на этапе
+ * компиляции: FNV-1a по ASCII-имени, открытая адресация, одно
+ * подтверждающее сравнение строки на совпавший слот. Таблица
+ * обработчиков сервера — плоский массив, индексированный id.
+ *
+ * @note id — внутренняя нумерация процесса (плотные индексы массивов),
+ * на провод уходят имена (JSON) либо теги бинарных записей (Messages).
+ * Порядок в Commands менять можно свободно — id нигде не сериализуются.
+ */
+inline constexpr const char* Commands[] = {
+    // Аутентификация и сессия
+    "login", "token_login", "register", "logout_request",
+    // Контакты и пользователи
+    "search_users", "add_contact_request", "add_contacts_bulk",
+    "contact_request_response", "update_profile", "get_profiles",
+    // Сообщения
+    "private_message", "get_history", "delete_message", "edit_message",
+    "typing", "create_group", "group_message", "set_retention",
+    // Статусы доставки
+    "message_delivered", "message_read",
+    // Звонки
+    "call_request", "call_accepted", "call_rejected", "call_end",
+    "get_call_history", "get_call_stats", "conference_create", "conference_leave",
+    // Служебные
+    "handshake", "binary_mode", "compression", "presence_subscribe", "pong",
+    // Файловый канал
+    "file_upload_begin", "file_upload_finish", "file_download",
+};
+
+inline constexpr int CommandCount = int(sizeof(Commands) / sizeof(Commands[0]));
+
+/** @brief FNV-1a по ASCII-строке (имена команд). */
+constexpr quint32 commandHash(const char* s)
+{
+    quint32 h = 2166136261u;
+    for (; *s; ++s) {
+        h = (h ^ quint32(quint8(*s))) * 16777619u;
+    }
+    return h;
+}
+
+/** @brief Размер замороженной таблицы: степень двойки, запас ~4x команд. */
+inline constexpr quint32 CommandSlotCount = 128;
+
+/** @brief Слот замороженной таблицы: хеш имени и id команды (-1 — пусто). */
+struct CommandSlot {
+    quint32 hash = 0;
+    qint16 id = -1;
+};
+
+namespace detail {
+
+/** @brief Обертка массива слотов: constexpr-функции нельзя вернуть массив. */
+struct CommandSlotTable {
+    CommandSlot slots[CommandSlotCount] {};
+};
+
+/** @brief Строит таблицу на этапе компиляции (линейное зондирование). */
+constexpr CommandSlotTable buildCommandSlots()
+{
+    CommandSlotTable table;
+    for (int id = 0; id < CommandCount; ++id) {
+        const quint32 hash = commandHash(Commands[id]);
+        quint32 slot = hash & (CommandSlotCount - 1);
+        while (table.slots[slot].id >= 0) {
+            slot = (slot + 1) & (CommandSlotCount - 1);
+        }
+        table.slots[slot].hash = hash;
+        table.slots[slot].id = qint16(id);
+    }
+    return table;
+}
+
+} // namespace detail
+
+inline constexpr detail::CommandSlotTable CommandSlots = detail::buildCommandSlots();
+
+/**
+ * @brief Перевод имени команды в плотный id (регистрация обработчиков).
+ * @details Линейный constexpr-поиск: вызывается при инициализации, не в
+ * хот-пате; в constexpr-контексте опечатка в имени — ошибка компиляции.
+ * @return id команды (индекс Commands) или -1 для неизвестного имени
+ */
+constexpr int commandIdFor(const char* name)
+{
+    for (int id = 0; id < CommandCount; ++id) {
+        const char* a = Commands[id];
+        const char* b = name;
+        while (*a != '\0' && *a == *b) { ++a; ++b; }
+        if (*a == '\0' && *b == '\0') return id;
+    }
+    return -1;
+}
+
+/**
+ * @brief Перевод значения поля "type" в плотный id (хот-пат диспетчера).
+ * @details Один проход хеша по символам (без конвертации QString в байты),
+ * зондирование по замороженной таблице и единственное подтверждающее
+ * сравнение строки на совпавший слот — вместо дерева строковых
+ * сравнений QMap на каждый запрос.
+ * @param type Значение поля "type" входящего запроса
+ * @return id команды (индекс Commands) или -1 для неизвестной
+ */
+inline int commandIdFor(const QString& type)
+{
+    quint32 h = 2166136261u;
+    for (const QChar ch : type) {
+        if (ch.unicode() > 127) return -1; // Имена команд — чистый ASCII
+        h = (h ^ quint32(ch.unicode())) * 16777619u;
+    }
+
+    for (quint32 probe = 0; probe < CommandSlotCount; ++probe) {
+        const CommandSlot& slot =
+            CommandSlots.slots[(h + probe) & (CommandSlotCount - 1)];
+        if (slot.id < 0) {
+            return -1; // Пустой слот — имени в таблице нет
+        }
+        if (slot.hash == h && type == QLatin1String(Commands[slot.id])) {
+            return slot.id;
+        }
+    }
+    return -1;
+}
+
+}
+
+#endif // PROTOCOLSCHEMA_H
@@ -0,0 +1,17 @@
+#include "startupclock.h"
+#include <QElapsedTimer>
+#include <QDebug>
+
+namespace StartupClock {
+
+void mark(const QString& phase)
+{
+    // Секундомер процесса: стартует при первой метке
+    static QElapsedTimer clock;
+    if (!clock.isValid()) {
+        clock.start();
+    }
+    qInfo() << "[Startup]" << qPrintable(phase) << ":" << clock.elapsed() << "ms";
+}
+
+} // namespace StartupClock
@@ -0,0 +1,25 @@
+#ifndef STARTUPCLOCK_H
+#define STARTUPCLOCK_H
+
+#include <QString>
+
+/**
+ * @brief Метки времени фаз холодного старта.
+ *
+ * Единый секундомер процесса: первая метка запускает отсчет, каждая
+ * следующая пишет в лог имя фазы и миллисекунды от старта. По этим
+ * строкам отслеживаются регрессии времени запуска между сборками.
+ *
+ * Пример вывода: "[Startup] main ui built: 412 ms".
+ */
+namespace StartupClock {
+
+/**
+ * @brief Фиксирует фазу старта в логе.
+ * @param phase Короткое имя фазы (например, "tcp connect started")
+ */
+void mark(const QString& phase);
+
+} // namespace StartupClock
+
+#endif // STARTUPCLOCK_H
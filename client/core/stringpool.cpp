@@ -0,0 +1,25 @@
+#include "stringpool.h"
+
+#include <QSet>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace {
+    // Канонические экземпляры строк; доступ только под мьютексом
+    QSet<QString> g_pool;
+    QMutex g_mutex;
+}
+
+QString StringPool::intern(const QString& value)
+{
+    // Пустые строки и так не занимают кучу
+    if (value.isEmpty()) {
+        return value;
+    }
+
+    QMutexLocker locker(&g_mutex);
+
+    // insert возвращает итератор на уже существующий элемент, если строка
+    // в пуле есть — копия из него разделяет буфер с каноническим экземпляром
+    return *g_pool.insert(value);
+}
@@ -0,0 +1,31 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+
+/**
+ * @brief Пул интернирования коротких повторяющихся строк.
+ *
+ * В кэше из тысяч сообщений поля fromUser/toUser повторяют одни и те же
+ * два-три имени, но при разборе JSON и чтении из БД каждая копия получает
+ * собственный буфер в куче. Пул возвращает канонический экземпляр строки:
+ * все сообщения чата разделяют один буфер через implicit sharing QString,
+ * и дубликаты исчезают.
+ *
+ * Предназначен для значений с малой кардинальностью (имена пользователей);
+ * произвольный текст сообщений интернировать не нужно.
+ */
+namespace StringPool {
+
+/**
+ * @brief Возвращает канонический экземпляр строки из пула.
+ * @param value Строка для интернирования
+ * @return QString, разделяющий буфер со всеми равными значениями
+ *
+ * Потокобезопасно: вызывается и из GUI-потока, и из потока БД.
+ */
+QString intern(const QString& value);
+
+}
+
+#endif // STRINGPOOL_H
@@ -5,6 +5,10 @@
 #include <QList>
 #include <QMetaType>
 #include <QObject>
+#include <QSharedPointer>
+#include <QDateTime>
+#include <QPersistentModelIndex>
+#include "compactstring.h"
 
 /**
  * @brief Структура, представляющая чат с пользователем.
@@ -18,7 +22,7 @@ struct Chat {
     QString username;                 ///< Имя пользователя-собеседника (ключ чата)
     QString displayName;              ///< Отображаемое имя собеседника
     QString lastMessagePayload;       ///< Текст последнего сообщения (для превью)
-    QString lastMessageTimestamp;     ///< Временная метка последнего сообщения
+    qint64 lastMessageTimestamp = 0;  ///< Время последнего сообщения (мс эпохи)
     qint64 lastMessageId = 0;         ///< ID последнего сообщения
     int unreadCount = 0;              ///< Количество непрочитанных сообщений
     bool isPinned = false;            ///< Флаг: чат закреплен в верху списка
@@ -26,13 +30,14 @@ struct Chat {
     bool isLastMessageOutgoing = false;  ///< Флаг: последнее сообщение отправлено нами
     QString draftText;                ///< Сохраненный черновик неотправленного сообщения
     bool isMuted = false;             ///< Флаг: уведомления для чата отключены
+    qint64 retentionSeconds = 0;      ///< Срок хранения сообщений, с (0 — вечно)
 
     /** @brief Конструктор по умолчанию. Инициализирует поля пустыми значениями. */
     Chat(){
         username = "";
         displayName = "";
         lastMessagePayload = "";
-        lastMessageTimestamp = "";
+        lastMessageTimestamp = 0;
         lastMessageId = 0;
         unreadCount = 0;
         isPinned = false;
@@ -40,6 +45,7 @@ struct Chat {
         isLastMessageOutgoing = false;
         draftText = "";
         isMuted = false;
+        retentionSeconds = 0;
     }
 
     /**
@@ -50,7 +56,7 @@ struct Chat {
         : username(user) {
         displayName = "";
         lastMessagePayload = "";
-        lastMessageTimestamp = "";
+        lastMessageTimestamp = 0;
         lastMessageId = 0;
         unreadCount = 0;
         isPinned = false;
@@ -58,6 +64,7 @@ struct Chat {
         isLastMessageOutgoing = false;
         draftText = "";
         isMuted = false;
+        retentionSeconds = 0;
     }
 
     /**
@@ -65,7 +72,7 @@ struct Chat {
      *
      * Приоритет сортировки:
      * 1. Закрепленные чаты всегда выше.
-     * 2. Более новые сообщения выше (по timestamp).
+     * 2. Более новые сообщения выше (сравнение int64-меток, без строк).
      */
     bool operator<(const Chat& other) const {
         if (isPinned != other.isPinned) {
@@ -76,6 +83,11 @@ struct Chat {
 
     Chat(const Chat& other) = default;
     Chat& operator=(const Chat& other) = default;
+
+    // Явно объявленные копирующие операции подавили бы неявные перемещающие —
+    // без них std::move записи в кэш выродился бы в глубокую копию
+    Chat(Chat&& other) = default;
+    Chat& operator=(Chat&& other) = default;
 };
 
 Q_DECLARE_METATYPE(Chat)
@@ -120,23 +132,97 @@ struct ChatMessage {
     };
 
     qint64 id = 0;                    ///< ID сообщения на сервере
-    QString tempId;                   ///< Временный GUID для локального трекинга до подтверждения сервером
-    QString fromUser;                 ///< Имя отправителя
-    QString toUser;                   ///< Имя получателя
-    QString payload;                  ///< Тело сообщения (текст или описание)
-    QString timestamp;                ///< Время создания (ISO 8601)
+    CompactString tempId;             ///< Временный GUID для локального трекинга до подтверждения сервером
+    QString fromUser;                 ///< Имя отправителя (интернируется через StringPool)
+    QString toUser;                   ///< Имя получателя (интернируется через StringPool)
+    CompactString payload;            ///< Тело сообщения, UTF-8 inline до 23 байт (см. CompactString)
+    qint64 timestamp = 0;             ///< Время создания (мс эпохи, серверные часы)
 
     bool isEdited = false;            ///< Флаг: сообщение было изменено
     qint64 replyToId = 0;             ///< ID сообщения, на которое это является ответом
-    User forwardedFrom;               ///< Информация об авторе пересылаемого сообщения (если есть)
+    QSharedPointer<User> forwardedFrom;  ///< Автор пересылаемого сообщения (выделяется только для пересланных)
     MessageType messageType;          ///< Тип контента
     MessageStatus status;             ///< Текущий статус доставки
     QString mediaUrl;                 ///< Ссылка на медиа (для картинок/файлов)
     bool isOutgoing;                  ///< true, если сообщение отправлено текущим пользователем
     bool isFailed = false;            ///< Флаг ошибки (дублирует статус Error для удобства)
     QString fileId;                   ///< ID файла на сервере (если есть вложение)
-    QString fileName;                 ///< Оригинальное имя файла
+    CompactString fileName;           ///< Оригинальное имя файла (обычно короткое, UTF-8 inline)
     QString fileUrl;                  ///< Полный URL файла
+
+    /**
+     * @brief Время для отображения в пузыре сообщения (HH:mm).
+     *
+     * Форматируется лениво при первом обращении и кэшируется: делегат
+     * перерисовывает видимые строки десятки раз (скролл, наведение),
+     * и разбор даты на каждый paint был заметен в профиле.
+     */
+    const QString& timeText() const {
+        if (m_timeText.isEmpty() && timestamp > 0) {
+            m_timeText = QDateTime::fromMSecsSinceEpoch(timestamp)
+                             .toString(QStringLiteral("HH:mm"));
+        }
+        return m_timeText;
+    }
+
+    /**
+     * @brief Стикероподобное сообщение: стикер или одни эмодзи без вложений.
+     *
+     * Такие строки делегат рисует по быстрому пути — одна картинка или
+     * пара крупных глифов без пузыря и без верстки QTextDocument (это
+     * самые дорогие строки общего пути). Результат кэшируется по образцу
+     * timeText: модель прогревает флаг при загрузке, делегат читает
+     * готовое значение на каждый paint.
+     */
+    bool isStickerLike() const {
+        if (m_stickerLike == 0) {
+            const bool like =
+                messageType == Sticker
+                || (messageType == Text && fileId.isEmpty()
+                    && emojiOnlyPayload(payload.toString()));
+            m_stickerLike = like ? 2 : 1;
+        }
+        return m_stickerLike == 2;
+    }
+
+private:
+    /// Максимум эмодзи-глифов, при котором сообщение считается "одни эмодзи"
+    static constexpr int MaxEmojiGlyphs = 8;
+
+    /**
+     * @brief Состоит ли текст только из эмодзи (и их модификаторов).
+     * Распознаются основные блоки эмодзи, флаги, ZWJ-связки и селекторы
+     * вариантов; любой обычный символ — и сообщение идет по общему пути.
+     */
+    static bool emojiOnlyPayload(const QString& text) {
+        if (text.isEmpty() || text.size() > MaxEmojiGlyphs * 8)
+            return false;
+        const QChar* ch = text.constData();
+        int glyphs = 0;
+        qsizetype i = 0;
+        while (i < text.size()) {
+            char32_t cp = ch[i].unicode();
+            if (ch[i].isHighSurrogate() && i + 1 < text.size()
+                && ch[i + 1].isLowSurrogate()) {
+                cp = QChar::surrogateToUcs4(ch[i], ch[i + 1]);
+                i += 2;
+            } else {
+                ++i;
+            }
+            if (cp == 0x200D || cp == 0xFE0F) continue;  // ZWJ и селектор варианта
+            if ((cp >= 0x1F300 && cp <= 0x1FAFF)         // основные блоки эмодзи
+                || (cp >= 0x1F1E6 && cp <= 0x1F1FF)      // региональные флаги
+                || (cp >= 0x2600 && cp <= 0x27BF)) {     // пиктограммы и дингбаты
+                ++glyphs;
+                continue;
+            }
+            return false;
+        }
+        return glyphs > 0 && glyphs <= MaxEmojiGlyphs;
+    }
+
+    mutable QString m_timeText;       ///< Кэш отформатированного времени
+    mutable quint8 m_stickerLike = 0; ///< Кэш флага: 0 не считан, 1 нет, 2 да
 };
 
 /**
@@ -146,6 +232,36 @@ inline bool operator==(const ChatMessage& lhs, const ChatMessage& rhs) {
     return lhs.id == rhs.id;
 }
 
+/**
+ * @brief Сохраненная позиция прокрутки чата.
+ *
+ * Позиция задается якорем — верхним видимым сообщением — и пиксельным
+ * смещением его верха от верха вьюпорта (ноль или отрицательное: часть
+ * пузыря может быть выше границы). Привязка к сообщению, а не к значению
+ * скроллбара, переживает дозагрузку истории и пересчет высот.
+ */
+struct ChatScrollAnchor {
+    qint64 messageId = 0; ///< ID якорного сообщения (0 — чат был прокручен вниз)
+    int pixelOffset = 0;  ///< Смещение верха якоря от верха вьюпорта, px (<= 0)
+};
+
+/**
+ * @brief Хендл сообщения, разрешенного по точке клика.
+ *
+ * Вью один раз извлекает строку и копию полей из модели, и дальше
+ * контекстное меню и потоки ответа/редактирования работают с хендлом —
+ * без повторных поисков сообщения по id на каждом действии.
+ * QPersistentModelIndex переживает сдвиг строк (дозагрузку истории),
+ * пока сообщение остается в окне модели.
+ */
+struct ChatMessageHandle {
+    QPersistentModelIndex index; ///< Стабильная строка модели
+    ChatMessage message;         ///< Копия полей на момент клика
+
+    /** @brief Хендл указывает на живую строку модели. */
+    bool isValid() const { return index.isValid(); }
+};
+
 /**
  * @brief Кеш истории сообщений для одного чата.
  *
@@ -156,6 +272,7 @@ struct ChatCache {
     QList<ChatMessage> messages;       ///< Список загруженных сообщений
     qint64 oldestMessageId = -1;       ///< ID самого старого сообщения в кеше (для пагинации)
     bool allMessagesLoaded = false;    ///< Флаг: вся история чата загружена полностью
+    bool prefetched = false;           ///< Окно прогрето префетчером: открытие чата не ходит в БД
 };
 
 /**
@@ -172,6 +289,20 @@ struct CallItem {
     int durationSeconds;       ///< Длительность разговора в секундах
 };
 
+/**
+ * @brief Результат полнотекстового поиска по сообщениям.
+ *
+ * Возвращается локальным FTS-индексом: хранит ID найденного сообщения,
+ * чат, фрагмент текста с совпадением и релевантность для сортировки.
+ */
+struct MessageSearchHit {
+    qint64 messageId = 0;      ///< server_id найденного сообщения
+    QString chatPartner;       ///< Собеседник чата, где найдено сообщение
+    QString snippet;           ///< Фрагмент текста вокруг совпадения
+    qint64 timestamp = 0;      ///< Время сообщения (мс эпохи)
+    double rank = 0.0;         ///< Релевантность bm25 (меньше — лучше)
+};
+
 /**
  * @brief Информация о загруженном файле для кеширования.
  */
@@ -0,0 +1,124 @@
+#ifndef THREADCHECK_H
+#define THREADCHECK_H
+
+#include <QObject>
+#include <QThread>
+#include <QDebug>
+#include <atomic>
+
+/**
+ * @brief Дешевые проверки потоковой принадлежности и реентерабельности.
+ *
+ * Сервисы разъехались по потокам (воркер БД, декодер сети, аудиопоток,
+ * комнаты конференций) и общаются очередями событий; общих данных нет —
+ * пока каждый метод действительно вызывается на потоке своего объекта.
+ * Ошибку такого рода (прямой вызов вместо invokeMethod, connect без
+ * QueuedConnection между потоками) компилятор не ловит, а проявляется
+ * она редкой порчей данных в проде.
+ *
+ * THREAD_AFFINITY_ASSERT ставится на входные точки сервисов и стоит:
+ *  - в отладочной сборке — полная проверка на каждом вызове, нарушение
+ *    валит процесс с именем метода (ошибку чинят, а не наблюдают);
+ *  - в релизе — проверяется каждый AffinitySampleMask+1-й вызов
+ *    (инкремент атомарного счетчика на остальных), нарушение попадает
+ *    в журнал qCritical, процесс продолжает работу.
+ *
+ * ReentrancyGuard ловит повторный вход в метод через вложенный цикл
+ * событий (processEvents, модальный диалог) — классический источник
+ * разрушения состояния "самим собой". Взведение флага стоит одну запись
+ * bool; вложенные блокировки в проекте не используются (единственные
+ * мьютексы — листовые, в PerfMetrics и StringPool), поэтому трекинг
+ * порядка локов здесь не нужен.
+ */
+namespace ThreadCheck {
+
+/// Релизная выборка: проверяется каждый (маска+1)-й вызов точки входа
+constexpr unsigned AffinitySampleMask = 255;
+
+/** @brief Метод вызван на потоке, которому принадлежит объект. */
+inline bool onOwnThread(const QObject* object)
+{
+    return QThread::currentThread() == object->thread();
+}
+
+/** @brief Нарушение принадлежности в отладочной сборке: валим процесс. */
+inline void failAffinity(const QObject* object, const char* where)
+{
+    qFatal("[ThreadCheck] %s called on thread '%s', object lives on '%s'",
+           where,
+           qUtf8Printable(QThread::currentThread()->objectName()),
+           qUtf8Printable(object->thread()->objectName()));
+}
+
+/** @brief Нарушение принадлежности в релизе: журнал, работа продолжается. */
+inline void warnAffinity(const QObject* object, const char* where)
+{
+    qCritical() << "[ThreadCheck] Thread affinity violation:" << where
+                << "called on" << QThread::currentThread()->objectName()
+                << "object lives on" << object->thread()->objectName();
+}
+
+/**
+ * @brief RAII-страж от повторного входа в метод.
+ *
+ * Держит ссылку на флаг-член объекта: конструктор проверяет и взводит,
+ * деструктор снимает. Повторный вход (вложенный цикл событий добрался
+ * до того же слота) в отладке фатален, в релизе логируется.
+ */
+class ReentrancyGuard
+{
+public:
+    ReentrancyGuard(bool& flag, const char* where)
+        : m_flag(flag)
+    {
+        if (m_flag) {
+#ifdef QT_DEBUG
+            qFatal("[ThreadCheck] Reentered %s via nested event loop", where);
+#else
+            qCritical() << "[ThreadCheck] Reentered" << where
+                        << "via nested event loop";
+#endif
+        }
+        m_flag = true;
+    }
+
+    ~ReentrancyGuard() { m_flag = false; }
+
+    ReentrancyGuard(const ReentrancyGuard&) = delete;
+    ReentrancyGuard& operator=(const ReentrancyGuard&) = delete;
+
+private:
+    bool& m_flag; ///< Флаг "внутри метода" (член охраняемого объекта)
+};
+
+} // namespace ThreadCheck
+
+/**
+ * @brief Проверка, что метод выполняется на потоке своего объекта.
+ *
+ * Ставится первой строкой входных точек сервисов, живущих не на
+ * GUI-потоке (и наоборот — GUI-сервисов, которые нельзя звать с
+ * воркеров). Пишется с this: THREAD_AFFINITY_ASSERT(this).
+ */
+#ifdef QT_DEBUG
+#define THREAD_AFFINITY_ASSERT(object)                                        \
+    do {                                                                      \
+        if (!ThreadCheck::onOwnThread(object))                                \
+            ThreadCheck::failAffinity(object, Q_FUNC_INFO);                   \
+    } while (false)
+#else
+#define THREAD_AFFINITY_ASSERT(object)                                        \
+    do {                                                                      \
+        static std::atomic<unsigned> threadCheckCalls { 0 };                  \
+        if ((threadCheckCalls.fetch_add(1, std::memory_order_relaxed)         \
+             & ThreadCheck::AffinitySampleMask) == 0                          \
+            && !ThreadCheck::onOwnThread(object))                             \
+            ThreadCheck::warnAffinity(object, Q_FUNC_INFO);                   \
+    } while (false)
+#endif
+
+/** @brief Страж от повторного входа; flag — bool-член охраняемого объекта. */
+#define REENTRANCY_GUARD(flag)                                                \
+    ThreadCheck::ReentrancyGuard threadCheckReentrancyGuard(flag, Q_FUNC_INFO)
+
+#endif // THREADCHECK_H
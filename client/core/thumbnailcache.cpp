@@ -0,0 +1,193 @@
+#include "thumbnailcache.h"
+#include "httpclient.h"
+#include <QFile>
+#include <QDebug>
+
+//См. "thumbnailcache.h"
+
+void ThumbnailWorker::makeThumbnail(const QString& fileId,
+                                    const QString& sourcePath,
+                                    int maxWidth, int maxHeight,
+                                    const QString& thumbPath,
+                                    const QString& previewPath)
+{
+    QImage original(sourcePath);
+    if (original.isNull()) {
+        qDebug() << "[ThumbCache] Не удалось декодировать оригинал"
+                 << fileId << sourcePath;
+        return;
+    }
+
+    // Вписываем в экранный бокс — больше пикселей пузырь не покажет,
+    // а хранить и блитить полный кадр незачем
+    QImage thumb = original.scaled(maxWidth, maxHeight,
+                                   Qt::KeepAspectRatio,
+                                   Qt::SmoothTransformation);
+
+    // Персистентный ярус: повторный запуск приложения декод не повторяет
+    if (!thumb.save(thumbPath, "PNG")) {
+        qDebug() << "[ThumbCache] Не удалось сохранить миниатюру" << thumbPath;
+    }
+
+    // Крошечное превью: декодируется мгновенно и апскейлится в
+    // размытую заглушку, пока миниатюра делается заново
+    QImage preview = thumb.scaled(PreviewWidth, PreviewWidth,
+                                  Qt::KeepAspectRatio,
+                                  Qt::FastTransformation);
+    preview.save(previewPath, "PNG");
+
+    emit thumbnailReady(fileId, thumb);
+}
+
+ThumbnailCache::ThumbnailCache(QObject* parent)
+    : QObject(parent)
+{
+    // Та же схема каталогов, что у AvatarCache: оригиналы рядом с
+    // рабочей директорией, миниатюры — отдельным ярусом
+    m_mediaDir = QDir(QDir::currentPath() + "/media_cache");
+    if (!m_mediaDir.exists())
+        QDir().mkpath(m_mediaDir.path());
+
+    m_thumbDir = QDir(m_mediaDir.filePath("thumbs"));
+    if (!m_thumbDir.exists())
+        QDir().mkpath(m_thumbDir.path());
+
+    // Поток изготовления миниатюр (декод + уменьшение вне GUI)
+    m_worker = new ThumbnailWorker();
+    m_worker->moveToThread(&m_workerThread);
+    connect(&m_workerThread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_worker, &ThumbnailWorker::thumbnailReady,
+            this, &ThumbnailCache::onThumbnailReady);
+    m_workerThread.setObjectName("media-thumb");
+    m_workerThread.start();
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    m_workerThread.quit();
+    m_workerThread.wait();
+}
+
+QPixmap ThumbnailCache::thumbnail(const QString& fileId,
+                                  int maxWidth, int maxHeight)
+{
+    if (fileId.isEmpty() || maxWidth <= 0 || maxHeight <= 0)
+        return QPixmap();
+
+    // 1. Кеш в памяти
+    auto it = m_thumbCache.constFind(fileId);
+    if (it != m_thumbCache.constEnd()) {
+        m_thumbLru.removeOne(fileId);
+        m_thumbLru.append(fileId);
+        return it.value();
+    }
+
+    // 2. Готовый PNG на диске (дешевый декод маленького файла)
+    const QString thumbPath = m_thumbDir.filePath(fileId + "_thumb.png");
+    QFile thumbFile(thumbPath);
+    if (thumbFile.exists() && thumbFile.size() > 0) {
+        QPixmap pm(thumbPath);
+        if (!pm.isNull()) {
+            insertThumbnail(fileId, pm);
+            return pm;
+        }
+    }
+
+    // 3. Миниатюры нет — изготовление (и скачивание при нужде) в фон
+    scheduleThumbnail(fileId, maxWidth, maxHeight);
+
+    // 4. Пока она зреет — размытая заглушка из крошечного превью
+    auto pit = m_previewCache.constFind(fileId);
+    if (pit != m_previewCache.constEnd())
+        return pit.value();
+
+    const QString previewPath = m_thumbDir.filePath(fileId + "_preview.png");
+    QFile previewFile(previewPath);
+    if (previewFile.exists() && previewFile.size() > 0) {
+        QImage tiny(previewPath);
+        if (!tiny.isNull()) {
+            // Апскейл со сглаживанием дает мягкое "размытие"
+            QPixmap pm = QPixmap::fromImage(
+                tiny.scaled(maxWidth, maxHeight,
+                            Qt::KeepAspectRatio,
+                            Qt::SmoothTransformation));
+            m_previewCache.insert(fileId, pm);
+            return pm;
+        }
+    }
+
+    return QPixmap();
+}
+
+void ThumbnailCache::scheduleThumbnail(const QString& fileId,
+                                       int maxWidth, int maxHeight)
+{
+    if (m_pending.contains(fileId))
+        return;
+    m_pending.insert(fileId);
+
+    const QString sourcePath  = m_mediaDir.filePath(fileId);
+    const QString thumbPath   = m_thumbDir.filePath(fileId + "_thumb.png");
+    const QString previewPath = m_thumbDir.filePath(fileId + "_preview.png");
+
+    QFile sourceFile(sourcePath);
+    if (sourceFile.exists() && sourceFile.size() > 0) {
+        // Оригинал уже скачан — сразу в рабочий поток
+        QMetaObject::invokeMethod(m_worker, "makeThumbnail",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QString, fileId),
+                                  Q_ARG(QString, sourcePath),
+                                  Q_ARG(int, maxWidth),
+                                  Q_ARG(int, maxHeight),
+                                  Q_ARG(QString, thumbPath),
+                                  Q_ARG(QString, previewPath));
+        return;
+    }
+
+    // Оригинала нет — скачиваем через общий HTTP-слой: keep-alive, кэш
+    // DNS, запись на диск по мере прихода; оборванная закачка большого
+    // медиа продолжается Range-запросом с хвоста .part
+    QUrl fileUrl("http://localhost:9090/files/download/" + fileId);
+    HttpClient::instance()->download(
+        fileUrl, sourcePath, HttpClient::Lane::Background,
+        [this, fileId, sourcePath, maxWidth, maxHeight,
+         thumbPath, previewPath](bool ok, const QString& error) {
+            if (!ok) {
+                qDebug() << "[ThumbCache] Оригинал" << fileId
+                         << "не скачался:" << error;
+                m_pending.remove(fileId);
+                return;
+            }
+            qDebug() << "[ThumbCache] Скачан оригинал" << fileId;
+            QMetaObject::invokeMethod(m_worker, "makeThumbnail",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(QString, fileId),
+                                      Q_ARG(QString, sourcePath),
+                                      Q_ARG(int, maxWidth),
+                                      Q_ARG(int, maxHeight),
+                                      Q_ARG(QString, thumbPath),
+                                      Q_ARG(QString, previewPath));
+        });
+}
+
+void ThumbnailCache::onThumbnailReady(const QString& fileId,
+                                      const QImage& image)
+{
+    m_pending.remove(fileId);
+    m_previewCache.remove(fileId); // Заглушка больше не нужна
+    insertThumbnail(fileId, QPixmap::fromImage(image));
+    emit thumbnailReady(fileId);
+}
+
+void ThumbnailCache::insertThumbnail(const QString& fileId,
+                                     const QPixmap& pixmap)
+{
+    m_thumbCache.insert(fileId, pixmap);
+    m_thumbLru.removeOne(fileId);
+    m_thumbLru.append(fileId);
+
+    // Вытесняем самые давние миниатюры сверх лимита (диск не трогаем)
+    while (m_thumbLru.size() > MaxThumbnails) {
+        m_thumbCache.remove(m_thumbLru.takeFirst());
+    }
+}
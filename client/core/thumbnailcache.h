@@ -0,0 +1,144 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QObject>
+#include <QDir>
+#include <QImage>
+#include <QPixmap>
+#include <QMap>
+#include <QSet>
+#include <QThread>
+
+/**
+ * @brief Фоновое изготовление миниатюр изображений из сообщений.
+ *
+ * Живет в отдельном потоке: декодирует оригинал полного размера,
+ * вписывает его в экранный бокс и сохраняет PNG на диск, чтобы
+ * полноразмерный декод никогда не выполнялся в paint() делегата.
+ * Заодно сохраняет крошечное превью — при следующем запуске оно
+ * декодируется мгновенно и апскейлится в размытую заглушку.
+ */
+class ThumbnailWorker : public QObject {
+    Q_OBJECT
+
+public:
+    /** @brief Ширина крошечного превью-заглушки, пикселей. */
+    static constexpr int PreviewWidth = 24;
+
+public slots:
+    /**
+     * @brief Делает миниатюру и превью из оригинала изображения.
+     * @param fileId ID файла (ключ кеша)
+     * @param sourcePath Путь к скачанному оригиналу
+     * @param maxWidth Максимальная ширина миниатюры в пикселях
+     * @param maxHeight Максимальная высота миниатюры в пикселях
+     * @param thumbPath Путь для сохранения PNG миниатюры
+     * @param previewPath Путь для сохранения PNG превью
+     */
+    void makeThumbnail(const QString& fileId, const QString& sourcePath,
+                       int maxWidth, int maxHeight,
+                       const QString& thumbPath, const QString& previewPath);
+
+signals:
+    /**
+     * @brief Готовая миниатюра (QImage безопасен между потоками).
+     */
+    void thumbnailReady(const QString& fileId, const QImage& image);
+};
+
+/**
+ * @brief Кеш миниатюр изображений-сообщений (ключ — fileId).
+ *
+ * Медиа-тракт чата: оригинал скачивается один раз в media_cache/,
+ * миниатюра под размер пузыря изготавливается в рабочем потоке и
+ * дальше живет тремя ярусами — ограниченный кеш QPixmap в памяти,
+ * PNG на диске (thumbs/), изготовление в фоне. Пока миниатюра зреет,
+ * thumbnail() возвращает размытый апскейл крошечного превью с
+ * прошлого запуска или пустой QPixmap (делегат рисует подложку).
+ * О готовности сообщает сигнал thumbnailReady — получателю
+ * достаточно перерисовать вьюпорт (та же схема, что у AvatarCache).
+ */
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Конструктор. Создает директории кеша и рабочий поток.
+     * @param parent Родительский QObject для управления временем жизни
+     */
+    explicit ThumbnailCache(QObject* parent = nullptr);
+
+    /** @brief Деструктор. Останавливает рабочий поток. */
+    ~ThumbnailCache() override;
+
+    /**
+     * @brief Возвращает миниатюру изображения под экранный бокс.
+     *
+     * Сначала проверяется кеш в памяти, затем PNG на диске; при
+     * промахе изготовление (и скачивание оригинала при необходимости)
+     * уходит в фон, а вызывающему возвращается размытая заглушка из
+     * превью или пустой QPixmap.
+     *
+     * @param fileId ID файла на сервере
+     * @param maxWidth Максимальная ширина бокса в пикселях
+     * @param maxHeight Максимальная высота бокса в пикселях
+     * @return Миниатюра, размытая заглушка или пустой QPixmap
+     */
+    QPixmap thumbnail(const QString& fileId, int maxWidth, int maxHeight);
+
+signals:
+    /**
+     * @brief Миниатюра готова к отрисовке.
+     *
+     * Следующий вызов thumbnail() с тем же fileId вернет ее из кеша
+     * в памяти; получателю достаточно перерисовать вьюпорт.
+     * @param fileId ID файла
+     */
+    void thumbnailReady(const QString& fileId);
+
+private slots:
+    /** @brief Принимает готовую миниатюру из рабочего потока. */
+    void onThumbnailReady(const QString& fileId, const QImage& image);
+
+private:
+    /**
+     * @brief Запускает изготовление миниатюры в фоне.
+     *
+     * Если оригинала нет на диске, он сначала скачивается с файлового
+     * сервера (тот же путь, что у файлов и аватаров), и лишь затем
+     * задание уходит в рабочий поток. Ключи в работе дедуплицируются.
+     */
+    void scheduleThumbnail(const QString& fileId, int maxWidth, int maxHeight);
+
+    /** @brief Кладет миниатюру в кеш памяти, вытесняя давние сверх лимита. */
+    void insertThumbnail(const QString& fileId, const QPixmap& pixmap);
+
+    // Предел кеша миниатюр в памяти
+    static constexpr int MaxThumbnails = 128;
+
+    /**
+     * @brief Директория скачанных оригиналов.
+     *
+     * Путь: <current_dir>/media_cache/
+     * Файлы именуются как <fileId>.
+     */
+    QDir m_mediaDir;
+
+    QDir m_thumbDir;                 ///< Миниатюры и превью (thumbs/)
+    QThread m_workerThread;          ///< Поток изготовления миниатюр
+    ThumbnailWorker* m_worker;       ///< Работник (живет в m_workerThread)
+
+    /** @brief Кеш готовых миниатюр в памяти. Ключ: fileId. */
+    QMap<QString, QPixmap> m_thumbCache;
+
+    /** @brief Апскейленные превью-заглушки (до готовности миниатюры). */
+    QMap<QString, QPixmap> m_previewCache;
+
+    /** @brief Порядок использования ключей миниатюр (конец — свежие). */
+    QList<QString> m_thumbLru;
+
+    /** @brief Файлы, уже отданные в скачивание/изготовление. */
+    QSet<QString> m_pending;
+};
+
+#endif // THUMBNAILCACHE_H
@@ -0,0 +1,133 @@
+//См. "timerhub.h"
+#include "timerhub.h"
+
+#include <QDebug>
+#include <QPointer>
+
+#include <algorithm>
+#include <climits>
+
+TimerHub& TimerHub::instance()
+{
+    // Первый вызов обязан прийти из главного потока (см. доку класса);
+    // дальше экземпляр живет до конца процесса
+    static TimerHub hub;
+    return hub;
+}
+
+TimerHub::TimerHub(QObject* parent)
+    : QObject(parent)
+{
+    // Ведущий таймер грубый и одноразовый: после каждого пробуждения он
+    // перевзводится на новый ближайший дедлайн
+    m_driver.setTimerType(Qt::CoarseTimer);
+    m_driver.setSingleShot(true);
+    connect(&m_driver, &QTimer::timeout, this, &TimerHub::onDriverFired);
+
+    m_clock.start();
+    m_rateWindow.start();
+    m_auditEnabled = qEnvironmentVariableIsSet("MESSENGER_WAKE_AUDIT");
+}
+
+double TimerHub::wakeupsPerSecond() const
+{
+    const qint64 elapsed = m_rateWindow.elapsed();
+    if (elapsed <= 0) return 0.0;
+    return double(m_wakes) * 1000.0 / double(elapsed);
+}
+
+void TimerHub::attach(CoalescedTimer* timer)
+{
+    m_timers.append(timer);
+}
+
+void TimerHub::detach(CoalescedTimer* timer)
+{
+    m_timers.removeOne(timer);
+    rearm();
+}
+
+void TimerHub::rearm()
+{
+    qint64 nearest = -1;
+    for (CoalescedTimer* timer : std::as_const(m_timers)) {
+        if (timer->m_dueMs < 0) continue;
+        if (nearest < 0 || timer->m_dueMs < nearest) {
+            nearest = timer->m_dueMs;
+        }
+    }
+    if (nearest < 0) {
+        // Ни одного взведенного таймера — хаб не тикает вовсе
+        m_driver.stop();
+        return;
+    }
+    const qint64 delay = qMax<qint64>(0, nearest - m_clock.elapsed());
+    m_driver.start(int(qMin<qint64>(delay, INT_MAX)));
+}
+
+void TimerHub::onDriverFired()
+{
+    ++m_wakes;
+
+    // Одно пробуждение обслуживает все дедлайны в пределах окна склейки:
+    // таймер, которому осталось меньше SlackMs, срабатывает сейчас, а не
+    // отдельным пробуждением через долю секунды
+    const qint64 now = m_clock.elapsed();
+    const qint64 horizon = now + SlackMs;
+
+    // Обработчик timeout может взводить и удалять таймеры (сброс черновика
+    // запускает новую коалесценцию) — идем по снимку списка под защитой
+    const QList<QPointer<CoalescedTimer>> snapshot(m_timers.begin(), m_timers.end());
+    for (const QPointer<CoalescedTimer>& timer : snapshot) {
+        if (!timer || timer->m_dueMs < 0 || timer->m_dueMs > horizon) continue;
+        if (timer->m_singleShot) {
+            timer->m_dueMs = -1;
+        } else {
+            // Повторный таймер шагает от дедлайна, а не от "сейчас", чтобы
+            // окно склейки не накапливало дрейф интервала
+            timer->m_dueMs += qMax(1, timer->m_intervalMs);
+        }
+        emit timer->timeout();
+    }
+
+    rearm();
+
+    if (m_auditEnabled && m_rateWindow.elapsed() >= RateLogIntervalMs) {
+        qInfo() << "[TimerHub]" << QString::number(wakeupsPerSecond(), 'f', 2)
+                << "wakeups/sec over the last" << m_rateWindow.elapsed() / 1000 << "s"
+                << "(" << m_timers.size() << "timers registered )";
+        m_wakes = 0;
+        m_rateWindow.restart();
+    }
+}
+
+CoalescedTimer::CoalescedTimer(QObject* parent)
+    : QObject(parent)
+{
+    TimerHub::instance().attach(this);
+}
+
+CoalescedTimer::~CoalescedTimer()
+{
+    TimerHub::instance().detach(this);
+}
+
+void CoalescedTimer::start()
+{
+    start(m_intervalMs);
+}
+
+void CoalescedTimer::start(int msec)
+{
+    m_intervalMs = msec;
+    TimerHub& hub = TimerHub::instance();
+    m_dueMs = hub.m_clock.elapsed() + qMax(0, msec);
+    hub.rearm();
+}
+
+void CoalescedTimer::stop()
+{
+    if (m_dueMs < 0) return;
+    m_dueMs = -1;
+    TimerHub::instance().rearm();
+}
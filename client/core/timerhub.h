@@ -0,0 +1,128 @@
+#ifndef TIMERHUB_H
+#define TIMERHUB_H
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QElapsedTimer>
+
+class CoalescedTimer;
+
+/**
+ * @class TimerHub
+ * @brief Единый источник пробуждений для грубых таймеров клиента.
+ *
+ * @details Клиент исторически обзавелся десятком независимых QTimer —
+ * реапер surface-виджетов, сброс черновиков, ленивые счетчики, истечение
+ * статусов "печатает". Каждый из них — отдельный источник пробуждения:
+ * событийный цикл просыпается на каждый дедлайн по отдельности, что
+ * фрагментирует простой и мешает ядру углублять C-состояния (картину
+ * показывает WakeAudit). Ни одному из этих таймеров точность до
+ * миллисекунды не нужна.
+ *
+ * Хаб держит ровно один ведущий QTimer (Qt::CoarseTimer) и взводит его на
+ * ближайший дедлайн из всех зарегистрированных CoalescedTimer. При
+ * срабатывании выполняются все таймеры, чей дедлайн попадает в окно
+ * SlackMs от текущего момента, — соседние дедлайны склеиваются в одно
+ * пробуждение. Цель: меньше 5 пробуждений в секунду у простаивающего
+ * клиента вместо сотен.
+ *
+ * Точным таймерам (аудио-джиттер, тон вызова) здесь не место — они
+ * остаются обычными QTimer с Qt::PreciseTimer. Хаб — только для
+ * хозяйственных задач, которым все равно, когда именно в пределах
+ * четверти секунды сработать.
+ *
+ * Потоки: хаб живет в главном потоке и обслуживает только его таймеры.
+ */
+class TimerHub : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Окно склейки дедлайнов: таймеры ближе SlackMs делят пробуждение, мс. */
+    static constexpr int SlackMs = 250;
+
+    /** @brief Минимальный интервал между сводками частоты пробуждений, мс. */
+    static constexpr qint64 RateLogIntervalMs = 60 * 1000;
+
+    /** @brief Единственный экземпляр хаба (создается при первом обращении). */
+    static TimerHub& instance();
+
+    /**
+     * @brief Текущая частота ведущих пробуждений, шт/с.
+     * @details Скользящее окно с последней сводки; диагностика для
+     * WakeAudit и ручной проверки цели "< 5 пробуждений/с в простое".
+     */
+    double wakeupsPerSecond() const;
+
+private:
+    explicit TimerHub(QObject* parent = nullptr);
+
+    /** @brief Перевзводит ведущий таймер на ближайший дедлайн (или останавливает). */
+    void rearm();
+
+    /** @brief Выполняет все таймеры с дедлайном в пределах SlackMs от "сейчас". */
+    void onDriverFired();
+
+    // Регистрация и планирование доступны только самим таймерам
+    friend class CoalescedTimer;
+    void attach(CoalescedTimer* timer);
+    void detach(CoalescedTimer* timer);
+
+    QTimer m_driver;                     ///< Единственный ведущий таймер
+    QList<CoalescedTimer*> m_timers;     ///< Все таймеры хаба (активные и нет)
+    QElapsedTimer m_clock;               ///< Монотонные часы дедлайнов
+    QElapsedTimer m_rateWindow;          ///< Окно счетчика пробуждений
+    quint64 m_wakes = 0;                 ///< Пробуждений в текущем окне
+    bool m_auditEnabled = false;         ///< Сводки включены (MESSENGER_WAKE_AUDIT)
+};
+
+/**
+ * @class CoalescedTimer
+ * @brief Грубый таймер, разделяющий пробуждения с остальными через TimerHub.
+ *
+ * @details Повторяет подмножество интерфейса QTimer, которым пользуется
+ * клиентский код (setInterval/setSingleShot/start/stop/isActive и сигнал
+ * timeout) — миграция хозяйственного таймера сводится к замене типа.
+ * Собственного системного таймера у экземпляра нет: дедлайн регистрируется
+ * в хабе, и срабатывание может опоздать на величину до TimerHub::SlackMs.
+ */
+class CoalescedTimer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoalescedTimer(QObject* parent = nullptr);
+    ~CoalescedTimer() override;
+
+    /** @brief Интервал по умолчанию для start() без аргумента, мс. */
+    void setInterval(int msec) { m_intervalMs = msec; }
+    int interval() const { return m_intervalMs; }
+
+    /** @brief Однократный режим: таймер сам останавливается после срабатывания. */
+    void setSingleShot(bool singleShot) { m_singleShot = singleShot; }
+    bool isSingleShot() const { return m_singleShot; }
+
+    /** @brief Взведен ли таймер в данный момент. */
+    bool isActive() const { return m_dueMs >= 0; }
+
+public slots:
+    /** @brief Взводит таймер на интервал по умолчанию (перевзводит, если активен). */
+    void start();
+
+    /** @brief Взводит таймер на msec миллисекунд (интервал запоминается). */
+    void start(int msec);
+
+    /** @brief Снимает таймер с взвода; таймер без взвода — допустимый no-op. */
+    void stop();
+
+signals:
+    /** @brief Срабатывание таймера (с опозданием до TimerHub::SlackMs). */
+    void timeout();
+
+private:
+    friend class TimerHub;
+    int m_intervalMs = 0;     ///< Интервал по умолчанию
+    bool m_singleShot = false;///< Остановиться после первого срабатывания
+    qint64 m_dueMs = -1;      ///< Дедлайн по часам хаба; -1 — не взведен
+};
+
+#endif // TIMERHUB_H
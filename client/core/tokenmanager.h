@@ -100,12 +100,66 @@ public:
         settings.remove("auth/token");
         settings.remove("auth/username");
         settings.remove("auth/timestamp");
+        settings.remove("resume/server_key");
+        settings.remove("resume/contacts_rev");
 
         settings.sync();
 
         qDebug() << "[TokenManager] Token cleared";
     }
 
+    /**
+     * @brief Сохраняет резюм-ключ сервера для 0-RTT входа при следующем запуске.
+     *
+     * Сервер рекламирует ключ в каждом ответе-рукопожатии; с ним клиент может
+     * запечатать token_login прямо в кадр рукопожатия следующего подключения.
+     *
+     * @param keyBase64 Публичный резюм-ключ сервера (Base64, 32 байта)
+     */
+    static void saveResumeKey(const QString& keyBase64)
+    {
+        QString configPath = getConfigPath();
+        QSettings settings(configPath, QSettings::IniFormat);
+        settings.setValue("resume/server_key", keyBase64);
+    }
+
+    /**
+     * @brief Загружает сохраненный резюм-ключ сервера.
+     * @return Ключ в Base64 или пустая строка, если кэша нет.
+     */
+    static QString getResumeKey()
+    {
+        QString configPath = getConfigPath();
+        QSettings settings(configPath, QSettings::IniFormat);
+        return settings.value("resume/server_key", "").toString();
+    }
+
+    /**
+     * @brief Сохраняет подтвержденную сервером версию списка контактов.
+     *
+     * Версия вкладывается в 0-RTT пакет возобновления, чтобы сервер сразу
+     * ответил дельтой списка, а не полным снимком.
+     *
+     * @param rev Версия списка контактов (contacts_rev)
+     */
+    static void saveContactsRev(qint64 rev)
+    {
+        QString configPath = getConfigPath();
+        QSettings settings(configPath, QSettings::IniFormat);
+        settings.setValue("resume/contacts_rev", rev);
+    }
+
+    /**
+     * @brief Загружает последнюю подтвержденную версию списка контактов.
+     * @return Версия или -1, если кэша нет (сервер пришлет полный список).
+     */
+    static qint64 getContactsRev()
+    {
+        QString configPath = getConfigPath();
+        QSettings settings(configPath, QSettings::IniFormat);
+        return settings.value("resume/contacts_rev", -1).toLongLong();
+    }
+
     /**
      * @brief Проверяет срок действия токена.
      *
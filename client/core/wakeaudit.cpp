@@ -0,0 +1,106 @@
+//См. "wakeaudit.h"
+#include "wakeaudit.h"
+
+#include <QEvent>
+#include <QTimerEvent>
+#include <QGuiApplication>
+#include <QDebug>
+
+void WakeAudit::install(QObject* app)
+{
+    if (qEnvironmentVariableIntValue("MESSENGER_WAKE_AUDIT") != 1) {
+        return;
+    }
+
+    // Фильтр живет столько же, сколько приложение — родитель удалит.
+    auto* audit = new WakeAudit(app);
+    app->installEventFilter(audit);
+    qInfo() << "[WakeAudit] Enabled: logging timer/meta-call wake sources while idle"
+            << "(idle after" << IdleAfterMs << "ms of no input)";
+}
+
+
+WakeAudit::WakeAudit(QObject* parent)
+    : QObject(parent)
+{
+    m_sinceInput.start();
+    m_sinceDump.start();
+}
+
+
+bool WakeAudit::eventFilter(QObject* watched, QEvent* event)
+{
+    const QEvent::Type type = event->type();
+
+    // Любой ввод пользователя сбрасывает отсчет простоя.
+    switch (type) {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+    case QEvent::KeyPress:
+    case QEvent::TouchBegin:
+        m_sinceInput.restart();
+        return false;
+    default:
+        break;
+    }
+
+    // Учитываются только пробуждения: срабатывания таймеров и отложенные
+    // queued-вызовы. Остальной поток событий аудит не трогает.
+    if (type != QEvent::Timer && type != QEvent::MetaCall) {
+        return false;
+    }
+
+    const bool appInactive =
+        QGuiApplication::applicationState() != Qt::ApplicationActive;
+    if (!appInactive && m_sinceInput.elapsed() < IdleAfterMs) {
+        return false; // Клиент активен — пробуждения легитимны
+    }
+
+    // Источник — класс и имя объекта-получателя: этого достаточно, чтобы
+    // найти таймер в коде (для QEvent::Timer добавляется timerId).
+    QByteArray source = watched->metaObject()->className();
+    if (!watched->objectName().isEmpty()) {
+        source += '/';
+        source += watched->objectName().toUtf8();
+    }
+    if (type == QEvent::MetaCall) {
+        source += " (meta-call)";
+    }
+
+    quint64& count = m_wakes[source];
+    if (count == 0) {
+        // Первое срабатывание источника в простое — сразу в лог.
+        if (type == QEvent::Timer) {
+            qInfo() << "[WakeAudit] Idle wake by timer" << static_cast<QTimerEvent*>(event)->timerId()
+                    << "of" << source.constData();
+        } else {
+            qInfo() << "[WakeAudit] Idle wake by queued call to" << source.constData();
+        }
+    }
+    ++count;
+    ++m_totalWakes;
+
+    // Сводка — лениво, при очередном событии: собственный таймер сделал бы
+    // аудит источником тех самых пробуждений, которые он ищет.
+    if (m_sinceDump.elapsed() >= DumpIntervalMs) {
+        dumpCounts();
+    }
+
+    return false;
+}
+
+
+void WakeAudit::dumpCounts()
+{
+    const double seconds = m_sinceDump.elapsed() / 1000.0;
+    qInfo() << "[WakeAudit]" << m_totalWakes << "idle wake(s) in the last"
+            << seconds << "s:";
+    for (auto it = m_wakes.constBegin(); it != m_wakes.constEnd(); ++it) {
+        qInfo() << "[WakeAudit]   " << it.value() << "x" << it.key().constData();
+    }
+
+    m_wakes.clear();
+    m_totalWakes = 0;
+    m_sinceDump.restart();
+}
@@ -0,0 +1,65 @@
+#ifndef WAKEAUDIT_H
+#define WAKEAUDIT_H
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+/**
+ * @class WakeAudit
+ * @brief Аудит источников пробуждения простаивающего клиента.
+ *
+ * @details Клиент в трее не должен тикать: каждый таймер или queued-вызов,
+ * срабатывающий без дела, будит процесс, мешает ядру углублять C-состояния
+ * и двигает нас вверх в рейтингах расхода батареи. Этот фильтр — режим
+ * диагностики для поиска таких источников: он ставится на все приложение
+ * (qApp) и, пока клиент простаивает, учитывает каждое событие QEvent::Timer
+ * и QEvent::MetaCall по классу и имени объекта-получателя.
+ *
+ * Простой определяется без собственного таймера (аудит не должен сам быть
+ * источником пробуждений): фильтр запоминает момент последнего ввода
+ * пользователя, и событие считается "пробуждением на холостом ходу", если
+ * ввода не было дольше IdleAfterMs либо приложение неактивно. Первое
+ * срабатывание каждого источника логируется сразу (с понятным виновником),
+ * агрегированная таблица выводится не чаще раза в DumpIntervalMs — лениво,
+ * при очередном событии.
+ *
+ * Включается переменной окружения `MESSENGER_WAKE_AUDIT=1` (как трассировка
+ * MESSENGER_TRACE); в обычном режиме фильтр не устанавливается и не стоит
+ * ничего.
+ */
+class WakeAudit : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Порог тишины ввода, после которого клиент считается простаивающим, мс. */
+    static constexpr qint64 IdleAfterMs = 5000;
+
+    /** @brief Минимальный интервал между агрегированными сводками, мс. */
+    static constexpr qint64 DumpIntervalMs = 30000;
+
+    /**
+     * @brief Устанавливает аудит на приложение, если включен в окружении.
+     * @details Вызывается один раз из main() после создания QApplication;
+     * без MESSENGER_WAKE_AUDIT=1 ничего не делает.
+     * @param app Объект приложения (qApp).
+     */
+    static void install(QObject* app);
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+private:
+    explicit WakeAudit(QObject* parent);
+
+    /** @brief Выводит агрегированную таблицу источников и обнуляет счетчики. */
+    void dumpCounts();
+
+    QElapsedTimer m_sinceInput;            ///< Время с последнего ввода пользователя
+    QElapsedTimer m_sinceDump;             ///< Время с последней сводки
+    QHash<QByteArray, quint64> m_wakes;    ///< Источник -> число пробуждений в простое
+    quint64 m_totalWakes = 0;              ///< Всего пробуждений с последней сводки
+};
+
+#endif // WAKEAUDIT_H
@@ -1,14 +1,18 @@
 #include "chatmessagedelegate.h"
 #include "chatmessagemodel.h"
+#include "perfmetrics.h"
 #include "structures.h"
+#include "thumbnailcache.h"
 #include <QPainter>
 #include <QSvgRenderer>
 #include <QPainterPath>
 #include <algorithm>
+#include <QElapsedTimer>
 #include <QTextDocument>
 #include <QFileInfo>
 #include <QEvent>
 #include <QMouseEvent>
+#include <QCoreApplication>
 
 QString getFileIconPath(const QString& fileName) {
     QFileInfo fileInfo(fileName);
@@ -82,6 +86,60 @@ QString getFileIconPath(const QString& fileName) {
 QMap<ChatMessage::MessageStatus, QSvgRenderer*> ChatMessageDelegate::m_statusRenderers;
 QMap<QString, QPixmap> ChatMessageDelegate::m_iconCache;
 bool ChatMessageDelegate::m_renderersInitialized = false;
+QStringList ChatMessageDelegate::m_bubbleLru;
+
+QString ChatMessageDelegate::bubbleCacheKey(const ChatMessage& message,
+                                            int width, qreal dpr)
+{
+    // Статус и хеш текста входят в ключ: смена статуса или правка
+    // текста дает промах, и строка перерисовывается
+    return QString("bubble:%1:%2:%3:%4:%5:%6")
+        .arg(message.id)
+        .arg(width)
+        .arg(int(message.status))
+        .arg(message.isEdited ? 1 : 0)
+        .arg(qulonglong(qHash(message.payload)))
+        .arg(dpr);
+}
+
+void ChatMessageDelegate::touchBubble(const QString& key)
+{
+    m_bubbleLru.removeOne(key);
+    m_bubbleLru.append(key);
+}
+
+void ChatMessageDelegate::insertBubble(const QString& key, const QPixmap& pixmap)
+{
+    m_iconCache.insert(key, pixmap);
+    touchBubble(key);
+
+    // Вытесняем самые давние пузыри сверх лимита (иконки файлов живут
+    // под своими ключами и лимитом не затрагиваются)
+    while (m_bubbleLru.size() > MaxCachedBubbles) {
+        m_iconCache.remove(m_bubbleLru.takeFirst());
+    }
+}
+
+DocumentLayoutWorker::DocumentLayoutWorker(QObject* parent)
+    : QObject(parent)
+{
+}
+
+void DocumentLayoutWorker::layoutDocument(qint64 messageId,
+                                          const QString& payload,
+                                          int textWidth,
+                                          const QFont& font)
+{
+    auto* doc = new QTextDocument();
+    doc->setDefaultFont(font);
+    doc->setPlainText(payload);
+    doc->setTextWidth(textWidth);
+    doc->size(); // Принудительная верстка здесь, а не в sizeHint()/paint()
+
+    // Передаем владение GUI-потоку: делегат заберет документ в слоте
+    doc->moveToThread(QCoreApplication::instance()->thread());
+    emit documentReady(messageId, textWidth, doc);
+}
 
 ChatMessageDelegate::ChatMessageDelegate(const ChatMessageModel* model, QObject *parent)
     : QStyledItemDelegate(parent),
@@ -89,15 +147,116 @@ ChatMessageDelegate::ChatMessageDelegate(const ChatMessageModel* model, QObject
 {
     // Инициализируем SVG-рендереры статуса один раз на процесс
     initRenderers(this);
+
+    // Поток фоновой верстки: документы соседних строк готовятся впрок,
+    // чтобы первая прокрутка длинного чата не верстала текст синхронно
+    m_layoutWorker = new DocumentLayoutWorker();
+    m_layoutWorker->moveToThread(&m_layoutThread);
+    connect(&m_layoutThread, &QThread::finished, m_layoutWorker, &QObject::deleteLater);
+    connect(m_layoutWorker, &DocumentLayoutWorker::documentReady,
+            this, &ChatMessageDelegate::onDocumentReady);
+    m_layoutThread.setObjectName("chat-doc-layout");
+    m_layoutThread.start();
+
+    // Медиа-тракт изображений: миниатюры готовятся и скачиваются в
+    // фоне, paint() берет только готовые pixmap'ы
+    m_thumbnailCache = new ThumbnailCache(this);
 }
 
 ChatMessageDelegate::~ChatMessageDelegate()
 {
+    m_layoutThread.quit();
+    m_layoutThread.wait();
+
     // Чистим кеш QTextDocument для сообщений
     qDeleteAll(m_documentCache);
     m_documentCache.clear();
 }
 
+QTextDocument* ChatMessageDelegate::cachedDocument(const QPair<qint64, int>& key) const
+{
+    auto it = m_documentCache.constFind(key);
+    PerfMetrics::recordDocCache(it != m_documentCache.constEnd());
+    if (it == m_documentCache.constEnd())
+        return nullptr;
+
+    // LRU: помечаем ключ как недавно использованный
+    m_documentLru.removeOne(key);
+    m_documentLru.append(key);
+    return it.value();
+}
+
+void ChatMessageDelegate::insertDocument(const QPair<qint64, int>& key,
+                                         QTextDocument* doc) const
+{
+    if (m_documentCache.contains(key)) {
+        delete m_documentCache.take(key);
+        m_documentLru.removeOne(key);
+    }
+    m_documentCache.insert(key, doc);
+    m_documentLru.append(key);
+
+    // Вытесняем самые давние документы сверх лимита
+    while (m_documentLru.size() > MaxCachedDocuments) {
+        const QPair<qint64, int> victim = m_documentLru.takeFirst();
+        delete m_documentCache.take(victim);
+    }
+}
+
+void ChatMessageDelegate::prefetchAround(const QModelIndex& index,
+                                         int textMaxWidth,
+                                         const QFont& font) const
+{
+    const QAbstractItemModel* model = index.model();
+    if (!model)
+        return;
+
+    const int rows = model->rowCount();
+    const int from = std::max(0, index.row() - PrefetchRadius);
+    const int to   = std::min(rows - 1, index.row() + PrefetchRadius);
+
+    for (int row = from; row <= to; ++row) {
+        if (row == index.row())
+            continue;
+
+        const ChatMessage msg =
+            model->index(row, 0).data(Qt::UserRole).value<ChatMessage>();
+
+        // Строки без серверного ID (ключ по -row нестабилен) и без текста
+        // верстаются синхронно как раньше; стикеры/эмодзи документ
+        // не используют вовсе
+        if (msg.id <= 0 || msg.payload.isEmpty()
+            || (msg.replyToId <= 0 && msg.isStickerLike()))
+            continue;
+
+        const QPair<qint64, int> key(msg.id, textMaxWidth);
+        if (m_documentCache.contains(key) || m_pendingLayouts.contains(key))
+            continue;
+
+        m_pendingLayouts.insert(key);
+        QMetaObject::invokeMethod(m_layoutWorker, "layoutDocument",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(qint64, msg.id),
+                                  Q_ARG(QString, msg.payload),
+                                  Q_ARG(int, textMaxWidth),
+                                  Q_ARG(QFont, font));
+    }
+}
+
+void ChatMessageDelegate::onDocumentReady(qint64 messageId, int textWidth,
+                                          QTextDocument* doc)
+{
+    const QPair<qint64, int> key(messageId, textWidth);
+    m_pendingLayouts.remove(key);
+
+    // Документ могли сверстать синхронно, пока шел фоновый расчет
+    if (m_documentCache.contains(key)) {
+        delete doc;
+        return;
+    }
+    insertDocument(key, doc);
+}
+
 void ChatMessageDelegate::initRenderers(QObject* parent)
 {
     // Защита от повторной инициализации статиков
@@ -124,22 +283,78 @@ void ChatMessageDelegate::paint(QPainter *painter,
                                 const QStyleOptionViewItem &option,
                                 const QModelIndex &index) const
 {
-    // Базовая подготовка
+    // Замер длительности отрисовки строки для гистограммы PerfMetrics
+    QElapsedTimer paintTimer;
+    paintTimer.start();
+
+    // Базовая подготовка (фон/выделение рисуем всегда на живом painter)
     QStyleOptionViewItem opt = option;
     QStyledItemDelegate::paint(painter, opt, index);
 
-    painter->save();
-    painter->setRenderHint(QPainter::Antialiasing);
+    // Достаем ChatMessage из UserRole
+    ChatMessage message = index.data(Qt::UserRole).value<ChatMessage>();
+    const QRect& originalRect = option.rect;
+
+    // --------- Быстрый путь: стикеры и эмодзи-сообщения ---------
+    // Флаг прогрет моделью при загрузке; строки с цитатой зависят от
+    // чужого сообщения и идут по общему пути
+    if (message.replyToId <= 0 && message.isStickerLike()) {
+        drawStickerRow(painter, option, message);
+        PerfMetrics::recordPaint(paintTimer.nsecsElapsed() / 1000);
+        return;
+    }
+
+    // --------- Кеш отрендеренных пузырей ---------
+    // Завершенные строки рисуются один раз в pixmap (с учетом device
+    // pixel ratio) и дальше прокрутка — это blit. Ключ включает статус и
+    // хеш текста, поэтому updateMessageStatus/editMessage дают промах и
+    // перерисовку. Строки с цитатой зависят от чужого сообщения и
+    // рисуются по-старому. Хранилище общее с m_iconCache.
+    const qreal dpr = painter->device()
+                          ? painter->device()->devicePixelRatioF()
+                          : 1.0;
+    // Строки с картинками не кешируются: их миниатюра дозревает
+    // асинхронно, и pixmap зафиксировал бы заглушку
+    const bool bubbleCacheable = message.id > 0 && message.replyToId <= 0
+                                 && message.messageType != ChatMessage::Image;
+    QString bubbleKey;
+    if (bubbleCacheable) {
+        bubbleKey = bubbleCacheKey(message, originalRect.width(), dpr);
+        const auto it = m_iconCache.constFind(bubbleKey);
+        PerfMetrics::recordBubbleCache(it != m_iconCache.constEnd());
+        if (it != m_iconCache.constEnd()) {
+            touchBubble(bubbleKey);
+            painter->drawPixmap(originalRect.topLeft(), it.value());
+            PerfMetrics::recordPaint(paintTimer.nsecsElapsed() / 1000);
+            return;
+        }
+    }
+
+    // Промах кеша: рисуем либо в pixmap (кешируемые строки), либо сразу
+    // на экран. Дальнейший код работает через указатель p.
+    QPixmap bubblePixmap;
+    QPainter bubblePainter;
+    QPainter* p = painter;
+    if (bubbleCacheable) {
+        bubblePixmap = QPixmap(originalRect.size() * dpr);
+        bubblePixmap.setDevicePixelRatio(dpr);
+        bubblePixmap.fill(Qt::transparent);
+        bubblePainter.begin(&bubblePixmap);
+        // Существующая геометрия считает от originalRect — сдвигаем
+        // систему координат pixmap так, чтобы ничего не менять
+        bubblePainter.translate(-originalRect.topLeft());
+        p = &bubblePainter;
+    }
+
+    p->save();
+    p->setRenderHint(QPainter::Antialiasing);
 
     // Шрифт для метаданных (время, "изм.")
     QFont metaFont = option.font;
     metaFont.setPointSizeF(metaFont.pointSizeF() * 0.75);
     QFontMetrics metaFm(metaFont);
 
-    // Достаем ChatMessage из UserRole
-    ChatMessage message = index.data(Qt::UserRole).value<ChatMessage>();
-    const QRect& originalRect = option.rect;
-    QFontMetrics fm(painter->font());
+    QFontMetrics fm(p->font());
 
     // Базовые константы геометрии
     const int margin          = 10;
@@ -153,6 +368,12 @@ void ChatMessageDelegate::paint(QPainter *painter,
     if (message.fileId.isEmpty())
         iconSize = 0;  // Нет файла – нет иконки
 
+    // Для картинок блок вложения — бокс миниатюры вместо иконки с именем
+    const bool isImage = message.messageType == ChatMessage::Image
+                         && !message.fileId.isEmpty();
+    if (isImage)
+        iconSize = ImageThumbHeight + padding;
+
     // --------- Расчет блока цитаты (reply) ---------
     int quoteHeight = 0;
     int quoteTextWidth = 0;
@@ -191,7 +412,7 @@ void ChatMessageDelegate::paint(QPainter *painter,
     // Ключ кэша QTextDocument: (id или -row, ширина)
     QPair<qint64, int> cacheKey(message.id > 0 ? message.id : -index.row(),
                                 textMaxWidth);
-    QTextDocument* doc = m_documentCache.value(cacheKey, nullptr);
+    QTextDocument* doc = cachedDocument(cacheKey);
 
     // Высота и фактическая ширина текста
     qreal textHeight = doc
@@ -213,6 +434,8 @@ void ChatMessageDelegate::paint(QPainter *painter,
                                             Qt::ElideMiddle, 300));
     if (fileNameWidth > textMaxWidth)
         fileNameWidth = textMaxWidth;
+    if (isImage)
+        fileNameWidth = ImageThumbWidth; // Пузырь не уже бокса миниатюры
 
     if (message.payload.isEmpty()) {
         textHeight      = 0;
@@ -223,7 +446,7 @@ void ChatMessageDelegate::paint(QPainter *painter,
     QString metaText;
     if (message.isEdited)
         metaText += "(изм.) ";
-    metaText += message.timestamp.mid(11, 5); // HH:MM
+    metaText += message.timeText(); // HH:MM, лениво и с кэшем
 
     int metaTextWidth  = metaFm.horizontalAdvance(metaText);
     int metaDataHeight = metaFm.height();
@@ -264,12 +487,22 @@ void ChatMessageDelegate::paint(QPainter *painter,
     QColor bubbleColor = message.isOutgoing
                              ? QColor("#753955")
                              : QColor("#3D383A");
-    painter->setBrush(bubbleColor);
-    painter->setPen(Qt::NoPen);
-    painter->drawRoundedRect(bubbleRect, borderRadius, borderRadius);
-
+    p->setBrush(bubbleColor);
+    p->setPen(Qt::NoPen);
+    p->drawRoundedRect(bubbleRect, borderRadius, borderRadius);
+
+    // --------- Вложенное изображение (миниатюра) ---------
+    if (isImage) {
+        QRect imageRect(bubbleRect.left() + padding,
+                        bubbleRect.top() + quoteHeight + padding,
+                        ImageThumbWidth, ImageThumbHeight);
+        drawImageThumbnail(p, imageRect, message);
+
+        // Сдвигаем область текста ниже бокса миниатюры
+        textDrawRect.moveTop(textDrawRect.top() + iconSize + 5);
+    }
     // --------- Вложенный файл (иконка + имя) ---------
-    if (!message.fileId.isEmpty()) {
+    else if (!message.fileId.isEmpty()) {
         // Прямоугольник под иконку
         QRect iconRect = bubbleRect.adjusted(
             padding,
@@ -290,18 +523,18 @@ void ChatMessageDelegate::paint(QPainter *painter,
             m_iconCache.insert(iconPath, pm);
         }
 
-        painter->drawPixmap(iconRect, m_iconCache[iconPath]);
+        p->drawPixmap(iconRect, m_iconCache[iconPath]);
 
         // Прямоугольник под имя файла
         QRect fileNameRect = iconRect.adjusted(
             iconSize + padding, 0,
             bubbleRect.width() - iconSize - 2 * padding, 0
             );
-        painter->setPen(Qt::white);
+        p->setPen(Qt::white);
         QString fileName = message.fileName.isEmpty()
                                ? "[файл]"
                                : message.fileName;
-        painter->drawText(
+        p->drawText(
             fileNameRect,
             Qt::AlignVCenter | Qt::AlignLeft,
             fm.elidedText(fileName, Qt::ElideMiddle, fileNameRect.width())
@@ -339,23 +572,23 @@ void ChatMessageDelegate::paint(QPainter *painter,
         QColor quoteRectColor = message.isOutgoing
                                     ? QColor("#ff7fbb").darker(150)
                                     : QColor("#ff7fbb");
-        painter->setBrush(quoteRectColor);
-        painter->setPen(Qt::NoPen);
-        painter->drawRoundedRect(quoteRect, 5, 5);
+        p->setBrush(quoteRectColor);
+        p->setPen(Qt::NoPen);
+        p->drawRoundedRect(quoteRect, 5, 5);
 
         // Цветная вертикальная полоска слева
         QRectF colorBarRect = quoteRect;
         colorBarRect.setWidth(5);
-        painter->setBrush(QColor("#ffffff"));
-        painter->drawRoundedRect(colorBarRect, 0, 0);
+        p->setBrush(QColor("#ffffff"));
+        p->drawRoundedRect(colorBarRect, 0, 0);
 
         // Текст цитаты (от кого и текст/имя файла)
         QRectF quoteTextRect = quoteRect.adjusted(
             colorBarRect.width() + padding, 5,
             -padding, -5
             );
-        painter->setPen(QColor("#ffffff"));
-        painter->drawText(
+        p->setPen(QColor("#ffffff"));
+        p->drawText(
             quoteTextRect,
             Qt::AlignTop | Qt::AlignLeft,
             fm.elidedText(fromUser, Qt::ElideRight,
@@ -363,7 +596,7 @@ void ChatMessageDelegate::paint(QPainter *painter,
             );
 
         QRectF repliedTextRect = quoteTextRect.adjusted(0, fm.height(), 0, 0);
-        painter->drawText(
+        p->drawText(
             repliedTextRect,
             Qt::AlignTop | Qt::AlignLeft,
             fm.elidedText(payload, Qt::ElideRight,
@@ -372,18 +605,18 @@ void ChatMessageDelegate::paint(QPainter *painter,
     }
 
     // --------- Текст сообщения ---------
-    painter->setPen(Qt::white);
+    p->setPen(Qt::white);
 
     if (doc) {
-        painter->save();
-        painter->translate(textDrawRect.topLeft());
-        painter->setPen(Qt::white);
-        doc->drawContents(painter);
-        painter->restore();
+        p->save();
+        p->translate(textDrawRect.topLeft());
+        p->setPen(Qt::white);
+        doc->drawContents(p);
+        p->restore();
     } else {
         QTextOption textOption(Qt::AlignLeft | Qt::AlignTop);
         textOption.setWrapMode(QTextOption::WrapAnywhere);
-        painter->drawText(textDrawRect, message.payload, textOption);
+        p->drawText(textDrawRect, message.payload, textOption);
     }
 
     // --------- Метаданные (время + статус/галочки) ---------
@@ -394,7 +627,7 @@ void ChatMessageDelegate::paint(QPainter *painter,
     baseMetaRect.setHeight(metaDataHeight);
     baseMetaRect.moveBottom(bubbleRect.bottom() - padding);
 
-    painter->setFont(metaFont);
+    p->setFont(metaFont);
 
     if (message.isOutgoing) {
         int statusIconSize = fm.height() - 2;
@@ -413,8 +646,8 @@ void ChatMessageDelegate::paint(QPainter *painter,
         QPen textPen = (message.status == ChatMessage::Read)
                            ? QColor(70, 150, 255)
                            : Qt::gray;
-        painter->setPen(textPen);
-        painter->drawText(textMetaRect,
+        p->setPen(textPen);
+        p->drawText(textMetaRect,
                           Qt::AlignRight | Qt::AlignVCenter,
                           metaText);
 
@@ -446,23 +679,135 @@ void ChatMessageDelegate::paint(QPainter *painter,
             effectPainter.fillRect(pixmap.rect(), iconColor);
             effectPainter.end();
 
-            painter->drawPixmap(iconRect, pixmap);
+            p->drawPixmap(iconRect, pixmap);
         } else {
             // Фоллбек: только текст времени
-            painter->setPen(Qt::gray);
-            painter->drawText(baseMetaRect,
+            p->setPen(Qt::gray);
+            p->drawText(baseMetaRect,
                               Qt::AlignRight | Qt::AlignVCenter,
                               metaText);
         }
     } else {
         // Для входящих – только время, без иконки статуса
-        painter->setPen(Qt::gray);
-        painter->drawText(baseMetaRect,
+        p->setPen(Qt::gray);
+        p->drawText(baseMetaRect,
                           Qt::AlignRight | Qt::AlignVCenter,
                           metaText);
     }
 
-    painter->restore();
+    p->restore();
+
+    if (bubbleCacheable) {
+        bubblePainter.end();
+        insertBubble(bubbleKey, bubblePixmap);
+        painter->drawPixmap(originalRect.topLeft(), bubblePixmap);
+    }
+
+    PerfMetrics::recordPaint(paintTimer.nsecsElapsed() / 1000);
+}
+
+void ChatMessageDelegate::drawStickerRow(QPainter* p,
+                                         const QStyleOptionViewItem& option,
+                                         const ChatMessage& message) const
+{
+    const QRect& rect = option.rect;
+    const int margin          = 10;
+    const int verticalSpacing = 6;
+
+    QFont metaFont = option.font;
+    metaFont.setPointSizeF(metaFont.pointSizeF() * 0.75);
+    QFontMetrics metaFm(metaFont);
+
+    // Бокс фиксированный: высота строки известна без верстки, и строка
+    // не прыгает, когда стикер дозревает в фоне
+    QRect box(0, rect.top() + verticalSpacing / 2,
+              StickerBoxSize, StickerBoxSize);
+    if (message.isOutgoing)
+        box.moveRight(rect.right() - margin);
+    else
+        box.moveLeft(rect.left() + margin);
+
+    if (message.messageType == ChatMessage::Sticker
+        && !message.fileId.isEmpty()) {
+        // Стикер — готовая миниатюра из общего кеша изображений
+        const QPixmap sticker = m_thumbnailCache->thumbnail(
+            message.fileId, StickerBoxSize, StickerBoxSize);
+        if (!sticker.isNull()) {
+            QRect target(QPoint(0, 0), sticker.size());
+            target.moveCenter(box.center());
+            p->drawPixmap(target, sticker);
+        }
+    } else {
+        // Эмодзи-сообщение: крупные глифы растеризуются один раз в pixmap
+        // общего кеша (LRU пузырей), дальше прокрутка — это blit
+        const qreal dpr = p->device()
+                              ? p->device()->devicePixelRatioF()
+                              : 1.0;
+        const QString key = QStringLiteral("emoji:%1:%2")
+                                .arg(qHash(message.payload.toString()))
+                                .arg(dpr);
+        const auto it = m_iconCache.constFind(key);
+        QPixmap glyphs;
+        if (it != m_iconCache.constEnd()) {
+            touchBubble(key);
+            glyphs = it.value();
+        } else {
+            glyphs = QPixmap(QSize(StickerBoxSize, StickerBoxSize) * dpr);
+            glyphs.setDevicePixelRatio(dpr);
+            glyphs.fill(Qt::transparent);
+            QPainter gp(&glyphs);
+            QFont emojiFont = option.font;
+            emojiFont.setPointSizeF(emojiFont.pointSizeF() * EmojiFontScale);
+            gp.setFont(emojiFont);
+            gp.setPen(Qt::white);
+            gp.drawText(QRect(0, 0, StickerBoxSize, StickerBoxSize),
+                        Qt::AlignCenter | Qt::TextWordWrap,
+                        message.payload);
+            gp.end();
+            insertBubble(key, glyphs);
+        }
+        p->drawPixmap(box.topLeft(), glyphs);
+    }
+
+    // Время под боксом, без пузыря; синее — прочитано (как в общем пути)
+    QRect metaRect(box.left(), box.bottom() + 2,
+                   box.width(), metaFm.height());
+    p->save();
+    p->setFont(metaFont);
+    p->setPen(message.isOutgoing && message.status == ChatMessage::Read
+                  ? QColor(70, 150, 255)
+                  : QColor(Qt::gray));
+    p->drawText(metaRect,
+                (message.isOutgoing ? Qt::AlignRight : Qt::AlignLeft)
+                    | Qt::AlignVCenter,
+                message.timeText());
+    p->restore();
+}
+
+void ChatMessageDelegate::drawImageThumbnail(QPainter* p, const QRect& box,
+                                             const ChatMessage& message) const
+{
+    // Углы бокса скругляем в стиле пузыря
+    QPainterPath clip;
+    clip.addRoundedRect(box, 10, 10);
+    p->save();
+    p->setClipPath(clip, Qt::IntersectClip);
+
+    const QPixmap thumb = m_thumbnailCache->thumbnail(message.fileId,
+                                                      ImageThumbWidth,
+                                                      ImageThumbHeight);
+    if (!thumb.isNull()) {
+        // Миниатюра (или размытое превью) по центру бокса
+        p->fillRect(box, QColor("#2B2729"));
+        QRect target(QPoint(0, 0), thumb.size());
+        target.moveCenter(box.center());
+        p->drawPixmap(target, thumb);
+    } else {
+        // Ни миниатюры, ни превью еще нет: ровная подложка на время
+        // скачивания и декода в фоне
+        p->fillRect(box, QColor("#2B2729"));
+    }
+    p->restore();
 }
 
 
@@ -472,6 +817,19 @@ QSize ChatMessageDelegate::sizeHint(const QStyleOptionViewItem &option,
     // Достаем сообщение из UserRole
     ChatMessage message = index.data(Qt::UserRole).value<ChatMessage>();
 
+    // --------- Кеш sizeHint ---------
+    // Ключ: (ID, ширина области); хеш текста отсекает устаревшие записи
+    // после редактирования. Строки без серверного ID не кешируем.
+    const QPair<qint64, int> sizeKey(message.id, option.rect.width());
+    const size_t payloadHash = qHash(message.payload);
+    if (message.id > 0) {
+        auto it = m_sizeHintCache.constFind(sizeKey);
+        if (it != m_sizeHintCache.constEnd() &&
+            it.value().payloadHash == payloadHash) {
+            return it.value().size;
+        }
+    }
+
     QFontMetrics fm(option.font);
     QFont metaFont = option.font;
     metaFont.setPointSizeF(metaFont.pointSizeF() * 0.75);
@@ -481,6 +839,17 @@ QSize ChatMessageDelegate::sizeHint(const QStyleOptionViewItem &option,
     const int verticalSpacing = 6;
     const int minBubbleWidth  = 100;
 
+    // --------- Быстрый путь: стикеры и эмодзи-сообщения ---------
+    // Бокс фиксированный — размер известен без создания документа
+    if (message.replyToId <= 0 && message.isStickerLike()) {
+        const QSize result(StickerBoxSize + 2 * padding,
+                           StickerBoxSize + metaFm.height() + 2
+                               + verticalSpacing);
+        if (message.id > 0)
+            m_sizeHintCache.insert(sizeKey, { result, payloadHash });
+        return result;
+    }
+
     // --------- Высота блока цитаты (reply) ---------
     int quoteHeight = 0;
     int quoteTextWidth = 0;
@@ -526,23 +895,26 @@ QSize ChatMessageDelegate::sizeHint(const QStyleOptionViewItem &option,
         textMaxWidth
     );
 
-    if (m_documentCache.contains(cacheKey)) {
-        doc = m_documentCache.value(cacheKey);
-
+    doc = cachedDocument(cacheKey);
+    if (doc) {
         // Если текст изменился (редактирование) — обновляем документ
         if (doc->toPlainText() != message.payload) {
             doc->setPlainText(message.payload);
             doc->setTextWidth(textMaxWidth);
         }
     } else {
-        // Создаем новый QTextDocument для текста
+        // Синхронный запасной путь: создаем документ на месте
         doc = new QTextDocument();
         doc->setDefaultFont(option.font);
         doc->setPlainText(message.payload);
         doc->setTextWidth(textMaxWidth);
-        m_documentCache.insert(cacheKey, doc);
+        insertDocument(cacheKey, doc);
     }
 
+    // Соседние строки верстаем фоном впрок — к моменту прокрутки
+    // их документы уже лежат в кеше
+    prefetchAround(index, textMaxWidth, option.font);
+
     qreal textHeight      = doc->size().height();
     qreal textActualWidth = doc->idealWidth();
 
@@ -550,7 +922,7 @@ QSize ChatMessageDelegate::sizeHint(const QStyleOptionViewItem &option,
     QString metaText;
     if (message.isEdited)
         metaText += "(изм.) ";
-    metaText += message.timestamp.mid(11, 5);
+    metaText += message.timeText();
 
     int metaTextWidth  = metaFm.horizontalAdvance(metaText);
     int metaDataHeight = metaFm.height();
@@ -574,6 +946,13 @@ QSize ChatMessageDelegate::sizeHint(const QStyleOptionViewItem &option,
         fileNameWidth = 0;
     }
 
+    // Картинка: фиксированный бокс миниатюры вместо иконки с именем —
+    // размер строки не зависит от готовности миниатюры
+    if (message.messageType == ChatMessage::Image && !message.fileId.isEmpty()) {
+        iconSize      = ImageThumbHeight + padding;
+        fileNameWidth = ImageThumbWidth;
+    }
+
     // --------- Итоговая ширина и высота пузыря ---------
     int bubbleContentWidth = std::max({
         static_cast<int>(textActualWidth),
@@ -596,13 +975,18 @@ QSize ChatMessageDelegate::sizeHint(const QStyleOptionViewItem &option,
 
     int totalHeight = bubbleContentHeight + verticalSpacing;
 
-    return QSize(bubbleContentWidth + 2 * padding, totalHeight);
+    const QSize result(bubbleContentWidth + 2 * padding, totalHeight);
+    if (message.id > 0)
+        m_sizeHintCache.insert(sizeKey, { result, payloadHash });
+
+    return result;
 }
 
 void ChatMessageDelegate::clearSizeHintCache()
 {
-    // Кеш sizeHint больше не используется (был m_sizeHintCache),
-    // поэтому этот метод — пустышка или можно убрать
+    // Вызывается при смене ширины области просмотра и переключении чата:
+    // записи под старую ширину безвредны (ширина входит в ключ), но
+    // держать их в памяти незачем
     m_sizeHintCache.clear();
     qDebug() << "[Delegate] Кеш размеров sizeHint очищен";
 }
@@ -612,6 +996,14 @@ void ChatMessageDelegate::clearCaches()
     // Очищаем все QTextDocument из кеша (освобождаем память)
     qDeleteAll(m_documentCache);
     m_documentCache.clear();
+    m_documentLru.clear();
+    m_pendingLayouts.clear();
+
+    // Отрендеренные пузыри (общий кеш с иконками) тоже сбрасываем
+    for (const QString& key : std::as_const(m_bubbleLru)) {
+        m_iconCache.remove(key);
+    }
+    m_bubbleLru.clear();
     qDebug() << "[Delegate] Все кеши QTextDocument очищены";
 }
 
@@ -662,6 +1054,10 @@ bool ChatMessageDelegate::editorEvent(QEvent *event,
             int quoteHeight = 0;
             int quoteTextWidth = 0;
 
+            const bool isImage = message.messageType == ChatMessage::Image;
+            if (isImage)
+                iconSize = ImageThumbHeight + padding;
+
             // Высота/ширина блока цитаты
             if (message.replyToId > 0) {
                 ChatMessage repliedMsg;
@@ -702,7 +1098,7 @@ bool ChatMessageDelegate::editorEvent(QEvent *event,
                 message.id > 0 ? message.id : -index.row(),
                 textMaxWidth
             );
-            QTextDocument* doc = m_documentCache.value(cacheKey, nullptr);
+            QTextDocument* doc = cachedDocument(cacheKey);
 
             qreal textHeight = doc
                 ? doc->size().height()
@@ -723,6 +1119,8 @@ bool ChatMessageDelegate::editorEvent(QEvent *event,
                                                       textMaxWidth));
             if (fileNameWidth > textMaxWidth)
                 fileNameWidth = textMaxWidth;
+            if (isImage)
+                fileNameWidth = ImageThumbWidth;
 
             if (message.payload.isEmpty())
                 textHeight = 0;
@@ -731,7 +1129,7 @@ bool ChatMessageDelegate::editorEvent(QEvent *event,
             QString metaText;
             if (message.isEdited)
                 metaText += "(изм.) ";
-            metaText += message.timestamp.mid(11, 5);
+            metaText += message.timeText();
             int metaTextWidth  = metaFm.horizontalAdvance(metaText);
             int metaDataHeight = metaFm.height();
             if (message.isOutgoing)
@@ -760,6 +1158,26 @@ bool ChatMessageDelegate::editorEvent(QEvent *event,
                 bubbleRect.moveTopLeft(
                     QPoint(originalRect.left() + margin, currentY));
 
+            // Клик по боксу миниатюры: полноразмерный декод — только
+            // по явному запросу (скачивание/открытие оригинала)
+            if (isImage) {
+                QRect imageRect(bubbleRect.left() + padding,
+                                bubbleRect.top() + quoteHeight + padding,
+                                ImageThumbWidth, ImageThumbHeight);
+                if (imageRect.contains(pos)) {
+                    qDebug() << "emit fileDownloadRequested(message.fileId, "
+                                "message.fileUrl, message.fileName);";
+                    emit fileDownloadRequested(
+                        message.fileId,
+                        message.fileUrl,
+                        message.fileName
+                    );
+                    return true;
+                }
+                return QStyledItemDelegate::editorEvent(event, model,
+                                                        option, index);
+            }
+
             // Области иконки и текста файла
             QRect iconRect = bubbleRect.adjusted(
                 padding,
@@ -4,12 +4,54 @@
 #include <QObject>
 #include <QStyledItemDelegate>
 #include <QMap>
+#include <QSet>
+#include <QStringList>
 #include <QStaticText>
 #include <QTextDocument>
+#include <QThread>
 #include "structures.h"
 
 class ChatMessageModel;
 class QSvgRenderer;
+class ThumbnailCache;
+
+/**
+ * @brief Фоновая верстка QTextDocument для делегата сообщений.
+ *
+ * Живет в отдельном потоке: получает текст и ширину зоны отрисовки,
+ * создает документ, принудительно выполняет верстку и передает готовый
+ * документ обратно в GUI-поток (moveToThread), где делегат кладет его
+ * в кеш. Так первая прокрутка длинного чата не верстает текст
+ * синхронно внутри sizeHint()/paint().
+ */
+class DocumentLayoutWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DocumentLayoutWorker(QObject* parent = nullptr);
+
+public slots:
+    /**
+     * @brief Верстает документ для сообщения вне GUI-потока.
+     * @param messageId ID сообщения (часть ключа кеша)
+     * @param payload Текст сообщения
+     * @param textWidth Ширина зоны отрисовки
+     * @param font Базовый шрифт документа
+     */
+    void layoutDocument(qint64 messageId, const QString& payload,
+                        int textWidth, const QFont& font);
+
+signals:
+    /**
+     * @brief Готовый, уже сверстанный документ.
+     *
+     * Документ передан в GUI-поток; получатель становится владельцем.
+     * @param messageId ID сообщения
+     * @param textWidth Ширина, под которую сверстан документ
+     * @param doc Указатель на документ
+     */
+    void documentReady(qint64 messageId, int textWidth, QTextDocument* doc);
+};
 
 /**
  * @brief Делегат для отрисовки сообщений в списке чата.
@@ -36,6 +78,14 @@ public:
     /** @brief Принудительная очистка всех кешей (размеров, документов, иконок). */
     void clearCaches();
 
+    /**
+     * @brief Кеш миниатюр изображений-сообщений.
+     *
+     * Нужен создателю делегата, чтобы подписаться на thumbnailReady
+     * и перерисовать вьюпорт, когда миниатюра дозреет в фоне.
+     */
+    ThumbnailCache* thumbnailCache() const { return m_thumbnailCache; }
+
     /**
      * @brief Основной метод отрисовки элемента списка.
      *
@@ -79,6 +129,13 @@ public slots:
     /** @brief Слот для очистки кеша размеров (вызывается при изменении шрифта или ресайзе). */
     void clearSizeHintCache();
 
+private slots:
+    /**
+     * @brief Принимает сверстанный фоном документ и кладет его в кеш.
+     * Если документ успели сверстать синхронно — дубль удаляется.
+     */
+    void onDocumentReady(qint64 messageId, int textWidth, QTextDocument* doc);
+
 signals:
     /**
      * @brief Сигнал запроса на скачивание файла.
@@ -100,12 +157,24 @@ private:
 
     const ChatMessageModel* m_model;   ///< Ссылка на модель данных
 
+    /**
+     * @brief Запись кеша sizeHint: размер плюс хеш текста на момент расчета.
+     * Хеш играет роль ревизии правок — после editMessage значение не
+     * совпадет и размер пересчитается.
+     */
+    struct SizeHintEntry {
+        QSize size;
+        size_t payloadHash = 0;
+    };
+
     /**
      * @brief Кеш вычисленных размеров сообщений.
-     * Ключ: ID сообщения, Значение: QSize.
+     * Ключ: пара <ID сообщения, ширина области просмотра>; ширина в ключе
+     * делает записи других ширин безвредными, а clearSizeHintCache при
+     * ресайзе убирает их из памяти.
      * mutable позволяет менять кеш внутри константного метода sizeHint.
      */
-    mutable QMap<qint64, QSize> m_sizeHintCache;
+    mutable QMap<QPair<qint64, int>, SizeHintEntry> m_sizeHintCache;
 
     /** @brief Статический кеш SVG-рендереров для иконок статусов (галочки, часы). */
     static QMap<ChatMessage::MessageStatus, QSvgRenderer*> m_statusRenderers;
@@ -113,17 +182,114 @@ private:
     /** @brief Флаг инициализации статических рендереров. */
     static bool m_renderersInitialized;
 
+    /**
+     * @brief Достает документ из кеша и помечает его недавно использованным.
+     * @return Указатель на документ или nullptr, если его нет в кеше.
+     */
+    QTextDocument* cachedDocument(const QPair<qint64, int>& key) const;
+
+    /**
+     * @brief Кладет документ в кеш, вытесняя самые давние сверх лимита.
+     * Кеш становится владельцем документа.
+     */
+    void insertDocument(const QPair<qint64, int>& key, QTextDocument* doc) const;
+
+    /**
+     * @brief Ставит в очередь фоновую верстку документов соседних строк.
+     *
+     * Вызывается из sizeHint(): строки вокруг видимой области верстаются
+     * в потоке m_layoutThread и к моменту прокрутки уже лежат в кеше.
+     */
+    void prefetchAround(const QModelIndex& index, int textMaxWidth,
+                        const QFont& font) const;
+
+    // Предел кеша документов: дальше самые давние вытесняются (LRU)
+    static constexpr int MaxCachedDocuments = 400;
+
+    // Сколько строк вокруг текущей верстается фоном впрок
+    static constexpr int PrefetchRadius = 12;
+
     /**
      * @brief Кеш текстовых документов (QTextDocument) для сложной верстки.
-     * Ключ: пара <ID сообщения, ширина зоны отрисовки>.
+     * Ключ: пара <ID сообщения, ширина зоны отрисовки>. Размер ограничен
+     * MaxCachedDocuments; порядок использования отслеживает m_documentLru.
      */
     mutable QMap<QPair<qint64, int>, QTextDocument*> m_documentCache;
 
+    /** @brief Порядок использования ключей кеша (конец — самые свежие). */
+    mutable QList<QPair<qint64, int>> m_documentLru;
+
+    /** @brief Ключи, уже отданные на фоновую верстку (защита от дублей). */
+    mutable QSet<QPair<qint64, int>> m_pendingLayouts;
+
+    QThread m_layoutThread;            ///< Поток фоновой верстки документов
+    DocumentLayoutWorker* m_layoutWorker; ///< Работник верстки (живет в m_layoutThread)
+
+    // Бокс миниатюры изображения внутри пузыря. Размер фиксирован:
+    // высота строки не меняется, когда миниатюра дозревает в фоне,
+    // и прокрутка не прыгает
+    static constexpr int ImageThumbWidth  = 260;
+    static constexpr int ImageThumbHeight = 195;
+
+    // Бокс быстрого пути стикеров/эмодзи: фиксированный размер дает
+    // sizeHint без какой-либо верстки
+    static constexpr int StickerBoxSize = 160;
+
+    // Масштаб шрифта крупных эмодзи-глифов относительно базового
+    static constexpr qreal EmojiFontScale = 2.5;
+
+    /**
+     * @brief Быстрый путь отрисовки стикеров и эмодзи-сообщений.
+     *
+     * Такая строка — одна картинка (или пара крупных глифов) без пузыря:
+     * полная верстка QTextDocument ей не нужна, а это самые дорогие
+     * строки общего пути (~20% трафика). Стикер берется из ThumbnailCache
+     * по fileId; эмодзи растеризуются один раз в pixmap общего кеша
+     * m_iconCache, и дальше прокрутка — это blit.
+     */
+    void drawStickerRow(QPainter* p, const QStyleOptionViewItem& option,
+                        const ChatMessage& message) const;
+
+    /**
+     * @brief Рисует миниатюру изображения (или заглушку) в боксе пузыря.
+     *
+     * Полноразмерный декод здесь не выполняется никогда: берется
+     * готовая миниатюра из ThumbnailCache, размытое превью или
+     * ровная подложка, пока изготовление идет в фоне.
+     */
+    void drawImageThumbnail(QPainter* p, const QRect& box,
+                            const ChatMessage& message) const;
+
+    ThumbnailCache* m_thumbnailCache;  ///< Миниатюры изображений (по fileId)
+
     /** @brief Инициализирует SVG рендереры (загружает ресурсы один раз). */
     static void initRenderers(QObject* parent);
 
-    /** @brief Кеш загруженных иконок файлов. */
+    /**
+     * @brief Кеш pixmap: иконки файлов (ключ — путь к SVG) и
+     * отрендеренные пузыри завершенных сообщений (ключ "bubble:...").
+     */
     static QMap<QString, QPixmap> m_iconCache;
+
+    /** @brief Порядок использования ключей пузырей в m_iconCache (LRU). */
+    static QStringList m_bubbleLru;
+
+    // Предел количества отрендеренных пузырей в m_iconCache
+    static constexpr int MaxCachedBubbles = 600;
+
+    /**
+     * @brief Ключ кеша отрендеренного пузыря.
+     * Включает статус, признак правки и хеш текста — их изменение
+     * инвалидирует запись естественным промахом.
+     */
+    static QString bubbleCacheKey(const ChatMessage& message,
+                                  int width, qreal dpr);
+
+    /** @brief Помечает пузырь недавно использованным (LRU). */
+    static void touchBubble(const QString& key);
+
+    /** @brief Кладет пузырь в m_iconCache, вытесняя давние сверх лимита. */
+    static void insertBubble(const QString& key, const QPixmap& pixmap);
 };
 
 #endif // CHATMESSAGEDELEGATE_H
@@ -1,12 +1,15 @@
 #include "contactlistdelegate.h"
 #include "contactlistmodel.h"
+#include "avatarcache.h"
 #include <QPainter>
 #include <QApplication>
 #include <QDebug>
 #include <QDateTime>
 #include <QPainterPath>
-ContactListDelegate::ContactListDelegate(QObject *parent)
-    : QStyledItemDelegate(parent)
+ContactListDelegate::ContactListDelegate(AvatarCache* avatarCache,
+                                         QObject *parent)
+    : QStyledItemDelegate(parent),
+      m_avatarCache(avatarCache)
 {}
 
 void ContactListDelegate::paint(QPainter *painter,
@@ -33,39 +36,44 @@ void ContactListDelegate::paint(QPainter *painter,
     QString lastMessageTime = index.data(ContactListModel::LastMessageTimestampRole).toString();
     bool isPinned         = index.data(ContactListModel::IsPinnedRole).toBool();
     QString avatarUrl     = index.data(ContactListModel::AvatarRole).toString();
+    QString username      = index.data(ContactListModel::UsernameRole).toString();
 
     const int padding = 10;
     const int spacing = 10;
     const int pinWidth = 5;
     int avatarSize = 32;
 
-    // Загрузка аватара
-    QPixmap avatar;
-    if (!avatarUrl.isEmpty()) {
-        qDebug() << "[ContactListDelegate] Avatar url not empty!";
-        avatar.load(avatarUrl);
-        if (avatar.isNull()) {
-            qDebug() << "[ContactListDelegate] WARNING: can't load avatarUrl, fallback to default";
-            avatar.load(":/icons/icons/default_avatar.png");
+    // Миниатюра из яруса AvatarCache: декод и уменьшение уже сделаны
+    // в рабочем потоке, здесь остается только blit
+    QPixmap rounded;
+    if (m_avatarCache && !avatarUrl.isEmpty()) {
+        rounded = m_avatarCache->thumbnail(username, avatarUrl, avatarSize);
+    }
+
+    if (rounded.isNull()) {
+        // Строка видна, а аватар еще качается — поднимаем его в голову
+        // очереди загрузки: видимые пользователи важнее нижних по списку
+        if (m_avatarCache && !username.isEmpty()) {
+            m_avatarCache->prioritize(username);
         }
-    } else {
+
+        // Запасной путь: миниатюра еще готовится или аватара нет
+        QPixmap avatar;
         avatar.load(":/icons/icons/default_avatar.png");
-    }
 
-    if (avatar.isNull()) {
-        qDebug() << "[ContactListDelegate] ERROR: default avatar missing, drawing placeholder";
-        avatar = QPixmap(avatarSize, avatarSize);
-        avatar.fill(Qt::gray);
-        QPainter pIcon(&avatar);
-        pIcon.setPen(Qt::white);
-        pIcon.setFont(QFont("Segoe UI", 16, QFont::Bold));
-        pIcon.drawText(avatar.rect(), Qt::AlignCenter, "?");
-    }
+        if (avatar.isNull()) {
+            qDebug() << "[ContactListDelegate] ERROR: default avatar missing, drawing placeholder";
+            avatar = QPixmap(avatarSize, avatarSize);
+            avatar.fill(Qt::gray);
+            QPainter pIcon(&avatar);
+            pIcon.setPen(Qt::white);
+            pIcon.setFont(QFont("Segoe UI", 16, QFont::Bold));
+            pIcon.drawText(avatar.rect(), Qt::AlignCenter, "?");
+        }
 
-    // Округляем аватар в круг
-    QPixmap rounded(avatarSize, avatarSize);
-    rounded.fill(Qt::transparent);
-    {
+        // Округляем аватар в круг
+        rounded = QPixmap(avatarSize, avatarSize);
+        rounded.fill(Qt::transparent);
         QPainter p(&rounded);
         QPainterPath path;
         path.addEllipse(0, 0, avatarSize, avatarSize);
@@ -102,14 +110,9 @@ void ContactListDelegate::paint(QPainter *painter,
             bottomText = lastMessage;
     }
 
-    // Метка времени HH:mm
-    QString timeLabel;
-    if (!lastMessageTime.isEmpty()) {
-        QDateTime dt = QDateTime::fromString(lastMessageTime, Qt::ISODate);
-        if (dt.isValid()) {
-            timeLabel = dt.toLocalTime().toString("HH:mm");
-        }
-    }
+    // Метка времени HH:mm: модель отдает уже отформатированную строку,
+    // разбор даты на каждый paint ушел в сборку снимка строки
+    const QString& timeLabel = lastMessageTime;
 
     QFont timeFont = painter->font();
     QFontMetrics timeFm(timeFont);
@@ -3,6 +3,8 @@
 
 #include <QStyledItemDelegate>
 
+class AvatarCache;
+
 /**
  * @brief Делегат для отрисовки элементов списка контактов/чатов.
  *
@@ -21,9 +23,11 @@ class ContactListDelegate : public QStyledItemDelegate
 public:
     /**
      * @brief Конструктор делегата.
+     * @param avatarCache Кеш аватаров (ярус готовых миниатюр).
      * @param parent Родительский объект.
      */
-    explicit ContactListDelegate(QObject *parent = nullptr);
+    explicit ContactListDelegate(AvatarCache* avatarCache,
+                                 QObject *parent = nullptr);
 
 protected:
     /**
@@ -49,6 +53,9 @@ protected:
      * @return QSize Размер прямоугольника контакта
      */
     QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    AvatarCache* m_avatarCache; ///< Ярус миниатюр аватаров (декод вне paint)
 };
 
 #endif // CONTACTLISTDELEGATE_H
@@ -3,12 +3,20 @@
 #include <QDebug>         
 #include <QApplication>   
 #include <dataservice.h>
+#include <startupclock.h>
+#include <wakeaudit.h>
 
 int main(int argc, char *argv[])
 {
+    StartupClock::mark("process entered");
+
     // Создаем приложение Qt с переданными аргументами
     QApplication a(argc, argv);
 
+    // Аудит пробуждений в простое (MESSENGER_WAKE_AUDIT=1): ловит таймеры,
+    // тикающие без дела, — источники расхода батареи у свернутого клиента
+    WakeAudit::install(&a);
+
     // Загружаем CSS стили из ресурсов
     QFile styleFile(":/styles.css");
     if (!styleFile.open(QFile::ReadOnly)) {
@@ -22,14 +30,19 @@ int main(int argc, char *argv[])
         styleFile.close();
     }
 
+    StartupClock::mark("styles applied");
+
     // Создаем сервис данных (общий для всего приложения)
     DataService dataService;
+    StartupClock::mark("data service created");
 
     // Создаем главное окно, передавая сервис данных
     MainWindow w(&dataService);
+    StartupClock::mark("main window constructed");
 
     // Показываем главное окно
     w.show();
+    StartupClock::mark("window shown");
 
     // Запускаем главный цикл событий приложения
     return a.exec();
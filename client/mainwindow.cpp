@@ -1,5 +1,7 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include <utility>
+#include <QCloseEvent>
 #include <QDebug>
 #include <QJsonObject>
 #include <QJsonDocument>
@@ -10,6 +12,8 @@
 #include <QMenu>
 #include <QTcpSocket>
 #include <QTimer>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QUuid>
 #include <QLineEdit>
 #include <QListWidget>
@@ -48,12 +52,18 @@
 #include "chatmessagemodel.h"
 #include "profileviewwidget.h"
 #include "chatmessagedelegate.h"
+#include "thumbnailcache.h"
 #include "smoothlistview.h"
 #include "dataservice.h"
 #include "incomingrequestswidget.h"
 #include "tokenmanager.h"
+#include "startupclock.h"
+#include "perfhudwidget.h"
+#include "perfmetrics.h"
 #include "bottomsheetdialog.h"
 #include "cryptoutils.h"
+#include "fileuploadservice.h"
+#include "httpclient.h"
 
 
 DataService* MainWindow::m_dataService = nullptr;
@@ -72,18 +82,76 @@ MainWindow::MainWindow(DataService* dataService, QWidget *parent)
     fullScreenShortcut->setKey(QKeySequence(Qt::Key_F11));
     connect(fullScreenShortcut, &QShortcut::activated, this, &MainWindow::toggleFullScreen);
 
+    // Отладочный оверлей производительности (Ctrl+Shift+P): гистограмма
+    // времени отрисовки, хит-рейты кэшей, очередь БД, круг до сервера
+    m_perfHud = new PerfHudWidget(this);
+    QShortcut *perfHudShortcut = new QShortcut(this);
+    perfHudShortcut->setKey(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_P));
+    connect(perfHudShortcut, &QShortcut::activated,
+            this, [this]() { m_perfHud->toggle(); });
+
     // Сохраняем указатели на сервисы данных и сети
     m_dataService = dataService;
     m_networkService = new NetworkService(this);
 
     // Синхронизируем криптографические ключи текущего пользователя
     m_dataService->updateOrAddCurrentUserCrypto(m_networkService->getCurrentUserCrypto());
-    
-    // Инициализируем VoIP сервис и виджет звонков
+
+    // Подключаемся к серверу сразу, до построения виджетов: TCP connect и
+    // рукопожатие идут параллельно с конструированием интерфейса
+    {
+        QString configPath = QCoreApplication::applicationDirPath() + "/config.ini";
+        QSettings settings(configPath, QSettings::IniFormat);
+        qDebug() << "Current path:" << QDir::currentPath();
+        qDebug() << "INI keys =" << settings.allKeys();
+        QString serv_Ip = settings.value("network/servIp", "127.0.0.1").toString();
+
+        // 0-RTT возобновление: при валидном токене и кэшированном резюм-ключе
+        // сервера token_login уезжает прямо в кадре рукопожатия — вход и
+        // дельта-синхронизация приходят первым же ответом сервера вместо трех
+        // последовательных обменов. Версия списка контактов берется из
+        // session.ini: БД к этому моменту еще открывается в своем потоке.
+        if (TokenManager::hasToken() && TokenManager::isTokenValid(30)) {
+            const QByteArray resumeKey =
+                QByteArray::fromBase64(TokenManager::getResumeKey().toLatin1());
+            if (resumeKey.size() == 32) {
+                QJsonObject bundle;
+                bundle["type"] = "token_login";
+                bundle["token"] = TokenManager::getToken();
+                bundle["username"] = TokenManager::getUsername();
+                bundle["contacts_rev"] =
+                    static_cast<double>(TokenManager::getContactsRev());
+                m_networkService->stageResumeTicket(resumeKey, bundle);
+                StartupClock::mark("resume ticket staged");
+            }
+        }
+
+        m_networkService->connectToServer(serv_Ip, 1234);
+        StartupClock::mark("tcp connect started");
+    }
+
+    // Инициализируем VoIP сервис; CallWidget создается лениво при первом
+    // звонке (ensureCallWidget) и не тормозит холодный старт
     m_callService = new CallService(m_networkService, m_dataService, this);
-    m_callWidget = new CallWidget(m_callService, this);
-    m_callWidget->hide();
-    qDebug() << "[MainWindow] CallWidget created:" << (m_callWidget ? "OK" : "FAILED");
+
+    // Загрузчик вложений: чанки по основному шифрованному соединению,
+    // с дедупликацией по хешу и точной докачкой после обрыва. При
+    // недоступности канала (старый сервер) откатываемся на HTTP-путь
+    m_fileUploadService = new FileUploadService(m_networkService, m_dataService, this);
+
+    // Шейпинг передач на время звонка: чанки уступают uplink UDP-аудио
+    // (см. FileUploadService::setCallActive)
+    connect(m_callService, &CallService::callConnected, m_fileUploadService,
+            [this] { m_fileUploadService->setCallActive(true); });
+    connect(m_callService, &CallService::callEnded, m_fileUploadService,
+            [this] { m_fileUploadService->setCallActive(false); });
+
+    connect(m_fileUploadService, &FileUploadService::uploadFailed,
+            this, [this](const QString& filePath, const QString& reason) {
+        qWarning() << "[MainWindow] File channel upload failed (" << reason
+                   << "), falling back to HTTP for" << filePath;
+        uploadFileToGo(filePath);
+    });
 
     // Создаем модель и прокси для фильтрации сообщений чата
     m_chatModel = new ChatMessageModel(this);
@@ -94,6 +162,24 @@ MainWindow::MainWindow(DataService* dataService, QWidget *parent)
 
     // Строим основной интерфейс и настраиваем стек виджетов
     buildMainUI();
+    StartupClock::mark("main ui built");
+
+    // Реестр вторичных поверхностей: виджеты создаются ensure*-фабриками
+    // при первом показе, а реапер выгружает те, что давно скрыты
+    // (см. hibernateIdleSurfaces) — простаивающие surface не держат память
+    registerLazySurface(QStringLiteral("call"),
+                        [this]() -> QWidget* { return m_callWidget; });
+    registerLazySurface(QStringLiteral("profile"),
+                        [this]() -> QWidget* { return m_profileViewWidget; });
+    registerLazySurface(QStringLiteral("requests"),
+                        [this]() -> QWidget* { return m_incomingRequestsWidget; });
+
+    // Реапер — хозяйственный таймер: точность ему не нужна, поэтому он
+    // живет в TimerHub и делит пробуждения с остальными грубыми таймерами
+    m_surfaceReaper = new CoalescedTimer(this);
+    m_surfaceReaper->setInterval(SurfaceSweepIntervalMs);
+    connect(m_surfaceReaper, &CoalescedTimer::timeout, this, &MainWindow::hibernateIdleSurfaces);
+    m_surfaceReaper->start();
     ui->rootStackedWidget->addWidget(m_loginWidget);
     ui->rootStackedWidget->addWidget(m_mainChatWidget);
     ui->rootStackedWidget->setCurrentWidget(m_loginWidget);
@@ -101,6 +187,20 @@ MainWindow::MainWindow(DataService* dataService, QWidget *parent)
     // Создаем всплывающее окно результатов поиска
     m_searchResultsPopup = new SearchResultsPopup(this);
 
+    // Дебоунс-таймеры пакетных подтверждений: квитанции доставки сжимаются
+    // в верхнюю границу {from, up_to_id}, квитанции прочтения копятся в
+    // массив ids. Открытие чата с сотнями непрочитанных — это один
+    // message_read вместо сотен.
+    m_deliveredAckTimer = new QTimer(this);
+    m_deliveredAckTimer->setSingleShot(true);
+    m_deliveredAckTimer->setInterval(50);
+    connect(m_deliveredAckTimer, &QTimer::timeout, this, &MainWindow::flushDeliveredAcks);
+
+    m_readReceiptTimer = new QTimer(this);
+    m_readReceiptTimer->setSingleShot(true);
+    m_readReceiptTimer->setInterval(100);
+    connect(m_readReceiptTimer, &QTimer::timeout, this, &MainWindow::flushReadReceipts);
+
     // Устанавливаем глобальный фильтр событий для приложения
     qApp->installEventFilter(this);
 
@@ -112,23 +212,48 @@ MainWindow::MainWindow(DataService* dataService, QWidget *parent)
     // Подключаем все сигналы/слоты
     setupConnections();
 
-    // Загружаем конфигурацию сервера из INI файла
-    QString configPath = QCoreApplication::applicationDirPath() + "/config.ini";
-    QSettings settings(configPath, QSettings::IniFormat);
-    qDebug() << "Current path:" << QDir::currentPath();
-    qDebug() << "INI keys =" << settings.allKeys();
-    QString serv_Ip = settings.value("network/servIp", "127.0.0.1").toString();
-    
     // Включаем контекстное меню для списка пользователей
     m_userListView->setContextMenuPolicy(Qt::CustomContextMenu);
-    
-    // Подключаемся к серверу по IP и порту из конфигурации
-    m_networkService->connectToServer(serv_Ip, 1234);
+
+    // Холодный старт с валидным токеном: показываем список чатов из
+    // локальной SQLite сразу, не дожидаясь соединения и token_login.
+    // Сервер потом дообновит кэши обычным путем (onLoginSuccess/initLoad).
+    if (TokenManager::hasToken() && TokenManager::isTokenValid(30)) {
+        User me;
+        me.username = TokenManager::getUsername();
+        m_dataService->updateOrAddCurrentUser(me);
+        ui->rootStackedWidget->setCurrentWidget(m_mainChatWidget);
+        setWindowTitle(me.username);
+
+        auto showLocalContacts = [this]() {
+            m_dataService->initLoad();
+            StartupClock::mark("local contacts shown");
+        };
+        DatabaseFacade* db = m_dataService->getDatabaseService();
+        if (db && db->isReady()) {
+            showLocalContacts();
+        } else if (db) {
+            // БД еще открывается в своем потоке — загрузимся по готовности
+            connect(db, &DatabaseFacade::ready, this,
+                    [showLocalContacts](bool ok) {
+                if (ok)
+                    showLocalContacts();
+            });
+        }
+    }
 }
 
 
 void MainWindow::attemptAutoLogin()
 {
+    // Сессия уже возобновлена 0-RTT пакетом в кадре рукопожатия: сервер
+    // обработал вложенный token_login, login_success придет (или уже пришел)
+    // тем же полетом — повторный запрос только задублирует дельта-синхронизацию
+    if (m_dataService->sessionResumed()) {
+        qInfo() << "[MainWindow] Session resumed via 0-RTT ticket, skipping token_login";
+        return;
+    }
+
     // Проверяем наличие сохраненного токена
     if (!TokenManager::hasToken()) {
         qDebug() << "[MainWindow] No saved token, showing login screen";
@@ -154,6 +279,20 @@ void MainWindow::attemptAutoLogin()
     request["token"] = token;
     request["username"] = username;
 
+    // Версия локального кэша контактов — сервер ответит дельтой списка.
+    // Версия читается в потоке БД; запрос уходит из коллбэка.
+    if (m_dataService && m_dataService->getDatabaseService()
+            && m_dataService->getDatabaseService()->isReady()) {
+        m_dataService->getDatabaseService()->query<qint64>(
+            [username](DatabaseService &db) { return db.contactsRev(username); },
+            this,
+            [this, request](const qint64 &rev) mutable {
+                request["contacts_rev"] = static_cast<double>(rev);
+                m_networkService->sendJson(request);
+            });
+        return;
+    }
+
     // Отправляем запрос на сервер
     m_networkService->sendJson(request);
 }
@@ -212,6 +351,7 @@ void MainWindow::setupMenuPage()
         qDebug() << "[CLIENT] Showing Incoming Requests";
 
         // Показываем заявки в bottom sheet диалоге
+        ensureIncomingRequestsWidget();
         BottomSheetDialog* dlg = new BottomSheetDialog(m_incomingRequestsWidget, this);
         m_incomingRequestsWidget->show();
         dlg->exec();
@@ -342,7 +482,14 @@ void MainWindow::buildMainUI()
     // Настраиваем модель и делегат списка контактов
     m_contactModel = new ContactListModel(m_dataService, this);
     m_userListView->setModel(m_contactModel);
-    m_userListView->setItemDelegate(new ContactListDelegate(this));
+    m_userListView->setItemDelegate(
+        new ContactListDelegate(m_dataService->getAvatarCache(), this));
+
+    // Миниатюра аватара дозрела в фоне — перерисовываем список
+    connect(m_dataService->getAvatarCache(), &AvatarCache::avatarThumbnailReady,
+            this, [this](const QString&, int) {
+        m_userListView->viewport()->update();
+    });
 
     // Оптимизируем отображение списка
     m_userListView->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
@@ -393,19 +540,24 @@ void MainWindow::buildMainUI()
     // Подключаем сигналы делегата сообщений
     if (m_chatDelegate) {
         connect(m_chatDelegate, &ChatMessageDelegate::replyRequested, m_chatViewWidget, &ChatViewWidget::onMessageDoubleClicked);
-        connect(m_chatDelegate, &ChatMessageDelegate::fileDownloadRequested, m_chatViewWidget, &ChatViewWidget::fileDownloadRequested); 
+        connect(m_chatDelegate, &ChatMessageDelegate::fileDownloadRequested, m_chatViewWidget, &ChatViewWidget::fileDownloadRequested);
+
+        // Миниатюра изображения дозрела в фоне — перерисовываем чат
+        connect(m_chatDelegate->thumbnailCache(), &ThumbnailCache::thumbnailReady,
+                this, [chatView](const QString&) {
+            chatView->viewport()->update();
+        });
 
         qDebug() << "Delegate connections setup";
     }
 
-    // Создаем стековый layout для правой панели и виджет профиля
+    // Создаем стековый layout для правой панели; виджеты профиля и
+    // входящих заявок создаются лениво при первом обращении
     m_rightSideStackedLayout = new QStackedLayout(this);
-    m_profileViewWidget = new ProfileViewWidget(m_networkService, this);
     m_rightSideContainer->setLayout(m_rightSideLayout);
 
     // Добавляем виджеты в стек правой панели
     m_rightSideStackedLayout->addWidget(m_chatViewWidget);
-    m_incomingRequestsWidget = new IncomingRequestsWidget(this);
     m_rightSideStackedLayout->addWidget(m_placeholderWidget);
 
     // Финальная сборка layout'ов
@@ -416,6 +568,108 @@ void MainWindow::buildMainUI()
     mainLayout->addWidget(m_rightSideContainer, 1);
 }
 
+void MainWindow::ensureCallWidget()
+{
+    touchSurface(QStringLiteral("call"));
+    if (m_callWidget)
+        return;
+
+    QElapsedTimer buildTimer;
+    buildTimer.start();
+
+    m_callWidget = new CallWidget(m_callService, this);
+    m_callWidget->hide();
+
+    connect(m_callWidget, &CallWidget::acceptClicked, m_callService, &CallService::acceptCall);
+    connect(m_callWidget, &CallWidget::rejectClicked, m_callService, &CallService::rejectCall);
+    connect(m_callWidget, &CallWidget::endCallClicked, m_callService, &CallService::endCall);
+
+    StartupClock::mark(QStringLiteral("call widget built lazily (%1 ms)")
+                           .arg(buildTimer.elapsed()));
+}
+
+void MainWindow::ensureProfileViewWidget()
+{
+    touchSurface(QStringLiteral("profile"));
+    if (m_profileViewWidget)
+        return;
+
+    QElapsedTimer buildTimer;
+    buildTimer.start();
+
+    m_profileViewWidget = new ProfileViewWidget(m_networkService, this);
+
+    StartupClock::mark(QStringLiteral("profile view built lazily (%1 ms)")
+                           .arg(buildTimer.elapsed()));
+}
+
+void MainWindow::ensureIncomingRequestsWidget()
+{
+    touchSurface(QStringLiteral("requests"));
+    if (m_incomingRequestsWidget)
+        return;
+
+    QElapsedTimer buildTimer;
+    buildTimer.start();
+
+    m_incomingRequestsWidget = new IncomingRequestsWidget(this);
+
+    connect(m_incomingRequestsWidget, &IncomingRequestsWidget::requestRejected, this, &MainWindow::onRequestRejected);
+    connect(m_incomingRequestsWidget, &IncomingRequestsWidget::requestAccepted, this, &MainWindow::onRequestAccepted);
+    connect(m_dataService, &DataService::pendingContactRequestsUpdated,
+            m_incomingRequestsWidget, &IncomingRequestsWidget::updateRequests);
+
+    // Список заявок сервер прислал еще при логине: наполняем виджет из
+    // кэша DataService — критично после гибернации, когда виджет
+    // пересоздается с уже накопленными заявками
+    m_incomingRequestsWidget->updateRequests(m_dataService->pendingContactRequests());
+
+    StartupClock::mark(QStringLiteral("incoming requests widget built lazily (%1 ms)")
+                           .arg(buildTimer.elapsed()));
+}
+
+void MainWindow::registerLazySurface(const QString& name, std::function<QWidget*()> instance)
+{
+    LazySurface surface;
+    surface.instance = std::move(instance);
+    surface.lastUsedMs = QDateTime::currentMSecsSinceEpoch();
+    m_lazySurfaces.insert(name, surface);
+}
+
+void MainWindow::touchSurface(const QString& name)
+{
+    auto it = m_lazySurfaces.find(name);
+    if (it != m_lazySurfaces.end()) {
+        it->lastUsedMs = QDateTime::currentMSecsSinceEpoch();
+    }
+}
+
+void MainWindow::hibernateIdleSurfaces()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    for (auto it = m_lazySurfaces.begin(); it != m_lazySurfaces.end(); ++it) {
+        QWidget* widget = it->instance();
+        if (!widget) {
+            continue; // Поверхность не создана или уже выгружена
+        }
+        if (widget->isVisible()) {
+            // Открытая поверхность (идущий звонок, bottom sheet) — не трогаем
+            // и заодно двигаем таймер: простой отсчитывается от закрытия
+            it->lastUsedMs = now;
+            continue;
+        }
+        if (now - it->lastUsedMs < SurfaceIdleTimeoutMs) {
+            continue;
+        }
+
+        // Состояние поверхности восстановимо: ensure*-фабрика пересоздаст
+        // виджет при следующем показе, данные вернутся из кэшей сервисов
+        qInfo() << "[MainWindow] Hibernating idle surface:" << it.key();
+        widget->deleteLater();
+    }
+}
+
 void MainWindow::onContactsUpdated(const QStringList& sortedUsernames) {
     // Запрашиваем историю чата для всех контактов из кэша
     auto userCache = m_dataService->getUserCache()->keys();
@@ -440,50 +694,37 @@ void MainWindow::onOnlineStatusUpdated() {
 }
 
 void MainWindow::onOlderHistoryChunkPrepended(const QString& chatPartner, const QList<ChatMessage>& messages) {
+    // Круг запрос -> prepend замкнулся: подмешиваем замер в EWMA задержки
+    // страницы — от нее зависит глубина упреждающей пагинации
+    if (m_pageLoadClock.isValid()) {
+        const qint64 elapsedMs = m_pageLoadClock.elapsed();
+        m_pageLoadLatencyMs = m_pageLoadLatencyMs * (1.0 - PrefetchEwmaAlpha)
+                              + elapsedMs * PrefetchEwmaAlpha;
+        m_pageLoadClock.invalidate();
+    }
+
     // Игнорируем если не текущий чат или сообщений нет
     if (chatPartner != m_dataService->getCurrentChatPartner()->username || messages.isEmpty()) {
         m_dataService->updateOrAddIsLoadingHistory(false);
-        m_expectingRangeChange = false;
-        return;
-    }
-    
-    // Добавляем старые сообщения в начало истории
-    m_chatModel->prependMessages(messages);
-}
-
-void MainWindow::onScrollBarRangeChanged()
-{
-    // Игнорируем если не ожидаем изменения диапазона
-    if (!m_expectingRangeChange) {
         return;
     }
 
-    m_expectingRangeChange = false;
-    qDebug() << "[SCROLL] Range changed as expected.";
-
-    // Получаем smooth list view и скролбар
-    SmoothListView* view = qobject_cast<SmoothListView*>(m_chatViewWidget->chatHistoryView());
-    QScrollBar* scrollBar = view->verticalScrollBar();
-
-    // Вычисляем добавленную высоту и прокручиваем к ней
-    int newMaximum = scrollBar->maximum();
-    int heightAdded = newMaximum - m_oldScrollMax;
-
-    if (heightAdded > 0) {
-        view->stopScrollAnimation();
-        m_programmaticScrollInProgress = true;
-        scrollBar->setValue(heightAdded);
-        qDebug() << "[SCROLL] Manually setting scroll value to:" << heightAdded;
+    // Добавляем старые сообщения в начало истории; позицию вьюпорта
+    // с точностью до пикселя удерживает якорный prepend вью
+    // (SmoothListView), внешних компенсаций не требуется
+    m_chatModel->prependMessages(messages);
+    m_dataService->updateOrAddIsLoadingHistory(false);
 
-        // Сбрасываем флаг программной прокрутки через 50мс
-        QTimer::singleShot(50, this, [this]() {
-            m_programmaticScrollInProgress = false;
-        });
+    // Цепочка упреждения: при очень быстрой прокрутке или медленной
+    // странице одной вставки мало — если вьюпорт все еще внутри зазора,
+    // сразу запрашиваем следующую страницу, глубина упреждения сама
+    // подстраивается под скорость
+    const int value = m_chatViewWidget->chatHistoryView()->verticalScrollBar()->value();
+    if (value <= prefetchThresholdPx() && m_dataService->getOldestMessageId() != 0) {
+        m_dataService->updateOrAddIsLoadingHistory(true);
+        m_pageLoadClock.restart();
+        m_dataService->loadOlderHistoryChunk();
     }
-
-    // Сбрасываем флаг загрузки истории
-    m_dataService->updateOrAddIsLoadingHistory(false);
-    qDebug() << "[SCROLL] Loading finished, flag reset.";
 }
 
 void MainWindow::onHistoryLoaded(const QString& chatPartner, const QList<ChatMessage>& messages) {
@@ -505,8 +746,13 @@ void MainWindow::onHistoryLoaded(const QString& chatPartner, const QList<ChatMes
     m_chatModel->clearMessages();
     m_chatModel->addMessages(messages);
 
-    // Прокручиваем к непрочитанным сообщениям
-    onScrollToUnreadFast();
+    // Сохраненная позиция прокрутки имеет приоритет: возвращаем вьюпорт
+    // туда, где пользователь остановился; без якоря (или если якорь не
+    // попал в окно) — прежнее поведение, прокрутка к непрочитанным
+    const ChatScrollAnchor anchor = m_dataService->scrollAnchor(chatPartner);
+    if (anchor.messageId == 0 || !restoreScrollAnchor(anchor)) {
+        onScrollToUnreadFast();
+    }
     
     // Обрабатываем видимые сообщения через 50мс (для стабилизации layout)
     QTimer::singleShot(50, this, &MainWindow::processVisibleMessages);
@@ -590,11 +836,15 @@ void MainWindow::onNewMessageReceived(const ChatMessage& incomingMsg)
 {
     qDebug() << "onNewMessageRecived";
 
-    // Отправляем подтверждение доставки сообщения
-    QJsonObject deliveredCmd;
-    deliveredCmd["type"] = "message_delivered";
-    deliveredCmd["id"] = (double)incomingMsg.id;
-    m_networkService->sendJson(deliveredCmd);
+    // Ставим подтверждение доставки в пакет верхней границей: TCP упорядочен,
+    // значит получение id N от автора означает получение всех его более ранних
+    // сообщений. При шторме входящих (выдача офлайн-очереди) серверу уйдет
+    // одна запись {from, up_to_id} вместо массива из сотен ids.
+    qint64 &highWater = m_pendingDeliveredAcks[incomingMsg.fromUser];
+    highWater = qMax(highWater, incomingMsg.id);
+    if (!m_deliveredAckTimer->isActive()) {
+        m_deliveredAckTimer->start();
+    }
 
     // Игнорируем если нет активного чата
     if(m_dataService->getCurrentChatPartner() == nullptr)
@@ -646,6 +896,11 @@ void MainWindow::onMessageStatusChanged(qint64 messageId, ChatMessage::MessageSt
     //m_dataService->getDatabaseService()->updateMessageStatus(messageId, newStatus);
 }
 
+void MainWindow::onMessageStatusesChanged(const QList<qint64>& messageIds, ChatMessage::MessageStatus newStatus) {
+    // Пакетная квитанция: модель применяет весь набор одним проходом
+    m_chatModel->updateMessageStatuses(messageIds, newStatus);
+}
+
 void MainWindow::onUnreadCountChanged() {
     // Обновляем весь список контактов при изменении непрочитанных
     m_contactModel->refreshList();
@@ -667,7 +922,23 @@ void MainWindow::onMessageDeleted(const QString& chatPartner, qint64 messageId)
     m_contactModel->refreshContact(chatPartner);
 }
 
-void MainWindow::onSearchResultsReceived(const QJsonArray& users){
+void MainWindow::onSearchResultsReceived(const QJsonArray& users, qint64 generation,
+                                         bool firstChunk){
+    // Чанк устаревшего запроса (пользователь продолжил печатать) молча
+    // отбрасывается; нулевое поколение — ответ сервера без потоковой выдачи.
+    if (generation != 0 && generation != m_searchGeneration) {
+        return;
+    }
+
+    // Хвостовой чанк дополняет уже показанный список; если popup к этому
+    // моменту скрыт (клик мимо, пустое поле), заново его не поднимаем.
+    if (!firstChunk) {
+        if (m_searchResultsPopup->isVisible()) {
+            m_searchResultsPopup->appendResults(users);
+        }
+        return;
+    }
+
     // Позиционируем popup поиска под строкой поиска
     QWidget *searchBar = m_searchLineEdit;
     m_searchResultsPopup->move(searchBar->mapToGlobal(QPoint(0, searchBar->height())));
@@ -748,18 +1019,17 @@ void MainWindow::setupConnections()
     }
     qDebug() << "[MainWindow] m_callService exists: OK";
 
-    if (!m_callWidget) {
-        qWarning() << "[MainWindow] ERROR: m_callWidget is nullptr!";
-        return;
-    }
-    qDebug() << "[MainWindow] m_callWidget exists: OK";
-
     // --- Подключение сервисных и пользовательских событий (DataService/NetworkService/UI) ---
     connect(m_networkService, &NetworkService::connected, this, &MainWindow::onConnected);
     connect(m_networkService, &NetworkService::disconnected, this, &MainWindow::onDisconnected);
     connect(m_networkService, &NetworkService::jsonReceived, this, &MainWindow::onJsonReceived);
     connect(m_dataService, &DataService::encryptionEnabled, this, &MainWindow::attemptAutoLogin);
 
+    // Восстановление сессии после реконнекта: только после login_success
+    // NetworkService выталкивает сообщения, накопленные за время разрыва
+    connect(m_dataService, &DataService::loginSuccess,
+            m_networkService, &NetworkService::onSessionEstablished);
+
 
     connect(m_dataService, &DataService::contactsUpdated, this, &MainWindow::onContactsUpdated);
     connect(m_dataService, &DataService::onlineStatusUpdated, this, &MainWindow::onOnlineStatusUpdated);
@@ -772,6 +1042,7 @@ void MainWindow::setupConnections()
 
     connect(m_dataService, &DataService::newMessageReceived, this, &MainWindow::onNewMessageReceived);
     connect(m_dataService, &DataService::messageStatusChanged, this, &MainWindow::onMessageStatusChanged);
+    connect(m_dataService, &DataService::messageStatusesChanged, this, &MainWindow::onMessageStatusesChanged);
     connect(m_dataService, &DataService::unreadCountChanged, this, &MainWindow::onUnreadCountChanged);
     connect(m_dataService, &DataService::messageEdited, this, &MainWindow::onMessageEdited);
     connect(m_dataService, &DataService::messageDeleted, this, &MainWindow::onMessageDeleted);
@@ -781,8 +1052,6 @@ void MainWindow::setupConnections()
 
     // Входящие запросы — напрямую во view виджет заявок
     connect(m_dataService, &DataService::contactRequestReceived, this, &MainWindow::onContactRequestReceived);
-    connect(m_incomingRequestsWidget, &IncomingRequestsWidget::requestRejected, this, &MainWindow::onRequestRejected);
-    connect(m_incomingRequestsWidget, &IncomingRequestsWidget::requestAccepted, this, &MainWindow::onRequestAccepted);
 
     connect(m_dataService, &DataService::logoutSuccess, this, &MainWindow::onLogoutSuccess);
     connect(m_dataService, &DataService::logoutFailure, this, &MainWindow::onLogoutFailure);
@@ -812,6 +1081,15 @@ void MainWindow::setupConnections()
 
     //connect(m_profileViewWidget, &ProfileViewWidget::backButtonClicked, this, &MainWindow::hideProfileView);
     connect(m_chatViewWidget->messageTextEdit(), &QTextEdit::textChanged, this, &MainWindow::onTypingNotificationFired);
+
+    // Живой черновик: каждый символ обновляет только кэш, запись в БД
+    // коалесцируется внутри DataService
+    connect(m_chatViewWidget->messageTextEdit(), &QTextEdit::textChanged, this, [this]() {
+        if (const User* partner = m_dataService->getCurrentChatPartner()) {
+            m_dataService->updateDraft(partner->username,
+                                       m_chatViewWidget->messageTextEdit()->toPlainText());
+        }
+    });
     connect(m_chatViewWidget, &ChatViewWidget::replyToMessageRequested, this, &MainWindow::onReplyToMessage);
     connect(m_chatViewWidget, &ChatViewWidget::editMessageRequested, this, &MainWindow::onEditMessageRequested);
     connect(m_chatViewWidget, &ChatViewWidget::deleteMessageRequested, this, &MainWindow::onDeleteMessageRequested);
@@ -820,13 +1098,14 @@ void MainWindow::setupConnections()
     connect(m_chatViewWidget, &ChatViewWidget::replyCancelled, this, [this](){
         m_dataService->updateOrAddReplyToMessageId(0);
     });
+    connect(m_chatViewWidget, &ChatViewWidget::searchRequested,
+            m_dataService, &DataService::searchLocalMessages);
     connect(m_chatViewWidget, &ChatViewWidget::scrollToUnreadRequested, this, &MainWindow::onScrollToUnread);
     connect(m_chatViewWidget, &ChatViewWidget::scrollToBottomRequested, this, &MainWindow::onScrollToBottom);
 
     QScrollBar* scrollBar = m_chatViewWidget->chatHistoryView()->verticalScrollBar();
     connect(scrollBar, &QScrollBar::valueChanged, this, &MainWindow::processVisibleMessages);
     connect(scrollBar, &QScrollBar::valueChanged, this, &MainWindow::onChatScroll);
-    connect(scrollBar, &QScrollBar::rangeChanged, this, &MainWindow::onScrollBarRangeChanged);
 
     connect(m_userListView, &QListView::clicked, this, &MainWindow::onUserSelectionChanged);
     connect(m_userListView, &QListView::customContextMenuRequested, this, &MainWindow::onContactListContextMenu);
@@ -849,6 +1128,19 @@ void MainWindow::setupConnections()
     //connect(this, &MainWindow::newMessageForCurrentChat, m_chatViewWidget, &ChatViewWidget::onNewMessageReceived);
     connect(m_chatModel, &ChatMessageModel::messageNeedsReadReceipt, this, &MainWindow::onSendMessageReadReceipt);
 
+    // Модель вытеснила старые строки сверху — сдвигаем якорь пагинации,
+    // чтобы прокрутка вверх подгружала историю с фактического верха окна
+    connect(m_chatModel, &ChatMessageModel::windowTrimmed, this, [this](qint64 newOldestId){
+        m_dataService->updateOrAddOldestMessageId(newOldestId);
+    });
+
+    // Цель реплая вне окна модели: поднимаем из локальной БД и
+    // возвращаем в кэш резолвов модели — цитата дорисуется сама
+    connect(m_chatModel, &ChatMessageModel::replyTargetMissing,
+            m_dataService, &DataService::resolveReplyMessage);
+    connect(m_dataService, &DataService::replyMessageResolved,
+            m_chatModel, &ChatMessageModel::applyReplyFallback);
+
     // Символьный поиск по истории чата
     connect(m_chatViewWidget, &ChatViewWidget::searchTextEntered, this, [this](const QString& text){
         m_chatFilterProxy->setFilterRegularExpression(QRegularExpression::escape(text));
@@ -856,15 +1148,14 @@ void MainWindow::setupConnections()
 
     // --- Меню и заявки ---
 
-    connect(m_dataService, &DataService::pendingContactRequestsUpdated, m_incomingRequestsWidget, &IncomingRequestsWidget::updateRequests);
     connect(m_menuButton, &QToolButton::clicked, this,  &MainWindow::onMenuButtonClicked);
     connect(m_chatViewWidget, &ChatViewWidget::attachFileRequested, this, &MainWindow::onAttachFileRequested);
     connect(m_chatViewWidget, &ChatViewWidget::fileDownloadRequested, this, &MainWindow::onFileDownloadRequested);
 
     // --- Звонки (audio/video) ---
     qDebug() << "[MW] Setting up call connections...";
-    if (!m_callService || !m_callWidget) {
-        qWarning() << "[MW] ❌ CallService or CallWidget not initialized";
+    if (!m_callService) {
+        qWarning() << "[MW] ❌ CallService not initialized";
         return;
     }
 
@@ -894,10 +1185,7 @@ void MainWindow::setupConnections()
             [this](const QString& fromUser) {
                 qDebug() << "[MW] ========== INCOMING CALL SIGNAL RECEIVED ==========";
                 qDebug() << "[MW] From:" << fromUser;
-                if (!m_callWidget) {
-                    qWarning() << "[MW] ❌ CallWidget is nullptr!";
-                    return;
-                }
+                ensureCallWidget();
                 qDebug() << "[MW] Setting caller name to:" << fromUser;
                 m_callWidget->setCallerName(fromUser);
                 qDebug() << "[MW] Setting state to 'Входящий звонок'";
@@ -912,6 +1200,7 @@ void MainWindow::setupConnections()
     connect(m_callService, &CallService::outgoingCallShow, this,
             [this]() {
                 qDebug() << "[MW] >>> OUTGOING CALL - waiting for answer";
+                ensureCallWidget();
                 qDebug() << "[MW] Setting caller name to:" << m_dataService->getCurrentChatPartner()->username;
                 m_callWidget->setCallerName(m_dataService->getCurrentChatPartner()->username);
                 m_callWidget->setCallState("Ожидание ответа");
@@ -924,6 +1213,7 @@ void MainWindow::setupConnections()
     connect(m_callService, &CallService::callConnected, this,
             [this]() {
                 qDebug() << "[MW] >>> CALL CONNECTED";
+                ensureCallWidget();
                 m_callWidget->setCallState("Разговор активен");
                 m_callWidget->show();
                 qDebug() << "[MW] ✅ Call connected";
@@ -934,13 +1224,15 @@ void MainWindow::setupConnections()
                 int mins = seconds / 60;
                 int secs = seconds % 60;
                 QString timeStr = QString::asprintf("%02d:%02d", mins, secs);
-                m_callWidget->onDurationChanged(timeStr);
+                if (m_callWidget)
+                    m_callWidget->onDurationChanged(timeStr);
             });
 
     connect(m_callService, &CallService::callEnded, this,
             [this]() {
                 qDebug() << "[MW] >>> CALL ENDED";
-                m_callWidget->hide();
+                if (m_callWidget)
+                    m_callWidget->hide();
                 qDebug() << "[MW] ✅ Call UI hidden";
             });
 
@@ -950,14 +1242,6 @@ void MainWindow::setupConnections()
                 qWarning() << "[MW] Call error:" << error;
             });
 
-    if (!m_callWidget) {
-        qWarning() << "[MainWindow] CallWidget not available, skipping connections";
-        return;
-    }
-
-    connect(m_callWidget, &CallWidget::acceptClicked, m_callService, &CallService::acceptCall);
-    connect(m_callWidget, &CallWidget::rejectClicked, m_callService, &CallService::rejectCall);
-    connect(m_callWidget, &CallWidget::endCallClicked, m_callService, &CallService::endCall);
 
     // Прочее: получение истории, обновление профиля
     connect(m_dataService, &DataService::requestServerHistory, this, &MainWindow::onRequestServerHistory);
@@ -968,6 +1252,33 @@ void MainWindow::setupConnections()
 
     connect(m_dataService, &DataService::chatMetadataChanged,
             m_contactModel, &ContactListModel::onChatMetadataChanged);
+
+    // Ленивый профиль пришел после входа: пересобираем снимок строки,
+    // чтобы имя/статус/аватар появились без перезагрузки списка
+    connect(m_dataService, &DataService::userCacheChanged,
+            this, [this](const QString& username) {
+        if (!m_contactModel) {
+            return;
+        }
+        const QModelIndex idx = m_contactModel->indexForUsername(username);
+        if (idx.isValid()) {
+            m_contactModel->refreshContact(idx);
+        }
+    });
+    // Свежий last_seen запрашивается только при открытии карточки профиля
+    // (см. showProfileView); когда ответ приходит, открытая карточка
+    // перерисовывается из обновленного кэша
+    connect(m_dataService, &DataService::profileReceived,
+            this, [this](const QString& username) {
+        if (!m_profileViewWidget || !m_profileViewWidget->isVisible()
+            || m_profileViewWidget->profileUsername() != username) {
+            return;
+        }
+        if (const User* cached = m_dataService->getUserFromCache(username)) {
+            const User* me = m_dataService->getCurrentUser();
+            m_profileViewWidget->setUserProfile(*cached, me && username == me->username);
+        }
+    });
     connect(m_dataService, &DataService::chatMetadataChanged, this, [this](const QString& username){
         if(m_dataService->getCurrentChatPartner() == nullptr){
             qDebug() << "m_dataService->getCurrentChatPartner() == nullptr";
@@ -1003,18 +1314,21 @@ void MainWindow::onAttachFileRequested(){
     // Открываем диалог выбора файла для отправки
     QString filePath = QFileDialog::getOpenFileName(this, tr("Выберите файл для отправки"));
     if (!filePath.isEmpty()) {
-        uploadFileToGo(filePath);  
+        // Конвейерная загрузка чанками по основному соединению; HTTP-путь
+        // остается запасным (см. uploadFailed в setup-коннектах)
+        m_fileUploadService->enqueueUpload(filePath);
     }
 }
 
 void MainWindow::onAvatarUpdated(const QString &username, const QString &avatarUrl) {
     Q_UNUSED(avatarUrl);
     
-    // Обновляем аватар контакта в списке
+    // Обновляем аватар контакта в списке: refreshContact пересобирает
+    // снимок строки модели (голый dataChanged оставил бы его устаревшим)
     if (m_contactModel) {
-        QModelIndex idx = m_contactModel->indexForUsername(username);  
+        QModelIndex idx = m_contactModel->indexForUsername(username);
         if (idx.isValid()) {
-            emit m_contactModel->dataChanged(idx, idx, {ContactListModel::AvatarRole});
+            m_contactModel->refreshContact(idx);
         }
     }
 }
@@ -1022,47 +1336,42 @@ void MainWindow::onAvatarUpdated(const QString &username, const QString &avatarU
 void MainWindow::onContactRequestReceived(const QJsonObject& request){
     // Загружаем аватар заявителя и добавляем заявку
     m_dataService->getAvatarCache()->ensureAvatar(request.value("fromUsername").toString(), request.value("fromAvatarUrl").toString());
+    ensureIncomingRequestsWidget();
     m_incomingRequestsWidget->addRequest(request);
 }
 
 void MainWindow::onFileDownloadRequested(const QString &fileId, const QString &url, const QString &fileName) {
     // Формируем URL для скачивания и путь сохранения
-    QNetworkAccessManager* manager = new QNetworkAccessManager(this);
     QUrl fileUrl(url);
     fileUrl = "http://localhost:9090/files/download/" +  fileId;
     QString savePath = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation) + "/MessengerFiles/"+ fileId + "_" + fileName;
-    
+
     QFileInfo file(savePath);
     if (file.exists() && file.isFile()) {
         // Открываем существующий файл
         QDesktopServices::openUrl(QUrl::fromLocalFile(savePath));
     } else{
-        // Скачиваем новый файл
-        QNetworkRequest request(fileUrl);
-        QNetworkReply *reply = manager->get(request);
-        connect(reply, &QNetworkReply::finished, this, [this,reply, savePath]() {
-            if (reply->error() == QNetworkReply::NoError) {
-                QByteArray content = reply->readAll();
-                QFile file(savePath);
-                if (file.open(QIODevice::WriteOnly)) {
-                    file.write(content);
-                    file.close();
-                    QMessageBox::information(this, "Файл скачан", "Файл сохранён в " + savePath);
+        // Скачивание по клику идет интерактивной полосой общего
+        // HTTP-слоя: потоковая запись на диск, keep-alive соединение,
+        // а оборванная закачка продолжается Range-запросом с хвоста
+        HttpClient::instance()->download(
+            fileUrl, savePath, HttpClient::Lane::Interactive,
+            [this, savePath](bool ok, const QString& error) {
+                if (ok) {
+                    QMessageBox::information(this, "Файл скачан",
+                                             "Файл сохранён в " + savePath);
                 } else {
-                    QMessageBox::critical(this, "Ошибка", "Не удалось сохранить файл!");
+                    QMessageBox::critical(this, "Ошибка сети", error);
                 }
-            } else {
-                QMessageBox::critical(this, "Ошибка сети", reply->errorString());
-            }
-            reply->deleteLater();
-        });
+            });
     }
 }
 
 void MainWindow::uploadFileToGo(const QString& filePath)
 {
-    // Загружаем файл на Go сервер через multipart/form-data
-    QNetworkAccessManager* manager = new QNetworkAccessManager(this);
+    // Загружаем файл на Go сервер через multipart/form-data — менеджером
+    // общего HTTP-слоя (keep-alive соединение и кэш DNS на весь процесс)
+    QNetworkAccessManager* manager = HttpClient::instance()->networkManager();
     QHttpMultiPart* multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType, this);
 
     QFile* file = new QFile(filePath, this);
@@ -1139,6 +1448,36 @@ void MainWindow::onContactListContextMenu(const QPoint& pos)
     menu.addSeparator();
     QAction* profileAction = menu.addAction("Открыть профиль " + displayName);
 
+    // Сквозное шифрование — опция на чат; пункт доступен только когда
+    // обмен ключами с собеседником уже состоялся
+    QAction* encryptAction = nullptr;
+    E2ESessionManager* e2e = m_dataService->getE2ESessions();
+    if (e2e->hasSession(username)) {
+        menu.addSeparator();
+        encryptAction = menu.addAction(e2e->isChatEncrypted(username)
+                                           ? "Отключить сквозное шифрование"
+                                           : "Включить сквозное шифрование");
+    }
+
+    // Срок хранения сообщений (исчезающие сообщения): политика общая на
+    // диалог, сервер применит ее к своей копии и уведомит собеседника
+    menu.addSeparator();
+    QMenu* retentionMenu = menu.addMenu("Автоудаление сообщений");
+    const qint64 currentRetention = m_dataService->retentionSeconds(username);
+    const QList<QPair<QString, qint64>> retentionOptions = {
+        {"Выключено", 0},
+        {"24 часа", 24LL * 60 * 60},
+        {"7 дней", 7LL * 24 * 60 * 60},
+        {"30 дней", 30LL * 24 * 60 * 60},
+    };
+    QHash<QAction*, qint64> retentionActions;
+    for (const auto& option : retentionOptions) {
+        QAction* action = retentionMenu->addAction(option.first);
+        action->setCheckable(true);
+        action->setChecked(option.second == currentRetention);
+        retentionActions.insert(action, option.second);
+    }
+
     menu.addSeparator();
     QAction* deleteAction = menu.addAction("Удалить чат");
 
@@ -1150,6 +1489,12 @@ void MainWindow::onContactListContextMenu(const QPoint& pos)
     if (selected == pinAction) {
         // Закрепляем/открепляем чат
         m_dataService->setPinned(username, !isPinned);
+    } else if (retentionActions.contains(selected)) {
+        // Меняем срок хранения сообщений чата
+        m_dataService->setRetention(username, retentionActions.value(selected));
+    } else if (encryptAction && selected == encryptAction) {
+        // Переключаем сквозное шифрование чата
+        e2e->setChatEncrypted(username, !e2e->isChatEncrypted(username));
     } else if (selected == profileAction) {
         // Показываем профиль контакта
         showProfileView((*m_dataService->getUserCache())[username] );
@@ -1186,10 +1531,14 @@ void MainWindow::onProfileUpdateResult(const QJsonObject& response) {
         // Обновляем локальные данные профиля при успехе
         const User* currentUser = m_dataService->getCurrentUser();
         if (currentUser) {
+            // Ответ дифференциальный: применяем только присланные поля
             User updatedUser = *currentUser;
-            updatedUser.displayName = response.value("displayname").toString();
-            updatedUser.statusMessage = response.value("status_message").toString();
-            updatedUser.avatarUrl = response.value("avatar_url").toString();
+            if (response.contains("displayname"))
+                updatedUser.displayName = response.value("displayname").toString();
+            if (response.contains("status_message"))
+                updatedUser.statusMessage = response.value("status_message").toString();
+            if (response.contains("avatar_url"))
+                updatedUser.avatarUrl = response.value("avatar_url").toString();
             m_dataService->updateOrAddCurrentUser(updatedUser);
         } else {
             qWarning() << "[DataService] currentUser is null, cannot update.";
@@ -1261,6 +1610,79 @@ void MainWindow::onScrollToBottom() {
     QMetaObject::invokeMethod(m_chatViewWidget, "scrollToBottom", Qt::QueuedConnection);
 }
 
+void MainWindow::captureScrollAnchor(const QString& chatPartner)
+{
+    if (!m_chatViewWidget) {
+        return;
+    }
+
+    QListView* view = m_chatViewWidget->chatHistoryView();
+    QScrollBar* scrollBar = view->verticalScrollBar();
+
+    // Внизу чата (тот же допуск, что в isScrolledToBottom) позиция не
+    // нужна — сбрасываем сохраненную, чтобы не вернуться к устаревшей
+    if (scrollBar->value() >= scrollBar->maximum() - 5) {
+        m_dataService->saveScrollAnchor(chatPartner, ChatScrollAnchor());
+        return;
+    }
+
+    // Якорь — верхнее видимое сообщение (середина ширины: отступы пузырей
+    // у краев могут не накрывать точку у самой кромки)
+    const QModelIndex topIndex =
+        view->indexAt(QPoint(view->viewport()->width() / 2, 1));
+    if (!topIndex.isValid()) {
+        return;
+    }
+
+    const ChatMessage msg = topIndex.data(Qt::UserRole).value<ChatMessage>();
+    if (msg.id <= 0) {
+        return; // Неподтвержденное сообщение без серверного ID якорем не делаем
+    }
+
+    ChatScrollAnchor anchor;
+    anchor.messageId = msg.id;
+    anchor.pixelOffset = view->visualRect(topIndex).top();
+    m_dataService->saveScrollAnchor(chatPartner, anchor);
+
+    qDebug() << "[MainWindow] Scroll anchor saved:" << chatPartner
+             << "message" << anchor.messageId << "offset" << anchor.pixelOffset;
+}
+
+bool MainWindow::restoreScrollAnchor(const ChatScrollAnchor& anchor)
+{
+    // Ищем якорное сообщение в загруженном окне модели
+    for (int row = 0; row < m_chatModel->rowCount(); ++row) {
+        const QModelIndex sourceIndex = m_chatModel->index(row, 0);
+        if (sourceIndex.data(Qt::UserRole).value<ChatMessage>().id != anchor.messageId) {
+            continue;
+        }
+
+        const QModelIndex proxyIndex = m_chatFilterProxy->mapFromSource(sourceIndex);
+        if (!proxyIndex.isValid()) {
+            return false;
+        }
+
+        QListView* view = m_chatViewWidget->chatHistoryView();
+        QScrollBar* scrollBar = view->verticalScrollBar();
+
+        // Ставим якорь к верху вьюпорта и довозим пиксельный сдвиг
+        // (offset <= 0: часть пузыря была выше кромки). Флаг программной
+        // прокрутки не дает onChatScroll принять это за запрос пагинации
+        m_programmaticScrollInProgress = true;
+        view->scrollTo(proxyIndex, QAbstractItemView::PositionAtTop);
+        scrollBar->setValue(scrollBar->value() - anchor.pixelOffset);
+        QTimer::singleShot(50, this, [this]() {
+            m_programmaticScrollInProgress = false;
+        });
+
+        qDebug() << "[MainWindow] Scroll anchor restored: message"
+                 << anchor.messageId << "offset" << anchor.pixelOffset;
+        return true;
+    }
+
+    return false; // Якорь вне загруженного окна
+}
+
 void MainWindow::onConnected() {
     qDebug() << "[DEBUG] onConnected, m_loginWidget =" << m_loginWidget;
     
@@ -1317,18 +1739,18 @@ void MainWindow::processVisibleMessages()
     }
 }
 
-void MainWindow::onEditMessageRequested(qint64 messageId, const QString& oldText)
+void MainWindow::onEditMessageRequested(const ChatMessageHandle& handle)
 {
-    qDebug() << "[MainWindow]: Caught editMessageRequested signal for ID:" << messageId;
+    qDebug() << "[MainWindow]: Caught editMessageRequested signal for ID:" << handle.message.id;
 
     // Скрываем UI ответа при редактировании
     m_chatViewWidget->hideReplyUI();
 
     // Устанавливаем ID редактируемого сообщения
-    m_dataService->updateOrAddEditingMessageId(messageId);
+    m_dataService->updateOrAddEditingMessageId(handle.message.id);
 
-    // Переключаем чат в режим редактирования
-    m_chatViewWidget->setEditMode(true, oldText);
+    // Переключаем чат в режим редактирования: старый текст уже в хендле
+    m_chatViewWidget->setEditMode(true, handle.message.payload);
 }
 
 void MainWindow::onDeleteMessageRequested(qint64 messageId)
@@ -1357,10 +1779,13 @@ void MainWindow::onAddContactRequested(const QString& username)
     if (reply == QMessageBox::Yes) {
         qDebug() << "[CLIENT] Sending 'add_contact_request' for user:" << username;
 
-        // Отправляем запрос на сервер
+        // Отправляем запрос на сервер. Публичный ключ E2E едет попутно:
+        // обмен ключами подвезен к принятию контакта, без отдельных
+        // круговых обменов (сервер ретранслирует поле, не заглядывая)
         QJsonObject request;
         request["type"] = "add_contact_request";
         request["username"] = username;
+        request["e2e_key"] = m_dataService->getE2ESessions()->localPublicKeyBase64();
         m_networkService->sendJson(request);
     }
 }
@@ -1390,18 +1815,17 @@ void MainWindow::onTypingNotificationFired()
     m_dataService->getTypingSendTimer()->start();
 }
 
-void MainWindow::onReplyToMessage(qint64 messageId)
+void MainWindow::onReplyToMessage(const ChatMessageHandle& handle)
 {
-    qDebug() << "[CLIENT] Setting reply context to message ID:" << messageId;
-    ChatMessage msg;
+    qDebug() << "[CLIENT] Setting reply context to message ID:" << handle.message.id;
 
-    // Получаем сообщение для контекста ответа
-    if (m_chatModel->getMessageById(messageId, msg)) {
-        m_dataService->updateOrAddReplyToMessageId(messageId);
+    // Поля сообщения уже в хендле — поиск по модели не нужен
+    const ChatMessage& msg = handle.message;
+    m_dataService->updateOrAddReplyToMessageId(msg.id);
+
+    // Показываем UI ответа с текстом/именем файла
+    m_chatViewWidget->showReplyUI(msg.fromUser, (msg.payload == "")? msg.fileName :msg.payload );
 
-        // Показываем UI ответа с текстом/именем файла
-        m_chatViewWidget->showReplyUI(msg.fromUser, (msg.payload == "")? msg.fileName :msg.payload );
-    }
     m_chatViewWidget->scrollToBottom();
 }
 void MainWindow::onChatSearchTriggered(const QString &text)
@@ -1470,9 +1894,11 @@ void MainWindow::onSendMessageRequested(const QString& text)
         qDebug() << "[CLIENT] Sending 'edit_message' request for ID:" <<editingMessageId;
 
         QJsonObject request;
-        request["type"] = "edit_message";                  
-        request["id"] = editingMessageId;     
-        request["payload"] = text;                              
+        request["type"] = "edit_message";
+        request["id"] = editingMessageId;
+        // В зашифрованном чате и правка уходит запечатанной
+        request["payload"] = m_dataService->getE2ESessions()->sealIfEnabled(
+            m_dataService->getCurrentChatPartner()->username, text);
         m_networkService->sendJson(request);
     } else {
         // ОТПРАВКА НОВОГО СООБЩЕНИЯ
@@ -1489,7 +1915,7 @@ void MainWindow::onSendMessageRequested(const QString& text)
         msg.payload = text;
         msg.status = ChatMessage::Sending;           
         msg.isOutgoing = true;
-        msg.timestamp = QDateTime::currentDateTime().toString(Qt::ISODate);
+        msg.timestamp = QDateTime::currentMSecsSinceEpoch();
         msg.tempId = QUuid::createUuid().toString(QUuid::WithoutBraces);
         msg.replyToId =replyToMessageId;
         msg.isEdited = false;
@@ -1507,8 +1933,8 @@ void MainWindow::onSendMessageRequested(const QString& text)
             }
         }
 
-        // Сохраняем в локальную БД
-        if (m_dataService->getDatabaseService() && m_dataService->getDatabaseService()->isConnected()) {
+        // Сохраняем в локальную БД (запись уходит в поток БД)
+        if (m_dataService->getDatabaseService() && m_dataService->getDatabaseService()->isReady()) {
             m_dataService->getDatabaseService()->saveMessage(msg, m_dataService->getCurrentUser()->username);
         }
 
@@ -1522,18 +1948,23 @@ void MainWindow::onSendMessageRequested(const QString& text)
             m_dataService->getChatCacheForUser(chatPartner)->messages.append(msg);
         }
 
-        // Отправляем на сервер
+        // Отправляем на сервер. В зашифрованном чате нагрузка
+        // запечатывается ключом диалога прямо здесь: локальная БД и UI
+        // выше работают с открытым текстом, сервер видит только шифртекст
         QJsonObject request;
         request["type"] = "private_message";
         request["fromUser"] = msg.fromUser;
         request["toUser"] = msg.toUser;
-        request["payload"] = msg.payload;
+        request["payload"] = m_dataService->getE2ESessions()->sealIfEnabled(
+            msg.toUser, msg.payload.toString());
         request["reply_to_id"] = msg.replyToId;
-        request["temp_id"] = msg.tempId;
+        request["temp_id"] = msg.tempId.toString();
         request["file_id"] = msg.fileId;
-        request["file_name"] = msg.fileName;
+        request["file_name"] = msg.fileName.toString();
         request["file_url"] = msg.fileUrl;
 
+        // Метка для замера круга до сервера (echo вернет тот же temp_id)
+        PerfMetrics::markSent(msg.tempId.toString());
         m_networkService->sendJson(request);
 
         // Сбрасываем контекст ответа
@@ -1561,12 +1992,15 @@ void MainWindow::onLogoutButtonClicked()
 
 void MainWindow::onUserSelectionChanged(const QModelIndex &current)
 {
-    // Сохраняем черновик текущего чата перед переключением
+    // Сохраняем черновик текущего чата перед переключением: пустой текст
+    // тоже сбрасывается — это удаляет устаревший черновик из БД
     if (m_dataService->getCurrentChatPartner()) {
         QString currentDraft = m_chatViewWidget->messageTextEdit()->toPlainText();
-        if (!currentDraft.isEmpty()) {
-            m_dataService->saveDraft(m_dataService->getCurrentChatPartner()->username, currentDraft);
-        }
+        m_dataService->saveDraft(m_dataService->getCurrentChatPartner()->username, currentDraft);
+
+        // Вместе с черновиком уходит и позиция прокрутки: возврат в чат
+        // откроет его там же, где пользователь остановился
+        captureScrollAnchor(m_dataService->getCurrentChatPartner()->username);
     }
 
     // Сбрасываем UI если выбор недействителен
@@ -1702,8 +2136,13 @@ void MainWindow::showProfileView(User Us)
     qDebug() << "[CLIENT] Showing profile for" << Us.username;
 
     // Показываем профиль в bottom sheet (с флагом "свой профиль")
+    ensureProfileViewWidget();
     m_profileViewWidget->setUserProfile(Us, Us.username == m_dataService->getCurrentUser()->username);
 
+    // Кэшированный last_seen показан сразу, свежий дозапрашивается только
+    // для открытой карточки и придет через profileReceived
+    m_dataService->refreshProfile(Us.username);
+
     BottomSheetDialog* dlg = new BottomSheetDialog(m_profileViewWidget, this);
     dlg->exec();
 
@@ -1715,7 +2154,9 @@ void MainWindow::showProfileView()
     // Перегруженная версия для текущего собеседника
     if(m_dataService->getCurrentChatPartner()){
         qDebug() << "[CLIENT] Showing profile for" <<m_dataService->getCurrentChatPartner()->username;
+        ensureProfileViewWidget();
         m_profileViewWidget->setUserProfile(*m_dataService->getCurrentChatPartner(), false);
+        m_dataService->refreshProfile(m_dataService->getCurrentChatPartner()->username);
         BottomSheetDialog* dlg = new BottomSheetDialog(m_profileViewWidget, this);
         dlg->exec();
     }
@@ -1751,6 +2192,10 @@ void MainWindow::showContactRequestPrompt(const QString& fromUsername, const QSt
 
     if (reply == QMessageBox::Yes) {
         contactResponse["response"] = "accepted";
+        // Ответная половина обмена ключами E2E: инициатор получит наш
+        // публичный ключ в уведомлении contact_accepted
+        contactResponse["e2e_key"] =
+            m_dataService->getE2ESessions()->localPublicKeyBase64();
     } else {
         contactResponse["response"] = "declined";
     }
@@ -1759,16 +2204,24 @@ void MainWindow::showContactRequestPrompt(const QString& fromUsername, const QSt
 }
 
 void MainWindow::onRequestAccepted(const QJsonObject& request) {
+    // Заявка отвечена — убираем из кэша, чтобы пересозданный после
+    // гибернации виджет ее не показал снова
+    m_dataService->removePendingContactRequest(request["fromUsername"].toString());
+
     // Автоматическое принятие заявки из IncomingRequestsWidget
     QJsonObject contactResponse;
     contactResponse["type"] = "contact_request_response";     
     contactResponse["fromUsername"] = request["fromUsername"];  
 
-    contactResponse["response"] = "accepted";  
-    m_networkService->sendJson(contactResponse);  
+    contactResponse["response"] = "accepted";
+    contactResponse["e2e_key"] =
+        m_dataService->getE2ESessions()->localPublicKeyBase64();
+    m_networkService->sendJson(contactResponse);
 }
 
 void MainWindow::onRequestRejected(const QJsonObject& request) {
+    m_dataService->removePendingContactRequest(request["fromUsername"].toString());
+
     // Автоматическое отклонение заявки из IncomingRequestsWidget
     QJsonObject contactResponse;
     contactResponse["type"] = "contact_request_response";
@@ -1782,8 +2235,10 @@ void MainWindow::onGlobalSearchTriggered()
 {
     QString query = m_searchLineEdit->text().trimmed();
 
-    // Скрываем popup если пустой поиск
+    // Скрываем popup если пустой поиск. Поколение сдвигаем и здесь:
+    // долетающие чанки прерванного запроса станут устаревшими.
     if (query.isEmpty()) {
+        ++m_searchGeneration;
         if (m_searchResultsPopup && m_searchResultsPopup->isVisible()) {
             m_searchResultsPopup->hide();
         }
@@ -1792,10 +2247,13 @@ void MainWindow::onGlobalSearchTriggered()
 
     qDebug() << "[CLIENT] Triggered global user search for:" << query;
 
-    // Отправляем запрос поиска пользователей на сервер
+    // Отправляем запрос поиска пользователей на сервер. Поколение запроса
+    // возвращается сервером в каждом чанке результатов: и сервер, и клиент
+    // по нему отменяют хвосты превзойденных запросов.
     QJsonObject request;
     request["type"] = "search_users";
     request["term"] = query;
+    request["gen"] = ++m_searchGeneration;
     m_networkService->sendJson(request);
 }
 
@@ -1811,49 +2269,143 @@ bool MainWindow::eventFilter(QObject *watched, QEvent *event)
     // Завершаем VoIP звонок при закрытии окна
     if (event->type() == QEvent::Close) {
         m_callService->endCall();
+
+        // Позиция прокрутки открытого чата переживает перезапуск
+        if (m_dataService->getCurrentChatPartner()) {
+            captureScrollAnchor(m_dataService->getCurrentChatPartner()->username);
+        }
     }
 
     return QMainWindow::eventFilter(watched, event);
 }
 
+int MainWindow::prefetchThresholdPx() const
+{
+    // Нижняя граница — прежние два экрана: даже при нулевой измеренной
+    // скорости страница уходит в запрос заранее, а не по удару о верх
+    const int basePx = m_chatViewWidget->chatHistoryView()->viewport()->height() * 2;
+
+    // За время загрузки страницы вьюпорт проедет velocity * latency
+    // пикселей; запас покрывает разгон жеста между замерами
+    const int velocityPx = qRound(m_scrollVelocityPxS
+                                  * (m_pageLoadLatencyMs / 1000.0)
+                                  * PrefetchSafetyFactor);
+    return qMax(basePx, velocityPx);
+}
+
 void MainWindow::onChatScroll(int value)
 {
-    // Игнорируем программную прокрутку и загрузку истории
-    if (m_programmaticScrollInProgress || m_dataService->getIsLoadingHistory()) {
+    // Программная прокрутка (restoreScrollAnchor, переключение чата) не
+    // говорит ничего о скорости пальца — ни в замер, ни в триггер
+    if (m_programmaticScrollInProgress) {
+        m_lastScrollValue = value;
+        m_scrollSampleClock.restart();
         return;
     }
 
-    // Загружаем старые сообщения при прокрутке к верху
-    if (value == 0 && m_dataService->getOldestMessageId() != 0) {
-        QScrollBar* scrollBar = m_chatViewWidget->chatHistoryView()->verticalScrollBar();
-
-        m_expectingRangeChange = true;        
-        m_oldScrollMax = scrollBar->maximum();  
+    // Оценка скорости прокрутки вверх по соседним событиям скроллбара.
+    // Скачки от якорного prepend (вставка страницы сдвигает value на
+    // сотни пикселей за один тик) отбрасываются порогом по величине
+    if (m_lastScrollValue >= 0 && m_scrollSampleClock.isValid()) {
+        const qint64 dtMs = m_scrollSampleClock.elapsed();
+        const int dv = m_lastScrollValue - value; // >0 — движение вверх
+        const int jumpThresholdPx =
+            m_chatViewWidget->chatHistoryView()->viewport()->height();
+        if (dtMs > 0 && qAbs(dv) < jumpThresholdPx) {
+            const double instantPxS = dv * 1000.0 / dtMs;
+            m_scrollVelocityPxS = m_scrollVelocityPxS * (1.0 - PrefetchEwmaAlpha)
+                                  + qMax(0.0, instantPxS) * PrefetchEwmaAlpha;
+        }
+    }
+    m_lastScrollValue = value;
+    m_scrollSampleClock.restart();
 
-        qDebug() << "[SCROLL] Scrolled to top. Expecting range change. Old max:" << m_oldScrollMax;
+    if (m_dataService->getIsLoadingHistory()) {
+        return;
+    }
 
-        m_dataService->updateOrAddIsLoadingHistory(true);  
+    // Упреждающая пагинация: зазор до верха растет со скоростью
+    // прокрутки и с измеренной задержкой страницы — быстрый
+    // пролистыватель запрашивает историю дальше вперед, чем неспешный.
+    // Позицию вьюпорта при вставке удерживает якорный prepend
+    // (SmoothListView)
+    if (value <= prefetchThresholdPx() && m_dataService->getOldestMessageId() != 0) {
+        m_dataService->updateOrAddIsLoadingHistory(true);
+        m_pageLoadClock.restart();
 
-        QJsonObject request;
-        request["type"] = "get_history";
-        request["with_user"] = m_dataService->getCurrentChatPartner()->username;
-        request["before_id"] = m_dataService->getOldestMessageId();
-        m_networkService->sendJson(request);
+        // Страница берется из локальной БД; сервер запрашивается,
+        // только если локальная история исчерпана
+        m_dataService->loadOlderHistoryChunk();
     }
 }
 
 void MainWindow::onSendMessageReadReceipt(qint64 messageId)
 {
-    qDebug() << "[CLIENT] Received receipt signal for message ID:" << messageId << ". Sending to server.";
+    qDebug() << "[CLIENT] Received receipt signal for message ID:" << messageId << ". Queued for batch.";
+
+    // Локально обновляем статус сообщения сразу
+    m_dataService->updateMessageStatus(messageId, ChatMessage::MessageStatus::Read);
+
+    // Квитанция уходит в пакет: прокрутка чата или его открытие порождают
+    // шквал сигналов от модели, серверу они уйдут одним запросом.
+    m_pendingReadReceipts.insert(messageId);
+    if (!m_readReceiptTimer->isActive()) {
+        m_readReceiptTimer->start();
+    }
+}
+
+void MainWindow::flushDeliveredAcks()
+{
+    if (m_pendingDeliveredAcks.isEmpty()) return;
+
+    // Обратное давление: если очередь отправки загружена (например, идет
+    // выгрузка файла), придерживаем пакет квитанций до следующего тика
+    if (m_networkService->bytesQueued() > SendQueueSoftLimit) {
+        m_deliveredAckTimer->start();
+        return;
+    }
+
+    // Диапазонная форма: по одной константной записи на собеседника,
+    // сколько бы сообщений ни накопил дебоунс (обычно собеседник один).
+    for (auto it = m_pendingDeliveredAcks.constBegin();
+         it != m_pendingDeliveredAcks.constEnd(); ++it) {
+        QJsonObject deliveredCmd;
+        deliveredCmd["type"] = "message_delivered";
+        deliveredCmd["from"] = it.key();
+        deliveredCmd["up_to_id"] = (double)it.value();
+        m_networkService->sendJson(deliveredCmd);
+    }
+
+    qDebug() << "[CLIENT] Sent range delivery acks for"
+             << m_pendingDeliveredAcks.size() << "sender(s)";
+    m_pendingDeliveredAcks.clear();
+}
+
+void MainWindow::flushReadReceipts()
+{
+    if (m_pendingReadReceipts.isEmpty()) return;
+
+    // Обратное давление: при загруженной очереди отправки откладываем
+    // пакет квитанций — интерактивный трафик важнее
+    if (m_networkService->bytesQueued() > SendQueueSoftLimit) {
+        m_readReceiptTimer->start();
+        return;
+    }
 
-    // Формируем подтверждение прочтения
     QJsonObject readCmd;
     readCmd["type"] = "message_read";
-    readCmd["id"] = (double)messageId;
-    
-    // Локально обновляем статус сообщения
-    m_dataService->updateMessageStatus(messageId, ChatMessage::MessageStatus::Read);;
+    if (m_pendingReadReceipts.size() == 1) {
+        readCmd["id"] = (double)*m_pendingReadReceipts.constBegin();
+    } else {
+        QJsonArray ids;
+        for (qint64 id : std::as_const(m_pendingReadReceipts)) {
+            ids.append((double)id);
+        }
+        readCmd["ids"] = ids;
+    }
 
+    qDebug() << "[CLIENT] Sending read receipt batch of" << m_pendingReadReceipts.size();
+    m_pendingReadReceipts.clear();
     m_networkService->sendJson(readCmd);
 }
 
@@ -1874,3 +2426,23 @@ MainWindow::~MainWindow()
     qDebug() << "[DEBUG] MainWindow destructor called";
     delete ui;
 }
+
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    qDebug() << "[CLIENT] Shutdown: flushing pending state";
+
+    // Накопленные квитанции доставки/прочтения уходят на сервер сейчас,
+    // а не по таймеру, которого уже не будет
+    if (m_deliveredAckTimer) m_deliveredAckTimer->stop();
+    if (m_readReceiptTimer) m_readReceiptTimer->stop();
+    flushDeliveredAcks();
+    flushReadReceipts();
+
+    // Черновики и счетчики — одним пакетом в очередь БД, затем поток БД
+    // дорабатывает, делает WAL-чекпойнт и завершается с дедлайном
+    if (m_dataService) {
+        m_dataService->shutdown();
+    }
+
+    QMainWindow::closeEvent(event);
+}
@@ -4,6 +4,11 @@
 #include <QMainWindow>
 #include <QPointer>
 #include <QTimer>
+#include "core/timerhub.h"
+#include <QSet>
+#include <QHash>
+#include <QElapsedTimer>
+#include <functional>
 #include "chatfilterproxymodel.h"
 #include "structures.h"
 #include "networkservice.h"
@@ -21,6 +26,8 @@ class QStackedLayout;
 class QTimer;
 class QPoint;
 class QListView;
+class QCloseEvent;
+class PerfHudWidget;
 class QToolButton;
 class QMenu;
 class QAction;
@@ -36,6 +43,7 @@ class ChatMessageModel;
 class ChatFilterProxyModel;
 class SearchResultsPopup;
 class DataService;
+class FileUploadService;
 class IncomingRequestsWidget;
 QT_END_NAMESPACE
 
@@ -98,6 +106,15 @@ protected:
     /** @brief Обработка нажатий клавиш (Esc для закрытия поиска/меню). */
     void keyPressEvent(QKeyEvent *event);
 
+    /**
+     * @brief Упорядоченное завершение при закрытии окна.
+     *
+     * Одним пакетом дожимает грязное состояние (квитанции, черновики,
+     * счетчики) и останавливает поток БД с жестким дедлайном, чтобы
+     * выход был быстрым и без потери данных.
+     */
+    void closeEvent(QCloseEvent *event) override;
+
 private slots:
     /** @brief Отправка выбранного файла на сервер. */
     void uploadFileToGo(const QString& filePath);
@@ -123,13 +140,15 @@ private slots:
     void onHistoryLoaded(const QString& chatPartner, const QList<ChatMessage>& messages);
     void onNewMessageReceived(const ChatMessage& incomingMsg);
     void onMessageStatusChanged(qint64 messageId, ChatMessage::MessageStatus newStatus);
+    void onMessageStatusesChanged(const QList<qint64>& messageIds, ChatMessage::MessageStatus newStatus);
     void onUnreadCountChanged();
     void onMessageEdited(const QString& chatPartner, qint64 messageId, const QString& newPayload);
     void onMessageDeleted(const QString& chatPartner, qint64 messageId);
     void onConfirmMessageSent(QString tempId, const ChatMessage& msg);
 
     // --- Поиск и Контакты ---
-    void onSearchResultsReceived(const QJsonArray& users);
+    void onSearchResultsReceived(const QJsonArray& users, qint64 generation,
+                                 bool firstChunk);
     void onAddContactSuccess(const QString& username);
     void onAddContactFailure(const QString& reason);
     void onPendingContactRequestsUpdated(const QJsonArray& requests);
@@ -142,16 +161,17 @@ private slots:
     // --- Взаимодействие с чатом ---
     void onSendMessageRequested(const QString& text);
     void onUserSelectionChanged(const QModelIndex &current);
-    void onEditMessageRequested(qint64 messageId, const QString& oldText);
+    void onEditMessageRequested(const ChatMessageHandle& handle);
     void onDeleteMessageRequested(qint64 messageId);
-    void onReplyToMessage(qint64 messageId);
+    void onReplyToMessage(const ChatMessageHandle& handle);
     void onSendMessageReadReceipt(qint64 messageId);
+    void flushDeliveredAcks();
+    void flushReadReceipts();
     void onChatScroll(int value);
     void onTypingNotificationFired();
     void onTypingStatusChanged(const QString& username, bool isTyping);
     void onScrollToUnread();
     void onScrollToBottom();
-    void onScrollBarRangeChanged();
     void processVisibleMessages();
     void onRequestServerHistory(const QString& chatPartner, int afterId);
     void onScrollToUnreadFast();
@@ -186,6 +206,41 @@ private:
     /** @brief Подключение сигналов и слотов между компонентами. */
     void setupConnections();
 
+    /** @brief Ленивое создание виджета звонка при первом звонке. */
+    void ensureCallWidget();
+
+    /** @brief Ленивое создание виджета просмотра профиля. */
+    void ensureProfileViewWidget();
+
+    /** @brief Ленивое создание виджета входящих заявок. */
+    void ensureIncomingRequestsWidget();
+
+    /**
+     * @brief Регистрирует вторичную поверхность в реестре ленивых виджетов.
+     *
+     * Сами виджеты создают ensure*-фабрики при первом показе; реестр дает
+     * реаперу (hibernateIdleSurfaces) единый обход живых экземпляров без
+     * знания их конкретных типов.
+     *
+     * @param name Имя поверхности (ключ реестра, фигурирует в логах)
+     * @param instance Доступ к текущему экземпляру (nullptr — не создан)
+     */
+    void registerLazySurface(const QString& name, std::function<QWidget*()> instance);
+
+    /** @brief Отмечает обращение к поверхности (отодвигает гибернацию). */
+    void touchSurface(const QString& name);
+
+    /**
+     * @brief Освобождает давно не использовавшиеся скрытые поверхности.
+     *
+     * Вызывается реапер-таймером раз в SurfaceSweepIntervalMs: скрытый
+     * виджет, к которому не обращались дольше SurfaceIdleTimeoutMs,
+     * удаляется (QPointer-члены обнуляются сами), а ensure*-фабрика
+     * пересоздаст его при следующем показе. Видимые поверхности
+     * (идущий звонок, открытый bottom sheet) не трогаются.
+     */
+    void hibernateIdleSurfaces();
+
     /** @brief Инициализация обработчиков ответов (если используется). */
     void initResponseHandlers();
 
@@ -198,6 +253,29 @@ private:
     /** @brief Показ диалога входящего запроса в друзья. */
     void showContactRequestPrompt(const QString& fromUsername, const QString& fromDisplayName);
 
+    /**
+     * @brief Снимает позицию прокрутки покидаемого чата.
+     *
+     * Якорь — верхнее видимое сообщение и пиксельный сдвиг его верха от
+     * верха вьюпорта; позиция внизу чата сохраняется как "якоря нет"
+     * (следующее открытие идет обычным путем к непрочитанным/вниз).
+     *
+     * @param chatPartner Собеседник покидаемого чата
+     */
+    void captureScrollAnchor(const QString& chatPartner);
+
+    /**
+     * @brief Восстанавливает позицию прокрутки по сохраненному якорю.
+     *
+     * Ищет якорное сообщение в загруженном окне модели и ставит вьюпорт
+     * так, чтобы верх якоря оказался на сохраненном пиксельном сдвиге.
+     *
+     * @param anchor Сохраненная позиция (см. ChatScrollAnchor)
+     * @return false, если якорь не найден в окне — вызывающий прокручивает
+     *         к непрочитанным как раньше
+     */
+    bool restoreScrollAnchor(const ChatScrollAnchor& anchor);
+
     /** @brief Настройка страницы меню (бургер-меню). */
     void setupMenuPage();
 
@@ -210,6 +288,7 @@ private:
     // Сервисы (QPointer для безопасности при удалении)
     QPointer<NetworkService> m_networkService;
     QPointer<CallService> m_callService;
+    QPointer<FileUploadService> m_fileUploadService; ///< Загрузчик вложений по файловому каналу
 
     // Виджеты экранов
     QPointer<LoginWidget> m_loginWidget;
@@ -235,7 +314,23 @@ private:
     QPointer<ProfileViewWidget> m_profileViewWidget;
     QPointer<IncomingRequestsWidget> m_incomingRequestsWidget;
     QPointer<SearchResultsPopup> m_searchResultsPopup;
+    qint64 m_searchGeneration = 0; ///< Поколение последнего поискового запроса (отбраковка устаревших чанков)
+
+    /** @brief Порог простоя, после которого скрытая поверхность выгружается. */
+    static constexpr int SurfaceIdleTimeoutMs = 5 * 60 * 1000;
+
+    /** @brief Период обхода реестра поверхностей реапером. */
+    static constexpr int SurfaceSweepIntervalMs = 60 * 1000;
+
+    /** @brief Запись реестра ленивых поверхностей. */
+    struct LazySurface {
+        std::function<QWidget*()> instance; ///< Текущий экземпляр (nullptr — не создан)
+        qint64 lastUsedMs = 0;              ///< Последнее обращение (мс эпохи)
+    };
+    QHash<QString, LazySurface> m_lazySurfaces; ///< Реестр вторичных поверхностей
+    CoalescedTimer* m_surfaceReaper = nullptr;  ///< Таймер обхода реестра (гибернация)
     QPointer<CallWidget> m_callWidget;
+    QPointer<PerfHudWidget> m_perfHud; ///< Отладочный оверлей метрик (Ctrl+Shift+P)
 
     // Модели
     QPointer<ChatMessageModel> m_chatModel;
@@ -243,11 +338,51 @@ private:
     QPointer<ContactListModel> m_contactModel;
     QPointer<ChatMessageDelegate> m_chatDelegate;
 
+    // Пакетные подтверждения (см. flush*-слоты). Доставка подтверждается
+    // верхней границей: отправитель -> максимальный полученный id, серверу
+    // уходит одна запись {from, up_to_id} на собеседника независимо от
+    // размера шторма. Квитанции прочтения идут построчно (массивом ids):
+    // чтение через viewport не обязано покрывать префикс диалога.
+    QHash<QString, qint64> m_pendingDeliveredAcks;
+    QSet<qint64> m_pendingReadReceipts;
+    QPointer<QTimer> m_deliveredAckTimer;
+    QPointer<QTimer> m_readReceiptTimer;
+
+    // Порог обратного давления: при большем объеме неотправленных данных
+    // фоновые пакеты (квитанции) откладываются до разгрузки очереди
+    static constexpr qint64 SendQueueSoftLimit = 256 * 1024;
+
     // Состояние скролла
     qint64 m_scrollAnchorId = 0;
-    int m_oldScrollMax = 0;
     bool m_programmaticScrollInProgress = false;
-    bool m_expectingRangeChange = false;
+
+    /**
+     * @brief Упреждающая пагинация по скорости прокрутки.
+     *
+     * Фиксированный зазор в два экрана спасал от паузы только неспешную
+     * прокрутку: быстрый пролистыватель добирался до верха раньше, чем
+     * приходила страница. Теперь зазор считается из измеренной скорости
+     * (EWMA по событиям скроллбара, пиксели/с вверх) и измеренной
+     * задержки загрузки страницы (EWMA по кругу запрос -> prepend):
+     * страница запрашивается за velocity * latency * запас до верха,
+     * а по прибытии догружается следующая, если вьюпорт все еще внутри
+     * зазора — глубина упреждения сама растет со скоростью и с
+     * медленной БД/сетью.
+     */
+    double m_scrollVelocityPxS = 0.0;    ///< Скорость прокрутки вверх, px/s (EWMA)
+    int m_lastScrollValue = -1;          ///< Последнее значение скроллбара
+    QElapsedTimer m_scrollSampleClock;   ///< Интервал между событиями прокрутки
+    double m_pageLoadLatencyMs = 150.0;  ///< Задержка страницы истории, мс (EWMA)
+    QElapsedTimer m_pageLoadClock;       ///< Замер текущей загрузки страницы
+
+    /** @brief Запас к произведению скорость*задержка (неравномерность жеста). */
+    static constexpr double PrefetchSafetyFactor = 1.5;
+
+    /** @brief Сглаживание EWMA скорости и задержки (доля нового замера). */
+    static constexpr double PrefetchEwmaAlpha = 0.3;
+
+    /** @brief Пиксельный зазор упреждающей пагинации при текущей скорости. */
+    int prefetchThresholdPx() const;
 
     // Навигация (левая панель)
     QStackedWidget* m_leftMainPanel;
@@ -1,6 +1,7 @@
 #include "chatmessagemodel.h"
-#include <QDebug>  
+#include <QDebug>
 #include <QDate>
+#include <algorithm>
 ChatMessageModel::ChatMessageModel(QObject *parent)
     : QAbstractListModel(parent)
 {
@@ -11,7 +12,7 @@ ChatMessageModel::ChatMessageModel(QObject *parent)
 
 QModelIndex ChatMessageModel::findFirstUnreadMessage() const
 {
-    for (int i = 0; i < m_messages.count(); ++i) {
+    for (int i = 0; i < int(m_messages.size()); ++i) {
         const ChatMessage& msg = m_messages.at(i);
 
         // Первое входящее сообщение со статусом Sent или Delivered считаем непрочитанным
@@ -30,12 +31,12 @@ QModelIndex ChatMessageModel::findFirstUnreadMessage() const
 int ChatMessageModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    return m_messages.count();
+    return int(m_messages.size());
 }
 
 QVariant ChatMessageModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || index.row() >= m_messages.count()) {
+    if (!index.isValid() || index.row() >= int(m_messages.size())) {
         qDebug() << "[ChatMessageModel] data: invalid index" << index.row();
         return QVariant();
     }
@@ -72,14 +73,19 @@ bool ChatMessageModel::setData(const QModelIndex &index,
 
 void ChatMessageModel::addMessage(const ChatMessage &message)
 {
-    const int newRow = m_messages.count();
+    const int newRow = int(m_messages.size());
 
     beginInsertRows(QModelIndex(), newRow, newRow);
-    m_messages.append(message);
+    m_messages.push_back(message);
+    // Прогрев флага быстрого пути отрисовки: стикеры и эмодзи-сообщения
+    // распознаются при загрузке, а не внутри первого paint
+    m_messages.back().isStickerLike();
     if (message.id > 0)
-        m_messageMap[message.id] = message;
+        m_idToSeq[message.id] = m_frontSeq + newRow;
     endInsertRows();
 
+    trimToWindow();
+
     qDebug() << "[ChatMessageModel] addMessage: добавлено сообщение с id"
              << message.id << "rows:" << newRow + 1;
 }
@@ -89,21 +95,42 @@ void ChatMessageModel::addMessages(const QList<ChatMessage> &messages)
     if (messages.isEmpty())
         return;
 
-    int first = m_messages.count();
+    int first = int(m_messages.size());
     int last  = first + messages.count() - 1;
 
     beginInsertRows(QModelIndex(), first, last);
-    m_messages.append(messages);
     for (const auto& msg : messages) {
-        m_messageMap[msg.id] = msg;
+        if (msg.id > 0)
+            m_idToSeq[msg.id] = m_frontSeq + qint64(m_messages.size());
+        m_messages.push_back(msg);
+        m_messages.back().isStickerLike(); // Прогрев флага быстрого пути
     }
     endInsertRows();
 
+    trimToWindow();
+
     qDebug() << "[ChatMessageModel] addMessages: добавлено"
              << messages.size() << "сообщений. Новый размер:"
              << m_messages.size();
 }
 
+qint64 ChatMessageModel::anchorForRow(int row) const
+{
+    if (row < 0 || row >= int(m_messages.size()))
+        return NoAnchor;
+    return m_frontSeq + row;
+}
+
+int ChatMessageModel::rowForAnchor(qint64 anchor) const
+{
+    if (anchor == NoAnchor)
+        return -1;
+    const qint64 row = anchor - m_frontSeq;
+    if (row < 0 || row >= qint64(m_messages.size()))
+        return -1;
+    return int(row);
+}
+
 void ChatMessageModel::prependMessages(const QList<ChatMessage> &messages)
 {
     if (messages.isEmpty())
@@ -111,12 +138,16 @@ void ChatMessageModel::prependMessages(const QList<ChatMessage> &messages)
 
     beginInsertRows(QModelIndex(), 0, messages.count() - 1);
 
-    // Добавляем сообщения в начало в обратном порядке,
-    // чтобы сохранить хронологию
+    // Добавляем сообщения в начало в обратном порядке, чтобы сохранить
+    // хронологию; push_front у deque не сдвигает остальные элементы,
+    // а в индексе меняется только база порядковых номеров
     for (int i = messages.count() - 1; i >= 0; --i) {
         const auto& msg = messages.at(i);
-        m_messages.prepend(msg);
-        m_messageMap[msg.id] = msg;
+        m_messages.push_front(msg);
+        m_messages.front().isStickerLike(); // Прогрев флага быстрого пути
+        --m_frontSeq;
+        if (msg.id > 0)
+            m_idToSeq[msg.id] = m_frontSeq;
     }
 
     endInsertRows();
@@ -126,44 +157,84 @@ void ChatMessageModel::prependMessages(const QList<ChatMessage> &messages)
 
 void ChatMessageModel::clearMessages()
 {
-    if (m_messages.isEmpty())
+    if (m_messages.empty())
         return;
 
     beginResetModel();
     m_messages.clear();
-    m_messageMap.clear();
+    m_idToSeq.clear();
+    m_frontSeq = 0;
+    m_replyFallback.clear();
+    m_pendingReplyLookups.clear();
     endResetModel();
 
     qDebug() << "[ChatMessageModel] clearMessages: очищены все сообщения";
 }
 
+void ChatMessageModel::trimToWindow()
+{
+    if (int(m_messages.size()) <= MaxVisibleRows)
+        return;
+
+    // Вытесняем старые строки сверху: в долгоживущем чате модель не растет
+    // бесконечно вместе с потоком новых сообщений. Вытесненное остается
+    // в локальной БД и возвращается прокруткой вверх.
+    const int excess = int(m_messages.size()) - MaxVisibleRows;
+
+    beginRemoveRows(QModelIndex(), 0, excess - 1);
+    for (int i = 0; i < excess; ++i) {
+        m_idToSeq.remove(m_messages.front().id);
+        m_messages.pop_front();
+        ++m_frontSeq;
+    }
+    endRemoveRows();
+
+    // Сдвигаем якорь пагинации на фактический верх окна
+    const qint64 newOldestId = m_messages.front().id;
+    emit windowTrimmed(newOldestId);
+
+    qDebug() << "[ChatMessageModel] trimToWindow: вытеснено" << excess
+             << "строк, новая верхняя граница id" << newOldestId;
+}
+
 void ChatMessageModel::removeMessage(qint64 messageId)
 {
-    for (int i = 0; i < m_messages.count(); ++i) {
-        if (m_messages[i].id == messageId) {
-            beginRemoveRows(QModelIndex(), i, i);
-            m_messages.removeAt(i);
-            m_messageMap.remove(messageId);
-            endRemoveRows();
+    const int row = rowForId(messageId);
+    if (row < 0) {
+        qDebug() << "[ChatMessageModel] removeMessage: сообщение id"
+                 << messageId << "не найдено для удаления";
+        return;
+    }
 
-            qDebug() << "[ChatMessageModel] removeMessage: сообщение id"
-                     << messageId << "удалено из строки" << i;
-            return;
-        }
+    beginRemoveRows(QModelIndex(), row, row);
+    m_messages.erase(m_messages.begin() + row);
+    m_idToSeq.remove(messageId);
+
+    // Удаление из середины сдвигает строки ниже — пересчитываем их
+    // порядковые номера (единственный путь, требующий перестройки)
+    for (int i = row; i < int(m_messages.size()); ++i) {
+        if (m_messages[i].id > 0)
+            m_idToSeq[m_messages[i].id] = m_frontSeq + i;
     }
+    endRemoveRows();
+
     qDebug() << "[ChatMessageModel] removeMessage: сообщение id"
-             << messageId << "не найдено для удаления";
+             << messageId << "удалено из строки" << row;
 }
 
 void ChatMessageModel::confirmMessage(const QString& tempId,
                                       const ChatMessage& confirmedMessage)
 {
-    for (int i = 0; i < m_messages.count(); ++i) {
+    for (int i = 0; i < int(m_messages.size()); ++i) {
         if (m_messages[i].tempId == tempId &&
             !m_messages[i].tempId.isEmpty())
         {
+            // Строка получает серверный id — обновляем индекс
+            if (m_messages[i].id > 0)
+                m_idToSeq.remove(m_messages[i].id);
             m_messages[i] = confirmedMessage;
-            m_messageMap[confirmedMessage.id] = confirmedMessage;
+            if (confirmedMessage.id > 0)
+                m_idToSeq[confirmedMessage.id] = m_frontSeq + i;
 
             QModelIndex idx = index(i, 0);
             emit dataChanged(idx, idx, { Qt::UserRole });
@@ -180,56 +251,127 @@ void ChatMessageModel::confirmMessage(const QString& tempId,
 void ChatMessageModel::updateMessageStatus(qint64 messageId,
                                            ChatMessage::MessageStatus newStatus)
 {
-    for (int i = 0; i < m_messages.count(); ++i) {
-        if (m_messages[i].id == messageId) {
-            m_messages[i].status = newStatus;
-            if (m_messageMap.contains(messageId))
-                m_messageMap[messageId].status = newStatus;
+    const int row = rowForId(messageId);
+    if (row < 0) {
+        qDebug() << "[ChatMessageModel] updateMessageStatus: сообщение id"
+                 << messageId << "не найдено";
+        return;
+    }
 
-            QModelIndex idx = index(i, 0);
-            emit dataChanged(idx, idx, { Qt::UserRole });
+    m_messages[row].status = newStatus;
 
-            qDebug() << "[ChatMessageModel] updateMessageStatus: обновлён статус для id"
-                     << messageId << "->" << newStatus;
-            return;
+    QModelIndex idx = index(row, 0);
+    emit dataChanged(idx, idx, { Qt::UserRole });
+
+    qDebug() << "[ChatMessageModel] updateMessageStatus: обновлён статус для id"
+             << messageId << "->" << newStatus;
+}
+
+void ChatMessageModel::updateMessageStatuses(const QList<qint64>& messageIds,
+                                             ChatMessage::MessageStatus newStatus)
+{
+    // Один проход: собираем затронутые строки через индекс id->row
+    QVector<int> rows;
+    rows.reserve(messageIds.size());
+    for (qint64 messageId : messageIds) {
+        const int row = rowForId(messageId);
+        if (row < 0) continue; // Сообщение вне окна — строки нет
+        if (m_messages[row].status == newStatus) continue;
+        m_messages[row].status = newStatus;
+        rows.append(row);
+    }
+    if (rows.isEmpty()) return;
+
+    // Склеиваем строки в непрерывные диапазоны: по dataChanged на диапазон
+    std::sort(rows.begin(), rows.end());
+    int rangeStart = rows.first();
+    int rangeEnd = rangeStart;
+    for (int i = 1; i < rows.size(); ++i) {
+        if (rows[i] == rangeEnd + 1) {
+            rangeEnd = rows[i];
+            continue;
         }
+        emit dataChanged(index(rangeStart, 0), index(rangeEnd, 0), { Qt::UserRole });
+        rangeStart = rangeEnd = rows[i];
     }
-    qDebug() << "[ChatMessageModel] updateMessageStatus: сообщение id"
-             << messageId << "не найдено";
+    emit dataChanged(index(rangeStart, 0), index(rangeEnd, 0), { Qt::UserRole });
+
+    qDebug() << "[ChatMessageModel] updateMessageStatuses:" << rows.size()
+             << "строк ->" << newStatus;
 }
 
 void ChatMessageModel::editMessage(qint64 messageId,
                                    const QString& newPayload)
 {
-    for (int i = 0; i < m_messages.count(); ++i) {
-        if (m_messages[i].id == messageId) {
-            m_messages[i].payload  = newPayload;
-            m_messages[i].isEdited = true;
+    const int row = rowForId(messageId);
+    if (row < 0) {
+        qDebug() << "[ChatMessageModel] editMessage: сообщение id"
+                 << messageId << "не найдено для редактирования";
+        return;
+    }
 
-            if (m_messageMap.contains(messageId)) {
-                m_messageMap[messageId].payload  = newPayload;
-                m_messageMap[messageId].isEdited = true;
-            }
+    m_messages[row].payload  = newPayload;
+    m_messages[row].isEdited = true;
 
-            QModelIndex idx = index(i, 0);
-            emit dataChanged(idx, idx, { Qt::UserRole });
+    QModelIndex idx = index(row, 0);
+    emit dataChanged(idx, idx, { Qt::UserRole });
 
-            qDebug() << "[ChatMessageModel] editMessage: сообщение id"
-                     << messageId << "отредактировано";
-            return;
-        }
-    }
     qDebug() << "[ChatMessageModel] editMessage: сообщение id"
-             << messageId << "не найдено для редактирования";
+             << messageId << "отредактировано";
+}
+
+int ChatMessageModel::rowForId(qint64 id) const
+{
+    auto it = m_idToSeq.constFind(id);
+    if (it == m_idToSeq.constEnd())
+        return -1;
+    return int(it.value() - m_frontSeq);
 }
 
 bool ChatMessageModel::getMessageById(qint64 id, ChatMessage &msg) const
 {
-    if (m_messageMap.contains(id)) {
-        msg = m_messageMap.value(id);
+    const int row = rowForId(id);
+    if (row >= 0) {
+        msg = m_messages[row];
         return true;
     }
 
-    qDebug() << "[ChatMessageModel] getMessageById:" << id << "не найден";
+    // Цель вне загруженного окна: возможно, она уже поднята из БД
+    auto it = m_replyFallback.constFind(id);
+    if (it != m_replyFallback.constEnd()) {
+        msg = it.value();
+        return true;
+    }
+
+    // Первый промах по этому id — просим владельца модели поднять
+    // сообщение из локальной БД. Сигнал из константного метода требует
+    // const_cast; состояние ожидания живет в mutable-наборе.
+    if (id > 0 && !m_pendingReplyLookups.contains(id)) {
+        m_pendingReplyLookups.insert(id);
+        emit const_cast<ChatMessageModel*>(this)->replyTargetMissing(id);
+        qDebug() << "[ChatMessageModel] getMessageById:" << id
+                 << "вне окна, запрошен из локальной БД";
+    }
     return false;
 }
+
+void ChatMessageModel::applyReplyFallback(const ChatMessage &message)
+{
+    if (message.id <= 0) {
+        return; // В БД сообщения нет — строки продолжают рисовать заглушку
+    }
+
+    m_pendingReplyLookups.remove(message.id);
+    m_replyFallback.insert(message.id, message);
+
+    // Перерисовываем строки, цитирующие поднятое сообщение
+    for (int i = 0; i < int(m_messages.size()); ++i) {
+        if (m_messages[i].replyToId == message.id) {
+            const QModelIndex idx = index(i, 0);
+            emit dataChanged(idx, idx, { Qt::UserRole });
+        }
+    }
+
+    qDebug() << "[ChatMessageModel] applyReplyFallback: цель реплая id"
+             << message.id << "поднята из БД";
+}
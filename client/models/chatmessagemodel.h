@@ -2,6 +2,10 @@
 #define CHATMESSAGEMODEL_H
 
 #include <QAbstractListModel>
+#include <limits>
+#include <QHash>
+#include <QSet>
+#include <deque>
 #include "structures.h"
 
 Q_DECLARE_METATYPE(ChatMessage)
@@ -12,7 +16,15 @@ Q_DECLARE_METATYPE(ChatMessage)
  * Наследуется от QAbstractListModel и предоставляет данные для QListView/QML.
  * Поддерживает операции добавления (в конец и начало), удаления, редактирования,
  * а также обновление статусов доставки.
- * Хранит данные в двух структурах: линейный список для отображения и Map для быстрого доступа по ID.
+ *
+ * Хранилище — std::deque: вставка старой истории в начало (пагинация вверх)
+ * амортизированно O(1), в отличие от QList::prepend, который сдвигал все
+ * элементы и делал глубокую прокрутку квадратичной. Модель держит окно
+ * видимых строк: при росте хвоста сверх MaxVisibleRows старые строки
+ * вытесняются сверху (они остаются в локальной БД и прозрачно
+ * подгружаются обратно прокруткой вверх через DataService); о вытеснении
+ * сообщает сигнал windowTrimmed, чтобы якорь пагинации сдвинулся вместе
+ * с верхом окна.
  */
 class ChatMessageModel : public QAbstractListModel
 {
@@ -69,6 +81,28 @@ public:
      */
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
 
+    /** @brief Значение "якоря нет" для anchorForRow()/rowForAnchor(). */
+    static constexpr qint64 NoAnchor = std::numeric_limits<qint64>::min();
+
+    /**
+     * @brief Стабильный якорь строки, переживающий prepend.
+     *
+     * Номера строк сдвигаются при вставке старых страниц в начало;
+     * якорь — сквозной порядковый номер от начала истории (база окна —
+     * m_frontSeq), и у уже загруженных строк он не меняется. Вью
+     * запоминает якорь верхней видимой строки перед prepend и по нему
+     * находит ту же строку после (см. SmoothListView::setModel).
+     * @param row Номер строки в текущем окне
+     * @return Якорь строки или NoAnchor для невалидного номера
+     */
+    qint64 anchorForRow(int row) const;
+
+    /**
+     * @brief Номер строки по якорю anchorForRow().
+     * @return Номер строки или -1, если строка выпала из окна модели
+     */
+    int rowForAnchor(qint64 anchor) const;
+
 public slots:
     /**
      * @brief Добавляет одно новое сообщение в конец списка.
@@ -117,6 +151,21 @@ public slots:
      */
     void updateMessageStatus(qint64 messageId, ChatMessage::MessageStatus newStatus);
 
+    /**
+     * @brief Пакетно применяет один статус к набору сообщений.
+     *
+     * Квитанция о прочтении приходит массивом ids; обновление по одному —
+     * это N поисков и N сигналов dataChanged. Здесь строки находятся через
+     * индекс id->row, а dataChanged испускается одним вызовом на каждый
+     * непрерывный диапазон затронутых строк (квитанции обычно покрывают
+     * подряд идущий хвост чата, так что чаще всего диапазон один).
+     *
+     * @param messageIds ID сообщений (неизвестные окну молча пропускаются).
+     * @param newStatus Новый статус для всех перечисленных.
+     */
+    void updateMessageStatuses(const QList<qint64>& messageIds,
+                               ChatMessage::MessageStatus newStatus);
+
     /**
      * @brief Редактирует текст сообщения.
      * @param messageId ID сообщения.
@@ -125,14 +174,39 @@ public slots:
     void editMessage(qint64 messageId, const QString& newPayload);
 
     /**
-     * @brief Быстрый поиск сообщения по ID.
+     * @brief Быстрый поиск сообщения по ID (O(1) по индексу id -> строка).
+     *
+     * Сначала ищется в загруженном окне, затем в кэше резолвов из БД.
+     * При первом промахе (цель реплая вытеснена из окна) излучается
+     * replyTargetMissing — владелец модели поднимает сообщение из
+     * локальной БД и возвращает его через applyReplyFallback.
+     *
      * @param id Идентификатор сообщения.
      * @param msg [out] Ссылка для записи найденного сообщения.
      * @return true, если сообщение найдено.
      */
     bool getMessageById(qint64 id, ChatMessage &msg) const;
 
+public slots:
+    /**
+     * @brief Принимает сообщение, поднятое из локальной БД по промаху реплая.
+     *
+     * Кладет его в кэш резолвов и перерисовывает строки, которые его
+     * цитируют. Пустое сообщение (id <= 0) означает "в БД нет" — строки
+     * продолжают рисовать заглушку.
+     * @param message Найденное сообщение.
+     */
+    void applyReplyFallback(const ChatMessage &message);
+
 signals:
+    /**
+     * @brief Цель реплая не найдена в окне модели.
+     *
+     * Излучается один раз на id; получатель должен асинхронно поднять
+     * сообщение из локальной БД и вернуть его в applyReplyFallback.
+     * @param messageId ID цитируемого сообщения
+     */
+    void replyTargetMissing(qint64 messageId);
     /**
      * @brief Сигнал о необходимости отправить отчет о прочтении.
      * Генерируется, когда сообщение отображается в представлении (View).
@@ -140,15 +214,61 @@ signals:
      */
     void messageNeedsReadReceipt(qint64 messageId);
 
+    /**
+     * @brief Окно модели обрезано сверху.
+     *
+     * Строки старше newOldestMessageId вытеснены (остаются в локальной БД);
+     * получатель должен сдвинуть якорь пагинации, чтобы прокрутка вверх
+     * продолжилась с фактического верха окна.
+     * @param newOldestMessageId ID самой старой оставшейся строки
+     */
+    void windowTrimmed(qint64 newOldestMessageId);
+
 private:
-    /** @brief Основное хранилище сообщений (упорядоченный список). */
-    QList<ChatMessage> m_messages;
+    /**
+     * @brief Вытесняет строки сверху, если хвост перерос окно видимости.
+     *
+     * Вызывается на путях добавления в конец; при вытеснении излучает
+     * windowTrimmed с новой верхней границей.
+     */
+    void trimToWindow();
+
+    // Максимум строк в окне модели: дальше старые строки вытесняются
+    // сверху и при необходимости перечитываются из локальной БД
+    static constexpr int MaxVisibleRows = 500;
 
     /**
-     * @brief Индекс для быстрого поиска сообщений по ID.
-     * Дублирует данные для оптимизации методов update/edit/remove.
+     * @brief Строка по ID через индекс id -> порядковый номер.
+     * @return Номер строки или -1, если сообщения нет в окне.
      */
-    QMap<qint64, ChatMessage> m_messageMap;
+    int rowForId(qint64 id) const;
+
+    /** @brief Основное хранилище сообщений (deque: O(1) вставка с обоих концов). */
+    std::deque<ChatMessage> m_messages;
+
+    /**
+     * @brief Индекс id -> порядковый номер строки.
+     *
+     * Вместо номера строки хранится монотонный порядковый номер:
+     * prepend и вытеснение сверху сдвигают все строки разом, но меняют
+     * только m_frontSeq — индекс не перестраивается. Фактическая строка
+     * = seq - m_frontSeq. Полная перестройка нужна лишь при удалении из
+     * середины (редкий путь). Ранее здесь лежали копии сообщений целиком.
+     */
+    QHash<qint64, qint64> m_idToSeq;
+
+    /** @brief Порядковый номер строки m_messages.front(). */
+    qint64 m_frontSeq = 0;
+
+    /**
+     * @brief Кэш целей реплаев, поднятых из локальной БД.
+     * Нужен строкам, цитирующим сообщения за пределами окна модели.
+     * mutable: пополняется по промаху внутри константного getMessageById.
+     */
+    mutable QHash<qint64, ChatMessage> m_replyFallback;
+
+    /** @brief ID, по которым запрос в БД уже отправлен (защита от дублей). */
+    mutable QSet<qint64> m_pendingReplyLookups;
 };
 
 #endif // CHATMESSAGEMODEL_H
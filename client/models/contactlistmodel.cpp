@@ -2,7 +2,9 @@
 #include "mainwindow.h"
 #include "dataservice.h"
 #include <QSet>
+#include <QDateTime>
 #include <QDebug>
+#include <algorithm>
 
 ContactListModel::ContactListModel(DataService* dataService, QObject *parent)
     : QAbstractListModel(parent)
@@ -31,57 +33,104 @@ QModelIndex ContactListModel::indexForUsername(const QString& username) const
 
 QVariant ContactListModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || index.row() >= m_contactUsernames.size())
+    if (!index.isValid() || index.row() >= m_rows.size())
         return QVariant();
 
-    QString username = m_contactUsernames.at(index.row());
-    const User* user = m_dataService->getUserFromCache(username);
-    const Chat& chat = m_dataService->getChatMetadata(username);
-
-    if (!user)
-        return QVariant();
+    // Отрисовка читает только поля снимка: никаких походов в кеши
+    // DataService — стоимость data() одинакова при любом состоянии кешей
+    const Row& row = m_rows.at(index.row());
 
     switch (role) {
     case UsernameRole:
-        return username;
+        return row.username;
     case DisplayNameRole:
-        return user->displayName;
+        if (row.displayName.isEmpty()) {
+            // Профиль еще не загружен (вход отдает только имена): строка
+            // попала в видимую область — дозапрашиваем детали пачкой.
+            // Повторный вызов стоит одну проверку по множеству
+            m_dataService->requestProfile(row.username);
+            return row.username;
+        }
+        return row.displayName;
     case IsOnlineRole:
-        return user->isOnline;
+        return row.isOnline;
     case LastSeenRole:
-        return user->lastSeen;
+        return row.lastSeen;
     case IsTypingRole:
-        return user->isTyping;
+        return row.isTyping;
 
     case UnreadCountRole:
-        return !chat.username.isEmpty() ? chat.unreadCount : 0;
+        return !row.chat.username.isEmpty() ? row.chat.unreadCount : 0;
     case LastMessageRole:
-        return !chat.username.isEmpty() ? chat.lastMessagePayload : QString();
+        return !row.chat.username.isEmpty() ? row.chat.lastMessagePayload : QString();
     case LastMessageTimestampRole:
-        return !chat.username.isEmpty() ? chat.lastMessageTimestamp : QString();
+        // Уже отформатировано при сборке строки: делегат раньше разбирал
+        // ISO-строку на каждый paint
+        return row.lastMessageTime;
     case IsLastMessageOutgoingRole:
-        return !chat.username.isEmpty() ? chat.isLastMessageOutgoing : false;
+        return !row.chat.username.isEmpty() ? row.chat.isLastMessageOutgoing : false;
     case IsPinnedRole:
-        return !chat.username.isEmpty() ? chat.isPinned : false;
+        return !row.chat.username.isEmpty() ? row.chat.isPinned : false;
     case DraftTextRole:
-        return !chat.username.isEmpty() ? chat.draftText : QString();
+        return !row.chat.username.isEmpty() ? row.chat.draftText : QString();
 
     case Qt::UserRole:
-        return QVariant::fromValue(user);
+        // Живой указатель нужен редким потребителям — единственная роль,
+        // которая все еще ходит в кеш
+        return QVariant::fromValue(m_dataService->getUserFromCache(row.username));
     case ChatRole:
-        return QVariant::fromValue(chat);
+        return QVariant::fromValue(row.chat);
     case AvatarRole:
-        return user->avatarUrl;
+        return row.avatarUrl;
 
     default:
         return QVariant();
     }
 }
 
+
+ContactListModel::Row ContactListModel::buildRow(const QString& username) const
+{
+    Row row;
+    row.username = username;
+
+    if (const User* user = m_dataService->getUserFromCache(username)) {
+        row.displayName = user->displayName;
+        row.lastSeen = user->lastSeen;
+        row.avatarUrl = user->avatarUrl;
+        row.isOnline = user->isOnline;
+        row.isTyping = user->isTyping;
+    }
+
+    row.chat = m_dataService->getChatMetadata(username);
+
+    // Время последнего сообщения форматируется один раз здесь, а не в
+    // делегате на каждый paint видимой строки
+    if (row.chat.lastMessageTimestamp > 0) {
+        row.lastMessageTime = QDateTime::fromMSecsSinceEpoch(row.chat.lastMessageTimestamp)
+                                  .toString(QStringLiteral("HH:mm"));
+    }
+    return row;
+}
+
+
+void ContactListModel::rebuildSnapshot()
+{
+    // Двойная буферизация: собираем в дублер и подменяем swap'ом — емкость
+    // переиспользуется, активный снимок заменяется за O(1)
+    m_staging.clear();
+    m_staging.reserve(m_contactUsernames.size());
+    for (const QString& username : m_contactUsernames) {
+        m_staging.append(buildRow(username));
+    }
+    m_rows.swap(m_staging);
+}
+
 void ContactListModel::clear()
 {
     beginResetModel();
     m_contactUsernames.clear();
+    m_rows.clear();
     endResetModel();
     qDebug() << "[ContactListModel] Contact list cleared";
 }
@@ -94,6 +143,8 @@ void ContactListModel::refreshContact(const QString& username)
         return;
     }
 
+    m_rows[row] = buildRow(username); // Пересобираем снимок строки
+
     QModelIndex idx = index(row, 0);
     emit dataChanged(idx, idx);
     qDebug() << "[ContactListModel] Refreshed contact:" << username << "at row:" << row;
@@ -101,9 +152,11 @@ void ContactListModel::refreshContact(const QString& username)
 
 void ContactListModel::refreshContact(const QModelIndex& index)
 {
-    if (!index.isValid())
+    if (!index.isValid() || index.row() >= m_rows.size())
         return;
 
+    m_rows[index.row()] = buildRow(m_contactUsernames.at(index.row()));
+
     emit dataChanged(index, index);
     qDebug() << "[ContactListModel] Refreshed contact at row:" << index.row();
 }
@@ -115,47 +168,104 @@ void ContactListModel::updateContacts(const QStringList& usernames)
     refreshList();
 }
 
+int ContactListModel::sortedRowFor(const QString& username, int oldIndex) const
+{
+    const Chat& changed = m_dataService->getChatMetadata(username);
+
+    // Список инвариантно отсортирован по Chat::operator<: сперва сегмент
+    // закрепленных, внутри сегментов — по времени последнего сообщения.
+    // Позиция ищется двоичным поиском по ключам снимка строк: приход
+    // сообщения размещает чат за O(log n) вместо прохода по всем соседям
+    // с походом в кэш метаданных на каждого. Сравнение по снимку (m_rows)
+    // корректно: именно эти ключи и установили текущий порядок.
+    const auto it = std::lower_bound(
+        m_rows.constBegin(), m_rows.constEnd(), changed,
+        [](const Row& row, const Chat& value) { return row.chat < value; });
+    int row = int(it - m_rows.constBegin());
+
+    // Результат — позиция в нумерации без старой строки самого чата:
+    // если она стоит выше найденной, поиск посчитал и ее
+    if (oldIndex != -1 && oldIndex < row)
+        --row;
+    return row;
+}
+
 void ContactListModel::onChatMetadataChanged(const QString& username)
 {
-    // Текущая позиция чата
+    const Chat& chat = m_dataService->getChatMetadata(username);
     int oldIndex = m_contactUsernames.indexOf(username);
 
-    if (oldIndex == -1) {
-        qDebug() << "[ContactListModel] Chat not in list, refreshing";
-        refreshList();
+    // Архивированный чат уходит из основного списка
+    if (!chat.username.isEmpty() && chat.isArchived) {
+        if (oldIndex != -1) {
+            beginRemoveRows(QModelIndex(), oldIndex, oldIndex);
+            m_contactUsernames.removeAt(oldIndex);
+            m_rows.removeAt(oldIndex);
+            endRemoveRows();
+            qDebug() << "[ContactListModel] Chat archived, row removed:" << username;
+        }
         return;
     }
 
-    // Новый порядок с учётом пинов, времени последнего сообщения и т.п.
-    QStringList newSortedList = m_dataService->getSortedChatList();
-    int newIndex = newSortedList.indexOf(username);
-
-    if (newIndex == -1) {
-        qDebug() << "[ContactListModel] Chat removed from list";
-        refreshList();
+    if (oldIndex == -1) {
+        // Новый чат: вставляем строку в отсортированную позицию
+        if (chat.username.isEmpty()) {
+            qDebug() << "[ContactListModel] Chat not in list and no metadata, refreshing";
+            refreshList();
+            return;
+        }
+        int newRow = sortedRowFor(username, oldIndex);
+        beginInsertRows(QModelIndex(), newRow, newRow);
+        m_contactUsernames.insert(newRow, username);
+        m_rows.insert(newRow, buildRow(username));
+        endInsertRows();
+        qDebug() << "[ContactListModel] Chat inserted:" << username << "at row:" << newRow;
         return;
     }
 
+    // Новая позиция по порядку Chat::operator< (пины, время сообщения)
+    int newIndex = sortedRowFor(username, oldIndex);
+
     if (oldIndex == newIndex) {
         // Порядок не изменился — просто обновляем данные по контакту
         refreshContact(username);
     } else {
-        // Позиция изменилась — двигаем строку с beginMoveRows/endMoveRows
+        // Позиция изменилась — двигаем строку с beginMoveRows/endMoveRows.
+        // destinationChild задается в нумерации до перемещения
         int targetRow = (newIndex > oldIndex) ? newIndex + 1 : newIndex;
 
         beginMoveRows(QModelIndex(), oldIndex, oldIndex,
                       QModelIndex(), targetRow);
 
-        m_contactUsernames = newSortedList;
+        m_contactUsernames.removeAt(oldIndex);
+        m_contactUsernames.insert(newIndex, username);
+        m_rows.move(oldIndex, newIndex);
 
         endMoveRows();
+
+        // Содержимое строки (последнее сообщение, счетчик) тоже изменилось
+        refreshContact(username);
     }
 }
 
 void ContactListModel::refreshList()
 {
-    beginResetModel();
     // Берем актуальный отсортированный список чатов из DataService
-    m_contactUsernames = m_dataService->getSortedChatList();
+    const QStringList newList = m_dataService->getSortedChatList();
+
+    if (newList == m_contactUsernames) {
+        // Состав и порядок прежние — пересобираем снимок в буфер-дублер
+        // и объявляем dataChanged; reset (и повторный layout) не нужен
+        rebuildSnapshot();
+        if (!m_contactUsernames.isEmpty()) {
+            emit dataChanged(index(0, 0),
+                             index(m_contactUsernames.size() - 1, 0));
+        }
+        return;
+    }
+
+    beginResetModel();
+    m_contactUsernames = newList;
+    rebuildSnapshot();
     endResetModel();
 }
@@ -4,6 +4,7 @@
 #include <QAbstractListModel>
 #include <QStringList>
 #include <QMap>
+#include <QVector>
 #include "structures.h"
 
 class DataService;
@@ -11,8 +12,13 @@ class DataService;
 /**
  * @brief Модель списка контактов/чатов для главного экрана.
  *
- * Предоставляет данные для отображения списка диалогов. Данные подтягиваются
- * напрямую из DataService, модель хранит только упорядоченный список имен пользователей (usernames).
+ * Предоставляет данные для отображения списка диалогов. Модель рисует из
+ * собственного плоского снимка строк (Row): делегат запрашивает около десятка
+ * ролей на каждую отрисовку строки, и раньше каждый data() ходил в хеш-кеши
+ * DataService заново — порядка двадцати поисков по хешу на строку за кадр.
+ * Снимок строится один раз на изменение (точечно для одной строки или целиком
+ * в буфер-дублер со swap'ом), а data() сводится к чтению поля по индексу —
+ * стоимость отрисовки детерминирована и не зависит от состояния кешей.
  * Реализует множество кастомных ролей для отображения аватаров, статусов и последних сообщений.
  */
 class ContactListModel : public QAbstractListModel
@@ -31,7 +37,7 @@ public:
         IsTypingRole,                     ///< Флаг "печатает..."
         UnreadCountRole,                  ///< Число непрочитанных сообщений
         LastMessageRole,                  ///< Текст последнего сообщения
-        LastMessageTimestampRole,         ///< Время последнего сообщения (для сортировки и UI)
+        LastMessageTimestampRole,         ///< Время последнего сообщения (HH:mm, уже отформатировано)
         IsLastMessageOutgoingRole,        ///< Флаг исходящего сообщения (для иконки "Вы:")
         IsPinnedRole,                     ///< Флаг закрепленного чата
         DraftTextRole,                    ///< Текст черновика, если есть
@@ -63,8 +69,9 @@ public:
     /**
      * @brief Получает данные для отображения.
      *
-     * Поддерживает все роли из ContactRoles. Данные извлекаются из кешей DataService
-     * (UserCache и ChatMetadataCache) в реальном времени.
+     * Поддерживает все роли из ContactRoles. Данные читаются из плоского
+     * снимка строк модели — без обращений к кешам DataService во время
+     * отрисовки (исключение — редкая роль Qt::UserRole с указателем User*).
      *
      * @param index Индекс элемента.
      * @param role Запрашиваемая роль.
@@ -80,9 +87,11 @@ signals:
 
 public slots:
     /**
-     * @brief Полностью обновляет список контактов новыми данными.
+     * @brief Обновляет список контактов новыми данными.
      *
-     * Вызывает reset модели.
+     * Если состав и порядок не изменились, обходится точечным dataChanged;
+     * reset остается только на случай изменения состава (вход, дельта
+     * контактов).
      * @param usernames Новый список имен пользователей (уже отсортированный).
      */
     void updateContacts(const QStringList& usernames);
@@ -103,19 +112,70 @@ public slots:
 
     /**
      * @brief Слот реакции на изменение метаданных чата.
+     *
+     * Находит новую позицию строки по порядку Chat::operator< и излучает
+     * точечные сигналы: dataChanged, beginMoveRows, beginInsertRows или
+     * beginRemoveRows — стоимость одного сообщения O(1) строк UI вместо
+     * reset всей модели.
      * @param username Имя пользователя чата.
      */
     void onChatMetadataChanged(const QString& username);
 
     /**
      * @brief Перезапрашивает актуальный список чатов у DataService и обновляет модель.
-     * Используется при изменении сортировки или добавлении новых чатов.
+     *
+     * При неизменном составе и порядке ограничивается dataChanged по
+     * строкам; reset выполняется только если список действительно
+     * перестроился.
      */
     void refreshList();
 
 private:
+    /**
+     * @brief Снимок одной строки списка: все поля, нужные делегату.
+     *
+     * Плоская структура собирается из кешей DataService в момент изменения;
+     * во время отрисовки читаются только ее поля.
+     */
+    struct Row {
+        QString username;     ///< Имя пользователя (ключ чата)
+        QString displayName;  ///< Отображаемое имя
+        QString lastSeen;     ///< Время последней активности
+        QString avatarUrl;    ///< Путь/URL аватара
+        QString lastMessageTime; ///< Время последнего сообщения (HH:mm, для отрисовки)
+        bool isOnline = false; ///< Статус "В сети"
+        bool isTyping = false; ///< Флаг "печатает..."
+        Chat chat;            ///< Метаданные чата (копия на момент снимка)
+    };
+
+    /**
+     * @brief Позиция чата в отсортированном списке по Chat::operator<.
+     *
+     * Двоичный поиск по ключам снимка строк: список инвариантно
+     * отсортирован (сегмент закрепленных, затем остальные по времени),
+     * поэтому размещение стоит O(log n). Результат — итоговая строка
+     * после перемещения/вставки, в нумерации без старой строки чата.
+     *
+     * @param username Чат, для которого ищется позиция
+     * @param oldIndex Его текущая строка (-1 — чата в списке нет)
+     */
+    int sortedRowFor(const QString& username, int oldIndex) const;
+
+    /** @brief Собирает снимок строки из кешей DataService. */
+    Row buildRow(const QString& username) const;
+
+    /**
+     * @brief Перестраивает снимок целиком в буфер-дублер и подменяет swap'ом.
+     *
+     * Буфер переиспользует емкость предыдущего построения — перестроение
+     * списка не аллоцирует, начиная со второго раза.
+     */
+    void rebuildSnapshot();
+
     DataService* m_dataService;        ///< Источник данных (кеши пользователей и чатов)
     QStringList m_contactUsernames;    ///< Текущий список контактов (ключи для доступа к данным)
+    QVector<Row> m_rows;               ///< Активный снимок строк (читает data())
+    QVector<Row> m_staging;            ///< Буфер-дублер для перестроения снимка
 };
 
 #endif // CONTACTLISTMODEL_H
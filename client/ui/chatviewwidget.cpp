@@ -331,38 +331,44 @@ void ChatViewWidget::clearReplyUI()
     ui->messageTextEdit->setPlaceholderText("Напишите сообщение...");
 }
 
+ChatMessageHandle ChatViewWidget::handleForIndex(const QModelIndex &index) const
+{
+    // Единственное обращение к модели на все действие: строка и копия
+    // полей кэшируются в хендле, дальше меню и получатели сигналов
+    // работают с ним без повторных поисков по id
+    ChatMessageHandle handle;
+    if (!index.isValid()) return handle;
+
+    handle.index = QPersistentModelIndex(index);
+    handle.message = index.data(Qt::UserRole).value<ChatMessage>();
+    return handle;
+}
+
 void ChatViewWidget::onMessageDoubleClicked(const QModelIndex &index)
 {
-    // Логируем начало обработки двойного клика
-    qDebug() <<"onMessageDoubleClicked 1";
-    
-    // Проверяем валидность индекса, выходим если сообщение не найдено
-    if (!index.isValid()) return;
-    
-    // Логируем успешное получение индекса
-    qDebug() <<"onMessageDoubleClicked 2";
-    
-    // Извлекаем данные сообщения из модели
-    ChatMessage msg = index.data(Qt::UserRole).value<ChatMessage>();
-    
+    // Разрешаем строку в хендл; выходим, если клик не по сообщению
+    const ChatMessageHandle handle = handleForIndex(index);
+    if (!handle.isValid()) return;
+
     // Активируем режим ответа с данными сообщения
-    showReplyUI(msg.fromUser, msg.payload);
-    
+    showReplyUI(handle.message.fromUser, handle.message.payload);
+
     // Уведомляем о необходимости ответа на конкретное сообщение
-    emit replyToMessageRequested(msg.id);
+    emit replyToMessageRequested(handle);
 }
 
 void ChatViewWidget::onChatContextMenuRequested(const QPoint &pos)
 {
-    // Получаем индекс сообщения по координатам клика
-    QModelIndex index = ui->chatHistoryView->indexAt(pos);
-    
+    // Разрешаем сообщение по координатам клика один раз — меню и все
+    // действия дальше работают с кэшированными полями хендла
+    const ChatMessageHandle handle =
+        handleForIndex(ui->chatHistoryView->indexAt(pos));
+
     // Выходим если клик не по сообщению
-    if (!index.isValid()) return;
-    
-    // Извлекаем данные выбранного сообщения
-    ChatMessage msg = index.data(Qt::UserRole).value<ChatMessage>();
-    
+    if (!handle.isValid()) return;
+
+    const ChatMessage& msg = handle.message;
+
     // Создаем контекстное меню
     QMenu contextMenu(this);
     
@@ -393,11 +399,12 @@ void ChatViewWidget::onChatContextMenuRequested(const QPoint &pos)
     } 
     // Переходим в режим ответа
     else if (selectedAction == replyAction) {
-        onMessageDoubleClicked(index);
+        showReplyUI(msg.fromUser, msg.payload);
+        emit replyToMessageRequested(handle);
     } 
     // Запрашиваем редактирование сообщения
     else if (selectedAction == editAction) {
-        emit editMessageRequested(msg.id, msg.payload);
+        emit editMessageRequested(handle);
     } 
     // Запрашиваем удаление сообщения
     else if (selectedAction == deleteAction) {
@@ -626,6 +633,10 @@ void ChatViewWidget::onSearchTriggered(const QString& text)
 {
     // Логируем запуск поиска по чату
     qDebug() << "Search in chat triggered:" << text;
+
+    // Передаем запрос наверх: поиск идет по локальному FTS-индексу,
+    // а не только по загруженному в модель окну сообщений
+    emit searchRequested(text);
 }
 
 void ChatViewWidget::setEditMode(bool enabled, const QString& text)
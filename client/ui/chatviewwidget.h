@@ -54,6 +54,15 @@ public:
      */
     bool isScrolledToBottom() const;
 
+    /**
+     * @brief Разрешает строку модели в хендл сообщения.
+     *
+     * Единственное обращение к модели на все действие: дальше контекстное
+     * меню и сигналы работают с копией полей из хендла.
+     * @param index Строка под курсором
+     */
+    ChatMessageHandle handleForIndex(const QModelIndex &index) const;
+
 signals:
     /** @brief Запрос на скачивание прикрепленного файла. */
     void fileDownloadRequested(const QString &fileId, const QString &url, const QString &fileName);
@@ -70,8 +79,16 @@ signals:
     /** @brief Нажата кнопка поиска (лупа). */
     void searchButtonClicked();
 
-    /** @brief Запрос на ответ конкретному сообщению (через контекстное меню). */
-    void replyToMessageRequested(qint64 messageId);
+    /** @brief Введен текст поиска по сообщениям. */
+    void searchRequested(const QString& text);
+
+    /**
+     * @brief Запрос на ответ конкретному сообщению (через контекстное меню).
+     *
+     * Хендл несет копию полей сообщения: получателю не нужно искать
+     * его в модели заново.
+     */
+    void replyToMessageRequested(const ChatMessageHandle& handle);
 
     /** @brief Отмена режима ответа (нажат крестик в Reply UI). */
     void replyCancelled();
@@ -88,8 +105,8 @@ signals:
     /** @brief Нажата кнопка аудиозвонка. */
     void callRequested();
 
-    /** @brief Запрос на редактирование сообщения. */
-    void editMessageRequested(qint64 messageId, const QString& oldText);
+    /** @brief Запрос на редактирование сообщения (хендл несет старый текст). */
+    void editMessageRequested(const ChatMessageHandle& handle);
 
     /** @brief Запрос на удаление сообщения. */
     void deleteMessageRequested(qint64 messageId);
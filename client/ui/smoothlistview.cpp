@@ -1,13 +1,35 @@
 #include "smoothlistview.h"
+#include "../models/chatmessagemodel.h"
 #include <QWheelEvent>
 #include <QResizeEvent>
 #include <QEvent>
 #include <QScrollBar>
-#include <QEasingCurve>
+#include <QScreen>
+#include <QGuiApplication>
+#include <QOpenGLWidget>
+#include <QSurfaceFormat>
+#include <QDebug>
+#include <cmath>
 
 SmoothListView::SmoothListView(QWidget *parent)
     : QListView(parent)
 {
+    // GPU-композиция вьюпорта (MESSENGER_GPU=1): те же вызовы QPainter, но
+    // через OpenGL-бэкенд. Кешированные пиксмапы пузырей загружаются в
+    // текстуры один раз (кеш текстур живет по ключу пиксмапа) и дальше
+    // кадр собирает видеокарта. Платой служит полный рекомпозит кадра
+    // вместо блита scroll() у растрового вьюпорта, но рекомпозит из
+    // готовых текстур на 4K дешевле для CPU, чем растровая перерисовка
+    // открывшейся полосы: CPU остается только обход видимых строк
+    if (qEnvironmentVariableIntValue("MESSENGER_GPU") == 1) {
+        auto *glViewport = new QOpenGLWidget(this);
+        QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+        format.setSwapInterval(1); // vsync: драйвер прокрутки и так тикает по кадру экрана
+        glViewport->setFormat(format);
+        setViewport(glViewport);
+        qDebug() << "[SmoothListView] GPU viewport enabled (MESSENGER_GPU=1)";
+    }
+
     // Включаем пиксельную прокрутку для плавности
     setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
 
@@ -18,14 +40,13 @@ SmoothListView::SmoothListView(QWidget *parent)
     setLayoutMode(QListView::SinglePass);
     setBatchSize(100);
 
-    // Создаем анимацию плавной прокрутки для вертикального скролбара
-    m_scrollAnimation = new QPropertyAnimation(this);
-    m_scrollAnimation->setTargetObject(verticalScrollBar());
-    m_scrollAnimation->setPropertyName("value");
-    m_scrollAnimation->setDuration(200);                
+    // Покадровый драйвер прокрутки: одно обновление скролбара за кадр
+    // экрана (вместо пошаговой анимации значения у QPropertyAnimation)
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_frameTimer, &QTimer::timeout, this, &SmoothListView::onFrameTick);
 
-    // Применяем плавную кривую замедления
-    m_scrollAnimation->setEasingCurve(QEasingCurve::OutQuad);
+    // Счетчик FPS прокрутки — включается вместе с трассировкой задержки
+    m_fpsLogEnabled = qEnvironmentVariableIntValue("MESSENGER_TRACE") == 1;
 
     // Отключаем выделение элементов
     setSelectionMode(QAbstractItemView::NoSelection);
@@ -34,36 +55,169 @@ SmoothListView::SmoothListView(QWidget *parent)
     setDragDropMode(QAbstractItemView::NoDragDrop);
 }
 
-void SmoothListView::wheelEvent(QWheelEvent *e)
+void SmoothListView::setModel(QAbstractItemModel *model)
 {
-    // Останавливаем текущую анимацию прокрутки
-    m_scrollAnimation->stop();
+    if (QAbstractItemModel *previous = this->model()) {
+        disconnect(previous, &QAbstractItemModel::rowsAboutToBeInserted,
+                   this, &SmoothListView::onRowsAboutToBeInserted);
+        disconnect(previous, &QAbstractItemModel::rowsInserted,
+                   this, &SmoothListView::onRowsInserted);
+    }
 
-    // Получаем текущую позицию скролбара
-    QScrollBar* bar = verticalScrollBar();
-    int currentValue = bar->value();
+    QListView::setModel(model);
+
+    if (model) {
+        connect(model, &QAbstractItemModel::rowsAboutToBeInserted,
+                this, &SmoothListView::onRowsAboutToBeInserted);
+        connect(model, &QAbstractItemModel::rowsInserted,
+                this, &SmoothListView::onRowsInserted);
+    }
+}
+
+void SmoothListView::onRowsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(last);
+    m_anchorArmed = false;
+
+    // Интересует только prepend (вставка в начало непустого списка)
+    if (parent.isValid() || first != 0) {
+        return;
+    }
+    auto *model = qobject_cast<ChatMessageModel*>(this->model());
+    if (!model || model->rowCount() == 0) {
+        return;
+    }
+
+    const QModelIndex top = indexAt(QPoint(0, 0));
+    if (!top.isValid()) {
+        return;
+    }
+
+    m_prependAnchor = model->anchorForRow(top.row());
+    m_prependAnchorTop = visualRect(top).top();
+    m_anchorArmed = m_prependAnchor != ChatMessageModel::NoAnchor;
+}
+
+void SmoothListView::onRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(last);
+    if (!m_anchorArmed || parent.isValid() || first != 0) {
+        return;
+    }
+    m_anchorArmed = false;
+
+    auto *model = qobject_cast<ChatMessageModel*>(this->model());
+    if (!model) {
+        return;
+    }
+    const int row = model->rowForAnchor(m_prependAnchor);
+    if (row < 0) {
+        return;
+    }
 
-    // Вычисляем дельту прокрутки (усиленная в 2 раза)
-    int delta = - (e->angleDelta().y() * 2);
+    // Геометрия вставленных строк нужна сейчас, а не в отложенной
+    // выкладке: высоты приходят из кэша sizeHint делегата, поэтому
+    // довыкладка дешевая и полного релейаута не вызывает
+    executeDelayedItemsLayout();
 
-    // Ограничиваем целевую позицию границами скролбара
-    int targetValue = currentValue + delta;
-    if (targetValue < bar->minimum()) {
-        targetValue = bar->minimum();
+    const int newTop = visualRect(model->index(row, 0)).top();
+    const int delta = newTop - m_prependAnchorTop;
+    if (delta == 0) {
+        return;
     }
-    if (targetValue > bar->maximum()) {
-        targetValue = bar->maximum();
+
+    // Сдвигаем скролбар ровно на высоту добавленного: якорная строка
+    // остается на прежнем пикселе экрана. Дробная позиция кинетического
+    // драйвера сдвигается на ту же величину — идущая прокрутка
+    // продолжается без разрыва скорости
+    QScrollBar *bar = verticalScrollBar();
+    bar->setValue(bar->value() + delta);
+    if (m_frameTimer.isActive()) {
+        m_scrollPos += delta;
     }
+}
 
-    // Запускаем анимацию к целевой позиции
-    m_scrollAnimation->setStartValue(currentValue);
-    m_scrollAnimation->setEndValue(targetValue);
-    m_scrollAnimation->start();
+void SmoothListView::wheelEvent(QWheelEvent *e)
+{
+    // Дельта колеса — импульс скорости; несколько щелчков подряд
+    // складываются в кинетический разгон, затухающий трением
+    const qreal impulse = -(e->angleDelta().y() * 10.0); // px/s за щелчок
+
+    // Смена направления гасит накопленную скорость сразу
+    if ((impulse > 0) != (m_scrollVelocity > 0))
+        m_scrollVelocity = 0.0;
+    m_scrollVelocity += impulse;
+
+    if (!m_frameTimer.isActive()) {
+        m_scrollPos = verticalScrollBar()->value();
+        startFrameDriver();
+    }
 
     // Принимаем событие колеса мыши
     e->accept();
 }
 
+void SmoothListView::startFrameDriver()
+{
+    // Период кадра берем у экрана окна: на 144 Гц дисплее это ~7 мс,
+    // т.е. ровно одно обновление значения (и одна перерисовка) на vsync
+    qreal refreshRate = 60.0;
+    if (QScreen* s = screen())
+        refreshRate = s->refreshRate();
+    if (refreshRate < 30.0)
+        refreshRate = 60.0;
+
+    m_frameTimer.start(int(1000.0 / refreshRate));
+    m_frameClock.start();
+
+    if (m_fpsLogEnabled) {
+        m_fpsClock.start();
+        m_fpsFrames = 0;
+    }
+}
+
+void SmoothListView::onFrameTick()
+{
+    const qreal dt = m_frameClock.restart() / 1000.0;
+    if (dt <= 0.0)
+        return;
+
+    QScrollBar* bar = verticalScrollBar();
+
+    // Продвигаем позицию и гасим скорость экспоненциальным трением
+    m_scrollPos += m_scrollVelocity * dt;
+    m_scrollVelocity *= std::pow(FrictionPerSecond, dt);
+
+    // У границ останавливаемся без "отскока"
+    if (m_scrollPos <= bar->minimum()) {
+        m_scrollPos = bar->minimum();
+        m_scrollVelocity = 0.0;
+    } else if (m_scrollPos >= bar->maximum()) {
+        m_scrollPos = bar->maximum();
+        m_scrollVelocity = 0.0;
+    }
+
+    // Единственная запись в скролбар за кадр: прокрутка вьюпорта сдвигает
+    // уже отрисованное содержимое, делегат перерисовывает только открывшуюся
+    // полосу (а ее строки, как правило, уже лежат в кеше пузырей)
+    bar->setValue(int(std::lround(m_scrollPos)));
+
+    if (m_fpsLogEnabled) {
+        ++m_fpsFrames;
+        if (m_fpsClock.elapsed() >= 1000) {
+            qDebug() << "[SmoothListView] scroll fps:"
+                     << m_fpsFrames * 1000.0 / m_fpsClock.elapsed();
+            m_fpsClock.restart();
+            m_fpsFrames = 0;
+        }
+    }
+
+    if (std::abs(m_scrollVelocity) < MinVelocity) {
+        m_frameTimer.stop();
+        m_scrollVelocity = 0.0;
+    }
+}
+
 void SmoothListView::resizeEvent(QResizeEvent *e)
 {
     // Вызываем базовый обработчик изменения размера
@@ -76,10 +230,9 @@ void SmoothListView::resizeEvent(QResizeEvent *e)
 
 void SmoothListView::stopScrollAnimation()
 {
-    // Останавливаем анимацию если она активна
-    if (m_scrollAnimation->state() == QAbstractAnimation::Running) {
-        m_scrollAnimation->stop();
-    }
+    // Останавливаем покадровый драйвер и сбрасываем накопленную скорость
+    m_frameTimer.stop();
+    m_scrollVelocity = 0.0;
 }
 
 bool SmoothListView::viewportEvent(QEvent *event)
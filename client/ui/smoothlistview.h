@@ -2,7 +2,8 @@
 #define SMOOTHLISTVIEW_H
 
 #include <QListView>
-#include <QPropertyAnimation>
+#include <QElapsedTimer>
+#include <QTimer>
 
 /**
  * @brief Кастомный QListView с плавной прокруткой.
@@ -10,6 +11,11 @@
  * Переопределяет стандартное поведение колесика мыши для реализации
  * инерционной или плавной (интерполированной) прокрутки списка,
  * что делает интерфейс более отзывчивым и приятным визуально.
+ *
+ * Переменной окружения `MESSENGER_GPU=1` включается GPU-композиция
+ * вьюпорта (QOpenGLWidget): кешированные пиксмапы пузырей рисуются как
+ * текстуры, и кадр инерционной прокрутки собирает видеокарта — нагрузка
+ * на CPU при флинге на 4K-экранах падает до обхода видимых строк.
  */
 class SmoothListView : public QListView
 {
@@ -30,12 +36,30 @@ public:
      */
     explicit SmoothListView(QWidget *parent = nullptr);
 
+    /**
+     * @brief Подключает модель и включает якорную компенсацию prepend'ов.
+     *
+     * Вставка старых страниц истории в начало списка (пагинация вверх)
+     * раньше требовала внешней компенсации по rangeChanged с полным
+     * релейаутом. Теперь перед вставкой запоминается стабильный якорь
+     * верхней видимой строки (ChatMessageModel::anchorForRow) и ее
+     * пиксельное смещение во вьюпорте; после вставки позиция скролбара
+     * сдвигается ровно на высоту добавленного — строка остается на том
+     * же месте экрана с точностью до пикселя. Высоты новых строк
+     * считаются из кэша sizeHint делегата при довыкладке, идущая
+     * кинетическая прокрутка продолжается без разрыва.
+     * @param model Модель сообщений (для других моделей компенсация
+     *        тихо выключена).
+     */
+    void setModel(QAbstractItemModel *model) override;
+
 protected:
     /**
      * @brief Обработчик события прокрутки колесика мыши.
      *
-     * Перехватывает стандартное событие, вычисляет целевую позицию скролла
-     * и запускает QPropertyAnimation для плавного перехода к ней.
+     * Перехватывает стандартное событие и добавляет импульс скорости:
+     * дальше позицию ведет покадровый драйвер (onFrameTick), затухание
+     * скорости дает кинетическую инерцию.
      * @param e Событие колесика.
      */
     void wheelEvent(QWheelEvent *e) override;
@@ -58,12 +82,43 @@ protected:
      */
     bool viewportEvent(QEvent *event) override;
 
-private:
+private slots:
+    /** @brief Перед вставкой в начало: запоминает якорь верхней строки. */
+    void onRowsAboutToBeInserted(const QModelIndex &parent, int first, int last);
+
+    /** @brief После вставки в начало: возвращает якорь на прежний пиксель. */
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+
     /**
-     * @brief Объект анимации для интерполяции значения прокрутки.
-     * Управляет изменением значения QScrollBar::value.
+     * @brief Кадр анимации прокрутки.
+     *
+     * Вызывается таймером с периодом кадра экрана: сдвигает позицию на
+     * скорость * dt, гасит скорость трением и пишет значение в скролбар
+     * ровно один раз за кадр — одна перерисовка на vsync вместо
+     * перерисовки на каждый пиксель у QPropertyAnimation.
      */
-    QPropertyAnimation* m_scrollAnimation;
+    void onFrameTick();
+
+private:
+    /** @brief Запускает покадровый драйвер с периодом кадра экрана. */
+    void startFrameDriver();
+
+    // Затухание скорости (доля, остающаяся через секунду) и порог остановки
+    static constexpr qreal FrictionPerSecond = 0.015;
+    static constexpr qreal MinVelocity = 8.0; // px/s
+
+    QTimer m_frameTimer;          ///< Покадровый таймер (период = кадру экрана)
+    QElapsedTimer m_frameClock;   ///< Измеряет dt между кадрами
+    qreal m_scrollVelocity = 0.0; ///< Текущая скорость прокрутки, px/s
+    qreal m_scrollPos = 0.0;      ///< Дробная позиция прокрутки
+
+    qint64 m_prependAnchor = 0;   ///< Якорь верхней видимой строки (NoAnchor — нет)
+    int m_prependAnchorTop = 0;   ///< Ее пиксельное смещение во вьюпорте
+    bool m_anchorArmed = false;   ///< Якорь взят для текущей вставки
+
+    bool m_fpsLogEnabled = false; ///< Счетчик FPS прокрутки (MESSENGER_TRACE=1)
+    QElapsedTimer m_fpsClock;     ///< Окно усреднения FPS
+    int m_fpsFrames = 0;          ///< Кадров в текущем окне
 };
 
 #endif // SMOOTHLISTVIEW_H
@@ -1,7 +1,11 @@
 #include "smoothtextedit.h"
+#include "perfmetrics.h"
 #include <QWheelEvent>
+#include <QKeyEvent>
 #include <QScrollBar>
 #include <QEasingCurve>
+#include <QImage>
+#include <QPainter>
 
 SmoothTextEdit::SmoothTextEdit(QWidget *parent)
     : QTextEdit(parent)
@@ -20,6 +24,55 @@ SmoothTextEdit::SmoothTextEdit(QWidget *parent)
 
     // Применяем плавную кривую замедления OutCubic
     m_scrollAnimation->setEasingCurve(QEasingCurve::OutCubic);
+
+    // Только плоский текст: сообщение уходит через toPlainText(), а
+    // HTML из вставки лишь заставлял перераскладывать многоформатные
+    // блоки на каждом нажатии
+    setAcceptRichText(false);
+
+    prewarmEmojiGlyphs();
+}
+
+void SmoothTextEdit::prewarmEmojiGlyphs()
+{
+    // Внеэкранная отрисовка типичных эмодзи прогревает поиск
+    // fallback-шрифта и кэш растеризованных глифов: первый смайлик
+    // в черновике раскладывается так же быстро, как сотый
+    QImage scratch(64, 32, QImage::Format_ARGB32_Premultiplied);
+    scratch.fill(Qt::transparent);
+
+    QPainter painter(&scratch);
+    painter.setFont(font());
+    painter.drawText(scratch.rect(), Qt::AlignLeft,
+                     QStringLiteral("\U0001F600\U0001F44D\u2764\uFE0F"));
+}
+
+void SmoothTextEdit::keyPressEvent(QKeyEvent *e)
+{
+    // Замеряем только нажатия, меняющие текст: навигация и модификаторы
+    // раскладку не трогают и в метрику печати не входят
+    const bool editsText = !e->text().isEmpty()
+        || e->key() == Qt::Key_Backspace
+        || e->key() == Qt::Key_Delete;
+    if (editsText) {
+        m_inputClock.start();
+        m_inputPending = true;
+    }
+
+    QTextEdit::keyPressEvent(e);
+}
+
+void SmoothTextEdit::paintEvent(QPaintEvent *e)
+{
+    QTextEdit::paintEvent(e);
+
+    // Глиф нажатой клавиши только что попал в backing store — это и есть
+    // задержка ввода. Мигание курсора и прочие перерисовки не считаются:
+    // флаг взводит только keyPressEvent
+    if (m_inputPending) {
+        m_inputPending = false;
+        PerfMetrics::recordInputLatency(m_inputClock.nsecsElapsed() / 1000);
+    }
 }
 
 void SmoothTextEdit::wheelEvent(QWheelEvent *e)
@@ -3,12 +3,25 @@
 
 #include <QTextEdit>
 #include <QPropertyAnimation>
+#include <QElapsedTimer>
 
 /**
  * @brief Кастомный QTextEdit с плавной прокруткой.
  *
  * Аналогично SmoothListView, добавляет инерционную или плавную прокрутку
  * для текстовых полей (например, для просмотра длинных сообщений или логов).
+ *
+ * Поле работает только с плоским текстом: сообщения все равно уходят
+ * через toPlainText(), а принятая при вставке HTML-разметка заставляла
+ * QTextDocument перераскладывать многоформатные блоки на каждом нажатии.
+ * С плоским текстом раскладка инкрементальна — пересчитывается только
+ * измененный блок.
+ *
+ * Заодно здесь живет замер задержки ввода (клавиша -> глиф на экране):
+ * каждое меняющее текст нажатие замеряется до ближайшей отрисовки и
+ * уходит в PerfMetrics — HUD показывает p95 печати как первоклассную
+ * метрику. Эмодзи-шрифт прогревается при создании: первый смайлик в
+ * черновике не платит за поиск fallback-шрифта и растеризацию глифов.
  */
 class SmoothTextEdit : public QTextEdit
 {
@@ -31,11 +44,41 @@ protected:
      */
     void wheelEvent(QWheelEvent *e) override;
 
+    /**
+     * @brief Обработчик нажатия клавиши.
+     *
+     * Для нажатий, меняющих текст, запускает замер задержки ввода:
+     * секундомер останавливает ближайший paintEvent.
+     * @param e Событие клавиатуры.
+     */
+    void keyPressEvent(QKeyEvent *e) override;
+
+    /**
+     * @brief Отрисовка поля.
+     *
+     * Завершает начатый в keyPressEvent замер: к этому моменту раскладка
+     * пересчитана и глиф нажатой клавиши попал на экран.
+     * @param e Событие отрисовки.
+     */
+    void paintEvent(QPaintEvent *e) override;
+
 private:
+    /**
+     * @brief Прогревает кэш глифов эмодзи-шрифта.
+     *
+     * Отрисовка пары типичных эмодзи во внеэкранный буфер заставляет Qt
+     * найти fallback-шрифт и растеризовать глифы заранее, а не на первом
+     * смайлике черновика.
+     */
+    void prewarmEmojiGlyphs();
+
     /**
      * @brief Анимация для управления значением вертикального скроллбара.
      */
     QPropertyAnimation *m_scrollAnimation;
+
+    QElapsedTimer m_inputClock;  ///< Секундомер текущего замера ввода
+    bool m_inputPending = false; ///< Нажатие ждет своей отрисовки
 };
 
 #endif // SMOOTHTEXTEDIT_H
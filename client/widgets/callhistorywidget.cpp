@@ -2,6 +2,7 @@
 #include <QDebug>
 #include <QDateTime>
 #include <QApplication>
+#include <QScrollBar>
 
 CallHistoryWidget::CallHistoryWidget(QWidget* parent)
     : QWidget(parent)
@@ -39,6 +40,11 @@ void CallHistoryWidget::setupUI()
             this, &CallHistoryWidget::onItemDoubleClicked);
     connect(m_callListWidget, &QListWidget::itemClicked,
             this, &CallHistoryWidget::onItemClicked);
+
+    // Ленивая догрузка: прокрутка к концу списка запрашивает следующую
+    // страницу вместо загрузки всей истории разом
+    connect(m_callListWidget->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &CallHistoryWidget::onListScrolled);
     mainLayout->addWidget(m_callListWidget);
 
     // Нижняя панель управления
@@ -62,13 +68,40 @@ void CallHistoryWidget::setupUI()
     qDebug() << "[CallHistoryWidget] UI полностью инициализирован";
 }
 
-void CallHistoryWidget::setCallHistory(const QJsonArray& calls)
+void CallHistoryWidget::setCallHistory(const QJsonArray& calls, bool hasMore)
 {
-    // Полная очистка текущей истории
+    // Полная очистка текущей истории (первая страница)
     clearHistory();
-    m_callListWidget->clear();
-    m_calls.clear();
 
+    appendCalls(calls);
+    m_hasMore = hasMore;
+    m_fetchingMore = false;
+
+    m_statusLabel->setText(QString("✅ Loaded %1 calls%2")
+                               .arg(m_calls.size())
+                               .arg(hasMore ? "…" : ""));
+
+    qDebug() << "[CALL_HISTORY] First page:" << calls.size()
+             << "calls, has_more =" << hasMore;
+    this->show();
+}
+
+void CallHistoryWidget::appendCallHistory(const QJsonArray& calls, bool hasMore)
+{
+    appendCalls(calls);
+    m_hasMore = hasMore;
+    m_fetchingMore = false;
+
+    m_statusLabel->setText(QString("✅ Loaded %1 calls%2")
+                               .arg(m_calls.size())
+                               .arg(hasMore ? "…" : ""));
+
+    qDebug() << "[CALL_HISTORY] Appended page:" << calls.size()
+             << "calls, has_more =" << hasMore;
+}
+
+void CallHistoryWidget::appendCalls(const QJsonArray& calls)
+{
     // Заполняем внутренний список и QListWidget
     for (const QJsonValue& value : calls) {
         QJsonObject obj = value.toObject();
@@ -88,29 +121,37 @@ void CallHistoryWidget::setCallHistory(const QJsonArray& calls)
         listItem->setData(Qt::UserRole, m_calls.size() - 1);
         m_callListWidget->addItem(listItem);
     }
+}
 
-    m_statusLabel->setText(QString("✅ Loaded %1 calls").arg(calls.size()));
-
-    // Подсчет агрегированной статистики
-    int completed = 0, missed = 0, rejected = 0;
-    int totalDuration = 0;
-    for (const auto& call : m_calls) {
-        if (call.status == "completed") {
-            completed++;
-            totalDuration += call.durationSeconds;
-        } else if (call.status == "missed") {
-            missed++;
-        } else if (call.status == "rejected") {
-            rejected++;
-        }
+void CallHistoryWidget::setCallStats(const QJsonObject& stats)
+{
+    // Сводка из rollup'а сервера: мгновенная, страниц списка не ждет
+    const int completed = stats["completed"].toInt();
+    const int missed = stats["missed"].toInt();
+    const int totalDuration = stats["total_duration_sec"].toInt();
+    const int avgDuration = completed > 0 ? totalDuration / completed : 0;
+
+    m_statsLabel->setText(
+        QString("📤 %1 out | 📥 %2 in | ✅ %3 completed | ⏭️ %4 missed | ⏱️ Avg: %5s")
+            .arg(stats["outgoing"].toInt())
+            .arg(stats["incoming"].toInt())
+            .arg(completed)
+            .arg(missed)
+            .arg(avgDuration));
+}
+
+void CallHistoryWidget::onListScrolled(int value)
+{
+    if (!m_hasMore || m_fetchingMore) {
+        return;
     }
-    int avgDuration = completed > 0 ? totalDuration / completed : 0;
-    QString statsText = QString("✅ %1 completed | ⏭️ %2 missed | ❌ %3 rejected | ⏱️ Avg: %4s")
-                            .arg(completed).arg(missed).arg(rejected).arg(avgDuration);
-    m_statsLabel->setText(statsText);
 
-    qDebug() << "[CALL_HISTORY] Loaded" << calls.size() << "calls";
-    this->show();
+    // Следующая страница запрашивается заранее, за страницу до конца
+    QScrollBar* bar = m_callListWidget->verticalScrollBar();
+    if (value >= bar->maximum() - bar->pageStep()) {
+        m_fetchingMore = true;
+        emit loadMoreRequested();
+    }
 }
 
 void CallHistoryWidget::showLoading(bool loading)
@@ -32,14 +32,34 @@ public:
     ~CallHistoryWidget();
 
     /**
-     * @brief Заполняет список звонков данными из JSON.
+     * @brief Показывает первую страницу истории звонков.
      *
-     * Парсит массив JSON, преобразует его в список объектов CallItem
-     * и обновляет элементы QListWidget. Также обновляет статистику звонков.
+     * Сбрасывает список и заполняет его строками страницы. Следующие
+     * страницы догружаются appendCallHistory по прокрутке к концу
+     * списка (сигнал loadMoreRequested). Сводная строка статистики
+     * приходит отдельно (setCallStats) и страниц не ждет.
      *
-     * @param calls JSON-массив с историей звонков от сервера.
+     * @param calls JSON-массив звонков первой страницы.
+     * @param hasMore За последней строкой есть еще звонки.
      */
-    void setCallHistory(const QJsonArray& calls);
+    void setCallHistory(const QJsonArray& calls, bool hasMore);
+
+    /**
+     * @brief Дописывает следующую страницу звонков в конец списка.
+     * @param calls JSON-массив звонков страницы.
+     * @param hasMore За последней строкой есть еще звонки.
+     */
+    void appendCallHistory(const QJsonArray& calls, bool hasMore);
+
+    /**
+     * @brief Показывает сводную строку из rollup'а сервера (call_stats).
+     *
+     * Сводка считается сервером инкрементально и приходит мгновенно —
+     * строка заполняется до того, как загрузятся страницы списка.
+     * @param stats Объект call_stats (outgoing/incoming/completed/missed/
+     *        total_duration_sec).
+     */
+    void setCallStats(const QJsonObject& stats);
 
     /**
      * @brief Управляет отображением индикатора загрузки.
@@ -64,6 +84,13 @@ signals:
     /** @brief Сигнал: пользователь нажал кнопку "Обновить". */
     void refreshRequested();
 
+    /**
+     * @brief Сигнал: список прокручен к концу, нужна следующая страница.
+     *
+     * Повторно не испускается, пока страница не придет (appendCallHistory).
+     */
+    void loadMoreRequested();
+
     /**
      * @brief Сигнал: выбран конкретный звонок (для просмотра деталей или перезвона).
      * @param call Структура с данными выбранного звонка.
@@ -90,6 +117,12 @@ private:
     /** @brief Инициализация графического интерфейса и layout'ов. */
     void setupUI();
 
+    /** @brief Добавляет строки звонков страницы в модель и список. */
+    void appendCalls(const QJsonArray& calls);
+
+    /** @brief Прокрутка у конца списка — запрашивает следующую страницу. */
+    void onListScrolled(int value);
+
     /**
      * @brief Форматирует строку описания звонка для списка.
      * @param item Данные звонка.
@@ -117,6 +150,8 @@ private:
     QLabel* m_statusLabel;          ///< Лейбл для ошибок и статусов загрузки
     QLabel* m_statsLabel;           ///< Лейбл общей статистики (всего, длительность)
     QList<CallItem> m_calls;        ///< Локальное хранилище данных истории
+    bool m_hasMore = false;         ///< Сервер сообщил о следующей странице
+    bool m_fetchingMore = false;    ///< Страница уже запрошена, ждем ответ
 };
 
 #endif // CALLHISTORYWIDGET_H
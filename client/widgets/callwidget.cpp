@@ -12,6 +12,7 @@ CallWidget::CallWidget(CallService* service, QWidget* parent)
     , m_callerLabel(new QLabel("Входящий звонок", this))
     , m_stateLabel(new QLabel("Ожидание...", this))
     , m_durationLabel(new QLabel("00:00", this))
+    , m_statsLabel(new QLabel(QString(), this))
     , m_acceptBtn(new QPushButton("Принять", this))
     , m_rejectBtn(new QPushButton("Отклонить", this))
     , m_endBtn(new QPushButton("Завершить", this))
@@ -31,10 +32,12 @@ CallWidget::CallWidget(CallService* service, QWidget* parent)
     m_callerLabel->setStyleSheet("font-size: 16px; font-weight: bold;");
     m_stateLabel->setStyleSheet("font-size: 14px;");
     m_durationLabel->setStyleSheet("font-size: 18px; font-weight: bold; color: blue;");
+    m_statsLabel->setStyleSheet("font-size: 11px; color: gray;");
 
     layout->addWidget(m_callerLabel);
     layout->addWidget(m_stateLabel);
     layout->addWidget(m_durationLabel);
+    layout->addWidget(m_statsLabel);
     layout->addSpacing(20);
 
     // Кнопки управления
@@ -74,6 +77,32 @@ CallWidget::CallWidget(CallService* service, QWidget* parent)
         qDebug() << "[CW] ✅ endCallClicked() emitted";
     });
 
+    // Живая телеметрия качества от сервиса звонков (раз в секунду)
+    if (m_callService) {
+        connect(m_callService, &CallService::callStatsUpdated, this,
+                [this](double jitterMs, int lossPercent, int reorderCount,
+                       int rttMs, qlonglong concealedFrames) {
+            Q_UNUSED(reorderCount);
+            Q_UNUSED(concealedFrames);
+            const QString rtt = (rttMs >= 0) ? QString::number(rttMs) + " мс" : "—";
+            QString line = QString("джиттер %1 мс · потери %2% · RTT %3")
+                               .arg(jitterMs, 0, 'f', 1)
+                               .arg(lossPercent)
+                               .arg(rtt);
+            if (!m_opPoint.isEmpty()) {
+                line += " · " + m_opPoint;
+            }
+            m_statsLabel->setText(line);
+        });
+        // Рабочая точка энкодера (тюнер CPU-бюджета) — в ту же строку
+        connect(m_callService, &CallService::callOperatingPointChanged, this,
+                [this](int complexity, int bitrateBps) {
+            m_opPoint = QString("c%1 / %2 кбит/с")
+                            .arg(complexity)
+                            .arg(bitrateBps / 1000);
+        });
+    }
+
     // По умолчанию режим входящего вызова
     m_endBtn->hide();
     m_acceptBtn->show();
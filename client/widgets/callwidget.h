@@ -72,6 +72,8 @@ private:
     QLabel* m_callerLabel;       ///< UI: Имя собеседника
     QLabel* m_stateLabel;        ///< UI: Текущий статус (Ringing/Connected)
     QLabel* m_durationLabel;     ///< UI: Время разговора
+    QLabel* m_statsLabel;        ///< UI: Телеметрия качества (джиттер/потери/RTT)
+    QString m_opPoint;           ///< Рабочая точка энкодера (сложность/битрейт)
 
     QPushButton* m_acceptBtn;    ///< Кнопка приема вызова (обычно зеленая)
     QPushButton* m_rejectBtn;    ///< Кнопка сброса входящего (обычно красная)
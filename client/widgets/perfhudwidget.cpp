@@ -0,0 +1,146 @@
+//См. "perfhudwidget.h"
+#include "perfhudwidget.h"
+#include "perfmetrics.h"
+
+#include <QEvent>
+#include <QPainter>
+
+PerfHudWidget::PerfHudWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    // Оверлей не должен перехватывать клики по чату под ним
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setFixedSize(HudWidth, HudHeight);
+    hide();
+
+    // Пока панель скрыта, таймер остановлен — нулевая стоимость
+    m_refreshTimer.setInterval(RefreshIntervalMs);
+    connect(&m_refreshTimer, &QTimer::timeout,
+            this, QOverload<>::of(&QWidget::update));
+
+    if (parent) {
+        parent->installEventFilter(this);
+        reposition();
+    }
+}
+
+void PerfHudWidget::toggle()
+{
+    if (isVisible()) {
+        m_refreshTimer.stop();
+        hide();
+        // Показания снимаются одним хоткеем: скрытие = дамп в лог
+        PerfMetrics::dump();
+    } else {
+        reposition();
+        raise();
+        show();
+        m_refreshTimer.start();
+    }
+}
+
+void PerfHudWidget::reposition()
+{
+    if (!parentWidget()) return;
+    move(parentWidget()->width() - width() - HudMargin, HudMargin);
+}
+
+bool PerfHudWidget::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == parentWidget() && event->type() == QEvent::Resize) {
+        reposition();
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void PerfHudWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    const PerfMetrics::Snapshot s = PerfMetrics::snapshot();
+
+    QPainter p(this);
+    p.setRenderHint(QPainter::Antialiasing);
+
+    // Полупрозрачная подложка поверх чата
+    p.setPen(Qt::NoPen);
+    p.setBrush(QColor(20, 18, 20, 215));
+    p.drawRoundedRect(rect(), 8, 8);
+
+    QFont font = p.font();
+    font.setPointSizeF(font.pointSizeF() * 0.85);
+    p.setFont(font);
+    const int lineHeight = p.fontMetrics().height() + 2;
+    int y = 10 + p.fontMetrics().ascent();
+    const int x = 12;
+
+    const auto hitRate = [](quint64 hits, quint64 misses) {
+        const quint64 total = hits + misses;
+        return total > 0 ? qRound(100.0 * double(hits) / double(total)) : 0;
+    };
+
+    p.setPen(QColor(230, 230, 230));
+    p.drawText(x, y, QString("paint: %1").arg(s.paintCount));
+    y += lineHeight;
+    p.drawText(x, y, QString("doc cache: %1% (%2/%3)")
+                         .arg(hitRate(s.docHits, s.docMisses))
+                         .arg(s.docHits)
+                         .arg(s.docHits + s.docMisses));
+    y += lineHeight;
+    p.drawText(x, y, QString("bubble cache: %1% (%2/%3)")
+                         .arg(hitRate(s.bubbleHits, s.bubbleMisses))
+                         .arg(s.bubbleHits)
+                         .arg(s.bubbleHits + s.bubbleMisses));
+    y += lineHeight;
+    p.drawText(x, y, QString("db queue: %1 (done %2)")
+                         .arg(s.dbQueueDepth)
+                         .arg(s.dbJobsDone));
+    y += lineHeight;
+    p.drawText(x, y, s.rttCount > 0
+                         ? QString("rtt: %1 ms (avg %2, n=%3)")
+                               .arg(s.lastRttMs)
+                               .arg(s.avgRttMs)
+                               .arg(s.rttCount)
+                         : QStringLiteral("rtt: —"));
+    y += lineHeight;
+    // Задержка ввода: клавиша -> глиф на экране (замеряет SmoothTextEdit)
+    p.drawText(x, y, s.inputCount > 0
+                         ? QString("input: %1 ms (p95 %2, n=%3)")
+                               .arg(s.inputLastUs / 1000.0, 0, 'f', 1)
+                               .arg(s.inputP95Us / 1000.0, 0, 'f', 1)
+                               .arg(s.inputCount)
+                         : QStringLiteral("input: —"));
+    y += lineHeight + 4;
+
+    // Гистограмма времени paint(): высота столбца — доля корзины.
+    // Подписи — верхние границы корзин в мс
+    quint64 maxBucket = 1;
+    for (int i = 0; i < PerfMetrics::FrameBucketCount; ++i) {
+        maxBucket = qMax(maxBucket, s.frameBuckets[i]);
+    }
+
+    const int histTop = y;
+    const int histHeight = HudHeight - histTop - lineHeight - 8;
+    const int barGap = 6;
+    const int barWidth = (width() - 2 * x - barGap * (PerfMetrics::FrameBucketCount - 1))
+                         / PerfMetrics::FrameBucketCount;
+
+    for (int i = 0; i < PerfMetrics::FrameBucketCount; ++i) {
+        const int barX = x + i * (barWidth + barGap);
+        const int barH = qMax(2, int(histHeight * s.frameBuckets[i] / maxBucket));
+
+        // Медленные корзины подсвечиваем теплее
+        p.setPen(Qt::NoPen);
+        p.setBrush(i < 3 ? QColor(120, 190, 120)
+                         : i < 5 ? QColor(220, 180, 90)
+                                 : QColor(220, 100, 90));
+        p.drawRect(barX, histTop + histHeight - barH, barWidth, barH);
+
+        p.setPen(QColor(160, 160, 160));
+        const QString label = i < PerfMetrics::FrameBucketCount - 1
+            ? QString("<%1").arg(PerfMetrics::FrameBucketEdgesMs[i])
+            : QStringLiteral("16+");
+        p.drawText(QRect(barX, histTop + histHeight + 2, barWidth, lineHeight),
+                   Qt::AlignHCenter | Qt::AlignTop, label);
+    }
+}
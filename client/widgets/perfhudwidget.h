@@ -0,0 +1,62 @@
+#ifndef PERFHUDWIDGET_H
+#define PERFHUDWIDGET_H
+
+#include <QWidget>
+#include <QTimer>
+
+/**
+ * @brief Отладочный оверлей с метриками производительности клиента.
+ *
+ * Полупрозрачная панель в правом верхнем углу главного окна: гистограмма
+ * времени отрисовки строк чата, хит-рейты кэшей делегата, глубина очереди
+ * потока БД и время круга до сервера. Данные берутся из PerfMetrics
+ * (счетчики всегда включены), сама панель — чистый потребитель: пока она
+ * скрыта, накладных расходов нет.
+ *
+ * Переключается хоткеем из MainWindow (Ctrl+Shift+P); при скрытии
+ * дампит сводку счетчиков в лог.
+ */
+class PerfHudWidget : public QWidget {
+    Q_OBJECT
+public:
+    /**
+     * @brief Конструктор оверлея.
+     * @param parent Родительский виджет (главное окно)
+     */
+    explicit PerfHudWidget(QWidget *parent = nullptr);
+
+    /**
+     * @brief Показывает/скрывает оверлей.
+     *
+     * При скрытии выводит сводку PerfMetrics::dump() в лог —
+     * удобный способ снять показания одним хоткеем.
+     */
+    void toggle();
+
+protected:
+    /**
+     * @brief Рисует панель с текущим снимком счетчиков.
+     */
+    void paintEvent(QPaintEvent *event) override;
+
+    /**
+     * @brief Следит за изменением размера родителя, чтобы держаться
+     * в правом верхнем углу.
+     */
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    /**
+     * @brief Прижимает оверлей к правому верхнему углу родителя.
+     */
+    void reposition();
+
+    QTimer m_refreshTimer; ///< Периодическая перерисовка (2 раза в секунду)
+
+    static constexpr int HudWidth = 280;      ///< Ширина панели
+    static constexpr int HudHeight = 228;     ///< Высота панели
+    static constexpr int HudMargin = 12;      ///< Отступ от краев родителя
+    static constexpr int RefreshIntervalMs = 500; ///< Период обновления
+};
+
+#endif // PERFHUDWIDGET_H
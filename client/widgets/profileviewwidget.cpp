@@ -83,28 +83,22 @@ void ProfileViewWidget::onEditButtonClicked() {
     QString newDisplayName = m_displayName->text();
     QString newAbout = m_about->text();
 
-    // Проверяем наличие изменений
-    bool changed = false;
-    User updated = m_currentUser;
-    
+    // Дифференциальный запрос: уходит только то, что реально поменялось —
+    // сервер обновит только эти колонки и разошлет контактам компактную
+    // дельту вместо полного профиля
+    QJsonObject req;
+    req["type"]     = "update_profile";
+    req["username"] = m_currentUser.username;
+
     if (newDisplayName != m_currentUser.displayName) {
-        updated.displayName = newDisplayName;
-        changed = true;
+        req["display_name"] = newDisplayName;
     }
     if (newAbout != m_currentUser.statusMessage) {
-        updated.statusMessage = newAbout;
-        changed = true;
+        req["status_message"] = newAbout;
     }
-    if (!changed)
-        return;
+    if (req.size() <= 2)
+        return; // Кроме type/username ничего не изменилось
 
-    // Формируем JSON запрос для обновления профиля на сервере
-    QJsonObject req;
-    req["type"]          = "update_profile";
-    req["username"]      = updated.username;
-    req["display_name"]  = updated.displayName;
-    req["status_message"] = updated.statusMessage;
-    req["avatar_url"]    = updated.avatarUrl;
     m_netService->sendJson(req);
 }
 
@@ -189,6 +189,9 @@ public slots:
      */
     void setUserProfile(const User& user, bool isMyProfile = false);
 
+    /** @brief Имя пользователя, чья карточка открыта сейчас. */
+    QString profileUsername() const { return m_currentUser.username; }
+
     /**
      * @brief Обработчик нажатия кнопки "EDIT" / "SAVE".
      *
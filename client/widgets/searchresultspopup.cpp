@@ -41,6 +41,11 @@ SearchResultsPopup::SearchResultsPopup(QWidget *parent) : QWidget(parent)
         "}"
         );
 
+    // Строки одинаковой высоты: раскладка списка не измеряет каждый элемент,
+    // а рендер строк за видимой областью откладывается до прокрутки — хвост
+    // потоковой выдачи в сотни результатов не стоит ничего, пока его не листают
+    m_listWidget->setUniformItemSizes(true);
+
     // Обработчик клика по элементу - испускаем сигнал и скрываем popup
     connect(m_listWidget, &QListWidget::itemClicked, this, [this](QListWidgetItem *item){
         emit userSelected(item->data(Qt::UserRole).toString());
@@ -53,6 +58,32 @@ void SearchResultsPopup::showResults(const QJsonArray &users)
     // Очищаем предыдущие результаты
     m_listWidget->clear();
 
+    appendItems(users);
+
+    // Если результатов нет - скрываем popup
+    if (m_listWidget->count() == 0) {
+        hide();
+        return;
+    }
+
+    updatePopupHeight();
+
+    // Показываем popup если он скрыт
+    if (!isVisible()) {
+        show();
+    }
+}
+
+void SearchResultsPopup::appendResults(const QJsonArray &users)
+{
+    // Высота окна от хвоста не меняется (видимых строк и так максимум 4),
+    // но скроллбар мог быть выключен первым коротким чанком
+    appendItems(users);
+    updatePopupHeight();
+}
+
+void SearchResultsPopup::appendItems(const QJsonArray &users)
+{
     // Парсим JSON массив пользователей и создаем элементы списка
     for (const QJsonValue &value : users) {
         QJsonObject userObj = value.toObject();
@@ -64,13 +95,11 @@ void SearchResultsPopup::showResults(const QJsonArray &users)
         item->setData(Qt::UserRole, username);      
         m_listWidget->addItem(item);
     }
+}
 
-    // Если результатов нет - скрываем popup
+void SearchResultsPopup::updatePopupHeight()
+{
     int count = m_listWidget->count();
-    if (count == 0) {
-        hide();
-        return;
-    }
 
     // Вычисляем оптимальную высоту popup
     QFontMetrics fm(m_listWidget->font());
@@ -90,9 +119,4 @@ void SearchResultsPopup::showResults(const QJsonArray &users)
 
     // Устанавливаем фиксированную высоту popup
     this->setFixedHeight(targetHeight);
-
-    // Показываем popup если он скрыт
-    if (!isVisible()) {
-        show();
-    }
 }
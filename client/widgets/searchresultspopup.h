@@ -37,7 +37,26 @@ public:
      */
     void showResults(const QJsonArray &users);
 
+    /**
+     * @brief Дополняет список хвостовым чанком потоковой выдачи.
+     *
+     * Сервер отдает результаты поиска чанками по рангу: первый показывает
+     * showResults, остальные доклеиваются сюда без очистки и перерисовки
+     * уже видимых строк. Высота окна не меняется — хвост уходит под
+     * скроллбар, а рендер строк за видимой областью QListWidget и так
+     * откладывает до прокрутки.
+     *
+     * @param users Пользователи очередного чанка
+     */
+    void appendResults(const QJsonArray &users);
+
 private:
+    /** @brief Добавляет строки чанка в список. */
+    void appendItems(const QJsonArray &users);
+
+    /** @brief Пересчитывает высоту окна по числу строк (не более 4 видимых). */
+    void updatePopupHeight();
+
     QListWidget *m_listWidget;  ///< Виджет списка для отображения результатов
 
 signals:
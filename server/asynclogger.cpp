@@ -0,0 +1,203 @@
+//См. "asynclogger.h"
+#include "asynclogger.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+AsyncLogger *g_instance = nullptr; ///< Единственный экземпляр логгера.
+FILE *g_out = nullptr;             ///< Назначение вывода (файл или stderr).
+bool g_jsonOutput = false;         ///< true — JSON-строки, false — текст.
+
+/** @brief Текстовая метка уровня для структурированного вывода. */
+const char *levelName(int type)
+{
+    switch (type) {
+    case QtDebugMsg:    return "debug";
+    case QtInfoMsg:     return "info";
+    case QtWarningMsg:  return "warning";
+    case QtCriticalMsg: return "critical";
+    case QtFatalMsg:    return "fatal";
+    }
+    return "unknown";
+}
+
+} // namespace
+
+
+void AsyncLogger::install()
+{
+    if (g_instance) return;
+
+    // Назначение вывода: файл со структурированным JSON или stderr текстом
+    const QByteArray logPath = qgetenv("MESSENGER_LOG_FILE");
+    if (!logPath.isEmpty()) {
+        g_out = std::fopen(logPath.constData(), "a");
+        if (g_out) {
+            g_jsonOutput = true;
+        } else {
+            std::fprintf(stderr, "[LOG] Cannot open %s, falling back to stderr\n",
+                         logPath.constData());
+        }
+    }
+    if (!g_out) {
+        g_out = stderr;
+        g_jsonOutput = false;
+    }
+
+    g_instance = new AsyncLogger();
+    g_instance->start(QThread::LowPriority);
+
+    qInstallMessageHandler(&AsyncLogger::messageHandler);
+    qAddPostRoutine(&AsyncLogger::shutdown); // Дописать остаток при выходе
+}
+
+
+void AsyncLogger::shutdown()
+{
+    if (!g_instance) return;
+
+    qInstallMessageHandler(nullptr); // Дальше — синхронно, как раньше
+
+    g_instance->m_running.store(false, std::memory_order_release);
+    g_instance->wait(); // run() дренирует остаток буфера перед выходом
+
+    if (g_out && g_out != stderr) {
+        std::fclose(g_out);
+        g_out = stderr;
+    }
+
+    delete g_instance;
+    g_instance = nullptr;
+}
+
+
+qint64 AsyncLogger::droppedCount()
+{
+    return g_instance ? g_instance->m_dropped.load(std::memory_order_relaxed) : 0;
+}
+
+
+void AsyncLogger::messageHandler(QtMsgType type, const QMessageLogContext &context,
+                                 const QString &message)
+{
+    // Падение не должно терять последнюю строку: fatal минует очередь
+    if (type == QtFatalMsg) {
+        const QByteArray utf8 = message.toUtf8();
+        std::fprintf(stderr, "%s\n", utf8.constData());
+        if (g_out && g_out != stderr) {
+            std::fprintf(g_out, "%s\n", utf8.constData());
+            std::fflush(g_out);
+        }
+        return; // qFatal вызовет abort() после возврата из обработчика
+    }
+
+    AsyncLogger *logger = g_instance;
+    if (!logger || !logger->enqueue(type, context.category, message)) {
+        if (logger) {
+            logger->m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+bool AsyncLogger::enqueue(QtMsgType type, const char *category, const QString &message)
+{
+    // MPMC-схема Вьюкова: слот свободен, когда его sequence равен позиции.
+    // Производитель занимает позицию CAS'ом, заполняет слот и публикует
+    // его инкрементом sequence — писатель увидит запись целиком.
+    quint32 pos = m_enqueuePos.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Slot &slot = m_ring[pos & (RingCapacity - 1)];
+        const quint32 seq = slot.sequence.load(std::memory_order_acquire);
+        const qint32 dif = qint32(seq - pos);
+
+        if (dif == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                   std::memory_order_relaxed)) {
+                slot.timestampMs = QDateTime::currentMSecsSinceEpoch();
+                slot.type = int(type);
+                slot.category = category ? QByteArray(category) : QByteArray("default");
+                slot.message = message.toUtf8();
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+            // CAS проиграл — pos обновлен, пробуем следующую позицию
+        } else if (dif < 0) {
+            return false; // Буфер полон: отбрасываем, не блокируем
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+void AsyncLogger::run()
+{
+    // Единственный потребитель: m_dequeuePos не нуждается в атомарности.
+    for (;;) {
+        bool wrote = false;
+
+        for (;;) {
+            Slot &slot = m_ring[m_dequeuePos & (RingCapacity - 1)];
+            const quint32 seq = slot.sequence.load(std::memory_order_acquire);
+            if (qint32(seq - (m_dequeuePos + 1)) < 0) {
+                break; // Запись в этой позиции еще не опубликована
+            }
+
+            writeRecord(slot);
+            slot.category.clear();
+            slot.message.clear();
+
+            // Слот снова свободен для производителей следующего круга
+            slot.sequence.store(m_dequeuePos + RingCapacity,
+                                std::memory_order_release);
+            ++m_dequeuePos;
+            wrote = true;
+        }
+
+        // О потерях сообщает сам писатель — не чаще, чем появляются новые
+        const qint64 dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped > m_droppedReported) {
+            std::fprintf(g_out, "[LOG] %lld record(s) dropped (ring buffer full)\n",
+                         static_cast<long long>(dropped - m_droppedReported));
+            m_droppedReported = dropped;
+            wrote = true;
+        }
+
+        if (wrote) {
+            std::fflush(g_out);
+        } else {
+            if (!m_running.load(std::memory_order_acquire)) {
+                return; // Буфер пуст и остановка запрошена — выходим
+            }
+            msleep(10);
+        }
+    }
+}
+
+
+void AsyncLogger::writeRecord(const Slot &slot)
+{
+    if (g_jsonOutput) {
+        QJsonObject line;
+        line["ts"] = double(slot.timestampMs);
+        line["lvl"] = QLatin1String(levelName(slot.type));
+        line["cat"] = QLatin1String(slot.category.constData());
+        line["msg"] = QString::fromUtf8(slot.message);
+
+        const QByteArray json = QJsonDocument(line).toJson(QJsonDocument::Compact);
+        std::fwrite(json.constData(), 1, size_t(json.size()), g_out);
+        std::fputc('\n', g_out);
+    } else {
+        std::fwrite(slot.message.constData(), 1, size_t(slot.message.size()), g_out);
+        std::fputc('\n', g_out);
+    }
+}
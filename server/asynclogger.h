@@ -0,0 +1,94 @@
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QByteArray>
+#include <QThread>
+
+#include <atomic>
+
+/**
+ * @class AsyncLogger
+ * @brief Асинхронный вывод логов: кольцевой буфер и отдельный поток-писатель.
+ *
+ * @details Штатный обработчик Qt пишет каждое сообщение в stderr синхронно:
+ * на горячих путях (сообщение, пакет, кадр) поток событий платит за
+ * форматирование времени, блокировку stderr и сам write(2). Логгер
+ * перехватывает вывод qInstallMessageHandler'ом и лишь кладет запись в
+ * ограниченный lock-free кольцевой буфер (MPMC-схема Вьюкова: атомарный
+ * счетчик позиций плюс номер поколения в каждом слоте) — производитель
+ * платит пару атомарных операций и перенос уже отформатированной строки.
+ * Отдельный поток дренирует буфер и пишет строки пакетно.
+ *
+ * При переполнении буфера записи отбрасываются, а не блокируют
+ * производителя; число потерь считается и периодически печатается самим
+ * писателем. QtFatalMsg минует очередь и пишется синхронно — падение
+ * не должно терять последнюю строку.
+ *
+ * Формат вывода: переменная окружения `MESSENGER_LOG_FILE` задает путь к
+ * файлу, строки пишутся структурированным JSON (ts/lvl/cat/msg — по строке
+ * на запись, готово для сборщика логов). Без переменной вывод идет в stderr
+ * компактным текстом — как раньше, но асинхронно.
+ *
+ * Фильтрация: уровни по категориям применяются ДО обработчика правилами
+ * QLoggingCategory (ServerConfig гасит debug в проде), так что отключенная
+ * категория не доходит до очереди. Полностью нулевой стоимости отключенных
+ * qDebug-site'ов достигает сборка с DEFINES += QT_NO_DEBUG_OUTPUT —
+ * тогда отладочные вызовы компилируются в пустоту вместе с аргументами.
+ */
+class AsyncLogger : public QThread
+{
+public:
+    /** @brief Емкость кольцевого буфера (степень двойки). */
+    static constexpr quint32 RingCapacity = 8192;
+
+    /**
+     * @brief Устанавливает обработчик сообщений и запускает поток-писатель.
+     * @details Вызывать один раз, в начале main() — до создания сервера,
+     * чтобы под перехват попал весь вывод, включая инициализацию.
+     */
+    static void install();
+
+    /**
+     * @brief Останавливает писателя, дописав остаток буфера.
+     * @details Вызывается автоматически при выходе (qAddPostRoutine).
+     */
+    static void shutdown();
+
+    /** @brief Записей, отброшенных из-за переполнения буфера. */
+    static qint64 droppedCount();
+
+protected:
+    /** @brief Цикл писателя: дренаж буфера и пакетная запись. */
+    void run() override;
+
+private:
+    AsyncLogger() = default;
+
+    /** @brief Слот кольцевого буфера. */
+    struct Slot {
+        std::atomic<quint32> sequence{0}; ///< Номер поколения (схема Вьюкова).
+        qint64 timestampMs = 0;           ///< Момент записи, мс эпохи.
+        int type = 0;                     ///< QtMsgType записи.
+        QByteArray category;              ///< Категория логирования.
+        QByteArray message;               ///< Отформатированное сообщение (UTF-8).
+    };
+
+    /** @brief Обработчик qInstallMessageHandler: кладет запись в буфер. */
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context,
+                               const QString &message);
+
+    /** @brief Пытается занять слот и записать сообщение; false — буфер полон. */
+    bool enqueue(QtMsgType type, const char *category, const QString &message);
+
+    /** @brief Пишет одну запись в назначенный вывод (поток писателя). */
+    void writeRecord(const Slot &slot);
+
+    Slot m_ring[RingCapacity];            ///< Кольцевой буфер записей.
+    std::atomic<quint32> m_enqueuePos{0}; ///< Позиция производителей.
+    quint32 m_dequeuePos = 0;             ///< Позиция писателя (один поток).
+    std::atomic<bool> m_running{true};    ///< Флаг работы цикла писателя.
+    std::atomic<qint64> m_dropped{0};     ///< Отброшено при переполнении.
+    qint64 m_droppedReported = 0;         ///< Потерь, о которых уже сообщено.
+};
+
+#endif // ASYNCLOGGER_H
@@ -0,0 +1,69 @@
+#ifndef BINARYCODEC_H
+#define BINARYCODEC_H
+
+#include <QByteArray>
+#include <QJsonObject>
+
+/**
+ * @class BinaryCodec
+ * @brief Компактный бинарный кодек для высокочастотных типов сообщений.
+ *
+ * @details На горячих типах трафика (индикатор "печатает...", подтверждения
+ * доставки и прочтения) основная часть CPU уходит не на сеть и не на
+ * шифрование, а на QJsonDocument::fromJson / toJson. Для этих типов кодек
+ * определяет бинарные записи с фиксированными тегами:
+ *
+ *     [Magic 0xB1 (1 байт)] [тег записи (1 байт)] [поля через QDataStream Qt_6_2]
+ *
+ * Редкие типы сообщений остаются на JSON: encode() возвращает для них пустой
+ * массив, и вызывающий код шлет обычную JSON-сериализацию.
+ *
+ * Набор бинарных типов, их теги и поля описаны в одном месте — реестре
+ * ProtocolSchema (protocolschema.h); кодек — это общие циклы по
+ * дескриптору, поэтому encode() и decode() разойтись не могут.
+ *
+ * Режим включается по согласованию: клиент после рукопожатия отправляет
+ * запрос `binary_mode`, сервер отвечает `binary_mode_ack`, и с этого момента
+ * обе стороны МОГУТ слать горячие типы бинарно. Приемная сторона различает
+ * форматы по первому байту расшифрованного пакета: JSON всегда начинается
+ * с '{' (0x7B), бинарная запись — с Magic (0xB1). Фрейминг TCP-канала
+ * ([длина][nonce][MAC+шифртекст]) не меняется.
+ *
+ * @note Файл намеренно идентичен в server/ и client/core/ (как cryptoutils):
+ * обе стороны должны кодировать и декодировать записи одинаково.
+ */
+class BinaryCodec
+{
+public:
+    /** @brief Первый байт бинарной записи; не совпадает с '{' (0x7B) JSON. */
+    static constexpr quint8 Magic = 0xB1;
+
+    /** @brief Версия протокола, передаваемая при согласовании binary_mode. */
+    static constexpr int Version = 1;
+
+    /**
+     * @brief Проверяет, является ли расшифрованный пакет бинарной записью.
+     * @param payload Полезная нагрузка пакета (после снятия шифрования).
+     */
+    static bool isBinary(const QByteArray& payload);
+
+    /**
+     * @brief Кодирует JSON-сообщение в бинарную запись, если его тип горячий.
+     * @param json Сообщение в обычном JSON-представлении.
+     * @return Бинарная запись, либо пустой массив — тип не поддержан,
+     *         отправляйте как JSON.
+     */
+    static QByteArray encode(const QJsonObject& json);
+
+    /**
+     * @brief Декодирует бинарную запись обратно в JSON-объект.
+     * @details Результат в точности совпадает с тем, что отправитель передал
+     * бы в JSON-режиме, поэтому дальнейшая маршрутизация (диспетчеризация
+     * по полю "type") не меняется.
+     * @param payload Бинарная запись (первый байт — Magic).
+     * @return Восстановленный объект, либо пустой объект при ошибке формата.
+     */
+    static QJsonObject decode(const QByteArray& payload);
+};
+
+#endif // BINARYCODEC_H
@@ -0,0 +1,142 @@
+#include "callrelay.h"
+
+#include <QUdpSocket>
+#include <QDebug>
+
+CallRelay::CallRelay(QObject* parent)
+    : QObject(parent)
+{
+    // Максимальный теоретический размер UDP-датаграммы; буфер выделяется
+    // один раз, горячий путь приема не аллоцирует вовсе.
+    m_recvBuffer.resize(65536);
+}
+
+
+bool CallRelay::start()
+{
+    quint16 port = DefaultPort;
+    if (qEnvironmentVariableIsSet("MESSENGER_RELAY_PORT")) {
+        const int configured = qEnvironmentVariableIntValue("MESSENGER_RELAY_PORT");
+        if (configured == 0) {
+            qDebug() << "[RELAY] Disabled (MESSENGER_RELAY_PORT=0)";
+            return true;
+        }
+        port = static_cast<quint16>(configured);
+    }
+
+    m_socket = new QUdpSocket(this);
+    if (!m_socket->bind(QHostAddress::Any, port)) {
+        qCritical() << "[RELAY] Failed to bind UDP port" << port
+                    << ":" << m_socket->errorString();
+        delete m_socket;
+        m_socket = nullptr;
+        return false;
+    }
+
+    connect(m_socket, &QUdpSocket::readyRead, this, &CallRelay::onReadyRead);
+
+    m_port = port;
+    qInfo() << "[RELAY] Call relay listening on UDP port" << port;
+    return true;
+}
+
+
+void CallRelay::openSession(const QString& callId)
+{
+    if (!enabled() || m_sessions.contains(callId)) return;
+
+    auto* session = new Session();
+    session->callId = callId;
+    m_sessions.insert(callId, session);
+
+    qDebug() << "[RELAY] Session opened for call" << callId;
+}
+
+
+void CallRelay::closeSession(const QString& callId)
+{
+    Session* session = m_sessions.take(callId);
+    if (!session) return;
+
+    for (const Endpoint& side : session->sides) {
+        if (side.bound) {
+            m_byAddress.remove(qMakePair(side.address, side.port));
+        }
+    }
+
+    qDebug() << "[RELAY] Session closed for call" << callId;
+    delete session;
+}
+
+
+void CallRelay::registerEndpoint(const QString& callId,
+                                 const QHostAddress& address, quint16 port)
+{
+    Session* session = m_sessions.value(callId, nullptr);
+    if (!session) {
+        // Приветствие неизвестного звонка: сигналинг еще не дошел или
+        // звонок уже завершен — клиент перестанет повторять сам.
+        return;
+    }
+
+    const AddressKey key = qMakePair(address, port);
+    if (m_byAddress.value(key, nullptr) == session) {
+        return; // Повторное приветствие той же стороны
+    }
+
+    for (Endpoint& side : session->sides) {
+        if (!side.bound) {
+            side.address = address;
+            side.port = port;
+            side.bound = true;
+            m_byAddress.insert(key, session);
+            qDebug() << "[RELAY] Endpoint bound for call" << callId
+                     << ":" << address.toString() << ":" << port;
+            return;
+        }
+    }
+
+    qWarning() << "[RELAY] Third endpoint for call" << callId
+               << "ignored:" << address.toString() << ":" << port;
+}
+
+
+void CallRelay::onReadyRead()
+{
+    // Пакетный drain: все накопленные датаграммы обрабатываются за одну
+    // активацию нотификатора, прием — в преаллоцированный буфер.
+    while (m_socket->hasPendingDatagrams()) {
+        QHostAddress fromAddress;
+        quint16 fromPort = 0;
+        const qint64 size = m_socket->readDatagram(m_recvBuffer.data(),
+                                                   m_recvBuffer.size(),
+                                                   &fromAddress, &fromPort);
+        if (size <= 0) continue;
+
+        // Датаграмма-приветствие: [HelloMagic][callId utf8].
+        if (static_cast<quint8>(m_recvBuffer.at(0)) == HelloMagic) {
+            const QString callId = QString::fromUtf8(
+                m_recvBuffer.constData() + 1, static_cast<int>(size) - 1);
+            registerEndpoint(callId, fromAddress, fromPort);
+            continue;
+        }
+
+        // Аудио: один lookup по адресу отправителя, пересылка второй
+        // стороне без разбора содержимого.
+        Session* session =
+            m_byAddress.value(qMakePair(fromAddress, fromPort), nullptr);
+        if (!session) continue; // Посторонний трафик на порту ретранслятора
+
+        const Endpoint& a = session->sides[0];
+        const Endpoint& b = session->sides[1];
+        const bool fromA = a.bound
+                        && a.address == fromAddress && a.port == fromPort;
+        const Endpoint& peer = fromA ? b : a;
+
+        if (!peer.bound) continue; // Вторая сторона еще не зарегистрировалась
+
+        m_socket->writeDatagram(m_recvBuffer.constData(), size,
+                                peer.address, peer.port);
+        ++m_datagramsRelayed;
+    }
+}
@@ -0,0 +1,62 @@
+/**
+ * @file chatsequencer.cpp
+ * @brief Реализация атомарных счетчиков порядка по диалогам.
+ */
+
+#include <QDateTime>
+
+#include "chatsequencer.h"
+#include "messageidgenerator.h"
+
+namespace {
+
+/**
+ * @brief Время-упорядоченное зерно нового счетчика.
+ * @details Та же раскладка, что у MessageIdGenerator (мс от Epoch <<
+ * SequenceBits): штамп, выданный после перезапуска, заведомо больше любого
+ * выданного раньше — монотонность диалога переживает рестарт без чтения БД.
+ */
+qint64 timeOrderedSeed()
+{
+    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch()
+                         - MessageIdGenerator::EpochMs;
+    return nowMs << MessageIdGenerator::SequenceBits;
+}
+
+} // namespace
+
+
+std::atomic<qint64>* ChatSequencer::counterFor(const QString& key)
+{
+    {
+        // Горячий путь: диалог уже известен — достаточно разделяемой
+        // блокировки чтения, потоки-маршрутизаторы друг другу не мешают.
+        QReadLocker readLocker(&m_lock);
+        auto it = m_counters.constFind(key);
+        if (it != m_counters.constEnd()) {
+            return it.value().get();
+        }
+    }
+
+    // Первое сообщение пары: эксклюзивная вставка. Перепроверяем под
+    // write-блокировкой — конкурирующий поток мог успеть раньше.
+    QWriteLocker writeLocker(&m_lock);
+    auto it = m_counters.find(key);
+    if (it == m_counters.end()) {
+        it = m_counters.insert(
+            key, std::make_unique<std::atomic<qint64>>(timeOrderedSeed()));
+    }
+    return it.value().get();
+}
+
+
+qint64 ChatSequencer::next(const QString& userA, const QString& userB)
+{
+    // Каноничный ключ: обе стороны диалога делят один счетчик.
+    const QString key = (userA < userB) ? userA + QLatin1Char('\n') + userB
+                                        : userB + QLatin1Char('\n') + userA;
+
+    // Сам штамп — один fetch_add, без блокировок: стабильный указатель на
+    // атомик получен выше, рехеш карты его не двигает.
+    return counterFor(key)->fetch_add(1, std::memory_order_relaxed) + 1;
+}
@@ -0,0 +1,61 @@
+#ifndef CHATSEQUENCER_H
+#define CHATSEQUENCER_H
+
+#include <QString>
+#include <QHash>
+#include <QReadWriteLock>
+
+#include <atomic>
+#include <memory>
+
+/**
+ * @class ChatSequencer
+ * @brief Счетчики порядка сообщений на каждый диалог (без глобальной блокировки).
+ *
+ * @details Сегодня порядок сообщений внутри диалога держится на том, что
+ * handlePrivateMessage выполняется в одном потоке: глобальные ID
+ * (MessageIdGenerator) выдаются в порядке обработки. Это неявная гарантия —
+ * при переносе маршрутизации в несколько потоков два сообщения одной пары
+ * могут получить глобальные ID «не в ту сторону» в зависимости от того, чей
+ * поток успел первым.
+ *
+ * Секвенсор делает гарантию явной: у каждого диалога (каноничный ключ пары
+ * пользователей) — собственный атомарный счетчик. Штамп `chat_seq` берется
+ * одним fetch_add; какой бы поток ни обрабатывал сообщение, внутри пары
+ * штампы строго упорядочены. Читатели (получатель, история) сортируют по
+ * кортежу (chat_seq, id).
+ *
+ * Устройство:
+ * - счетчики лежат в hash-карте за QReadWriteLock: горячий путь берет
+ *   разделяемую read-блокировку (только поиск, конкуренции нет), эксклюзивная
+ *   write-блокировка нужна лишь первому сообщению нового диалога;
+ * - сами счетчики — std::atomic за стабильным указателем: рехеш карты их
+ *   не перемещает, инкремент не требует блокировок вовсе;
+ * - начальное значение — время-упорядоченное (как MessageIdGenerator:
+ *   миллисекунды << SequenceBits), поэтому штампы монотонны и через
+ *   перезапуск сервера без какого-либо чтения БД: новое зерно заведомо
+ *   больше всего, что было выдано раньше.
+ */
+class ChatSequencer
+{
+public:
+    /**
+     * @brief Выдает следующий штамп порядка для диалога пары пользователей.
+     * @details Ключ каноничен (имена упорядочены), поэтому обе стороны
+     * переписки попадают в один счетчик.
+     * @return Строго возрастающий в пределах диалога 53-битный штамп.
+     */
+    qint64 next(const QString& userA, const QString& userB);
+
+private:
+    /** @brief Находит счетчик диалога, создавая его для новой пары. */
+    std::atomic<qint64>* counterFor(const QString& key);
+
+    /** @brief Счетчики по каноничному ключу пары "меньший\nбольший". */
+    QHash<QString, std::unique_ptr<std::atomic<qint64>>> m_counters;
+
+    /** @brief Read-блокировка на поиск, write — на вставку новой пары. */
+    mutable QReadWriteLock m_lock;
+};
+
+#endif // CHATSEQUENCER_H
@@ -0,0 +1,127 @@
+//См. "circuitbreaker.h"
+#include "circuitbreaker.h"
+
+#include <QDebug>
+#include <QSqlError>
+
+CircuitBreaker::CircuitBreaker(const QString& name)
+    : m_name(name)
+{
+    m_clock.start();
+}
+
+bool CircuitBreaker::allowRequest()
+{
+    if (m_state != State::Open) return true;
+
+    if (m_clock.elapsed() - m_openedAtMs < m_cooldownMs) {
+        return false; // Пауза не истекла: мгновенный отказ без ресурса
+    }
+
+    // Пауза истекла: один пробный запрос, остальные ждут его исхода
+    if (m_probeInFlight) return false;
+    m_state = State::HalfOpen;
+    m_probeInFlight = true;
+    qInfo() << "[BREAKER]" << m_name << "half-open: letting one probe through";
+    return true;
+}
+
+void CircuitBreaker::beginCall()
+{
+    m_callFailed = false;
+}
+
+void CircuitBreaker::endCall()
+{
+    if (m_callFailed) return;
+
+    // Вызов прошел без зарегистрированных отказов — это успех
+    if (m_state == State::HalfOpen) {
+        qInfo() << "[BREAKER]" << m_name << "closed: probe succeeded";
+        m_state = State::Closed;
+        m_cooldownMs = CooldownMs;
+        m_probeInFlight = false;
+    }
+    m_failures = 0;
+}
+
+void CircuitBreaker::recordFailure(ErrorClass errorClass)
+{
+    m_callFailed = true;
+
+    // Отказ пробного запроса: снова Open с удвоенной паузой
+    if (m_state == State::HalfOpen) {
+        m_probeInFlight = false;
+        trip(qMin(m_cooldownMs * 2, MaxCooldownMs));
+        return;
+    }
+    if (m_state == State::Open) return;
+
+    if (errorClass == ErrorClass::Permanent) {
+        // Диск полон / БД повреждена: ретраи бессмысленны, открываемся
+        // сразу и надолго
+        trip(MaxCooldownMs);
+        return;
+    }
+
+    // Transient/Overload: счет в скользящем окне
+    const qint64 now = m_clock.elapsed();
+    if (now - m_windowStartMs > WindowMs) {
+        m_windowStartMs = now;
+        m_failures = 0;
+    }
+    ++m_failures;
+
+    const int threshold = (errorClass == ErrorClass::Overload)
+                              ? FailureThreshold / 2
+                              : FailureThreshold;
+    if (m_failures >= threshold) {
+        trip(m_cooldownMs);
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::state() const
+{
+    if (m_state == State::Open
+        && m_clock.elapsed() - m_openedAtMs >= m_cooldownMs) {
+        return State::HalfOpen;
+    }
+    return m_state;
+}
+
+qint64 CircuitBreaker::retryAfterMs() const
+{
+    if (m_state != State::Open) return 0;
+    return qMax<qint64>(0, m_cooldownMs - (m_clock.elapsed() - m_openedAtMs));
+}
+
+CircuitBreaker::ErrorClass CircuitBreaker::classifySqlError(const QSqlError& error)
+{
+    // Нативные коды SQLite (https://sqlite.org/rescode.html); расширенные
+    // коды несут базовый в младшем байте
+    const int code = error.nativeErrorCode().toInt() & 0xFF;
+    switch (code) {
+    case 5:  // SQLITE_BUSY
+    case 6:  // SQLITE_LOCKED
+        return ErrorClass::Transient;
+    case 7:  // SQLITE_NOMEM
+    case 8:  // SQLITE_READONLY
+    case 10: // SQLITE_IOERR
+    case 11: // SQLITE_CORRUPT
+    case 13: // SQLITE_FULL
+    case 14: // SQLITE_CANTOPEN
+        return ErrorClass::Permanent;
+    default:
+        return ErrorClass::Transient;
+    }
+}
+
+void CircuitBreaker::trip(qint64 cooldownMs)
+{
+    m_state = State::Open;
+    m_openedAtMs = m_clock.elapsed();
+    m_cooldownMs = cooldownMs;
+    m_failures = 0;
+    qWarning() << "[BREAKER]" << m_name << "open for" << cooldownMs
+               << "ms: shedding non-essential work";
+}
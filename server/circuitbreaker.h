@@ -0,0 +1,117 @@
+#ifndef CIRCUITBREAKER_H
+#define CIRCUITBREAKER_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+class QSqlError;
+
+/**
+ * @class CircuitBreaker
+ * @brief Предохранитель одной подсистемы: быстрый отказ вместо ретраев в стену.
+ *
+ * @details Когда SQLite или запись в сокет начинают стабильно падать,
+ * обработчики раньше логировали ошибку и продолжали — следующий запрос
+ * упирался в тот же отказ и только усиливал нагрузку (переполненный диск
+ * однажды превратился в спираль CPU). Предохранитель разрывает эту петлю:
+ * после серии отказов подсистема переходит в состояние Open, и ее запросы
+ * отклоняются мгновенно, без обращения к больному ресурсу, пока не
+ * истечет пауза охлаждения.
+ *
+ * Классификация ошибки определяет реакцию:
+ *  - Transient (SQLITE_BUSY, залоченная таблица) — считается в скользящем
+ *    окне; предохранитель открывается только по порогу серии.
+ *  - Permanent (диск полон, БД повреждена, read-only) — открывает
+ *    предохранитель немедленно и с длинной паузой: ретраи бессмысленны.
+ *  - Overload (очереди забиты, таймауты) — как Transient, но с половинным
+ *    порогом: при перегрузке сбрасывать работу нужно раньше.
+ *
+ * Классическая машина состояний Closed -> Open -> HalfOpen: по истечении
+ * паузы пропускается один пробный запрос; успех закрывает предохранитель,
+ * отказ снова открывает его с удвоенной паузой (до потолка).
+ *
+ * Предохранители вешаются только на несущественные домены (поиск,
+ * статистика, аватары/профили) — маршрутизация сообщений не шеддится
+ * никогда, ее пропускная способность в деградации и есть защищаемый
+ * ресурс. Живет в основном потоке, синхронизации не требует.
+ */
+class CircuitBreaker
+{
+public:
+    /** @brief Класс отказа: определяет скорость открытия предохранителя. */
+    enum class ErrorClass {
+        Transient, ///< Мимолетный отказ (блокировка, гонка) — ретрай осмыслен
+        Permanent, ///< Ретраи бессмысленны (диск полон, БД повреждена)
+        Overload   ///< Ресурс перегружен — работу нужно сбрасывать раньше
+    };
+
+    /** @brief Состояние машины предохранителя. */
+    enum class State {
+        Closed,   ///< Нормальная работа, отказы считаются в окне
+        Open,     ///< Запросы отклоняются без обращения к ресурсу
+        HalfOpen  ///< Пауза истекла: пропущен один пробный запрос
+    };
+
+    /** @brief Порог отказов в окне, открывающий предохранитель. */
+    static constexpr int FailureThreshold = 5;
+
+    /** @brief Скользящее окно счета отказов, мс. */
+    static constexpr qint64 WindowMs = 10 * 1000;
+
+    /** @brief Начальная пауза охлаждения открытого предохранителя, мс. */
+    static constexpr qint64 CooldownMs = 5 * 1000;
+
+    /** @brief Пауза при Permanent-отказе и потолок удвоения, мс. */
+    static constexpr qint64 MaxCooldownMs = 60 * 1000;
+
+    explicit CircuitBreaker(const QString& name);
+
+    /**
+     * @brief Пропускать ли запрос к подсистеме.
+     * @details Open с неистекшей паузой — мгновенный отказ; истекшая пауза
+     * переводит в HalfOpen и пропускает один пробный запрос.
+     */
+    bool allowRequest();
+
+    /** @brief Начало обслуживаемого вызова (сбрасывает флаг отказа вызова). */
+    void beginCall();
+
+    /**
+     * @brief Конец вызова: если отказ не был зарегистрирован — это успех.
+     * @details Успех в HalfOpen закрывает предохранитель и сбрасывает паузу.
+     */
+    void endCall();
+
+    /** @brief Регистрирует отказ текущего вызова с его классом. */
+    void recordFailure(ErrorClass errorClass);
+
+    /** @brief Текущее состояние (для метрик; Open с истекшей паузой — HalfOpen). */
+    State state() const;
+
+    /** @brief Миллисекунды до пробного запроса; 0 — предохранитель не открыт. */
+    qint64 retryAfterMs() const;
+
+    /**
+     * @brief Классифицирует ошибку SQLite по нативному коду.
+     * @details BUSY/LOCKED — Transient; FULL/IOERR/CORRUPT/READONLY/
+     * CANTOPEN/NOMEM — Permanent; остальное (в т.ч. ошибки запроса) —
+     * Transient: неверный SQL не должен надолго гасить подсистему.
+     */
+    static ErrorClass classifySqlError(const QSqlError& error);
+
+private:
+    /** @brief Переводит в Open и назначает паузу охлаждения. */
+    void trip(qint64 cooldownMs);
+
+    QString m_name;            ///< Имя домена для журнала
+    QElapsedTimer m_clock;     ///< Монотонные часы окна и пауз
+    State m_state = State::Closed;
+    int m_failures = 0;        ///< Отказов в текущем окне
+    qint64 m_windowStartMs = 0;///< Начало скользящего окна
+    qint64 m_openedAtMs = 0;   ///< Момент открытия
+    qint64 m_cooldownMs = CooldownMs; ///< Текущая пауза (растет при рецидивах)
+    bool m_callFailed = false; ///< Отказ зарегистрирован в текущем вызове
+    bool m_probeInFlight = false; ///< Пробный запрос HalfOpen уже выдан
+};
+
+#endif // CIRCUITBREAKER_H
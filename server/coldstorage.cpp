@@ -0,0 +1,289 @@
+/**
+ * @file coldstorage.cpp
+ * @brief Реализация сегментного архива истории.
+ *
+ * @details Формат сегмента: последовательность записей
+ * `[quint32 длина (big-endian)][компактный JSON]`. Формат индекса:
+ * последовательность записей QDataStream `(QString ключ пары, qint64 ID,
+ * qint64 смещение, qint32 длина)` — смещение указывает на тело JSON.
+ * Оба файла append-only: ни одна записанная запись не модифицируется.
+ */
+
+#include <QFile>
+#include <QDir>
+#include <QDataStream>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QtEndian>
+#include <QDebug>
+
+#include <algorithm>
+
+#include "coldstorage.h"
+#include "messageidgenerator.h"
+
+ColdStorage::ColdStorage(QObject *parent)
+    : QObject(parent)
+{
+}
+
+
+ColdStorage::~ColdStorage()
+{
+    for (Segment &segment : m_segments) {
+        if (segment.mapped) {
+            segment.data->unmap(segment.mapped);
+        }
+        delete segment.data;
+        delete segment.index;
+    }
+}
+
+
+QString ColdStorage::keyFor(const QString &userA, const QString &userB)
+{
+    return (userA < userB) ? userA + QLatin1Char('\n') + userB
+                           : userB + QLatin1Char('\n') + userA;
+}
+
+
+QString ColdStorage::bucketForId(qint64 messageId)
+{
+    // Время зашито в старших битах ID (см. MessageIdGenerator).
+    const qint64 ms = (messageId >> MessageIdGenerator::SequenceBits)
+                      + MessageIdGenerator::EpochMs;
+    return QDateTime::fromMSecsSinceEpoch(ms).toString(QStringLiteral("yyyyMM"));
+}
+
+
+bool ColdStorage::open(const QString &directory)
+{
+    QDir dir(directory);
+    if (!dir.exists() && !dir.mkpath(QStringLiteral("."))) {
+        qWarning() << "[ARCHIVE] Failed to create archive directory:" << directory;
+        return false;
+    }
+    m_directory = dir.absolutePath();
+
+    // Поднимаем существующие сегменты и их индексы.
+    const QStringList segments = dir.entryList({QStringLiteral("messages-*.seg")},
+                                               QDir::Files, QDir::Name);
+    for (const QString &name : segments) {
+        QString bucket = name;
+        bucket.remove(QStringLiteral("messages-"));
+        bucket.remove(QStringLiteral(".seg"));
+        segmentFor(bucket); // Открытие + загрузка индекса.
+    }
+
+    // Ссылки каждого диалога должны идти по возрастанию ID — сегменты
+    // загружались помесячно, внутри месяца порядок append-only уже верный.
+    for (auto it = m_chatIndex.begin(); it != m_chatIndex.end(); ++it) {
+        std::sort(it->begin(), it->end(),
+                  [](const ColdRef &a, const ColdRef &b) { return a.id < b.id; });
+    }
+
+    qInfo() << "[ARCHIVE] Cold storage opened:" << m_segments.size()
+            << "segment(s)," << m_archivedCount << "archived message(s),"
+            << m_chatIndex.size() << "conversation(s)";
+    return true;
+}
+
+
+int ColdStorage::segmentFor(const QString &bucket)
+{
+    auto it = m_segmentByBucket.constFind(bucket);
+    if (it != m_segmentByBucket.constEnd()) {
+        return it.value();
+    }
+
+    Segment segment;
+    segment.bucket = bucket;
+    segment.data = new QFile(m_directory + QStringLiteral("/messages-%1.seg").arg(bucket));
+    segment.index = new QFile(m_directory + QStringLiteral("/messages-%1.idx").arg(bucket));
+
+    if (!segment.data->open(QIODevice::ReadWrite | QIODevice::Append)
+        || !segment.index->open(QIODevice::ReadWrite | QIODevice::Append)) {
+        qWarning() << "[ARCHIVE] Failed to open segment" << bucket << ":"
+                   << segment.data->errorString();
+        delete segment.data;
+        delete segment.index;
+        return -1;
+    }
+
+    segment.writeEnd = segment.data->size();
+    remapSegment(segment);
+
+    const int segmentNo = m_segments.size();
+    m_segments.append(segment);
+    m_segmentByBucket.insert(bucket, segmentNo);
+
+    loadIndex(segmentNo);
+    return segmentNo;
+}
+
+
+bool ColdStorage::remapSegment(Segment &segment) const
+{
+    if (segment.mapped) {
+        segment.data->unmap(segment.mapped);
+        segment.mapped = nullptr;
+        segment.mappedSize = 0;
+    }
+
+    const qint64 size = segment.data->size();
+    if (size == 0) {
+        return true; // Пустой сегмент — отображать нечего.
+    }
+
+    segment.mapped = segment.data->map(0, size);
+    if (!segment.mapped) {
+        // mmap не удался (например, исчерпано адресное пространство) —
+        // чтение пойдет медленным путем через seek/read.
+        qWarning() << "[ARCHIVE] mmap failed for segment" << segment.bucket;
+        return false;
+    }
+    segment.mappedSize = size;
+    return true;
+}
+
+
+void ColdStorage::loadIndex(int segmentNo)
+{
+    Segment &segment = m_segments[segmentNo];
+    segment.index->seek(0);
+
+    QDataStream in(segment.index);
+    while (!in.atEnd()) {
+        QString key;
+        ColdRef ref;
+        qint64 offset = 0;
+        in >> key >> ref.id >> offset >> ref.length;
+        if (in.status() != QDataStream::Ok) {
+            // Оборванная запись (падение между data и index) — хвост
+            // индекса отбрасывается, данные без ссылки просто не видны.
+            qWarning() << "[ARCHIVE] Truncated index tail in segment"
+                       << segment.bucket;
+            break;
+        }
+        ref.segment = segmentNo;
+        ref.offset = offset;
+        m_chatIndex[key].append(ref);
+        ++m_archivedCount;
+    }
+
+    segment.index->seek(segment.index->size()); // Возврат в режим дозаписи.
+}
+
+
+bool ColdStorage::appendMessage(const QString &userA, const QString &userB,
+                                const QJsonObject &message)
+{
+    const qint64 messageId = static_cast<qint64>(message["id"].toDouble());
+    if (messageId <= 0) {
+        return false;
+    }
+
+    const int segmentNo = segmentFor(bucketForId(messageId));
+    if (segmentNo < 0) {
+        return false;
+    }
+    Segment &segment = m_segments[segmentNo];
+
+    const QByteArray body = QJsonDocument(message).toJson(QJsonDocument::Compact);
+
+    // Тело записи: [длина][JSON]. Смещение в индексе указывает на JSON.
+    char prefix[sizeof(quint32)];
+    qToBigEndian<quint32>(quint32(body.size()), prefix);
+
+    // Смещение считается по собственному счетчику записи: QFile::size()
+    // может не учитывать данные, еще лежащие в буфере QIODevice.
+    const qint64 bodyOffset = segment.writeEnd + qint64(sizeof(prefix));
+    if (segment.data->write(prefix, sizeof(prefix)) != sizeof(prefix)
+        || segment.data->write(body) != body.size()) {
+        qWarning() << "[ARCHIVE] Failed to append to segment" << segment.bucket
+                   << ":" << segment.data->errorString();
+        return false;
+    }
+    segment.writeEnd = bodyOffset + body.size();
+    segment.data->flush();
+
+    // Ссылка публикуется после данных: упавший между записями процесс
+    // оставит в сегменте невидимый хвост, но не битую ссылку.
+    const QString key = keyFor(userA, userB);
+    QDataStream out(segment.index);
+    out << key << messageId << bodyOffset << qint32(body.size());
+    segment.index->flush();
+
+    ColdRef ref;
+    ref.id = messageId;
+    ref.segment = segmentNo;
+    ref.offset = bodyOffset;
+    ref.length = body.size();
+
+    // Переносятся самые старые сообщения — почти всегда ссылка встает в
+    // конец; на всякий случай поддерживаем инвариант сортировки явно.
+    QVector<ColdRef> &refs = m_chatIndex[key];
+    if (!refs.isEmpty() && refs.last().id > messageId) {
+        auto pos = std::lower_bound(refs.begin(), refs.end(), messageId,
+            [](const ColdRef &r, qint64 id) { return r.id < id; });
+        refs.insert(pos, ref);
+    } else {
+        refs.append(ref);
+    }
+
+    ++m_archivedCount;
+    return true;
+}
+
+
+QJsonArray ColdStorage::readOlder(const QString &userA, const QString &userB,
+                                  qint64 beforeId, int limit) const
+{
+    QJsonArray page;
+
+    auto chat = m_chatIndex.constFind(keyFor(userA, userB));
+    if (chat == m_chatIndex.constEnd() || limit <= 0) {
+        return page;
+    }
+    const QVector<ColdRef> &refs = chat.value();
+
+    // Верхняя граница окна: первая ссылка с id >= beforeId (0 — весь хвост).
+    int end = refs.size();
+    if (beforeId > 0) {
+        end = int(std::lower_bound(refs.begin(), refs.end(), beforeId,
+                      [](const ColdRef &r, qint64 id) { return r.id < id; })
+                  - refs.begin());
+    }
+    const int start = qMax(0, end - limit);
+
+    for (int i = start; i < end; ++i) {
+        const ColdRef &ref = refs.at(i);
+        const Segment &segment = m_segments.at(ref.segment);
+
+        QByteArray body;
+        if (segment.mapped && ref.offset + ref.length <= segment.mappedSize) {
+            // Быстрый путь: байты берутся прямо из отображенной памяти.
+            body = QByteArray::fromRawData(
+                reinterpret_cast<const char*>(segment.mapped) + ref.offset,
+                ref.length);
+        } else {
+            // Запись дозаписана после mmap или mmap не удался — seek/read.
+            if (!segment.data->seek(ref.offset)) continue;
+            body = segment.data->read(ref.length);
+            segment.data->seek(segment.data->size());
+        }
+
+        const QJsonDocument doc = QJsonDocument::fromJson(body);
+        if (doc.isObject()) {
+            page.append(doc.object());
+        }
+    }
+
+    return page;
+}
+
+
+bool ColdStorage::hasChat(const QString &userA, const QString &userB) const
+{
+    return m_chatIndex.contains(keyFor(userA, userB));
+}
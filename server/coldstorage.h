@@ -0,0 +1,121 @@
+#ifndef COLDSTORAGE_H
+#define COLDSTORAGE_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QJsonObject>
+#include <QJsonArray>
+
+class QFile;
+
+/**
+ * @class ColdStorage
+ * @brief Холодный ярус истории: append-only сегменты с mmap-чтением.
+ *
+ * @details Таблица messages растет безгранично, при этом подавляющая часть
+ * строк никогда не читается — но продолжает раздувать каждый индекс, который
+ * трогает handleGetHistory, и замедлять VACUUM и резервное копирование.
+ * Холодный ярус выносит давно неактивные диалоги из SQLite в сегментные
+ * файлы, оставляя БД маленькой и горячей:
+ *
+ * - сегмент — append-only файл одного календарного месяца
+ *   (`archive/messages-YYYYMM.seg`); запись — компактный JSON строки
+ *   истории с префиксом длины, формат совпадает с history_data;
+ * - рядом с сегментом ведется индексный файл `.idx`: пара диалога -> (ID,
+ *   смещение, длина). При старте индексы загружаются в память — на диалог
+ *   получается плотный отсортированный по ID вектор ссылок;
+ * - чтение идет через QFile::map(): страница истории из архива — это
+ *   бинарный поиск по вектору ссылок и копирование готовых байтов из
+ *   отображенной памяти, без SQL и без парсинга всего сегмента.
+ *
+ * Перенос выполняет Server::archiveIdleConversations() (ночной проход);
+ * handleGetHistory прозрачно подклеивает архивные строки к странице
+ * пагинации, когда пользователь долистывает до выгруженной глубины.
+ *
+ * @note Запись и чтение — только из основного потока сервера.
+ */
+class ColdStorage : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ColdStorage(QObject *parent = nullptr);
+    ~ColdStorage() override;
+
+    /**
+     * @brief Открывает каталог архива и загружает индексы сегментов.
+     * @param directory Каталог сегментных файлов (создается при отсутствии).
+     * @return `false`, если каталог недоступен для записи.
+     */
+    bool open(const QString &directory);
+
+    /**
+     * @brief Дописывает одну строку истории в сегмент ее месяца.
+     * @details Сегмент выбирается по времени, зашитому в ID сообщения.
+     * Запись уходит в файл и в индекс (память + .idx) атомарно для читателей:
+     * ссылка публикуется только после успешной записи данных.
+     * @param message Строка истории в форме history_data (есть поле "id").
+     * @return `true`, если запись и индекс зафиксированы.
+     */
+    bool appendMessage(const QString &userA, const QString &userB,
+                       const QJsonObject &message);
+
+    /**
+     * @brief Читает страницу архивной истории диалога.
+     * @param beforeId Верхняя граница (исключительно); 0 — с самого конца.
+     * @param limit Максимум строк.
+     * @return Строки в порядке возрастания ID (как страница history_data).
+     */
+    QJsonArray readOlder(const QString &userA, const QString &userB,
+                         qint64 beforeId, int limit) const;
+
+    /** @brief Есть ли у диалога архивные строки (дешевая проверка). */
+    bool hasChat(const QString &userA, const QString &userB) const;
+
+    /** @brief Всего строк в архиве (для метрик). */
+    qint64 archivedCount() const { return m_archivedCount; }
+
+private:
+    /** @brief Ссылка на одну запись сегмента. */
+    struct ColdRef {
+        qint64 id = 0;        ///< ID сообщения (ключ сортировки и пагинации).
+        int segment = -1;     ///< Индекс сегмента в m_segments.
+        qint64 offset = 0;    ///< Смещение тела записи в сегменте.
+        qint32 length = 0;    ///< Длина тела записи (JSON, без префикса).
+    };
+
+    /** @brief Открытый сегментный файл с отображением в память. */
+    struct Segment {
+        QString bucket;            ///< Метка месяца "YYYYMM".
+        QFile *data = nullptr;     ///< Файл данных (открыт на дозапись).
+        QFile *index = nullptr;    ///< Файл индекса (открыт на дозапись).
+        uchar *mapped = nullptr;   ///< Отображение данных (QFile::map).
+        qint64 mappedSize = 0;     ///< Размер отображенной области.
+        qint64 writeEnd = 0;       ///< Конец данных с учетом буфера записи.
+    };
+
+    /** @brief Каноничный ключ пары (меньшее имя первым). */
+    static QString keyFor(const QString &userA, const QString &userB);
+
+    /** @brief Метка месяца по времени, зашитому в ID сообщения. */
+    static QString bucketForId(qint64 messageId);
+
+    /** @brief Находит или создает сегмент месяца. */
+    int segmentFor(const QString &bucket);
+
+    /** @brief Обновляет отображение сегмента после дозаписи. */
+    bool remapSegment(Segment &segment) const;
+
+    /** @brief Загружает .idx одного сегмента в индекс памяти. */
+    void loadIndex(int segmentNo);
+
+    QString m_directory;                        ///< Каталог архива.
+    QVector<Segment> m_segments;                ///< Открытые сегменты.
+    QHash<QString, int> m_segmentByBucket;      ///< Метка месяца -> сегмент.
+    QHash<QString, QVector<ColdRef>> m_chatIndex; ///< Пара -> ссылки (ID asc).
+    qint64 m_archivedCount = 0;                 ///< Всего записей в архиве.
+};
+
+#endif // COLDSTORAGE_H
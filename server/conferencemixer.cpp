@@ -0,0 +1,360 @@
+#include "conferencemixer.h"
+#include "threadcheck.h"
+
+#include <QUdpSocket>
+#include <QTimer>
+#include <QThread>
+#include <QDebug>
+#include <QtEndian>
+#include <algorithm>
+#include <opus.h>
+
+//См. "conferencemixer.h"
+
+namespace {
+/// Тип полезной нагрузки аудиокадра в клиентском заголовке
+constexpr quint8 PayloadAudio = 0;
+
+/// Порог DTX: пакеты Opus в 2 байта и короче — маркеры тишины,
+/// декодировать и миксовать их смысла нет
+constexpr int DtxMaxBytes = 2;
+
+/// Сэмплов 48-кГц часов в 20-мс кадре (метка исходящего микса)
+constexpr int TimestampPerFrame = 960;
+}
+
+ConferenceWorker::ConferenceWorker(const QString& conferenceId, QObject* parent)
+    : QObject(parent),
+      m_conferenceId(conferenceId)
+{
+}
+
+ConferenceWorker::~ConferenceWorker()
+{
+    for (Participant* p : m_participants) {
+        if (p->decoder) opus_decoder_destroy(p->decoder);
+        if (p->encoder) opus_encoder_destroy(p->encoder);
+        delete p;
+    }
+}
+
+void ConferenceWorker::initialize()
+{
+    // Сокет и таймер создаются здесь, на потоке комнаты: они
+    // принадлежат потоку, который их обслуживает
+    m_socket = new QUdpSocket(this);
+    if (!m_socket->bind(QHostAddress::Any, 0)) {
+        qWarning() << "[CONF]" << m_conferenceId
+                   << "failed to bind UDP socket:" << m_socket->errorString();
+        return;
+    }
+    connect(m_socket, &QUdpSocket::readyRead, this, &ConferenceWorker::onReadyRead);
+
+    m_mixTimer = new QTimer(this);
+    m_mixTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_mixTimer, &QTimer::timeout, this, &ConferenceWorker::onMixTick);
+    m_mixTimer->start(20);
+
+    qInfo() << "[CONF] Room" << m_conferenceId << "mixing on UDP port"
+            << m_socket->localPort();
+    emit socketBound(m_socket->localPort());
+}
+
+void ConferenceWorker::addParticipant(const QString& username)
+{
+    if (m_participants.contains(username)) {
+        return;
+    }
+
+    auto* p = new Participant();
+    p->username = username;
+
+    int error = OPUS_OK;
+    p->decoder = opus_decoder_create(MixRate, 1, &error);
+    if (error != OPUS_OK) {
+        qWarning() << "[CONF] opus_decoder_create failed for" << username;
+    }
+    p->encoder = opus_encoder_create(MixRate, 1, OPUS_APPLICATION_VOIP, &error);
+    if (error != OPUS_OK) {
+        qWarning() << "[CONF] opus_encoder_create failed for" << username;
+    }
+    if (p->encoder) {
+        // Тот же профиль устойчивости, что и у клиентского энкодера
+        opus_encoder_ctl(p->encoder, OPUS_SET_INBAND_FEC(1));
+        opus_encoder_ctl(p->encoder, OPUS_SET_DTX(1));
+    }
+
+    m_participants.insert(username, p);
+    qDebug() << "[CONF]" << m_conferenceId << "participant added:" << username
+             << "(" << m_participants.size() << "total )";
+}
+
+void ConferenceWorker::removeParticipant(const QString& username)
+{
+    Participant* p = m_participants.take(username);
+    if (!p) {
+        return;
+    }
+    if (p->bound) {
+        m_byAddress.remove(qMakePair(p->address, p->port));
+    }
+    if (p->decoder) opus_decoder_destroy(p->decoder);
+    if (p->encoder) opus_encoder_destroy(p->encoder);
+    delete p;
+
+    qDebug() << "[CONF]" << m_conferenceId << "participant left:" << username;
+    if (m_participants.isEmpty()) {
+        emit becameEmpty();
+    }
+}
+
+void ConferenceWorker::onReadyRead()
+{
+    THREAD_AFFINITY_ASSERT(this);
+
+    // Пакетный drain, как в CallRelay: одна активация нотификатора
+    // вычитывает все накопленное, прием — в преаллоцированный буфер
+    while (m_socket->hasPendingDatagrams()) {
+        QHostAddress sender;
+        quint16 senderPort = 0;
+        const qint64 len = m_socket->readDatagram(m_recvBuffer.data(),
+                                                  qint64(m_recvBuffer.size()),
+                                                  &sender, &senderPort);
+        if (len <= 0) {
+            continue;
+        }
+
+        // Датаграмма-приветствие: привязка адреса участника по имени
+        if (quint8(m_recvBuffer[0]) == HelloMagic) {
+            const QString username = QString::fromUtf8(m_recvBuffer.data() + 1,
+                                                       int(len) - 1);
+            Participant* p = m_participants.value(username);
+            if (!p) {
+                continue; // Незваный гость — игнорируем
+            }
+            if (p->bound) {
+                m_byAddress.remove(qMakePair(p->address, p->port));
+            }
+            p->address = sender;
+            p->port = senderPort;
+            p->bound = true;
+            m_byAddress.insert(qMakePair(sender, senderPort), p);
+            continue;
+        }
+
+        // Аудио: источник ищется одним lookup'ом по адресу
+        Participant* p = m_byAddress.value(qMakePair(sender, senderPort));
+        if (!p || len <= HeaderBytes || len > MaxPacketBytes) {
+            continue;
+        }
+        if (quint8(m_recvBuffer[0]) != PayloadAudio) {
+            continue; // Служебные пакеты p2p-протокола комнате не нужны
+        }
+
+        // Последний пакет до такта побеждает: джиттер-буфер глубины 1
+        ++m_stats.packetsIn;
+        p->pendingLen = int(len) - HeaderBytes;
+        std::copy(m_recvBuffer.data() + HeaderBytes,
+                  m_recvBuffer.data() + len,
+                  p->pending.data());
+    }
+}
+
+void ConferenceWorker::onMixTick()
+{
+    THREAD_AFFINITY_ASSERT(this);
+
+    // 1. Декод активных источников. Молчащие (нет пакета или DTX-маркер)
+    // пропускаются целиком — ни декода, ни вклада в сумму
+    int activeCount = 0;
+    std::fill(m_mixSum.begin(), m_mixSum.end(), 0);
+
+    for (Participant* p : m_participants) {
+        p->active = false;
+        const int len = p->pendingLen;
+        p->pendingLen = 0;
+        if (len <= DtxMaxBytes || !p->decoder) {
+            continue;
+        }
+        const int samples = opus_decode(p->decoder, p->pending.data(), len,
+                                        p->frame.data(), FrameSamples, 0);
+        if (samples != FrameSamples) {
+            continue;
+        }
+        p->active = true;
+        ++activeCount;
+
+        // Вклад источника в общую сумму с его усилением; цикл по
+        // непрерывным массивам, векторизуется компилятором
+        const float gain = p->gain;
+        int* sum = m_mixSum.data();
+        const short* src = p->frame.data();
+        for (int i = 0; i < FrameSamples; ++i) {
+            sum[i] += int(float(src[i]) * gain);
+        }
+    }
+
+    // Посекундная публикация счетчиков для опроса метрик с главного потока
+    if (--m_statsCountdown <= 0) {
+        m_statsCountdown = StatsIntervalTicks;
+        m_statsSnapshot.publish(m_stats);
+    }
+
+    if (activeCount == 0) {
+        return; // Вся комната молчит — такт бесплатный
+    }
+    ++m_stats.framesMixed;
+
+    // 2. Раздача миксов: каждому уходит сумма минус его собственный
+    // вклад. Участнику, для которого не говорил никто другой, не
+    // кодируется и не шлется ничего — его клиентский PLC/DTX закроет паузу
+    for (Participant* p : m_participants) {
+        if (!p->bound) {
+            continue;
+        }
+        if (activeCount == 1 && p->active) {
+            continue; // Говорил только он сам — его микс пуст
+        }
+
+        const int* sum = m_mixSum.data();
+        short* out = m_mixOut.data();
+        if (p->active) {
+            const float gain = p->gain;
+            const short* own = p->frame.data();
+            for (int i = 0; i < FrameSamples; ++i) {
+                const int s = sum[i] - int(float(own[i]) * gain);
+                out[i] = short(qBound(-32768, s, 32767));
+            }
+        } else {
+            for (int i = 0; i < FrameSamples; ++i) {
+                out[i] = short(qBound(-32768, sum[i], 32767));
+            }
+        }
+
+        sendMixTo(p, out);
+    }
+}
+
+void ConferenceWorker::sendMixTo(Participant* p, const short* pcm)
+{
+    if (!p->encoder) {
+        return;
+    }
+
+    // Кодируем сразу в буфер отправки, после заголовка
+    const int opusLen = opus_encode(p->encoder, pcm, FrameSamples,
+                                    m_txPacket.data() + HeaderBytes,
+                                    int(m_txPacket.size()) - HeaderBytes);
+    if (opusLen <= 0) {
+        return;
+    }
+
+    // Тот же 9-байтовый заголовок, что пишет клиентский AudioEngine
+    m_txPacket[0] = PayloadAudio;
+    qToBigEndian(p->txSeq, m_txPacket.data() + 1);
+    qToBigEndian(p->txTimestamp, m_txPacket.data() + 5);
+    ++p->txSeq;
+    p->txTimestamp += TimestampPerFrame;
+
+    m_socket->writeDatagram(reinterpret_cast<const char*>(m_txPacket.data()),
+                            HeaderBytes + opusLen, p->address, p->port);
+    ++m_stats.packetsOut;
+}
+
+
+ConferenceMixer::ConferenceMixer(QObject* parent)
+    : QObject(parent)
+{
+}
+
+ConferenceMixer::~ConferenceMixer()
+{
+    const QStringList ids = m_rooms.keys();
+    for (const QString& id : ids) {
+        closeConference(id);
+    }
+}
+
+ConferenceWorker::MixStats ConferenceMixer::totalStats() const
+{
+    ConferenceWorker::MixStats total;
+    for (const Room& room : m_rooms) {
+        const ConferenceWorker::MixStats stats = room.worker->readStats();
+        total.packetsIn += stats.packetsIn;
+        total.framesMixed += stats.framesMixed;
+        total.packetsOut += stats.packetsOut;
+    }
+    return total;
+}
+
+void ConferenceMixer::createConference(const QString& conferenceId)
+{
+    if (m_rooms.contains(conferenceId)) {
+        return;
+    }
+
+    Room room;
+    room.thread = new QThread(this);
+    room.thread->setObjectName("conf-mix-" + conferenceId.left(8));
+    room.worker = new ConferenceWorker(conferenceId);
+    room.worker->moveToThread(room.thread);
+
+    // bind — уже на потоке комнаты; порт возвращается сигналом
+    connect(room.thread, &QThread::started,
+            room.worker, &ConferenceWorker::initialize);
+    connect(room.worker, &ConferenceWorker::socketBound, this,
+            [this, conferenceId](quint16 port) {
+        auto it = m_rooms.find(conferenceId);
+        if (it != m_rooms.end()) {
+            it->port = port;
+            emit conferenceReady(conferenceId, port);
+        }
+    });
+    connect(room.worker, &ConferenceWorker::becameEmpty, this,
+            [this, conferenceId]() {
+        closeConference(conferenceId);
+    });
+
+    m_rooms.insert(conferenceId, room);
+    room.thread->start();
+    qInfo() << "[CONF] Conference created:" << conferenceId;
+}
+
+void ConferenceMixer::addParticipant(const QString& conferenceId, const QString& username)
+{
+    auto it = m_rooms.constFind(conferenceId);
+    if (it == m_rooms.constEnd()) {
+        return;
+    }
+    QMetaObject::invokeMethod(it->worker, "addParticipant", Qt::QueuedConnection,
+                              Q_ARG(QString, username));
+}
+
+void ConferenceMixer::removeParticipant(const QString& conferenceId, const QString& username)
+{
+    auto it = m_rooms.constFind(conferenceId);
+    if (it == m_rooms.constEnd()) {
+        return;
+    }
+    QMetaObject::invokeMethod(it->worker, "removeParticipant", Qt::QueuedConnection,
+                              Q_ARG(QString, username));
+}
+
+void ConferenceMixer::closeConference(const QString& conferenceId)
+{
+    Room room = m_rooms.take(conferenceId);
+    if (!room.worker) {
+        return;
+    }
+    room.thread->quit();
+    room.thread->wait();
+    delete room.worker;
+    room.thread->deleteLater();
+    qInfo() << "[CONF] Conference closed:" << conferenceId;
+}
+
+quint16 ConferenceMixer::portOf(const QString& conferenceId) const
+{
+    auto it = m_rooms.constFind(conferenceId);
+    return (it != m_rooms.constEnd()) ? it->port : 0;
+}
@@ -0,0 +1,234 @@
+#ifndef CONFERENCEMIXER_H
+#define CONFERENCEMIXER_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QHostAddress>
+#include <array>
+
+#include "statssnapshot.h"
+
+class QUdpSocket;
+class QTimer;
+class QThread;
+
+struct OpusDecoder;
+struct OpusEncoder;
+
+/**
+ * @brief Рабочий объект одной конференции: декод, микс, кодирование.
+ *
+ * @details Живет на выделенном потоке "conf-mix-<id>" вместе со своим
+ * UDP-сокетом и 20-мс тактовым таймером — комнаты не конкурируют друг
+ * с другом за один поток, и затык в одной не слышен в остальных (та же
+ * схема владения, что у клиентского AudioEngine).
+ *
+ * Протокол привязки участника — как у CallRelay: клиент шлет на порт
+ * комнаты датаграмму-приветствие `[HelloMagic:1][username utf8]` и
+ * повторяет ее, пока не пойдет звук в обратную сторону. Аудиопакеты —
+ * тот же 9-байтовый заголовок, что и в p2p-звонках (тип, seq, метка).
+ *
+ * Такт микса:
+ *  - пришедший с последнего такта пакет каждого источника декодируется
+ *    в его кадровый слот; источники без пакета или с DTX-пакетом Opus
+ *    (<= 2 байта) считаются молчащими и в декод/микс не попадают;
+ *  - общая сумма активных источников считается один раз, далее каждому
+ *    участнику уходит "сумма минус его собственный вклад" (он себя не
+ *    слышит) — N-1 миксов за O(N) проходов, а не O(N^2);
+ *  - участникам, для которых в этом такте никто не говорил, не
+ *    кодируется и не шлется ничего — в типичной комнате из 5 человек
+ *    говорит один, и энкодеры молчащих направлений простаивают.
+ *
+ * Циклы микса — простые суммирования по непрерывным массивам int;
+ * компилятор их векторизует, модульной адресации на горячем пути нет.
+ */
+class ConferenceWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** @brief Первый байт датаграммы-приветствия участника. */
+    static constexpr quint8 HelloMagic = 0xCB;
+
+    /** @brief Частота микса: fullband, как у RTP-часов клиента. */
+    static constexpr int MixRate = 48000;
+
+    /** @brief Сэмплов в 20-мс кадре микса. */
+    static constexpr int FrameSamples = 960;
+
+    /** @brief Размер RTP-подобного заголовка клиента, байт. */
+    static constexpr int HeaderBytes = 9;
+
+    /** @brief Максимальный размер аудиодатаграммы (MTU с запасом). */
+    static constexpr int MaxPacketBytes = 1500;
+
+    /** @brief Тактов микса между публикациями снимка счетчиков (1 с). */
+    static constexpr int StatsIntervalTicks = 50;
+
+    explicit ConferenceWorker(const QString& conferenceId, QObject* parent = nullptr);
+    ~ConferenceWorker() override;
+
+    /**
+     * @brief Счетчики комнаты: ведутся на потоке комнаты, публикуются
+     * снимком раз в секунду (50 тактов микса).
+     */
+    struct MixStats {
+        qint64 packetsIn = 0;    ///< Принятых аудиопакетов источников
+        qint64 framesMixed = 0;  ///< Тактов с хотя бы одним активным источником
+        qint64 packetsOut = 0;   ///< Отправленных кадров микса
+    };
+
+    /**
+     * @brief Последний снимок счетчиков комнаты. Любой поток.
+     *
+     * Главный поток сервера (gauge-метрики /metrics) читает его без
+     * блокировок и без вмешательства в 20-мс такт микса.
+     */
+    MixStats readStats() const { return m_statsSnapshot.read(); }
+
+public slots:
+    /** @brief На потоке комнаты: bind UDP-сокета, запуск 20-мс такта. */
+    void initialize();
+
+    /**
+     * @brief Регистрирует участника (кодеки создаются сразу, адрес —
+     *        по его датаграмме-приветствию).
+     * @param username Имя участника
+     */
+    void addParticipant(const QString& username);
+
+    /** @brief Убирает участника и освобождает его кодеки. */
+    void removeParticipant(const QString& username);
+
+signals:
+    /** @brief UDP-порт комнаты привязан. @param port Назначенный порт */
+    void socketBound(quint16 port);
+
+    /** @brief Последний участник вышел — комнату можно закрывать. */
+    void becameEmpty();
+
+private slots:
+    /** @brief Пакетный drain сокета: приветствия и аудио источников. */
+    void onReadyRead();
+
+    /** @brief 20-мс такт: декод активных, микс, кодирование, отправка. */
+    void onMixTick();
+
+private:
+    /** @brief Состояние одного участника комнаты. */
+    struct Participant {
+        QString username;
+        QHostAddress address;          ///< Внешний адрес (после hello)
+        quint16 port = 0;
+        bool bound = false;            ///< Адрес зарегистрирован
+
+        OpusDecoder* decoder = nullptr; ///< Его поток -> PCM 48 кГц
+        OpusEncoder* encoder = nullptr; ///< Его микс -> Opus
+
+        float gain = 1.0f;             ///< Усиление источника в миксе
+
+        // Последний пришедший пакет источника: перезапись до такта
+        // эквивалентна джиттер-буферу глубины 1 — для серверного микса
+        // этого достаточно, клиентский буфер сгладит остальное
+        std::array<unsigned char, MaxPacketBytes> pending;
+        int pendingLen = 0;            ///< 0 — пакета с прошлого такта не было
+
+        std::array<short, FrameSamples> frame; ///< Декодированный кадр
+        bool active = false;           ///< Говорил в текущем такте
+
+        quint32 txSeq = 0;             ///< seq исходящего микса
+        quint32 txTimestamp = 0;       ///< Метка исходящего микса
+    };
+
+    using AddressKey = QPair<QHostAddress, quint16>;
+
+    /** @brief Кодирует и шлет кадр микса одному участнику. */
+    void sendMixTo(Participant* p, const short* pcm);
+
+    QString m_conferenceId;
+    QUdpSocket* m_socket = nullptr;
+    QTimer* m_mixTimer = nullptr;
+
+    QHash<QString, Participant*> m_participants;  ///< По имени
+    QHash<AddressKey, Participant*> m_byAddress;  ///< Горячий индекс приема
+
+    std::array<char, 65536> m_recvBuffer;         ///< Приемный буфер
+    std::array<int, FrameSamples> m_mixSum;       ///< Сумма активных источников
+    std::array<short, FrameSamples> m_mixOut;     ///< Кадр на кодирование
+    std::array<unsigned char, MaxPacketBytes> m_txPacket; ///< Пакет на отправку
+
+    MixStats m_stats;                             ///< Счетчики потока комнаты
+    int m_statsCountdown = StatsIntervalTicks;    ///< Тактов до публикации снимка
+    StatsSnapshot<MixStats> m_statsSnapshot;      ///< Снимок для других потоков
+};
+
+/**
+ * @brief Серверный микшер групповых звонков (фасад на главном потоке).
+ *
+ * @details Полносвязный p2p для групп не живет: каждый участник лил бы
+ * N-1 восходящих потоков. Здесь сервер принимает по одному потоку от
+ * каждого и возвращает каждому один готовый микс остальных — restов
+ * полоса участника не зависит от размера комнаты.
+ *
+ * Фасад создает по комнате рабочий поток с ConferenceWorker, хранит
+ * назначенные порты и транслирует команды очередными вызовами —
+ * главный поток сервера сокетов комнат не касается. Порт комнаты
+ * становится известен асинхронно (bind на потоке комнаты), поэтому
+ * сигналинг приглашений строится от сигнала conferenceReady.
+ */
+class ConferenceMixer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConferenceMixer(QObject* parent = nullptr);
+    ~ConferenceMixer() override;
+
+    /** @brief Создает комнату и ее поток; порт придет в conferenceReady. */
+    void createConference(const QString& conferenceId);
+
+    /** @brief Регистрирует участника комнаты (очередной вызов воркеру). */
+    void addParticipant(const QString& conferenceId, const QString& username);
+
+    /** @brief Убирает участника; пустая комната закрывается сама. */
+    void removeParticipant(const QString& conferenceId, const QString& username);
+
+    /** @brief Останавливает поток комнаты и освобождает воркера. */
+    void closeConference(const QString& conferenceId);
+
+    /** @brief Порт комнаты или 0, если комнаты нет/порт еще не привязан. */
+    quint16 portOf(const QString& conferenceId) const;
+
+    /** @brief Активных комнат (для метрик). */
+    int activeConferences() const { return m_rooms.size(); }
+
+    /**
+     * @brief Суммарные счетчики живых комнат (для метрик).
+     *
+     * Снимки воркеров читаются без блокировок (StatsSnapshot); такт
+     * микса опрос не замечает. Счетчики закрытых комнат исчезают вместе
+     * с ними — метрика отражает текущую нагрузку микшера.
+     */
+    ConferenceWorker::MixStats totalStats() const;
+
+signals:
+    /**
+     * @brief Комната готова принимать участников.
+     * @param conferenceId Идентификатор комнаты
+     * @param udpPort Привязанный UDP-порт микса
+     */
+    void conferenceReady(const QString& conferenceId, quint16 udpPort);
+
+private:
+    /** @brief Комната: воркер и его поток. */
+    struct Room {
+        ConferenceWorker* worker = nullptr;
+        QThread* thread = nullptr;
+        quint16 port = 0;
+    };
+
+    QHash<QString, Room> m_rooms;
+};
+
+#endif // CONFERENCEMIXER_H
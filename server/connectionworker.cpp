@@ -0,0 +1,549 @@
+/**
+ * @file connectionworker.cpp
+ * @brief Обслуживание TCP-соединений в пуле рабочих потоков.
+ *
+ * @details Реализация WorkerTcpServer и ConnectionWorker. Логика фрейминга и
+ * шифрования повторяет однопоточный путь Server::onTcpReadyRead / Server::sendJson,
+ * но выполняется в рабочем потоке, к которому жестко привязан сокет.
+ */
+
+#include <QTcpSocket>
+#include "sockettuning.h"
+#include <QThread>
+#include <QDataStream>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "connectionworker.h"
+#include "binarycodec.h"
+#include "filetransfer.h"
+#include "framebuffer.h"
+
+void WorkerTcpServer::incomingConnection(qintptr socketDescriptor)
+{
+    if (m_poolMode) {
+        if (!m_poolWorkers.isEmpty()) {
+            // Шардированный режим: дескриптор уходит воркеру напрямую из
+            // потока листенера, основной цикл событий не участвует.
+            ConnectionWorker *worker = m_poolWorkers.at(m_nextWorker);
+            m_nextWorker = (m_nextWorker + 1) % m_poolWorkers.size();
+            QMetaObject::invokeMethod(worker, "addConnection", Qt::QueuedConnection,
+                                      Q_ARG(qintptr, socketDescriptor));
+            return;
+        }
+        // Режим пула: сокет будет создан в рабочем потоке из дескриптора.
+        emit connectionReady(socketDescriptor);
+    } else {
+        // Классический режим: создаем сокет со встроенным парсером кадров
+        // и отдаем его в очередь nextPendingConnection().
+        auto *socket = new FramedTcpSocket(this);
+        if (!socket->setSocketDescriptor(socketDescriptor)) {
+            qWarning() << "[SERVER] Failed to adopt socket descriptor:" << socket->errorString();
+            socket->deleteLater();
+            return;
+        }
+        addPendingConnection(socket);
+    }
+}
+
+
+void WorkerTcpServer::setWorkerPool(const QList<ConnectionWorker*> &workers, int firstWorker)
+{
+    m_poolWorkers = workers;
+    m_nextWorker = workers.isEmpty() ? 0 : qBound(0, firstWorker, workers.size() - 1);
+}
+
+
+bool WorkerTcpServer::listenReusePort(const QHostAddress &address, quint16 port)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    // setSocketDescriptor() требует уже слушающий сокет, поэтому создание,
+    // опции и bind/listen выполняются на нативном дескрипторе вручную
+    const bool ipv4 = address.protocol() == QAbstractSocket::IPv4Protocol;
+    const int fd = ::socket(ipv4 ? AF_INET : AF_INET6, SOCK_STREAM, 0);
+    if (fd < 0) {
+        qWarning() << "[SERVER] listenReusePort: socket() failed:" << strerror(errno);
+        return false;
+    }
+
+    const int one = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+        || ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+        qWarning() << "[SERVER] listenReusePort: setsockopt failed:" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    int bindResult;
+    if (ipv4) {
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(address.toIPv4Address());
+        bindResult = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    } else {
+        // Any слушаем dual-stack (v6 + v4-mapped) — как обычный QTcpServer
+        const int off = 0;
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+        sockaddr_in6 addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(port);
+        const Q_IPV6ADDR ip6 = address.toIPv6Address();
+        std::memcpy(&addr.sin6_addr, &ip6, sizeof(ip6));
+        bindResult = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+
+    if (bindResult != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        qWarning() << "[SERVER] listenReusePort: bind/listen failed on port"
+                   << port << ":" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    if (!setSocketDescriptor(fd)) {
+        qWarning() << "[SERVER] listenReusePort: setSocketDescriptor failed:"
+                   << errorString();
+        ::close(fd);
+        return false;
+    }
+
+    return true;
+#else
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+    // Платформа без SO_REUSEPORT — вызывающая сторона откатится на один листенер
+    return false;
+#endif
+}
+
+
+ConnectionWorker::ConnectionWorker(QObject *parent) : QObject(parent)
+{
+}
+
+
+ConnectionWorker::~ConnectionWorker()
+{
+    // Состояние соединений живет в самих сокетах — дочерних объектах
+    // воркера, Qt уничтожит их вместе с ним.
+    m_connections.clear();
+}
+
+
+void ConnectionWorker::addConnection(qintptr socketDescriptor)
+{
+    // Создаем сокет в ЭТОМ потоке — обязательное требование Qt для работы
+    // с QTcpSocket из рабочего потока. Парсер кадров встроен в сам сокет.
+    auto *socket = new FramedTcpSocket(this);
+
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning() << "[WORKER] Failed to adopt socket descriptor:" << socket->errorString();
+        socket->deleteLater();
+        return;
+    }
+
+    qInfo() << "[WORKER] New TCP client connected from:" << socket->peerAddress().toString()
+            << "(thread:" << QThread::currentThread() << ")";
+
+    // Тот же транспортный профиль, что и в однопоточном пути приема
+    SocketTuning::tuneClientSocket(socket);
+
+    connect(socket, &QTcpSocket::readyRead, this, &ConnectionWorker::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, &ConnectionWorker::onDisconnected);
+
+    // Эфемерная пара ключей уже сгенерирована внутри сокета (FramedTcpSocket);
+    // в реестре воркера сокет числится только для проверки актуальности
+    // указателей в queued-вызовах writeJson.
+    m_connections.insert(socket);
+}
+
+
+void ConnectionWorker::adoptConnection(qintptr socketDescriptor,
+                                       const QByteArray &cryptoState,
+                                       const QByteArray &pendingBytes, int index)
+{
+    auto *socket = new FramedTcpSocket(this);
+
+    // Дескриптор уже соединен: setSocketDescriptor лишь оборачивает его
+    // нотификатором этого потока, ядро все это время держало соединение
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning() << "[WORKER] Failed to adopt handed-over descriptor:"
+                   << socket->errorString();
+        socket->deleteLater();
+        return;
+    }
+
+    SocketTuning::tuneClientSocket(socket);
+
+    if (!socket->crypto().importSession(cryptoState)) {
+        qWarning() << "[WORKER] Corrupt crypto session in hand-off, dropping"
+                   << socket->peerAddress().toString();
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+
+    connect(socket, &QTcpSocket::readyRead, this, &ConnectionWorker::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, &ConnectionWorker::onDisconnected);
+    m_connections.insert(socket);
+
+    // Основной поток регистрирует сокет в своих картах по индексу манифеста
+    // ДО обработки кадров: кадры пойдут через jsonReceived с уже
+    // привязанной сессией
+    emit connectionAdopted(socket, index);
+
+    // Хвост, не доработанный старым процессом, плюс все, что ядро успело
+    // принять за время передачи — кадры продолжаются с точного места среза
+    socket->framer().append(pendingBytes);
+    socket->framer().append(socket->readAll());
+    drainFrames(socket);
+}
+
+
+QVector<HandoverConnection> ConnectionWorker::exportConnections()
+{
+    // Выполняется в потоке воркера (блокирующий инвок из beginHandover):
+    // сокеты в согласованном состоянии, очереди записи дожимаются до среза
+    flushPendingWrites();
+
+    QVector<HandoverConnection> out;
+    out.reserve(m_connections.size());
+
+    for (QTcpSocket *connection : std::as_const(m_connections)) {
+        auto *socket = qobject_cast<FramedTcpSocket*>(connection);
+        if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
+            continue;
+        }
+
+        // После среза ни один байт не потребляется этим процессом: все,
+        // что придет дальше, останется в буфере ядра для нового процесса
+        disconnect(socket, &QTcpSocket::readyRead,
+                   this, &ConnectionWorker::onReadyRead);
+
+        HandoverConnection record;
+        record.socket = socket;
+        record.fd = socket->socketDescriptor();
+        record.cryptoState = socket->crypto().exportSession();
+
+        // Недообработанный хвост парсера + то, что уже лежит в буфере Qt
+        record.pendingBytes = socket->framer().pendingBytes();
+        record.pendingBytes.append(socket->readAll());
+
+        out.append(record);
+    }
+
+    qInfo() << "[WORKER] Exported" << out.size() << "connection(s) for hand-off"
+            << "(thread:" << QThread::currentThread() << ")";
+    return out;
+}
+
+
+void ConnectionWorker::onReadyRead()
+{
+    auto socket = qobject_cast<FramedTcpSocket*>(sender());
+    if (!socket) return;
+
+    // Состояние фрейминга живет в самом сокете: поиска по карте на каждое
+    // чтение нет, кадры нарезаются из накопительного буфера без копирования.
+    socket->framer().append(socket->readAll());
+    drainFrames(socket);
+}
+
+
+void ConnectionWorker::drainFrames(FramedTcpSocket *socket)
+{
+    FrameBuffer &framer = socket->framer();
+
+    // TCP — поток: за один readyRead может прийти несколько пакетов.
+    // Лимит кадра зависит от класса трафика и пересчитывается на каждой
+    // итерации: рукопожатие включает шифрование прямо внутри цикла.
+    QByteArray frame;
+    while (framer.nextFrame(frame, socket->crypto().isEncrypted()
+                                       ? FrameBuffer::SessionFrameLimit
+                                       : FrameBuffer::HandshakeFrameLimit)) {
+
+        CryptoManager &crypto = socket->crypto();
+
+        // Поток для разбора полей внутри кадра (формат совпадает с клиентом).
+        QDataStream in(frame);
+        in.setVersion(QDataStream::Qt_6_2);
+
+        if (!crypto.isEncrypted()) {
+            // ================================================================
+            // РЕЖИМ 1: Незашифрованное соединение (handshake, login, register)
+            // ================================================================
+            QByteArray jsonData;
+            in >> jsonData;
+
+            QJsonDocument doc = QJsonDocument::fromJson(jsonData);
+
+            if (!doc.isNull() && doc.isObject()) {
+                QJsonObject request = doc.object();
+
+                // Рукопожатие обрабатываем локально: CryptoManager живет здесь.
+                if (request["type"].toString() == "handshake") {
+                    processHandshake(socket, request);
+                } else {
+                    emit jsonReceived(request, socket);
+                }
+                continue;
+            } else {
+                qWarning() << "[WORKER] Invalid JSON received from" << socket->peerAddress().toString();
+                sendPlain(socket, QJsonDocument(QJsonObject{{"type", "error"},
+                                                            {"reason", "Malformed JSON"}})
+                                      .toJson(QJsonDocument::Compact));
+                return;
+            }
+        }
+
+        // ====================================================================
+        // РЕЖИМ 2: Зашифрованное соединение (XChaCha20-Poly1305)
+        // ====================================================================
+        // Разбор полей кадра и AEAD-верификация общие для всех транспортов
+        // (CryptoManager::openSealedBody): поля читаются по указателям прямо
+        // из буфера кадра, выход расшифровки пишется в переиспользуемый
+        // m_decryptScratch — в установившемся режиме путь приема не аллоцирует.
+        const int textLen = crypto.openSealedBody(
+            reinterpret_cast<const uint8_t*>(frame.constData()),
+            frame.size(), m_decryptScratch);
+
+        if (textLen == -1) {
+            qCritical() << "[WORKER] Malformed encrypted frame from"
+                        << socket->peerAddress().toString();
+            socket->abort();
+            return;
+        }
+        if (textLen < 0) {
+            qCritical() << "[WORKER] DECRYPTION FAILED! MAC mismatch. Possible attack or corruption from"
+                        << socket->peerAddress().toString();
+            socket->abort();
+            return;
+        }
+
+        // Вид без владения: обработка ниже синхронна, буфер не будет
+        // перезаписан до следующего пакета.
+        const QByteArray decrypted =
+            QByteArray::fromRawData(m_decryptScratch.constData(), textLen);
+
+        // Чанк файловой передачи уходит в основной поток: состояние передач
+        // (FileTransfer) живет там. Через границу потоков передается глубокая
+        // копия — view смотрит в переиспользуемый буфер этого потока.
+        if (FileTransfer::isChunk(decrypted)) {
+            emit fileChunkReceived(QByteArray(decrypted.constData(), decrypted.size()),
+                                   socket);
+            continue;
+        }
+
+        // Бинарная запись согласованного протокола декодируется без
+        // JSON-парсера; в основной поток уходит обычный QJsonObject.
+        if (BinaryCodec::isBinary(decrypted)) {
+            QJsonObject record = BinaryCodec::decode(decrypted);
+            if (!record.isEmpty()) {
+                emit jsonReceived(record, socket);
+            }
+            continue;
+        }
+
+        QJsonDocument doc = QJsonDocument::fromJson(decrypted);
+
+        if (!doc.isNull() && doc.isObject()) {
+            emit jsonReceived(doc.object(), socket);
+            continue;
+        } else {
+            qWarning() << "[WORKER] Invalid JSON after decryption";
+            writeJson(socket, QJsonDocument(QJsonObject{{"type", "error"},
+                                                        {"reason", "Invalid request format"}})
+                                  .toJson(QJsonDocument::Compact));
+            return;
+        }
+    }
+
+    // Префикс длины за пределами лимита — протокол сломан или нас пытаются
+    // заставить буферизовать гигабайты: рвем соединение, как при подделке MAC.
+    if (framer.overflowed()) {
+        qCritical() << "[WORKER] Frame length prefix exceeds limit from"
+                    << socket->peerAddress().toString() << "- aborting connection";
+        socket->abort();
+        return;
+    }
+
+    // Всплеск обработан: раздутая емкость парсера возвращается системе,
+    // простаивающее соединение не удерживает ее до следующего сообщения.
+    framer.trim();
+}
+
+
+void ConnectionWorker::processHandshake(QTcpSocket *socket, const QJsonObject &request)
+{
+    auto framedSocket = qobject_cast<FramedTcpSocket*>(socket);
+    if (!framedSocket) {
+        qWarning() << "[WORKER] Crypto context missing for socket:" << socket->peerAddress().toString();
+        return;
+    }
+
+    CryptoManager &crypto = framedSocket->crypto();
+
+    // Защита от повторного рукопожатия
+    if (crypto.isEncrypted()) {
+        qWarning() << "[WORKER] Handshake attempted on already encrypted connection from:"
+                   << socket->peerAddress().toString();
+        return;
+    }
+
+    // 1. Извлекаем публичный ключ клиента, base64 -> QByteArray
+    QByteArray clientKey = QByteArray::fromBase64(request["key"].toString().toLatin1());
+
+    if (clientKey.size() != 32) {
+        qWarning() << "[WORKER] Invalid client public key size:" << clientKey.size() << "expected 32 bytes";
+        return;
+    }
+
+    // 2. Вычисляем общий секрет (ECDH). Вся тяжелая математика X25519
+    //    выполняется здесь, в рабочем потоке, не блокируя основной цикл.
+    crypto.computeSharedSecret(clientKey);
+
+    // 3. Отправляем клиенту наш публичный ключ (еще открытым текстом)
+    QJsonObject json;
+    json["type"] = "handshake";
+    json["key"] = QString::fromLatin1(
+        QByteArray((const char*)crypto.getMyPublicKey(), 32).toBase64()
+    );
+    sendPlain(socket, QJsonDocument(json).toJson(QJsonDocument::Compact));
+
+    qInfo() << "[WORKER] Handshake complete with" << socket->peerAddress().toString()
+            << ". Connection secured.";
+}
+
+
+void ConnectionWorker::sendPlain(QTcpSocket *socket, const QByteArray &jsonData)
+{
+    QByteArray block;
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_2);
+
+    out << (quint32)0;              // Резервируем место под длину
+    out << jsonData;                // Пишем данные
+    out.device()->seek(0);          // Возвращаемся в начало
+    out << (quint32)(block.size() - sizeof(quint32));
+
+    enqueueWrite(socket, block);
+}
+
+
+void ConnectionWorker::writeJson(QObject *socket, const QByteArray &jsonData)
+{
+    auto tcpSocket = qobject_cast<QTcpSocket*>(socket);
+    if (!tcpSocket) return;
+
+    // Сокет мог отключиться (и быть удален), пока запрос шел через очередь
+    // событий — указатель проверяется по реестру живых сокетов воркера.
+    if (!m_connections.contains(tcpSocket)) return;
+
+    if (tcpSocket->state() != QAbstractSocket::ConnectedState) {
+        qWarning() << "[WORKER] Socket not connected, state:" << tcpSocket->state();
+        return;
+    }
+
+    CryptoManager &crypto = static_cast<FramedTcpSocket*>(tcpSocket)->crypto();
+
+    if (!crypto.isEncrypted()) {
+        sendPlain(tcpSocket, jsonData);
+        return;
+    }
+
+    // --- ШИФРОВАНИЕ И ФРЕЙМИНГ (XChaCha20-Poly1305) ---
+    // Кадр [Length][Nonce][MAC+Ciphertext] собирается одним проходом:
+    // sealFrame шифрует прямо в буфер результата точного размера.
+    enqueueWrite(tcpSocket, crypto.sealFrame(jsonData));
+}
+
+
+void ConnectionWorker::enqueueWrite(QTcpSocket *socket, const QByteArray &packet)
+{
+    // Клиент на зависшем канале не должен удерживать десятки мегабайт в RSS:
+    // превысивший жесткий потолок сокет разрывается, очистку состояния
+    // выполнит штатный onDisconnected().
+    const qint64 buffered = socket->bytesToWrite()
+                            + m_pendingWrites.value(socket).size()
+                            + packet.size();
+    if (buffered > SendHardCapBytes) {
+        qWarning() << "[WORKER] Slow consumer exceeded send hard cap:"
+                   << buffered << "bytes buffered, disconnecting";
+        m_pendingWrites.remove(socket);
+        socket->abort();
+        return;
+    }
+
+    // Кадры одной итерации цикла событий склеиваются в общий буфер сокета.
+    m_pendingWrites[socket] += packet;
+
+    // Один отложенный сброс на итерацию: queued-вызов выполнится, когда все
+    // поступившие воркеру ответы уже поставлены в очередь.
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, &ConnectionWorker::flushPendingWrites,
+                                  Qt::QueuedConnection);
+    }
+}
+
+
+void ConnectionWorker::flushPendingWrites()
+{
+    m_flushScheduled = false;
+
+    const QHash<QTcpSocket*, QByteArray> pending = std::move(m_pendingWrites);
+    m_pendingWrites = QHash<QTcpSocket*, QByteArray>();
+
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        QTcpSocket *socket = it.key();
+        if (!m_connections.contains(socket)
+            || socket->state() != QAbstractSocket::ConnectedState) {
+            continue; // Клиент успел отключиться — буфер просто выбрасывается
+        }
+
+        // Один write() на сокет за итерацию цикла событий.
+        if (socket->write(it.value()) == -1) {
+            qWarning() << "[WORKER] Write failed:" << socket->errorString();
+        }
+    }
+}
+
+
+void ConnectionWorker::onDisconnected()
+{
+    auto socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) return;
+
+    // Очищаем состояние воркера: очередь записи и запись в реестре живых
+    // сокетов. Само состояние соединения (парсер, криптографический
+    // контекст) живет в сокете и умрет вместе с ним.
+    m_pendingWrites.remove(socket);
+    m_connections.remove(socket);
+
+    // Основной поток сервера обновит карты онлайн-статуса и БД. Удалять
+    // сокет здесь нельзя: в очереди главного потока могут лежать еще не
+    // обработанные jsonReceived с этим указателем. Сервер вернет запрос
+    // на удаление queued-вызовом releaseSocket(), когда закончит с
+    // отключением.
+    emit socketDisconnected(socket);
+}
+
+
+void ConnectionWorker::releaseSocket(QObject *socket)
+{
+    // Выполняется в потоке воркера после того, как главный поток обработал
+    // socketDisconnected (а значит, и все более ранние события сокета).
+    socket->deleteLater();
+}
@@ -0,0 +1,296 @@
+#ifndef CONNECTIONWORKER_H
+#define CONNECTIONWORKER_H
+
+// Включения базовых классов Qt
+#include <QObject>
+#include <QTcpServer>
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QJsonObject>
+
+#include "cryptoutils.h" // CryptoManager (X25519 + XChaCha20-Poly1305)
+#include "handover.h" // Состояние соединений при бесшовном рестарте.
+
+class QTcpSocket;
+class QHostAddress;
+class ConnectionWorker;
+class FramedTcpSocket;
+
+/**
+ * @class WorkerTcpServer
+ * @brief TCP-сервер с поддержкой передачи соединений в пул рабочих потоков.
+ *
+ * @details В обычном режиме ведет себя как стандартный QTcpServer (сокет создается
+ * в потоке сервера и извлекается через nextPendingConnection()). В режиме пула
+ * перехватывает `incomingConnection()` и вместо создания QTcpSocket испускает
+ * сигнал с "сырым" дескриптором сокета. Дескриптор затем передается в один из
+ * рабочих потоков, где и создается QTcpSocket — это обязательное условие Qt:
+ * сокет должен жить в том потоке, который с ним работает.
+ *
+ * Для шардирования accept'ов несколько экземпляров могут слушать ОДИН порт
+ * через SO_REUSEPORT (listenReusePort): ядро само распределяет входящие
+ * соединения по очередям листенеров, и при лавине переподключений после
+ * рестарта accept-нагрузка делится между потоками. Если листенеру задан
+ * пул воркеров (setWorkerPool), дескрипторы раздаются напрямую из потока
+ * листенера, минуя основной цикл событий сервера.
+ */
+class WorkerTcpServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Конструктор.
+     * @param poolMode `true` — соединения передаются в пул через connectionReady(),
+     *                 `false` — классическое поведение QTcpServer.
+     * @param parent Родительский объект.
+     */
+    explicit WorkerTcpServer(bool poolMode, QObject *parent = nullptr)
+        : QTcpServer(parent), m_poolMode(poolMode) {}
+
+    /**
+     * @brief Начинает прослушивание порта с опцией SO_REUSEPORT.
+     *
+     * @details Создает нативный сокет, выставляет SO_REUSEADDR/SO_REUSEPORT,
+     * привязывает и передает дескриптор в setSocketDescriptor(). Несколько
+     * листенеров с этой опцией делят один порт, и ядро шардирует accept'ы
+     * между ними. Вызывать в потоке, которому принадлежит листенер
+     * (setSocketDescriptor создает нотификатор в текущем потоке).
+     *
+     * @param address Адрес интерфейса (Any — слушать все).
+     * @param port Порт прослушивания.
+     * @return `true` при успехе; `false`, если платформа не поддерживает
+     *         SO_REUSEPORT или bind/listen не удался.
+     */
+    bool listenReusePort(const QHostAddress &address, quint16 port);
+
+    /**
+     * @brief Задает пул воркеров для прямой раздачи дескрипторов.
+     *
+     * @details С непустым пулом incomingConnection() сам назначает соединение
+     * воркеру по кругу (queued-вызов addConnection), не проходя через основной
+     * поток. Вызывать до старта прослушивания.
+     *
+     * @param workers Воркеры пула (живут в своих потоках).
+     * @param firstWorker Стартовый индекс round-robin — у каждого листенера
+     *        свой, чтобы шарды не начинали раздачу с одного и того же воркера.
+     */
+    void setWorkerPool(const QList<ConnectionWorker*> &workers, int firstWorker);
+
+signals:
+    /**
+     * @brief Новое соединение готово к передаче в рабочий поток.
+     * @param socketDescriptor Нативный дескриптор принятого сокета.
+     */
+    void connectionReady(qintptr socketDescriptor);
+
+protected:
+    /**
+     * @brief Перехват входящего соединения.
+     * @details В режиме пула QTcpSocket здесь НЕ создается — только пересылается
+     * дескриптор. Иначе вызывается базовая реализация.
+     */
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    bool m_poolMode; ///< Флаг: соединения обслуживаются пулом потоков.
+    QList<ConnectionWorker*> m_poolWorkers; ///< Непустой — раздача дескрипторов напрямую.
+    int m_nextWorker = 0; ///< Индекс round-robin (только поток листенера).
+};
+
+/**
+ * @class ConnectionWorker
+ * @brief Обработчик группы TCP-соединений, живущий в отдельном рабочем потоке.
+ *
+ * @details Каждый экземпляр закреплен за своим QThread и полностью владеет
+ * назначенными ему сокетами: принимает байтовый поток, собирает пакеты по
+ * префиксу длины (FrameBuffer внутри FramedTcpSocket), выполняет рукопожатие
+ * X25519 и шифрование/расшифровку XChaCha20-Poly1305. Состояние соединения
+ * (парсер и криптографический контекст) целиком живет в самом сокете;
+ * благодаря жесткой привязке "сокет -> поток" оно не требует синхронизации.
+ *
+ * Распарсенные JSON-запросы передаются в основной поток сервера через
+ * сигнал `jsonReceived` (queued connection), а ответы возвращаются обратно
+ * слотом `writeJson`. Таким образом тяжелая часть (I/O, криптография, парсинг)
+ * масштабируется по ядрам, а маршрутизация и БД остаются в одном потоке.
+ */
+class ConnectionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Конструктор. Создается в основном потоке, затем перемещается
+     *        в рабочий через moveToThread().
+     */
+    explicit ConnectionWorker(QObject *parent = nullptr);
+
+    /**
+     * @brief Деструктор. Оставшиеся сокеты уничтожаются как дочерние объекты.
+     */
+    ~ConnectionWorker() override;
+
+public slots:
+    /**
+     * @brief Принимает новое соединение по дескриптору (вызывается в рабочем потоке).
+     * @details Создает FramedTcpSocket — сокет со встроенным состоянием
+     * соединения (парсер кадров и криптографический контекст).
+     * @param socketDescriptor Дескриптор, полученный от WorkerTcpServer.
+     */
+    void addConnection(qintptr socketDescriptor);
+
+    /**
+     * @brief Усыновляет соединение, переданное старым процессом.
+     *
+     * @details Часть бесшовного рестарта (см. Handover): создает
+     * FramedTcpSocket поверх принятого дескриптора, восстанавливает
+     * криптографическую сессию и скармливает парсеру недообработанный
+     * хвост потока старого процесса. О готовом сокете сообщает сигнал
+     * connectionAdopted — основной поток привязывает к нему сессию и
+     * флаги протокола из манифеста по индексу.
+     *
+     * @param socketDescriptor Дескриптор из пакета SCM_RIGHTS.
+     * @param cryptoState Блоб CryptoManager::exportSession().
+     * @param pendingBytes Хвост FrameBuffer::pendingBytes().
+     * @param index Индекс соединения в манифесте передачи.
+     */
+    void adoptConnection(qintptr socketDescriptor, const QByteArray &cryptoState,
+                         const QByteArray &pendingBytes, int index);
+
+    /**
+     * @brief Собирает состояние всех соединений воркера для передачи.
+     *
+     * @details Вызывается из основного потока блокирующим инвоком при
+     * начале передачи (см. Server::beginHandover): выполняется в потоке
+     * воркера, поэтому видит согласованное состояние сокетов. Дожимает
+     * очереди записи, отключает чтение (ни один байт не будет потреблен
+     * после среза) и снимает дескриптор, криптосессию и хвост парсера
+     * каждого соединения.
+     *
+     * @return Состояния соединений; сокеты остаются открытыми до выхода
+     *         старого процесса.
+     */
+    QVector<HandoverConnection> exportConnections();
+
+    /**
+     * @brief Отправляет JSON-данные клиенту (вызывается в рабочем потоке).
+     * @details Если сессия зашифрована — шифрует пакет XChaCha20-Poly1305,
+     * иначе отправляет открытый JSON с префиксом длины.
+     * @param socket Сокет получателя (должен принадлежать этому воркеру).
+     * @param jsonData Сериализованный JSON (Compact).
+     */
+    void writeJson(QObject *socket, const QByteArray &jsonData);
+
+    /**
+     * @brief Удаляет сокет отключившегося клиента (вызывается в рабочем потоке).
+     *
+     * @details Завершение протокола отключения: воркер сообщает об обрыве
+     * сигналом socketDisconnected, но сокет не трогает — в очереди главного
+     * потока могут ждать обработки jsonReceived с этим же указателем.
+     * Главный поток вызывает этот метод queued-инвоком после
+     * handleClientDisconnect: FIFO-порядок очередей между парой потоков
+     * гарантирует, что к этому моменту все более ранние события сокета
+     * уже обработаны и указатель больше никому не нужен.
+     *
+     * @param socket Сокет, о котором ранее был послан socketDisconnected.
+     */
+    void releaseSocket(QObject *socket);
+
+signals:
+    /**
+     * @brief Полный JSON-запрос принят, расшифрован и распарсен.
+     * @details Подключается к диспетчеру сервера через Qt::QueuedConnection.
+     */
+    void jsonReceived(const QJsonObject &request, QObject *socket);
+
+    /**
+     * @brief Бинарный чанк файловой передачи (см. FileTransfer::ChunkMagic).
+     * @details Состояние передач живет в основном потоке — чанк пересылается
+     * туда без разбора, как и JSON-запросы.
+     */
+    void fileChunkReceived(const QByteArray &chunk, QObject *socket);
+
+    /**
+     * @brief Клиент отключился; состояние воркера очищено, сокет еще жив.
+     * @details Сам сокет удаляется позже, когда главный поток вернет
+     * releaseSocket() — см. протокол отключения в его описании.
+     */
+    void socketDisconnected(QObject *socket);
+
+    /**
+     * @brief Переданное соединение усыновлено в потоке воркера.
+     * @details Основной поток по индексу манифеста регистрирует сокет в
+     * своих картах (сессия, heartbeat, флаги бинарного режима и сжатия).
+     */
+    void connectionAdopted(QObject *socket, int index);
+
+private slots:
+    /** @brief Слот чтения данных из сокета (аналог Server::onTcpReadyRead). */
+    void onReadyRead();
+
+private:
+    /**
+     * @brief Нарезает и обрабатывает кадры, накопленные парсером сокета.
+     * @details Общий хвост onReadyRead() и adoptConnection(): усыновленный
+     * сокет мог переехать с полукадром и даже целыми кадрами в буфере.
+     */
+    void drainFrames(FramedTcpSocket *socket);
+
+private slots:
+
+    /** @brief Слот обработки разрыва соединения. */
+    void onDisconnected();
+
+private:
+    /**
+     * @brief Выполняет серверную часть рукопожатия X25519 прямо в рабочем потоке.
+     * @details Криптографический контекст принадлежит воркеру, поэтому handshake
+     * не пересылается в основной поток — общий секрет вычисляется здесь же.
+     */
+    void processHandshake(QTcpSocket *socket, const QJsonObject &request);
+
+    /** @brief Отправляет незашифрованный JSON с префиксом длины. */
+    void sendPlain(QTcpSocket *socket, const QByteArray &jsonData);
+
+    /**
+     * @brief Ставит готовый кадр в очередь записи сокета.
+     * @details Кадры, поступившие воркеру в одной итерации его цикла событий,
+     * склеиваются и уходят одним write() в flushPendingWrites() — шторм мелких
+     * ответов (логин, выдача офлайн-сообщений) не порождает по TCP-сегменту
+     * на каждое сообщение.
+     */
+    void enqueueWrite(QTcpSocket *socket, const QByteArray &packet);
+
+    /**
+     * @brief Жесткий потолок исходящего буфера сокета.
+     * @details Для сокетов главного потока тот же предел применяет
+     * Server::applySendBackpressure (Server::SendHardCapBytes); у сокетов
+     * пула bytesToWrite() доступен только из потока воркера, поэтому
+     * потолок контролируется здесь, в enqueueWrite().
+     */
+    static constexpr qint64 SendHardCapBytes = 16 * 1024 * 1024;
+
+    /** @brief Отправляет накопленные очереди записи (конец итерации цикла событий). */
+    void flushPendingWrites();
+
+    /**
+     * @brief Живые сокеты, закрепленные за воркером.
+     * @details Служит только проверкой актуальности указателя: writeJson
+     * приходит через очередь событий и может застать сокет уже удаленным.
+     * Само состояние соединения живет в FramedTcpSocket.
+     */
+    QSet<QTcpSocket*> m_connections;
+
+    /** @brief Очереди исходящей записи: сокет -> накопленные кадры. */
+    QHash<QTcpSocket*, QByteArray> m_pendingWrites;
+
+    /** @brief Переиспользуемый буфер расшифровки (см. Server::m_decryptScratch). */
+    QByteArray m_decryptScratch;
+
+    /** @brief Отложенный сброс m_pendingWrites уже запланирован. */
+    bool m_flushScheduled = false;
+};
+
+#endif // CONNECTIONWORKER_H
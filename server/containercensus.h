@@ -0,0 +1,90 @@
+#ifndef CONTAINERCENSUS_H
+#define CONTAINERCENSUS_H
+
+#include <QString>
+#include <QList>
+#include <QJsonObject>
+#include <QElapsedTimer>
+
+#include <functional>
+
+/**
+ * @class ContainerCensus
+ * @brief Перепись долгоживущих контейнеров сервера для поиска утечек памяти.
+ *
+ * @details RSS процесса растет на ~100 МБ в сутки, и без heap-профайлера
+ * непонятно, чья это память: подозрения падают на записи per-socket таблиц,
+ * пережившие свой сокет, но это гадание. Класс решает задачу переписью:
+ * каждая крупная долгоживущая структура (реестр сессий, кэши, очереди
+ * записи, per-socket таблицы) регистрирует зонд — замыкание, возвращающее
+ * текущее число записей и, где это дешево посчитать, занятые байты.
+ *
+ * В момент регистрации (старт сервера) снимается базовая отметка; дальше
+ * каждый опрос сравнивает текущий размер с ней. Дамп `/census` на
+ * административном сокете (см. ServerMetrics) перечисляет все зонды,
+ * отсортированные по приросту с момента старта, — верх списка и есть
+ * кандидаты в утечку, без подключения профайлера к боевому процессу.
+ *
+ * Замечание по подходу: «помеченные аллокаторы» вокруг контейнеров здесь
+ * невозможны — контейнеры Qt пользовательский аллокатор не принимают.
+ * Перепись размеров дает ту же атрибуцию по подсистемам ценой одного
+ * обхода списка замыканий в момент опроса; горячий путь не трогается
+ * вообще.
+ *
+ * @note Все зонды читаются только из основного потока сервера — там же,
+ * где живут сами контейнеры, — поэтому ни блокировок, ни копий не нужно.
+ */
+class ContainerCensus
+{
+public:
+    ContainerCensus();
+
+    /**
+     * @brief Регистрирует зонд одного контейнера.
+     *
+     * Базовая отметка снимается сразу же, поэтому регистрировать зонды
+     * нужно на старте, до приема трафика — иначе «прирост с момента
+     * старта» будет считаться от уже наполненного контейнера.
+     *
+     * @param subsystem Подсистема-владелец ("sessions", "caches", ...).
+     * @param name Имя контейнера в дампе (snake_case).
+     * @param entries Замыкание, возвращающее текущее число записей.
+     * @param bytes Замыкание, возвращающее занятые байты; пустое, если
+     *        дешевой оценки нет — тогда в дампе будут только записи.
+     */
+    void registerProbe(const QString &subsystem, const QString &name,
+                       std::function<qint64()> entries,
+                       std::function<qint64()> bytes = {});
+
+    /** @brief Суммарное число записей во всех зондах (для gauge-метрики). */
+    qint64 totalEntries() const;
+
+    /** @brief Суммарные байты по зондам, умеющим их считать. */
+    qint64 totalBytes() const;
+
+    /**
+     * @brief Полный дамп переписи для административного эндпоинта.
+     *
+     * @return JSON с массивом "sites": для каждого зонда — подсистема,
+     * имя, текущий размер, размер на старте и прирост; массив
+     * отсортирован по приросту записей по убыванию, так что верхние
+     * строки — главные кандидаты в утечку.
+     */
+    QJsonObject dump() const;
+
+private:
+    /** @brief Один зарегистрированный контейнер. */
+    struct Probe {
+        QString subsystem;                 ///< Подсистема-владелец.
+        QString name;                      ///< Имя в дампе.
+        std::function<qint64()> entries;   ///< Текущее число записей.
+        std::function<qint64()> bytes;     ///< Занятые байты (может быть пустым).
+        qint64 baselineEntries = 0;        ///< Записей на момент регистрации.
+        qint64 baselineBytes = 0;          ///< Байт на момент регистрации.
+    };
+
+    QList<Probe> m_probes;   ///< Зонды в порядке регистрации.
+    QElapsedTimer m_started; ///< Монотонное время с момента старта переписи.
+};
+
+#endif // CONTAINERCENSUS_H
@@ -0,0 +1,58 @@
+//См. "conversationdirectory.h"
+#include "conversationdirectory.h"
+#include "statementcache.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+qint64 ConversationDirectory::idFor(QSqlDatabase &db, const QString &userA,
+                                    const QString &userB)
+{
+    // Каноничный порядок: меньший username всегда в user_a.
+    const bool ordered = userA < userB;
+
+    QSqlQuery &query = StatementCache::get(db,
+        "SELECT id FROM conversations WHERE user_a = :a AND user_b = :b");
+    query.bindValue(":a", ordered ? userA : userB);
+    query.bindValue(":b", ordered ? userB : userA);
+
+    if (!query.exec()) {
+        qWarning() << "[DB] Conversation lookup failed for" << userA << "<->"
+                   << userB << ":" << query.lastError().text();
+        return -1;
+    }
+    if (!query.next()) {
+        return -1; // Пара еще не обменивалась сообщениями
+    }
+    return query.value(0).toLongLong();
+}
+
+
+qint64 ConversationDirectory::ensureId(QSqlDatabase &db, const QString &userA,
+                                       const QString &userB)
+{
+    const qint64 existing = idFor(db, userA, userB);
+    if (existing >= 0) {
+        return existing;
+    }
+
+    const bool ordered = userA < userB;
+
+    QSqlQuery &insert = StatementCache::get(db,
+        "INSERT INTO conversations (user_a, user_b) VALUES (:a, :b)");
+    insert.bindValue(":a", ordered ? userA : userB);
+    insert.bindValue(":b", ordered ? userB : userA);
+
+    if (!insert.exec()) {
+        qWarning() << "[DB] Failed to register conversation" << userA << "<->"
+                   << userB << ":" << insert.lastError().text();
+        return -1;
+    }
+
+    const qint64 id = insert.lastInsertId().toLongLong();
+    qDebug() << "[DB] Registered conversation" << id << "for" << userA
+             << "<->" << userB;
+    return id;
+}
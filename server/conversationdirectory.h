@@ -0,0 +1,51 @@
+#ifndef CONVERSATIONDIRECTORY_H
+#define CONVERSATIONDIRECTORY_H
+
+#include <QString>
+#include <QSqlDatabase>
+
+/**
+ * @class ConversationDirectory
+ * @brief Справочник диалогов: каноничная пара пользователей -> компактный ID.
+ *
+ * @details Исторически каждая строка messages несла диалог в виде двух
+ * текстовых колонок (fromUser, toUser), и составной индекс истории дублировал
+ * оба username в каждой записи b-tree. Таблица `conversations` выдает паре
+ * один целочисленный `conversation_id`, который штампуется на строке
+ * сообщения при записи: индекс (conversation_id, id) вдвое-втрое компактнее,
+ * а запросы истории/квитанций/архива превращаются в один range-scan без
+ * UNION по двум направлениям пары.
+ *
+ * Пара канонизируется лексикографически (меньший username — в user_a), как
+ * и везде в коде (ChatSequencer, RecentMessageCache::keyFor). Оба метода
+ * работают на переданном соединении через StatementCache, поэтому пригодны
+ * и в основном потоке, и в лямбдах DatabaseService.
+ */
+class ConversationDirectory
+{
+public:
+    /**
+     * @brief Ищет ID диалога пары, не создавая его.
+     * @details Для читающих путей: отсутствие записи означает, что пара еще
+     * не обменивалась сообщениями (или вся переписка уехала в архив до
+     * миграции) — истории в горячей таблице заведомо нет.
+     * @param db Соединение с БД (должно принадлежать текущему потоку).
+     * @param userA Один из участников (порядок не важен).
+     * @param userB Второй участник.
+     * @return ID диалога или -1, если пара неизвестна.
+     */
+    static qint64 idFor(QSqlDatabase &db, const QString &userA, const QString &userB);
+
+    /**
+     * @brief Возвращает ID диалога пары, создавая запись при первом обращении.
+     * @details Для пишущих путей (журнал сообщений): вставка выполняется на
+     * единственном писательском соединении, поэтому гонок за создание нет.
+     * @param db Соединение с БД (должно принадлежать текущему потоку).
+     * @param userA Один из участников (порядок не важен).
+     * @param userB Второй участник.
+     * @return ID диалога или -1 при ошибке БД.
+     */
+    static qint64 ensureId(QSqlDatabase &db, const QString &userA, const QString &userB);
+};
+
+#endif // CONVERSATIONDIRECTORY_H
@@ -5,6 +5,8 @@
 #include <QByteArray>
 #include <QDebug>
 #include <QRandomGenerator>
+#include <QtEndian> // Ручная сборка кадра в sealFrame (big-endian префиксы)
+#include <cstring> // memcpy для установки вычисленного общего секрета
 #include "monocypher.h" // Подключаем библиотеку Monocypher
 
 /**
@@ -90,6 +92,19 @@ private:
      */
     bool ready = false;
 
+    /**
+     * @brief Потоковый режим AEAD согласован (клиент прислал `aead: 2`).
+     * @details В этом режиме кадры шифруются стейтфул-контекстами txCtx/rxCtx
+     * вместо одноразовых вызовов с ключом сессии (см. enableStreamMode).
+     */
+    bool streamMode = false;
+
+    /** @brief Контекст исходящего направления (подключ и счетчик кадров). */
+    crypto_aead_ctx txCtx;
+
+    /** @brief Контекст входящего направления (подключ и счетчик кадров). */
+    crypto_aead_ctx rxCtx;
+
 public:
     /**
      * @brief Конструктор. Генерирует пару ключей (Private/Public).
@@ -133,6 +148,275 @@ public:
         qDebug() << "Shared Secret Hex:" << QByteArray((char*)sharedKey, 32).toHex();
     }
 
+    /**
+     * @brief Возвращает приватный ключ текущей стороны.
+     *
+     * @details Нужен для выноса скалярного умножения X25519 из потока событий:
+     *          задача криптопула получает копию ключевого материала и больше
+     *          не зависит от времени жизни этого объекта (он может быть удален
+     *          при разрыве соединения, пока задача стоит в очереди).
+     *
+     * @warning Ключ не должен покидать процесс и попадать в логи.
+     * @return Указатель на массив из 32 байт.
+     */
+    const uint8_t* getSecretKey() const { return secretKey; }
+
+    /**
+     * @brief Устанавливает общий секрет, вычисленный вне этого объекта.
+     *
+     * @details Парная операция к getSecretKey(): пул потоков выполняет
+     *          X25519(MyPrivateKey, TheirPublicKey) на своей копии ключей и
+     *          возвращает результат сюда. Устанавливает флаг `ready = true`.
+     *
+     * @param sharedSecret Общий секрет (должен быть 32 байта).
+     */
+    void setSharedSecret(const QByteArray& sharedSecret) {
+        if (sharedSecret.size() != 32) {
+            qWarning() << "Invalid shared secret size:" << sharedSecret.size();
+            return;
+        }
+
+        memcpy(sharedKey, sharedSecret.constData(), 32);
+        ready = true;
+    }
+
+    /**
+     * @brief Включает потоковый режим AEAD (стейтфул-контексты направлений).
+     *
+     * @details Одноразовый crypto_aead_lock заново выполняет развертку ключа
+     * (HChaCha20-подключ из ключа сессии и первой половины nonce) на каждый
+     * кадр. Здесь развертка выполняется один раз на направление: контексты
+     * txCtx/rxCtx инициализируются от ключа сессии с фиксированными нонсами
+     * направлений — это безопасно, потому что сам ключ эфемерный (X25519 на
+     * соединение) и у двух направлений нонсы различны. Дальше кадры
+     * нумеруются внутренним счетчиком контекста (nonce в кадре не передается
+     * и не занимает 24 байта на проводе), а каждый кадр дополнительно
+     * ратчетит ключ контекста — компрометация текущего состояния не
+     * раскрывает прошлый трафик.
+     *
+     * @note Требует установленного общего секрета; вызывается один раз после
+     * рукопожатия, строго до первого зашифрованного кадра.
+     * @param isServer `true` на серверной стороне: ее исходящее направление —
+     *        s2c, входящее — c2s (у клиента зеркально).
+     */
+    void enableStreamMode(bool isServer) {
+        if (!ready) {
+            qWarning() << "Stream AEAD requested before handshake completion";
+            return;
+        }
+
+        uint8_t nonce[24] = {0};
+        memcpy(nonce, isServer ? "s2c" : "c2s", 3);
+        crypto_aead_init_x(&txCtx, sharedKey, nonce);
+        memcpy(nonce, isServer ? "c2s" : "s2c", 3);
+        crypto_aead_init_x(&rxCtx, sharedKey, nonce);
+
+        streamMode = true;
+    }
+
+    /**
+     * @brief Согласован ли потоковый режим AEAD для этой сессии.
+     * @return `true`, если enableStreamMode был вызван после рукопожатия.
+     */
+    bool isStreamMode() const { return streamMode; }
+
+    /**
+     * @brief Сериализует состояние сессии для передачи новому процессу.
+     *
+     * @details Часть бесшовного рестарта (см. Handover): установленное
+     * соединение переезжает в новый процесс вместе с дескриптором сокета,
+     * и его криптографическая сессия должна продолжиться с точного места —
+     * общий секрет, флаги и стейтфул-контексты направлений (подключи и
+     * счетчики кадров) копируются как есть. Контексты передаются сырыми
+     * байтами структуры: передача идет между процессами одной машины
+     * через Unix-сокет, переносимость представления не требуется.
+     *
+     * @warning Блоб содержит ключевой материал: только Unix-сокет с правами
+     * владельца, никаких логов и никакой записи на диск.
+     * @return Блоб состояния для importSession().
+     */
+    QByteArray exportSession() const {
+        QByteArray blob;
+        blob.reserve(2 + 32 + 2 * int(sizeof(crypto_aead_ctx)));
+        blob.append(char(ready));
+        blob.append(char(streamMode));
+        blob.append(reinterpret_cast<const char*>(sharedKey), 32);
+        blob.append(reinterpret_cast<const char*>(&txCtx), sizeof(txCtx));
+        blob.append(reinterpret_cast<const char*>(&rxCtx), sizeof(rxCtx));
+        return blob;
+    }
+
+    /**
+     * @brief Восстанавливает состояние сессии, переданное старым процессом.
+     * @param blob Блоб из exportSession().
+     * @return `false`, если размер блоба не совпадает с ожидаемым.
+     */
+    bool importSession(const QByteArray& blob) {
+        constexpr int ExpectedSize = 2 + 32 + 2 * int(sizeof(crypto_aead_ctx));
+        if (blob.size() != ExpectedSize) {
+            qWarning() << "Session blob size mismatch:" << blob.size()
+                       << "expected" << ExpectedSize;
+            return false;
+        }
+        const char* p = blob.constData();
+        ready = (p[0] != 0);
+        streamMode = (p[1] != 0);
+        memcpy(sharedKey, p + 2, 32);
+        memcpy(&txCtx, p + 2 + 32, sizeof(txCtx));
+        memcpy(&rxCtx, p + 2 + 32 + sizeof(txCtx), sizeof(rxCtx));
+        return true;
+    }
+
+    /**
+     * @brief Шифрует пакет и собирает готовый кадр для записи в сокет.
+     *
+     * @details Горячий путь отправки. Раскладка кадра побайтово совпадает
+     * с исторической QDataStream-сериализацией:
+     * `[длина][nonce как QByteArray][MAC+шифртекст как QByteArray]`,
+     * но собирается одним проходом: буфер результата выделяется сразу
+     * точного размера, и `crypto_aead_lock` пишет шифртекст прямо в него.
+     * Для больших пакетов (история, файлы, аватары) это убирает две
+     * полноразмерные копии и два промежуточных выделения на кадр по
+     * сравнению со сборкой через QDataStream.
+     *
+     * В потоковом режиме (enableStreamMode) раскладка компактнее:
+     * `[4: длина кадра][16: MAC][N: шифртекст]` — nonce не передается
+     * (неявный счетчик контекста), подключ не развертывается заново,
+     * а префикс длины аутентифицируется как associated data: подмена
+     * длины кадра на проводе ломает MAC, а не парсер.
+     *
+     * @param plaintext Сериализованный пакет (JSON или бинарная запись).
+     * @return Готовый кадр с префиксом длины, nonce и MAC+шифртекстом.
+     */
+    QByteArray sealFrame(const QByteArray& plaintext) {
+        constexpr int NonceSize = 24;
+        constexpr int MacSize = 16;
+
+        if (streamMode) {
+            const quint32 frameSize = quint32(MacSize + plaintext.size());
+            QByteArray frame(qsizetype(4 + frameSize), Qt::Uninitialized);
+            uint8_t* p = reinterpret_cast<uint8_t*>(frame.data());
+            qToBigEndian<quint32>(frameSize, p);
+
+            crypto_aead_write(
+                &txCtx,
+                p + 4 + MacSize,                                        // шифртекст (выход)
+                p + 4,                                                  // MAC (выход)
+                p, 4,                                                   // AD: префикс длины
+                reinterpret_cast<const uint8_t*>(plaintext.constData()),
+                plaintext.size());
+
+            return frame;
+        }
+
+        uint8_t nonce[NonceSize];
+        QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(nonce), NonceSize / 4);
+
+        // Раскладка: [4: длина кадра][4: длина nonce][24: nonce]
+        //            [4: длина MAC+шифртекста][16: MAC][N: шифртекст]
+        const quint32 sealedSize = quint32(MacSize + plaintext.size());
+        const quint32 frameSize  = 4 + NonceSize + 4 + sealedSize;
+
+        QByteArray frame(qsizetype(4 + frameSize), Qt::Uninitialized);
+        uint8_t* p = reinterpret_cast<uint8_t*>(frame.data());
+
+        qToBigEndian<quint32>(frameSize, p);  p += 4;
+        qToBigEndian<quint32>(NonceSize, p);  p += 4;
+        memcpy(p, nonce, NonceSize);          p += NonceSize;
+        qToBigEndian<quint32>(sealedSize, p); p += 4;
+
+        crypto_aead_lock(
+            p + MacSize,                                            // шифртекст (выход)
+            p,                                                      // MAC (выход)
+            sharedKey,                                              // ключ сессии
+            nonce,                                                  // nonce
+            nullptr, 0,                                             // associated data (нет)
+            reinterpret_cast<const uint8_t*>(plaintext.constData()),// открытый текст
+            plaintext.size());
+
+        return frame;
+    }
+
+    /**
+     * @brief Разбирает и расшифровывает тело зашифрованного кадра.
+     *
+     * @details Обратная операция к sealFrame и общий путь приема для всех
+     * транспортов (TCP в основном потоке, TCP в воркерах, WebSocket): поля
+     * кадра читаются по указателям прямо из входного буфера
+     * (`[4: длина nonce][24: nonce][4: длина MAC+шифртекста][16: MAC][шифртекст]`),
+     * а выход расшифровки пишется в переиспользуемый scratch-буфер
+     * вызывающего — в установившемся режиме прием не обращается к malloc:
+     * буфер один раз дорастает до максимального пакета и остается.
+     *
+     * В потоковом режиме тело кадра — `[16: MAC][N: шифртекст]`; nonce
+     * восстанавливается из счетчика rx-контекста, а associated data —
+     * префикс длины, который восстанавливается из размера тела (транспорт
+     * уже сверил его с объявленной длиной кадра).
+     *
+     * @param body Тело кадра (без префикса общей длины).
+     * @param size Размер тела в байтах.
+     * @param scratch Переиспользуемый буфер под открытый текст.
+     * @return Длина открытого текста; -1 — битая структура кадра,
+     *         -2 — не сошелся MAC (подделка или порча данных).
+     */
+    int openSealedBody(const uint8_t* body, qsizetype size, QByteArray& scratch) {
+        constexpr int NonceSize = 24;
+        constexpr int MacSize = 16;
+
+        if (streamMode) {
+            if (size < MacSize) return -1;
+
+            const int textLen = int(size) - MacSize;
+            if (scratch.size() < textLen) {
+                scratch = QByteArray(textLen, Qt::Uninitialized);
+            }
+
+            uint8_t lengthPrefix[4];
+            qToBigEndian<quint32>(quint32(size), lengthPrefix);
+
+            const int status = crypto_aead_read(
+                &rxCtx,
+                reinterpret_cast<uint8_t*>(scratch.data()),
+                body,                                         // MAC
+                lengthPrefix, 4,                              // AD: префикс длины
+                body + MacSize,                               // шифртекст
+                textLen);
+
+            return status == 0 ? textLen : -2;
+        }
+
+        if (size < 4 + NonceSize + 4 + MacSize
+            || qFromBigEndian<quint32>(body) != quint32(NonceSize)) {
+            return -1;
+        }
+
+        const quint32 sealedSize = qFromBigEndian<quint32>(body + 4 + NonceSize);
+        if (sealedSize < quint32(MacSize)
+            || qint64(4 + NonceSize + 4) + sealedSize > size) {
+            return -1;
+        }
+
+        const uint8_t* nonce      = body + 4;
+        const uint8_t* mac        = body + 4 + NonceSize + 4;
+        const uint8_t* cipherText = mac + MacSize;
+        const int      textLen    = int(sealedSize) - MacSize;
+
+        if (scratch.size() < textLen) {
+            scratch = QByteArray(textLen, Qt::Uninitialized);
+        }
+
+        const int status = crypto_aead_unlock(
+            reinterpret_cast<uint8_t*>(scratch.data()),
+            mac,                                          // MAC для проверки подлинности
+            sharedKey,                                    // Общий ключ сессии
+            nonce,                                        // Nonce (уникален на кадр)
+            nullptr, 0,                                   // Associated Data (нет)
+            cipherText,
+            textLen);
+
+        return status == 0 ? textLen : -2;
+    }
+
     /**
      * @brief Проверяет, установлено ли защищенное соединение.
      * @return `true`, если общий секрет вычислен.
@@ -0,0 +1,237 @@
+/**
+ * @file databaseservice.cpp
+ * @brief Реализация асинхронного слоя доступа к базе данных.
+ *
+ * @details Задачи записи выполняются последовательно в одном выделенном потоке
+ * через очередь событий Qt (QMetaObject::invokeMethod с функтором). Это дает
+ * полную развязку сокетного I/O и дискового I/O SQLite без блокировок.
+ *
+ * Чтения уходят в отдельный пул соединений: в режиме WAL SELECT на своем
+ * соединении не ждет COMMIT писателя, поэтому запрос истории не стоит в
+ * очереди за пакетом INSERT из журнала сообщений. Каждый читатель — свой
+ * поток со своим именованным соединением (ограничение Qt SQL), задачи
+ * раздаются round-robin.
+ */
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QPointer>
+#include <QDebug>
+
+#include "databaseservice.h"
+
+DatabaseService::DatabaseService(const QString &databaseName, QObject *parent)
+    : QObject(parent),
+      m_executor(nullptr),
+      m_databaseName(databaseName),
+      m_connectionName(QStringLiteral("db-service"))
+{
+    m_thread.setObjectName(QStringLiteral("db-service"));
+}
+
+
+DatabaseService::~DatabaseService()
+{
+    // Сначала останавливаем читателей: их соединения закрываются в своих
+    // потоках-владельцах, как и у писателя.
+    for (Reader &reader : m_readers) {
+        if (!reader.thread->isRunning()) continue;
+
+        QMetaObject::invokeMethod(reader.executor,
+                                  [connectionName = reader.connectionName]() {
+            {
+                QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+                if (db.isOpen()) db.close();
+            }
+            QSqlDatabase::removeDatabase(connectionName);
+        }, Qt::BlockingQueuedConnection);
+
+        reader.thread->quit();
+        reader.thread->wait();
+    }
+
+    if (m_thread.isRunning()) {
+        // Закрываем соединение в потоке-владельце перед остановкой.
+        QMetaObject::invokeMethod(m_executor, [connectionName = m_connectionName]() {
+            {
+                QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+                if (db.isOpen()) db.close();
+            }
+            QSqlDatabase::removeDatabase(connectionName);
+        }, Qt::BlockingQueuedConnection);
+
+        m_thread.quit();
+        m_thread.wait();
+    }
+}
+
+
+bool DatabaseService::start()
+{
+    // Исполнитель — пустой QObject, служащий "якорем" потока для
+    // QMetaObject::invokeMethod: все функторы выполняются в его потоке.
+    m_executor = new QObject();
+    m_executor->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_executor, &QObject::deleteLater);
+
+    m_thread.start();
+
+    // Открываем соединение синхронно, чтобы сразу сообщить об ошибке запуска.
+    bool opened = false;
+    QMetaObject::invokeMethod(m_executor, [this, &opened]() {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+        db.setDatabaseName(m_databaseName);
+        opened = db.open();
+        if (!opened) {
+            qCritical() << "[DB-SERVICE] Failed to open database:" << db.lastError().text();
+        } else {
+            // WAL: читатели не блокируют писателя, COMMIT заметно дешевле.
+            // synchronous=NORMAL — рекомендованная пара к WAL для серверов.
+            QSqlQuery pragma(db);
+            if (!pragma.exec("PRAGMA journal_mode=WAL;")) {
+                qWarning() << "[DB-SERVICE] Failed to enable WAL mode:" << pragma.lastError().text();
+            }
+            if (!pragma.exec("PRAGMA synchronous=NORMAL;")) {
+                qWarning() << "[DB-SERVICE] Failed to set synchronous=NORMAL:" << pragma.lastError().text();
+            }
+            qInfo() << "[DB-SERVICE] Database thread started, connection open.";
+        }
+    }, Qt::BlockingQueuedConnection);
+
+    if (!opened) {
+        return false;
+    }
+
+    // Пул читающих соединений:
+    // - По умолчанию: 2 читателя — достаточно, чтобы чтения не стояли
+    //   за пакетными INSERT, и не создает лишних подключений к файлу.
+    // - MESSENGER_DB_READERS=N — явно задать размер пула.
+    // - MESSENGER_DB_READERS=0 — без читателей, чтения уходят писателю.
+    int readerCount = 2;
+    if (qEnvironmentVariableIsSet("MESSENGER_DB_READERS")) {
+        readerCount = qEnvironmentVariableIntValue("MESSENGER_DB_READERS");
+    }
+    readerCount = qBound(0, readerCount, 8);
+
+    m_readers.reserve(readerCount);
+    for (int i = 0; i < readerCount; ++i) {
+        Reader reader;
+        reader.connectionName = QStringLiteral("db-reader-%1").arg(i);
+
+        reader.thread = new QThread(this);
+        reader.thread->setObjectName(reader.connectionName);
+
+        reader.executor = new QObject();
+        reader.executor->moveToThread(reader.thread);
+        connect(reader.thread, &QThread::finished, reader.executor, &QObject::deleteLater);
+
+        reader.thread->start();
+
+        // Открываем соединение синхронно: неоткрывшийся читатель хуже
+        // отсутствующего, об ошибке нужно узнать на старте.
+        bool readerOpened = false;
+        QMetaObject::invokeMethod(reader.executor,
+                                  [this, &reader, &readerOpened]() {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", reader.connectionName);
+            db.setDatabaseName(m_databaseName);
+            readerOpened = db.open();
+            if (!readerOpened) {
+                qCritical() << "[DB-SERVICE] Failed to open reader connection"
+                            << reader.connectionName << ":" << db.lastError().text();
+                return;
+            }
+
+            QSqlQuery pragma(db);
+            // query_only страхует от случайной записи мимо очереди писателя.
+            if (!pragma.exec("PRAGMA query_only=1;")) {
+                qWarning() << "[DB-SERVICE] Failed to set query_only:" << pragma.lastError().text();
+            }
+            // При гонке за WAL-чекпоинт короткое ожидание вместо SQLITE_BUSY.
+            if (!pragma.exec("PRAGMA busy_timeout=2000;")) {
+                qWarning() << "[DB-SERVICE] Failed to set busy_timeout:" << pragma.lastError().text();
+            }
+        }, Qt::BlockingQueuedConnection);
+
+        if (!readerOpened) {
+            reader.thread->quit();
+            reader.thread->wait();
+            continue;
+        }
+
+        m_readers.append(reader);
+    }
+
+    if (!m_readers.isEmpty()) {
+        qInfo() << "[DB-SERVICE] Reader pool started:" << m_readers.size() << "connections.";
+    }
+
+    return true;
+}
+
+
+void DatabaseService::post(Job job)
+{
+    QMetaObject::invokeMethod(m_executor,
+                              [connectionName = m_connectionName, job = std::move(job)]() {
+        QSqlDatabase db = QSqlDatabase::database(connectionName);
+        job(db);
+    }, Qt::QueuedConnection);
+}
+
+
+void DatabaseService::query(Job job, QObject *context, Completion completion)
+{
+    // QPointer отслеживает время жизни контекста: если Server (или сокет)
+    // уничтожен к моменту завершения задачи, коллбэк молча пропускается.
+    QPointer<QObject> guard(context);
+
+    QMetaObject::invokeMethod(m_executor,
+                              [connectionName = m_connectionName,
+                               job = std::move(job),
+                               guard,
+                               completion = std::move(completion)]() {
+        QSqlDatabase db = QSqlDatabase::database(connectionName);
+        QVariant result = job(db);
+
+        if (!guard) return; // Контекст уже уничтожен
+
+        // Доставляем результат в поток контекста через очередь событий.
+        QMetaObject::invokeMethod(guard.data(),
+                                  [completion = std::move(completion), result]() {
+            completion(result);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+
+void DatabaseService::read(Job job, QObject *context, Completion completion)
+{
+    // Без читателей (MESSENGER_DB_READERS=0) чтение выполняет писатель —
+    // контракт для вызывающего тот же, меняется только очередь.
+    if (m_readers.isEmpty()) {
+        query(std::move(job), context, std::move(completion));
+        return;
+    }
+
+    const Reader &reader = m_readers.at(m_nextReader);
+    m_nextReader = (m_nextReader + 1) % m_readers.size();
+
+    QPointer<QObject> guard(context);
+
+    QMetaObject::invokeMethod(reader.executor,
+                              [connectionName = reader.connectionName,
+                               job = std::move(job),
+                               guard,
+                               completion = std::move(completion)]() {
+        QSqlDatabase db = QSqlDatabase::database(connectionName);
+        QVariant result = job(db);
+
+        if (!guard) return; // Контекст уже уничтожен
+
+        QMetaObject::invokeMethod(guard.data(),
+                                  [completion = std::move(completion), result]() {
+            completion(result);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
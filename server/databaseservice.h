@@ -0,0 +1,116 @@
+#ifndef DATABASESERVICE_H
+#define DATABASESERVICE_H
+
+// Включения базовых классов Qt
+#include <QObject>
+#include <QThread>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include <functional> // std::function для задач и коллбэков
+
+class QSqlDatabase;
+
+/**
+ * @class DatabaseService
+ * @brief Асинхронный слой доступа к базе данных в выделенном потоке.
+ *
+ * @details SQLite-запросы — главный источник задержек в основном цикле событий:
+ * один медленный fsync диска замораживает всех подключенных клиентов. Этот класс
+ * выносит работу с БД в отдельные потоки по модели "запрос/завершение":
+ *
+ * - `post()` — поставить задачу записи без результата (fire-and-forget),
+ *   например обновление last_seen или флагов доставки.
+ * - `query()` — поставить задачу записи с результатом; по завершении коллбэк
+ *   вызывается в потоке объекта-контекста через очередь событий Qt.
+ * - `read()` — поставить задачу ЧТЕНИЯ: выполняется в пуле читающих
+ *   соединений и не ждет в очереди за пакетными INSERT.
+ *
+ * Соединения разделены по ролям "писатель/читатели". Писатель один: все
+ * задачи записи выполняются строго последовательно в порядке постановки,
+ * поэтому внутри сервиса синхронизация не нужна. Читателей несколько —
+ * в режиме WAL чтение идет параллельно с записью, но только на отдельных
+ * соединениях; каждое живет в собственном потоке (требование Qt SQL:
+ * соединение можно использовать только из потока, в котором оно создано).
+ *
+ * Если объект-контекст (обычно Server) уничтожен к моменту завершения задачи,
+ * коллбэк не вызывается — это защищает от обращений к висячим указателям.
+ */
+class DatabaseService : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Тип задачи, выполняемой в потоке БД.
+     * @details Получает соединение потока сервиса; возвращаемое значение
+     * передается в коллбэк завершения (для post() игнорируется).
+     */
+    using Job = std::function<QVariant(QSqlDatabase&)>;
+
+    /**
+     * @brief Тип коллбэка завершения. Вызывается в потоке объекта-контекста.
+     */
+    using Completion = std::function<void(const QVariant&)>;
+
+    /**
+     * @brief Конструктор.
+     * @param databaseName Имя файла базы данных SQLite (например, "messenger.db").
+     * @param parent Родительский объект.
+     */
+    explicit DatabaseService(const QString &databaseName, QObject *parent = nullptr);
+
+    /**
+     * @brief Деструктор. Останавливает поток БД и закрывает соединение.
+     */
+    ~DatabaseService() override;
+
+    /**
+     * @brief Запускает поток сервиса и открывает соединение с БД.
+     * @return `true`, если соединение успешно открыто.
+     */
+    bool start();
+
+    /**
+     * @brief Ставит в очередь задачу без результата (fire-and-forget).
+     * @param job Задача, выполняемая в потоке БД.
+     */
+    void post(Job job);
+
+    /**
+     * @brief Ставит в очередь задачу с доставкой результата.
+     * @param job Задача, выполняемая в потоке БД.
+     * @param context Объект, в потоке которого будет вызван коллбэк.
+     *        Если контекст уничтожен до завершения — коллбэк не вызывается.
+     * @param completion Коллбэк с результатом задачи.
+     */
+    void query(Job job, QObject *context, Completion completion);
+
+    /**
+     * @brief Ставит задачу ЧТЕНИЯ в пул читающих соединений.
+     * @details Контракт как у query(), но задача выполняется на одном из
+     * читающих соединений (round-robin) и не ждет в очереди писателя за
+     * пакетными INSERT. Задача НЕ должна модифицировать БД: соединения
+     * открыты с PRAGMA query_only. Число читателей задается переменной
+     * окружения MESSENGER_DB_READERS; при 0 чтения уходят писателю.
+     */
+    void read(Job job, QObject *context, Completion completion);
+
+private:
+    /** @brief Поток одного читающего соединения. */
+    struct Reader {
+        QThread *thread = nullptr;   ///< Поток, владеющий соединением.
+        QObject *executor = nullptr; ///< Якорь потока для invokeMethod.
+        QString connectionName;      ///< Имя соединения Qt SQL читателя.
+    };
+
+    QThread m_thread;          ///< Выделенный поток для операций записи.
+    QObject *m_executor;       ///< Объект-исполнитель, живущий в m_thread.
+    QString m_databaseName;    ///< Имя файла базы данных.
+    QString m_connectionName;  ///< Имя соединения Qt SQL писателя.
+    QVector<Reader> m_readers; ///< Пул читающих соединений.
+    int m_nextReader = 0;      ///< Курсор round-robin по читателям.
+};
+
+#endif // DATABASESERVICE_H
@@ -0,0 +1,108 @@
+//См. "dbmaintenance.h"
+#include "dbmaintenance.h"
+#include "servermetrics.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+DbMaintenance::DbMaintenance(ServerMetrics *metrics, QObject *parent)
+    : QObject(parent)
+    , m_metrics(metrics)
+{
+    m_sinceAnalyze.start();
+
+    connect(&m_timer, &QTimer::timeout, this, &DbMaintenance::tick);
+    m_timer.start(TickIntervalMs);
+
+    qInfo() << "[DB] Maintenance scheduler started: checkpoint every"
+            << TickIntervalMs / 1000 << "s, vacuum/ANALYZE in idle windows";
+}
+
+
+void DbMaintenance::tick()
+{
+    // Работает на главном соединении в основном потоке — там же, где все
+    // записи сервера, поэтому конфликтов писателей не бывает по построению.
+
+    // 1. Пассивный checkpoint на каждом тике: переносит только кадры, не
+    // удерживаемые читателями, и не блокирует ни писателя, ни читателей.
+    // Держит WAL коротким, чтобы TRUNCATE в тихое окно был дешев.
+    runCheckpoint("PASSIVE");
+
+    // 2. Тихое окно определяем по счетчику обработчиков: если за минуту
+    // пришло меньше IdleRequestsPerTick запросов, нагрузка мала и можно
+    // позволить работы потяжелее.
+    const quint64 calls = m_metrics ? m_metrics->totalHandlerCalls() : 0;
+    const quint64 delta = calls - m_lastHandlerCalls;
+    m_lastHandlerCalls = calls;
+
+    if (delta >= quint64(IdleRequestsPerTick)) {
+        return;
+    }
+
+    // 3. Ограниченная порция incremental_vacuum: возвращает файловой системе
+    // до VacuumPagesPerStep страниц из freelist. Порция мала, поэтому даже
+    // ошибочное срабатывание в нагрузку стоит миллисекунды.
+    QSqlQuery query;
+    qint64 freeBefore = 0;
+    if (query.exec("PRAGMA freelist_count;") && query.next()) {
+        freeBefore = query.value(0).toLongLong();
+    }
+
+    if (freeBefore > 0) {
+        if (!query.exec(QStringLiteral("PRAGMA incremental_vacuum(%1);")
+                            .arg(VacuumPagesPerStep))) {
+            qWarning() << "[DB] incremental_vacuum failed:"
+                       << query.lastError().text();
+        } else if (query.exec("PRAGMA freelist_count;") && query.next()) {
+            const qint64 freeAfter = query.value(0).toLongLong();
+            if (freeBefore > freeAfter) {
+                m_pagesVacuumed += freeBefore - freeAfter;
+            }
+        }
+    }
+
+    // 4. TRUNCATE-checkpoint: в тихое окно читателей, удерживающих хвост
+    // WAL, почти наверняка нет — журнал сбрасывается в ноль.
+    runCheckpoint("TRUNCATE");
+
+    // 5. Суточный ANALYZE — самая тяжелая работа, поэтому только в тихое
+    // окно. Держит статистику планировщика свежей: без нее после роста
+    // таблиц SQLite выбирает неудачные планы для handleGetHistory.
+    if (!m_analyzeDone || m_sinceAnalyze.elapsed() >= AnalyzeIntervalMs) {
+        QElapsedTimer analyzeTimer;
+        analyzeTimer.start();
+
+        if (query.exec("ANALYZE;")) {
+            ++m_analyzeRuns;
+            m_analyzeDone = true;
+            m_sinceAnalyze.restart();
+            qInfo() << "[DB] ANALYZE completed in" << analyzeTimer.elapsed() << "ms";
+        } else {
+            qWarning() << "[DB] ANALYZE failed:" << query.lastError().text();
+        }
+    }
+}
+
+
+void DbMaintenance::runCheckpoint(const char *mode)
+{
+    QSqlQuery query;
+    if (!query.exec(QStringLiteral("PRAGMA wal_checkpoint(%1);")
+                        .arg(QLatin1String(mode)))) {
+        qWarning() << "[DB] wal_checkpoint(" << mode << ") failed:"
+                   << query.lastError().text();
+        return;
+    }
+
+    // Прагма возвращает строку (busy, log, checkpointed); checkpointed —
+    // число кадров WAL, фактически перенесенных в основной файл
+    if (query.next()) {
+        const qint64 checkpointed = query.value(2).toLongLong();
+        if (checkpointed > 0) {
+            m_framesCheckpointed += checkpointed;
+        }
+    }
+    ++m_checkpointsCompleted;
+}
@@ -0,0 +1,96 @@
+#ifndef DBMAINTENANCE_H
+#define DBMAINTENANCE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+class ServerMetrics;
+
+/**
+ * @class DbMaintenance
+ * @brief Фоновое обслуживание серверной SQLite: checkpoint, vacuum, ANALYZE.
+ *
+ * @details До сих пор базу никто не обслуживал: WAL-журнал чекпойнтился
+ * только автоматикой SQLite, статистика планировщика не обновлялась никогда,
+ * а освобожденные страницы копились, пока многогигабайтный файл не
+ * фрагментировался до ручного VACUUM с простоем. Планировщик раз в минуту
+ * выполняет ограниченную порцию работ на главном соединении:
+ *
+ * - **каждый тик** — `wal_checkpoint(PASSIVE)`: переносит в основной файл
+ *   только кадры, не удерживаемые читателями, и никогда не блокирует;
+ * - **в тихое окно** (менее IdleRequestsPerTick запросов за тик, по счетчику
+ *   обработчиков ServerMetrics) — `incremental_vacuum(N)` ограниченной
+ *   порцией страниц и `wal_checkpoint(TRUNCATE)` для сброса журнала;
+ * - **раз в сутки, только в тихое окно** — `ANALYZE`, чтобы планировщик
+ *   держал актуальные планы для handleGetHistory и поиска.
+ *
+ * Порции намеренно малы: каждый шаг занимает миллисекунды, и обслуживание
+ * не дает всплесков задержки даже при попадании в нагрузку. Счетчики работ
+ * отдаются наружу через gauge-метрики админ-эндпоинта.
+ *
+ * @note incremental_vacuum работает при `PRAGMA auto_vacuum=INCREMENTAL`
+ * (включается в initDatabase). На базах, созданных до включения, прагма
+ * вступит в силу после первого ручного VACUUM; до того шаг — безвредный no-op.
+ */
+class DbMaintenance : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** @brief Период тика обслуживания, мс. */
+    static constexpr int TickIntervalMs = 60 * 1000;
+
+    /** @brief Порог тихого окна: меньше запросов за тик — трафик низкий. */
+    static constexpr qint64 IdleRequestsPerTick = 50;
+
+    /** @brief Страниц за одну порцию incremental_vacuum (1 МБ при 4К-страницах). */
+    static constexpr int VacuumPagesPerStep = 256;
+
+    /** @brief Интервал полного ANALYZE, мс (раз в сутки). */
+    static constexpr qint64 AnalyzeIntervalMs = 24LL * 60 * 60 * 1000;
+
+    /**
+     * @brief Конструктор: запускает минутный таймер обслуживания.
+     * @param metrics Метрики сервера — источник счетчика запросов для
+     *        определения тихих окон.
+     * @param parent Родительский объект (сервер).
+     */
+    explicit DbMaintenance(ServerMetrics *metrics, QObject *parent = nullptr);
+
+    /** @brief Выполненных wal_checkpoint (PASSIVE и TRUNCATE). */
+    qint64 checkpointsCompleted() const { return m_checkpointsCompleted; }
+
+    /** @brief Кадров WAL, перенесенных в основной файл. */
+    qint64 framesCheckpointed() const { return m_framesCheckpointed; }
+
+    /** @brief Страниц, возвращенных файловой системе incremental_vacuum. */
+    qint64 pagesVacuumed() const { return m_pagesVacuumed; }
+
+    /** @brief Выполненных проходов ANALYZE. */
+    qint64 analyzeRuns() const { return m_analyzeRuns; }
+
+private slots:
+    /** @brief Минутный тик: checkpoint всегда, vacuum/ANALYZE — в тихое окно. */
+    void tick();
+
+private:
+    /**
+     * @brief Выполняет wal_checkpoint указанного режима.
+     * @param mode "PASSIVE" или "TRUNCATE".
+     */
+    void runCheckpoint(const char *mode);
+
+    ServerMetrics *m_metrics;       ///< Счетчик запросов для детекции тихих окон.
+    QTimer m_timer;                 ///< Минутный таймер обслуживания.
+    QElapsedTimer m_sinceAnalyze;   ///< Время с последнего ANALYZE.
+    quint64 m_lastHandlerCalls = 0; ///< Счетчик запросов на прошлом тике.
+    bool m_analyzeDone = false;     ///< Был ли хоть один ANALYZE.
+
+    qint64 m_checkpointsCompleted = 0; ///< Счетчик чекпойнтов.
+    qint64 m_framesCheckpointed = 0;   ///< Перенесенных кадров WAL.
+    qint64 m_pagesVacuumed = 0;        ///< Освобожденных страниц.
+    qint64 m_analyzeRuns = 0;          ///< Проходов ANALYZE.
+};
+
+#endif // DBMAINTENANCE_H
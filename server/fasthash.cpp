@@ -0,0 +1,211 @@
+//См. "fasthash.h"
+#include "fasthash.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+// ═══════════════════════════════════════════════════════════════════════════
+// CRC-32C: программный slice-by-8
+// ═══════════════════════════════════════════════════════════════════════════
+
+/** @brief Таблицы slice-by-8 (8 x 256), генерируются при первом вызове. */
+struct Crc32cTables {
+    quint32 t[8][256];
+
+    Crc32cTables()
+    {
+        // Отраженный полином Кастаньоли
+        constexpr quint32 poly = 0x82F63B78u;
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+            }
+            t[0][i] = crc;
+        }
+        for (quint32 i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice) {
+                t[slice][i] = (t[slice - 1][i] >> 8)
+                              ^ t[0][t[slice - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+quint32 crc32cSoft(const char* data, qsizetype len, quint32 crc)
+{
+    static const Crc32cTables tables;
+    const quint32 (*t)[256] = tables.t;
+
+    const quint8* p = reinterpret_cast<const quint8*>(data);
+    crc = ~crc;
+
+    // По 8 байт за шаг: каждая таблица закрывает свой байт слова.
+    // Слово читается как little-endian — порядок байтов CRC не зависит
+    // от платформы
+    while (len >= 8) {
+        const quint64 word = qFromLittleEndian<quint64>(p);
+        const quint32 low = quint32(word);
+        const quint32 high = quint32(word >> 32);
+        const quint32 x = crc ^ low;
+        crc = t[7][x & 0xFF] ^ t[6][(x >> 8) & 0xFF]
+              ^ t[5][(x >> 16) & 0xFF] ^ t[4][x >> 24]
+              ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF]
+              ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+// CRC-32C: аппаратный путь SSE4.2 (x86)
+// ═══════════════════════════════════════════════════════════════════════════
+
+#if defined(Q_PROCESSOR_X86_64) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+#define FASTHASH_HAVE_SSE42_CRC 1
+
+__attribute__((target("sse4.2")))
+quint32 crc32cHw(const char* data, qsizetype len, quint32 crc)
+{
+    const quint8* p = reinterpret_cast<const quint8*>(data);
+    quint64 c = ~crc;
+
+    while (len >= 8) {
+        quint64 word;
+        memcpy(&word, p, 8);
+        c = __builtin_ia32_crc32di(c, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        c = __builtin_ia32_crc32qi(quint32(c), *p++);
+    }
+    return ~quint32(c);
+}
+
+/** @brief Доступность аппаратного CRC проверяется один раз. */
+bool sse42Available()
+{
+    static const bool available = __builtin_cpu_supports("sse4.2");
+    return available;
+}
+
+#endif // FASTHASH_HAVE_SSE42_CRC
+
+// ═══════════════════════════════════════════════════════════════════════════
+// XXH64
+// ═══════════════════════════════════════════════════════════════════════════
+
+constexpr quint64 Prime1 = 11400714785074694791ULL;
+constexpr quint64 Prime2 = 14029467366897019727ULL;
+constexpr quint64 Prime3 = 1609587929392839161ULL;
+constexpr quint64 Prime4 = 9650029242287828579ULL;
+constexpr quint64 Prime5 = 2870177450012600261ULL;
+
+inline quint64 rotl64(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline quint64 read64(const quint8* p)
+{
+    quint64 v;
+    memcpy(&v, p, 8);
+    return qFromLittleEndian<quint64>(&v);
+}
+
+inline quint64 read32(const quint8* p)
+{
+    quint32 v;
+    memcpy(&v, p, 4);
+    return qFromLittleEndian<quint32>(&v);
+}
+
+inline quint64 xxhRound(quint64 acc, quint64 input)
+{
+    acc += input * Prime2;
+    acc = rotl64(acc, 31);
+    return acc * Prime1;
+}
+
+inline quint64 xxhMerge(quint64 acc, quint64 val)
+{
+    acc ^= xxhRound(0, val);
+    return acc * Prime1 + Prime4;
+}
+
+} // namespace
+
+quint32 FastHash::crc32c(const char* data, qsizetype len, quint32 seed)
+{
+#ifdef FASTHASH_HAVE_SSE42_CRC
+    if (sse42Available()) {
+        return crc32cHw(data, len, seed);
+    }
+#endif
+    return crc32cSoft(data, len, seed);
+}
+
+quint64 FastHash::hash64(const char* data, qsizetype len, quint64 seed)
+{
+    const quint8* p = reinterpret_cast<const quint8*>(data);
+    const quint8* const end = p + len;
+    quint64 h;
+
+    if (len >= 32) {
+        // Четыре независимые полосы: конвейер умножений не простаивает
+        quint64 v1 = seed + Prime1 + Prime2;
+        quint64 v2 = seed + Prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - Prime1;
+        const quint8* const limit = end - 32;
+        do {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p + 8));
+            v3 = xxhRound(v3, read64(p + 16));
+            v4 = xxhRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    } else {
+        h = seed + Prime5;
+    }
+
+    h += quint64(len);
+
+    // Хвост: 8-, 4- и однобайтовые шаги
+    while (p + 8 <= end) {
+        h ^= xxhRound(0, read64(p));
+        h = rotl64(h, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= read32(p) * Prime1;
+        h = rotl64(h, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * Prime5;
+        h = rotl64(h, 11) * Prime1;
+    }
+
+    // Финальная лавина
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,493 @@
+#include "filetransfer.h"
+#include "fasthash.h"
+
+#include <QDir>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QUuid>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+/**
+ * @brief Готовит каталог хранилища и потолок размера файла.
+ *
+ * @details Хранилище по умолчанию — подкаталог `files` рабочей директории
+ * (рядом с messenger.db); переменная окружения MESSENGER_FILES_DIR задает
+ * другой путь, MESSENGER_MAX_FILE_MB — другой потолок размера.
+ */
+FileTransfer::FileTransfer()
+{
+    m_storageDir = QString::fromUtf8(qgetenv("MESSENGER_FILES_DIR"));
+    if (m_storageDir.isEmpty()) {
+        m_storageDir = QStringLiteral("files");
+    }
+
+    if (!QDir().mkpath(m_storageDir)) {
+        qCritical() << "[FILES] Failed to create storage directory:" << m_storageDir;
+    }
+
+    // Недокачанные resumable-загрузки живут отдельно от готовых блобов
+    m_partialDir = m_storageDir + QStringLiteral("/partial");
+    if (!QDir().mkpath(m_partialDir)) {
+        qCritical() << "[FILES] Failed to create partial directory:" << m_partialDir;
+    }
+
+    // Брошенные partial-файлы (клиент так и не вернулся) выметаются
+    // по возрасту, чтобы не копиться бесконечно
+    const QDateTime cutoff = QDateTime::currentDateTime().addDays(-PartialMaxAgeDays);
+    const QFileInfoList stale = QDir(m_partialDir).entryInfoList(QDir::Files);
+    for (const QFileInfo& info : stale) {
+        if (info.lastModified() < cutoff) {
+            QFile::remove(info.absoluteFilePath());
+            qDebug() << "[FILES] Removed stale partial upload:" << info.fileName();
+        }
+    }
+
+    if (qEnvironmentVariableIsSet("MESSENGER_MAX_FILE_MB")) {
+        const qint64 mb = qEnvironmentVariableIntValue("MESSENGER_MAX_FILE_MB");
+        if (mb > 0) {
+            m_maxFileBytes = mb * 1024 * 1024;
+        }
+    }
+
+    qDebug() << "[FILES] Storage:" << QDir(m_storageDir).absolutePath()
+             << "max file:" << m_maxFileBytes / (1024 * 1024) << "MB";
+}
+
+
+FileTransfer::~FileTransfer()
+{
+    // Недописанные загрузки не должны оставаться в хранилище мусором.
+    const QList<quint32> uploadIds = m_uploads.keys();
+    for (quint32 id : uploadIds) {
+        dropUpload(id);
+    }
+
+    const QList<quint32> downloadIds = m_downloads.keys();
+    for (quint32 id : downloadIds) {
+        finishDownload(id);
+    }
+}
+
+
+// ═══════════════════════════════════════════════════════════════════════════
+// Формат чанка
+// ═══════════════════════════════════════════════════════════════════════════
+
+bool FileTransfer::isChunk(const QByteArray& payload)
+{
+    return payload.size() >= HeaderSize
+        && static_cast<quint8>(payload.at(0)) == ChunkMagic;
+}
+
+
+QByteArray FileTransfer::encodeChunk(quint32 transferId, quint32 seq,
+                                     const char* data, int length)
+{
+    QByteArray chunk(HeaderSize + length, Qt::Uninitialized);
+    char* p = chunk.data();
+    p[0] = static_cast<char>(ChunkMagic);
+    qToBigEndian(transferId, p + 1);
+    qToBigEndian(seq, p + 5);
+    qToBigEndian(FastHash::crc32c(data, length), p + 9);
+    memcpy(p + HeaderSize, data, static_cast<size_t>(length));
+    return chunk;
+}
+
+
+bool FileTransfer::decodeChunkHeader(const QByteArray& payload,
+                                     quint32& transferId, quint32& seq)
+{
+    if (!isChunk(payload)) {
+        return false;
+    }
+    const char* p = payload.constData();
+    transferId = qFromBigEndian<quint32>(p + 1);
+    seq = qFromBigEndian<quint32>(p + 5);
+
+    // Контрольная сумма полезной нагрузки: порченый чанк отбрасывается
+    // здесь, а не всей передачей при сверке SHA-256 в finishUpload
+    const quint32 expected = qFromBigEndian<quint32>(p + 9);
+    const quint32 actual = FastHash::crc32c(p + HeaderSize,
+                                            payload.size() - HeaderSize);
+    if (expected != actual) {
+        qWarning() << "[FILES] Chunk CRC mismatch: transfer" << transferId
+                   << "seq" << seq;
+        return false;
+    }
+    return true;
+}
+
+
+// ═══════════════════════════════════════════════════════════════════════════
+// Прием файлов (upload)
+// ═══════════════════════════════════════════════════════════════════════════
+
+quint32 FileTransfer::beginUpload(QObject* socket, const QString& fileName,
+                                  qint64 declaredSize, const QString& expectedHash,
+                                  qint64* resumeOffset, QString* error)
+{
+    *resumeOffset = 0;
+
+    if (declaredSize <= 0 || declaredSize > m_maxFileBytes) {
+        *error = QStringLiteral("Invalid file size");
+        return 0;
+    }
+
+    Upload upload;
+    upload.socket = socket;
+    upload.fileUuid = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    upload.fileName = fileName;
+    upload.expectedHash = expectedHash.toLower();
+    upload.declaredSize = declaredSize;
+    upload.hasher = new QCryptographicHash(QCryptographicHash::Sha256);
+
+    // Загрузка с заявленным хешем пишется в partial-файл под именем
+    // будущего блоба — при обрыве файл остается, и та же загрузка
+    // продолжается с его конца. Если этот же хеш прямо сейчас грузит
+    // кто-то другой, вторая передача идет обычным путем по UUID:
+    // два потока в один partial-файл писать нельзя.
+    upload.resumable = !upload.expectedHash.isEmpty();
+    for (auto it = m_uploads.constBegin();
+         upload.resumable && it != m_uploads.constEnd(); ++it) {
+        if (it->resumable && it->expectedHash == upload.expectedHash) {
+            upload.resumable = false;
+        }
+    }
+
+    const QString targetPath = upload.resumable
+        ? partialPathFor(upload.expectedHash)
+        : storagePathFor(upload.fileUuid);
+
+    upload.file = new QFile(targetPath);
+    if (upload.resumable && upload.file->exists()) {
+        // Докачка: дописываем с конца, но сперва досчитываем хеш по уже
+        // принятой части — finishUpload сверяет его как обычно
+        if (!upload.file->open(QIODevice::ReadWrite)) {
+            *error = QStringLiteral("Storage unavailable");
+            qCritical() << "[FILES] Cannot reopen partial upload:"
+                        << upload.file->fileName() << upload.file->errorString();
+            delete upload.file;
+            delete upload.hasher;
+            return 0;
+        }
+
+        qint64 kept = truncateToChunkBoundary(upload.file);
+        if (kept >= declaredSize) {
+            // Partial не меньше заявленного размера — он от другого файла
+            // или поврежден; докачивать нечего, начинаем с нуля
+            upload.file->resize(0);
+            kept = 0;
+        }
+
+        upload.file->seek(0);
+        if (!upload.hasher->addData(upload.file)) {
+            // Сохраненную часть не перечитать — начинаем с нуля
+            upload.file->resize(0);
+            upload.hasher->reset();
+            kept = 0;
+        }
+        upload.file->seek(kept);
+
+        upload.received = kept;
+        upload.nextSeq = static_cast<quint32>(kept / ChunkSize);
+        *resumeOffset = kept;
+
+        if (kept > 0) {
+            qInfo() << "[FILES] Resuming upload" << fileName
+                    << "from byte" << kept;
+        }
+    } else if (!upload.file->open(QIODevice::WriteOnly)) {
+        *error = QStringLiteral("Storage unavailable");
+        qCritical() << "[FILES] Cannot open upload target:"
+                    << upload.file->fileName() << upload.file->errorString();
+        delete upload.file;
+        delete upload.hasher;
+        return 0;
+    }
+
+    const quint32 transferId = m_nextTransferId++;
+    if (m_nextTransferId == 0) m_nextTransferId = 1;
+
+    m_uploads.insert(transferId, upload);
+    return transferId;
+}
+
+
+bool FileTransfer::writeUploadChunk(quint32 transferId, QObject* socket,
+                                    quint32 seq, const char* data, int length,
+                                    QString* error)
+{
+    auto it = m_uploads.find(transferId);
+    if (it == m_uploads.end() || it->socket != socket) {
+        *error = QStringLiteral("Unknown transfer");
+        return false;
+    }
+
+    // Чанки одного сокета приходят по одному TCP-потоку и не могут
+    // переупорядочиться; нарушение seq означает потерю данных или баг клиента.
+    if (seq != it->nextSeq) {
+        *error = QStringLiteral("Out-of-order chunk");
+        dropUpload(transferId);
+        return false;
+    }
+
+    if (it->received + length > it->declaredSize) {
+        *error = QStringLiteral("More data than declared");
+        dropUpload(transferId);
+        return false;
+    }
+
+    if (it->file->write(data, length) != length) {
+        *error = QStringLiteral("Storage write failed");
+        qCritical() << "[FILES] Write failed:" << it->file->errorString();
+        dropUpload(transferId);
+        return false;
+    }
+
+    // Хеш содержимого считается по ходу приема: к моменту finishUpload
+    // дополнительного прохода по файлу не требуется.
+    it->hasher->addData(QByteArrayView(data, length));
+
+    it->received += length;
+    ++it->nextSeq;
+    return true;
+}
+
+
+bool FileTransfer::finishUpload(quint32 transferId, QObject* socket,
+                                CompletedUpload& result, QString* error)
+{
+    auto it = m_uploads.find(transferId);
+    if (it == m_uploads.end() || it->socket != socket) {
+        *error = QStringLiteral("Unknown transfer");
+        return false;
+    }
+
+    if (it->received != it->declaredSize) {
+        *error = QStringLiteral("Size mismatch");
+        dropUpload(transferId);
+        return false;
+    }
+
+    const QString contentHash =
+        QString::fromLatin1(it->hasher->result().toHex());
+
+    // Клиент мог заявить хеш заранее (для дедупликации) — расхождение
+    // означает поврежденную передачу или подлог.
+    if (!it->expectedHash.isEmpty() && it->expectedHash != contentHash) {
+        *error = QStringLiteral("Content hash mismatch");
+        dropUpload(transferId);
+        return false;
+    }
+
+    it->file->close();
+
+    // Перекладываем временный файл в блоб-хранилище под именем хеша.
+    // Если блоб уже там (дубликат догнал оригинал), временный файл просто
+    // удаляется — содержимое байт-в-байт одно и то же.
+    const QString blobPath = storagePathFor(contentHash);
+    if (QFile::exists(blobPath)) {
+        it->file->remove();
+        result.deduplicated = true;
+    } else if (!it->file->rename(blobPath)) {
+        *error = QStringLiteral("Storage rename failed");
+        qCritical() << "[FILES] Cannot move upload into blob store:"
+                    << it->file->errorString();
+        dropUpload(transferId);
+        return false;
+    }
+
+    result.fileUuid = it->fileUuid;
+    result.fileName = it->fileName;
+    result.fileSize = it->received;
+    result.contentHash = contentHash;
+
+    delete it->file;
+    delete it->hasher;
+    m_uploads.erase(it);
+    return true;
+}
+
+
+bool FileTransfer::hasBlob(const QString& contentHash) const
+{
+    return !contentHash.isEmpty()
+        && QFile::exists(storagePathFor(contentHash.toLower()));
+}
+
+
+QString FileTransfer::uploadUuid(quint32 transferId) const
+{
+    auto it = m_uploads.constFind(transferId);
+    return it != m_uploads.constEnd() ? it->fileUuid : QString();
+}
+
+
+void FileTransfer::dropUpload(quint32 transferId, bool keepPartial)
+{
+    auto it = m_uploads.find(transferId);
+    if (it == m_uploads.end()) {
+        return;
+    }
+
+    if (keepPartial && it->resumable && it->received > 0) {
+        // Обрыв соединения: сохраняем принятое для докачки. Хвост за
+        // последней границей чанка срезается — beginUpload продолжит
+        // с целого seq, и подтвержденные клиенту байты не пропадут
+        truncateToChunkBoundary(it->file);
+        it->file->close();
+    } else {
+        it->file->close();
+        it->file->remove(); // Без докачки частичный файл бесполезен
+    }
+
+    delete it->file;
+    delete it->hasher;
+    m_uploads.erase(it);
+}
+
+
+qint64 FileTransfer::uploadedBytes(quint32 transferId) const
+{
+    auto it = m_uploads.constFind(transferId);
+    return it != m_uploads.constEnd() ? it->received : 0;
+}
+
+
+qint64 FileTransfer::truncateToChunkBoundary(QFile* file)
+{
+    const qint64 aligned = (file->size() / ChunkSize) * ChunkSize;
+    if (file->size() != aligned) {
+        file->resize(aligned);
+    }
+    return aligned;
+}
+
+
+QString FileTransfer::partialPathFor(const QString& contentHash) const
+{
+    return m_partialDir + QLatin1Char('/') + contentHash;
+}
+
+
+// ═══════════════════════════════════════════════════════════════════════════
+// Отдача файлов (download)
+// ═══════════════════════════════════════════════════════════════════════════
+
+quint32 FileTransfer::beginDownload(QObject* socket, const QString& fileUuid,
+                                    const QString& contentHash,
+                                    qint64& fileSize, QString* error)
+{
+    // Новые записи ссылаются на блоб по хешу содержимого; записи времен
+    // по-файлового хранения (без хеша) лежат под своим UUID.
+    const QString storageKey =
+        contentHash.isEmpty() ? fileUuid : contentHash.toLower();
+
+    Download download;
+    download.socket = socket;
+    download.fileUuid = fileUuid;
+    download.file = new QFile(storagePathFor(storageKey));
+
+    if (!download.file->open(QIODevice::ReadOnly)) {
+        *error = QStringLiteral("File not found in storage");
+        delete download.file;
+        return 0;
+    }
+
+    download.size = download.file->size();
+
+    // Отображение в память: чанки читаются прямо из страничного кэша ОС,
+    // без буфера read() на каждую порцию. Для пустых файлов map не нужен.
+    if (download.size > 0) {
+        download.mapped = download.file->map(0, download.size);
+        if (!download.mapped) {
+            *error = QStringLiteral("Cannot map file");
+            qCritical() << "[FILES] map() failed for" << download.file->fileName();
+            delete download.file;
+            return 0;
+        }
+    }
+
+    const quint32 transferId = m_nextTransferId++;
+    if (m_nextTransferId == 0) m_nextTransferId = 1;
+
+    fileSize = download.size;
+    m_downloads.insert(transferId, download);
+    return transferId;
+}
+
+
+QByteArray FileTransfer::nextDownloadChunk(quint32 transferId, quint32& seq)
+{
+    auto it = m_downloads.find(transferId);
+    if (it == m_downloads.end() || it->offset >= it->size) {
+        return QByteArray();
+    }
+
+    const qint64 length = qMin<qint64>(ChunkSize, it->size - it->offset);
+    seq = it->nextSeq++;
+
+    // fromRawData не копирует: массив ссылается на mmap-страницы и живет
+    // только до finishDownload — вызывающий кадрирует и шифрует его сразу.
+    const QByteArray view = QByteArray::fromRawData(
+        reinterpret_cast<const char*>(it->mapped) + it->offset,
+        static_cast<int>(length));
+
+    it->offset += length;
+    return view;
+}
+
+
+bool FileTransfer::downloadFinished(quint32 transferId) const
+{
+    auto it = m_downloads.constFind(transferId);
+    return it == m_downloads.constEnd() || it->offset >= it->size;
+}
+
+
+void FileTransfer::finishDownload(quint32 transferId)
+{
+    auto it = m_downloads.find(transferId);
+    if (it == m_downloads.end()) {
+        return;
+    }
+    if (it->mapped) {
+        it->file->unmap(it->mapped);
+    }
+    delete it->file;
+    m_downloads.erase(it);
+}
+
+
+void FileTransfer::abortSocket(QObject* socket)
+{
+    // Разрыв соединения — не ошибка данных: resumable-передачи оставляют
+    // partial-файл, и клиент докачает после реконнекта
+    const QList<quint32> uploadIds = m_uploads.keys();
+    for (quint32 id : uploadIds) {
+        auto it = m_uploads.constFind(id);
+        if (it != m_uploads.constEnd() && it->socket == socket) {
+            dropUpload(id, /*keepPartial=*/true);
+        }
+    }
+
+    for (auto it = m_downloads.begin(); it != m_downloads.end();) {
+        if (it->socket == socket) {
+            if (it->mapped) {
+                it->file->unmap(it->mapped);
+            }
+            delete it->file;
+            it = m_downloads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+
+QString FileTransfer::storagePathFor(const QString& fileUuid) const
+{
+    return m_storageDir + QLatin1Char('/') + fileUuid;
+}
@@ -0,0 +1,241 @@
+#ifndef FILETRANSFER_H
+#define FILETRANSFER_H
+
+#include <QObject>
+#include <QHash>
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QCryptographicHash>
+
+/**
+ * @brief Потоковая передача файлов порциями фиксированного размера.
+ *
+ * @details Исторически файлы ходили через внешний HTTP-сервис и не касались
+ * основного соединения. FileTransfer переносит их в то же шифрованное
+ * соединение, но отдельным бинарным каналом: управляющие команды
+ * (`file_upload_begin`, `file_upload_finish`, `file_download`) остаются
+ * JSON-запросами, а сами данные идут кадрами-чанками с собственным
+ * magic-байтом (ChunkMagic) — по аналогии с записями BinaryCodec и
+ * Compression, которые тоже различаются первым байтом расшифрованного кадра.
+ *
+ * Ключевое свойство — O(chunk) память на передачу:
+ * - На загрузке каждый принятый чанк немедленно пишется в файл хранилища;
+ *   в памяти никогда не находится больше одного чанка.
+ * - На отдаче файл отображается в память (QFile::map), и чанки читаются
+ *   прямо из страничного кэша ОС без промежуточного буфера read().
+ *
+ * Хранилище адресуется содержимым: завершенная загрузка попадает в него
+ * под именем SHA-256 своих байт, поэтому один и тот же файл, загруженный
+ * пятьюдесятью пользователями, физически лежит один раз. Хеш считается
+ * инкрементально по мере приема чанков; клиент может прислать его заранее
+ * и вовсе пропустить передачу при попадании (см. handleFileUploadBegin).
+ * Счетчики ссылок на блобы ведет Server в таблице `blobs`.
+ *
+ * Загрузки с заявленным хешем докачиваются после разрыва: их данные
+ * пишутся в подкаталог partial под именем будущего блоба, при обрыве
+ * соединения недописанный файл сохраняется (обрезанным до границы чанка),
+ * и следующий beginUpload с тем же хешем продолжает с этого места —
+ * клиенту возвращается resume_offset. Загрузки без хеша, как раньше,
+ * пишутся под UUID передачи и при обрыве удаляются: без хеша нельзя
+ * убедиться, что докачка продолжает тот же файл. Брошенные partial-файлы
+ * выметаются при старте по возрасту.
+ *
+ * Формат чанка (после расшифровки кадра):
+ *   [ChunkMagic:1][transferId:4 BE][seq:4 BE][crc32c:4 BE][payload:N]
+ *
+ * crc32c — контрольная сумма полезной нагрузки чанка (FastHash::crc32c,
+ * на x86 — аппаратная инструкция). AEAD-слой уже защищает кадр на
+ * проводе; CRC ловит порчу по эту сторону расшифровки — в буферах,
+ * памяти и на пути до диска — до того, как finishUpload обнаружит
+ * несовпадение SHA-256 и выбросит всю передачу целиком.
+ *
+ * Класс управляет только хранилищем и состоянием передач; отправку чанков
+ * в сокеты (с учетом их потоков и backpressure) выполняет Server.
+ */
+class FileTransfer
+{
+public:
+    /** @brief Первый байт чанка (не пересекается с BinaryCodec и Compression). */
+    static constexpr quint8 ChunkMagic = 0xF5;
+
+    /** @brief Размер заголовка чанка: magic + transferId + seq + crc32c. */
+    static constexpr int HeaderSize = 13;
+
+    /** @brief Размер порции данных: достаточно крупно для пропускной
+     *  способности, достаточно мелко, чтобы не раздувать буферы записи. */
+    static constexpr int ChunkSize = 256 * 1024;
+
+    /** @brief Потолок размера файла по умолчанию (переопределяется
+     *  переменной окружения MESSENGER_MAX_FILE_MB). */
+    static constexpr qint64 DefaultMaxFileBytes = 512LL * 1024 * 1024;
+
+    /** @brief Каждый сколький принятый чанк сервер подтверждает
+     *  file_upload_ack: клиент по ним двигает скользящее окно отправки,
+     *  а подтвержденные байты уже лежат на диске — докачка точная. */
+    static constexpr int AckChunkInterval = 4;
+
+    /** @brief Возраст, после которого брошенный partial-файл удаляется. */
+    static constexpr int PartialMaxAgeDays = 7;
+
+    /** @brief Описание завершенной загрузки (для записи в таблицу files). */
+    struct CompletedUpload {
+        QString fileUuid;
+        QString fileName;
+        qint64 fileSize = 0;
+        /** @brief SHA-256 содержимого (hex) — ключ в блоб-хранилище. */
+        QString contentHash;
+        /** @brief true, если блоб уже лежал в хранилище (дубликат). */
+        bool deduplicated = false;
+    };
+
+    FileTransfer();
+    ~FileTransfer();
+
+    /** @brief true, если расшифрованный кадр — чанк файловой передачи. */
+    static bool isChunk(const QByteArray& payload);
+
+    /** @brief Собирает чанк: заголовок плюс копия порции данных. */
+    static QByteArray encodeChunk(quint32 transferId, quint32 seq,
+                                  const char* data, int length);
+
+    /**
+     * @brief Разбирает заголовок чанка и сверяет CRC полезной нагрузки.
+     * @return false при усеченном кадре или несовпадении контрольной
+     * суммы; payload начинается с HeaderSize.
+     */
+    static bool decodeChunkHeader(const QByteArray& payload,
+                                  quint32& transferId, quint32& seq);
+
+    /**
+     * @brief Начинает прием файла: создает запись передачи и временный файл.
+     * @details С заявленным хешем данные пишутся в partial-файл под именем
+     * будущего блоба; если такой файл остался от прерванной передачи,
+     * прием продолжается с его конца (resumeOffset — сколько байт уже
+     * на диске, nextSeq сдвинут соответственно, хеш досчитывается по
+     * сохраненной части). Без хеша — временный файл по UUID передачи,
+     * как раньше. При завершении файл перекладывается в блоб-хранилище
+     * под именем SHA-256 содержимого; expectedHash сверяется в finishUpload.
+     * @param resumeOffset Выход: байт, с которого клиент продолжает (0 — с начала)
+     * @return Идентификатор передачи или 0 при ошибке (текст — в error).
+     */
+    quint32 beginUpload(QObject* socket, const QString& fileName,
+                        qint64 declaredSize, const QString& expectedHash,
+                        qint64* resumeOffset, QString* error);
+
+    /**
+     * @brief Дописывает принятый чанк в файл передачи.
+     * @details Чанки применяются строго по порядку seq; нарушение порядка
+     * или превышение заявленного размера прерывает передачу.
+     */
+    bool writeUploadChunk(quint32 transferId, QObject* socket, quint32 seq,
+                          const char* data, int length, QString* error);
+
+    /**
+     * @brief Завершает прием: сверяет размер и фиксирует файл в хранилище.
+     */
+    bool finishUpload(quint32 transferId, QObject* socket,
+                      CompletedUpload& result, QString* error);
+
+    /** @brief UUID файла, принимаемого в рамках передачи (для ответов). */
+    QString uploadUuid(quint32 transferId) const;
+
+    /** @brief Байт передачи уже записано на диск (для file_upload_ack). */
+    qint64 uploadedBytes(quint32 transferId) const;
+
+    /**
+     * @brief Начинает отдачу файла: открывает и отображает его в память.
+     * @details Файл берется из блоб-хранилища по contentHash; для записей
+     * до ввода дедупликации (contentHash пуст) — по UUID, как раньше.
+     * @return Идентификатор передачи или 0 при ошибке.
+     */
+    quint32 beginDownload(QObject* socket, const QString& fileUuid,
+                          const QString& contentHash,
+                          qint64& fileSize, QString* error);
+
+    /** @brief true, если блоб с данным хешем уже есть в хранилище. */
+    bool hasBlob(const QString& contentHash) const;
+
+    /**
+     * @brief Следующая порция отдачи прямо из отображенной области.
+     * @details Возвращенный QByteArray ссылается на mmap-страницы без
+     * копирования (fromRawData) и действителен до finishDownload/abortSocket.
+     * @return Пустой массив, когда файл отдан целиком.
+     */
+    QByteArray nextDownloadChunk(quint32 transferId, quint32& seq);
+
+    /** @brief true, если все данные передачи уже выданы nextDownloadChunk. */
+    bool downloadFinished(quint32 transferId) const;
+
+    /** @brief Освобождает состояние завершенной или прерванной отдачи. */
+    void finishDownload(quint32 transferId);
+
+    /** @brief Прерывает все передачи сокета (разрыв соединения). */
+    void abortSocket(QObject* socket);
+
+    /** @brief Абсолютный путь файла хранилища по его UUID. */
+    QString storagePathFor(const QString& fileUuid) const;
+
+    /** @brief Потолок размера принимаемого файла. */
+    qint64 maxFileBytes() const { return m_maxFileBytes; }
+
+    /** @brief Активных загрузок (для метрик). */
+    int activeUploads() const { return m_uploads.size(); }
+
+    /** @brief Активных отдач (для метрик). */
+    int activeDownloads() const { return m_downloads.size(); }
+
+private:
+    /** @brief Состояние приема одного файла. */
+    struct Upload {
+        QObject* socket = nullptr;
+        QString fileUuid;
+        QString fileName;
+        QString expectedHash;
+        qint64 declaredSize = 0;
+        qint64 received = 0;
+        quint32 nextSeq = 0;
+        QFile* file = nullptr;
+        /** @brief SHA-256 считается инкрементально по мере приема чанков. */
+        QCryptographicHash* hasher = nullptr;
+        /** @brief Данные идут в partial-файл по хешу: при обрыве файл
+         *  сохраняется для докачки, а не удаляется. */
+        bool resumable = false;
+    };
+
+    /** @brief Состояние отдачи одного файла. */
+    struct Download {
+        QObject* socket = nullptr;
+        QString fileUuid;
+        QFile* file = nullptr;
+        uchar* mapped = nullptr;
+        qint64 size = 0;
+        qint64 offset = 0;
+        quint32 nextSeq = 0;
+    };
+
+    /**
+     * @brief Удаляет передачу.
+     * @param keepPartial Сохранить недописанный файл для докачки (только
+     *        resumable-передачи; файл обрезается до границы чанка).
+     */
+    void dropUpload(quint32 transferId, bool keepPartial = false);
+
+    /** @brief Путь partial-файла докачиваемой загрузки по хешу содержимого. */
+    QString partialPathFor(const QString& contentHash) const;
+
+    /** @brief Обрезает файл до границы чанка и возвращает итоговый размер. */
+    static qint64 truncateToChunkBoundary(QFile* file);
+
+    QString m_storageDir;
+    QString m_partialDir;
+    qint64 m_maxFileBytes = DefaultMaxFileBytes;
+
+    QHash<quint32, Upload> m_uploads;
+    QHash<quint32, Download> m_downloads;
+
+    /** @brief Счетчик идентификаторов передач (0 зарезервирован под ошибку). */
+    quint32 m_nextTransferId = 1;
+};
+
+#endif // FILETRANSFER_H
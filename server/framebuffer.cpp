@@ -0,0 +1,98 @@
+/**
+ * @file framebuffer.cpp
+ * @brief Реализация инкрементального парсера кадров.
+ *
+ * @details Префикс длины читается вручную в big-endian — так же его пишет
+ * QDataStream на стороне клиента, поэтому форматы полностью совместимы.
+ */
+
+#include <QtEndian>
+
+#include "framebuffer.h"
+
+void FrameBuffer::append(const QByteArray& chunk)
+{
+    if (m_head == m_buffer.size()) {
+        // Все обработано: обнуляем размер, емкость QByteArray сохраняется —
+        // следующее чтение пройдет без реаллокации.
+        m_buffer.resize(0);
+        m_head = 0;
+    } else if (m_head > CompactThreshold) {
+        // Обработанный префикс разросся: сдвигаем хвост одним memmove,
+        // чтобы буфер не рос бесконечно.
+        m_buffer.remove(0, m_head);
+        m_head = 0;
+    }
+
+    m_buffer.append(chunk);
+}
+
+
+bool FrameBuffer::nextFrame(QByteArray& frame, quint32 limit)
+{
+    // Переполнение фатально: границы потока потеряны, кадры не выдаются
+    if (m_overflowed) {
+        return false;
+    }
+
+    // --- Этап 1: Заголовок с размером кадра (quint32, big-endian) ---
+    if (m_pendingSize == 0) {
+        if (m_buffer.size() - m_head < qsizetype(sizeof(quint32))) {
+            return false; // Заголовок еще не пришел целиком
+        }
+        m_pendingSize = qFromBigEndian<quint32>(m_buffer.constData() + m_head);
+        m_head += sizeof(quint32);
+    }
+
+    // Лимит проверяется по префиксу, до накопления тела: гигабайтный
+    // префикс не заставит буферизовать гигабайт.
+    if (m_pendingSize > limit) {
+        m_overflowed = true;
+        return false;
+    }
+
+    // --- Этап 2: Полное тело кадра ---
+    if (m_buffer.size() - m_head < qsizetype(m_pendingSize)) {
+        return false; // Данных пока недостаточно — ждем
+    }
+
+    // Представление внутрь буфера: ни одной копии тела кадра.
+    frame = QByteArray::fromRawData(m_buffer.constData() + m_head, m_pendingSize);
+    m_head += m_pendingSize;
+    m_pendingSize = 0;
+    return true;
+}
+
+
+QByteArray FrameBuffer::pendingBytes() const
+{
+    QByteArray out;
+    if (m_pendingSize != 0) {
+        // Заголовок текущего кадра уже вырезан из буфера — восстанавливаем
+        // его, чтобы парсер получателя начал с границы кадра
+        char header[sizeof(quint32)];
+        qToBigEndian<quint32>(m_pendingSize, header);
+        out.append(header, sizeof(header));
+    }
+    out.append(m_buffer.constData() + m_head, m_buffer.size() - m_head);
+    return out;
+}
+
+
+void FrameBuffer::trim()
+{
+    // Недообработанные данные (полукадр) — буфер еще нужен как есть.
+    if (m_head != m_buffer.size()) {
+        return;
+    }
+
+    if (m_buffer.capacity() > IdleCapacityBytes) {
+        // Разросся на всплеске (крупный кадр, пачка сообщений) — отдаем
+        // память системе, простаивающее соединение ее не удерживает.
+        m_buffer = QByteArray();
+    } else {
+        // Небольшая емкость остается под переиспользование.
+        m_buffer.resize(0);
+    }
+    m_head = 0;
+}
@@ -0,0 +1,171 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <QByteArray>
+#include <QTcpSocket>
+
+#include "cryptoutils.h"
+
+/**
+ * @class FrameBuffer
+ * @brief Инкрементальный парсер потока пакетов с префиксом длины.
+ *
+ * @details Исторически границы пакетов отслеживались картой
+ * `QMap<QTcpSocket*, quint32> m_nextBlockSizes` с поиском на каждый readyRead
+ * и сборкой пакетов через промежуточные копии QByteArray. На пиках трафика
+ * (~10k сообщений в минуту) копирование на каждое чтение хорошо видно в
+ * профиле аллокаций.
+ *
+ * FrameBuffer владеет растущим буфером, в который дописываются сырые байты
+ * из сокета, и нарезает из него готовые кадры БЕЗ копирования: nextFrame()
+ * возвращает QByteArray::fromRawData-представление, указывающее внутрь
+ * буфера. Емкость буфера переиспользуется между чтениями; сдвиг хвоста
+ * (memmove) происходит только когда накопленный «прочитанный» префикс
+ * превышает порог компактификации.
+ *
+ * Формат потока — тот же, что у QDataStream-фрейминга клиента:
+ * `[длина кадра quint32, big-endian][тело кадра]`.
+ *
+ * @warning Возвращенный кадр действителен только до следующего вызова
+ * append(): обрабатывайте все кадры до следующего чтения из сокета
+ * (именно так устроены циклы onTcpReadyRead / onReadyRead).
+ */
+class FrameBuffer
+{
+public:
+    /**
+     * @brief Дописывает сырые байты из сокета в конец буфера.
+     * @details Перед дописыванием буфер при возможности компактифицируется:
+     * полностью обработанный — обнуляется с сохранением емкости, сильно
+     * «израсходованный» — сдвигается одним memmove.
+     */
+    void append(const QByteArray& chunk);
+
+    /**
+     * @brief Пытается вырезать следующий полный кадр.
+     *
+     * @details Заявленный размер кадра проверяется сразу по префиксу, ДО
+     * накопления тела: злонамеренный (или сбойный) клиент с префиксом в
+     * гигабайт раньше заставлял сервер честно буферизовать весь объем.
+     * Превышение лимита — фатальная ошибка протокола: парсер переходит в
+     * состояние overflowed() и кадров больше не выдает, вызывающий рвет
+     * соединение (abort), как при подделке MAC.
+     *
+     * @param frame [out] Представление тела кадра внутри буфера (без копии).
+     * @param limit Потолок тела кадра для текущего класса трафика:
+     *        HandshakeFrameLimit до установления шифрования (рукопожатие,
+     *        login/register — килобайтные JSON), SessionFrameLimit после.
+     * @return `true`, если полный кадр доступен; `false` — ждать данных
+     *         либо зафиксировано переполнение (см. overflowed()).
+     */
+    bool nextFrame(QByteArray& frame, quint32 limit);
+
+    /**
+     * @brief Префикс длины превысил лимит — соединение подлежит разрыву.
+     */
+    bool overflowed() const { return m_overflowed; }
+
+    /**
+     * @brief Недообработанный хвост потока (для передачи соединения).
+     *
+     * @details Часть бесшовного рестарта (см. Handover): байты полукадра,
+     * накопленные к моменту передачи сокета новому процессу, уезжают вместе
+     * с дескриптором и скармливаются парсеру принявшей стороны через
+     * append(). Если префикс длины текущего кадра уже потреблен, он
+     * восстанавливается перед хвостом — у получателя парсер начинает
+     * с чистого состояния.
+     *
+     * @return Копия необработанных байт (с восстановленным заголовком).
+     */
+    QByteArray pendingBytes() const;
+
+    /**
+     * @brief Отдает системе разросшуюся емкость после всплеска трафика.
+     * @details Вызывается в конце цикла readyRead, когда все кадры обработаны.
+     * Небольшая емкость (до IdleCapacityBytes) сохраняется под переиспользование;
+     * буфер, раздутый одиночным крупным кадром (аватар, файловый чанк),
+     * освобождается — иначе каждый такой кадр навсегда закрепляет сотни
+     * килобайт за простаивающим соединением.
+     */
+    void trim();
+
+    /**
+     * @brief Потолок кадра до установления шифрования.
+     * @details Открытым текстом ходят только рукопожатие и login/register —
+     * килобайтные JSON; все крупное легитимным быть не может.
+     */
+    static constexpr quint32 HandshakeFrameLimit = 16 * 1024;
+
+    /**
+     * @brief Потолок кадра шифрованной сессии.
+     * @details Самый крупный легитимный кадр — чанк файлового канала
+     * (FileTransfer::ChunkSize, 256 КБ) плюс заголовок и AEAD-накладные;
+     * четырехкратный запас покрывает будущий рост чанка без пересборки.
+     */
+    static constexpr quint32 SessionFrameLimit = 1 * 1024 * 1024;
+
+private:
+    /**
+     * @brief Порог компактификации: буфер сдвигается, когда обработанный
+     * префикс превышает это значение и не может быть просто обнулен.
+     */
+    static constexpr qsizetype CompactThreshold = 64 * 1024;
+
+    /**
+     * @brief Емкость, которую простаивающее соединение может удерживать.
+     * @details Покрывает типичные сообщения с запасом; все сверх этого
+     * возвращается аллокатору в trim().
+     */
+    static constexpr qsizetype IdleCapacityBytes = 8 * 1024;
+
+    QByteArray m_buffer;       ///< Накопленные сырые байты потока.
+    qsizetype m_head = 0;      ///< Смещение первого необработанного байта.
+    quint32 m_pendingSize = 0; ///< Ожидаемый размер тела кадра (0 — ждем заголовок).
+    bool m_overflowed = false; ///< Префикс длины превысил лимит (фатально).
+};
+
+/**
+ * @class FramedTcpSocket
+ * @brief QTcpSocket со встроенным состоянием соединения.
+ *
+ * @details Единая запись на соединение: парсер кадров и криптографический
+ * контекст лежат по значению внутри объекта сокета — одна аллокация на
+ * клиента вместо heap-объекта CryptoManager плюс узлов карт
+ * `сокет -> контекст` в Server/ConnectionWorker. Обработчикам достаточно
+ * привести sender() к FramedTcpSocket — поисков по картам на горячем пути
+ * нет, а состояние умирает строго вместе с сокетом.
+ *
+ * Создается вместо QTcpSocket в WorkerTcpServer (классический режим) и
+ * в ConnectionWorker::addConnection (режим пула).
+ */
+class FramedTcpSocket : public QTcpSocket
+{
+    Q_OBJECT
+
+public:
+    explicit FramedTcpSocket(QObject *parent = nullptr)
+        : QTcpSocket(parent)
+    {
+        // Потолок приемного буфера: без него Qt копит непрочитанные данные
+        // без ограничений, и медленный (или злонамеренный) отправитель
+        // раздувает RSS. Читаем мы сразу же (readAll в readyRead), так что
+        // потолок виден только при настоящем затыке — тогда TCP-окно
+        // закрывается само, давя на отправителя.
+        setReadBufferSize(ReadBufferCap);
+    }
+
+    /** @brief Парсер потока этого соединения. */
+    FrameBuffer& framer() { return m_framer; }
+
+    /** @brief Криптографический контекст сессии этого соединения. */
+    CryptoManager& crypto() { return m_crypto; }
+
+private:
+    /** @brief Потолок непрочитанных данных в буфере сокета. */
+    static constexpr qint64 ReadBufferCap = 256 * 1024;
+
+    FrameBuffer m_framer;    ///< Состояние сборки кадров данного соединения.
+    CryptoManager m_crypto;  ///< Ключи сессии (эфемерная пара создается сразу).
+};
+
+#endif // FRAMEBUFFER_H
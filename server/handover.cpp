@@ -0,0 +1,365 @@
+#include "handover.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QtEndian>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Реализация передачи сокетов между процессами (SCM_RIGHTS).
+ *
+ * Вся платформенная часть собрана здесь: raw-сокеты AF_UNIX вместо
+ * QLocalSocket, потому что Qt не умеет отправлять вспомогательные данные
+ * (ancillary data) — а именно ими ядро передает дескрипторы.
+ */
+
+#ifdef Q_OS_UNIX
+
+namespace {
+
+/// Пишет буфер целиком, пережидая короткие записи и EINTR.
+bool writeAll(int fd, const char* data, qint64 size)
+{
+    qint64 done = 0;
+    while (done < size) {
+        const ssize_t n = ::write(fd, data + done, size_t(size - done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/// Читает ровно size байт, пережидая короткие чтения и EINTR.
+bool readAll(int fd, char* data, qint64 size)
+{
+    qint64 done = 0;
+    while (done < size) {
+        const ssize_t n = ::read(fd, data + done, size_t(size - done));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/// Отправляет пакет дескрипторов: 1 байт данных (количество) + SCM_RIGHTS.
+bool sendFdBatch(int channel, const int* fds, int count)
+{
+    char countByte = char(count);
+    struct iovec iov;
+    iov.iov_base = &countByte;
+    iov.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int) * Handover::FdsPerMessage)] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * size_t(count));
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * size_t(count));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * size_t(count));
+
+    for (;;) {
+        if (::sendmsg(channel, &msg, 0) >= 0) return true;
+        if (errno != EINTR) return false;
+    }
+}
+
+/// Принимает пакет дескрипторов; возвращает количество или -1.
+int recvFdBatch(int channel, int* fds)
+{
+    char countByte = 0;
+    struct iovec iov;
+    iov.iov_base = &countByte;
+    iov.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int) * Handover::FdsPerMessage)] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    for (;;) {
+        const ssize_t n = ::recvmsg(channel, &msg, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return -1; // Отправитель закрыл канал раньше времени
+        break;
+    }
+
+    const int expected = int(countByte);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    const int received =
+        int((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    if (received != expected || received > Handover::FdsPerMessage) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * size_t(received));
+    return received;
+}
+
+/// Пишущий конец socketpair для обработчика SIGUSR2.
+int g_usr2WriteFd = -1;
+
+extern "C" void usr2Handler(int)
+{
+    // В контексте сигнала допустим только async-signal-safe код
+    const char byte = 1;
+    if (g_usr2WriteFd >= 0) {
+        ssize_t ignored = ::write(g_usr2WriteFd, &byte, 1);
+        (void)ignored;
+    }
+}
+
+} // namespace
+
+bool Handover::sendState(const QString& socketPath, const QByteArray& manifest,
+                         const QList<int>& fds)
+{
+    const int channel = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (channel < 0) {
+        qCritical() << "[HANDOVER] socket() failed:" << strerror(errno);
+        return false;
+    }
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    const QByteArray path = QFile::encodeName(socketPath);
+    if (path.size() >= int(sizeof(addr.sun_path))) {
+        qCritical() << "[HANDOVER] Socket path too long:" << socketPath;
+        ::close(channel);
+        return false;
+    }
+    memcpy(addr.sun_path, path.constData(), size_t(path.size()));
+
+    // Короткие повторы: новый процесс мог еще не успеть привязать сокет
+    bool connected = false;
+    for (int attempt = 0; attempt < 50; ++attempt) {
+        if (::connect(channel, reinterpret_cast<struct sockaddr*>(&addr),
+                      sizeof(addr)) == 0) {
+            connected = true;
+            break;
+        }
+        QThread::msleep(100);
+    }
+    if (!connected) {
+        qCritical() << "[HANDOVER] Cannot connect to" << socketPath
+                    << ":" << strerror(errno);
+        ::close(channel);
+        return false;
+    }
+
+    // Кадр манифеста: [длина BE][JSON]
+    char header[sizeof(quint32)];
+    qToBigEndian<quint32>(quint32(manifest.size()), header);
+    if (!writeAll(channel, header, sizeof(header)) ||
+        !writeAll(channel, manifest.constData(), manifest.size())) {
+        qCritical() << "[HANDOVER] Manifest write failed:" << strerror(errno);
+        ::close(channel);
+        return false;
+    }
+
+    // Количество дескрипторов — отдельным полем: получатель знает,
+    // когда передача закончилась, не дожидаясь закрытия канала
+    qToBigEndian<quint32>(quint32(fds.size()), header);
+    if (!writeAll(channel, header, sizeof(header))) {
+        qCritical() << "[HANDOVER] Descriptor count write failed:" << strerror(errno);
+        ::close(channel);
+        return false;
+    }
+
+    // Дескрипторы пакетами по FdsPerMessage
+    for (int offset = 0; offset < fds.size(); offset += FdsPerMessage) {
+        const int count = qMin(FdsPerMessage, int(fds.size()) - offset);
+        int batch[FdsPerMessage];
+        for (int i = 0; i < count; ++i) {
+            batch[i] = fds.at(offset + i);
+        }
+        if (!sendFdBatch(channel, batch, count)) {
+            qCritical() << "[HANDOVER] Descriptor batch failed:" << strerror(errno);
+            ::close(channel);
+            return false;
+        }
+    }
+
+    // Дожидаемся закрытия со стороны получателя: признак, что все принято
+    char ack = 0;
+    ssize_t ignored = ::read(channel, &ack, 1);
+    (void)ignored;
+    ::close(channel);
+    return true;
+}
+
+bool Handover::receiveState(const QString& socketPath, int timeoutMs,
+                            QByteArray* manifest, QList<int>* fds)
+{
+    const QByteArray path = QFile::encodeName(socketPath);
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= int(sizeof(addr.sun_path))) {
+        qCritical() << "[HANDOVER] Socket path too long:" << socketPath;
+        return false;
+    }
+    memcpy(addr.sun_path, path.constData(), size_t(path.size()));
+
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        qCritical() << "[HANDOVER] socket() failed:" << strerror(errno);
+        return false;
+    }
+
+    // Хвост прошлой неудачной передачи не должен мешать привязке;
+    // права 0600 — блоб содержит ключевой материал сессий
+    ::unlink(path.constData());
+    const mode_t oldMask = ::umask(0077);
+    const int bindResult =
+        ::bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    ::umask(oldMask);
+    if (bindResult != 0 || ::listen(listener, 1) != 0) {
+        qCritical() << "[HANDOVER] bind/listen failed on" << socketPath
+                    << ":" << strerror(errno);
+        ::close(listener);
+        return false;
+    }
+
+    // Ждем подключения старого процесса не дольше timeoutMs
+    struct pollfd pfd = {};
+    pfd.fd = listener;
+    pfd.events = POLLIN;
+    const int pollResult = ::poll(&pfd, 1, timeoutMs);
+    if (pollResult <= 0) {
+        qCritical() << "[HANDOVER] No hand-off within" << timeoutMs << "ms";
+        ::close(listener);
+        ::unlink(path.constData());
+        return false;
+    }
+
+    const int channel = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+    ::unlink(path.constData());
+    if (channel < 0) {
+        qCritical() << "[HANDOVER] accept() failed:" << strerror(errno);
+        return false;
+    }
+
+    bool ok = false;
+    do {
+        char header[sizeof(quint32)];
+        if (!readAll(channel, header, sizeof(header))) break;
+        const quint32 manifestSize = qFromBigEndian<quint32>(header);
+
+        manifest->resize(qsizetype(manifestSize));
+        if (!readAll(channel, manifest->data(), manifest->size())) break;
+
+        if (!readAll(channel, header, sizeof(header))) break;
+        const int fdCount = int(qFromBigEndian<quint32>(header));
+
+        int batch[FdsPerMessage];
+        while (fds->size() < fdCount) {
+            const int received = recvFdBatch(channel, batch);
+            if (received < 0) break; // Канал закрыт или поврежден
+            for (int i = 0; i < received; ++i) {
+                fds->append(batch[i]);
+            }
+        }
+        ok = (fds->size() == fdCount) && fdCount > 0;
+    } while (false);
+
+    // Закрытие канала служит подтверждением для отправителя
+    ::close(channel);
+    if (!ok) {
+        qCritical() << "[HANDOVER] Transfer incomplete, received"
+                    << fds->size() << "descriptors";
+        for (int fd : *fds) {
+            ::close(fd);
+        }
+        fds->clear();
+    }
+    return ok;
+}
+
+void Handover::closeDescriptors(const QList<int>& fds)
+{
+    for (int fd : fds) {
+        ::close(fd);
+    }
+}
+
+void Handover::installUsr2Handler(std::function<void()> onHandover)
+{
+    int pair[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        qWarning() << "[HANDOVER] socketpair failed, SIGUSR2 hand-off disabled:"
+                   << strerror(errno);
+        return;
+    }
+    g_usr2WriteFd = pair[1];
+
+    // Нотификатор живет до конца процесса (передача — одноразовое событие)
+    auto *notifier = new QSocketNotifier(pair[0], QSocketNotifier::Read);
+    QObject::connect(notifier, &QSocketNotifier::activated, notifier,
+                     [callback = std::move(onHandover), readFd = pair[0]]() {
+        char drained = 0;
+        ssize_t ignored = ::read(readFd, &drained, 1);
+        (void)ignored;
+        callback();
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = usr2Handler;
+    ::sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    ::sigaction(SIGUSR2, &action, nullptr);
+}
+
+#else // !Q_OS_UNIX
+
+bool Handover::sendState(const QString&, const QByteArray&, const QList<int>&)
+{
+    qWarning() << "[HANDOVER] Socket hand-off is Unix-only";
+    return false;
+}
+
+bool Handover::receiveState(const QString&, int, QByteArray*, QList<int>*)
+{
+    qWarning() << "[HANDOVER] Socket hand-off is Unix-only";
+    return false;
+}
+
+void Handover::closeDescriptors(const QList<int>&)
+{
+}
+
+void Handover::installUsr2Handler(std::function<void()>)
+{
+}
+
+#endif // Q_OS_UNIX
@@ -0,0 +1,116 @@
+#ifndef HANDOVER_H
+#define HANDOVER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+#include <functional>
+
+class QObject;
+
+/**
+ * @brief Состояние одного клиентского соединения при передаче процесса.
+ *
+ * @details Собирается воркером в его потоке (см.
+ * ConnectionWorker::exportConnections): дескриптор сокета, сериализованная
+ * криптографическая сессия (CryptoManager::exportSession) и недообработанный
+ * хвост входящего потока (FrameBuffer::pendingBytes). Имя пользователя и
+ * флаги протокола (бинарный режим, сжатие) дописывает основной поток —
+ * реестр сессий живет там.
+ */
+struct HandoverConnection {
+    QObject* socket = nullptr;  ///< Сокет в старом процессе (ключ карт сервера)
+    qintptr fd = -1;            ///< Нативный дескриптор соединения
+    QByteArray cryptoState;     ///< Блоб CryptoManager::exportSession()
+    QByteArray pendingBytes;    ///< Недообработанный хвост входящего потока
+};
+
+/**
+ * @namespace Handover
+ * @brief Передача слушающих сокетов и состояния сессий между процессами.
+ *
+ * @details Бесшовный рестарт сервера: каждый деплой раньше рвал все
+ * соединения и запускал лавину переподключений. Вместо этого старый процесс
+ * передает новому через Unix-сокет (SCM_RIGHTS) дескриптор слушающего
+ * TCP-сокета и дескрипторы всех установленных соединений вместе с
+ * манифестом состояния — именами сессий, криптографическим материалом и
+ * хвостами полукадров. Ядро сохраняет соединения открытыми: для клиентов
+ * рестарт невидим, TCP-поток просто продолжается из нового процесса.
+ *
+ * Хореография (управляется скриптом деплоя):
+ *  1. Новый процесс стартует с MESSENGER_HANDOVER_ACCEPT=<путь>: он
+ *     инициализируется, привязывает Unix-сокет и ждет передачу.
+ *  2. Старому процессу посылается SIGUSR2: он перестает принимать новые
+ *     соединения, собирает состояние и отправляет его с дескрипторами.
+ *  3. Старый процесс завершается; новый принимает слушающий сокет и
+ *     усыновляет соединения. Клиенты, не попавшие в передачу (WebSocket,
+ *     гонка в момент среза), переподключаются по резюм-пути как обычно.
+ *
+ * Протокол на Unix-сокете: кадр манифеста `[длина quint32 BE][JSON]`,
+ * поле `[quint32 BE: всего дескрипторов]`, затем пакеты дескрипторов —
+ * по одному байту данных (число дескрипторов в пакете) с вложением
+ * SCM_RIGHTS. Порядок дескрипторов: слушающий сокет,
+ * затем соединения в порядке манифеста.
+ *
+ * @note Только Unix: на прочих платформах функции возвращают false.
+ */
+namespace Handover {
+
+/** @brief Максимум дескрипторов в одном пакете SCM_RIGHTS. */
+constexpr int FdsPerMessage = 64;
+
+/**
+ * @brief Отправляет манифест и дескрипторы новому процессу.
+ *
+ * @details Подключается к Unix-сокету, который уже слушает новый процесс
+ * (короткие повторы на случай гонки запуска). Дескрипторы отправляются
+ * пакетами по FdsPerMessage; вызывающий остается владельцем дескрипторов.
+ *
+ * @param socketPath Путь Unix-сокета передачи
+ * @param manifest Сериализованный JSON-манифест состояния
+ * @param fds Дескрипторы: слушающий сокет, затем соединения
+ * @return `true`, если все отправлено
+ */
+bool sendState(const QString& socketPath, const QByteArray& manifest,
+               const QList<int>& fds);
+
+/**
+ * @brief Принимает манифест и дескрипторы от старого процесса.
+ *
+ * @details Привязывает и слушает Unix-сокет, ждет подключения старого
+ * процесса не дольше timeoutMs, читает манифест и собирает дескрипторы.
+ * Принятые дескрипторы переходят во владение вызывающего.
+ *
+ * @param socketPath Путь Unix-сокета передачи (создается с правами 0600)
+ * @param timeoutMs Потолок ожидания подключения старого процесса
+ * @param manifest [out] Сериализованный JSON-манифест состояния
+ * @param fds [out] Принятые дескрипторы в порядке отправки
+ * @return `true`, если передача завершилась целиком
+ */
+bool receiveState(const QString& socketPath, int timeoutMs,
+                  QByteArray* manifest, QList<int>* fds);
+
+/**
+ * @brief Закрывает набор принятых дескрипторов.
+ * @details Путь отката acceptHandover: при поврежденной передаче принятые
+ * дескрипторы освобождаются, соединения закрываются — клиенты уходят на
+ * обычное переподключение.
+ * @param fds Дескрипторы из receiveState().
+ */
+void closeDescriptors(const QList<int>& fds);
+
+/**
+ * @brief Устанавливает обработчик SIGUSR2 для запуска передачи.
+ *
+ * @details Сигнал POSIX нельзя обрабатывать в его контексте — хендлер лишь
+ * пишет байт в socketpair, а QSocketNotifier вызывает коллбэк в основном
+ * потоке цикла событий (классический Qt-паттерн для Unix-сигналов).
+ *
+ * @param onHandover Коллбэк запуска передачи (основной поток)
+ */
+void installUsr2Handler(std::function<void()> onHandover);
+
+} // namespace Handover
+
+#endif // HANDOVER_H
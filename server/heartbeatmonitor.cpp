@@ -0,0 +1,110 @@
+/**
+ * @file heartbeatmonitor.cpp
+ * @brief Реализация хешированного колеса таймеров для heartbeat-соединений.
+ */
+
+#include <QTimer>
+#include <QDebug>
+
+#include <utility>
+
+#include "heartbeatmonitor.h"
+
+HeartbeatMonitor::HeartbeatMonitor(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+
+    m_timer = new QTimer(this);
+    m_timer->setInterval(TickMs);
+    connect(m_timer, &QTimer::timeout, this, &HeartbeatMonitor::tick);
+    m_timer->start();
+}
+
+
+void HeartbeatMonitor::track(QObject *socket)
+{
+    // Идемпотентно: для уже известного сокета просто продлеваем дедлайн.
+    activity(socket);
+}
+
+
+void HeartbeatMonitor::activity(QObject *socket)
+{
+    Entry &entry = m_entries[socket];
+
+    // Снимаем с прежнего слота (если был) и ставим на новый дедлайн.
+    if (entry.slot >= 0) {
+        m_wheel[entry.slot].remove(socket);
+    }
+
+    entry.awaitingPong = false;
+    schedule(socket, entry, IdleTimeoutMs);
+}
+
+
+void HeartbeatMonitor::forget(QObject *socket)
+{
+    const auto it = m_entries.constFind(socket);
+    if (it == m_entries.constEnd()) return;
+
+    if (it->slot >= 0) {
+        m_wheel[it->slot].remove(socket);
+    }
+    m_entries.remove(socket);
+}
+
+
+void HeartbeatMonitor::schedule(QObject *socket, Entry &entry, qint64 delayMs)
+{
+    entry.deadlineMs = m_clock.elapsed() + delayMs;
+
+    // Слот выбирается по числу тиков до дедлайна. Дедлайны дальше одного
+    // оборота колеса ставятся в максимально дальний слот: тик перехеширует
+    // их по фактическому остатку (ленивое каскадирование).
+    qint64 ticks = delayMs / TickMs + 1;
+    if (ticks > WheelSize - 1) {
+        ticks = WheelSize - 1;
+    }
+
+    entry.slot = int((m_currentSlot + ticks) & (WheelSize - 1));
+    m_wheel[entry.slot].insert(socket);
+}
+
+
+void HeartbeatMonitor::tick()
+{
+    m_currentSlot = (m_currentSlot + 1) & (WheelSize - 1);
+
+    // Забираем содержимое слота целиком: просроченные записи обрабатываются,
+    // непросроченные перехешируются в будущие слоты.
+    const QSet<QObject*> due = std::exchange(m_wheel[m_currentSlot], {});
+    if (due.isEmpty()) return;
+
+    const qint64 now = m_clock.elapsed();
+
+    for (QObject *socket : due) {
+        const auto it = m_entries.find(socket);
+        if (it == m_entries.end()) continue;
+
+        Entry &entry = it.value();
+
+        if (entry.deadlineMs > now) {
+            // Дедлайн дальше оборота колеса — досрочное попадание, ставим
+            // обратно по фактическому остатку.
+            schedule(socket, entry, entry.deadlineMs - now);
+            continue;
+        }
+
+        if (!entry.awaitingPong) {
+            // Соединение молчит: отправляем ping и даем льготный срок.
+            entry.awaitingPong = true;
+            schedule(socket, entry, PongGraceMs);
+            emit pingDue(socket);
+        } else {
+            // Ping остался без ответа — соединение мертво.
+            m_entries.erase(it);
+            emit sessionExpired(socket);
+        }
+    }
+}
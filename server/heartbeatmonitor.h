@@ -0,0 +1,102 @@
+#ifndef HEARTBEATMONITOR_H
+#define HEARTBEATMONITOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+
+#include <array>
+
+class QTimer;
+
+/**
+ * @class HeartbeatMonitor
+ * @brief Прикладной heartbeat на хешированном колесе таймеров.
+ *
+ * @details Обнаружение разрыва раньше полагалось только на TCP teardown:
+ * полуоткрытые соединения мобильных/NAT-клиентов минутами висели в реестре
+ * сессий и отравляли маршрутизацию сообщений. Монитор ведет дедлайн
+ * активности каждого соединения и своевременно выбраковывает мертвые:
+ *
+ * - Любой входящий запрос продлевает дедлайн (activity()).
+ * - Если соединение молчит дольше IdleTimeoutMs, эмитится pingDue() —
+ *   сервер отправляет прикладной ping (или WebSocket ping-фрейм).
+ * - Если за PongGraceMs не пришло ни pong, ни других данных — эмитится
+ *   sessionExpired(), и сервер рвет соединение.
+ *
+ * Дедлайны хранятся в **хешированном колесе таймеров**: WheelSize слотов,
+ * один QTimer на весь сервер, тик обслуживает только свой слот. Продление
+ * дедлайна — O(1) (перестановка между слотами), тик — O(истекших) с
+ * амортизированным O(1) на соединение. QTimer на каждый сокет не создается.
+ *
+ * @note Используется только из основного потока сервера. Сокеты пула
+ * соединений живут в рабочих потоках, но монитор оперирует лишь указателями
+ * как ключами и не обращается к самим объектам.
+ */
+class HeartbeatMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** @brief Период тика колеса (один слот за тик). */
+    static constexpr int TickMs = 1000;
+
+    /** @brief Число слотов колеса (степень двойки, span = 64 секунды). */
+    static constexpr int WheelSize = 64;
+
+    /** @brief Молчание, после которого соединению отправляется ping. */
+    static constexpr int IdleTimeoutMs = 60 * 1000;
+
+    /** @brief Срок ожидания ответа на ping до выбраковки соединения. */
+    static constexpr int PongGraceMs = 15 * 1000;
+
+    explicit HeartbeatMonitor(QObject *parent = nullptr);
+
+    /**
+     * @brief Ставит соединение под наблюдение (вызывается при подключении).
+     * @details Идемпотентна: повторный вызов эквивалентен activity().
+     */
+    void track(QObject *socket);
+
+    /**
+     * @brief Отмечает активность соединения: продлевает дедлайн.
+     * @details Вызывается на каждый входящий запрос; сбрасывает ожидание pong.
+     */
+    void activity(QObject *socket);
+
+    /**
+     * @brief Снимает соединение с наблюдения (вызывается при отключении).
+     */
+    void forget(QObject *socket);
+
+signals:
+    /** @brief Соединение молчит дольше IdleTimeoutMs — пора отправить ping. */
+    void pingDue(QObject *socket);
+
+    /** @brief Ping остался без ответа — соединение считается мертвым. */
+    void sessionExpired(QObject *socket);
+
+private slots:
+    /** @brief Тик колеса: обслуживает дедлайны очередного слота. */
+    void tick();
+
+private:
+    /** @brief Состояние наблюдения за одним соединением. */
+    struct Entry {
+        qint64 deadlineMs = 0;    ///< Дедлайн по m_clock.elapsed().
+        int slot = -1;            ///< Текущий слот колеса.
+        bool awaitingPong = false;///< Ping отправлен, ждем ответ.
+    };
+
+    /** @brief Ставит сокет в слот колеса, соответствующий задержке. */
+    void schedule(QObject *socket, Entry &entry, qint64 delayMs);
+
+    QHash<QObject*, Entry> m_entries;              ///< Наблюдаемые соединения.
+    std::array<QSet<QObject*>, WheelSize> m_wheel; ///< Слоты колеса.
+    QElapsedTimer m_clock;                         ///< Монотонные часы.
+    QTimer *m_timer = nullptr;                     ///< Единственный таймер тика.
+    int m_currentSlot = 0;                         ///< Обслуживаемый слот.
+};
+
+#endif // HEARTBEATMONITOR_H
@@ -13,6 +13,8 @@
 
 #include <QCoreApplication> // Основной класс для консольных приложений Qt.
 #include <QDebug>           // Для вывода критических ошибок (qCritical).
+#include "asynclogger.h"    // Асинхронный вывод логов (кольцевой буфер + писатель).
+#include "handover.h"       // Передача сокетов при бесшовном рестарте.
 #include "server.h"         // Включаем заголовочный файл нашего серверного класса.
 
 /**
@@ -29,13 +31,53 @@ int main(int argc, char *argv[])
     //    создавать графический интерфейс.
     QCoreApplication a(argc, argv);
 
+    // Асинхронное логирование включается до создания сервера: дальше любой
+    // qDebug/qInfo лишь кладет запись в кольцевой буфер, а форматирование
+    // времени и запись на диск выполняет отдельный поток-писатель.
+    // MESSENGER_LOG_FILE переключает вывод на структурированный JSON.
+    AsyncLogger::install();
+
     // 2. Создание главного объекта сервера.
     //    Вся логика сервера инкапсулирована в классе `Server`.
     Server server;
 
+    // Режим воспроизведения (MESSENGER_REPLAY=<журнал>): вместо прослушивания
+    // портов сервер подает захваченный трафик в собственный диспетчер против
+    // подложенного снимка базы и завершается по концу журнала. Темп задает
+    // MESSENGER_REPLAY_SPEED (1 — исходный, 0 — без пауз).
+    if (qEnvironmentVariableIsSet("MESSENGER_REPLAY")) {
+        if (!server.startReplay(qEnvironmentVariable("MESSENGER_REPLAY"))) {
+            qCritical() << "Replay failed to start!";
+            return 1;
+        }
+        return a.exec();
+    }
+
+    // Бесшовный рестарт: путь Unix-сокета передачи общий для обеих сторон.
+    // Новый процесс стартует с MESSENGER_HANDOVER_ACCEPT=1 и принимает от
+    // старого слушающий сокет и установленные соединения; старому процессу
+    // деплой-скрипт посылает SIGUSR2 (см. handover.h).
+    const QString handoverPath =
+        qEnvironmentVariableIsSet("MESSENGER_HANDOVER_SOCKET")
+            ? qEnvironmentVariable("MESSENGER_HANDOVER_SOCKET")
+            : QStringLiteral("/tmp/messenger-handover.sock");
+    Handover::installUsr2Handler([&server, handoverPath]() {
+        server.beginHandover(handoverPath);
+    });
+
+    bool adopted = false;
+    if (qEnvironmentVariableIsSet("MESSENGER_HANDOVER_ACCEPT")) {
+        adopted = server.acceptHandover(handoverPath);
+        if (!adopted) {
+            // Передача не состоялась (старый процесс не вышел на связь или
+            // канал поврежден) — поднимаемся как при обычном рестарте.
+            qWarning() << "Hand-off failed, falling back to a cold start";
+        }
+    }
+
     // 3. Попытка запустить сервер для прослушивания портов.
     //    Метод `listen()` возвращает `true` в случае успеха и `false` в случае неудачи.
-    if (!server.listen()) {
+    if (!adopted && !server.listen()) {
         // Если сервер не смог запуститься (например, порты уже заняты),
         // выводим критическую ошибку в консоль.
         qCritical() << "Server could not start!";
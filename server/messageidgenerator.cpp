@@ -0,0 +1,34 @@
+/**
+ * @file messageidgenerator.cpp
+ * @brief Реализация генератора время-упорядоченных ID сообщений.
+ */
+
+#include <QDateTime>
+
+#include "messageidgenerator.h"
+
+qint64 MessageIdGenerator::nextId()
+{
+    qint64 nowMs = QDateTime::currentMSecsSinceEpoch() - EpochMs;
+
+    // Часы ушли назад (NTP-коррекция): продолжаем от последней выданной
+    // миллисекунды — монотонность важнее точной привязки ко времени.
+    if (nowMs < m_lastMs) {
+        nowMs = m_lastMs;
+    }
+
+    if (nowMs == m_lastMs) {
+        ++m_sequence;
+        // Счетчик миллисекунды исчерпан — занимаем следующую миллисекунду.
+        // Реальное время догонит m_lastMs само; ожидание здесь не нужно.
+        if (m_sequence >= (1 << SequenceBits)) {
+            ++m_lastMs;
+            m_sequence = 0;
+        }
+    } else {
+        m_lastMs = nowMs;
+        m_sequence = 0;
+    }
+
+    return (m_lastMs << SequenceBits) | m_sequence;
+}
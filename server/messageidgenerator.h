@@ -0,0 +1,54 @@
+#ifndef MESSAGEIDGENERATOR_H
+#define MESSAGEIDGENERATOR_H
+
+#include <QtGlobal>
+
+/**
+ * @class MessageIdGenerator
+ * @brief Внутрипроцессный генератор время-упорядоченных ID сообщений.
+ *
+ * @details Исторически ID сообщения присваивал SQLite AUTOINCREMENT: ack
+ * отправителю и пересылка получателю ждали COMMIT вставки. Генератор убирает
+ * БД с критического пути задержки — сервер присваивает окончательный ID сам,
+ * в момент приема сообщения, а пакетный писатель фиксирует строку позже.
+ *
+ * Формат ID (по мотивам Snowflake, но урезанный до одного процесса):
+ *
+ *     [41 бит: миллисекунды от Epoch] [12 бит: счетчик внутри миллисекунды]
+ *
+ * Итого 53 бита — ровно предел точного представления целых в IEEE double.
+ * Это принципиально: ID ходит по протоколу как JSON number, и полноразмерный
+ * 63-битный Snowflake терял бы младшие биты на клиенте. 41 бита миллисекунд
+ * хватает на ~69 лет от Epoch, 4096 ID на миллисекунду — это 4M сообщений/с.
+ *
+ * Свойства:
+ * - ID строго возрастают (и заведомо больше любых старых AUTOINCREMENT-ID),
+ *   поэтому keyset-пагинация истории и порядок в индексах сохраняются.
+ * - Откат системных часов не ломает монотонность: генератор продолжает от
+ *   последней выданной миллисекунды.
+ * - Бит узла нет: генератор рассчитан на один процесс сервера.
+ *
+ * @note Используется только из основного потока сервера (там же, где
+ * диспетчер команд), поэтому обходится без атомарных операций.
+ */
+class MessageIdGenerator
+{
+public:
+    /** @brief Начало отсчета: 2024-01-01T00:00:00 UTC, мс Unix-времени. */
+    static constexpr qint64 EpochMs = 1704067200000LL;
+
+    /** @brief Бит на счетчик внутри миллисекунды (4096 ID/мс). */
+    static constexpr int SequenceBits = 12;
+
+    /**
+     * @brief Выдает следующий ID.
+     * @return Строго возрастающий 53-битный время-упорядоченный ID.
+     */
+    qint64 nextId();
+
+private:
+    qint64 m_lastMs = 0;  ///< Миллисекунда последнего выданного ID (от Epoch).
+    int m_sequence = 0;   ///< Счетчик внутри m_lastMs.
+};
+
+#endif // MESSAGEIDGENERATOR_H
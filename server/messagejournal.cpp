@@ -0,0 +1,245 @@
+/**
+ * @file messagejournal.cpp
+ * @brief Реализация write-behind журнала сообщений.
+ *
+ * @details Пакет сообщений записывается одной транзакцией в потоке
+ * DatabaseService. ID присвоены сервером заранее; коллбэки в основном
+ * потоке лишь подтверждают фиксацию или сигнализируют об ошибке записи.
+ */
+
+#include <QSqlDatabase>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+#include "messagejournal.h"
+#include "compression.h"
+#include "databaseservice.h"
+#include "replication.h"
+#include "statementcache.h"
+#include "conversationdirectory.h"
+
+MessageJournal::MessageJournal(DatabaseService *dbService, QObject *parent)
+    : QObject(parent), m_dbService(dbService)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FlushIntervalMs);
+    connect(&m_flushTimer, &QTimer::timeout, this, &MessageJournal::flush);
+}
+
+
+void MessageJournal::append(PendingMessage message)
+{
+    m_pending.append(std::move(message));
+
+    if (m_pending.size() >= MaxBatch) {
+        // Пакет набран — сбрасываем немедленно, не дожидаясь таймера.
+        m_flushTimer.stop();
+        flush();
+    } else if (!m_flushTimer.isActive()) {
+        // Первое сообщение пакета: гарантируем сброс не позднее FlushIntervalMs.
+        m_flushTimer.start();
+    }
+}
+
+
+void MessageJournal::flush()
+{
+    if (m_pending.isEmpty()) return;
+
+    // Забираем накопленный пакет; новые сообщения пойдут в следующий.
+    QList<PendingMessage> batch;
+    batch.swap(m_pending);
+
+    qDebug() << "[JOURNAL] Flushing" << batch.size() << "message(s) in one transaction";
+
+    // Горячий резерв: пакет уходит в tail-журнал той же гранулярностью,
+    // что и в транзакцию БД (реплей на standby идемпотентен по ID)
+    if (m_replication) {
+        m_replication->appendMessageBatch(batch);
+    }
+
+    // До подтверждения фиксации пакет числится "в полете": квитанции на его
+    // сообщения превращаются в компенсирующие UPDATE (см. markFlagByIds).
+    m_inFlight.append(batch);
+
+    m_dbService->query(
+        [batch](QSqlDatabase &db) -> QVariant {
+            // Одна транзакция (один fsync) на весь пакет — ключ к пропускной
+            // способности на медленных дисках.
+            if (!db.transaction()) {
+                qCritical() << "[JOURNAL] Failed to begin transaction:" << db.lastError().text();
+            }
+
+            QVariantList ids;
+            ids.reserve(batch.size());
+
+            // ID задан явно: он присвоен сервером до постановки в журнал,
+            // AUTOINCREMENT для таких вставок SQLite не задействует.
+            QSqlQuery &query = StatementCache::get(db,
+                "INSERT INTO messages (id, fromUser, toUser, payload, timestamp, file_id, file_name, file_url,  reply_to_id, chat_seq, conversation_id, is_delivered, is_read) "
+                "VALUES (:id, :fromUser, :toUser, :payload, :timestamp,:fileId, :fileName, :fileUrl, :reply_to_id, :chat_seq, :conversation_id, :is_delivered, :is_read)");
+
+            // ID диалога на время пакета: один диалог шлет пачками, так что
+            // чаще всего это одно обращение к справочнику на весь пакет.
+            QHash<QString, qint64> conversationIds;
+
+            for (const PendingMessage &msg : batch) {
+                query.bindValue(":id", msg.id);
+                query.bindValue(":fromUser", msg.fromUser);
+                query.bindValue(":toUser", msg.toUser);
+                // Сжатие "в покое": длинные тексты уходят в колонку
+                // BLOB'ом Compression, читатели различают их по Magic-байту
+                query.bindValue(":payload", Compression::packText(msg.payload));
+                query.bindValue(":timestamp", msg.timestamp);
+                query.bindValue(":fileId", msg.fileId);
+                query.bindValue(":fileName", msg.fileName);
+                query.bindValue(":fileUrl", msg.fileUrl);
+
+                // Обрабатываем reply_to_id: если 0, сохраняем NULL в БД
+                query.bindValue(":reply_to_id", (msg.replyToId > 0) ? QVariant(msg.replyToId) : QVariant());
+
+                query.bindValue(":chat_seq", msg.chatSeq);
+
+                // Квитанция могла прийти раньше записи (см. markFlagByIds) —
+                // строка рождается сразу с финальными флагами.
+                query.bindValue(":is_delivered", msg.delivered ? 1 : 0);
+                query.bindValue(":is_read", msg.read ? 1 : 0);
+
+                const QString pairKey = (msg.fromUser < msg.toUser)
+                    ? msg.fromUser + QLatin1Char('\n') + msg.toUser
+                    : msg.toUser + QLatin1Char('\n') + msg.fromUser;
+                auto cidIt = conversationIds.find(pairKey);
+                if (cidIt == conversationIds.end()) {
+                    cidIt = conversationIds.insert(pairKey,
+                        ConversationDirectory::ensureId(db, msg.fromUser, msg.toUser));
+                }
+                query.bindValue(":conversation_id",
+                                (cidIt.value() >= 0) ? QVariant(cidIt.value()) : QVariant());
+
+                if (query.exec()) {
+                    ids.append(msg.id);
+                } else {
+                    qCritical() << "[JOURNAL] Failed to insert message:" << query.lastError().text();
+                    ids.append(QVariant()); // Невалидный ID — сигнал ошибки для коллбэка
+                }
+            }
+
+            if (!db.commit()) {
+                qCritical() << "[JOURNAL] Commit failed:" << db.lastError().text();
+                db.rollback();
+                // Вся транзакция откатилась — ни один ID не действителен.
+                for (QVariant &id : ids) id = QVariant();
+            }
+
+            return ids;
+        },
+        this,
+        [this, batch](const QVariant &result) {
+            // Пакеты фиксируются в порядке постановки — снимаем головные
+            // записи списка "в полете".
+            m_inFlight.erase(m_inFlight.begin(), m_inFlight.begin() + batch.size());
+
+            const QVariantList ids = result.toList();
+
+            // Раздаем присвоенные ID коллбэкам в порядке постановки.
+            for (int i = 0; i < batch.size(); ++i) {
+                const QVariant id = (i < ids.size()) ? ids.at(i) : QVariant();
+                if (batch.at(i).completion) {
+                    batch.at(i).completion(id);
+                }
+            }
+        });
+}
+
+
+QList<MessageJournal::ReceiptTarget> MessageJournal::markFlagByIds(
+    const QList<qint64> &ids, const QString &field)
+{
+    const bool readFlag = (field == QLatin1String("is_read"));
+
+    QSet<qint64> wanted;
+    for (qint64 id : ids) {
+        wanted.insert(id);
+    }
+
+    QList<ReceiptTarget> marked;
+    QList<qint64> inFlightIds;
+
+    const auto apply = [&](PendingMessage &msg, bool inFlight) {
+        if (!wanted.contains(msg.id)) return;
+        bool &flag = readFlag ? msg.read : msg.delivered;
+        if (flag) return; // Повторная квитанция — переход уже был
+        flag = true;
+        marked.append({msg.id, msg.fromUser, msg.toUser});
+        if (inFlight) {
+            inFlightIds.append(msg.id);
+        }
+    };
+
+    // Текущий пакет запишется уже с финальными флагами; ушедшим в очередь
+    // писателя нужен компенсирующий UPDATE после их INSERT.
+    for (PendingMessage &msg : m_pending) apply(msg, false);
+    for (PendingMessage &msg : m_inFlight) apply(msg, true);
+
+    if (!inFlightIds.isEmpty()) {
+        persistFlagByIds(inFlightIds, field);
+    }
+    return marked;
+}
+
+
+int MessageJournal::markFlagUpTo(const QString &fromUser, const QString &toUser,
+                                 qint64 upToId, const QString &field)
+{
+    const bool readFlag = (field == QLatin1String("is_read"));
+
+    int marked = 0;
+    QList<qint64> inFlightIds;
+
+    const auto apply = [&](PendingMessage &msg, bool inFlight) {
+        if (msg.fromUser != fromUser || msg.toUser != toUser || msg.id > upToId) return;
+        bool &flag = readFlag ? msg.read : msg.delivered;
+        if (flag) return;
+        flag = true;
+        ++marked;
+        if (inFlight) {
+            inFlightIds.append(msg.id);
+        }
+    };
+
+    for (PendingMessage &msg : m_pending) apply(msg, false);
+    for (PendingMessage &msg : m_inFlight) apply(msg, true);
+
+    if (!inFlightIds.isEmpty()) {
+        persistFlagByIds(inFlightIds, field);
+    }
+    return marked;
+}
+
+
+void MessageJournal::persistFlagByIds(const QList<qint64> &ids, const QString &field)
+{
+    QStringList idStrings;
+    idStrings.reserve(ids.size());
+    for (qint64 id : ids) {
+        idStrings.append(QString::number(id));
+    }
+
+    // Поле подставляется строкой, но приходит только из внутренних вызовов
+    // ("is_delivered"/"is_read") — пользовательский ввод сюда не попадает.
+    const QString sql = QStringLiteral("UPDATE messages SET %1 = 1 WHERE id IN (%2)")
+                            .arg(field, idStrings.join(QLatin1Char(',')));
+
+    m_dbService->post([sql](QSqlDatabase &db) -> QVariant {
+        QSqlQuery query(db);
+        if (!query.exec(sql)) {
+            qWarning() << "[JOURNAL] Failed receipt catch-up update:"
+                       << query.lastError().text();
+        }
+        return QVariant();
+    });
+}
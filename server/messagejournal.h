@@ -0,0 +1,163 @@
+#ifndef MESSAGEJOURNAL_H
+#define MESSAGEJOURNAL_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QTimer>
+#include <QVariant>
+
+#include <functional>
+
+class DatabaseService;
+class ReplicationService;
+
+/**
+ * @class MessageJournal
+ * @brief Write-behind журнал для пакетной записи сообщений в БД.
+ *
+ * @details handlePrivateMessage исторически делал один autocommit-INSERT на
+ * каждое сообщение: на медленных дисках это ограничивает пропускную способность
+ * несколькими сотнями сообщений в секунду (каждый COMMIT — отдельный fsync).
+ *
+ * Журнал копит входящие сообщения в памяти и сбрасывает их в SQLite одной
+ * групповой транзакцией по достижении размера пакета (MaxBatch) или по
+ * таймеру (FlushIntervalMs) — что наступит раньше. Один fsync на десятки
+ * сообщений поднимает устойчивый ingest на порядок без изменения протокола.
+ *
+ * ID сообщению присваивает сервер (MessageIdGenerator) еще до постановки
+ * в журнал, поэтому ack отправителю и пересылка получателю не ждут записи.
+ * Коллбэк каждого сообщения вызывается после фиксации транзакции с тем же
+ * ID (или невалидным QVariant при ошибке записи) — это канал уведомления
+ * об ошибках, а не источник ID.
+ *
+ * Поскольку получатель видит сообщение раньше, чем оно зафиксировано в БД,
+ * квитанции доставки/прочтения регулярно приходят внутрь окна сброса и не
+ * находят строку для UPDATE. Для таких случаев журнал принимает квитанции
+ * сам (markFlagByIds / markFlagUpTo): еще не сброшенные сообщения метятся
+ * прямо в пакете и записываются уже с финальными флагами, а для пакетов,
+ * ушедших в очередь писателя, но еще не зафиксированных, ставится
+ * компенсирующий UPDATE в ту же очередь — FIFO единственного писателя
+ * гарантирует, что он выполнится после INSERT.
+ *
+ * @note Работает в основном потоке сервера; сами INSERT'ы выполняются
+ * в потоке DatabaseService.
+ */
+class MessageJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** @brief Максимальный размер пакета перед принудительным сбросом. */
+    static constexpr int MaxBatch = 64;
+
+    /** @brief Максимальная задержка сброса после первого сообщения в пакете, мс. */
+    static constexpr int FlushIntervalMs = 25;
+
+    /**
+     * @brief Ожидающее записи сообщение со всеми полями таблицы messages.
+     */
+    struct PendingMessage {
+        qint64 id = 0;        ///< Присвоенный сервером ID (MessageIdGenerator).
+        QString fromUser;     ///< Отправитель.
+        QString toUser;       ///< Получатель.
+        QString payload;      ///< Текст сообщения.
+        qint64 timestamp = 0; ///< Серверная временная метка (мс эпохи).
+        QString fileId;       ///< ID прикрепленного файла (пустой, если нет).
+        QString fileName;     ///< Имя файла.
+        QString fileUrl;      ///< URL файла.
+        qint64 replyToId = 0; ///< ID цитируемого сообщения (0 — не ответ).
+        qint64 chatSeq = 0;   ///< Штамп порядка внутри диалога (ChatSequencer).
+        bool delivered = false; ///< Квитанция доставки пришла до записи в БД.
+        bool read = false;      ///< Квитанция прочтения пришла до записи в БД.
+
+        /**
+         * @brief Коллбэк завершения: вызывается в основном потоке после COMMIT.
+         * @details Аргумент — тот же присвоенный сервером ID
+         * (QVariant::isValid() == false при ошибке записи).
+         */
+        std::function<void(const QVariant&)> completion;
+    };
+
+    /**
+     * @brief Конструктор.
+     * @param dbService Асинхронный сервис БД, выполняющий групповые транзакции.
+     * @param parent Родительский объект (обычно Server).
+     */
+    explicit MessageJournal(DatabaseService *dbService, QObject *parent = nullptr);
+
+    /**
+     * @brief Добавляет сообщение в журнал.
+     * @details Сброс произойдет немедленно при наборе MaxBatch сообщений
+     * или не позднее FlushIntervalMs после первого сообщения пакета.
+     */
+    void append(PendingMessage message);
+
+    /**
+     * @brief Сообщение журнала, задетое квитанцией.
+     * @details Участники нужны вызывающему для уведомления автора и
+     * декремента счетчика непрочитанных — SELECT по БД этих строк
+     * не увидит, они еще не записаны.
+     */
+    struct ReceiptTarget {
+        qint64 id = 0;    ///< ID помеченного сообщения.
+        QString fromUser; ///< Автор сообщения.
+        QString toUser;   ///< Получатель (отправитель квитанции).
+    };
+
+    /**
+     * @brief Применяет квитанцию по списку id к еще не записанным сообщениям.
+     *
+     * @details Сообщения текущего пакета метятся в памяти (сброс запишет их
+     * уже с финальным флагом); для сообщений пакетов, ушедших в очередь
+     * писателя, но еще не зафиксированных, ставится компенсирующий UPDATE
+     * в ту же очередь. Повторная квитанция тех же id — no-op.
+     *
+     * @param ids ID сообщений из квитанции.
+     * @param field Имя флага: "is_delivered" или "is_read".
+     * @return Сообщения, чей флаг перешел 0 -> 1 (для уведомлений автору).
+     */
+    QList<ReceiptTarget> markFlagByIds(const QList<qint64> &ids, const QString &field);
+
+    /**
+     * @brief Диапазонная квитанция "всё от автора вплоть до id" по журналу.
+     *
+     * @details Дополнение к range-UPDATE обработчика: покрывает сообщения
+     * пары, еще не добравшиеся до БД. Семантика меток — как у markFlagByIds.
+     *
+     * @param fromUser Автор подтверждаемых сообщений.
+     * @param toUser Получатель (отправитель квитанции).
+     * @param upToId Верхняя граница диапазона id (включительно).
+     * @param field Имя флага: "is_delivered" или "is_read".
+     * @return Число переходов флага 0 -> 1 (для декремента счетчиков).
+     */
+    int markFlagUpTo(const QString &fromUser, const QString &toUser,
+                     qint64 upToId, const QString &field);
+
+    /**
+     * @brief Подключает стрим пакетов в горячий резерв.
+     * @details Каждый сбрасываемый пакет дополнительно дописывается в
+     * tail-журнал репликации (см. ReplicationService); nullptr отключает.
+     */
+    void setReplication(ReplicationService *replication) { m_replication = replication; }
+
+private slots:
+    /** @brief Сбрасывает накопленный пакет одной транзакцией в поток БД. */
+    void flush();
+
+private:
+    /**
+     * @brief Ставит компенсирующий UPDATE флага для уже ушедших пакетов.
+     * @details Очередь писателя одна, поэтому UPDATE выполнится строго
+     * после INSERT-транзакции, увезшей эти сообщения.
+     */
+    void persistFlagByIds(const QList<qint64> &ids, const QString &field);
+
+    DatabaseService *m_dbService;    ///< Сервис БД (не владеем).
+    ReplicationService *m_replication = nullptr; ///< Стрим пакетов в резерв (не владеем).
+    QList<PendingMessage> m_pending; ///< Накопленные, еще не записанные сообщения.
+    QList<PendingMessage> m_inFlight; ///< Сброшенные пакеты до подтверждения фиксации.
+    QTimer m_flushTimer;             ///< Одноразовый таймер отложенного сброса.
+};
+
+#endif // MESSAGEJOURNAL_H
@@ -0,0 +1,84 @@
+//См. "outboundqueue.h"
+#include "outboundqueue.h"
+
+#include <QDebug>
+
+void OutboundQueue::onDisconnect(const QString& username, qint64 nowMs)
+{
+    sweep(nowMs);
+
+    // Грубая защита памяти: при шторме отключений новые окна не открываем —
+    // их получатели обслужатся прежним офлайн-путем из БД
+    if (m_windows.size() >= MaxUsers && !m_windows.contains(username)) {
+        return;
+    }
+
+    Entry& entry = m_windows[username];
+    entry.openedMs = nowMs;
+    entry.overflowed = false;
+    entry.messages.clear();
+}
+
+
+bool OutboundQueue::tryEnqueue(const QString& username, const QJsonObject& message,
+                               qint64 nowMs)
+{
+    const auto it = m_windows.find(username);
+    if (it == m_windows.end()) {
+        return false;
+    }
+
+    if (nowMs - it->openedMs > GraceWindowMs) {
+        m_windows.erase(it); // Окно истекло — дальше работает офлайн-путь
+        return false;
+    }
+
+    if (it->messages.size() >= MaxMessagesPerUser) {
+        // Потолок: копию не держим, но окно не закрываем — на
+        // переподключении очередь дополнит обязательный БД-проход
+        it->overflowed = true;
+        return false;
+    }
+
+    it->messages.append(message);
+    return true;
+}
+
+
+bool OutboundQueue::take(const QString& username, qint64 nowMs,
+                         QList<QJsonObject>* out, bool* overflowed)
+{
+    const auto it = m_windows.find(username);
+    if (it == m_windows.end()) {
+        return false;
+    }
+
+    const bool fresh = nowMs - it->openedMs <= GraceWindowMs;
+    if (fresh) {
+        if (out) *out = std::move(it->messages);
+        if (overflowed) *overflowed = it->overflowed;
+        if (out) m_flushed += out->size();
+    }
+    m_windows.erase(it);
+
+    return fresh;
+}
+
+
+void OutboundQueue::sweep(qint64 nowMs)
+{
+    // Ленивая чистка не чаще раза в окно: записи и так выбрасываются при
+    // попадании, здесь добираются только получатели, не вернувшиеся вовсе
+    if (nowMs - m_lastSweepMs < GraceWindowMs) {
+        return;
+    }
+    m_lastSweepMs = nowMs;
+
+    for (auto it = m_windows.begin(); it != m_windows.end();) {
+        if (nowMs - it->openedMs > GraceWindowMs) {
+            it = m_windows.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+/**
+ * @class OutboundQueue
+ * @brief Короткоживущая очередь доставки для недавно отключившихся получателей.
+ *
+ * @details Мобильные клиенты рвут соединение на каждую смену сети и
+ * возвращаются через секунды. Раньше сообщение, пришедшее в этот зазор,
+ * уходило в офлайн-путь: на переподключении клиент получал его через
+ * постраничную выдачу из БД (sendOfflineMessages) — полный круг через
+ * пул читателей ради сообщения трехсекундной давности.
+ *
+ * Очередь держит готовые к отправке JSON-копии сообщений для получателей,
+ * отключившихся не далее GraceWindowMs назад. На переподключении в окно
+ * копии вручаются мгновенно из памяти, и БД-проход пропускается. Это
+ * именно кэш доставки: строка сообщения в любом случае персистится
+ * write-behind журналом, и при истечении окна (или рестарте сервера)
+ * доставку выполняет прежний офлайн-путь из БД.
+ *
+ * Пропуск БД-прохода корректен, пока очередь полна: всё, адресованное
+ * получателю после разрыва, попало в нее. При переполнении
+ * (MaxMessagesPerUser) запись помечается, и на переподключении выдача
+ * из БД выполняется как раньше — очередь тогда лишь дополняет ее.
+ *
+ * @note Используется только из основного потока сервера.
+ */
+class OutboundQueue
+{
+public:
+    /** @brief Окно удержания после разрыва, мс. */
+    static constexpr qint64 GraceWindowMs = 30 * 1000;
+
+    /** @brief Потолок удерживаемых сообщений на получателя. */
+    static constexpr int MaxMessagesPerUser = 200;
+
+    /** @brief Потолок одновременно отслеживаемых получателей. */
+    static constexpr int MaxUsers = 4096;
+
+    /**
+     * @brief Открывает окно удержания для отключившегося пользователя.
+     * @param username Отключившийся получатель.
+     * @param nowMs Текущее время (QDateTime::currentMSecsSinceEpoch()).
+     */
+    void onDisconnect(const QString& username, qint64 nowMs);
+
+    /**
+     * @brief Пытается удержать сообщение для недавно отключившегося получателя.
+     * @param username Получатель сообщения.
+     * @param message Готовая к отправке JSON-копия (без поля temp_id).
+     * @param nowMs Текущее время.
+     * @return `true` — окно открыто и копия удержана; `false` — окна нет
+     *         или оно истекло, доставку выполнит офлайн-путь из БД.
+     */
+    bool tryEnqueue(const QString& username, const QJsonObject& message, qint64 nowMs);
+
+    /**
+     * @brief Забирает удержанные сообщения на переподключении.
+     * @param username Переподключившийся пользователь.
+     * @param nowMs Текущее время.
+     * @param out Сюда переносятся удержанные сообщения (в порядке приема).
+     * @param overflowed Сюда пишется признак переполнения: часть сообщений
+     *        не поместилась, и БД-проход пропускать нельзя.
+     * @return `true` — окно было открыто (даже если сообщений не накопилось
+     *         и БД-проход можно пропустить); `false` — окна нет или истекло.
+     */
+    bool take(const QString& username, qint64 nowMs,
+              QList<QJsonObject>* out, bool* overflowed);
+
+    /** @brief Сообщений, врученных из памяти (для метрик). */
+    qint64 flushedCount() const { return m_flushed; }
+
+    /** @brief Открытых окон удержания (для переписи контейнеров). */
+    int windowCount() const { return m_windows.size(); }
+
+private:
+    /** @brief Окно удержания одного получателя. */
+    struct Entry {
+        qint64 openedMs = 0;          ///< Момент разрыва соединения.
+        bool overflowed = false;      ///< Потолок сообщений был превышен.
+        QList<QJsonObject> messages;  ///< Удержанные копии в порядке приема.
+    };
+
+    /** @brief Лениво выбрасывает записи с истекшим окном. */
+    void sweep(qint64 nowMs);
+
+    QHash<QString, Entry> m_windows; ///< Открытые окна по получателям.
+    qint64 m_lastSweepMs = 0;        ///< Время последней ленивой чистки.
+    qint64 m_flushed = 0;            ///< Счетчик врученных из памяти.
+};
+
+#endif // OUTBOUNDQUEUE_H
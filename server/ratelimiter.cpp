@@ -0,0 +1,87 @@
+/**
+ * @file ratelimiter.cpp
+ * @brief Реализация ведер токенов с классами стоимости команд.
+ */
+
+#include "ratelimiter.h"
+
+RateLimiter::RateLimiter()
+{
+    m_clock.start();
+}
+
+
+qint64 RateLimiter::costOf(const QString& command)
+{
+    // Дешевый класс: эфемерные статусные команды, их и так коалесцирует
+    // и сбрасывает backpressure — жестко ограничивать нет смысла.
+    if (command == QLatin1String("typing")
+        || command == QLatin1String("pong")) {
+        return 1;
+    }
+
+    // Тяжелый класс: команды, за которыми стоит запрос к БД с
+    // LIKE-поиском или выборкой страницы истории.
+    if (command == QLatin1String("search_users")
+        || command == QLatin1String("get_history")
+        || command == QLatin1String("get_call_history")) {
+        return 8;
+    }
+
+    // Обычный класс: сообщения, квитанции, сигнализация звонков и т.п.
+    return 2;
+}
+
+
+RateLimiter::Verdict RateLimiter::consume(QObject* socket, const QString& command,
+                                          qint64* retryAfterMs)
+{
+    const qint64 nowMs = m_clock.elapsed();
+
+    Bucket& bucket = m_buckets[socket]; // Новая сессия получает полное ведро.
+    if (bucket.lastRefillMs == 0) {
+        bucket.lastRefillMs = nowMs;
+    }
+
+    // Пополнение: m_refillPerSecond токенов/с == столько же милли-токенов/мс.
+    const qint64 refill = (nowMs - bucket.lastRefillMs) * m_refillPerSecond;
+    bucket.tokensMilli = qMin(bucket.tokensMilli + refill, m_capacityTokens * 1000);
+    bucket.lastRefillMs = nowMs;
+
+    const qint64 costMilli = costOf(command) * 1000;
+    if (bucket.tokensMilli >= costMilli) {
+        bucket.tokensMilli -= costMilli;
+        bucket.strikes = 0; // Успешный запрос обнуляет серию нарушений.
+        return Verdict::Allow;
+    }
+
+    ++m_throttled;
+    if (++bucket.strikes >= m_strikeLimit) {
+        // Клиент продолжает слать запросы, игнорируя throttled-ответы —
+        // вероятно, зацикленный бот. Дальше разговаривать не о чем.
+        ++m_disconnects;
+        return Verdict::Disconnect;
+    }
+
+    if (retryAfterMs) {
+        // Сколько ждать, пока пополнение покроет стоимость этой команды.
+        const qint64 deficit = costMilli - bucket.tokensMilli;
+        *retryAfterMs = deficit / m_refillPerSecond + 1;
+    }
+    return Verdict::Throttle;
+}
+
+
+void RateLimiter::setLimits(qint64 capacityTokens, qint64 refillPerSecond,
+                            int strikeLimit)
+{
+    m_capacityTokens = qMax<qint64>(1, capacityTokens);
+    m_refillPerSecond = qMax<qint64>(1, refillPerSecond);
+    m_strikeLimit = qMax(1, strikeLimit);
+}
+
+
+void RateLimiter::forget(QObject* socket)
+{
+    m_buckets.remove(socket);
+}
@@ -0,0 +1,108 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QElapsedTimer>
+
+/**
+ * @class RateLimiter
+ * @brief Лимитер запросов: token bucket на каждую сессию.
+ *
+ * @details Один зациклившийся клиент (баг в боте, бесконечный retry) способен
+ * насытить весь однопоточный диспетчер — сервер занят его запросами, остальные
+ * ждут. Лимитер стоит перед `Server::processJsonRequest` и тратит на проверку
+ * O(1): одно хеширование указателя сокета и пара целочисленных операций.
+ *
+ * Модель — классическое ведро токенов:
+ *
+ * - у каждой сессии есть запас токенов (Capacity), пополняемый с постоянной
+ *   скоростью (RefillPerSecond) — всплески разрешены, постоянный поток ограничен;
+ * - каждая команда списывает стоимость своего класса: дешевые статусные
+ *   (typing, pong) — 1, обычные — 2, тяжелые запросы к БД (поиск, история) — 8;
+ * - на пустом ведре запрос отклоняется с ответом `throttled` и засчитывается
+ *   страйк; серия страйков подряд означает, что клиент игнорирует ответы,
+ *   и соединение дешевле разорвать.
+ *
+ * Арифметика ведется в милли-токенах на монотонных часах QElapsedTimer —
+ * без чисел с плавающей точкой и без зависимости от системного времени.
+ *
+ * @note Используется только из основного потока сервера, синхронизация
+ * не требуется.
+ */
+class RateLimiter
+{
+public:
+    /** @brief Решение лимитера по одному входящему запросу. */
+    enum class Verdict {
+        Allow,      ///< Токенов хватает — запрос обрабатывается.
+        Throttle,   ///< Ведро пусто — клиенту уходит ответ `throttled`.
+        Disconnect  ///< Клиент игнорирует троттлинг — соединение разрывается.
+    };
+
+    /** @brief Емкость ведра: размер разрешенного всплеска, токенов. */
+    static constexpr qint64 CapacityTokens = 60;
+
+    /** @brief Скорость пополнения, токенов в секунду (установившийся темп). */
+    static constexpr qint64 RefillPerSecond = 20;
+
+    /** @brief Страйков подряд до принудительного разрыва соединения. */
+    static constexpr int StrikeLimit = 30;
+
+    RateLimiter();
+
+    /**
+     * @brief Применяет лимиты из конфигурации (горячая перезагрузка).
+     *
+     * Действует на последующие вызовы consume(); уже накопленные ведра
+     * сессий не пересчитываются — емкость подействует при пополнении.
+     *
+     * @param capacityTokens Емкость ведра (размер всплеска).
+     * @param refillPerSecond Скорость пополнения, токенов/с.
+     * @param strikeLimit Страйков подряд до разрыва соединения.
+     */
+    void setLimits(qint64 capacityTokens, qint64 refillPerSecond, int strikeLimit);
+
+    /**
+     * @brief Списывает стоимость команды из ведра сессии.
+     * @param socket Сокет-источник запроса (ключ сессии).
+     * @param command Тип команды из поля "type" — определяет стоимость.
+     * @param retryAfterMs Если не nullptr и вердикт Throttle — сюда пишется
+     *        время в миллисекундах, через которое токенов снова хватит.
+     * @return Вердикт: обработать, отклонить или разорвать соединение.
+     */
+    Verdict consume(QObject* socket, const QString& command,
+                    qint64* retryAfterMs = nullptr);
+
+    /** @brief Удаляет ведро отключившейся сессии. */
+    void forget(QObject* socket);
+
+    /** @brief Всего запросов, отклоненных троттлингом (для метрик). */
+    qint64 throttledCount() const { return m_throttled; }
+
+    /** @brief Соединений, разорванных за исчерпание страйков (для метрик). */
+    qint64 disconnectCount() const { return m_disconnects; }
+
+private:
+    /** @brief Состояние ведра одной сессии. */
+    struct Bucket {
+        qint64 tokensMilli = CapacityTokens * 1000; ///< Остаток, милли-токены.
+        qint64 lastRefillMs = 0; ///< Момент последнего пополнения (мс часов).
+        int strikes = 0;         ///< Отклонений подряд без успешного запроса.
+    };
+
+    /** @brief Стоимость команды в токенах по классу нагрузки. */
+    static qint64 costOf(const QString& command);
+
+    qint64 m_capacityTokens = CapacityTokens;   ///< Текущая емкость ведра.
+    qint64 m_refillPerSecond = RefillPerSecond; ///< Текущее пополнение, токенов/с.
+    int m_strikeLimit = StrikeLimit;            ///< Текущий предел страйков.
+
+    QHash<QObject*, Bucket> m_buckets; ///< Ведра по сессиям.
+    QElapsedTimer m_clock;             ///< Монотонные часы пополнения.
+    qint64 m_throttled = 0;            ///< Счетчик отклоненных запросов.
+    qint64 m_disconnects = 0;          ///< Счетчик принудительных разрывов.
+};
+
+#endif // RATELIMITER_H
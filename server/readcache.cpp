@@ -0,0 +1,42 @@
+//См. "readcache.h"
+#include "readcache.h"
+
+#include <QDebug>
+
+bool ReadCache::getPendingRequests(const QString& username, QJsonArray* out) const
+{
+    const auto it = m_pending.constFind(username);
+    if (it == m_pending.constEnd() || it->generation != m_generation) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+    if (out) *out = it->requests;
+    return true;
+}
+
+void ReadCache::storePendingRequests(const QString& username,
+                                     const QJsonArray& requests)
+{
+    // Грубая защита памяти: при переполнении сбрасываем кэш целиком —
+    // записи прошлых поколений все равно мертвы, а перечитать список
+    // дешевле, чем вести LRU ради редкого события
+    if (m_pending.size() >= MaxEntries) {
+        m_pending.clear();
+    }
+
+    m_pending.insert(username, { requests, m_generation });
+}
+
+void ReadCache::invalidatePendingFor(const QString& username)
+{
+    m_pending.remove(username);
+}
+
+void ReadCache::invalidateAllPending()
+{
+    ++m_generation;
+    qDebug() << "[ReadCache] Pending-кэш обесценен, поколение" << m_generation
+             << "(hits:" << m_hits << "misses:" << m_misses << ")";
+}
@@ -0,0 +1,88 @@
+#ifndef READCACHE_H
+#define READCACHE_H
+
+#include <QHash>
+#include <QJsonArray>
+#include <QString>
+
+/**
+ * @class ReadCache
+ * @brief Кэш результатов редких читающих запросов с явной инвалидацией.
+ *
+ * @details Список входящих запросов дружбы перечитывался из SQLite при
+ * каждом входе пользователя, хотя меняется он только тремя обработчиками:
+ * add_contact_request, contact_request_response и update_profile (профиль
+ * отправителя вшит в элементы списка). Кэш держит готовые JSON-массивы в
+ * памяти, и стоимость входа перестает расти с размером таблицы contacts.
+ *
+ * Корректность обеспечивается двумя механизмами:
+ * - **точечная инвалидация** — обработчики, меняющие запросы конкретного
+ *   пользователя, выбивают его запись (invalidatePendingFor);
+ * - **счетчик поколений** — изменения с неизвестным охватом (смена профиля
+ *   видна во всех списках, куда вшит отправитель) поднимают поколение
+ *   (invalidateAllPending), и все записи прошлых поколений считаются
+ *   промахом без обхода таблицы.
+ *
+ * Кэшируются и пустые списки: у большинства пользователей входящих
+ * запросов нет, и именно их входы дают основную массу запросов к БД.
+ *
+ * @note Используется только из основного потока сервера.
+ */
+class ReadCache
+{
+public:
+    /** @brief Максимум закэшированных списков (грубая защита памяти). */
+    static constexpr int MaxEntries = 4096;
+
+    /**
+     * @brief Ищет закэшированный список входящих запросов.
+     * @param username Пользователь-получатель запросов.
+     * @param out Сюда пишется список при попадании.
+     * @return true — попадание (включая закэшированный пустой список).
+     */
+    bool getPendingRequests(const QString& username, QJsonArray* out) const;
+
+    /**
+     * @brief Запоминает свежепрочитанный из БД список.
+     * @param username Пользователь-получатель запросов.
+     * @param requests Список в форме ответа pending_requests_list.
+     */
+    void storePendingRequests(const QString& username, const QJsonArray& requests);
+
+    /**
+     * @brief Точечно выбивает запись пользователя.
+     * @param username Пользователь, чьи входящие запросы изменились.
+     */
+    void invalidatePendingFor(const QString& username);
+
+    /**
+     * @brief Обесценивает все записи одним инкрементом поколения.
+     *
+     * Для изменений с неизвестным охватом: смена профиля отправителя
+     * видна во всех списках, куда он вшит.
+     */
+    void invalidateAllPending();
+
+    /** @brief Попаданий (для метрик и логов). */
+    qint64 hits() const { return m_hits; }
+
+    /** @brief Промахов (для метрик и логов). */
+    qint64 misses() const { return m_misses; }
+
+    /** @brief Записей в кэше (для переписи контейнеров). */
+    int entryCount() const { return m_pending.size(); }
+
+private:
+    /** @brief Запись кэша: список и поколение на момент записи. */
+    struct Entry {
+        QJsonArray requests; ///< Список запросов в форме ответа.
+        quint64 generation;  ///< Поколение кэша на момент записи.
+    };
+
+    QHash<QString, Entry> m_pending; ///< Списки по получателям.
+    quint64 m_generation = 1;        ///< Текущее поколение.
+    mutable qint64 m_hits = 0;       ///< Счетчик попаданий.
+    mutable qint64 m_misses = 0;     ///< Счетчик промахов.
+};
+
+#endif // READCACHE_H
@@ -0,0 +1,154 @@
+/**
+ * @file recentmessagecache.cpp
+ * @brief Реализация кэша последних сообщений активных диалогов.
+ */
+
+#include <QDebug>
+
+#include "recentmessagecache.h"
+
+QString RecentMessageCache::keyFor(const QString &user1, const QString &user2)
+{
+    // Канонический ключ: участники в лексическом порядке, разделитель —
+    // управляющий символ, который не встречается в username.
+    return (user1 < user2) ? user1 + QLatin1Char('\x1f') + user2
+                           : user2 + QLatin1Char('\x1f') + user1;
+}
+
+
+RecentMessageCache::Entry& RecentMessageCache::touch(const QString &key)
+{
+    const bool isNew = !m_conversations.contains(key);
+
+    // Вытеснение до вставки: кэш не превышает m_maxConversations. Линейный
+    // поиск минимума по ~256 записям дешев и не требует отдельного списка.
+    if (isNew && m_conversations.size() >= m_maxConversations) {
+        auto oldest = m_conversations.begin();
+        for (auto it = m_conversations.begin(); it != m_conversations.end(); ++it) {
+            if (it->lastUse < oldest->lastUse) {
+                oldest = it;
+            }
+        }
+        m_conversations.erase(oldest);
+    }
+
+    Entry &entry = m_conversations[key];
+    entry.lastUse = ++m_useCounter;
+    return entry;
+}
+
+
+void RecentMessageCache::setLimits(int maxConversations,
+                                   int maxMessagesPerConversation)
+{
+    m_maxConversations = qMax(1, maxConversations);
+    m_maxMessagesPerConversation = qMax(1, maxMessagesPerConversation);
+}
+
+
+void RecentMessageCache::seedLatest(const QString &user1, const QString &user2,
+                                    const QJsonArray &latestAscending)
+{
+    Entry &entry = touch(keyFor(user1, user2));
+
+    entry.messages.clear();
+    entry.messages.reserve(latestAscending.size());
+    for (const QJsonValue &value : latestAscending) {
+        entry.messages.append(value.toObject());
+    }
+
+    // Страница before_id = 0 — это по определению голова диалога в БД:
+    // с этого момента append() сохраняет непрерывность.
+    entry.headContiguous = true;
+}
+
+
+void RecentMessageCache::append(const QString &user1, const QString &user2,
+                                const QJsonObject &message)
+{
+    const QString key = keyFor(user1, user2);
+
+    // Незасеянный диалог не создаем: без свежайшей страницы из БД его
+    // содержимое было бы усеченным и непригодным для выдачи.
+    const auto it = m_conversations.find(key);
+    if (it == m_conversations.end()) {
+        return;
+    }
+
+    it->lastUse = ++m_useCounter;
+    it->messages.append(message);
+
+    // Отрезаем хвост старых сообщений: непрерывность головы сохраняется.
+    while (it->messages.size() > m_maxMessagesPerConversation) {
+        it->messages.removeFirst();
+    }
+}
+
+
+bool RecentMessageCache::latestPage(const QString &user1, const QString &user2,
+                                    int limit, QJsonArray &out)
+{
+    const auto it = m_conversations.find(keyFor(user1, user2));
+    if (it == m_conversations.end()) {
+        return false;
+    }
+
+    // Отдаем из кэша только полную страницу: если сообщений меньше limit,
+    // клиент счел бы историю короче, чем она есть в БД.
+    if (!it->headContiguous || it->messages.size() < limit) {
+        return false;
+    }
+
+    it->lastUse = ++m_useCounter;
+
+    const int first = it->messages.size() - limit;
+    for (int i = first; i < it->messages.size(); ++i) {
+        out.append(it->messages.at(i));
+    }
+    return true;
+}
+
+
+void RecentMessageCache::markFlag(const QString &user1, const QString &user2,
+                                  qint64 messageId, const QString &field)
+{
+    const auto it = m_conversations.find(keyFor(user1, user2));
+    if (it == m_conversations.end()) {
+        return;
+    }
+
+    // Статусы приходят для недавних сообщений — ищем с хвоста.
+    for (int i = it->messages.size() - 1; i >= 0; --i) {
+        QJsonObject &message = it->messages[i];
+        if (qint64(message["id"].toDouble()) == messageId) {
+            message[field] = 1;
+            return;
+        }
+    }
+}
+
+
+void RecentMessageCache::markFlagUpTo(const QString &from, const QString &to,
+                                      qint64 upToId, const QString &field)
+{
+    const auto it = m_conversations.find(keyFor(from, to));
+    if (it == m_conversations.end()) {
+        return;
+    }
+
+    // Сообщения лежат по возрастанию id — хвост диапазона обрывает проход.
+    for (QJsonObject &message : it->messages) {
+        if (qint64(message["id"].toDouble()) > upToId) {
+            break;
+        }
+        if (message["fromUser"].toString() == from) {
+            message[field] = 1;
+        }
+    }
+}
+
+
+void RecentMessageCache::invalidate(const QString &user1, const QString &user2)
+{
+    m_conversations.remove(keyFor(user1, user2));
+}
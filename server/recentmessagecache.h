@@ -0,0 +1,127 @@
+#ifndef RECENTMESSAGECACHE_H
+#define RECENTMESSAGECACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QJsonObject>
+#include <QJsonArray>
+
+/**
+ * @class RecentMessageCache
+ * @brief Ограниченный кэш последних сообщений активных диалогов.
+ *
+ * @details По трассировкам >80% запросов истории — это последняя страница
+ * диалога, в котором собеседники прямо сейчас переписываются. Кэш позволяет
+ * handleGetHistory отвечать на такие запросы из памяти, не трогая SQLite:
+ *
+ * - **Write-through.** handlePrivateMessage дописывает каждое сохраненное
+ *   сообщение в запись своего диалога; handleGetHistory засевает запись
+ *   последней страницей из БД при первом промахе.
+ * - **Непрерывность головы.** Страница отдается из кэша только если запись
+ *   засеяна свежайшей страницей БД (флаг непрерывности) и содержит не
+ *   меньше сообщений, чем запрошено, — усеченная история клиенту не уйдет.
+ * - **Ограниченность.** На диалог хранится не больше MaxMessagesPerConversation
+ *   сообщений (старые отрезаются), диалогов — не больше MaxConversations
+ *   (вытесняется самый давно использованный).
+ * - **Согласованность.** Статусы доставки/прочтения обновляются по месту;
+ *   редактирование и удаление сообщений инвалидируют запись диалога целиком.
+ *
+ * @note Используется только из основного потока сервера. Сообщения хранятся
+ * как QJsonObject в той же форме, что и строки ответа history_data.
+ */
+class RecentMessageCache
+{
+public:
+    /** @brief Максимум сообщений, удерживаемых на один диалог. */
+    static constexpr int MaxMessagesPerConversation = 100;
+
+    /** @brief Максимум диалогов в кэше (LRU-вытеснение). */
+    static constexpr int MaxConversations = 256;
+
+    /**
+     * @brief Применяет размеры из конфигурации (горячая перезагрузка).
+     *
+     * Ужесточение подействует при ближайших вставках (лишнее вытеснится
+     * естественным путем), расширение — сразу.
+     *
+     * @param maxConversations Максимум диалогов в кэше.
+     * @param maxMessagesPerConversation Максимум сообщений на диалог.
+     */
+    void setLimits(int maxConversations, int maxMessagesPerConversation);
+
+    /**
+     * @brief Засевает запись диалога последней страницей из БД.
+     * @param user1 Первый участник диалога.
+     * @param user2 Второй участник диалога.
+     * @param latestAscending Свежайшие сообщения в порядке возрастания id
+     *        (как в ответе history_data при before_id = 0).
+     */
+    void seedLatest(const QString &user1, const QString &user2,
+                    const QJsonArray &latestAscending);
+
+    /**
+     * @brief Дописывает новое сообщение в запись диалога (write-through).
+     * @details Не создает запись: диалог без засеянной головы продолжает
+     * обслуживаться из БД до первого запроса истории.
+     */
+    void append(const QString &user1, const QString &user2,
+                const QJsonObject &message);
+
+    /**
+     * @brief Пытается отдать последнюю страницу диалога из кэша.
+     * @param limit Размер запрошенной страницы.
+     * @param out Сюда записывается страница (возрастание id), если резидентна.
+     * @return true, если страница целиком резидентна и записана в out.
+     */
+    bool latestPage(const QString &user1, const QString &user2,
+                    int limit, QJsonArray &out);
+
+    /**
+     * @brief Помечает сообщение диалога флагом (is_delivered / is_read).
+     * @param field Имя JSON-поля статуса, устанавливаемого в 1.
+     */
+    void markFlag(const QString &user1, const QString &user2,
+                  qint64 messageId, const QString &field);
+
+    /**
+     * @brief Помечает флагом все сообщения автора вплоть до id включительно.
+     * @details Диапазонный аналог markFlag для компактных квитанций
+     *          (`up_to_id`): затрагиваются только сообщения from -> to.
+     * @param field Имя JSON-поля статуса, устанавливаемого в 1.
+     */
+    void markFlagUpTo(const QString &from, const QString &to,
+                      qint64 upToId, const QString &field);
+
+    /**
+     * @brief Сбрасывает запись диалога (редактирование/удаление сообщения).
+     */
+    void invalidate(const QString &user1, const QString &user2);
+
+    /**
+     * @brief Число резидентных диалогов (для метрик).
+     */
+    int conversationCount() const { return m_conversations.size(); }
+
+private:
+    /** @brief Запись одного диалога. */
+    struct Entry {
+        QList<QJsonObject> messages; ///< Последние сообщения, возрастание id.
+        bool headContiguous = false; ///< Голова совпадает со свежайшей в БД.
+        quint64 lastUse = 0;         ///< Метка LRU (счетчик обращений).
+    };
+
+    /** @brief Канонический ключ диалога (участники в лексическом порядке). */
+    static QString keyFor(const QString &user1, const QString &user2);
+
+    int m_maxConversations = MaxConversations; ///< Текущий предел диалогов.
+    int m_maxMessagesPerConversation = MaxMessagesPerConversation; ///< Предел на диалог.
+
+    /** @brief Обновляет метку LRU и при переполнении вытесняет старейший диалог. */
+    Entry& touch(const QString &key);
+
+    QHash<QString, Entry> m_conversations; ///< Записи диалогов по ключу.
+    quint64 m_useCounter = 0;              ///< Монотонный счетчик обращений LRU.
+};
+
+#endif // RECENTMESSAGECACHE_H
@@ -0,0 +1,250 @@
+#include "replaylog.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimer>
+#include <QDebug>
+
+/**
+ * Реализация журнала повтора трафика.
+ *
+ * Формат — строка JSONL на кадр; журнал самодостаточен (псевдонимы и
+ * номера сессий вычислены при захвате), поэтому драйвер воспроизведения
+ * не нуждается ни в карте обезличивания, ни в исходной базе.
+ */
+
+namespace {
+
+/// Поля адресации, значения которых — имена пользователей (обезличиваются).
+const char* const UserFields[] = {
+    "username", "user", "to", "from", "recipient", "contact",
+    "with_user", "owner", "target",
+};
+
+/// Поля-списки имен пользователей (обезличивается каждый элемент).
+const char* const UserListFields[] = {
+    "members", "users", "usernames", "participants",
+};
+
+/// Секреты: вырезаются из журнала целиком.
+const char* const SecretFields[] = {
+    "password", "token", "resume_key", "key", "aead",
+};
+
+/// Свободный текст: заменяется заполнителем той же длины.
+const char* const TextFields[] = {
+    "payload", "text", "message", "status_message", "display_name", "term",
+};
+
+} // namespace
+
+// ===========================================================================
+// ReplayLog — захват
+// ===========================================================================
+
+ReplayLog::ReplayLog(const QString& path, QObject* parent)
+    : QObject(parent)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "[REPLAY] Cannot open capture log" << path
+                   << ":" << m_file.errorString();
+        return;
+    }
+    m_clock.start();
+    qInfo() << "[REPLAY] Capture enabled, appending to" << path;
+}
+
+QString ReplayLog::pseudonym(const QString& username)
+{
+    if (username.isEmpty()) {
+        return QString();
+    }
+    auto it = m_pseudonyms.find(username);
+    if (it == m_pseudonyms.end()) {
+        it = m_pseudonyms.insert(
+            username, QStringLiteral("user-%1").arg(m_pseudonyms.size() + 1));
+    }
+    return it.value();
+}
+
+QJsonObject ReplayLog::scrub(const QJsonObject& request)
+{
+    QJsonObject out = request;
+
+    for (const char* field : UserFields) {
+        const auto key = QLatin1String(field);
+        if (out.contains(key) && out[key].isString()) {
+            out[key] = pseudonym(out[key].toString());
+        }
+    }
+
+    for (const char* field : UserListFields) {
+        const auto key = QLatin1String(field);
+        if (out.contains(key) && out[key].isArray()) {
+            QJsonArray scrubbed;
+            const QJsonArray src = out[key].toArray();
+            for (const QJsonValue& v : src) {
+                scrubbed.append(v.isString() ? QJsonValue(pseudonym(v.toString()))
+                                             : v);
+            }
+            out[key] = scrubbed;
+        }
+    }
+
+    for (const char* field : SecretFields) {
+        out.remove(QLatin1String(field));
+    }
+
+    // Содержимое сообщений — PII, но его размер определяет стоимость
+    // обработки; заполнитель той же длины сохраняет профиль нагрузки
+    for (const char* field : TextFields) {
+        const auto key = QLatin1String(field);
+        if (out.contains(key) && out[key].isString()) {
+            out[key] = QString(out[key].toString().size(), QLatin1Char('x'));
+        }
+    }
+
+    return out;
+}
+
+void ReplayLog::record(QObject* socket, const QString& username,
+                       const QJsonObject& request)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    auto it = m_sessionIds.find(socket);
+    if (it == m_sessionIds.end()) {
+        it = m_sessionIds.insert(socket, m_nextSessionId++);
+    }
+
+    QJsonObject entry;
+    entry["t"] = double(m_clock.elapsed());
+    entry["sid"] = it.value();
+    entry["user"] = pseudonym(username);
+    entry["req"] = scrub(request);
+
+    m_file.write(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+    m_file.write("\n", 1);
+}
+
+// ===========================================================================
+// ReplayDriver — воспроизведение
+// ===========================================================================
+
+ReplayDriver::ReplayDriver(const QString& path, double speed,
+                           Inject inject, Bind bind, QObject* parent)
+    : QObject(parent)
+    , m_path(path)
+    , m_speed(speed)
+    , m_inject(std::move(inject))
+    , m_bind(std::move(bind))
+{
+}
+
+bool ReplayDriver::load()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "[REPLAY] Cannot open replay log" << m_path
+                    << ":" << file.errorString();
+        return false;
+    }
+
+    qint64 badLines = 0;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        const QJsonDocument doc = QJsonDocument::fromJson(line);
+        if (!doc.isObject()) {
+            ++badLines;
+            continue;
+        }
+        const QJsonObject entry = doc.object();
+        Frame frame;
+        frame.atMs = qint64(entry["t"].toDouble());
+        frame.sessionId = entry["sid"].toInt();
+        frame.user = entry["user"].toString();
+        frame.request = entry["req"].toObject();
+        m_frames.append(frame);
+    }
+
+    if (badLines > 0) {
+        qWarning() << "[REPLAY] Skipped" << badLines
+                   << "malformed lines (truncated capture?)";
+    }
+    if (m_frames.isEmpty()) {
+        qCritical() << "[REPLAY] Log" << m_path << "contains no frames";
+        return false;
+    }
+
+    qInfo() << "[REPLAY] Loaded" << m_frames.size() << "frames spanning"
+            << m_frames.last().atMs << "ms, speed x"
+            << (m_speed > 0.0 ? m_speed : 0.0)
+            << (m_speed > 0.0 ? "" : "(no pacing)");
+    return true;
+}
+
+void ReplayDriver::start()
+{
+    m_clock.start();
+    pump();
+}
+
+QObject* ReplayDriver::sessionFor(const Frame& frame)
+{
+    auto it = m_sessions.find(frame.sessionId);
+    if (it != m_sessions.end()) {
+        return it.value();
+    }
+
+    // Заглушка вместо сокета: диспетчер различает сессии по указателю,
+    // а sendJson на объекте-не-сокете тихо не делает ничего
+    QObject* session = new QObject(this);
+    session->setObjectName(QStringLiteral("replay-session-%1").arg(frame.sessionId));
+    m_sessions.insert(frame.sessionId, session);
+    return session;
+}
+
+void ReplayDriver::pump()
+{
+    int batched = 0;
+    while (m_cursor < m_frames.size()) {
+        const Frame& frame = m_frames[m_cursor];
+
+        if (m_speed > 0.0) {
+            const qint64 dueMs = qint64(double(frame.atMs) / m_speed);
+            const qint64 waitMs = dueMs - m_clock.elapsed();
+            if (waitMs > 0) {
+                QTimer::singleShot(int(qMin<qint64>(waitMs, 60000)),
+                                   this, &ReplayDriver::pump);
+                return;
+            }
+        } else if (batched >= PumpBatchLimit) {
+            // Без пауз кадры идут пачками: возврат в цикл событий дает
+            // дорогу колбэкам потока БД и таймерам сервера
+            QTimer::singleShot(0, this, &ReplayDriver::pump);
+            return;
+        }
+
+        QObject* session = sessionFor(frame);
+
+        // Аутентификацию журнал не содержит (секреты вырезаны при захвате) —
+        // псевдоним сессии из журнала привязывается в реестр напрямую; кадры
+        // до логина шли с пустым именем, поэтому привязка идет по мере журнала
+        if (m_bind && !frame.user.isEmpty()) {
+            m_bind(session, frame.user);
+        }
+        m_inject(frame.request, session);
+        ++m_cursor;
+        ++batched;
+    }
+
+    qInfo() << "[REPLAY] Done:" << m_frames.size() << "frames in"
+            << m_clock.elapsed() << "ms";
+    emit finished(m_frames.size(), m_clock.elapsed());
+}
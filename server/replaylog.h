@@ -0,0 +1,165 @@
+#ifndef REPLAYLOG_H
+#define REPLAYLOG_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QFile>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QVector>
+
+#include <functional>
+
+/**
+ * @class ReplayLog
+ * @brief Запись расшифрованного входящего трафика для детерминированного
+ * воспроизведения.
+ *
+ * @details Продакшен-инциденты невоспроизводимы: к моменту разбора само
+ * чередование запросов, вызвавшее затык, уже потеряно. Журнал повтора
+ * включается переменной MESSENGER_REPLAY_CAPTURE=<файл> и дописывает каждый
+ * кадр, дошедший до `Server::processJsonRequest`, строкой JSONL:
+ *
+ *     {"t":<мс от старта захвата>,"sid":<номер сессии>,
+ *      "user":"user-3","req":{...}}
+ *
+ * Перед записью кадр проходит карту обезличивания: все имена пользователей
+ * (в полях адресации и в списках участников) консистентно заменяются
+ * псевдонимами user-N — один и тот же человек получает один и тот же
+ * псевдоним на весь журнал, так что форма трафика сохраняется. Секреты
+ * (пароли, токены, ключи) вырезаются, а свободный текст (payload, статус)
+ * заменяется заполнителем той же длины: для профилирования важен размер,
+ * а не содержимое.
+ *
+ * Запись идет через qDebug-независимый прямой append в файл; стоимость на
+ * кадр — одна сериализация Compact-JSON, режим строго опциональный.
+ *
+ * @note Живет в основном потоке сервера, синхронизация не требуется.
+ */
+class ReplayLog : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @brief Открывает файл журнала для дозаписи.
+     * @param path Путь к файлу журнала (из MESSENGER_REPLAY_CAPTURE)
+     * @param parent Родительский объект.
+     */
+    explicit ReplayLog(const QString& path, QObject* parent = nullptr);
+
+    /** @brief true, если файл журнала открыт и запись идет. */
+    bool isCapturing() const { return m_file.isOpen(); }
+
+    /**
+     * @brief Дописывает один входящий кадр в журнал.
+     * @param socket Сокет-источник (ключ номера сессии)
+     * @param username Имя аутентифицированной сессии (пустое до логина)
+     * @param request Расшифрованный кадр запроса
+     */
+    void record(QObject* socket, const QString& username,
+                const QJsonObject& request);
+
+private:
+    /** @brief Стабильный псевдоним имени пользователя (user-N). */
+    QString pseudonym(const QString& username);
+
+    /** @brief Возвращает копию кадра с примененной картой обезличивания. */
+    QJsonObject scrub(const QJsonObject& request);
+
+    QFile m_file;                          ///< Файл журнала (JSONL, append)
+    QElapsedTimer m_clock;                 ///< Часы от старта захвата
+    QHash<QObject*, int> m_sessionIds;     ///< Сокет -> номер сессии
+    QHash<QString, QString> m_pseudonyms;  ///< Имя -> псевдоним user-N
+    int m_nextSessionId = 1;               ///< Следующий номер сессии
+};
+
+/**
+ * @class ReplayDriver
+ * @brief Воспроизведение журнала трафика в диспетчер сервера.
+ *
+ * @details Читает журнал ReplayLog и подает кадры в
+ * `Server::processJsonRequest` (через инжектор-замыкание) в исходном
+ * или ускоренном темпе. Каждой сессии журнала соответствует
+ * QObject-заглушка: sendJson на ней тихо не делает ничего, а реестр
+ * сессий заранее привязывает к ней псевдоним из журнала — обезличенные
+ * login-кадры не аутентифицируются сами, но адресация и выборки истории
+ * идут от правильного имени.
+ *
+ * Сервер при этом открывает свою базу обычным путем — оператор заранее
+ * подкладывает снимок БД, соответствующий началу журнала (и обезличенный
+ * той же картой, если сравнивается содержимое, а не только тайминги).
+ *
+ * Темп задается множителем скорости: 1.0 — исходные интервалы между
+ * кадрами, 10.0 — в десять раз быстрее, 0 — без пауз, насколько успевает
+ * цикл событий (кадры подаются пачками через таймер с нулевым интервалом,
+ * чтобы колбэки потока БД не голодали).
+ */
+class ReplayDriver : public QObject
+{
+    Q_OBJECT
+public:
+    /** @brief Инжектор кадра в диспетчер сервера. */
+    using Inject = std::function<void(const QJsonObject& request,
+                                      QObject* session)>;
+    /** @brief Привязка псевдонима к сессии-заглушке в реестре сессий. */
+    using Bind = std::function<void(QObject* session, const QString& username)>;
+
+    /**
+     * @brief Конструктор драйвера воспроизведения.
+     * @param path Путь к файлу журнала
+     * @param speed Множитель скорости (0 — без пауз)
+     * @param inject Подача кадра в диспетчер
+     * @param bind Привязка псевдонима сессии в реестре
+     * @param parent Родительский объект.
+     */
+    ReplayDriver(const QString& path, double speed,
+                 Inject inject, Bind bind, QObject* parent = nullptr);
+
+    /**
+     * @brief Загружает журнал в память.
+     * @return false, если файл не открылся или не содержит ни одного кадра
+     */
+    bool load();
+
+    /** @brief Запускает подачу кадров по расписанию журнала. */
+    void start();
+
+signals:
+    /**
+     * @brief Журнал подан до конца.
+     * @param frames Количество воспроизведенных кадров
+     * @param elapsedMs Фактическая длительность воспроизведения, мс
+     */
+    void finished(qint64 frames, qint64 elapsedMs);
+
+private slots:
+    /** @brief Подает очередную порцию кадров, срок которых наступил. */
+    void pump();
+
+private:
+    /** @brief Один кадр журнала. */
+    struct Frame {
+        qint64 atMs = 0;     ///< Исходная метка времени кадра, мс
+        int sessionId = 0;   ///< Номер сессии журнала
+        QString user;        ///< Псевдоним сессии (пустой до логина)
+        QJsonObject request; ///< Кадр запроса
+    };
+
+    /** @brief Заглушка сессии: создает и привязывает при первом кадре. */
+    QObject* sessionFor(const Frame& frame);
+
+    QString m_path;                      ///< Путь к файлу журнала
+    double m_speed;                      ///< Множитель скорости (0 — без пауз)
+    Inject m_inject;                     ///< Подача кадра в диспетчер
+    Bind m_bind;                         ///< Привязка псевдонима сессии
+    QVector<Frame> m_frames;             ///< Загруженный журнал
+    QHash<int, QObject*> m_sessions;     ///< Номер сессии -> заглушка
+    QElapsedTimer m_clock;               ///< Часы воспроизведения
+    int m_cursor = 0;                    ///< Индекс следующего кадра
+
+    /** @brief Размер пачки кадров между возвратами в цикл событий. */
+    static constexpr int PumpBatchLimit = 256;
+};
+
+#endif // REPLAYLOG_H
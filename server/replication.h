@@ -0,0 +1,132 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <QObject>
+#include <QFile>
+#include <QString>
+#include <QTimer>
+#include <QList>
+
+#include "messagejournal.h"
+
+class DatabaseService;
+
+/**
+ * @class ReplicationService
+ * @brief Горячий резерв серверной SQLite: снимки + хвост журнала сообщений.
+ *
+ * @details До сих пор единственной страховкой данных была ночная копия
+ * файла БД, снятая с работающего сервера, — изредка она оказывалась
+ * битой (копирование под записью без snapshot-семантики). Сервис ведет
+ * каталог резерва (смонтированный со standby-машины или синхронизируемый
+ * в нее) из двух слоев:
+ *
+ * - **Снимки**: периодический `VACUUM INTO` в каталог резерва. Снимок
+ *   checkpoint-консистентен по построению (читается одной read-транзакцией
+ *   WAL) и не останавливает записи: выполняется на соединении пула
+ *   читателей, писатель продолжает работать. Хранятся последние
+ *   KeepSnapshots штук.
+ * - **Хвост журнала**: каждый пакет write-behind журнала сообщений
+ *   (MessageJournal) дописывается JSON-строками в текущий tail-файл —
+ *   одна буферизованная запись и один flush на пакет, то есть
+ *   амплификация записи ограничена одной последовательной копией потока
+ *   сообщений поверх самой БД. Остальные записи (профили, контакты,
+ *   счетчики) низкочастотны и попадают в резерв со следующим снимком.
+ *   На каждом снимке хвост ротируется; файлы старше старейшего
+ *   хранимого снимка удаляются.
+ *
+ * **Процедура failover** (выполняется оператором на standby):
+ * 1. взять свежайший `snapshot-<ms>.db` из каталога резерва и положить
+ *    его как `messenger.db` рабочей директории;
+ * 2. запустить сервер с `MESSENGER_REPLAY_TAIL=<tail-файл(ы) новее
+ *    снимка, через двоеточие>` — хвост проигрывается до начала приема
+ *    соединений;
+ * 3. повторный запуск с тем же хвостом безопасен: ID сообщениям
+ *    присваивает сервер заранее, и проигрывание идет через
+ *    INSERT OR IGNORE — реплей идемпотентен.
+ *
+ * Включается переменной окружения `MESSENGER_STANDBY_DIR=<каталог>`
+ * (по образцу MESSENGER_FILES_DIR); без нее сервис бездействует.
+ *
+ * @note Счетчики работы отдаются наружу gauge-метриками, регистрируемыми
+ * сервером (messenger_replication_*).
+ */
+class ReplicationService : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** @brief Период снятия снимка, мс (15 минут). */
+    static constexpr int SnapshotIntervalMs = 15 * 60 * 1000;
+
+    /** @brief Задержка первого снимка после старта, мс. */
+    static constexpr int FirstSnapshotDelayMs = 60 * 1000;
+
+    /** @brief Сколько последних снимков хранится в каталоге резерва. */
+    static constexpr int KeepSnapshots = 2;
+
+    /**
+     * @brief Конструктор: читает MESSENGER_STANDBY_DIR и открывает хвост.
+     * @param dbService Асинхронный сервис БД (снимки идут через пул читателей).
+     * @param parent Родительский объект (сервер).
+     */
+    explicit ReplicationService(DatabaseService *dbService, QObject *parent = nullptr);
+
+    /** @brief Репликация включена (каталог задан и доступен). */
+    bool enabled() const { return m_enabled; }
+
+    /**
+     * @brief Дописывает пакет журнала сообщений в текущий tail-файл.
+     *
+     * Вызывается из MessageJournal::flush синхронно с постановкой пакета
+     * в поток БД: одна буферизованная запись и один flush на пакет.
+     * @param batch Пакет сообщений в порядке постановки.
+     */
+    void appendMessageBatch(const QList<MessageJournal::PendingMessage> &batch);
+
+    /**
+     * @brief Проигрывает tail-файл(ы) в основную БД при промоушене standby.
+     *
+     * Работает на главном соединении до начала приема клиентов; вставки
+     * идут через INSERT OR IGNORE по серверным ID — повторный реплей
+     * безвреден. Несколько файлов разделяются двоеточием и проигрываются
+     * по порядку.
+     * @param journalPaths Пути tail-файлов (через ':').
+     * @return Количество примененных сообщений, -1 — фатальная ошибка.
+     */
+    static qint64 replayTail(const QString &journalPaths);
+
+    // --- Счетчики для gauge-метрик сервера ---
+
+    /** @brief Байт дописано в tail-журналы за время работы. */
+    qint64 journalBytes() const { return m_journalBytes; }
+
+    /** @brief Снимков снято успешно. */
+    qint64 snapshotsCompleted() const { return m_snapshotsCompleted; }
+
+    /** @brief Возраст последнего снимка, с (0 — снимков еще не было). */
+    qint64 snapshotAgeSeconds() const;
+
+private slots:
+    /** @brief Снимает очередной снимок через пул читателей. */
+    void takeSnapshot();
+
+private:
+    /** @brief Открывает новый tail-файл с текущей меткой времени. */
+    bool rotateTail();
+
+    /** @brief Удаляет снимки сверх KeepSnapshots и устаревшие хвосты. */
+    void pruneStandbyDir();
+
+    DatabaseService *m_dbService;     ///< Сервис БД (не владеем).
+    QString m_dir;                    ///< Каталог резерва (MESSENGER_STANDBY_DIR).
+    bool m_enabled = false;           ///< Каталог задан и доступен.
+    QFile m_tail;                     ///< Текущий tail-файл журнала.
+    QTimer m_snapshotTimer;           ///< Периодика снятия снимков.
+    bool m_snapshotInFlight = false;  ///< Снимок уже выполняется в пуле читателей.
+    qint64 m_journalBytes = 0;        ///< Всего байт дописано в хвосты.
+    qint64 m_snapshotsCompleted = 0;  ///< Успешных снимков.
+    qint64 m_lastSnapshotMs = 0;      ///< Момент последнего снимка (мс эпохи).
+};
+
+#endif // REPLICATION_H
@@ -31,10 +31,41 @@
 #include <QDataStream> ///< Для последовательной записи и чтения бинарных данных.
 #include <QSqlRecord> ///< Представляет запись результата SQL-запроса.
 #include <algorithm> ///< Стандартные алгоритмы C++, например, min, max.
+#include <limits> ///< Граничные значения типов (ключ первой страницы истории).
 #include <QWebSocket> ///< Работа с WebSocket соединениями.
 #include <thread> ///< Работа с потоками из стандартной библиотеки C++.
 #include <QUuid> ///< Генерация уникальных UUID.
+#include <QThread> ///< Рабочие потоки пула TCP-соединений.
+#include <QPointer> ///< Отслеживание времени жизни сокетов в асинхронных коллбэках.
+#include <QElapsedTimer> ///< Измерение времени выполнения обработчиков команд.
+#include <QTimer> ///< Планирование окон отдачи файловых чанков.
+#include <QFile> ///< Доступ к файлу БД для readahead-подсказки прогрева.
+#ifdef Q_OS_UNIX
+#include <fcntl.h> ///< posix_fadvise: подсказка ядру прочитать файл БД наперед.
+#endif
 #include "cryptoutils.h" ///< Пользовательская библиотека для криптографических функций.
+#include "connectionworker.h" ///< Пул рабочих потоков для TCP-соединений.
+#include "asynclogger.h" ///< Счетчик потерь асинхронного логирования (для метрик).
+#include "dbmaintenance.h" ///< Фоновое обслуживание SQLite (checkpoint/vacuum/ANALYZE).
+#include "databaseservice.h" ///< Асинхронный слой доступа к БД (выделенный поток).
+#include "statementcache.h" ///< Кэш подготовленных SQL-запросов для горячих путей.
+#include "messagejournal.h" ///< Write-behind журнал для пакетной записи сообщений.
+#include "replication.h" ///< Горячий резерв БД: снимки и tail-журнал для standby.
+#include "conversationdirectory.h" ///< Справочник диалогов: пара пользователей -> компактный ID.
+#include "tokenstore.h" ///< Кэш токенов автологина с write-behind персистентностью.
+#include "heartbeatmonitor.h" ///< Прикладной heartbeat на колесе таймеров.
+#include "replaylog.h" ///< Захват и воспроизведение входящего трафика.
+#include "handover.h" ///< Передача сокетов при бесшовном рестарте.
+#include "servermetrics.h" ///< Гистограммы обработчиков и административный эндпоинт.
+#include "binarycodec.h" ///< Бинарный кодек для горячих типов сообщений.
+#include "compression.h" ///< Сжатие крупных полезных нагрузок перед шифрованием.
+#include "framebuffer.h" ///< Инкрементальный парсер кадров TCP-потока.
+#include "sockettuning.h" ///< Профиль TCP-опций клиентских соединений.
+#include "shardbus.h" ///< Межузловая шина шардированного режима.
+#include "coldstorage.h" ///< Холодный ярус истории: mmap-сегменты архива.
+#include "callrelay.h" ///< UDP-ретранслятор аудио звонков (fallback за NAT).
+#include "conferencemixer.h" ///< Серверный микшер групповых звонков.
+#include "serverconfig.h" ///< Горячо перезагружаемая конфигурация сервера.
 #include "structures.h" ///< Пользовательские структуры и типы данных.
 #include "server.h" ///< Основной класс сервера и его методы.
 
@@ -52,18 +83,72 @@
  *              новых клиентских подключений.
  *          3.  Инициализирует базу данных, создавая необходимые таблицы, если их нет.
  *              В случае неудачи, приложение аварийно завершается.
- *          4.  Инициализирует карту обработчиков команд (`m_handlers`).
+ *          4.  Инициализирует таблицу обработчиков команд (`m_dispatch`).
  *
  * @param parent Родительский объект в иерархии Qt.
  */
 Server::Server(QObject *parent) : QObject(parent)
 {
     // -----------------------------------------------------------------------
-    // 1. Инициализация TCP-сервера
+    // 0. Конфигурация: server_config.ini рядом с бинарником. Файл
+    //    отслеживается, безопасные настройки применяются без рестарта.
     // -----------------------------------------------------------------------
-    // Создаем экземпляр QTcpServer. Передача `this` в конструктор гарантирует,
-    // что объект `m_secureTcpServer` будет автоматически удален при уничтожении `Server`.
-    m_secureTcpServer = new QTcpServer(this);
+    m_config = new ServerConfig(
+        QCoreApplication::applicationDirPath() + "/server_config.ini", this);
+    connect(m_config, &ServerConfig::configChanged,
+            this, &Server::applyConfig);
+    applyConfig();
+
+    // -----------------------------------------------------------------------
+    // 1. Инициализация TCP-сервера и пула рабочих потоков
+    // -----------------------------------------------------------------------
+    // Количество рабочих потоков для обслуживания TCP-соединений:
+    // - По умолчанию: число ядер CPU (QThread::idealThreadCount).
+    // - MESSENGER_WORKER_THREADS=N — явно задать размер пула.
+    // - MESSENGER_WORKER_THREADS=0 — однопоточный (legacy) режим.
+    int workerCount = QThread::idealThreadCount();
+    if (qEnvironmentVariableIsSet("MESSENGER_WORKER_THREADS")) {
+        workerCount = qEnvironmentVariableIntValue("MESSENGER_WORKER_THREADS");
+    }
+    workerCount = qMax(0, workerCount);
+
+    // Создаем TCP-сервер. В режиме пула он не создает QTcpSocket сам,
+    // а пересылает дескриптор в один из рабочих потоков.
+    auto *tcpServer = new WorkerTcpServer(workerCount > 0, this);
+    m_secureTcpServer = tcpServer;
+
+    if (workerCount > 0) {
+        qInfo() << "[SERVER] Connection worker pool enabled:" << workerCount << "thread(s)";
+
+        for (int i = 0; i < workerCount; ++i) {
+            auto *thread = new QThread(this);
+            thread->setObjectName(QStringLiteral("conn-worker-%1").arg(i));
+
+            auto *worker = new ConnectionWorker(); // Без родителя: будет перемещен в поток
+            worker->moveToThread(thread);
+            connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+
+            // Запрос/отключение приходят в основной поток через очередь событий,
+            // поэтому обработчики и БД остаются однопоточными.
+            connect(worker, &ConnectionWorker::jsonReceived,
+                    this, &Server::onWorkerJsonReceived, Qt::QueuedConnection);
+            connect(worker, &ConnectionWorker::fileChunkReceived,
+                    this, &Server::onWorkerFileChunk, Qt::QueuedConnection);
+            connect(worker, &ConnectionWorker::socketDisconnected,
+                    this, &Server::onWorkerSocketDisconnected, Qt::QueuedConnection);
+            connect(worker, &ConnectionWorker::connectionAdopted,
+                    this, &Server::onConnectionAdopted, Qt::QueuedConnection);
+
+            thread->start();
+            m_workerThreads.append(thread);
+            m_workers.append(worker);
+        }
+
+        connect(tcpServer, &WorkerTcpServer::connectionReady,
+                this, &Server::onWorkerConnectionReady);
+    } else {
+        qInfo() << "[SERVER] Connection worker pool disabled (single-threaded mode)";
+    }
 
     // (Опционально) Сервер для незащищенных соединений (сейчас отключен)
     // m_nonsecureTcpServer = new QTcpServer(this);
@@ -97,15 +182,678 @@ Server::Server(QObject *parent) : QObject(parent)
         qFatal("Fatal: Database initialization failed! Check permissions or disk space.");
     }
 
+    // Промоушен standby: хвост журнала репликации проигрывается в БД до
+    // начала приема соединений (см. процедуру failover в ReplicationService)
+    const QByteArray replayTailEnv = qgetenv("MESSENGER_REPLAY_TAIL");
+    if (!replayTailEnv.isEmpty()) {
+        const qint64 applied =
+            ReplicationService::replayTail(QString::fromUtf8(replayTailEnv));
+        if (applied < 0) {
+            qFatal("Fatal: replication tail replay failed! Database may be behind.");
+        }
+        qInfo() << "[REPL] Replayed" << applied << "message(s) from tail journal(s)";
+    }
+
+    // Состав групп поднимается в память один раз при старте: проверка
+    // членства и веерная рассылка — синхронный горячий путь обработчика
+    // (см. handleGroupMessage), он не может ждать пул читателей БД.
+    loadGroupState();
+    loadUserDirectory();
+
+    // Асинхронный сервис БД: горячие обработчики (история, счетчики,
+    // запись сообщений) выполняют SQL в его потоке, чтобы медленный
+    // дисковый flush не замораживал всех клиентов.
+    m_dbService = new DatabaseService("messenger.db", this);
+    if (!m_dbService->start()) {
+        qFatal("Fatal: Database service thread failed to start!");
+    }
+
+    // Журнал сообщений: групповые транзакции вместо INSERT-на-сообщение.
+    m_messageJournal = new MessageJournal(m_dbService, this);
+
+    // Горячий резерв: периодические снимки через пул читателей и стрим
+    // пакетов журнала сообщений в каталог standby (MESSENGER_STANDBY_DIR)
+    m_replication = new ReplicationService(m_dbService, this);
+    if (m_replication->enabled()) {
+        m_messageJournal->setReplication(m_replication);
+    }
+
+    // -----------------------------------------------------------------------
+    // 4.1. Холодный ярус истории: сегментный архив неактивных диалогов
+    // -----------------------------------------------------------------------
+    m_coldStorage = new ColdStorage(this);
+    if (!m_coldStorage->open(QStringLiteral("archive"))) {
+        qWarning() << "[ARCHIVE] Cold storage unavailable; history stays in SQLite";
+    }
+
+    // Порог неактивности: MESSENGER_ARCHIVE_MONTHS переопределяет значение
+    // по умолчанию, 0 отключает перенос целиком.
+    const QByteArray archiveEnv = qgetenv("MESSENGER_ARCHIVE_MONTHS");
+    if (!archiveEnv.isEmpty()) {
+        bool ok = false;
+        const int parsed = archiveEnv.toInt(&ok);
+        if (ok && parsed >= 0) {
+            m_archiveIdleMonths = parsed;
+        } else {
+            qWarning() << "[ARCHIVE] Invalid MESSENGER_ARCHIVE_MONTHS:" << archiveEnv;
+        }
+    }
+
+    if (m_archiveIdleMonths > 0) {
+        // Ночной проход переноса. Первый запуск отложен, чтобы не
+        // конкурировать со штормом переподключений после рестарта.
+        auto *archiveTimer = new QTimer(this);
+        archiveTimer->setInterval(24 * 60 * 60 * 1000);
+        connect(archiveTimer, &QTimer::timeout,
+                this, &Server::archiveIdleConversations);
+        archiveTimer->start();
+        QTimer::singleShot(5 * 60 * 1000, this, &Server::archiveIdleConversations);
+    } else {
+        qDebug() << "[ARCHIVE] Conversation archiving disabled (MESSENGER_ARCHIVE_MONTHS=0)";
+    }
+
+    // Часовой проход удаления сообщений с истекшим сроком хранения
+    // (исчезающие сообщения). Первый запуск отложен по той же причине,
+    // что и архивный: не конкурировать со штормом переподключений.
+    auto *retentionTimer = new QTimer(this);
+    retentionTimer->setInterval(RetentionSweepIntervalMs);
+    connect(retentionTimer, &QTimer::timeout,
+            this, &Server::pruneExpiredMessages);
+    retentionTimer->start();
+    QTimer::singleShot(10 * 60 * 1000, this, &Server::pruneExpiredMessages);
+
+    // Кэш токенов автологина: живые токены подтягиваются из БД асинхронно,
+    // дальше token_login — чистый поиск в памяти.
+    m_tokenStore = new TokenStore(m_dbService, this);
+    m_tokenStore->loadFromDatabase();
+
+    // Отметки последнего визита копятся в памяти и пишутся пачкой: шторм
+    // обрывов мобильной сети не превращается в шторм одиночных UPDATE.
+    auto *lastSeenTimer = new QTimer(this);
+    lastSeenTimer->setInterval(LastSeenFlushIntervalMs);
+    connect(lastSeenTimer, &QTimer::timeout, this, &Server::flushLastSeen);
+    lastSeenTimer->start();
+
+    // -----------------------------------------------------------------------
+    // 4.2. Прикладной heartbeat: выбраковка полуоткрытых соединений
+    // -----------------------------------------------------------------------
+    m_heartbeat = new HeartbeatMonitor(this);
+
+    connect(m_heartbeat, &HeartbeatMonitor::pingDue, this, [this](QObject *socket) {
+        // Браузерные клиенты отвечают на нативный ping-фрейм автоматически;
+        // TCP-клиентам уходит прикладная команда ping.
+        if (auto *ws = qobject_cast<QWebSocket*>(socket)) {
+            ws->ping();
+            return;
+        }
+        sendJson(socket, QJsonObject{{"type", "ping"}});
+    });
+
+    connect(m_heartbeat, &HeartbeatMonitor::sessionExpired, this, [this](QObject *socket) {
+        qWarning() << "[SERVER] Heartbeat expired for"
+                   << m_sessions.usernameOf(socket, "<unauthenticated>")
+                   << "- dropping dead connection";
+
+        if (auto *ws = qobject_cast<QWebSocket*>(socket)) {
+            ws->abort(); // Очистка пройдет через сигнал disconnected
+            return;
+        }
+
+        if (auto *tcp = qobject_cast<QTcpSocket*>(socket)) {
+            // Сокеты пула соединений живут в рабочих потоках: рвем
+            // соединение в потоке сокета через очередь событий.
+            QMetaObject::invokeMethod(tcp, [tcp]() { tcp->abort(); }, Qt::QueuedConnection);
+        }
+    });
+
+    // Криптопул: несколько потоков под X25519 при рукопожатиях. Больше и не
+    // нужно — одно вычисление занимает сотни микросекунд, пул лишь снимает
+    // пики штормов переподключений с потока событий.
+    m_cryptoPool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+
+    // -----------------------------------------------------------------------
+    // 4.1. Метрики: гистограммы обработчиков и gauge-метрики состояния
+    // -----------------------------------------------------------------------
+    // Межузловая шина: активна только при заданных MESSENGER_SHARD_ID /
+    // MESSENGER_SHARD_PEERS; в одноузловом режиме isLocal() всегда true.
+    m_shardBus = new ShardBus(this);
+    connect(m_shardBus, &ShardBus::envelopeReceived,
+            this, &Server::onShardEnvelope);
+    m_shardBus->start();
+
+    // Ретранслятор аудио: запасной путь для пар за симметричным NAT.
+    m_callRelay = new CallRelay(this);
+    m_callRelay->start();
+
+    // Микшер групповых звонков: приглашения рассылаются, когда поток
+    // комнаты привяжет свой UDP-порт и сообщит его сюда.
+    m_conferenceMixer = new ConferenceMixer(this);
+    connect(m_conferenceMixer, &ConferenceMixer::conferenceReady,
+            this, &Server::onConferenceReady);
+
+    // Журнал повтора трафика: строго опционально, для разбора инцидентов.
+    // Каждый кадр, дошедший до диспетчера, дописывается обезличенной
+    // строкой JSONL (см. ReplayLog); воспроизводится через startReplay().
+    if (qEnvironmentVariableIsSet("MESSENGER_REPLAY_CAPTURE")) {
+        m_replayLog = new ReplayLog(
+            qEnvironmentVariable("MESSENGER_REPLAY_CAPTURE"), this);
+    }
+
+    m_metrics = new ServerMetrics(this);
+
+    // Предохранители несущественных доменов: после серии отказов SQLite
+    // поиск/статистика/аватары отвечают мгновенным отказом, не ретраясь в
+    // ту же стену, — маршрутизация сообщений не шеддится никогда.
+    // Сопоставление команда -> домен здесь же; состояние каждого домена
+    // отдается gauge-метрикой (0 — closed, 1 — half-open, 2 — open).
+    const struct { const char* domain; std::initializer_list<const char*> commands; }
+        breakerDomains[] = {
+            {"search",  {"search_users"}},
+            {"stats",   {"get_call_history", "get_call_stats"}},
+            {"avatars", {"get_profiles", "update_profile"}},
+        };
+    for (const auto& entry : breakerDomains) {
+        const QString domain = QString::fromLatin1(entry.domain);
+        auto* breaker = new CircuitBreaker(domain);
+        m_breakers.insert(domain, breaker);
+        for (const char* command : entry.commands) {
+            m_breakerByCommand.insert(ProtocolSchema::commandIdFor(command),
+                                      breaker);
+        }
+        m_metrics->registerGauge(
+            QStringLiteral("messenger_breaker_state_") + domain,
+            QStringLiteral("Circuit breaker state (0 closed, 1 half-open, 2 open)."),
+            [breaker]() -> qint64 {
+                switch (breaker->state()) {
+                case CircuitBreaker::State::Closed:   return 0;
+                case CircuitBreaker::State::HalfOpen: return 1;
+                case CircuitBreaker::State::Open:     return 2;
+                }
+                return 0;
+            });
+    }
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_breaker_shed_total"),
+        QStringLiteral("Requests rejected by open circuit breakers."),
+        [this]() -> qint64 { return m_breakerShed; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_bulk_queue_depth"),
+        QStringLiteral("Bulk-lane requests deferred behind interactive traffic."),
+        [this]() -> qint64 { return m_bulkQueue.size(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_bulk_shed_total"),
+        QStringLiteral("Bulk requests rejected because the bulk lane overflowed."),
+        [this]() -> qint64 { return m_bulkShed; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_db_warmup_percent"),
+        QStringLiteral("Cold-start page-cache warm-up progress (100 = ready for traffic)."),
+        [this]() -> qint64 {
+            if (m_warmupFinished) return 100;
+            if (m_warmupTotal <= 0) return 0;
+            return qMin<qint64>(99, m_warmupCompleted * 100 / m_warmupTotal);
+        });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_retention_pruned_total"),
+        QStringLiteral("Messages deleted by per-conversation retention policies."),
+        [this]() -> qint64 { return m_retentionPruned; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_online_sessions"),
+        QStringLiteral("Number of authenticated client sessions."),
+        [this]() -> qint64 { return m_sessions.authenticatedSockets().size(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_recent_cache_conversations"),
+        QStringLiteral("Conversations resident in the recent-message cache."),
+        [this]() -> qint64 { return m_recentMessages.conversationCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_pending_write_queues"),
+        QStringLiteral("Sockets with corked outgoing data awaiting flush."),
+        [this]() -> qint64 { return m_pendingWrites.size(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_socket_write_buffer_bytes"),
+        QStringLiteral("Total bytes queued in OS-bound socket write buffers."),
+        [this]() -> qint64 {
+            qint64 total = 0;
+            const QList<QObject*> sockets = m_sessions.authenticatedSockets();
+            for (QObject *obj : sockets) {
+                if (auto *tcp = qobject_cast<QAbstractSocket*>(obj)) {
+                    total += tcp->bytesToWrite();
+                }
+            }
+            return total;
+        });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_typing_coalesced_total"),
+        QStringLiteral("Typing indicators suppressed by per-pair rate limiting."),
+        [this]() -> qint64 { return m_typingCoalesced; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_typing_dropped_backpressure_total"),
+        QStringLiteral("Typing indicators dropped because the recipient send buffer was backed up."),
+        [this]() -> qint64 { return m_typingDroppedBackpressure; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_socket_write_buffer_max_bytes"),
+        QStringLiteral("Largest per-socket outgoing buffer (worst slow consumer)."),
+        [this]() -> qint64 {
+            qint64 worst = 0;
+            const QList<QObject*> sockets = m_sessions.authenticatedSockets();
+            for (QObject *obj : sockets) {
+                if (!m_socketWorkers.contains(obj)) {
+                    worst = qMax(worst, bufferedBytesFor(obj));
+                }
+            }
+            return worst;
+        });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_backpressured_sockets"),
+        QStringLiteral("Sockets currently shedding non-essential traffic."),
+        [this]() -> qint64 { return m_backpressuredSockets.size(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_sends_shed_total"),
+        QStringLiteral("Non-essential sends dropped on backpressured sockets."),
+        [this]() -> qint64 { return m_sendsShedBackpressure; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_slow_consumers_disconnected_total"),
+        QStringLiteral("Connections dropped for exceeding the send-buffer hard cap."),
+        [this]() -> qint64 { return m_slowConsumersDisconnected; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_active_conferences"),
+        QStringLiteral("Conference rooms currently mixing."),
+        [this]() -> qint64 { return m_conferenceMixer->activeConferences(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_conference_frames_mixed"),
+        QStringLiteral("Mix frames produced by live conference rooms."),
+        [this]() -> qint64 { return m_conferenceMixer->totalStats().framesMixed; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_file_uploads_active"),
+        QStringLiteral("File uploads currently streaming to storage."),
+        [this]() -> qint64 { return m_fileTransfers.activeUploads(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_file_downloads_active"),
+        QStringLiteral("File downloads currently streaming to clients."),
+        [this]() -> qint64 { return m_fileTransfers.activeDownloads(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_shard_envelopes_forwarded_total"),
+        QStringLiteral("Envelopes forwarded to other cluster nodes."),
+        [this]() -> qint64 { return m_shardBus->forwardedCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_shard_envelopes_received_total"),
+        QStringLiteral("Envelopes received from other cluster nodes."),
+        [this]() -> qint64 { return m_shardBus->receivedCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_relay_sessions"),
+        QStringLiteral("Call relay sessions currently open."),
+        [this]() -> qint64 { return m_callRelay->activeSessions(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_relay_datagrams_total"),
+        QStringLiteral("Audio datagrams forwarded by the call relay."),
+        [this]() -> qint64 { return m_callRelay->datagramsRelayed(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_archived_messages"),
+        QStringLiteral("History rows resident in cold-storage segments."),
+        [this]() -> qint64 { return m_coldStorage->archivedCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_log_records_dropped_total"),
+        QStringLiteral("Log records dropped because the async logging ring was full."),
+        []() -> qint64 { return AsyncLogger::droppedCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_outbound_queue_flushed_total"),
+        QStringLiteral("Messages delivered from the reconnect grace-window queue."),
+        [this]() -> qint64 { return m_outboundQueue.flushedCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_auth_kdf_rejected_total"),
+        QStringLiteral("Authentication attempts rejected by KDF pool admission limits."),
+        [this]() -> qint64 { return m_kdfRejected; });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_requests_throttled_total"),
+        QStringLiteral("Requests rejected by the per-session rate limiter."),
+        [this]() -> qint64 { return m_rateLimiter.throttledCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_rate_limit_disconnects_total"),
+        QStringLiteral("Connections dropped for ignoring throttle responses."),
+        [this]() -> qint64 { return m_rateLimiter.disconnectCount(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_rate_limit_refill_per_second"),
+        QStringLiteral("Configured token bucket refill rate (tokens/second)."),
+        []() -> qint64 { return RateLimiter::RefillPerSecond; });
+
+    // Фоновое обслуживание БД: ограниченные чекпойнты каждую минуту,
+    // vacuum и ANALYZE — в тихие окна, определяемые по счетчику запросов.
+    m_dbMaintenance = new DbMaintenance(m_metrics, this);
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_db_checkpoints_total"),
+        QStringLiteral("WAL checkpoints completed by the maintenance scheduler."),
+        [this]() -> qint64 { return m_dbMaintenance->checkpointsCompleted(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_db_wal_frames_checkpointed_total"),
+        QStringLiteral("WAL frames moved into the main database file."),
+        [this]() -> qint64 { return m_dbMaintenance->framesCheckpointed(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_db_pages_vacuumed_total"),
+        QStringLiteral("Freelist pages returned to the filesystem by incremental vacuum."),
+        [this]() -> qint64 { return m_dbMaintenance->pagesVacuumed(); });
+
+    // Горячий резерв: объем стрима и свежесть снимков (0 — выключен)
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_replication_journal_bytes_total"),
+        QStringLiteral("Bytes appended to the standby tail journal."),
+        [this]() -> qint64 { return m_replication->journalBytes(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_replication_snapshots_total"),
+        QStringLiteral("Checkpoint-consistent snapshots taken for the standby."),
+        [this]() -> qint64 { return m_replication->snapshotsCompleted(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_replication_snapshot_age_seconds"),
+        QStringLiteral("Age of the newest standby snapshot (0 until the first one)."),
+        [this]() -> qint64 { return m_replication->snapshotAgeSeconds(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_db_analyze_runs_total"),
+        QStringLiteral("ANALYZE passes completed to refresh planner statistics."),
+        [this]() -> qint64 { return m_dbMaintenance->analyzeRuns(); });
+
+    // -----------------------------------------------------------------------
+    // Перепись долгоживущих контейнеров: RSS растет, а heap-профайлер к
+    // боевому процессу не подключить. Каждый подозреваемый (per-socket
+    // таблицы, кэши, очереди записи) регистрирует зонд размера; дамп
+    // `GET /census` сортирует их по приросту с момента старта.
+    // -----------------------------------------------------------------------
+    m_census.registerProbe(QStringLiteral("sessions"), QStringLiteral("session_registry"),
+        [this]() -> qint64 { return m_sessions.authenticatedSockets().size(); });
+    m_census.registerProbe(QStringLiteral("sessions"), QStringLiteral("socket_workers"),
+        [this]() -> qint64 { return m_socketWorkers.size(); });
+    m_census.registerProbe(QStringLiteral("crypto"), QStringLiteral("ws_crypto_managers"),
+        [this]() -> qint64 { return m_wsCrypto.size(); });
+    m_census.registerProbe(QStringLiteral("write_queues"), QStringLiteral("corked_buffers"),
+        [this]() -> qint64 { return m_pendingWrites.size(); },
+        [this]() -> qint64 {
+            qint64 total = 0;
+            for (auto it = m_pendingWrites.constBegin();
+                 it != m_pendingWrites.constEnd(); ++it) {
+                total += it.value().size();
+            }
+            return total;
+        });
+    m_census.registerProbe(QStringLiteral("write_queues"), QStringLiteral("outbound_grace_windows"),
+        [this]() -> qint64 { return m_outboundQueue.windowCount(); });
+    m_census.registerProbe(QStringLiteral("presence"), QStringLiteral("subscriber_lists"),
+        [this]() -> qint64 { return m_presenceSubscribers.size(); });
+    m_census.registerProbe(QStringLiteral("presence"), QStringLiteral("watch_sets"),
+        [this]() -> qint64 { return m_presenceWatches.size(); });
+    m_census.registerProbe(QStringLiteral("caches"), QStringLiteral("recent_message_conversations"),
+        [this]() -> qint64 { return m_recentMessages.conversationCount(); });
+    m_census.registerProbe(QStringLiteral("caches"), QStringLiteral("read_cache_entries"),
+        [this]() -> qint64 { return m_readCache.entryCount(); });
+    m_census.registerProbe(QStringLiteral("calls"), QStringLiteral("active_calls"),
+        [this]() -> qint64 { return m_activeCalls.size(); });
+    m_census.registerProbe(QStringLiteral("messages"), QStringLiteral("message_owners"),
+        [this]() -> qint64 { return m_messageOwners.size(); });
+    m_census.registerProbe(QStringLiteral("messages"), QStringLiteral("group_member_sets"),
+        [this]() -> qint64 { return m_groupMembers.size(); });
+    m_census.registerProbe(QStringLiteral("typing"), QStringLiteral("pair_forward_clocks"),
+        [this]() -> qint64 { return m_typingForwards.size(); });
+    m_census.registerProbe(QStringLiteral("search"), QStringLiteral("search_generations"),
+        [this]() -> qint64 { return m_searchGenerations.size(); });
+    m_census.registerProbe(QStringLiteral("delivery"), QStringLiteral("offline_deliveries"),
+        [this]() -> qint64 { return m_offlineDeliveries.size(); });
+    m_census.registerProbe(QStringLiteral("auth"), QStringLiteral("kdf_per_ip"),
+        [this]() -> qint64 { return m_kdfPerIp.size(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_census_tracked_entries"),
+        QStringLiteral("Entries across all containers tracked by the leak census."),
+        [this]() -> qint64 { return m_census.totalEntries(); });
+
+    m_metrics->registerGauge(
+        QStringLiteral("messenger_census_tracked_bytes"),
+        QStringLiteral("Bytes across census containers with cheap byte accounting."),
+        [this]() -> qint64 { return m_census.totalBytes(); });
+
+    // Точечный снимок состояния для разбора инцидентов (GET /snapshot).
+    m_metrics->registerSnapshotProvider([this]() { return buildAdminSnapshot(); });
+
+    // Перепись контейнеров с приростом с момента старта (GET /census).
+    m_metrics->registerCensusProvider([this]() { return m_census.dump(); });
+
+    m_metrics->startAdminEndpoint();
+
+    // Монотонные часы коалесценции typing-индикаторов.
+    m_typingClock.start();
+
     // -----------------------------------------------------------------------
     // 5. Инициализация логики (Dispatch Map)
     // -----------------------------------------------------------------------
-    // Заполняем карту `m_handlers`, связывая текстовые команды JSON (например, "LOGIN")
+    // Заполняем таблицу `m_dispatch`, связывая команды JSON (например, "login")
     // с методами C++ (например, &Server::handleLogin).
     initHandlers();
 }
 
 
+/**
+ * @brief Деструктор: останавливает рабочие потоки пула соединений.
+ *
+ * @details Сначала гасятся accept-листенеры (перестаем принимать новые
+ * соединения), затем рабочие потоки. Каждому потоку отправляется quit()
+ * и ожидается его завершение; воркеры и листенеры удаляются автоматически
+ * по сигналу QThread::finished.
+ */
+Server::~Server()
+{
+    flushLastSeen(); // Хвост отметок last_seen — в очередь БД до остановки потоков
+
+    for (QThread *thread : m_listenerThreads) {
+        thread->quit();
+        thread->wait();
+    }
+    for (QThread *thread : m_workerThreads) {
+        thread->quit();
+        thread->wait();
+    }
+
+    qDeleteAll(m_breakers); // Предохранители — не QObject, удаляем вручную
+}
+
+
+/**
+ * @brief Регистрирует отказ подсистемы в предохранителе ее домена.
+ *
+ * @details Единая точка для веток ошибок шеддируемых обработчиков:
+ * классифицированный отказ попадает в предохранитель домена, и после
+ * серии (или немедленно — для Permanent) домен переходит на быстрый
+ * отказ. Вызов с неизвестным доменом безвреден.
+ */
+void Server::reportSubsystemFailure(const QString& domain,
+                                    CircuitBreaker::ErrorClass errorClass)
+{
+    if (CircuitBreaker* breaker = m_breakers.value(domain, nullptr)) {
+        breaker->recordFailure(errorClass);
+    }
+}
+
+
+/**
+ * @brief true для команд объемной полосы.
+ *
+ * @details Объемные — команды, чей обработчик читает помногу (история,
+ * поиск, пакетные профили, статистика звонков, массовый импорт): их
+ * задержка и так измеряется чтением БД, лишние миллисекунды в очереди
+ * незаметны. Все остальное — интерактивная полоса: сообщения,
+ * сигнализация звонков, статусы, typing.
+ */
+bool Server::isBulkCommand(const QString& type)
+{
+    static const QSet<QString> bulk = {
+        QStringLiteral("get_history"),
+        QStringLiteral("search_users"),
+        QStringLiteral("get_profiles"),
+        QStringLiteral("get_call_history"),
+        QStringLiteral("add_contacts_bulk"),
+    };
+    return bulk.contains(type);
+}
+
+
+/**
+ * @brief Взводит осушение объемной очереди.
+ *
+ * @details Нулевой таймер встает в конец очереди событий: все уже
+ * принятые интерактивные запросы (и новые кадры воркеров) обслуживаются
+ * раньше следующего кванта объемной работы.
+ */
+void Server::scheduleBulkDrain()
+{
+    if (m_bulkDrainScheduled) {
+        return;
+    }
+    m_bulkDrainScheduled = true;
+    QTimer::singleShot(0, this, &Server::drainBulkQueue);
+}
+
+
+/**
+ * @brief Осушает объемную очередь одним квантом.
+ *
+ * @details Обрабатывает запросы, пока не истечет бюджет кванта
+ * (BulkSliceBudgetMs) — затем уступает цикл событий и перевзводится.
+ * Под чистым объемным трафиком пропускная способность не падает
+ * (кванты идут подряд), а при смешанном интерактивные запросы ждут
+ * не дольше одного кванта вместо всей глубины очереди.
+ */
+void Server::drainBulkQueue()
+{
+    m_bulkDrainScheduled = false;
+
+    QElapsedTimer slice;
+    slice.start();
+
+    m_drainingBulk = true;
+    while (!m_bulkQueue.isEmpty() && slice.elapsed() < BulkSliceBudgetMs) {
+        const DeferredBulkRequest deferred = m_bulkQueue.takeFirst();
+        if (!deferred.socket) {
+            continue; // Клиент отключился, пока запрос стоял в очереди
+        }
+        processJsonRequest(deferred.request, deferred.socket.data(),
+                           deferred.payloadBytes);
+    }
+    m_drainingBulk = false;
+
+    if (!m_bulkQueue.isEmpty()) {
+        scheduleBulkDrain();
+    }
+}
+
+
+/**
+ * @brief Назначает новое TCP-соединение одному из воркеров пула.
+ *
+ * @details Дескрипторы распределяются по кругу (round-robin), что дает
+ * равномерную загрузку потоков. QTcpSocket будет создан уже в рабочем потоке,
+ * поэтому вся дальнейшая работа с сокетом (чтение, фрейминг, криптография)
+ * не затрагивает основной цикл событий.
+ */
+void Server::onWorkerConnectionReady(qintptr socketDescriptor)
+{
+    ConnectionWorker *worker = m_workers.at(m_nextWorker);
+    m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+
+    QMetaObject::invokeMethod(worker, "addConnection", Qt::QueuedConnection,
+                              Q_ARG(qintptr, socketDescriptor));
+}
+
+
+/**
+ * @brief Принимает готовый JSON-запрос из рабочего потока.
+ *
+ * @details Выполняется в основном потоке сервера. Здесь же лениво заполняется
+ * карта `m_socketWorkers`: при первом запросе сокет связывается с воркером,
+ * чтобы sendJson() мог маршрутизировать ответы обратно в правильный поток.
+ */
+void Server::onWorkerJsonReceived(const QJsonObject &request, QObject *socket)
+{
+    auto *worker = qobject_cast<ConnectionWorker*>(sender());
+    if (worker && !m_socketWorkers.contains(socket)) {
+        m_socketWorkers.insert(socket, worker);
+        m_sessions.open(socket); // Первый запрос сокета из пула — регистрируем сессию
+        m_heartbeat->track(socket);
+    }
+
+    processJsonRequest(request, socket);
+}
+
+
+/**
+ * @brief Принимает бинарный чанк файловой передачи из рабочего потока.
+ *
+ * @details Выполняется в основном потоке: состояние передач (FileTransfer)
+ * не требует синхронизации, а чанк применяется тем же handleFileChunk,
+ * что и для сокетов основного потока.
+ */
+void Server::onWorkerFileChunk(const QByteArray &chunk, QObject *socket)
+{
+    handleFileChunk(socket, chunk);
+}
+
+
+/**
+ * @brief Обрабатывает отключение клиента, обслуживаемого пулом.
+ *
+ * @details Состояние воркера (очередь записи, реестр живых сокетов) уже
+ * очищено; здесь выполняется логическая часть — last_seen, карты
+ * онлайн-статуса, активные звонки, оповещение остальных клиентов — после
+ * чего воркеру queued-вызовом возвращается запрос на удаление сокета.
+ * Удалять раньше нельзя: этот слот и возможные jsonReceived перед ним
+ * приходят из одной очереди, и только по их исчерпании указатель
+ * гарантированно мертв для главного потока (см.
+ * ConnectionWorker::releaseSocket).
+ */
+void Server::onWorkerSocketDisconnected(QObject *socket)
+{
+    ConnectionWorker *worker = m_socketWorkers.take(socket);
+    handleClientDisconnect(socket, /*ownedByWorker=*/true);
+
+    if (worker) {
+        QMetaObject::invokeMethod(worker, [worker, socket]() {
+            worker->releaseSocket(socket);
+        }, Qt::QueuedConnection);
+    } else {
+        // Воркер уже остановлен (shutdown) — удаляем из главного потока.
+        socket->deleteLater();
+    }
+}
+
+
 /**
  * @brief Запускает сетевые службы сервера.
  *
@@ -121,9 +869,67 @@ Server::Server(QObject *parent) : QObject(parent)
  */
 bool Server::listen(const QHostAddress &address, quint16 tcpPort, quint16 wsPort)
 {
-    // 1. Попытка запуска защищенного TCP-сервера
+    // 0 означает "взять из конфигурации" (порты применяются только при
+    // старте: их смена требует rebind и рестарта)
+    const auto config = m_config->current();
+    if (tcpPort == 0) tcpPort = config->tcpPort;
+    if (wsPort == 0) wsPort = config->wsPort;
+
+    // 1. Попытка запуска защищенного TCP-сервера.
+    // При listener_shards > 1 (и включенном пуле воркеров) порт делят
+    // несколько листенеров через SO_REUSEPORT: ядро шардирует accept'ы
+    // между потоками, и лавина переподключений после рестарта не
+    // упирается в один accept-поток (~900 соединений/с в одном потоке).
     //QHostAddress address("26.57.175.166");
-    bool tcpSuccess = m_secureTcpServer->listen(address, tcpPort);
+    int shards = qMax(1, config->listenerShards);
+    if (m_workers.isEmpty()) {
+        shards = 1; // Без пула дескрипторы некому раздавать
+    }
+
+    bool tcpSuccess;
+    auto *primary = static_cast<WorkerTcpServer*>(m_secureTcpServer);
+
+    if (shards > 1 && primary->listenReusePort(address, tcpPort)) {
+        // Основной листенер уже в режиме SO_REUSEPORT; раздача дескрипторов
+        // идет напрямую воркерам, минуя основной цикл событий
+        primary->setWorkerPool(m_workers, 0);
+        tcpSuccess = true;
+
+        for (int i = 1; i < shards; ++i) {
+            auto *thread = new QThread(this);
+            thread->setObjectName(QStringLiteral("tcp-listener-%1").arg(i));
+
+            auto *listener = new WorkerTcpServer(true); // Без родителя: уедет в поток
+            // Стартовые индексы round-robin разнесены, чтобы шарды не
+            // начинали раздачу с одного и того же воркера
+            listener->setWorkerPool(m_workers, i % m_workers.size());
+            listener->moveToThread(thread);
+            connect(thread, &QThread::finished, listener, &QObject::deleteLater);
+            thread->start();
+            m_listenerThreads.append(thread);
+
+            // bind/listen выполняются в потоке листенера: нотификатор
+            // сокета должен принадлежать потоку, который будет принимать
+            bool shardOk = false;
+            QMetaObject::invokeMethod(listener, [listener, address, tcpPort]() {
+                return listener->listenReusePort(address, tcpPort);
+            }, Qt::BlockingQueuedConnection, &shardOk);
+
+            if (!shardOk) {
+                qWarning() << "[SERVER] Listener shard" << i
+                           << "failed to start; continuing with" << i << "shard(s)";
+                break;
+            }
+        }
+
+        qInfo() << "[SERVER] TCP accept sharding:"
+                << (m_listenerThreads.size() + 1) << "listener(s) on port" << tcpPort;
+    } else {
+        if (shards > 1) {
+            qWarning() << "[SERVER] SO_REUSEPORT unavailable - falling back to a single listener";
+        }
+        tcpSuccess = m_secureTcpServer->listen(address, tcpPort);
+    }
 
     // 2. Попытка запуска WebSocket-сервера
     bool wsSuccess = m_webSocketServer->listen(address, wsPort);
@@ -133,6 +939,11 @@ bool Server::listen(const QHostAddress &address, quint16 tcpPort, quint16 wsPort
         qInfo() << "Server started successfully!";
         qInfo() << " - TCP Server listening on:" << address.toString() << ":" << tcpPort;
         qInfo() << " - WebSocket Server listening on:" << address.toString() << ":" << wsPort;
+
+        // Прогрев страничного кэша БД — после начала прослушивания, в фоне:
+        // деплой дожидается messenger_db_warmup_percent == 100 и только
+        // потом переводит трафик на этот узел
+        QTimer::singleShot(0, this, &Server::startDatabaseWarmup);
         return true;
     }
 
@@ -152,6 +963,244 @@ bool Server::listen(const QHostAddress &address, quint16 tcpPort, quint16 wsPort
     return false;
 }
 
+bool Server::startReplay(const QString& logPath)
+{
+    // Темп воспроизведения: 1.0 — исходные интервалы журнала,
+    // N — в N раз быстрее, 0 — без пауз (профилирование под лупой)
+    double speed = 1.0;
+    if (qEnvironmentVariableIsSet("MESSENGER_REPLAY_SPEED")) {
+        bool ok = false;
+        const double parsed =
+            qEnvironmentVariable("MESSENGER_REPLAY_SPEED").toDouble(&ok);
+        if (ok && parsed >= 0.0) {
+            speed = parsed;
+        } else {
+            qWarning() << "[REPLAY] Invalid MESSENGER_REPLAY_SPEED, using 1.0";
+        }
+    }
+
+    // Кадры идут в тот же диспетчер, что и живой трафик: лимитер, метрики
+    // и трассировка работают как в продакшене. Сессии журнала — заглушки;
+    // sendJson на них не делает ничего, реестр сессий привязывает
+    // псевдонимы напрямую (аутентификация в журнале обезличена).
+    auto *driver = new ReplayDriver(
+        logPath, speed,
+        [this](const QJsonObject& request, QObject* session) {
+            processJsonRequest(request, session);
+        },
+        [this](QObject* session, const QString& username) {
+            if (!m_sessions.usernameOf(session).isEmpty()) {
+                return; // Сессия уже привязана
+            }
+            m_sessions.open(session);
+            m_sessions.bind(session, username);
+        },
+        this);
+
+    if (!driver->load()) {
+        driver->deleteLater();
+        return false;
+    }
+
+    connect(driver, &ReplayDriver::finished, this,
+            [](qint64 frames, qint64 elapsedMs) {
+        qInfo() << "[REPLAY] Replay complete:" << frames << "frames,"
+                << elapsedMs << "ms; metrics endpoint holds the histograms";
+        QCoreApplication::quit();
+    });
+
+    driver->start();
+    return true;
+}
+
+void Server::beginHandover(const QString& socketPath)
+{
+    qInfo() << "[HANDOVER] SIGUSR2 received, handing sockets to the new process";
+
+    // Прием новых соединений останавливается: основной листенер ставится
+    // на паузу (его очередь accept в ядре уедет вместе с дескриптором),
+    // шарды SO_REUSEPORT закрываются вместе со своими потоками
+    m_secureTcpServer->pauseAccepting();
+    for (QThread *thread : std::as_const(m_listenerThreads)) {
+        thread->quit();
+        thread->wait();
+    }
+
+    // WebSocket-сессии не переносимы; слушатель закрывается сразу, чтобы
+    // новый процесс мог привязать порт обычным listen
+    m_webSocketServer->close();
+
+    const qintptr listenerFd = m_secureTcpServer->socketDescriptor();
+    if (listenerFd == -1) {
+        qCritical() << "[HANDOVER] Listener has no descriptor; aborting hand-off";
+        return;
+    }
+
+    // Состояние соединений собирают сами воркеры в своих потоках:
+    // блокирующий инвок гарантирует согласованный срез (очереди записи
+    // дожаты, чтение отключено — ни байта после среза)
+    QVector<HandoverConnection> connections;
+    for (ConnectionWorker *worker : std::as_const(m_workers)) {
+        QVector<HandoverConnection> part;
+        QMetaObject::invokeMethod(worker, [worker, &part]() {
+            part = worker->exportConnections();
+        }, Qt::BlockingQueuedConnection);
+        connections += part;
+    }
+
+    // Манифест: имя сессии и флаги протокола каждого соединения известны
+    // только основному потоку, криптосессии и хвосты — воркерам
+    QJsonArray list;
+    QList<int> fds;
+    fds.append(int(listenerFd));
+    for (const HandoverConnection& record : std::as_const(connections)) {
+        QJsonObject entry;
+        entry["user"] = m_sessions.usernameOf(record.socket);
+        entry["crypto"] = QString::fromLatin1(record.cryptoState.toBase64());
+        entry["pending"] = QString::fromLatin1(record.pendingBytes.toBase64());
+        entry["binary"] = m_binaryClients.contains(record.socket);
+        entry["compressed"] = m_compressedClients.contains(record.socket);
+        list.append(entry);
+        fds.append(int(record.fd));
+    }
+
+    QJsonObject manifest;
+    manifest["version"] = 1;
+    manifest["connections"] = list;
+
+    const bool sent = Handover::sendState(
+        socketPath,
+        QJsonDocument(manifest).toJson(QJsonDocument::Compact), fds);
+
+    if (sent) {
+        qInfo() << "[HANDOVER] Handed over" << connections.size()
+                << "connection(s) and the listener; exiting";
+    } else {
+        // Передача не удалась — завершаемся как при обычном деплое:
+        // клиенты переподключатся к новому процессу по резюм-пути
+        qCritical() << "[HANDOVER] Hand-off failed; exiting as a plain restart";
+    }
+
+    // Деструкторы дожмут грязное состояние (журнал сообщений, last_seen)
+    // в базу — новый процесс уже работает с ней через WAL
+    QCoreApplication::quit();
+}
+
+bool Server::acceptHandover(const QString& socketPath)
+{
+    if (m_workers.isEmpty()) {
+        qCritical() << "[HANDOVER] Adoption requires the connection worker pool"
+                    << "(MESSENGER_WORKER_THREADS > 0)";
+        return false;
+    }
+
+    QByteArray manifestJson;
+    QList<int> fds;
+    if (!Handover::receiveState(socketPath, HandoverAcceptTimeoutMs,
+                                &manifestJson, &fds)) {
+        return false;
+    }
+
+    const QJsonObject manifest = QJsonDocument::fromJson(manifestJson).object();
+    const QJsonArray list = manifest["connections"].toArray();
+    if (fds.size() != list.size() + 1) {
+        qCritical() << "[HANDOVER] Manifest/descriptor mismatch:" << fds.size()
+                    << "descriptors for" << list.size() << "connections";
+        Handover::closeDescriptors(fds);
+        return false;
+    }
+
+    // Слушающий сокет: ядро продолжало копить очередь accept с момента
+    // паузы старого процесса — ни одно входящее соединение не потеряно.
+    // Передача идет одним листенером; шардирование accept'ов вернется
+    // при следующем обычном рестарте.
+    if (!m_secureTcpServer->setSocketDescriptor(fds.first())) {
+        qCritical() << "[HANDOVER] Cannot adopt listener descriptor:"
+                    << m_secureTcpServer->errorString();
+        Handover::closeDescriptors(fds);
+        return false;
+    }
+
+    // Манифест держится до регистрации последнего сокета: onConnectionAdopted
+    // восстанавливает по нему сессии и флаги протокола
+    m_handoverMeta = list;
+
+    for (int i = 0; i < list.size(); ++i) {
+        const QJsonObject entry = list.at(i).toObject();
+        ConnectionWorker *worker = m_workers.at(i % m_workers.size());
+        QMetaObject::invokeMethod(worker, "adoptConnection", Qt::QueuedConnection,
+                                  Q_ARG(qintptr, qintptr(fds.at(i + 1))),
+                                  Q_ARG(QByteArray, QByteArray::fromBase64(
+                                            entry["crypto"].toString().toLatin1())),
+                                  Q_ARG(QByteArray, QByteArray::fromBase64(
+                                            entry["pending"].toString().toLatin1())),
+                                  Q_ARG(int, i));
+    }
+
+    // WebSocket-слушатель поднимается обычным порядком: старый процесс
+    // закрыл свой до отправки состояния, порт свободен
+    const auto config = m_config->current();
+    if (!m_webSocketServer->listen(QHostAddress::Any, config->wsPort)) {
+        qWarning() << "[HANDOVER] WebSocket listen failed on port"
+                   << config->wsPort << ":" << m_webSocketServer->errorString();
+    }
+
+    qInfo() << "[HANDOVER] Adopted the listener and" << list.size()
+            << "connection(s); deploy is invisible to TCP clients";
+    return true;
+}
+
+void Server::onConnectionAdopted(QObject *socket, int index)
+{
+    auto *worker = qobject_cast<ConnectionWorker*>(sender());
+    if (!worker || index < 0 || index >= m_handoverMeta.size()) {
+        qWarning() << "[HANDOVER] Adopted connection without manifest entry:"
+                   << index;
+        return;
+    }
+    const QJsonObject entry = m_handoverMeta.at(index).toObject();
+
+    // Та же регистрация, что и при первом кадре нового сокета пула
+    // (onWorkerJsonReceived), плюс восстановление состояния сессии
+    m_socketWorkers.insert(socket, worker);
+    m_sessions.open(socket);
+    m_heartbeat->track(socket);
+
+    const QString username = entry["user"].toString();
+    if (!username.isEmpty()) {
+        m_sessions.bind(socket, username);
+    }
+    if (entry["binary"].toBool()) {
+        m_binaryClients.insert(socket);
+    }
+    if (entry["compressed"].toBool()) {
+        m_compressedClients.insert(socket);
+    }
+
+    qInfo() << "[HANDOVER] Session restored for"
+            << (username.isEmpty() ? QStringLiteral("<unauthenticated>") : username);
+}
+
+
+/**
+ * @brief Применяет горячие настройки текущего снимка конфигурации.
+ *
+ * @details Вызывается при старте и при каждом изменении server_config.ini.
+ * Применяются только настройки, безопасные без рестарта: лимиты запросов,
+ * размеры кэша последних сообщений (уровень логирования ServerConfig
+ * применяет сам при перечитывании).
+ */
+void Server::applyConfig()
+{
+    const auto config = m_config->current();
+
+    m_rateLimiter.setLimits(config->rateCapacityTokens,
+                            config->rateRefillPerSecond,
+                            config->rateStrikeLimit);
+    m_recentMessages.setLimits(config->recentCacheConversations,
+                               config->recentCacheMessagesPerConversation);
+}
+
 
 /**
  * @brief Слот обработки нового TCP-подключения.
@@ -173,6 +1222,10 @@ void Server::onNewTcpConnection()
 
     qInfo() << "New TCP client connected from:" << socket->peerAddress().toString();
 
+    // Профиль транспорта: Nagle выключен (батчинг делает коалесинг очереди
+    // отправки), буферы под окно файлового канала, быстрый keepalive
+    SocketTuning::tuneClientSocket(socket);
+
     // 2. Настраиваем асинхронную обработку событий через сигналы и слоты.
 
     // readyRead: срабатывает, когда в сокет приходят новые данные.
@@ -181,16 +1234,14 @@ void Server::onNewTcpConnection()
     // disconnected: срабатывает, когда клиент закрывает соединение или происходит обрыв.
     connect(socket, &QTcpSocket::disconnected, this, &Server::onClientDisconnected);
 
-    // 3. Инициализируем состояние парсера входящего потока.
-    // В TCP данные приходят потоком, а не пакетами. Мы используем QDataStream с префиксом длины.
-    // Значение '0' означает, что мы ожидаем заголовок с размером следующего блока данных.
-    m_nextBlockSizes.insert(socket, 0);
+    // 3. Регистрируем соединение: сессия получает целочисленный ID,
+    // heartbeat-монитор начинает отсчет дедлайна активности.
+    m_sessions.open(socket);
+    m_heartbeat->track(socket);
 
-    // 4. Инициализируем криптографию.
-    // Создаем экземпляр CryptoManager. В его конструкторе сразу генерируется
-    // эфемерная пара ключей (Private/Public) для этого конкретного соединения.
-    // Это подготовка к этапу Handshake.
-    m_clientCrypto[socket] = new CryptoManager();
+    // Криптографический контекст (эфемерная пара ключей для рукопожатия)
+    // живет внутри самого сокета (FramedTcpSocket): отдельной аллокации
+    // и записи в карту не требуется.
 }
 
 
@@ -203,7 +1254,7 @@ void Server::onNewTcpConnection()
  * 2. Подписывается на текстовые сообщения (JSON).
  * 3. Подписывается на отключение клиента.
  * 
- * @note В отличие от "сырого" TCP, здесь не нужна ручная сборка пакетов (m_nextBlockSizes),
+ * @note В отличие от "сырого" TCP, здесь не нужна ручная сборка пакетов (FrameBuffer),
  * так как WebSocket сам обеспечивает границы сообщений (frames).
  */
 void Server::onNewWebSocketConnection()
@@ -215,57 +1266,125 @@ void Server::onNewWebSocketConnection()
 
     qInfo() << "New WebSocket client connected from:" << socket->peerAddress().toString();
 
+    // Потолок входящего сообщения — тот же, что у TCP-кадров
+    // (FrameBuffer::SessionFrameLimit): без него QWebSocket честно
+    // буферизует сообщение любого заявленного размера, и один клиент
+    // может раздуть память процесса.
+    socket->setMaxAllowedIncomingMessageSize(FrameBuffer::SessionFrameLimit);
+
     // 2. Настраиваем обработчики событий.
     
     // textMessageReceived: Срабатывает, когда приходит полный текстовый фрейм.
     // WebSocket автоматически склеивает фрагменты, поэтому мы получаем готовую строку (JSON).
     connect(socket, &QWebSocket::textMessageReceived, this, &Server::onWebSocketTextMessageReceived);
-    
+
+    // binaryMessageReceived: бинарные кадры несут те же прикладные кодеки,
+    // что и TCP-путь (BinaryCodec / Compression / компактный JSON).
+    connect(socket, &QWebSocket::binaryMessageReceived, this, &Server::onWebSocketBinaryMessageReceived);
+
     // disconnected: Общий слот для очистки ресурсов при разрыве.
     connect(socket, &QWebSocket::disconnected, this, &Server::onClientDisconnected);
+
+    // pong: браузер автоматически отвечает на наши ping-фреймы — это и есть
+    // подтверждение живости WebSocket-соединения.
+    connect(socket, &QWebSocket::pong, this, [this, socket](quint64, const QByteArray&) {
+        m_heartbeat->activity(socket);
+    });
+
+    // 3. Регистрируем соединение: сессия получает целочисленный ID,
+    // heartbeat-монитор начинает отсчет дедлайна активности.
+    m_sessions.open(socket);
+    m_heartbeat->track(socket);
 }
 
 
 /**
  * @brief Инициализирует карту обработчиков команд (Command Pattern / Dispatch Table).
  * 
- * @details Заполняет таблицу `m_handlers`, связывая строковые ключи (приходящие в JSON-поле "type")
+ * @details Заполняет таблицу `m_dispatch`, связывая имена команд (приходящие в JSON-поле "type")
  *          с указателями на методы-члены класса `Server`.
  *          Это позволяет динамически выбирать метод обработки без использования громоздких конструкций switch/if-else.
  */
+/**
+ * @brief Регистрирует обработчик в плоской таблице диспетчеризации.
+ * @details Имя переводится в плотный id по constexpr-реестру
+ * ProtocolSchema::Commands. Команда вне реестра — ошибка программирования:
+ * она роняет процесс на старте, а не теряется молча в хот-пате.
+ */
+void Server::registerHandler(const char* type, Handler handler)
+{
+    const int id = ProtocolSchema::commandIdFor(type);
+    if (id < 0) {
+        qFatal("[SERVER] Command '%s' is not in ProtocolSchema::Commands", type);
+    }
+    m_dispatch[size_t(id)] = handler;
+}
+
+
 void Server::initHandlers() {
     // --- Аутентификация и регистрация ---
-    m_handlers["login"] = &Server::handleLogin;          // Вход по паролю
-    m_handlers["token_login"] = &Server::handleTokenLogin; // Авто-вход по токену
-    m_handlers["register"] = &Server::handleRegister;    // Регистрация нового пользователя
-    m_handlers["logout_request"] = &Server::handleLogoutRequest; // Явный выход
+    registerHandler("login", &Server::handleLogin);          // Вход по паролю
+    registerHandler("token_login", &Server::handleTokenLogin); // Авто-вход по токену
+    registerHandler("register", &Server::handleRegister);    // Регистрация нового пользователя
+    registerHandler("logout_request", &Server::handleLogoutRequest); // Явный выход
 
     // --- Управление контактами и пользователями ---
-    m_handlers["search_users"] = &Server::handleSearchUsers; // Поиск глобально
-    m_handlers["add_contact_request"] = &Server::handleAddContactRequest; // Запрос дружбы
-    m_handlers["contact_request_response"] = &Server::handleContactRequestResponse; // Ответ на запрос
-    m_handlers["update_profile"] = &Server::handleUpdateProfile; // Смена аватара/ника
+    registerHandler("search_users", &Server::handleSearchUsers); // Поиск глобально
+    registerHandler("add_contact_request", &Server::handleAddContactRequest); // Запрос дружбы
+    registerHandler("add_contacts_bulk", &Server::handleAddContactsBulk); // Массовый импорт списка контактов
+    registerHandler("get_profiles", &Server::handleGetProfiles); // Пакетная выдача профилей (ленивые детали)
+    registerHandler("contact_request_response", &Server::handleContactRequestResponse); // Ответ на запрос
+    registerHandler("update_profile", &Server::handleUpdateProfile); // Смена аватара/ника
 
     // --- Обмен сообщениями (Messaging) ---
-    m_handlers["private_message"] = &Server::handlePrivateMessage; // Отправка нового сообщения
-    m_handlers["get_history"] = &Server::handleGetHistory;         // Загрузка истории чата
-    m_handlers["delete_message"] = &Server::handleDeleteMessage;   // Удаление сообщения
-    m_handlers["edit_message"] = &Server::handleEditMessage;       // Редактирование сообщения
-    m_handlers["typing"] = &Server::handleTyping;                  // Статус "печатает..."
+    registerHandler("private_message", &Server::handlePrivateMessage); // Отправка нового сообщения
+    registerHandler("get_history", &Server::handleGetHistory);         // Загрузка истории чата
+    registerHandler("delete_message", &Server::handleDeleteMessage);   // Удаление сообщения
+    registerHandler("edit_message", &Server::handleEditMessage);       // Редактирование сообщения
+    registerHandler("set_retention", &Server::handleSetRetention);     // Срок хранения диалога (исчезающие сообщения)
+    registerHandler("typing", &Server::handleTyping);                  // Статус "печатает..."
+
+    // Групповые чаты
+    registerHandler("create_group", &Server::handleCreateGroup);   // Создание группы
+    registerHandler("group_message", &Server::handleGroupMessage); // Сообщение в группу (веерная рассылка)
 
     // --- Статусы доставки (Delivery Reports) ---
-    m_handlers["message_delivered"] = &Server::handleMessageDelivered; // Сообщение доставлено (2 серые галочки)
-    m_handlers["message_read"] = &Server::handleMessageRead;           // Сообщение прочитано (2 синие галочки)
+    registerHandler("message_delivered", &Server::handleMessageDelivered); // Сообщение доставлено (2 серые галочки)
+    registerHandler("message_read", &Server::handleMessageRead);           // Сообщение прочитано (2 синие галочки)
 
     // --- VoIP (Звонки) ---
-    m_handlers["call_request"] = &Server::handleCallRequest;   // Инициация звонка (Offer)
-    m_handlers["call_accepted"] = &Server::handleCallAccepted; // Принятие звонка (Answer)
-    m_handlers["call_rejected"] = &Server::handleCallRejected; // Отклонение
-    m_handlers["call_end"] = &Server::handleCallEnd;           // Завершение разговора
-    m_handlers["get_call_history"] = &Server::handleGetCallHistory; // Лог звонков
+    registerHandler("call_request", &Server::handleCallRequest);   // Инициация звонка (Offer)
+    registerHandler("call_accepted", &Server::handleCallAccepted); // Принятие звонка (Answer)
+    registerHandler("call_rejected", &Server::handleCallRejected); // Отклонение
+    registerHandler("call_end", &Server::handleCallEnd);           // Завершение разговора
+    registerHandler("get_call_history", &Server::handleGetCallHistory); // Лог звонков (страницами)
+    registerHandler("get_call_stats", &Server::handleGetCallStats);     // Сводка rollup'а звонков
+    registerHandler("conference_create", &Server::handleConferenceCreate); // Создание групповой комнаты
+    registerHandler("conference_leave", &Server::handleConferenceLeave);   // Выход из комнаты
 
     // --- Криптография ---
-    m_handlers["handshake"] = &Server::handleHandshake; // Обмен ключами (Diffie-Hellman)
+    registerHandler("handshake", &Server::handleHandshake); // Обмен ключами (Diffie-Hellman)
+    registerHandler("binary_mode", &Server::handleBinaryMode); // Согласование бинарного протокола
+    registerHandler("compression", &Server::handleCompression); // Согласование сжатия ответов
+    registerHandler("file_upload_begin", &Server::handleFileUploadBegin);   // Начало приема файла
+    registerHandler("file_upload_finish", &Server::handleFileUploadFinish); // Завершение приема файла
+    registerHandler("file_download", &Server::handleFileDownload);          // Отдача файла чанками
+    registerHandler("presence_subscribe", &Server::handlePresenceSubscribe); // Подписка на статусы контактов
+    registerHandler("pong", &Server::handlePong); // Ответ на прикладной heartbeat-ping
+}
+
+
+/**
+ * @brief Обрабатывает ответ клиента на прикладной ping.
+ *
+ * @details Дедлайн соединения уже продлен в processJsonRequest — как и для
+ * любого другого входящего запроса, — поэтому обработчику остается только
+ * существовать, чтобы pong не попадал в ветку неизвестных команд.
+ */
+void Server::handlePong(QObject* socket, const QJsonObject& request)
+{
+    Q_UNUSED(socket);
+    Q_UNUSED(request);
 }
 
 
@@ -276,28 +1395,39 @@ void Server::initHandlers() {
  * 1. Получает публичный ключ клиента, закодированный в base64.
  * 2. Конвертирует ключ в бинарный формат и проверяет корректность размера (32 байта).
  * 3. Вычисляет общий секрет (shared secret) с использованием приватного ключа сервера.
+ *    Скалярное умножение X25519 выполняется в криптопуле (m_cryptoPool), а не
+ *    в потоке событий; завершение возвращается сюда через очередь событий.
  * 4. Отправляет клиенту публичный ключ сервера для завершения обмена ключами.
  * 5. Переключает соединение в состояние зашифрованного.
- * 
- * В случае вызова с WebSocket игнорирует, так как обычно WSS-либы сами защищают канал.
  *
- * @param socket Сокет клиента, инициировавшего рукопожатие (ожидается QTcpSocket).
+ * 0-RTT возобновление: переподключающийся клиент может вложить в поле
+ * `resume` запрос token_login, запечатанный ключом X25519(его эфемерный
+ * секрет, резюм-ключ сервера из прошлой сессии). Тогда секрет сессии
+ * выводится из резюм-ключа, вложенный вход обрабатывается немедленно, и
+ * рукопожатие, login_success и дельта-синхронизация уходят клиенту одним
+ * полетом — вместо трех последовательных обменов. При несошедшейся
+ * расшифровке (резюм-ключ сменился после рестарта) пакет игнорируется
+ * и рукопожатие идет обычным путем.
+ *
+ * WebSocket-клиенты проходят то же рукопожатие на равных: крипто-сессия
+ * заводится в m_wsCrypto (QWebSocket не расширить, как FramedTcpSocket),
+ * скалярное умножение уходит в тот же криптопул, и после ответа сервера
+ * обе стороны обмениваются кадрами раскладки sealFrame бинарными
+ * WebSocket-сообщениями. Рукопожатие опционально: клиент без него
+ * продолжает работать открытым текстом в расчете на WSS.
+ *
+ * @param socket Сокет клиента, инициировавшего рукопожатие (ожидается QTcpSocket).
  * @param request JSON-объект с ключом клиента в поле "key" (base64).
  */
 void Server::handleHandshake(QObject* socket, const QJsonObject& request)
 {
-    // Приведение общего сокета к QTcpSocket
-    if (auto tcpSocket = qobject_cast<QTcpSocket*>(socket)) {
-
-        if (!m_clientCrypto.contains(tcpSocket)) {
-            qWarning() << "[SERVER] Crypto context missing for socket:" << tcpSocket->peerAddress().toString();
-            return;
-        }
+    // Приведение общего сокета к FramedTcpSocket (контекст живет в нем)
+    if (auto tcpSocket = qobject_cast<FramedTcpSocket*>(socket)) {
 
-        CryptoManager* crypto = m_clientCrypto.value(tcpSocket);
+        CryptoManager& crypto = tcpSocket->crypto();
 
         // Защита от повторного рукопожатия
-        if (crypto->isEncrypted()) {
+        if (crypto.isEncrypted()) {
             qWarning() << "[SERVER] Handshake attempted on already encrypted connection from:" << tcpSocket->peerAddress().toString();
             return;
         }
@@ -311,85 +1441,804 @@ void Server::handleHandshake(QObject* socket, const QJsonObject& request)
             return;
         }
 
-        // 2. Вычисляем общий секрет (ECDH)
-        crypto->computeSharedSecret(clientKey);
+        // 2. Вычисляем общий секрет (ECDH) в криптопуле
+        // Скалярное умножение X25519 стоит сотни микросекунд; при шторме
+        // переподключений очередь таких вычислений замораживала бы поток
+        // событий для всех уже подключенных клиентов. Задача получает копию
+        // ключевого материала: контекст живет в сокете и может быть удален
+        // при разрыве соединения, пока задача стоит в очереди пула.
+        QByteArray serverSecret(reinterpret_cast<const char*>(crypto.getSecretKey()), 32);
+        QPointer<FramedTcpSocket> socketGuard(tcpSocket);
+        const QString peerAddress = tcpSocket->peerAddress().toString();
+
+        // Потоковый AEAD (aead: 2): подключи направлений развертываются один
+        // раз после рукопожатия, нонсы кадров идут от счетчика. Клиенты без
+        // флага остаются на одноразовых кадрах со случайным nonce.
+        const bool streamAead = request["aead"].toInt() == 2;
+
+        // 0-RTT возобновление: клиент мог вложить в кадр рукопожатия
+        // token_login, запечатанный ключом X25519(его секрет, наш резюм-ключ).
+        // Копия резюм-секрета уходит в пул вместе с остальным материалом.
+        const QByteArray resumeTicket =
+            QByteArray::fromBase64(request["resume"].toString().toLatin1());
+        QByteArray resumeSecret;
+        if (resumeTicket.size() > 24 + 16) {
+            resumeSecret = QByteArray(
+                reinterpret_cast<const char*>(m_resumeCrypto.getSecretKey()), 32);
+        }
+
+        m_cryptoPool.start([this, socketGuard, serverSecret, clientKey, peerAddress,
+                            resumeTicket, resumeSecret, streamAead]() {
+            // Сначала путь возобновления: общий ключ с резюм-секретом и
+            // расшифровка вложенного token_login. Неудача (резюм-ключ сменился
+            // после рестарта, битый кадр) — падаем на обычное рукопожатие,
+            // клиент войдет прежним путем через attemptAutoLogin.
+            if (!resumeSecret.isEmpty()) {
+                uint8_t resumeShared[32];
+                crypto_x25519(resumeShared,
+                              reinterpret_cast<const uint8_t*>(resumeSecret.constData()),
+                              reinterpret_cast<const uint8_t*>(clientKey.constData()));
+
+                // Кадр пакета: nonce(24) + MAC(16) + шифртекст
+                const uint8_t* base =
+                    reinterpret_cast<const uint8_t*>(resumeTicket.constData());
+                const int textLen = resumeTicket.size() - 24 - 16;
+                QByteArray plain(textLen, Qt::Uninitialized);
+
+                const int status = crypto_aead_unlock(
+                    reinterpret_cast<uint8_t*>(plain.data()),
+                    base + 24,          // MAC
+                    resumeShared,       // Key
+                    base,               // Nonce
+                    nullptr, 0,         // Associated Data (нет)
+                    base + 24 + 16,     // Ciphertext
+                    textLen);
+
+                if (status == 0) {
+                    const QJsonDocument doc = QJsonDocument::fromJson(plain);
+                    if (doc.isObject()
+                        && doc.object()["type"].toString() == QLatin1String("token_login")) {
+                        QByteArray sharedSecret(
+                            reinterpret_cast<const char*>(resumeShared), 32);
+                        crypto_wipe(resumeShared, 32);
+                        const QJsonObject bundle = doc.object();
+                        const qint64 bundleSize = plain.size();
+
+                        QMetaObject::invokeMethod(this, [this, socketGuard, sharedSecret,
+                                                         peerAddress, bundle, bundleSize,
+                                                         streamAead]() {
+                            if (!socketGuard) {
+                                qDebug() << "[SERVER] Client" << peerAddress << "disconnected during handshake.";
+                                return;
+                            }
+
+                            CryptoManager& crypto = socketGuard->crypto();
+                            if (crypto.isEncrypted()) {
+                                return; // Рукопожатие уже завершено
+                            }
+
+                            crypto.setSharedSecret(sharedSecret);
+                            if (streamAead) crypto.enableStreamMode(true);
+                            sendServerPublicKey(socketGuard.data(), true);
+                            qInfo() << "[SERVER] 0-RTT resume from" << peerAddress
+                                    << ": handshake and login in one flight";
+
+                            // Вложенный token_login идет через общий диспетчер:
+                            // лимитер и метрики видят его как обычный запрос,
+                            // а ответы уходят уже зашифрованными — тем же полетом.
+                            processJsonRequest(bundle, socketGuard.data(), bundleSize);
+                        }, Qt::QueuedConnection);
+                        return;
+                    }
+                }
 
-        // 3. Отправляем клиенту наш публичный ключ
-        sendServerPublicKey(tcpSocket);
+                crypto_wipe(resumeShared, 32);
+                qInfo() << "[SERVER] Stale resume ticket from" << peerAddress
+                        << "- falling back to full handshake";
+            }
 
-        qInfo() << "[SERVER] Handshake complete with" << tcpSocket->peerAddress().toString() << ". Connection secured.";
+            uint8_t shared[32];
+            crypto_x25519(shared,
+                          reinterpret_cast<const uint8_t*>(serverSecret.constData()),
+                          reinterpret_cast<const uint8_t*>(clientKey.constData()));
+
+            QByteArray sharedSecret(reinterpret_cast<const char*>(shared), 32);
+            crypto_wipe(shared, 32);
+
+            // 3. Завершение — в основном потоке: установка секрета и отправка
+            // нашего публичного ключа клиенту.
+            QMetaObject::invokeMethod(this, [this, socketGuard, sharedSecret, peerAddress,
+                                             streamAead]() {
+                if (!socketGuard) {
+                    qDebug() << "[SERVER] Client" << peerAddress << "disconnected during handshake.";
+                    return;
+                }
 
-    } else {
-        // WebSocket с WSS обычно обрабатывается отдельно, шифрование не нужно вручную
-        qDebug() << "[SERVER] Handshake received from non-TCP socket (e.g. WebSocket), ignoring custom crypto.";
+                CryptoManager& crypto = socketGuard->crypto();
+                if (crypto.isEncrypted()) {
+                    return; // Рукопожатие уже завершено
+                }
+
+                crypto.setSharedSecret(sharedSecret);
+                if (streamAead) crypto.enableStreamMode(true);
+                sendServerPublicKey(socketGuard.data());
+
+                qInfo() << "[SERVER] Handshake complete with" << peerAddress << ". Connection secured.";
+            }, Qt::QueuedConnection);
+        });
+
+    } else if (auto wsSocket = qobject_cast<QWebSocket*>(socket)) {
+        // Паритет с TCP: та же крипто-сессия, тот же пул. Контекст живет в
+        // m_wsCrypto, потому что QWebSocket не обернуть как FramedTcpSocket.
+        CryptoManager* crypto = m_wsCrypto.value(socket, nullptr);
+        if (crypto && crypto->isEncrypted()) {
+            qWarning() << "[SERVER] Handshake attempted on already encrypted WebSocket from:"
+                       << wsSocket->peerAddress().toString();
+            return;
+        }
+        if (!crypto) {
+            crypto = new CryptoManager();
+            m_wsCrypto.insert(socket, crypto);
+        }
+
+        QByteArray clientKey = QByteArray::fromBase64(request["key"].toString().toLatin1());
+        if (clientKey.size() != 32) {
+            qWarning() << "[SERVER] Invalid client public key size:" << clientKey.size() << "expected 32 bytes";
+            return;
+        }
+
+        // Скалярное умножение — в криптопуле, как и для TCP: задача получает
+        // копию ключевого материала и не зависит от времени жизни сессии.
+        QByteArray serverSecret(reinterpret_cast<const char*>(crypto->getSecretKey()), 32);
+        QPointer<QWebSocket> socketGuard(wsSocket);
+        const QString peerAddress = wsSocket->peerAddress().toString();
+        const bool streamAead = request["aead"].toInt() == 2;
+
+        m_cryptoPool.start([this, socketGuard, serverSecret, clientKey, peerAddress,
+                            streamAead]() {
+            uint8_t shared[32];
+            crypto_x25519(shared,
+                          reinterpret_cast<const uint8_t*>(serverSecret.constData()),
+                          reinterpret_cast<const uint8_t*>(clientKey.constData()));
+
+            QByteArray sharedSecret(reinterpret_cast<const char*>(shared), 32);
+            crypto_wipe(shared, 32);
+
+            QMetaObject::invokeMethod(this, [this, socketGuard, sharedSecret, peerAddress,
+                                             streamAead]() {
+                if (!socketGuard) {
+                    qDebug() << "[SERVER] WebSocket client" << peerAddress << "disconnected during handshake.";
+                    return;
+                }
+
+                CryptoManager* crypto = m_wsCrypto.value(socketGuard.data(), nullptr);
+                if (!crypto || crypto->isEncrypted()) {
+                    return; // Сессия исчезла или рукопожатие уже завершено
+                }
+
+                crypto->setSharedSecret(sharedSecret);
+                if (streamAead) crypto->enableStreamMode(true);
+                sendServerPublicKey(socketGuard.data());
+
+                qInfo() << "[SERVER] WebSocket handshake complete with" << peerAddress
+                        << ". Connection secured.";
+            }, Qt::QueuedConnection);
+        });
     }
 }
 
 
+/**
+ * @brief Включает бинарный протокол для TCP-клиента по его запросу.
+ *
+ * @details Клиент после рукопожатия присылает `{"type":"binary_mode","version":N}`.
+ * Сервер помечает сокет в m_binaryClients и отвечает `binary_mode_ack`; с этого
+ * момента горячие типы сообщений (typing, message_delivered, message_read)
+ * уходят клиенту бинарными записями BinaryCodec, а от клиента принимаются в
+ * обоих форматах (приемный путь различает их по первому байту пакета).
+ *
+ * WebSocket-клиентам бинарный режим доступен наравне с TCP: записи уходят
+ * бинарными WebSocket-кадрами (см. onWebSocketBinaryMessageReceived и
+ * sendJson), кодек общий. Несовпадение версии — остаемся на JSON, это не
+ * ошибка соединения.
+ *
+ * @param socket Сокет клиента.
+ * @param request JSON-объект с полем `version`.
+ */
+void Server::handleBinaryMode(QObject* socket, const QJsonObject& request)
+{
+    const int clientVersion = request["version"].toInt();
+
+    if (clientVersion != BinaryCodec::Version) {
+        qWarning() << "[SERVER] Unsupported binary protocol version:" << clientVersion
+                   << "(ours:" << BinaryCodec::Version << "), keeping JSON.";
+        return;
+    }
+
+    m_binaryClients.insert(socket);
+
+    QJsonObject ack;
+    ack["type"] = "binary_mode_ack";
+    ack["version"] = BinaryCodec::Version;
+    sendJson(socket, ack);
+
+    qInfo() << "[SERVER] Binary protocol enabled for client" << m_sessions.usernameOf(socket, "<pre-login>");
+}
+
+
+/**
+ * @brief Включает сжатие крупных ответов для TCP-клиента по его запросу.
+ *
+ * @details Клиент после рукопожатия присылает
+ * `{"type":"compression","algorithm":"deflate"}`. Сервер помечает сокет в
+ * m_compressedClients и отвечает `compression_ack`; с этого момента полезные
+ * нагрузки крупнее Compression::MinSize (страницы истории, списки контактов)
+ * сжимаются перед шифрованием — после XChaCha20 сжимать уже нечего.
+ *
+ * WebSocket-клиентам сжатие доступно наравне с TCP: штатный
+ * permessage-deflate QWebSocketServer на серверной стороне не
+ * согласует, поэтому роль компрессии канала играет та же прикладная
+ * deflate-запись поверх бинарных кадров. Незнакомый алгоритм — остаемся
+ * на несжатых ответах, это не ошибка соединения.
+ *
+ * @param socket Сокет клиента.
+ * @param request JSON-объект с полем `algorithm`.
+ */
+void Server::handleCompression(QObject* socket, const QJsonObject& request)
+{
+    const QString algorithm = request["algorithm"].toString();
+
+    if (algorithm != QLatin1String("deflate")) {
+        qWarning() << "[SERVER] Unsupported compression algorithm:" << algorithm
+                   << "(ours: deflate), keeping raw payloads.";
+        return;
+    }
+
+    m_compressedClients.insert(socket);
+
+    QJsonObject ack;
+    ack["type"] = "compression_ack";
+    ack["algorithm"] = algorithm;
+    ack["min_size"] = Compression::MinSize;
+    sendJson(socket, ack);
+
+    qInfo() << "[SERVER] Response compression enabled for client"
+            << m_sessions.usernameOf(socket, "<pre-login>");
+}
+
+
+void Server::handleFileUploadBegin(QObject* socket, const QJsonObject& request)
+{
+    const QString username = m_sessions.usernameOf(socket);
+    if (username.isEmpty()) {
+        sendJson(socket, {{"type", "file_upload_failed"},
+                          {"reason", "Not authenticated"}});
+        return;
+    }
+
+    // Файловый канал работает поверх шифрованного TCP-фрейминга; WebSocket
+    // клиенты продолжают пользоваться прежним HTTP-путем.
+    if (!qobject_cast<QTcpSocket*>(socket)) {
+        sendJson(socket, {{"type", "file_upload_failed"},
+                          {"reason", "File channel requires TCP connection"}});
+        return;
+    }
+
+    const QString fileName = request["file_name"].toString();
+    const qint64 fileSize = static_cast<qint64>(request["file_size"].toDouble());
+
+    if (fileName.isEmpty()) {
+        sendJson(socket, {{"type", "file_upload_failed"},
+                          {"reason", "Missing file_name"}});
+        return;
+    }
+
+    // Дедупликация: клиент может заранее прислать SHA-256 содержимого.
+    // При попадании в блоб-хранилище передача не нужна вовсе — тот же мем,
+    // пересланный пятидесяти контактам, грузится и хранится один раз.
+    const QString claimedHash = request["sha256"].toString().toLower();
+    if (!claimedHash.isEmpty() && m_fileTransfers.hasBlob(claimedHash)) {
+        registerDedupedUpload(socket, username, fileName, fileSize, claimedHash);
+        return;
+    }
+
+    startFileUpload(socket, username, fileName, fileSize, claimedHash);
+}
+
+
+void Server::startFileUpload(QObject* socket, const QString& username,
+                             const QString& fileName, qint64 fileSize,
+                             const QString& expectedHash)
+{
+    QString error;
+    qint64 resumeOffset = 0;
+    const quint32 transferId = m_fileTransfers.beginUpload(socket, fileName,
+                                                           fileSize, expectedHash,
+                                                           &resumeOffset, &error);
+    if (transferId == 0) {
+        sendJson(socket, {{"type", "file_upload_failed"}, {"reason", error}});
+        return;
+    }
+
+    // Запись в files со status=0: при падении сервера недокачанные файлы
+    // отличимы от завершенных (status=1 ставит handleFileUploadFinish).
+    const QString fileUuid = m_fileTransfers.uploadUuid(transferId);
+    const QString uploadDate = QDateTime::currentDateTime().toString(Qt::ISODate);
+    m_dbService->post([fileUuid, username, fileName, fileSize, uploadDate](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &insert = StatementCache::get(db,
+            "INSERT INTO files (file_uuid, owner_username, original_filename, "
+            "filesize, status, upload_date) "
+            "VALUES (:uuid, :owner, :name, :size, 0, :date)");
+        insert.bindValue(":uuid", fileUuid);
+        insert.bindValue(":owner", username);
+        insert.bindValue(":name", fileName);
+        insert.bindValue(":size", fileSize);
+        insert.bindValue(":date", uploadDate);
+
+        if (!insert.exec()) {
+            qWarning() << "[FILES] Failed to register upload" << fileUuid
+                       << ":" << insert.lastError().text();
+        }
+        return QVariant();
+    });
+
+    QJsonObject ready;
+    ready["type"] = "file_upload_ready";
+    ready["transfer_id"] = static_cast<double>(transferId);
+    ready["file_id"] = fileUuid;
+    ready["chunk_size"] = FileTransfer::ChunkSize;
+    // Докачка: сколько байт уже на диске от прерванной передачи того же
+    // содержимого — клиент шлет чанки начиная с этого смещения
+    ready["resume_offset"] = static_cast<double>(resumeOffset);
+    ready["ack_interval"] = FileTransfer::AckChunkInterval;
+    sendJson(socket, ready);
+
+    qInfo() << "[FILES] Upload started:" << fileName << "(" << fileSize
+            << "bytes ) from" << username << "as" << fileUuid;
+}
+
+
+void Server::registerDedupedUpload(QObject* socket, const QString& username,
+                                   const QString& fileName, qint64 fileSize,
+                                   const QString& contentHash)
+{
+    const QString fileUuid = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    const QString uploadDate = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    m_dbService->post([fileUuid, username, fileName, fileSize, uploadDate,
+                       contentHash](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &insert = StatementCache::get(db,
+            "INSERT INTO files (file_uuid, owner_username, original_filename, "
+            "filesize, status, upload_date, content_hash) "
+            "VALUES (:uuid, :owner, :name, :size, 1, :date, :hash)");
+        insert.bindValue(":uuid", fileUuid);
+        insert.bindValue(":owner", username);
+        insert.bindValue(":name", fileName);
+        insert.bindValue(":size", fileSize);
+        insert.bindValue(":date", uploadDate);
+        insert.bindValue(":hash", contentHash);
+
+        if (!insert.exec()) {
+            qWarning() << "[FILES] Failed to register deduped upload" << fileUuid
+                       << ":" << insert.lastError().text();
+            return QVariant();
+        }
+
+        QSqlQuery &bump = StatementCache::get(db,
+            "UPDATE blobs SET refcount = refcount + 1 "
+            "WHERE content_hash = :hash");
+        bump.bindValue(":hash", contentHash);
+        if (!bump.exec()) {
+            qWarning() << "[FILES] Failed to bump blob refcount" << contentHash
+                       << ":" << bump.lastError().text();
+        }
+        return QVariant();
+    });
+
+    QJsonObject done;
+    done["type"] = "file_upload_complete";
+    done["file_id"] = fileUuid;
+    done["file_name"] = fileName;
+    done["file_size"] = static_cast<double>(fileSize);
+    done["file_url"] = QStringLiteral("file:") + fileUuid;
+    done["deduplicated"] = true;
+    sendJson(socket, done);
+
+    qInfo() << "[FILES] Upload deduplicated:" << fileName << "->"
+            << contentHash << "for" << username;
+}
+
+
+void Server::handleFileUploadFinish(QObject* socket, const QJsonObject& request)
+{
+    const quint32 transferId =
+        static_cast<quint32>(request["transfer_id"].toDouble());
+
+    QString error;
+    FileTransfer::CompletedUpload completed;
+    if (!m_fileTransfers.finishUpload(transferId, socket, completed, &error)) {
+        sendJson(socket, {{"type", "file_upload_failed"},
+                          {"transfer_id", static_cast<double>(transferId)},
+                          {"reason", error}});
+        return;
+    }
+
+    // Фиксация в БД: запись files получает хеш содержимого, а блоб —
+    // плюс одну ссылку (или появляется в учете, если он новый).
+    const QString fileUuid = completed.fileUuid;
+    const QString contentHash = completed.contentHash;
+    const qint64 blobSize = completed.fileSize;
+    m_dbService->post([fileUuid, contentHash, blobSize](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &update = StatementCache::get(db,
+            "UPDATE files SET status = 1, content_hash = :hash "
+            "WHERE file_uuid = :uuid");
+        update.bindValue(":hash", contentHash);
+        update.bindValue(":uuid", fileUuid);
+
+        if (!update.exec()) {
+            qWarning() << "[FILES] Failed to mark upload complete" << fileUuid
+                       << ":" << update.lastError().text();
+        }
+
+        QSqlQuery &blob = StatementCache::get(db,
+            "INSERT INTO blobs (content_hash, filesize, refcount) "
+            "VALUES (:hash, :size, 1) "
+            "ON CONFLICT(content_hash) DO UPDATE SET refcount = refcount + 1");
+        blob.bindValue(":hash", contentHash);
+        blob.bindValue(":size", blobSize);
+
+        if (!blob.exec()) {
+            qWarning() << "[FILES] Failed to account blob" << contentHash
+                       << ":" << blob.lastError().text();
+        }
+        return QVariant();
+    });
+
+    // Клиент подставляет эти поля в file_id/file_name/file_url исходящего
+    // ChatMessage — дальше они проходят через handlePrivateMessage как раньше.
+    QJsonObject done;
+    done["type"] = "file_upload_complete";
+    done["transfer_id"] = static_cast<double>(transferId);
+    done["file_id"] = completed.fileUuid;
+    done["file_name"] = completed.fileName;
+    done["file_size"] = static_cast<double>(completed.fileSize);
+    done["file_url"] = QStringLiteral("file:") + completed.fileUuid;
+    done["sha256"] = completed.contentHash;
+    if (completed.deduplicated) {
+        done["deduplicated"] = true;
+    }
+    sendJson(socket, done);
+
+    qInfo() << "[FILES] Upload complete:" << completed.fileUuid
+            << "(" << completed.fileSize << "bytes )";
+}
+
+
+void Server::handleFileChunk(QObject* socket, const QByteArray& payload)
+{
+    quint32 transferId = 0;
+    quint32 seq = 0;
+    if (!FileTransfer::decodeChunkHeader(payload, transferId, seq)) {
+        qWarning() << "[FILES] Malformed file chunk from"
+                   << m_sessions.usernameOf(socket, "<unknown>");
+        return;
+    }
+
+    QString error;
+    if (!m_fileTransfers.writeUploadChunk(transferId, socket, seq,
+                                          payload.constData() + FileTransfer::HeaderSize,
+                                          payload.size() - FileTransfer::HeaderSize,
+                                          &error)) {
+        sendJson(socket, {{"type", "file_upload_failed"},
+                          {"transfer_id", static_cast<double>(transferId)},
+                          {"reason", error}});
+        return;
+    }
+
+    // Периодическое подтверждение прогресса: чанк уже записан на диск,
+    // поэтому ack одновременно двигает скользящее окно клиента и служит
+    // точной отметкой докачки после обрыва
+    if ((seq + 1) % FileTransfer::AckChunkInterval == 0) {
+        sendJson(socket, {{"type", "file_upload_ack"},
+                          {"transfer_id", static_cast<double>(transferId)},
+                          {"received", static_cast<double>(
+                               m_fileTransfers.uploadedBytes(transferId))}});
+    }
+}
+
+
+void Server::handleFileDownload(QObject* socket, const QJsonObject& request)
+{
+    const QString username = m_sessions.usernameOf(socket);
+    if (username.isEmpty()) {
+        sendJson(socket, {{"type", "file_download_failed"},
+                          {"reason", "Not authenticated"}});
+        return;
+    }
+
+    if (!qobject_cast<QTcpSocket*>(socket)) {
+        sendJson(socket, {{"type", "file_download_failed"},
+                          {"reason", "File channel requires TCP connection"}});
+        return;
+    }
+
+    const QString fileUuid = request["file_id"].toString();
+    if (fileUuid.isEmpty()) {
+        sendJson(socket, {{"type", "file_download_failed"},
+                          {"reason", "Missing file_id"}});
+        return;
+    }
+
+    // Метаданные — чтение: уходит пулу читателей, писатель не блокируется.
+    QPointer<QObject> socketGuard(socket);
+    m_dbService->read([fileUuid](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &select = StatementCache::get(db,
+            "SELECT original_filename, content_hash FROM files "
+            "WHERE file_uuid = :uuid AND status = 1");
+        select.bindValue(":uuid", fileUuid);
+
+        if (!select.exec() || !select.next()) {
+            return QVariant(); // Нет такого файла или загрузка не завершена
+        }
+        return QStringList{select.value(0).toString(),
+                           select.value(1).toString()};
+    },
+    this,
+    [this, socketGuard, fileUuid](const QVariant &result) {
+        if (!socketGuard) return;
+        QObject *socket = socketGuard.data();
+
+        if (!result.isValid()) {
+            sendJson(socket, {{"type", "file_download_failed"},
+                              {"file_id", fileUuid},
+                              {"reason", "File not found"}});
+            return;
+        }
+
+        const QStringList meta = result.toStringList();
+        const QString fileName = meta.value(0);
+        const QString contentHash = meta.value(1);
+
+        QString error;
+        qint64 fileSize = 0;
+        const quint32 transferId =
+            m_fileTransfers.beginDownload(socket, fileUuid, contentHash,
+                                          fileSize, &error);
+        if (transferId == 0) {
+            sendJson(socket, {{"type", "file_download_failed"},
+                              {"file_id", fileUuid},
+                              {"reason", error}});
+            return;
+        }
+
+        // Заголовок передачи — клиент создает файл и ждет чанки transferId.
+        QJsonObject begin;
+        begin["type"] = "file_download_begin";
+        begin["transfer_id"] = static_cast<double>(transferId);
+        begin["file_id"] = fileUuid;
+        begin["file_name"] = fileName;
+        begin["file_size"] = static_cast<double>(fileSize);
+        begin["chunk_size"] = FileTransfer::ChunkSize;
+        sendJson(socket, begin);
+
+        pumpFileDownload(transferId, socket);
+    });
+}
+
+
+void Server::pumpFileDownload(quint32 transferId, QObject* socket)
+{
+    const bool pooled = m_socketWorkers.contains(socket);
+    int sentThisWindow = 0;
+
+    while (!m_fileTransfers.downloadFinished(transferId)) {
+        // Сокеты основного потока: окно ограничено заполненностью буфера
+        // записи (та же верхняя отметка, что у backpressure). Сокеты пула:
+        // их буфер отсюда не виден — фиксированное окно на тик, жесткий
+        // потолок воркера страхует от переполнения.
+        if (pooled) {
+            if (sentThisWindow >= DownloadWorkerWindow) break;
+        } else {
+            if (bufferedBytesFor(socket) > SendHighWatermarkBytes) break;
+        }
+
+        quint32 seq = 0;
+        const QByteArray data = m_fileTransfers.nextDownloadChunk(transferId, seq);
+        if (data.isEmpty()) break;
+
+        sendRawFrame(socket, FileTransfer::encodeChunk(transferId, seq,
+                                                       data.constData(),
+                                                       data.size()));
+        ++sentThisWindow;
+    }
+
+    if (m_fileTransfers.downloadFinished(transferId)) {
+        m_fileTransfers.finishDownload(transferId);
+        sendJson(socket, {{"type", "file_download_complete"},
+                          {"transfer_id", static_cast<double>(transferId)}});
+        return;
+    }
+
+    // Буфер заполнен или окно исчерпано — следующее окно чуть позже.
+    QPointer<QObject> socketGuard(socket);
+    QTimer::singleShot(DownloadRetryMs, this, [this, transferId, socketGuard]() {
+        if (!socketGuard) {
+            m_fileTransfers.finishDownload(transferId);
+            return;
+        }
+        pumpFileDownload(transferId, socketGuard.data());
+    });
+}
+
+
+void Server::sendRawFrame(QObject* socket, const QByteArray& payload)
+{
+    // Сокеты пула: воркер шифрует и пишет в своем потоке; writeJson
+    // принимает произвольные байты полезной нагрузки, не только JSON.
+    if (ConnectionWorker *worker = m_socketWorkers.value(socket, nullptr)) {
+        QMetaObject::invokeMethod(worker, "writeJson", Qt::QueuedConnection,
+                                  Q_ARG(QObject*, socket),
+                                  Q_ARG(QByteArray, payload));
+        return;
+    }
+
+    auto *tcpSocket = qobject_cast<QTcpSocket*>(socket);
+    if (!tcpSocket || tcpSocket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    auto framedSocket = qobject_cast<FramedTcpSocket*>(tcpSocket);
+    if (!framedSocket || !framedSocket->crypto().isEncrypted()) {
+        qWarning() << "[FILES] Refusing to send file chunk over cleartext link";
+        return;
+    }
+
+    enqueueWrite(tcpSocket, framedSocket->crypto().sealFrame(payload));
+}
+
+
 /**
  * @brief Обрабатывает запрос на обновление профиля пользователя.
- * 
- * @details Метод позволяет пользователю изменить свои публичные данные:
- * отображаемое имя, текстовый статус и аватар.
- * 
- * Алгоритм работы:
- * 1. Идентифицирует пользователя по сокету (через `m_clientsReverse`).
- * 2. Извлекает новые данные из JSON-запроса.
- * 3. Выполняет SQL-запрос `UPDATE` к таблице `users`.
- * 4. Отправляет клиенту результат операции (успех/ошибка) и обновленные данные.
- * 
+ *
+ * @details Дифференциальное обновление: запрос несет только изменившиеся
+ * поля (`display_name`, `status_message`, `avatar_url`), SQL `UPDATE`
+ * собирается из этих же полей и не трогает остальные колонки.
+ *
+ * Живое оповещение контактов идет по маршрутам pub/sub присутствия:
+ * подписчикам строки этого пользователя уходит компактное событие
+ * `profile_delta` только с изменившимися полями (в кластере — через
+ * конверт kind="presence" шины, который onShardEnvelope раздает по
+ * payload["username"]). Раньше смена статуса популярного пользователя
+ * оборачивалась полным пересбором списка контактов у каждого; теперь
+ * офлайн-клиенты получают изменение версионной дельтой при входе, а
+ * онлайн — одним маленьким событием.
+ *
  * @param socket Указатель на сокет пользователя, инициировавшего запрос.
- * @param request JSON-объект с полями:
+ * @param request JSON-объект с изменившимися полями (любое подмножество):
  *        - `display_name`: Новое отображаемое имя.
  *        - `status_message`: Новый текстовый статус.
- *        - `avatar_url`: (Опционально) Ссылка или Base64 строка аватара.
+ *        - `avatar_url`: Ссылка или Base64 строка аватара.
  */
 void Server::handleUpdateProfile(QObject* socket, const QJsonObject& request)
 {
     // 1. Определяем имя пользователя по сокету (проверка авторизации)
-    QString username = m_clientsReverse.value(socket);
+    QString username = m_sessions.usernameOf(socket);
     if (username.isEmpty()) {
         qWarning() << "[SERVER] Profile update attempt from unauthorized socket";
         return;
     }
 
-    // 2. Извлекаем новые значения из запроса
-    QString display_name  = request.value("display_name").toString();
-    QString statusMessage = request.value("status_message").toString();
-    QString avatarUrl     = request.value("avatar_url").toString(); 
-
-    // 3. Подготовка и выполнение SQL-запроса
-    QSqlQuery query;
-    query.prepare("UPDATE users SET display_name = :display_name, "
-                  "status_message = :status_message, "
-                  "avatar_url = :avatar_url "
-                  "WHERE username = :username");
-    
-    query.bindValue(":display_name", display_name);
-    query.bindValue(":status_message", statusMessage);
-    query.bindValue(":avatar_url", avatarUrl);
-    query.bindValue(":username", username);
+    // 2. Собираем только присланные поля: чего нет в запросе — не меняем.
+    //    Старые клиенты шлют все три поля разом и попадают на тот же путь.
+    struct ProfileField {
+        const char* requestKey;   ///< Ключ в запросе и в profile_delta
+        const char* responseKey;  ///< Ключ в update_profile_result (исторический)
+        const char* column;       ///< Колонка users
+    };
+    static const ProfileField kFields[] = {
+        { "display_name",   "displayname",    "display_name"   },
+        { "status_message", "status_message", "status_message" },
+        { "avatar_url",     "avatar_url",     "avatar_url"     },
+    };
+
+    QStringList assignments;
+    QList<const ProfileField*> changed;
+    for (const ProfileField& field : kFields) {
+        if (request.contains(QLatin1String(field.requestKey))) {
+            assignments << QString("%1 = :%1").arg(QLatin1String(field.column));
+            changed.append(&field);
+        }
+    }
 
-    // 4. Формирование ответа
     QJsonObject response;
     response["type"] = "update_profile_result";
 
+    if (changed.isEmpty()) {
+        // Пустой дифф — легальный no-op
+        response["success"] = true;
+        response["username"] = username;
+        sendJson(socket, response);
+        return;
+    }
+
+    // 3. UPDATE только по изменившимся колонкам
+    QSqlQuery query;
+    query.prepare("UPDATE users SET " + assignments.join(", ")
+                  + " WHERE username = :username");
+    for (const ProfileField* field : changed) {
+        query.bindValue(":" + QLatin1String(field->column),
+                        request.value(QLatin1String(field->requestKey)).toString());
+    }
+    query.bindValue(":username", username);
+
     if (query.exec()) {
-        // Успешное обновление
+        // Успешное обновление: эхо только присланных полей
         response["success"] = true;
         response["username"] = username; // Возвращаем, чтобы клиент мог подтвердить свои данные
-        response["displayname"] = display_name;
-        response["status_message"] = statusMessage;
-        response["avatar_url"] = avatarUrl;
-        
-        qInfo() << "[SERVER] User" << username << "successfully updated their profile.";
+        for (const ProfileField* field : changed) {
+            response[QLatin1String(field->responseKey)] =
+                request.value(QLatin1String(field->requestKey)).toString();
+        }
+
+        qInfo() << "[SERVER] User" << username << "updated profile field(s):"
+                << assignments.size();
+
+        // Имя и аватар отправителя вшиты в закэшированные списки входящих
+        // запросов других пользователей; статус там не показывается, так что
+        // поколение поднимается только когда менялись имя или аватар
+        const bool visibleInPending =
+            request.contains(QLatin1String("display_name"))
+            || request.contains(QLatin1String("avatar_url"));
+        if (visibleInPending) {
+            m_readCache.invalidateAllPending();
+        }
+
+        // Живое оповещение: компактная дельта полей подписчикам присутствия
+        // этого пользователя (его строку отображают ровно они)
+        QJsonObject delta;
+        delta["type"] = "profile_delta";
+        delta["username"] = username;
+        for (const ProfileField* field : changed) {
+            delta[QLatin1String(field->requestKey)] =
+                request.value(QLatin1String(field->requestKey)).toString();
+        }
+        if (m_shardBus->enabled()) {
+            // Конверт присутствия: onShardEnvelope пиров раздает payload
+            // локальным подписчикам по payload["username"]
+            QJsonObject envelope;
+            envelope["kind"] = "presence";
+            envelope["payload"] = delta;
+            m_shardBus->broadcast(envelope);
+        }
+        const QSet<QObject*> subscribers = m_presenceSubscribers.value(username);
+        for (QObject* subscriber : subscribers) {
+            sendJson(subscriber, delta);
+        }
+
+        // Профиль виден в списках всех подтвержденных контактов: их версии
+        // растут, и офлайн-клиенты получат изменение дельтой при входе.
+        QSqlQuery owners;
+        owners.prepare(
+            "SELECT u.username FROM users u "
+            "JOIN contacts c ON (u.id = c.user_id_1 OR u.id = c.user_id_2) "
+            "WHERE (c.user_id_1 = (SELECT id FROM users WHERE username = :me) "
+            "    OR c.user_id_2 = (SELECT id FROM users WHERE username = :me)) "
+            "AND c.status = 1 AND u.username != :me");
+        owners.bindValue(":me", username);
+        if (owners.exec()) {
+            while (owners.next()) {
+                recordContactDelta(owners.value(0).toString(), username, false);
+            }
+        }
     } else {
         // Ошибка при работе с БД
         response["success"] = false;
         response["reason"] = "Database error: " + query.lastError().text();
         
-        qWarning() << "[SERVER] Profile update FAILED for" << username 
+        qWarning() << "[SERVER] Profile update FAILED for" << username
                    << ". SQL Error:" << query.lastError().text();
+        reportSubsystemFailure(QStringLiteral("avatars"),
+                               CircuitBreaker::classifySqlError(query.lastError()));
     }
 
     // 5. Отправка результата
@@ -398,144 +2247,487 @@ void Server::handleUpdateProfile(QObject* socket, const QJsonObject& request)
 
 
 /**
- * @brief Обрабатывает подтверждение доставки сообщения (Delivery Receipt).
+ * @brief Извлекает ID сообщений из запроса подтверждения (одиночного или пакетного).
+ *
+ * @details Пакетный протокол подтверждений: клиент копит квитанции и присылает
+ * массив `ids`; одиночное поле `id` поддерживается для совместимости (и для
+ * компактных бинарных записей BinaryCodec, которые остаются одиночными).
+ * ID читаются через toDouble: значения генератора MessageIdGenerator не
+ * помещаются в int, и toInt() молча возвращал бы 0.
+ *
+ * @param request JSON-объект с полем `ids` (массив) или `id` (число).
+ * @return Список валидных (положительных) ID; может быть пустым.
+ */
+static QList<qint64> extractReceiptIds(const QJsonObject& request)
+{
+    QList<qint64> messageIds;
+
+    if (request.contains("ids")) {
+        const QJsonArray idsArray = request["ids"].toArray();
+        messageIds.reserve(idsArray.size());
+        for (const QJsonValue &value : idsArray) {
+            const qint64 id = qint64(value.toDouble());
+            if (id > 0) messageIds.append(id);
+        }
+    } else {
+        const qint64 id = qint64(request["id"].toDouble());
+        if (id > 0) messageIds.append(id);
+    }
+
+    return messageIds;
+}
+
+
+/**
+ * @brief Собирает SQL-список значений для оператора IN из ID сообщений.
+ * @details ID — проверенные положительные числа, поэтому подстановка в текст
+ * запроса безопасна; IN-списки переменной длины не выигрывают от кэша
+ * подготовленных запросов.
+ */
+static QString sqlIdList(const QList<qint64>& messageIds)
+{
+    QStringList idStrings;
+    idStrings.reserve(messageIds.size());
+    for (qint64 id : messageIds) {
+        idStrings.append(QString::number(id));
+    }
+    return idStrings.join(QLatin1Char(','));
+}
+
+
+/**
+ * @brief Обрабатывает подтверждение доставки сообщений (Delivery Receipt).
  *
  * @details Этот метод реализует механизм "двух серых галочек":
- * 1. Клиент-получатель сообщает серверу, что сообщение получено.
- * 2. Сервер обновляет статус сообщения в базе данных (`is_delivered = 1`).
- * 3. Сервер находит автора исходного сообщения и пересылает ему уведомление,
- *    чтобы тот увидел обновление статуса в своем интерфейсе.
+ * 1. Клиент-получатель сообщает серверу, что сообщения получены
+ *    (пакетом `ids` или одиночным `id` — см. extractReceiptIds).
+ * 2. Сервер обновляет статусы одним UPDATE (`is_delivered = 1`).
+ * 3. Сервер находит авторов исходных сообщений и пересылает каждому одно
+ *    сгруппированное уведомление об обновлении статусов.
+ *
+ * Пакетирование принципиально для открытия чата с сотнями непрочитанных:
+ * раньше это были сотни запросов и сотни одиночных UPDATE.
+ *
+ * Помимо перечислимых форм поддерживается диапазонная: `{"from": <автор>,
+ * "up_to_id": N}` — "доставлено всё от этого автора вплоть до id N". Она
+ * сжимает квитанцию шторма из сотен сообщений до одной константной записи
+ * и превращает IN-список в один индексный range-UPDATE
+ * (см. handleMessageDeliveredUpTo).
  *
  * @param socket Сокет клиента-получателя (того, кто подтверждает доставку).
- * @param request JSON-объект, содержащий `id` доставленного сообщения.
+ * @param request JSON-объект с `ids` (массив) или `id` доставленных сообщений.
  */
 void Server::handleMessageDelivered(QObject* socket, const QJsonObject& request) {
-    Q_UNUSED(socket); // Сокет здесь не обязателен, так как мы работаем по ID сообщения
-    
-    quint64 messageId = request["id"].toInt();
+    if (request.contains("up_to_id")) {
+        handleMessageDeliveredUpTo(socket, request["from"].toString(),
+                                   qint64(request["up_to_id"].toDouble()));
+        return;
+    }
+
+    const QList<qint64> messageIds = extractReceiptIds(request);
+    if (messageIds.isEmpty()) return;
+
+    // Потоковая выдача офлайн-сообщений: подтверждения освобождают место в
+    // текущем окне; когда окно подтверждено целиком — запрашиваем следующее.
+    auto offlineIt = m_offlineDeliveries.find(socket);
+    if (offlineIt != m_offlineDeliveries.end()) {
+        offlineIt->outstanding -= messageIds.size();
+        if (offlineIt->outstanding <= 0) {
+            sendNextOfflineBatch(socket);
+        }
+    }
+
+    const QString idList = sqlIdList(messageIds);
 
     // -----------------------------------------------------------------------
-    // 1. Обновляем статус в базе данных
+    // 1. Обновляем статусы в базе данных одним UPDATE
     // -----------------------------------------------------------------------
     QSqlQuery updateQuery;
-    updateQuery.prepare("UPDATE messages SET is_delivered = 1 WHERE id = :id");
-    updateQuery.bindValue(":id", messageId);
-    
-    if (!updateQuery.exec()) {
-        qWarning() << "[SERVER] Failed to mark message" << messageId 
-                   << "as delivered. DB Error:" << updateQuery.lastError().text();
-        // Если не удалось обновить БД, лучше не уведомлять отправителя ложным статусом
-        return; 
-    } else {
-        qDebug() << "[SERVER] Marked message" << messageId << "as delivered in DB.";
+    if (!updateQuery.exec(QStringLiteral(
+            "UPDATE messages SET is_delivered = 1 WHERE id IN (%1)").arg(idList))) {
+        qWarning() << "[SERVER] Failed to mark" << messageIds.size()
+                   << "message(s) as delivered. DB Error:" << updateQuery.lastError().text();
+        // Если не удалось обновить БД, лучше не уведомлять отправителей ложным статусом
+        return;
     }
+    qDebug() << "[SERVER] Marked" << messageIds.size() << "message(s) as delivered in DB.";
 
     // -----------------------------------------------------------------------
-    // 2. Находим автора исходного сообщения
+    // 2. Находим участников исходных сообщений и группируем по авторам
     // -----------------------------------------------------------------------
     QSqlQuery query;
-    query.prepare("SELECT fromUser FROM messages WHERE id = :id");
-    query.bindValue(":id", messageId);
-    
-    if (!query.exec() || !query.next()) {
-        qWarning() << "[SERVER] Could not find original sender for message ID" << messageId 
-                   << ":" << query.lastError().text();
+    if (!query.exec(QStringLiteral(
+            "SELECT id, fromUser, toUser FROM messages WHERE id IN (%1)").arg(idList))) {
+        qWarning() << "[SERVER] Could not find original senders for delivered batch:"
+                   << query.lastError().text();
         return;
     }
-    
-    QString originalSender = query.value("fromUser").toString();
+
+    QHash<QString, QJsonArray> idsPerSender;
+    while (query.next()) {
+        const qint64 messageId = query.value("id").toLongLong();
+        const QString originalSender = query.value("fromUser").toString();
+
+        // Обновляем статус в кэше последних сообщений (если диалог резидентен).
+        m_recentMessages.markFlag(originalSender, query.value("toUser").toString(),
+                                  messageId, "is_delivered");
+
+        idsPerSender[originalSender].append(static_cast<double>(messageId));
+    }
+
+    // Квитанция на быстром канале регулярно приходит раньше, чем write-behind
+    // журнал записал сообщение (окно 64 сообщений / 25 мс) — UPDATE и SELECT
+    // выше таких строк не видят. Помечаем их прямо в журнале: сброс запишет
+    // финальный флаг, а автора уведомляем здесь же.
+    const auto journalMarks =
+        m_messageJournal->markFlagByIds(messageIds, QStringLiteral("is_delivered"));
+    for (const auto &mark : journalMarks) {
+        m_recentMessages.markFlag(mark.fromUser, mark.toUser, mark.id, "is_delivered");
+        idsPerSender[mark.fromUser].append(static_cast<double>(mark.id));
+    }
 
     // -----------------------------------------------------------------------
-    // 3. Формируем и отправляем уведомление автору
+    // 3. Формируем и отправляем по одному уведомлению каждому автору
     // -----------------------------------------------------------------------
-    QJsonObject deliveredCmd;
-    deliveredCmd["type"] = "message_delivered";
-    deliveredCmd["id"] = (double)messageId; // JSON number
+    for (auto it = idsPerSender.constBegin(); it != idsPerSender.constEnd(); ++it) {
+        // Проверяем, онлайн ли автор сообщений
+        QObject* senderSocket = m_sessions.socketOf(it.key());
+        if (!senderSocket) {
+            // Если автор офлайн, он увидит статус доставки при следующей загрузке
+            // истории (get_history), так как мы уже обновили базу данных.
+            qDebug() << "[SERVER] Original sender" << it.key() << "is offline. Notification delayed.";
+            continue;
+        }
 
-    // Проверяем, онлайн ли автор сообщения
-    QObject* senderSocket = m_clients.value(originalSender);
-    
-    if (senderSocket) {
+        QJsonObject deliveredCmd;
+        deliveredCmd["type"] = "message_delivered";
+        if (it.value().size() == 1) {
+            // Одиночное уведомление сохраняет форму с "id" — она кодируется
+            // компактной бинарной записью BinaryCodec.
+            deliveredCmd["id"] = it.value().first();
+        } else {
+            deliveredCmd["ids"] = it.value();
+        }
         sendJson(senderSocket, deliveredCmd);
-        qDebug() << "[SERVER] Notification sent to original sender:" << originalSender;
-    } else {
-        // Если автор офлайн, он увидит статус доставки при следующей загрузке истории (get_history),
-        // так как мы уже обновили базу данных.
-        qDebug() << "[SERVER] Original sender" << originalSender << "is offline. Notification delayed.";
+        qDebug() << "[SERVER] Delivery notification sent to original sender:" << it.key();
     }
 }
 
 
 /**
- * @brief Обрабатывает подтверждение прочтения сообщения (Read Receipt).
+ * @brief Диапазонное подтверждение доставки: "всё от автора вплоть до id".
+ *
+ * @details TCP упорядочен, офлайн-очередь выдается раньше живого трафика,
+ * а MessageIdGenerator монотонен — поэтому, если получатель держит в руках
+ * сообщение с id N от автора S, все более ранние сообщения S он тоже получал.
+ * Это делает квитанцию верхней границей (high-water mark) корректной: один
+ * UPDATE по диапазону индекса idx_messages_conversation_id вместо IN-списка,
+ * и автору уходит одно константное уведомление `{"from", "up_to_id"}`
+ * независимо от размера шторма.
+ *
+ * @param socket Сокет клиента-получателя.
+ * @param originalSender Автор подтверждаемых сообщений.
+ * @param upToId Верхняя граница диапазона id (включительно).
+ */
+void Server::handleMessageDeliveredUpTo(QObject* socket, const QString& originalSender,
+                                        qint64 upToId) {
+    const QString recipient = m_sessions.usernameOf(socket);
+    if (recipient.isEmpty() || originalSender.isEmpty() || upToId <= 0) return;
+
+    QSqlDatabase db = QSqlDatabase::database();
+    const qint64 conversationId = ConversationDirectory::idFor(db, originalSender, recipient);
+    if (conversationId < 0) return; // Пара неизвестна — подтверждать нечего
+
+    QSqlQuery updateQuery;
+    updateQuery.prepare(
+        "UPDATE messages SET is_delivered = 1 "
+        "WHERE conversation_id = :conversationId AND fromUser = :fromUser "
+        "AND id <= :upToId AND is_delivered = 0");
+    updateQuery.bindValue(":conversationId", conversationId);
+    updateQuery.bindValue(":fromUser", originalSender);
+    updateQuery.bindValue(":upToId", upToId);
+    if (!updateQuery.exec()) {
+        qWarning() << "[SERVER] Failed range delivered-mark for" << recipient
+                   << "<-" << originalSender << ":" << updateQuery.lastError().text();
+        return;
+    }
+    const int markedDb = updateQuery.numRowsAffected();
+
+    // Сообщения внутри окна сброса журнала до БД еще не добрались — range
+    // выше их не задел; помечаем их в журнале (запишутся с финальным флагом).
+    const int markedJournal = m_messageJournal->markFlagUpTo(
+        originalSender, recipient, upToId, QStringLiteral("is_delivered"));
+    const int marked = markedDb + markedJournal;
+    qDebug() << "[SERVER] Marked" << marked << "message(s) from" << originalSender
+             << "as delivered up to id" << upToId;
+
+    // Потоковая выдача офлайн-сообщений: только что помеченные строки БД — это
+    // ровно те, что были высланы недоставленными; освобождаем окно на их число
+    // (строки журнала доставлялись вживую и в офлайн-окне не числятся).
+    auto offlineIt = m_offlineDeliveries.find(socket);
+    if (offlineIt != m_offlineDeliveries.end()) {
+        offlineIt->outstanding -= markedDb;
+        if (offlineIt->outstanding <= 0) {
+            sendNextOfflineBatch(socket);
+        }
+    }
+
+    if (marked == 0) return; // Повторная квитанция — автору сообщать нечего
+
+    // Обновляем статусы в кэше последних сообщений (если диалог резидентен).
+    m_recentMessages.markFlagUpTo(originalSender, recipient, upToId, "is_delivered");
+
+    QObject* senderSocket = m_sessions.socketOf(originalSender);
+    if (!senderSocket) {
+        qDebug() << "[SERVER] Original sender" << originalSender
+                 << "is offline. Notification delayed.";
+        return;
+    }
+
+    QJsonObject deliveredCmd;
+    deliveredCmd["type"] = "message_delivered";
+    deliveredCmd["from"] = recipient;
+    deliveredCmd["up_to_id"] = static_cast<double>(upToId);
+    sendJson(senderSocket, deliveredCmd);
+    qDebug() << "[SERVER] Range delivery notification sent to original sender:" << originalSender;
+}
+
+
+/**
+ * @brief Обрабатывает подтверждение прочтения сообщений (Read Receipt).
  *
  * @details Этот метод реализует механизм "двух синих галочек":
- * 1. Клиент-получатель сообщает серверу, что сообщение было показано на экране.
- * 2. Сервер обновляет статус сообщения в базе данных (`is_read = 1`).
- * 3. Сервер находит автора сообщения и пересылает ему уведомление о прочтении.
+ * 1. Клиент-получатель сообщает серверу, что сообщения были показаны на экране
+ *    (пакетом `ids` или одиночным `id` — см. extractReceiptIds).
+ * 2. Сервер обновляет статусы одним UPDATE (`is_read = 1`).
+ * 3. Сервер находит авторов сообщений и пересылает каждому одно
+ *    сгруппированное уведомление о прочтении.
+ *
+ * @note Как правило, клиент вызывает этот метод, когда сообщения появляются
+ *       в видимой области экрана (viewport) или когда пользователь открывает
+ *       чат — в последнем случае пакет покрывает все непрочитанные разом.
  *
- * @note Как правило, клиент вызывает этот метод, когда сообщение появляется в видимой
- *       области экрана (viewport) или когда пользователь открывает чат.
+ * Помимо перечислимых форм поддерживается диапазонная: `{"from": <автор>,
+ * "up_to_id": N}` — "прочитано всё от этого автора вплоть до id N"
+ * (см. handleMessageReadUpTo). Ее используют клиенты, гарантирующие
+ * префиксное чтение (например, боты и интеграции, читающие диалог подряд).
  *
- * @param socket Сокет клиента-получателя (того, кто читает сообщение).
- * @param request JSON-объект, содержащий `id` прочитанного сообщения.
+ * @param socket Сокет клиента-получателя (того, кто читает сообщения).
+ * @param request JSON-объект с `ids` (массив) или `id` прочитанных сообщений.
  */
 void Server::handleMessageRead(QObject* socket, const QJsonObject& request) {
-    Q_UNUSED(socket); // Идентификация происходит по ID сообщения
-    
-    quint64 messageId = request["id"].toInt();
+    if (request.contains("up_to_id")) {
+        handleMessageReadUpTo(socket, request["from"].toString(),
+                              qint64(request["up_to_id"].toDouble()));
+        return;
+    }
+    Q_UNUSED(socket); // Идентификация происходит по ID сообщений
+
+    const QList<qint64> allIds = extractReceiptIds(request);
+    if (allIds.isEmpty()) return;
 
     // -----------------------------------------------------------------------
-    // 1. Обновляем статус в базе данных
+    // 1. Находим участников еще не прочитанных сообщений пакета
     // -----------------------------------------------------------------------
-    QSqlQuery updateQuery;
-    updateQuery.prepare("UPDATE messages SET is_read = 1 WHERE id = :id");
-    updateQuery.bindValue(":id", messageId);
-    
-    if (!updateQuery.exec()) {
-        qWarning() << "[SERVER] Failed to mark message" << messageId 
-                   << "as read. DB Error:" << updateQuery.lastError().text();
-        return; // Прерываем, чтобы не отправлять ложный статус
-    } else {
-        qDebug() << "[SERVER] Marked message" << messageId << "as read in DB.";
+    // Условие is_read = 0 делает обработку идемпотентной: повторные read
+    // receipt тех же сообщений не дадут ни одной строки и не испортят
+    // материализованный счетчик непрочитанных.
+    QSqlQuery query;
+    if (!query.exec(QStringLiteral(
+            "SELECT id, fromUser, toUser FROM messages "
+            "WHERE id IN (%1) AND is_read = 0").arg(sqlIdList(allIds)))) {
+        qWarning() << "[SERVER] Could not find original senders for read batch:"
+                   << query.lastError().text();
+        return;
+    }
+
+    // Группируем переходы 0->1: уведомления — по авторам, декременты
+    // счетчика непрочитанных — по парам (получатель, автор).
+    QList<qint64> unreadIds;
+    QHash<QString, QJsonArray> idsPerSender;
+    QHash<QPair<QString, QString>, int> decrements;
+
+    while (query.next()) {
+        const qint64 messageId = query.value("id").toLongLong();
+        const QString originalSender = query.value("fromUser").toString();
+        const QString recipient = query.value("toUser").toString();
+
+        unreadIds.append(messageId);
+        idsPerSender[originalSender].append(static_cast<double>(messageId));
+        ++decrements[qMakePair(recipient, originalSender)];
+
+        // Обновляем статус в кэше последних сообщений (если диалог резидентен).
+        m_recentMessages.markFlag(originalSender, recipient, messageId, "is_read");
+    }
+
+    // Сообщения внутри окна сброса журнала SELECT выше не увидел — они еще
+    // не в БД. Помечаем их в журнале (запишутся с финальным флагом) и
+    // учитываем в уведомлениях и декрементах наравне со строками БД.
+    const auto journalMarks =
+        m_messageJournal->markFlagByIds(allIds, QStringLiteral("is_read"));
+    for (const auto &mark : journalMarks) {
+        idsPerSender[mark.fromUser].append(static_cast<double>(mark.id));
+        ++decrements[qMakePair(mark.toUser, mark.fromUser)];
+        m_recentMessages.markFlag(mark.fromUser, mark.toUser, mark.id, "is_read");
+    }
+
+    if (unreadIds.isEmpty() && journalMarks.isEmpty()) {
+        return; // Весь пакет уже был прочитан — ничего не меняем
     }
 
     // -----------------------------------------------------------------------
-    // 2. Находим автора исходного сообщения
+    // 2. Обновляем статусы в базе данных одним UPDATE
     // -----------------------------------------------------------------------
-    QSqlQuery query;
-    query.prepare("SELECT fromUser FROM messages WHERE id = :id");
-    query.bindValue(":id", messageId);
-    
-    if (!query.exec() || !query.next()) {
-        qWarning() << "[SERVER] Could not find original sender for message ID" << messageId 
-                   << ":" << query.lastError().text();
-        return;
+    if (!unreadIds.isEmpty()) {
+        QSqlQuery updateQuery;
+        if (!updateQuery.exec(QStringLiteral(
+                "UPDATE messages SET is_read = 1 WHERE id IN (%1)").arg(sqlIdList(unreadIds)))) {
+            qWarning() << "[SERVER] Failed to mark" << unreadIds.size()
+                       << "message(s) as read. DB Error:" << updateQuery.lastError().text();
+            return; // Прерываем, чтобы не отправлять ложный статус
+        }
+        qDebug() << "[SERVER] Marked" << unreadIds.size() << "message(s) as read in DB.";
     }
-    
-    QString originalSender = query.value("fromUser").toString();
 
     // -----------------------------------------------------------------------
-    // 3. Формируем и отправляем уведомление автору
+    // 2.1. Декремент материализованных счетчиков непрочитанных
     // -----------------------------------------------------------------------
-    QJsonObject readCmd;
-    readCmd["type"] = "message_read";
-    readCmd["id"] = (double)messageId;
+    // Декременты уходят в очередь DatabaseService — туда же, куда инкременты
+    // из handlePrivateMessage. Единая очередь писателя гарантирует порядок:
+    // декремент не может обогнать инкремент своего сообщения.
+    for (auto it = decrements.constBegin(); it != decrements.constEnd(); ++it) {
+        const QString recipient = it.key().first;
+        const QString originalSender = it.key().second;
+        const int count = it.value();
+
+        m_dbService->post([recipient, originalSender, count](QSqlDatabase &db) -> QVariant {
+            QSqlQuery &decQuery = StatementCache::get(db,
+                "UPDATE unread_counts SET unread = MAX(unread - :count, 0) "
+                "WHERE toUser = :toUser AND fromUser = :fromUser");
+            decQuery.bindValue(":count", count);
+            decQuery.bindValue(":toUser", recipient);
+            decQuery.bindValue(":fromUser", originalSender);
+
+            if (!decQuery.exec()) {
+                qWarning() << "[SERVER] Failed to decrement unread counter for" << recipient
+                           << "<-" << originalSender << ":" << decQuery.lastError().text();
+            }
+            return QVariant();
+        });
+    }
 
-    // Проверяем, онлайн ли автор сообщения
-    QObject* senderSocket = m_clients.value(originalSender);
-    
-    if (senderSocket) {
+    // -----------------------------------------------------------------------
+    // 3. Формируем и отправляем по одному уведомлению каждому автору
+    // -----------------------------------------------------------------------
+    for (auto it = idsPerSender.constBegin(); it != idsPerSender.constEnd(); ++it) {
+        // Проверяем, онлайн ли автор сообщений
+        QObject* senderSocket = m_sessions.socketOf(it.key());
+        if (!senderSocket) {
+            // Если автор офлайн, статус всё равно сохранён в БД и будет виден
+            // при следующей синхронизации.
+            qDebug() << "[SERVER] Original sender" << it.key() << "is offline. Read status cached.";
+            continue;
+        }
+
+        QJsonObject readCmd;
+        readCmd["type"] = "message_read";
+        if (it.value().size() == 1) {
+            // Одиночное уведомление сохраняет форму с "id" — она кодируется
+            // компактной бинарной записью BinaryCodec.
+            readCmd["id"] = it.value().first();
+        } else {
+            readCmd["ids"] = it.value();
+        }
         sendJson(senderSocket, readCmd);
-        qDebug() << "[SERVER] Read notification sent to original sender:" << originalSender;
-    } else {
-        // Если автор офлайн, статус всё равно сохранён в БД и будет виден при следующей синхронизации
-        qDebug() << "[SERVER] Original sender" << originalSender << "is offline. Read status cached.";
+        qDebug() << "[SERVER] Read notification sent to original sender:" << it.key();
     }
 }
 
 
 
+/**
+ * @brief Диапазонная квитанция прочтения: "всё от автора вплоть до id".
+ *
+ * @details Один range-UPDATE по индексу idx_messages_conversation_id с фильтром
+ * is_read = 0 дает и идемпотентность, и точное число переходов 0->1 через
+ * numRowsAffected() — на него и декрементируется материализованный счетчик
+ * непрочитанных, без предварительного SELECT перечня строк. Автору уходит
+ * одно константное уведомление `{"from", "up_to_id"}`.
+ *
+ * @param socket Сокет клиента-получателя.
+ * @param originalSender Автор прочитанных сообщений.
+ * @param upToId Верхняя граница диапазона id (включительно).
+ */
+void Server::handleMessageReadUpTo(QObject* socket, const QString& originalSender,
+                                   qint64 upToId) {
+    const QString recipient = m_sessions.usernameOf(socket);
+    if (recipient.isEmpty() || originalSender.isEmpty() || upToId <= 0) return;
+
+    QSqlDatabase db = QSqlDatabase::database();
+    const qint64 conversationId = ConversationDirectory::idFor(db, originalSender, recipient);
+    if (conversationId < 0) return; // Пара неизвестна — подтверждать нечего
+
+    QSqlQuery updateQuery;
+    updateQuery.prepare(
+        "UPDATE messages SET is_read = 1 "
+        "WHERE conversation_id = :conversationId AND fromUser = :fromUser "
+        "AND id <= :upToId AND is_read = 0");
+    updateQuery.bindValue(":conversationId", conversationId);
+    updateQuery.bindValue(":fromUser", originalSender);
+    updateQuery.bindValue(":upToId", upToId);
+    if (!updateQuery.exec()) {
+        qWarning() << "[SERVER] Failed range read-mark for" << recipient
+                   << "<-" << originalSender << ":" << updateQuery.lastError().text();
+        return;
+    }
+
+    // Сообщения внутри окна сброса журнала range-UPDATE не задел — они еще
+    // не в БД; помечаем их в журнале и учитываем в декременте счетчика.
+    const int markedJournal = m_messageJournal->markFlagUpTo(
+        originalSender, recipient, upToId, QStringLiteral("is_read"));
+    const int marked = updateQuery.numRowsAffected() + markedJournal;
+    if (marked == 0) {
+        return; // Весь диапазон уже был прочитан — ничего не меняем
+    }
+    qDebug() << "[SERVER] Marked" << marked << "message(s) from" << originalSender
+             << "as read up to id" << upToId;
+
+    // Обновляем статусы в кэше последних сообщений (если диалог резидентен).
+    m_recentMessages.markFlagUpTo(originalSender, recipient, upToId, "is_read");
+
+    // Декремент счетчика непрочитанных — в очередь DatabaseService, туда же,
+    // куда инкременты из handlePrivateMessage (порядок гарантирован).
+    m_dbService->post([recipient, originalSender, marked](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &decQuery = StatementCache::get(db,
+            "UPDATE unread_counts SET unread = MAX(unread - :count, 0) "
+            "WHERE toUser = :toUser AND fromUser = :fromUser");
+        decQuery.bindValue(":count", marked);
+        decQuery.bindValue(":toUser", recipient);
+        decQuery.bindValue(":fromUser", originalSender);
+
+        if (!decQuery.exec()) {
+            qWarning() << "[SERVER] Failed to decrement unread counter for" << recipient
+                       << "<-" << originalSender << ":" << decQuery.lastError().text();
+        }
+        return QVariant();
+    });
+
+    QObject* senderSocket = m_sessions.socketOf(originalSender);
+    if (!senderSocket) {
+        qDebug() << "[SERVER] Original sender" << originalSender
+                 << "is offline. Read status cached.";
+        return;
+    }
+
+    QJsonObject readCmd;
+    readCmd["type"] = "message_read";
+    readCmd["from"] = recipient;
+    readCmd["up_to_id"] = static_cast<double>(upToId);
+    sendJson(senderSocket, readCmd);
+    qDebug() << "[SERVER] Range read notification sent to original sender:" << originalSender;
+}
+
+
 /**
  * @brief Обрабатывает запрос клиента на явный выход из системы (Logout).
  *
@@ -559,7 +2751,7 @@ void Server::handleLogoutRequest(QObject* socket, const QJsonObject& request)
     // -----------------------------------------------------------------------
     // 1. Идентификация пользователя
     // -----------------------------------------------------------------------
-    QString username = m_clientsReverse.value(socket, "");
+    QString username = m_sessions.usernameOf(socket);
     
     if (username.isEmpty()) {
         qWarning() << "[SERVER] Logout request from unauthenticated or unknown socket";
@@ -574,43 +2766,22 @@ void Server::handleLogoutRequest(QObject* socket, const QJsonObject& request)
     qInfo() << "[SERVER] User" << username << "initiated logout.";
 
     // -----------------------------------------------------------------------
-    // 2. Удаление токена из памяти (Server RAM)
+    // 2-3. Отзыв токена (память + Persistent Storage)
     // -----------------------------------------------------------------------
-    m_userTokens.remove(username);
-
-    // -----------------------------------------------------------------------
-    // 3. Удаление токена из базы данных (Persistent Storage)
-    // -----------------------------------------------------------------------
-    QSqlQuery query;
-    query.prepare("DELETE FROM tokens WHERE username = :username");
-    query.bindValue(":username", username);
-    
-    if (!query.exec()) {
-        qWarning() << "[SERVER] Failed to delete token from DB for user" << username 
-                   << ":" << query.lastError().text();
-        
-        // Несмотря на ошибку БД, логика продолжается, так как токен уже удален из памяти.
-        // Но клиенту отправим сигнал о проблеме.
-        QJsonObject response;
-        response["type"] = "logout_failure";
-        response["reason"] = "Database error";
-        sendJson(socket, response);
-        return;
-    } else {
-        qDebug() << "[SERVER] Token deleted from DB for user:" << username;
-    }
+    // Кэш очищается немедленно — автологин по этому токену уже невозможен;
+    // DELETE из таблицы tokens уходит write-behind в поток БД.
+    m_tokenStore->revoke(username);
 
     // -----------------------------------------------------------------------
     // 4. Удаление из списка онлайн-пользователей
     // -----------------------------------------------------------------------
-    m_clients.remove(username);         // Удаляем из карты username -> socket
-    m_clientsReverse.remove(socket);    // Удаляем из обратной карты socket -> username
+    m_sessions.unbind(socket); // Сессия остается открытой, но становится анонимной
 
     // -----------------------------------------------------------------------
     // 5. Оповещение всех остальных клиентов
     // -----------------------------------------------------------------------
-    // Рассылаем обновленный список онлайн-пользователей всем, кто сейчас подключен.
-    broadcastUserList();
+    // Подписчикам уходит только дельта-событие "вышел из сети".
+    broadcastPresence(username, false);
 
     // -----------------------------------------------------------------------
     // 6. Отправка подтверждения клиенту
@@ -655,57 +2826,51 @@ void Server::onTcpReadyRead()
     // 1. Идентификация отправителя
     // -----------------------------------------------------------------------
     // Определяем, какой именно сокет отправил сигнал readyRead.
-    auto socket = qobject_cast<QTcpSocket*>(sender());
+    auto socket = qobject_cast<FramedTcpSocket*>(sender());
     if (!socket) return;
 
     // -----------------------------------------------------------------------
-    // 2. Инициализация потока для чтения
+    // 2. Передача сырых байт в парсер соединения
     // -----------------------------------------------------------------------
-    QDataStream in(socket);
-    in.setVersion(QDataStream::Qt_6_2); // Важно: версия должна совпадать с клиентом
-    
-    quint32 &nextBlockSize = m_nextBlockSizes[socket]; // Ссылка для изменения значения в карте
+    // Состояние фрейминга живет в самом сокете (FrameBuffer): поиска по карте
+    // на каждое чтение больше нет, а тело кадра нарезается из накопительного
+    // буфера без копирования.
+    FrameBuffer &framer = socket->framer();
+    framer.append(socket->readAll());
 
     // -----------------------------------------------------------------------
-    // 3. Цикл обработки входящих пакетов
+    // 3. Цикл обработки готовых кадров
     // -----------------------------------------------------------------------
     // TCP — это поток. За один сигнал readyRead может прийти несколько пакетов.
-    while (true) {
-        
-        // --- Этап 1: Чтение размера следующего блока данных ---
-        if (nextBlockSize == 0) {
-            // Проверяем, достаточно ли байт для чтения заголовка (quint32 = 4 байта)
-            if (socket->bytesAvailable() < (qint64)sizeof(quint32)) {
-                break;  // Ждем следующего сигнала readyRead
-            }
-            // Читаем размер блока
-            in >> nextBlockSize;
-        }
+    // Лимит кадра зависит от класса трафика и пересчитывается на каждой
+    // итерации: рукопожатие может включить шифрование прямо внутри цикла.
+    QByteArray frame;
+    while (framer.nextFrame(frame, socket->crypto().isEncrypted()
+                                       ? FrameBuffer::SessionFrameLimit
+                                       : FrameBuffer::HandshakeFrameLimit)) {
+
+        // -------------------------------------------------------------------
+        // 4. Проверка статуса шифрования
+        // -------------------------------------------------------------------
+        CryptoManager& crypto = socket->crypto();
 
-        // --- Этап 2: Ожидание полного тела сообщения ---
-        if (socket->bytesAvailable() < nextBlockSize) {
-            break;  // Данных пока недостаточно — выходим и ждем
-        }
+        // Поток для разбора полей внутри кадра (формат совпадает с клиентом).
+        QDataStream in(frame);
+        in.setVersion(QDataStream::Qt_6_2);
 
-        // -----------------------------------------------------------------------
-        // 4. Проверка статуса шифрования
-        // -----------------------------------------------------------------------
-        CryptoManager* crypto = m_clientCrypto[socket];
-        
-        if (!crypto->isEncrypted()) {
+        if (!crypto.isEncrypted()) {
             // ====================================================================
             // РЕЖИМ 1: Незашифрованное соединение (handshake, login, register)
             // ====================================================================
             QByteArray jsonData;
             in >> jsonData;
-            nextBlockSize = 0; // Сбрасываем для следующей итерации
 
             // Парсинг JSON
             QJsonDocument doc = QJsonDocument::fromJson(jsonData);
 
             if (!doc.isNull() && doc.isObject()) {
-                processJsonRequest(doc.object(), socket);
-                continue; // Проверяем, есть ли еще данные в буфере
+                processJsonRequest(doc.object(), socket, jsonData.size());
+                continue; // Проверяем, есть ли еще кадры в буфере
             } else {
                 qWarning() << "[SERVER] Invalid JSON received from" << socket->peerAddress().toString();
                 sendJson(socket, {{"type", "error"}, {"reason", "Malformed JSON"}});
@@ -717,66 +2882,59 @@ void Server::onTcpReadyRead()
         // РЕЖИМ 2: Зашифрованное соединение (XChaCha20-Poly1305)
         // ====================================================================
 
-        // --- Этап 3: Чтение зашифрованных данных ---
-        QByteArray nonceArray;
-        QByteArray encryptedData;
-        
-        in >> nonceArray;       // Nonce (24 байта)
-        in >> encryptedData;    // MAC (16 байт) + Ciphertext (N байт)
-
-        // Проверка корректности nonce
-        if (nonceArray.size() != 24) {
-            qCritical() << "[SERVER] Invalid nonce size:" << nonceArray.size() 
-                        << "from" << socket->peerAddress().toString();
-            socket->abort();
-            return;
-        }
-
-        // Проверка минимального размера зашифрованных данных (MAC + хотя бы 1 байт)
-        if (encryptedData.size() < 16) {
-            qCritical() << "[SERVER] Encrypted data too short! Possible corruption.";
+        // --- Этапы 1-2: Разбор полей кадра и расшифровка на месте ---
+        /**
+         * Поля кадра читаются по указателям прямо из буфера кадра, а выход
+         * расшифровки пишется в переиспользуемый m_decryptScratch — в
+         * установившемся режиме путь приема не обращается к malloc вовсе:
+         * буфер один раз дорастает до максимального пакета и остается.
+         * Разбор и AEAD-верификация общие для всех транспортов —
+         * см. CryptoManager::openSealedBody.
+         */
+        const int textLen = crypto.openSealedBody(
+            reinterpret_cast<const uint8_t*>(frame.constData()),
+            frame.size(), m_decryptScratch);
+
+        if (textLen == -1) {
+            qCritical() << "[SERVER] Malformed encrypted frame from"
+                        << socket->peerAddress().toString();
             socket->abort();
             return;
         }
-
-        // --- Этап 4: Извлечение компонентов ---
-        const uint8_t* nonce = reinterpret_cast<const uint8_t*>(nonceArray.constData());
-        const uint8_t* mac   = reinterpret_cast<const uint8_t*>(encryptedData.constData());
-        const uint8_t* cipherText = mac + 16; // Шифртекст начинается после MAC
-
-        qDebug() << "[SERVER] Decrypting packet. Nonce:" << QByteArray((char*)nonce, 24).toHex();
-
-        int textLen = encryptedData.size() - 16; // Длина шифртекста (без MAC)
-        QByteArray decrypted(textLen, Qt::Uninitialized);
-
-        // --- Этап 5: Расшифровка и верификация ---
-        // crypto_aead_unlock — это XChaCha20-Poly1305 AEAD (Authenticated Encryption with Associated Data).
-        // Возвращает 0 при успехе, ненулевое значение при подделке MAC (атака).
-        int status = crypto_aead_unlock(
-            reinterpret_cast<uint8_t*>(decrypted.data()), // Выход: расшифрованный текст
-            mac,                                          // Вход: MAC для проверки подлинности (16 байт)
-            crypto->getSessionKey(),                      // Общий ключ сессии (32 байта)
-            nonce,                                        // Nonce (24 байта, должен быть уникальным)
-            nullptr, 0,                                   // Associated Data (не используем)
-            cipherText,                                   // Вход: шифртекст
-            textLen                                      // Длина шифртекста
-        );
-
-        if (status != 0) {
-            qCritical() << "[SERVER] DECRYPTION FAILED! MAC mismatch. Possible attack or corruption from" 
+        if (textLen < 0) {
+            qCritical() << "[SERVER] DECRYPTION FAILED! MAC mismatch. Possible attack or corruption from"
                         << socket->peerAddress().toString();
             socket->abort(); // Разрываем соединение немедленно
             return;
         }
 
-        // Сброс значения размера для следующего пакета
-        nextBlockSize = 0;
+        // Вид на расшифрованный пакет без владения: вся обработка ниже
+        // синхронна и завершается до перезаписи буфера следующим пакетом.
+        const QByteArray decrypted =
+            QByteArray::fromRawData(m_decryptScratch.constData(), textLen);
+
+        // --- Этап 3: Парсинг расшифрованного пакета ---
+        // Чанк файловой передачи применяется напрямую, минуя JSON-путь:
+        // данные пишутся в файл хранилища, в памяти живет один чанк.
+        if (FileTransfer::isChunk(decrypted)) {
+            handleFileChunk(socket, decrypted);
+            continue;
+        }
+
+        // Бинарная запись согласованного протокола (первый байт — Magic)
+        // декодируется без JSON-парсера; диспетчеризация дальше общая.
+        if (BinaryCodec::isBinary(decrypted)) {
+            QJsonObject record = BinaryCodec::decode(decrypted);
+            if (!record.isEmpty()) {
+                processJsonRequest(record, socket, decrypted.size());
+            }
+            continue;
+        }
 
-        // --- Этап 6: Парсинг расшифрованного JSON ---
         QJsonDocument doc = QJsonDocument::fromJson(decrypted);
 
         if (!doc.isNull() && doc.isObject()) {
-            processJsonRequest(doc.object(), socket);
+            processJsonRequest(doc.object(), socket, decrypted.size());
             continue; // Проверяем, есть ли еще пакеты в буфере
         } else {
             qWarning() << "[SERVER] Invalid JSON after decryption";
@@ -784,6 +2942,19 @@ void Server::onTcpReadyRead()
             return;
         }
     }
+
+    // Префикс длины за пределами лимита — протокол сломан или нас пытаются
+    // заставить буферизовать гигабайты: рвем соединение, как при подделке MAC.
+    if (framer.overflowed()) {
+        qCritical() << "[SERVER] Frame length prefix exceeds limit from"
+                    << socket->peerAddress().toString() << "- aborting connection";
+        socket->abort();
+        return;
+    }
+
+    // Всплеск обработан: раздутая емкость парсера возвращается системе,
+    // простаивающее соединение не удерживает ее до следующего сообщения.
+    framer.trim();
 }
 
 
@@ -804,7 +2975,7 @@ void Server::onTcpReadyRead()
  * 
  * @note Метод автоматически определяет тип сокета и использует соответствующий формат передачи.
  */
-void Server::sendServerPublicKey(QTcpSocket* socket) {
+void Server::sendServerPublicKey(QObject* socket, bool resumed) {
     // -----------------------------------------------------------------------
     // 1. Валидация входных данных
     // -----------------------------------------------------------------------
@@ -812,23 +2983,49 @@ void Server::sendServerPublicKey(QTcpSocket* socket) {
         qWarning() << "[SERVER] sendServerPublicKey called with null socket";
         return;
     }
-    
-    if (!m_clientCrypto.contains(socket)) {
-        qWarning() << "[SERVER] No crypto context found for socket:" << socket->peerAddress().toString();
+
+    // Контекст сессии: у TCP-клиентов живет в обертке сокета, у
+    // WebSocket-клиентов — в m_wsCrypto (QWebSocket не обернуть).
+    CryptoManager* crypto = nullptr;
+    if (auto framedSocket = qobject_cast<FramedTcpSocket*>(socket)) {
+        crypto = &framedSocket->crypto();
+    } else {
+        crypto = m_wsCrypto.value(socket, nullptr);
+    }
+    if (!crypto) {
+        qWarning() << "[SERVER] No crypto context found for socket in sendServerPublicKey";
         return;
     }
 
-    CryptoManager* crypto = m_clientCrypto[socket];
-
     // -----------------------------------------------------------------------
     // 2. Формирование JSON с публичным ключом
     // -----------------------------------------------------------------------
     QJsonObject json;
     json["type"] = "handshake";
-    
+
     // Преобразуем публичный ключ (32 байта бинарных данных) в Base64-строку для JSON.
+    // При 0-RTT возобновлении клиент вывел секрет сессии из резюм-ключа —
+    // его и возвращаем, чтобы обе стороны сошлись на одном ключе.
+    const uint8_t* publicKey =
+        resumed ? m_resumeCrypto.getMyPublicKey() : crypto->getMyPublicKey();
     json["key"] = QString::fromLatin1(
-        QByteArray((const char*)crypto->getMyPublicKey(), 32).toBase64()
+        QByteArray((const char*)publicKey, 32).toBase64()
+    );
+    if (resumed) {
+        json["resume_ok"] = true; // Вложенный token_login принят и обработан
+    }
+
+    // Подтверждение потокового AEAD: клиент запросил его флагом aead в своем
+    // рукопожатии, режим уже включен для этой сессии — все кадры после этого
+    // ответа идут стейтфул-контекстами со счетчиком вместо nonce.
+    if (crypto->isStreamMode()) {
+        json["aead"] = 2;
+    }
+
+    // Резюм-ключ на следующее подключение: клиент кэширует его рядом с
+    // токеном и в следующий раз пришлет token_login нулевым RTT.
+    json["resume_key"] = QString::fromLatin1(
+        QByteArray((const char*)m_resumeCrypto.getMyPublicKey(), 32).toBase64()
     );
 
     QByteArray jsonData = QJsonDocument(json).toJson(QJsonDocument::Compact);
@@ -872,7 +3069,7 @@ void Server::sendServerPublicKey(QTcpSocket* socket) {
         return;
     }
 
-    qInfo() << "[SERVER] Handshake response (Public Key) sent to:" << socket->peerAddress().toString();
+    qInfo() << "[SERVER] Handshake response (Public Key) sent.";
 }
 
 
@@ -905,13 +3102,24 @@ void Server::onWebSocketTextMessageReceived(const QString &message)
         return;
     }
 
+    // После рукопожатия все кадры сессии — бинарные и шифрованные;
+    // открытый текст на такой сессии — попытка обойти крипто-канал.
+    CryptoManager* crypto = m_wsCrypto.value(socket, nullptr);
+    if (crypto && crypto->isEncrypted()) {
+        qWarning() << "[SERVER] Cleartext frame on encrypted WebSocket session from"
+                   << socket->peerAddress().toString();
+        socket->close();
+        return;
+    }
+
     // -----------------------------------------------------------------------
     // 2. Парсинг JSON
     // -----------------------------------------------------------------------
-    QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8());
-    
+    const QByteArray utf8 = message.toUtf8();
+    QJsonDocument doc = QJsonDocument::fromJson(utf8);
+
     if (doc.isNull() || !doc.isObject()) {
-        qWarning() << "[SERVER] Received invalid JSON from WebSocket client:" 
+        qWarning() << "[SERVER] Received invalid JSON from WebSocket client:"
                    << socket->peerAddress().toString();
         
         // Отправляем клиенту уведомление об ошибке
@@ -926,7 +3134,93 @@ void Server::onWebSocketTextMessageReceived(const QString &message)
     // 3. Передача в диспетчер команд
     // -----------------------------------------------------------------------
     // processJsonRequest автоматически найдет нужный обработчик по полю "type" в JSON.
-    processJsonRequest(doc.object(), socket);
+    processJsonRequest(doc.object(), socket, utf8.size());
+}
+
+
+/**
+ * @brief Слот для обработки бинарного сообщения, полученного по WebSocket.
+ *
+ * @details Текстовый путь (onWebSocketTextMessageReceived) дважды
+ * перекодирует каждый запрос: UTF-8 из кадра -> UTF-16 QString -> обратно
+ * в UTF-8 для парсера. Бинарные кадры отдают байты как есть и открывают
+ * веб-клиентам те же прикладные кодеки, что и TCP-клиентам: формат
+ * различается по первому байту сообщения — запись BinaryCodec,
+ * deflate-запись Compression или компактный JSON.
+ *
+ * Если клиент прошел рукопожатие (см. handleHandshake), каждый бинарный
+ * кадр — это sealFrame-кадр XChaCha20-Poly1305, расшифровываемый тем же
+ * путем, что и TCP-кадры; кодеки применяются уже к открытому тексту.
+ *
+ * @param message Полное бинарное сообщение (WebSocket собирает фрагменты сам).
+ */
+void Server::onWebSocketBinaryMessageReceived(const QByteArray &message)
+{
+    auto socket = qobject_cast<QWebSocket*>(sender());
+    if (!socket) {
+        qWarning() << "[SERVER] onWebSocketBinaryMessageReceived called with invalid sender";
+        return;
+    }
+
+    QByteArray payload = message;
+
+    // Кадры шифрованной сессии (после рукопожатия) — в раскладке sealFrame,
+    // включая префикс общей длины: он избыточен при WebSocket-фрейминге и
+    // только валидируется, зато кадр побайтово общий с TCP. Разбор и
+    // расшифровка — те же, что на TCP-пути (CryptoManager::openSealedBody).
+    CryptoManager* crypto = m_wsCrypto.value(socket, nullptr);
+    if (crypto && crypto->isEncrypted()) {
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(message.constData());
+        if (message.size() < 4
+            || qFromBigEndian<quint32>(base) != quint32(message.size() - 4)) {
+            qCritical() << "[SERVER] Malformed encrypted frame from WebSocket client:"
+                        << socket->peerAddress().toString();
+            socket->close();
+            return;
+        }
+
+        const int textLen = crypto->openSealedBody(base + 4, message.size() - 4,
+                                                   m_decryptScratch);
+        if (textLen < 0) {
+            qCritical() << "[SERVER] DECRYPTION FAILED! MAC mismatch. Possible attack or corruption from"
+                        << socket->peerAddress().toString();
+            socket->close();
+            return;
+        }
+
+        // Вид без владения: обработка ниже синхронна и завершается до
+        // перезаписи буфера следующим кадром.
+        payload = QByteArray::fromRawData(m_decryptScratch.constData(), textLen);
+    }
+
+    // Сжатая запись разворачивается до диспетчеризации: внутри — запись
+    // BinaryCodec или JSON, как и на TCP-пути.
+    if (Compression::isCompressed(payload)) {
+        payload = Compression::unwrap(payload);
+        if (payload.isEmpty()) {
+            qWarning() << "[SERVER] Corrupt compressed frame from WebSocket client:"
+                       << socket->peerAddress().toString();
+            return;
+        }
+    }
+
+    if (BinaryCodec::isBinary(payload)) {
+        QJsonObject record = BinaryCodec::decode(payload);
+        if (!record.isEmpty()) {
+            processJsonRequest(record, socket, payload.size());
+        }
+        return;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(payload);
+    if (doc.isNull() || !doc.isObject()) {
+        qWarning() << "[SERVER] Invalid binary frame from WebSocket client:"
+                   << socket->peerAddress().toString();
+        sendJson(socket, {{"type", "error"}, {"reason", "Invalid request format"}});
+        return;
+    }
+
+    processJsonRequest(doc.object(), socket, payload.size());
 }
 
 
@@ -934,11 +3228,12 @@ void Server::onWebSocketTextMessageReceived(const QString &message)
  * @brief Центральный диспетчер JSON-запросов (Command Dispatcher).
  *
  * @details Этот метод является единой точкой входа для всех запросов после их парсинга.
- * Он реализует паттерн **Command Pattern** через таблицу диспетчеризации (`m_handlers`).
+ * Он реализует паттерн **Command Pattern** через таблицу диспетчеризации (`m_dispatch`).
  * 
  * **Алгоритм работы:**
  * 1. Извлекает поле `"type"` из JSON (например, `"login"`, `"private_message"`).
- * 2. Ищет соответствующий метод-обработчик в `m_handlers`.
+ * 2. Переводит имя в плотный id (ProtocolSchema::commandIdFor) и берет
+ *    обработчик из плоского массива `m_dispatch`.
  * 3. Вызывает найденный метод с помощью указателя на член класса (member function pointer).
  * 4. Если команда неизвестна, отправляет клиенту сообщение об ошибке.
  * 
@@ -955,36 +3250,136 @@ void Server::onWebSocketTextMessageReceived(const QString &message)
  * @param request Распарсенный JSON-объект с полями команды.
  * @param socket Указатель на сокет клиента (может быть `QTcpSocket*` или `QWebSocket*`).
  */
-void Server::processJsonRequest(const QJsonObject& request, QObject* socket)
+void Server::processJsonRequest(const QJsonObject& request, QObject* socket, qint64 payloadBytes)
 {
     // -----------------------------------------------------------------------
     // 1. Извлечение типа команды
     // -----------------------------------------------------------------------
     QString type = request["type"].toString();
-    
+
+    // -----------------------------------------------------------------------
+    // 0. Вторая полоса: объемные команды откладываются
+    // -----------------------------------------------------------------------
+    // Классификация на входе стоит микросекунды, поэтому интерактивный
+    // запрос, пришедший следом за штормом get_history, не ждет ни одного
+    // объемного чтения: шторм лежит в m_bulkQueue и осушается квантами
+    // (см. drainBulkQueue). Весь конвейер ниже (повтор, лимитер, метрики)
+    // выполняется один раз — при фактической обработке из очереди.
+    if (!m_drainingBulk && isBulkCommand(type)) {
+        if (m_bulkQueue.size() >= BulkQueueMaxDepth) {
+            ++m_bulkShed;
+            sendJson(socket, QJsonObject{
+                {"type", "error"},
+                {"reason", "Server busy: " + type},
+                {"retry_after_ms", 1000.0}});
+            return;
+        }
+        m_bulkQueue.append({request, QPointer<QObject>(socket), payloadBytes});
+        scheduleBulkDrain();
+        return;
+    }
+
     // Логируем входящий запрос для отладки и аудита.
     // В продакшене можно ограничить логирование чувствительных команд (например, "login").
-    QString username = m_clientsReverse.value(socket, "<unauthenticated>");
+    QString username = m_sessions.usernameOf(socket, "<unauthenticated>");
     qDebug() << "[SERVER] Processing command:" << type << "from user:" << username;
 
+    // Захват трафика для детерминированного повтора: кадр уже расшифрован,
+    // а обезличивание происходит внутри журнала (см. ReplayLog::record)
+    if (m_replayLog) {
+        m_replayLog->record(socket, m_sessions.usernameOf(socket), request);
+    }
+
+    // Любой входящий запрос — признак живости соединения: продлеваем дедлайн.
+    m_heartbeat->activity(socket);
+
     // -----------------------------------------------------------------------
-    // 2. Поиск обработчика в таблице диспетчеризации
+    // 2. Лимитер запросов: ведро токенов сессии
     // -----------------------------------------------------------------------
-    if (m_handlers.contains(type)) {
-        // Получаем указатель на метод-член класса Server
-        Handler handler = m_handlers.value(type);
-        
+    // Зацикленный клиент не должен насыщать однопоточный диспетчер. Проверка
+    // O(1); стоимость зависит от класса команды (поиск и история дороже
+    // typing). Серия нарушений подряд означает, что клиент игнорирует
+    // throttled-ответы — соединение разрывается.
+    qint64 retryAfterMs = 0;
+    switch (m_rateLimiter.consume(socket, type, &retryAfterMs)) {
+    case RateLimiter::Verdict::Allow:
+        break;
+
+    case RateLimiter::Verdict::Throttle:
+        sendJson(socket, QJsonObject{
+            {"type", "throttled"},
+            {"reason", "Rate limit exceeded for: " + type},
+            {"retry_after_ms", double(retryAfterMs)}});
+        return;
+
+    case RateLimiter::Verdict::Disconnect:
+        qWarning() << "[SERVER] Rate limit strikes exhausted, disconnecting"
+                   << username;
+        if (auto *ws = qobject_cast<QWebSocket*>(socket)) {
+            ws->abort(); // Очистка пройдет через сигнал disconnected
+        } else if (auto *tcp = qobject_cast<QTcpSocket*>(socket)) {
+            // Сокеты пула живут в рабочих потоках: рвем соединение в потоке
+            // сокета через очередь событий (как при истечении heartbeat).
+            QMetaObject::invokeMethod(tcp, [tcp]() { tcp->abort(); },
+                                      Qt::QueuedConnection);
+        }
+        return;
+    }
+
+    // -----------------------------------------------------------------------
+    // 3. Поиск обработчика в таблице диспетчеризации
+    // -----------------------------------------------------------------------
+    // Имя переводится в плотный id замороженной constexpr-таблицей
+    // (один проход хеша, одно подтверждающее сравнение) — дальше поиск
+    // обработчика сводится к индексации массива
+    const int commandId = ProtocolSchema::commandIdFor(type);
+    Handler handler = (commandId >= 0) ? m_dispatch[size_t(commandId)] : nullptr;
+
+    if (handler) {
+        // Предохранитель несущественного домена: открытый отвечает
+        // мгновенным отказом, не трогая больной ресурс. Клиент получает
+        // retry_after_ms — как при троттлинге лимитером.
+        CircuitBreaker* breaker = m_breakerByCommand.value(commandId, nullptr);
+        if (breaker && !breaker->allowRequest()) {
+            ++m_breakerShed;
+            sendJson(socket, QJsonObject{
+                {"type", "error"},
+                {"reason", "Temporarily unavailable: " + type},
+                {"retry_after_ms", double(breaker->retryAfterMs())}});
+            return;
+        }
+        if (breaker) breaker->beginCall();
+
         // Вызываем метод через указатель. Синтаксис:
         // (this->*handler)(args...)
         // где:
         // - `this` — указатель на текущий экземпляр Server
         // - `*handler` — разыменование указателя на метод
         // - `(socket, request)` — аргументы метода
+        QElapsedTimer handlerTimer;
+        handlerTimer.start();
+
         (this->*handler)(socket, request);
-        
+
+        // Вызов без зарегистрированных отказов закрывает пробную фазу
+        if (breaker) breaker->endCall();
+
+        // Гистограммы по команде: время выполнения и размер входящего пакета.
+        m_metrics->recordHandler(type, handlerTimer.nsecsElapsed(), payloadBytes);
+
+        // Семплированная трасса: каждый 16-й трассируемый запрос (клиент
+        // проставил trace_id) оставляет строку с корреляционным ID и
+        // временем обработчика — достаточно для диагностики медленных
+        // сообщений, не затапливая журнал под нагрузкой.
+        if (request.contains("trace_id") && (++m_traceLogCounter & 0xF) == 0) {
+            qInfo().nospace() << "[TRACE] id=" << request["trace_id"].toString()
+                              << " type=" << type << " user=" << username
+                              << " handler_us=" << handlerTimer.nsecsElapsed() / 1000;
+        }
+
     } else {
         // -----------------------------------------------------------------------
-        // 3. Обработка неизвестной команды
+        // 4. Обработка неизвестной команды
         // -----------------------------------------------------------------------
         qWarning() << "[SERVER] Unknown command received:" << type << "from" << username;
         
@@ -1004,11 +3399,12 @@ void Server::processJsonRequest(const QJsonObject& request, QObject* socket)
  * Он выполняет полный цикл очистки ресурсов и обновления состояния сервера:
  * 
  * **Этапы работы:**
- * 1. Определяет, был ли клиент аутентифицирован (проверка в `m_clientsReverse`).
- * 2. Обновляет время последнего визита (`last_seen`) в базе данных.
- * 3. Удаляет пользователя из списков онлайн-статуса (`m_clients`, `m_clientsReverse`).
+ * 1. Определяет, был ли клиент аутентифицирован (проверка в реестре сессий).
+ * 2. Запоминает время последнего визита в памяти (в БД — пачкой, см. flushLastSeen()).
+ * 3. Закрывает сессию клиента (удаление из таблицы и hash-индексов за O(1)).
  * 4. Рассылает всем активным клиентам обновленный список присутствия.
- * 5. Для TCP-клиентов: очищает буферы парсера (`m_nextBlockSizes`) и криптографический контекст (`m_clientCrypto`).
+ * 5. Для TCP-клиентов отдельной очистки состояния соединения нет: парсер
+ *    потока и криптографический контекст живут в самом сокете (FramedTcpSocket).
  * 6. Безопасно удаляет объект сокета через `deleteLater()`.
  * 
  * @note Метод безопасен для вызова как от аутентифицированных, так и от неаутентифицированных клиентов.
@@ -1025,10 +3421,27 @@ void Server::onClientDisconnected()
         return;
     }
 
+    handleClientDisconnect(socket, /*ownedByWorker=*/false);
+}
+
+
+/**
+ * @brief Общая логика очистки состояния сервера при отключении клиента.
+ *
+ * @details Используется как классическим слотом onClientDisconnected() (сокеты
+ * основного потока: WebSocket и однопоточный TCP-режим), так и слотом
+ * onWorkerSocketDisconnected() для сокетов из пула рабочих потоков.
+ *
+ * @param socket Отключившийся сокет.
+ * @param ownedByWorker `true`, если сетевые ресурсы (парсер, криптография,
+ *        удаление объекта сокета) уже очищены воркером.
+ */
+void Server::handleClientDisconnect(QObject* socket, bool ownedByWorker)
+{
     // -----------------------------------------------------------------------
     // 2. Проверка статуса аутентификации
     // -----------------------------------------------------------------------
-    QString username = m_clientsReverse.value(socket);
+    QString username = m_sessions.usernameOf(socket);
     
     if (!username.isEmpty()) {
         // ====================================================================
@@ -1037,25 +3450,20 @@ void Server::onClientDisconnected()
         qInfo() << "[SERVER] User" << username << "disconnected from" 
                 << (qobject_cast<QTcpSocket*>(socket) ? "TCP" : "WebSocket");
 
-        // --- Обновление метаданных в базе данных ---
-        QSqlQuery updateQuery;
-        updateQuery.prepare("UPDATE users SET last_seen = :lastSeen WHERE username = :username");
-        updateQuery.bindValue(":lastSeen", QDateTime::currentDateTime().toString(Qt::ISODate));
-        updateQuery.bindValue(":username", username);
-        
-        if (!updateQuery.exec()) {
-            qWarning() << "[SERVER] Failed to update last_seen for user" << username 
-                       << ":" << updateQuery.lastError().text();
-        } else {
-            qDebug() << "[SERVER] Updated last_seen for user" << username;
-        }
+        // --- Отметка последнего визита (только в память) ---
+        // На диск значение уйдет периодическим flushLastSeen() с точностью
+        // до минут; читатели профилей до этого берут отметку из памяти.
+        m_pendingLastSeen.insert(username,
+                                 QDateTime::currentDateTime().toString(Qt::ISODate));
 
-        // --- Удаление из списков онлайн-статуса ---
-        m_clients.remove(username);         // username -> socket
-        m_clientsReverse.remove(socket);    // socket -> username
+        // Сессия закрывается ниже, безусловно для всех клиентов
 
         // --- Оповещение других пользователей об изменении статуса ---
-        broadcastUserList();
+        broadcastPresence(username, false);
+
+        // Открываем окно удержания: сообщения ближайших секунд вручатся
+        // из памяти, если это обычный обрыв мобильной сети.
+        m_outboundQueue.onDisconnect(username, QDateTime::currentMSecsSinceEpoch());
         
     } else {
         // ====================================================================
@@ -1064,21 +3472,50 @@ void Server::onClientDisconnected()
         qDebug() << "[SERVER] Unauthenticated client disconnected";
     }
 
+    // Бинарный режим и сжатие могли быть включены и до логина — чистим безусловно.
+    m_binaryClients.remove(socket);
+    m_compressedClients.remove(socket);
+
+    // Крипто-сессия WebSocket-клиента (если рукопожатие состоялось).
+    delete m_wsCrypto.take(socket);
+    m_backpressuredSockets.remove(socket);
+    m_fileTransfers.abortSocket(socket); // Недокачанные файлы удаляются
+
+    // Снимаем соединение с heartbeat-наблюдения.
+    m_heartbeat->forget(socket);
+
+    // Удаляем ведро токенов лимитера запросов.
+    m_rateLimiter.forget(socket);
+
+    // Выбрасываем неотправленные кадры отключившегося сокета.
+    m_pendingWrites.remove(socket);
+
+    // Прерываем потоковую выдачу офлайн-сообщений (если шла).
+    m_offlineDeliveries.remove(socket);
+
+    // Отменяем хвостовые чанки потоковой выдачи поиска.
+    m_searchGenerations.remove(socket);
+
+    // Снимаем подписки присутствия отключившегося сокета из обоих индексов.
+    const QSet<QString> watches = m_presenceWatches.take(socket);
+    for (const QString& watched : watches) {
+        auto it = m_presenceSubscribers.find(watched);
+        if (it != m_presenceSubscribers.end()) {
+            it->remove(socket);
+            if (it->isEmpty()) m_presenceSubscribers.erase(it);
+        }
+    }
+
+    // Закрываем сессию: удаляется из таблицы и обоих hash-индексов за O(1).
+    m_sessions.close(socket);
+
     // -----------------------------------------------------------------------
     // 3. Очистка TCP-специфичных ресурсов
     // -----------------------------------------------------------------------
-    if (auto tcpSocket = qobject_cast<QTcpSocket*>(socket)) {
-        
-        // Удаляем состояние парсера потока данных
-        m_nextBlockSizes.remove(tcpSocket);
-        
-        // Освобождаем криптографический контекст (если был создан)
-        if (m_clientCrypto.contains(tcpSocket)) {
-            delete m_clientCrypto[tcpSocket]; // Освобождаем память CryptoManager
-            m_clientCrypto.remove(tcpSocket);
-            qDebug() << "[SERVER] Crypto context cleaned for TCP socket";
-        }
-    }
+    // Состояние соединения (парсер потока и криптографический контекст)
+    // живет в самом сокете (FramedTcpSocket) и уничтожается вместе с ним —
+    // отдельной очистки не требуется.
+
     // Итерируемся по всем активным звонкам
     auto it = m_activeCalls.begin();
     while (it != m_activeCalls.end()) {
@@ -1093,7 +3530,7 @@ void Server::onClientDisconnected()
 
             // 2. Если собеседник есть и соединение живо, уведомляем его
             // (Проверяем peerSocket на null, хотя он может быть уже невалиден,
-            // но sendJson внутри себя обычно безопасен или peerSocket уже удален из m_clients)
+            // но sendJson внутри себя обычно безопасен или сессия собеседника уже закрыта)
             if (peerSocket) {
                 QJsonObject response;
                 response["type"] = "call_end";
@@ -1104,9 +3541,10 @@ void Server::onClientDisconnected()
             // 3. Обновляем статус в БД
             updateCallEnded(info.callId, "completed");
 
-            // 4. Удаляем звонок из памяти.
+            // 4. Удаляем звонок из памяти (и его сессию ретрансляции).
             // Важно: it = erase(it) возвращает итератор на следующий элемент,
             // поэтому цикл не ломается.
+            m_callRelay->closeSession(info.callId);
             it = m_activeCalls.erase(it);
         } else {
             // Если звонок не касается этого юзера, идем дальше
@@ -1119,9 +3557,57 @@ void Server::onClientDisconnected()
     // -----------------------------------------------------------------------
     // deleteLater() планирует удаление объекта при следующей итерации event loop.
     // Это предотвращает крашы, если в очереди событий остались сигналы от этого объекта.
-    socket->deleteLater();
-    
-    qDebug() << "[SERVER] Socket marked for deletion";
+    // Сокеты из пула удаляет их воркер (в своем потоке).
+    if (!ownedByWorker) {
+        socket->deleteLater();
+        qDebug() << "[SERVER] Socket marked for deletion";
+    }
+}
+
+
+/**
+ * @brief Пакетная запись накопленных отметок last_seen в таблицу users.
+ *
+ * @details Отключение клиента больше не порождает отдельный UPDATE:
+ * отметка выхода ложится в m_pendingLastSeen, а на диск весь накопленный
+ * набор уходит отсюда по таймеру (LastSeenFlushIntervalMs) одной
+ * транзакцией потока БД. Точности до минут для "был(а) в сети ..."
+ * достаточно, а шторм переподключений стоит одну запись вместо тысяч.
+ *
+ * Новые отключения во время записи копятся в свежем снимке карты и
+ * уйдут следующим проходом.
+ */
+void Server::flushLastSeen()
+{
+    if (m_pendingLastSeen.isEmpty()) {
+        return;
+    }
+
+    QHash<QString, QString> batch;
+    batch.swap(m_pendingLastSeen);
+
+    m_dbService->post([batch](QSqlDatabase &db) -> QVariant {
+        db.transaction();
+
+        QSqlQuery updateQuery(db);
+        updateQuery.prepare("UPDATE users SET last_seen = :lastSeen WHERE username = :username");
+        for (auto it = batch.constBegin(); it != batch.constEnd(); ++it) {
+            updateQuery.bindValue(":lastSeen", it.value());
+            updateQuery.bindValue(":username", it.key());
+            if (!updateQuery.exec()) {
+                qWarning() << "[SERVER] Failed to persist last_seen for user" << it.key()
+                           << ":" << updateQuery.lastError().text();
+            }
+        }
+
+        if (!db.commit()) {
+            qWarning() << "[SERVER] last_seen batch commit failed:" << db.lastError().text();
+            db.rollback();
+        } else {
+            qDebug() << "[SERVER] Persisted" << batch.count() << "last_seen mark(s)";
+        }
+        return QVariant();
+    });
 }
 
 
@@ -1150,6 +3636,18 @@ void Server::onClientDisconnected()
  * @note Использует `CREATE TABLE IF NOT EXISTS`, поэтому безопасен для повторного вызова.
  * @note В случае ошибки выводит критическое сообщение (`qCritical`) и возвращает `false`.
  */
+/**
+ * @brief Текущая версия схемы БД (штампуется в PRAGMA user_version).
+ *
+ * @details Увеличивать при любом изменении DDL в initDatabase: несовпадение
+ * версии на старте запускает полный проход создания таблиц и миграций,
+ * после чего версия штампуется заново.
+ *
+ * Версия 7: колонки retention_seconds в conversations/chats и составной
+ * индекс idx_call_start_time_id для keyset-пагинации истории звонков.
+ */
+static constexpr int CurrentSchemaVersion = 7;
+
 bool Server::initDatabase()
 {
     // ═══════════════════════════════════════════════════════════════════════
@@ -1166,6 +3664,59 @@ bool Server::initDatabase()
 
     QSqlQuery query;
 
+    // ═══════════════════════════════════════════════════════════════════════
+    // 1.1 Режим журналирования WAL
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * WAL (Write-Ahead Logging) позволяет читателям работать параллельно
+     * с писателем и резко сокращает стоимость COMMIT (нет перезаписи основного
+     * файла на каждую транзакцию). synchronous=NORMAL в связке с WAL —
+     * рекомендованный SQLite баланс надежности и скорости для серверов.
+     */
+    if (!query.exec("PRAGMA journal_mode=WAL;")) {
+        qWarning() << "[DB] Failed to enable WAL mode:" << query.lastError().text();
+    }
+    if (!query.exec("PRAGMA synchronous=NORMAL;")) {
+        qWarning() << "[DB] Failed to set synchronous=NORMAL:" << query.lastError().text();
+    }
+
+    /**
+     * Инкрементальный auto_vacuum: освобожденные страницы попадают в
+     * freelist и возвращаются файловой системе малыми порциями через
+     * PRAGMA incremental_vacuum (см. DbMaintenance) — вместо разового
+     * VACUUM с простоем. На базах, созданных до включения, прагма
+     * вступает в силу после первого ручного VACUUM; до того порции
+     * vacuum — безвредный no-op.
+     */
+    if (!query.exec("PRAGMA auto_vacuum=INCREMENTAL;")) {
+        qWarning() << "[DB] Failed to set auto_vacuum=INCREMENTAL:" << query.lastError().text();
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 1.2 Быстрый путь по версии схемы
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Полный проход ниже — десяток CREATE TABLE/INDEX, триггеры и разовые
+     * бэкфиллы — на больших базах задерживает начало прослушивания порта
+     * на секунды: даже IF NOT EXISTS заставляет SQLite разбирать каталог
+     * схемы, а бэкфиллы сканируют целые таблицы. Версия схемы хранится в
+     * PRAGMA user_version и штампуется после успешного полного прохода:
+     * при совпадении DDL пропускается целиком, и инициализация сводится
+     * к открытию соединения.
+     */
+    if (query.exec("PRAGMA user_version;") && query.next()
+        && query.value(0).toInt() == CurrentSchemaVersion) {
+        // Наличие FTS-индекса определяем по каталогу: его создавал (или не
+        // смог создать) тот же проход, что штамповал версию.
+        m_userSearchFts =
+            query.exec("SELECT 1 FROM sqlite_master "
+                       "WHERE type='table' AND name='users_fts';")
+            && query.next();
+        qInfo() << "[DB] Schema is current (version" << CurrentSchemaVersion
+                << "), DDL pass skipped.";
+        return true;
+    }
+
     // ═══════════════════════════════════════════════════════════════════════
     // 2. Создание таблицы пользователей (users)
     // ═══════════════════════════════════════════════════════════════════════
@@ -1198,6 +3749,54 @@ bool Server::initDatabase()
         return false;
     }
 
+    // ═══════════════════════════════════════════════════════════════════════
+    // 2.1. Полнотекстовый индекс пользователей (users_fts)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Глобальный поиск набирается по каждому нажатию клавиши (debounce на
+     * клиенте), а LIKE '%term%' — это полный проход по users на каждый запрос.
+     * FTS5-индекс external-content (данные остаются в users, индекс хранит
+     * только токены) отвечает на префиксные запросы по b-tree токенов за
+     * миллисекунды независимо от числа пользователей.
+     *
+     * Синхронизацию с users ведут триггеры: регистрация и update_profile
+     * обновляют индекс автоматически, на каком бы соединении ни выполнялась
+     * запись. prefix-индексы 1-3 ускоряют самые короткие запросы typeahead.
+     *
+     * Если сборка SQLite без FTS5 — остаемся на LIKE (m_userSearchFts).
+     */
+    m_userSearchFts = query.exec(
+        "CREATE VIRTUAL TABLE IF NOT EXISTS users_fts USING fts5("
+        "username, display_name, "
+        "content='users', content_rowid='id', "
+        "tokenize='unicode61', prefix='1 2 3');");
+
+    if (m_userSearchFts) {
+        query.exec("CREATE TRIGGER IF NOT EXISTS users_fts_ai AFTER INSERT ON users BEGIN "
+                   "INSERT INTO users_fts(rowid, username, display_name) "
+                   "VALUES (new.id, new.username, new.display_name); END;");
+        query.exec("CREATE TRIGGER IF NOT EXISTS users_fts_ad AFTER DELETE ON users BEGIN "
+                   "INSERT INTO users_fts(users_fts, rowid, username, display_name) "
+                   "VALUES ('delete', old.id, old.username, old.display_name); END;");
+        query.exec("CREATE TRIGGER IF NOT EXISTS users_fts_au AFTER UPDATE ON users BEGIN "
+                   "INSERT INTO users_fts(users_fts, rowid, username, display_name) "
+                   "VALUES ('delete', old.id, old.username, old.display_name); "
+                   "INSERT INTO users_fts(rowid, username, display_name) "
+                   "VALUES (new.id, new.username, new.display_name); END;");
+
+        // Разовая засыпка для существующих баз: пустой индекс при непустой
+        // users означает, что таблица создана только что — перестраиваем.
+        if (query.exec("SELECT EXISTS(SELECT 1 FROM users_fts)") && query.next()
+            && query.value(0).toInt() == 0) {
+            if (query.exec("INSERT INTO users_fts(users_fts) VALUES('rebuild');")) {
+                qDebug() << "[DB] Rebuilt users_fts index from existing users.";
+            }
+        }
+    } else {
+        qWarning() << "[DB] FTS5 unavailable, user search falls back to LIKE:"
+                   << query.lastError().text();
+    }
+
     // ═══════════════════════════════════════════════════════════════════════
     // 3. Создание таблицы сообщений (messages)
     // ═══════════════════════════════════════════════════════════════════════
@@ -1209,11 +3808,12 @@ bool Server::initDatabase()
      *  - fromUser: Отправитель (username).
      *  - toUser: Получатель (username).
      *  - payload: Текст сообщения или описание медиа.
-     *  - timestamp: Время отправки (ISO 8601).
+     *  - timestamp: Время отправки (int64 миллисекунд эпохи).
      *  - is_delivered: Флаг доставки (0/1) — "две серые галочки".
      *  - is_read: Флаг прочтения (0/1) — "две синие галочки".
      *  - is_edited: Флаг редактирования (0/1).
      *  - reply_to_id: ID цитируемого сообщения (NULL, если не ответ).
+     *  - conversation_id: Компактный ID диалога (см. ConversationDirectory).
      *  - forwarded_from: Username оригинального автора (для пересланных).
      *  - message_type: Тип контента (0=текст, 1=изображение, 2=файл, и т.д.).
      *  - media_url: Локальный путь или URL к файлу (для медиа).
@@ -1223,11 +3823,13 @@ bool Server::initDatabase()
                     "fromUser TEXT NOT NULL, "
                     "toUser TEXT NOT NULL, "
                     "payload TEXT NOT NULL, "
-                    "timestamp TEXT NOT NULL, "
+                    "timestamp INTEGER NOT NULL, "
                     "is_delivered INTEGER NOT NULL DEFAULT 0, "
                     "is_read INTEGER NOT NULL DEFAULT 0, "
                     "is_edited INTEGER NOT NULL DEFAULT 0, "
                     "reply_to_id INTEGER, "
+                    "chat_seq INTEGER, "
+                    "conversation_id INTEGER, "
                     "forwarded_from TEXT, "
                     "message_type INTEGER NOT NULL DEFAULT 0, "
                     "media_url TEXT, "
@@ -1239,33 +3841,251 @@ bool Server::initDatabase()
         return false;
     }
 
-    // ═══════════════════════════════════════════════════════════════════════
-    // 4. Создание таблицы контактов (contacts)
-    // ═══════════════════════════════════════════════════════════════════════
-    /**
-     * Таблица: contacts
-     * Описание: Связующая таблица для отношений "многие ко многим" (друзья, подписки).
-     * Поля:
-     *  - id: Первичный ключ.
-     *  - user_id_1, user_id_2: ID двух пользователей (внешние ключи на users.id).
-     *  - status: Статус связи (0=ожидание подтверждения, 1=подтверждено, 2=заблокировано).
-     *  - creation_date: Время создания связи.
-     * Ограничения:
-     *  - UNIQUE(user_id_1, user_id_2): Предотвращает дублирование.
-     *  - CHECK(user_id_1 < user_id_2): Обеспечивает каноническое представление (меньший ID всегда первый).
-     */
-    if (!query.exec("CREATE TABLE IF NOT EXISTS contacts ("
-                    "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                    "user_id_1 INTEGER NOT NULL, "
-                    "user_id_2 INTEGER NOT NULL, "
-                    "status INTEGER NOT NULL DEFAULT 0, "
-                    "creation_date TEXT NOT NULL, "
-                    "FOREIGN KEY(user_id_1) REFERENCES users(id), "
-                    "FOREIGN KEY(user_id_2) REFERENCES users(id), "
-                    "UNIQUE(user_id_1, user_id_2), "
-                    "CHECK(user_id_1 < user_id_2)"
-                    ");")) {
-        qCritical() << "[DB] Error: Failed to create 'contacts' table:" << query.lastError().text();
+    // Миграция существующих БД: штамп порядка внутри диалога (см.
+    // ChatSequencer) и компактный ID диалога (см. ConversationDirectory).
+    // У SQLite нет ADD COLUMN IF NOT EXISTS — ошибка "duplicate column"
+    // при повторном запуске ожидаема.
+    query.exec("ALTER TABLE messages ADD COLUMN chat_seq INTEGER;");
+    query.exec("ALTER TABLE messages ADD COLUMN conversation_id INTEGER;");
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 3.1. Справочник диалогов (conversations)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Таблица: conversations
+     * Описание: Выдает каждой паре собеседников компактный целочисленный ID,
+     * который штампуется на каждой строке messages при записи (см.
+     * ConversationDirectory). Заменяет дублирование двух текстовых username
+     * в индексе истории одним целым числом.
+     * Поля:
+     *  - id: ID диалога (используется в messages.conversation_id).
+     *  - user_a, user_b: Участники в каноничном порядке (user_a < user_b).
+     */
+    if (!query.exec("CREATE TABLE IF NOT EXISTS conversations ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                    "user_a TEXT NOT NULL, "
+                    "user_b TEXT NOT NULL, "
+                    "UNIQUE(user_a, user_b), "
+                    "CHECK(user_a < user_b)"
+                    ");")) {
+        qCritical() << "[DB] Error: Failed to create 'conversations' table:" << query.lastError().text();
+        return false;
+    }
+
+    // Разовая засыпка для существующих баз: регистрируем диалоги всех строк
+    // без штампа и проставляем им conversation_id. Для свежей БД оба
+    // оператора не находят строк и операция идемпотентна.
+    query.exec("INSERT OR IGNORE INTO conversations (user_a, user_b) "
+               "SELECT DISTINCT MIN(fromUser, toUser), MAX(fromUser, toUser) "
+               "FROM messages WHERE conversation_id IS NULL;");
+    if (query.exec("UPDATE messages SET conversation_id = ("
+                   "  SELECT c.id FROM conversations c "
+                   "  WHERE c.user_a = MIN(fromUser, toUser) "
+                   "    AND c.user_b = MAX(fromUser, toUser)) "
+                   "WHERE conversation_id IS NULL;")
+        && query.numRowsAffected() > 0) {
+        qDebug() << "[DB] Backfilled conversation_id for" << query.numRowsAffected()
+                 << "existing message(s).";
+    }
+
+    /**
+     * Составной индекс диалога для keyset-пагинации истории.
+     * Запрос "сообщения диалога C старше id X" — индексный range-scan по
+     * (conversation_id, id): стоимость O(размер страницы) независимо от
+     * длины переписки. Прежний индекс (fromUser, toUser, id) дублировал оба
+     * username в каждой записи b-tree и требовал UNION по двум направлениям
+     * пары — он вытеснен и удаляется.
+     */
+    query.exec("CREATE INDEX IF NOT EXISTS idx_messages_conversation_id "
+               "ON messages(conversation_id, id);");
+    query.exec("DROP INDEX IF EXISTS idx_messages_conversation;");
+
+    // Миграция: срок хранения сообщений диалога в секундах (исчезающие
+    // сообщения, см. handleSetRetention). NULL/0 — хранить вечно.
+    query.exec("ALTER TABLE conversations ADD COLUMN retention_seconds INTEGER;");
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 3.2. Материализованные счетчики непрочитанных (unread_counts)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Таблица: unread_counts
+     * Описание: Инкрементально поддерживаемые счетчики непрочитанных сообщений.
+     * Раньше логин выполнял COUNT(*) c GROUP BY по всей таблице messages —
+     * самый медленный шаг входа для пользователей с большой историей. Теперь
+     * счетчик инкрементируется при сохранении сообщения, декрементируется при
+     * прочтении, а логин читает готовые значения одним индексным SELECT.
+     * Поля:
+     *  - toUser: Получатель (владелец счетчика).
+     *  - fromUser: Отправитель (ключ группировки в UI).
+     *  - unread: Число непрочитанных сообщений от fromUser к toUser.
+     */
+    if (!query.exec("CREATE TABLE IF NOT EXISTS unread_counts ("
+                    "toUser TEXT NOT NULL, "
+                    "fromUser TEXT NOT NULL, "
+                    "unread INTEGER NOT NULL DEFAULT 0, "
+                    "PRIMARY KEY (toUser, fromUser)"
+                    ") WITHOUT ROWID;")) {
+        qCritical() << "[DB] Error: Failed to create 'unread_counts' table:" << query.lastError().text();
+        return false;
+    }
+
+    // Разовая засыпка для существующих баз: если таблица пуста, строим
+    // счетчики из messages. Для пустой таблицы операция идемпотентна.
+    if (query.exec("SELECT EXISTS(SELECT 1 FROM unread_counts)") && query.next()
+        && query.value(0).toInt() == 0) {
+        if (query.exec("INSERT INTO unread_counts (toUser, fromUser, unread) "
+                       "SELECT toUser, fromUser, COUNT(*) FROM messages "
+                       "WHERE is_read = 0 GROUP BY toUser, fromUser;")) {
+            qDebug() << "[DB] Backfilled unread_counts from existing messages.";
+        }
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 4. Создание таблицы контактов (contacts)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Таблица: contacts
+     * Описание: Связующая таблица для отношений "многие ко многим" (друзья, подписки).
+     * Поля:
+     *  - id: Первичный ключ.
+     *  - user_id_1, user_id_2: ID двух пользователей (внешние ключи на users.id).
+     *  - status: Статус связи (0=ожидание подтверждения, 1=подтверждено, 2=заблокировано).
+     *  - creation_date: Время создания связи.
+     * Ограничения:
+     *  - UNIQUE(user_id_1, user_id_2): Предотвращает дублирование.
+     *  - CHECK(user_id_1 < user_id_2): Обеспечивает каноническое представление (меньший ID всегда первый).
+     */
+    if (!query.exec("CREATE TABLE IF NOT EXISTS contacts ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                    "user_id_1 INTEGER NOT NULL, "
+                    "user_id_2 INTEGER NOT NULL, "
+                    "status INTEGER NOT NULL DEFAULT 0, "
+                    "creation_date TEXT NOT NULL, "
+                    "FOREIGN KEY(user_id_1) REFERENCES users(id), "
+                    "FOREIGN KEY(user_id_2) REFERENCES users(id), "
+                    "UNIQUE(user_id_1, user_id_2), "
+                    "CHECK(user_id_1 < user_id_2)"
+                    ");")) {
+        qCritical() << "[DB] Error: Failed to create 'contacts' table:" << query.lastError().text();
+        return false;
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 4.1. Версии и дельты списков контактов (contact_revs, contact_deltas)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Дельта-синхронизация списка контактов: полный список с именами,
+     * аватарами и статусами — основная часть байт логина у пользователей
+     * с сотнями контактов. Каждое изменение, видимое в чьем-то списке
+     * (принятая заявка, смена профиля контакта), увеличивает персональную
+     * версию списка владельца и оставляет строку дельты; клиент предъявляет
+     * свою версию при входе и получает только изменения
+     * (см. sendContactList и recordContactDelta).
+     *
+     * Таблица contact_revs: username (PRIMARY KEY) -> текущая версия списка.
+     * Таблица contact_deltas: по одной строке на версию владельца:
+     *  - username: Владелец списка.
+     *  - rev: Версия, созданная этим изменением.
+     *  - op: 'upsert' (добавление/обновление) или 'remove'.
+     *  - contact: Username контакта, которого касается изменение.
+     * Журнал усекается (recordContactDelta); слишком старая клиентская
+     * версия откатывается на полный список.
+     */
+    if (!query.exec("CREATE TABLE IF NOT EXISTS contact_revs ("
+                    "username TEXT PRIMARY KEY, "
+                    "rev INTEGER NOT NULL DEFAULT 0"
+                    ") WITHOUT ROWID;")) {
+        qCritical() << "[DB] Error: Failed to create 'contact_revs' table:" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS contact_deltas ("
+                    "username TEXT NOT NULL, "
+                    "rev INTEGER NOT NULL, "
+                    "op TEXT NOT NULL, "
+                    "contact TEXT NOT NULL, "
+                    "PRIMARY KEY (username, rev)"
+                    ") WITHOUT ROWID;")) {
+        qCritical() << "[DB] Error: Failed to create 'contact_deltas' table:" << query.lastError().text();
+        return false;
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 4.2. Групповые чаты (groups, group_members, group_messages, group_pending)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Таблица groups: сама группа (ID присваивает сервер, см. m_nextGroupId).
+     * Таблица group_members: состав; при старте целиком поднимается в память
+     *  (loadGroupState) — членство проверяется синхронно на горячем пути.
+     * Таблица group_messages: по одной строке на сообщение независимо от
+     *  числа участников (ID из общего пространства MessageIdGenerator).
+     * Таблица group_pending: очередь доставки для офлайн-участников;
+     *  заполняется одним пакетным INSERT на сообщение, снимается одним
+     *  DELETE после выдачи при входе (см. deliverPendingGroupMessages).
+     */
+    if (!query.exec("CREATE TABLE IF NOT EXISTS groups ("
+                    "id INTEGER PRIMARY KEY, "
+                    "name TEXT NOT NULL, "
+                    "owner TEXT NOT NULL, "
+                    "created_at TEXT NOT NULL"
+                    ");")) {
+        qCritical() << "[DB] Error: Failed to create 'groups' table:" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS group_members ("
+                    "group_id INTEGER NOT NULL, "
+                    "username TEXT NOT NULL, "
+                    "PRIMARY KEY (group_id, username)"
+                    ") WITHOUT ROWID;")) {
+        qCritical() << "[DB] Error: Failed to create 'group_members' table:" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS group_messages ("
+                    "id INTEGER PRIMARY KEY, "
+                    "group_id INTEGER NOT NULL, "
+                    "fromUser TEXT NOT NULL, "
+                    "payload TEXT, "
+                    "timestamp INTEGER NOT NULL"
+                    ");")) {
+        qCritical() << "[DB] Error: Failed to create 'group_messages' table:" << query.lastError().text();
+        return false;
+    }
+
+    // Разовая миграция для существующих баз: временные метки переводятся
+    // из строк ISO 8601 в int64 миллисекунд эпохи (клиент теперь сортирует
+    // и сравнивает их числами). SQLite типизирует значения, а не колонки,
+    // поэтому конвертация — UPDATE на месте; фильтр typeof делает проход
+    // идемпотентным, на мигрированной базе он не трогает ни строки.
+    const QStringList timestampMigrations = {
+        QStringLiteral("UPDATE messages SET timestamp = "
+                       "CAST(strftime('%s', timestamp) AS INTEGER) * 1000 "
+                       "WHERE typeof(timestamp) = 'text'"),
+        QStringLiteral("UPDATE group_messages SET timestamp = "
+                       "CAST(strftime('%s', timestamp) AS INTEGER) * 1000 "
+                       "WHERE typeof(timestamp) = 'text'"),
+    };
+    for (const QString &migration : timestampMigrations) {
+        if (!query.exec(migration)) {
+            qWarning() << "[DB] Timestamp migration failed:" << query.lastError().text();
+        }
+    }
+
+    // Пагинация истории группы — тот же keyset-паттерн, что и у 1:1
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_group_messages_group "
+                    "ON group_messages (group_id, id);")) {
+        qCritical() << "[DB] Error: Failed to create group message index:" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS group_pending ("
+                    "username TEXT NOT NULL, "
+                    "message_id INTEGER NOT NULL, "
+                    "group_id INTEGER NOT NULL, "
+                    "PRIMARY KEY (username, message_id)"
+                    ") WITHOUT ROWID;")) {
+        qCritical() << "[DB] Error: Failed to create 'group_pending' table:" << query.lastError().text();
         return false;
     }
 
@@ -1317,9 +4137,82 @@ bool Server::initDatabase()
      */
     query.exec("CREATE INDEX IF NOT EXISTS idx_call_caller ON call_history(caller_username);");
     query.exec("CREATE INDEX IF NOT EXISTS idx_call_callee ON call_history(callee_username);");
-    query.exec("CREATE INDEX IF NOT EXISTS idx_call_start_time ON call_history(start_time DESC);");
+    // Keyset-пагинация истории звонков: составной курсор и сортировка идут
+    // по (start_time, call_id) — call_id добирает строки, разделившие
+    // секунду с граничной. До существующих баз этот проход доходит благодаря
+    // бампу CurrentSchemaVersion (версия 7); имя новое, потому что под
+    // старым IF NOT EXISTS оставил бы одноколоночный индекс как есть —
+    // его подчищаем явно.
+    query.exec("DROP INDEX IF EXISTS idx_call_start_time;");
+    query.exec("CREATE INDEX IF NOT EXISTS idx_call_start_time_id ON call_history(start_time, call_id);");
     query.exec("CREATE INDEX IF NOT EXISTS idx_call_id ON call_history(call_id);");
 
+    // Миграция: колонки телеметрии качества звонка (джиттер, потери, RTT).
+    // Клиент присылает их в call_end; на существующей базе ALTER тихо
+    // упадет, если колонки уже есть — это ожидаемо.
+    query.exec("ALTER TABLE call_history ADD COLUMN avg_jitter_ms REAL;");
+    query.exec("ALTER TABLE call_history ADD COLUMN loss_percent INTEGER;");
+    query.exec("ALTER TABLE call_history ADD COLUMN rtt_ms INTEGER;");
+    query.exec("ALTER TABLE call_history ADD COLUMN reorder_count INTEGER;");
+    query.exec("ALTER TABLE call_history ADD COLUMN concealed_frames INTEGER;");
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 6.1. Создание таблицы агрегатов статистики звонков (call_stats)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Таблица: call_stats
+     * Описание: Инкрементальный rollup статистики звонков по пользователю.
+     * Агрегация по всей call_history на каждый запрос статистики заметно
+     * тормозила у пользователей с тысячами звонков; здесь суммы
+     * поддерживаются по ходу (updateCallEnded), и запрос статистики —
+     * чтение одной строки по первичному ключу.
+     * Поля:
+     *  - username: Пользователь (PRIMARY KEY).
+     *  - outgoing/incoming: Завершившиеся звонки по ролям.
+     *  - completed: Состоявшиеся разговоры (любая роль).
+     *  - missed: Пропущенные входящие.
+     *  - total_duration_sec: Суммарная длительность состоявшихся разговоров.
+     */
+    if (!query.exec("CREATE TABLE IF NOT EXISTS call_stats ("
+                    "username TEXT PRIMARY KEY, "
+                    "outgoing INTEGER NOT NULL DEFAULT 0, "
+                    "incoming INTEGER NOT NULL DEFAULT 0, "
+                    "completed INTEGER NOT NULL DEFAULT 0, "
+                    "missed INTEGER NOT NULL DEFAULT 0, "
+                    "total_duration_sec INTEGER NOT NULL DEFAULT 0"
+                    ");")) {
+        qCritical() << "[DB] Error: Failed to create 'call_stats' table:" << query.lastError().text();
+        return false;
+    }
+
+    // Бэкфилл для существующих БД: пустой rollup при непустой истории
+    // пересчитывается один раз на старте (как rebuild у users_fts).
+    if (query.exec("SELECT (SELECT COUNT(*) FROM call_stats) = 0 "
+                   "AND EXISTS (SELECT 1 FROM call_history)")
+        && query.next() && query.value(0).toInt() == 1) {
+        if (query.exec(
+                "INSERT INTO call_stats (username, outgoing, incoming, "
+                "completed, missed, total_duration_sec) "
+                "SELECT username, SUM(outgoing), SUM(incoming), SUM(completed), "
+                "SUM(missed), SUM(dur) FROM ("
+                "  SELECT caller_username AS username, 1 AS outgoing, 0 AS incoming, "
+                "    CASE WHEN status='completed' THEN 1 ELSE 0 END AS completed, "
+                "    0 AS missed, "
+                "    CASE WHEN status='completed' THEN COALESCE(duration_seconds,0) ELSE 0 END AS dur "
+                "  FROM call_history "
+                "  UNION ALL "
+                "  SELECT callee_username, 0, 1, "
+                "    CASE WHEN status='completed' THEN 1 ELSE 0 END, "
+                "    CASE WHEN status='missed' THEN 1 ELSE 0 END, "
+                "    CASE WHEN status='completed' THEN COALESCE(duration_seconds,0) ELSE 0 END "
+                "  FROM call_history"
+                ") GROUP BY username;")) {
+            qInfo() << "[DB] call_stats rollup backfilled from call_history";
+        } else {
+            qWarning() << "[DB] call_stats backfill failed:" << query.lastError().text();
+        }
+    }
+
     // ═══════════════════════════════════════════════════════════════════════
     // 7. Создание таблицы метаданных файлов (files)
     // ═══════════════════════════════════════════════════════════════════════
@@ -1333,6 +4226,7 @@ bool Server::initDatabase()
      *  - filesize: Размер в байтах.
      *  - status: Статус загрузки (0=в процессе, 1=завершено, 2=ошибка).
      *  - upload_date: Время загрузки.
+     *  - content_hash: SHA-256 содержимого — ссылка на блоб в хранилище.
      */
     if (!query.exec("CREATE TABLE IF NOT EXISTS files ("
                     "id INTEGER PRIMARY KEY AUTOINCREMENT, "
@@ -1341,12 +4235,42 @@ bool Server::initDatabase()
                     "original_filename TEXT NOT NULL, "
                     "filesize INTEGER NOT NULL, "
                     "status INTEGER NOT NULL DEFAULT 0, "
-                    "upload_date TEXT NOT NULL"
+                    "upload_date TEXT NOT NULL, "
+                    "content_hash TEXT"
                     ");")) {
         qCritical() << "[DB] Error: Failed to create 'files' table:" << query.lastError().text();
         return false;
     }
 
+    // Миграция существующих БД: у SQLite нет ADD COLUMN IF NOT EXISTS,
+    // поэтому ошибка "duplicate column" при повторном запуске ожидаема.
+    query.exec("ALTER TABLE files ADD COLUMN content_hash TEXT;");
+    query.exec("CREATE INDEX IF NOT EXISTS idx_files_hash ON files(content_hash);");
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 7.1. Создание таблицы блобов файлового хранилища (blobs)
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Таблица: blobs
+     * Описание: Учет содержимого файлового хранилища, адресуемого хешем.
+     * Один блоб может принадлежать многим записям files (дедупликация):
+     * один и тот же файл, загруженный разными пользователями, хранится
+     * и передается один раз.
+     * Поля:
+     *  - content_hash: SHA-256 содержимого (hex) — имя файла в хранилище.
+     *  - filesize: Размер блоба в байтах.
+     *  - refcount: Сколько записей files ссылаются на блоб (для будущей
+     *    сборки мусора: блоб с refcount=0 можно удалить с диска).
+     */
+    if (!query.exec("CREATE TABLE IF NOT EXISTS blobs ("
+                    "content_hash TEXT PRIMARY KEY, "
+                    "filesize INTEGER NOT NULL, "
+                    "refcount INTEGER NOT NULL DEFAULT 0"
+                    ");")) {
+        qCritical() << "[DB] Error: Failed to create 'blobs' table:" << query.lastError().text();
+        return false;
+    }
+
     // ═══════════════════════════════════════════════════════════════════════
     // 8. Создание таблицы токенов автологина (tokens)
     // ═══════════════════════════════════════════════════════════════════════
@@ -1377,26 +4301,481 @@ bool Server::initDatabase()
     qDebug() << "[DB] Tokens table initialized successfully.";
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 9. Очистка истекших токенов при запуске сервера
+    // 9. Очистка истекших токенов
     // ═══════════════════════════════════════════════════════════════════════
     /**
-     * Удаляем все токены, время действия которых истекло.
-     * Это предотвращает накопление "мертвых" записей в БД.
+     * Раньше здесь выполнялся блокирующий DELETE истекших токенов, который
+     * задерживал начало прослушивания порта. Теперь уборку (память + БД)
+     * периодически выполняет TokenStore::sweep в фоне, а загрузка кэша
+     * отфильтровывает истекшие записи сама.
      */
-    if (!query.exec("DELETE FROM tokens WHERE expires_at < CURRENT_TIMESTAMP")) {
-        qWarning() << "[DB] Failed to clean expired tokens:" << query.lastError().text();
-    } else {
-        qDebug() << "[DB] Expired tokens cleaned successfully.";
-    }
 
     // ═══════════════════════════════════════════════════════════════════════
     // 10. Финализация
     // ═══════════════════════════════════════════════════════════════════════
+    // Штамп версии: следующий старт на этой базе пропустит весь проход выше.
+    if (!query.exec(QStringLiteral("PRAGMA user_version = %1;")
+                        .arg(CurrentSchemaVersion))) {
+        qWarning() << "[DB] Failed to stamp schema version:"
+                   << query.lastError().text();
+    }
+
     qInfo() << "[DB] All database tables and indices initialized successfully.";
     return true;
 }
 
 
+void Server::loadGroupState()
+{
+    // Синхронное соединение конструктора: сервер еще не принимает клиентов,
+    // блокировка здесь никому не мешает. Состав групп невелик относительно
+    // сообщений, полная загрузка — один проход по group_members.
+    QSqlQuery query;
+
+    if (query.exec("SELECT group_id, username FROM group_members;")) {
+        while (query.next()) {
+            m_groupMembers[query.value(0).toLongLong()]
+                .insert(query.value(1).toString());
+        }
+    } else {
+        qWarning() << "[DB] Failed to load group members:" << query.lastError().text();
+    }
+
+    // ID групп присваивает сервер синхронно (ack создателю не ждет писателя),
+    // поэтому счетчик засеивается за верхней границей существующих ID.
+    if (query.exec("SELECT COALESCE(MAX(id), 0) FROM groups;") && query.next()) {
+        m_nextGroupId = query.value(0).toLongLong() + 1;
+    }
+
+    qInfo() << "[DB] Loaded" << m_groupMembers.size() << "groups into memory"
+            << "(next group id:" << m_nextGroupId << ")";
+}
+
+
+void Server::loadUserDirectory()
+{
+    // Как и loadGroupState: синхронное соединение конструктора, клиентов еще
+    // нет. Имена компактны — даже сотни тысяч пользователей помещаются в
+    // несколько мегабайт.
+    QSqlQuery query;
+
+    if (query.exec("SELECT username FROM users;")) {
+        while (query.next()) {
+            m_userDirectory.insert(query.value(0).toString());
+        }
+    } else {
+        qWarning() << "[DB] Failed to load user directory:" << query.lastError().text();
+    }
+
+    qInfo() << "[DB] Loaded" << m_userDirectory.size() << "usernames into directory";
+}
+
+
+// См. объявление в server.h: прогрев страничного кэша SQLite после ребута
+void Server::startDatabaseWarmup()
+{
+#ifdef Q_OS_UNIX
+    // Readahead-подсказка ядру: страницы файла БД начинают подниматься с
+    // диска асинхронно, еще до того как их затребуют запросы прогрева
+    QFile dbFile(QStringLiteral("messenger.db"));
+    if (dbFile.open(QIODevice::ReadOnly)) {
+        posix_fadvise(dbFile.handle(), 0, 0, POSIX_FADV_WILLNEED);
+    }
+#endif
+
+    // Справочники users и tokens логин трогает первыми; оба проходятся
+    // целиком — они на порядки меньше истории
+    QSqlQuery query;
+    query.exec("SELECT COUNT(username), COUNT(display_name) FROM users;");
+    query.exec("SELECT COUNT(token) FROM tokens;");
+
+    // Горячие диалоги: последние по активности — именно их историю
+    // запросят первые вошедшие после рестарта. Свежий хвост messages
+    // читается по первичному ключу, без прохода всей таблицы.
+    QSqlQuery recent;
+    if (recent.exec(QString(
+            "SELECT DISTINCT conversation_id FROM "
+            "(SELECT conversation_id FROM messages ORDER BY id DESC LIMIT %1) "
+            "WHERE conversation_id IS NOT NULL;")
+            .arg(WarmupConversations * 100))) {
+        while (recent.next() && m_warmupQueue.size() < WarmupConversations) {
+            m_warmupQueue.append(recent.value(0).toLongLong());
+        }
+    }
+
+    m_warmupCompleted = 1; // Справочники подняты
+    m_warmupTotal = 1 + m_warmupQueue.size();
+
+    qInfo() << "[SERVER] Database warm-up started:" << m_warmupQueue.size()
+            << "recent conversation(s) queued";
+    databaseWarmupStep();
+}
+
+
+void Server::databaseWarmupStep()
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    QElapsedTimer slice;
+    slice.start();
+
+    // Та же форма запроса, что у handleGetHistory: range-scan по индексу
+    // (conversation_id, id) плюс страницы строк — результат не нужен,
+    // важны поднятые в кэш страницы
+    while (!m_warmupQueue.isEmpty() && slice.elapsed() < WarmupSliceBudgetMs) {
+        const qint64 conversationId = m_warmupQueue.takeFirst();
+        QSqlQuery &page = StatementCache::get(db, QString(
+            "SELECT id, payload, timestamp FROM messages "
+            "WHERE conversation_id = :cid ORDER BY id DESC LIMIT %1")
+            .arg(WarmupRowsPerConversation));
+        page.bindValue(":cid", conversationId);
+        if (page.exec()) {
+            while (page.next()) { /* только фолты страниц */ }
+        }
+        ++m_warmupCompleted;
+    }
+
+    if (!m_warmupQueue.isEmpty()) {
+        // Перепостановка нулевым таймером: уже идущий живой трафик
+        // обрабатывается между порциями
+        QTimer::singleShot(0, this, &Server::databaseWarmupStep);
+        return;
+    }
+
+    m_warmupFinished = true;
+    qInfo() << "[SERVER] Database warm-up complete:" << m_warmupTotal << "step(s)";
+}
+
+
+void Server::archiveIdleConversations()
+{
+    if (m_archiveIdleMonths <= 0) return;
+
+    // Граница неактивности переводится в ID: время зашито в его старших
+    // битах (см. MessageIdGenerator), поэтому сравнение по ID — это
+    // сравнение по времени без разбора текстовых timestamp.
+    const qint64 cutoffMs = QDateTime::currentDateTimeUtc()
+                                .addMonths(-m_archiveIdleMonths)
+                                .toMSecsSinceEpoch()
+                            - MessageIdGenerator::EpochMs;
+    if (cutoffMs <= 0) return;
+    const qint64 cutoffId = cutoffMs << MessageIdGenerator::SequenceBits;
+
+    qInfo() << "[ARCHIVE] Nightly archive pass started (idle threshold:"
+            << m_archiveIdleMonths << "months)";
+
+    m_dbService->read(
+        [cutoffId](QSqlDatabase &db) -> QVariant {
+            // Диалоги, вся переписка которых старше границы. Вместо прежней
+            // группировки всего messages по каноничной паре — проход по
+            // справочнику conversations: MAX(id) каждого диалога берется
+            // одним пробником в хвост диапазона индекса (conversation_id, id);
+            // у диалога без горячих строк MAX дает NULL и условие ложно.
+            QSqlQuery query(db);
+            query.prepare(
+                "SELECT c.user_a, c.user_b FROM conversations c "
+                "WHERE (SELECT MAX(id) FROM messages m "
+                "       WHERE m.conversation_id = c.id) < :cutoff "
+                "LIMIT " + QString::number(ArchiveBatchConversations));
+            query.bindValue(":cutoff", cutoffId);
+
+            QStringList pairs;
+            if (!query.exec()) {
+                qWarning() << "[ARCHIVE] Idle-conversation scan failed:"
+                           << query.lastError().text();
+                return pairs;
+            }
+            while (query.next()) {
+                pairs << query.value(0).toString() + QLatin1Char('\n')
+                         + query.value(1).toString();
+            }
+            return pairs;
+        },
+        this,
+        [this](const QVariant &result) {
+            const QStringList pairs = result.toStringList();
+            if (pairs.isEmpty()) {
+                qDebug() << "[ARCHIVE] No idle conversations to archive";
+                return;
+            }
+
+            for (const QString &pair : pairs) {
+                const QStringList names = pair.split(QLatin1Char('\n'));
+                archiveConversation(names.value(0), names.value(1));
+            }
+        });
+}
+
+
+void Server::archiveConversation(const QString& userA, const QString& userB)
+{
+    m_dbService->read(
+        [userA, userB](QSqlDatabase &db) -> QVariant {
+            QJsonArray rows;
+
+            const qint64 conversationId = ConversationDirectory::idFor(db, userA, userB);
+            if (conversationId < 0) {
+                return rows; // Пара неизвестна — переносить нечего
+            }
+
+            // Порция самых старых строк диалога; длинный диалог доедет до
+            // архива за несколько ночных проходов.
+            QSqlQuery &query = StatementCache::get(db,
+                "SELECT id, fromUser, toUser, payload, timestamp, reply_to_id, chat_seq, is_read, is_edited, is_delivered, file_id, file_name, file_url "
+                "FROM messages "
+                "WHERE conversation_id = :conversationId "
+                "ORDER BY id ASC LIMIT " + QString::number(ArchiveRowsPerPass));
+            query.bindValue(":conversationId", conversationId);
+
+            if (!query.exec()) {
+                qWarning() << "[ARCHIVE] Failed to read conversation" << userA
+                           << "<->" << userB << ":" << query.lastError().text();
+                return rows;
+            }
+
+            while (query.next()) {
+                QSqlRecord record = query.record();
+                QJsonObject messageObject;
+                messageObject["id"] = record.value("id").toLongLong();
+                messageObject["fromUser"] = record.value("fromUser").toString();
+                messageObject["toUser"] = record.value("toUser").toString();
+                messageObject["payload"] = Compression::unpackText(record.value("payload"));
+                messageObject["timestamp"] = static_cast<double>(record.value("timestamp").toLongLong());
+                messageObject["is_read"] = record.value("is_read").toInt();
+                messageObject["is_delivered"] = record.value("is_delivered").toInt();
+                messageObject["is_edited"] = record.value("is_edited").toInt();
+                messageObject["reply_to_id"] = record.value("reply_to_id").toLongLong();
+                messageObject["chat_seq"] = record.value("chat_seq").toLongLong();
+                messageObject["file_id"] = record.value("file_id").toString();
+                messageObject["file_name"] = record.value("file_name").toString();
+                messageObject["file_url"] = record.value("file_url").toString();
+                rows.append(messageObject);
+            }
+            return rows;
+        },
+        this,
+        [this, userA, userB](const QVariant &result) {
+            const QJsonArray rows = result.toJsonArray();
+            if (rows.isEmpty()) return;
+
+            // Сначала все строки порции фиксируются в сегментах; DELETE
+            // уходит только после полного успеха — при сбое записи строки
+            // остаются в SQLite и попадут в следующий проход.
+            qint64 maxArchivedId = 0;
+            for (const QJsonValue &value : rows) {
+                const QJsonObject message = value.toObject();
+                if (!m_coldStorage->appendMessage(userA, userB, message)) {
+                    qWarning() << "[ARCHIVE] Append failed; aborting pass for"
+                               << userA << "<->" << userB;
+                    return;
+                }
+                maxArchivedId = static_cast<qint64>(message["id"].toDouble());
+            }
+
+            m_dbService->post([userA, userB, maxArchivedId](QSqlDatabase &db) -> QVariant {
+                const qint64 conversationId = ConversationDirectory::idFor(db, userA, userB);
+                if (conversationId < 0) return QVariant();
+
+                QSqlQuery &del = StatementCache::get(db,
+                    "DELETE FROM messages "
+                    "WHERE conversation_id = :conversationId AND id <= :maxId");
+                del.bindValue(":conversationId", conversationId);
+                del.bindValue(":maxId", maxArchivedId);
+
+                if (!del.exec()) {
+                    // Строки остались и в БД, и в архиве: чтение истории
+                    // дедуплицируется границей coldBound, а повторный
+                    // проход удалит их снова.
+                    qWarning() << "[ARCHIVE] Failed to delete archived rows:"
+                               << del.lastError().text();
+                }
+                return QVariant();
+            });
+
+            // Страница кэша могла пересекаться с перенесенными строками.
+            m_recentMessages.invalidate(userA, userB);
+
+            qInfo() << "[ARCHIVE] Archived" << rows.size() << "message(s) of"
+                    << userA << "<->" << userB << "(up to id" << maxArchivedId << ")";
+        });
+}
+
+
+void Server::handleSetRetention(QObject* socket, const QJsonObject& request)
+{
+    // 1. Идентификация и проверка аутентификации
+    const QString requestingUser = m_sessions.usernameOf(socket);
+    if (requestingUser.isEmpty()) {
+        qWarning() << "[SECURITY] Retention change from unauthenticated socket.";
+        return;
+    }
+
+    const QString peer = request["with"].toString();
+    const qint64 ttlSeconds =
+        qMax<qint64>(0, static_cast<qint64>(request["ttl_seconds"].toDouble()));
+    if (peer.isEmpty() || peer == requestingUser) {
+        qWarning() << "[SERVER] Invalid retention request from" << requestingUser;
+        return;
+    }
+
+    m_dbService->query(
+        [requestingUser, peer, ttlSeconds](QSqlDatabase &db) -> QVariant {
+            // Диалог мог еще не существовать (политика выставлена до первого
+            // сообщения) — справочник создает запись на месте
+            const qint64 conversationId =
+                ConversationDirectory::ensureId(db, requestingUser, peer);
+            if (conversationId < 0) return false;
+
+            QSqlQuery &query = StatementCache::get(db,
+                "UPDATE conversations SET retention_seconds = :ttl WHERE id = :id");
+            query.bindValue(":ttl", ttlSeconds > 0 ? QVariant(ttlSeconds) : QVariant());
+            query.bindValue(":id", conversationId);
+            if (!query.exec()) {
+                qWarning() << "[DB] Failed to store retention policy:"
+                           << query.lastError().text();
+                return false;
+            }
+            return true;
+        },
+        this,
+        [this, requestingUser, peer, ttlSeconds](const QVariant &result) {
+            if (!result.toBool()) return;
+
+            qInfo() << "[SERVER] Retention for" << requestingUser << "<->" << peer
+                    << "set to" << ttlSeconds << "second(s)";
+
+            // Уведомление обеим сторонам онлайн (как у delete_message):
+            // каждая чистит свою локальную базу по той же политике
+            QJsonObject event;
+            event["type"] = "retention_changed";
+            event["ttl_seconds"] = static_cast<double>(ttlSeconds);
+
+            if (QObject* fromSocket = m_sessions.socketOf(requestingUser)) {
+                event["with_user"] = peer;
+                sendJson(fromSocket, event);
+            }
+            if (QObject* toSocket = m_sessions.socketOf(peer)) {
+                event["with_user"] = requestingUser;
+                sendJson(toSocket, event);
+            }
+        });
+}
+
+
+void Server::pruneExpiredMessages()
+{
+    m_dbService->read(
+        [](QSqlDatabase &db) -> QVariant {
+            // Диалоги с включенной политикой хранения; у типичного
+            // развертывания их доли процента от справочника
+            QSqlQuery query(db);
+            QStringList rows;
+            if (!query.exec("SELECT id, user_a, user_b, retention_seconds "
+                            "FROM conversations WHERE retention_seconds > 0")) {
+                qWarning() << "[RETENTION] Policy scan failed:"
+                           << query.lastError().text();
+                return rows;
+            }
+            while (query.next()) {
+                rows << query.value(0).toString() + QLatin1Char('\n')
+                            + query.value(1).toString() + QLatin1Char('\n')
+                            + query.value(2).toString() + QLatin1Char('\n')
+                            + query.value(3).toString();
+            }
+            return rows;
+        },
+        this,
+        [this](const QVariant &result) {
+            const QStringList rows = result.toStringList();
+            if (rows.isEmpty()) return;
+
+            qDebug() << "[RETENTION] Sweep started:" << rows.size()
+                     << "conversation(s) with a retention policy";
+            for (const QString &row : rows) {
+                const QStringList fields = row.split(QLatin1Char('\n'));
+                pruneConversationRetention(fields.value(0).toLongLong(),
+                                           fields.value(1), fields.value(2),
+                                           fields.value(3).toLongLong());
+            }
+        });
+}
+
+
+void Server::pruneConversationRetention(qint64 conversationId, const QString& userA,
+                                        const QString& userB, qint64 retentionSeconds)
+{
+    // Граница срока переводится в ID: время зашито в его старших битах
+    // (см. MessageIdGenerator) — диапазон истекших строк вырезается
+    // range-scan'ом по индексу (conversation_id, id), без разбора timestamp
+    const qint64 cutoffMs = QDateTime::currentMSecsSinceEpoch()
+                            - retentionSeconds * 1000
+                            - MessageIdGenerator::EpochMs;
+    if (cutoffMs <= 0) return;
+    const qint64 cutoffId = cutoffMs << MessageIdGenerator::SequenceBits;
+
+    m_dbService->query(
+        [conversationId, cutoffId](QSqlDatabase &db) -> QVariant {
+            // Верхняя граница порции: первый проход после включения политики
+            // на длинном диалоге идет порциями, а не одним гигантским DELETE
+            QSqlQuery &bound = StatementCache::get(db,
+                "SELECT MAX(id) FROM ("
+                "  SELECT id FROM messages "
+                "  WHERE conversation_id = :conversationId AND id < :cutoff "
+                "  ORDER BY id ASC LIMIT " + QString::number(RetentionRowsPerPass) + ")");
+            bound.bindValue(":conversationId", conversationId);
+            bound.bindValue(":cutoff", cutoffId);
+            if (!bound.exec() || !bound.next() || bound.value(0).isNull()) {
+                return 0;
+            }
+            const qint64 maxId = bound.value(0).toLongLong();
+
+            // Истекшие, но не прочитанные строки списываются со счетчиков —
+            // иначе бейджи показывают призраков, которых уже не открыть
+            QSqlQuery &unread = StatementCache::get(db,
+                "SELECT toUser, fromUser, COUNT(*) FROM messages "
+                "WHERE conversation_id = :conversationId AND id <= :maxId "
+                "AND is_read = 0 GROUP BY toUser, fromUser");
+            unread.bindValue(":conversationId", conversationId);
+            unread.bindValue(":maxId", maxId);
+            if (unread.exec()) {
+                while (unread.next()) {
+                    QSqlQuery &fix = StatementCache::get(db,
+                        "UPDATE unread_counts SET unread = MAX(unread - :count, 0) "
+                        "WHERE toUser = :toUser AND fromUser = :fromUser");
+                    fix.bindValue(":count", unread.value(2).toLongLong());
+                    fix.bindValue(":toUser", unread.value(0).toString());
+                    fix.bindValue(":fromUser", unread.value(1).toString());
+                    fix.exec();
+                }
+            }
+
+            QSqlQuery &del = StatementCache::get(db,
+                "DELETE FROM messages "
+                "WHERE conversation_id = :conversationId AND id <= :maxId");
+            del.bindValue(":conversationId", conversationId);
+            del.bindValue(":maxId", maxId);
+            if (!del.exec()) {
+                qWarning() << "[RETENTION] Failed to prune conversation"
+                           << conversationId << ":" << del.lastError().text();
+                return 0;
+            }
+            return del.numRowsAffected();
+        },
+        this,
+        [this, userA, userB](const QVariant &result) {
+            const qint64 pruned = result.toLongLong();
+            if (pruned <= 0) return;
+
+            m_retentionPruned += pruned;
+
+            // Кэшированная страница диалога могла пересекаться с удаленным
+            m_recentMessages.invalidate(userA, userB);
+
+            qInfo() << "[RETENTION] Pruned" << pruned << "expired message(s) of"
+                    << userA << "<->" << userB;
+        });
+}
+
+
 
 /**
  * @brief Обрабатывает и пересылает уведомление о статусе "печатает..." (Typing Indicator).
@@ -1412,7 +4791,13 @@ bool Server::initDatabase()
  * - Уведомления о печати **не сохраняются** в базе данных (они эфемерные).
  * - Если получатель офлайн, уведомление просто игнорируется.
  * - Клиент обычно отправляет это уведомление каждые 3-5 секунд, пока печатает.
- * 
+ * - Сервер коалесцирует: не больше одной пересылки на пару
+ *   отправитель/получатель за TypingForwardIntervalMs — промежуточные
+ *   события не несут информации и подавляются.
+ * - Если исходящий буфер получателя распух (медленный канал), индикатор
+ *   сбрасывается целиком: это самый бесполезный трафик в очереди.
+ *   Оба счетчика подавления видны в метриках (messenger_typing_*).
+ *
  * @param socket Сокет клиента, который начал печатать.
  * @param request JSON-объект с полями:
  *        - `toUser`: Username получателя (кому показать индикатор).
@@ -1422,7 +4807,7 @@ void Server::handleTyping(QObject *socket, const QJsonObject &request)
     // -----------------------------------------------------------------------
     // 1. Идентификация отправителя
     // -----------------------------------------------------------------------
-    QString fromUsername = m_clientsReverse.value(socket);
+    QString fromUsername = m_sessions.usernameOf(socket);
     
     if (fromUsername.isEmpty()) {
         qWarning() << "[SERVER] Typing indicator from unauthenticated socket";
@@ -1442,16 +4827,55 @@ void Server::handleTyping(QObject *socket, const QJsonObject &request)
     // -----------------------------------------------------------------------
     // 3. Поиск получателя в списке онлайн-пользователей
     // -----------------------------------------------------------------------
-    QObject* toSocket = m_clients.value(toUsername, nullptr);
+    QObject* toSocket = m_sessions.socketOf(toUsername);
 
     if (toSocket) {
         // ====================================================================
-        // СЛУЧАЙ 1: Получатель онлайн — пересылаем уведомление
+        // СЛУЧАЙ 1: Получатель онлайн — коалесценция и пересылка
         // ====================================================================
+        // Не больше одной пересылки на пару за интервал: клиент дергает
+        // typing на каждый дебоунс набора, промежуточные события — шум.
+        const QString pairKey = fromUsername + QLatin1Char('\x1f') + toUsername;
+        const qint64 nowMs = m_typingClock.elapsed();
+        const qint64 lastMs = m_typingForwards.value(pairKey, -TypingForwardIntervalMs);
+
+        if (nowMs - lastMs < TypingForwardIntervalMs) {
+            ++m_typingCoalesced;
+            return;
+        }
+
+        // Отстающий получатель: typing — первый кандидат на сброс, когда
+        // его исходящий буфер уже не успевает уходить в сеть. Сокеты пула
+        // живут в рабочих потоках — их буфер отсюда не читается, проверка
+        // касается только соединений основного потока.
+        if (auto *tcpRecipient = qobject_cast<QTcpSocket*>(toSocket);
+            tcpRecipient && !m_socketWorkers.contains(toSocket)) {
+            const qint64 buffered = tcpRecipient->bytesToWrite()
+                                    + m_pendingWrites.value(toSocket).size();
+            if (buffered > TypingBackpressureBytes) {
+                ++m_typingDroppedBackpressure;
+                return;
+            }
+        }
+
+        m_typingForwards.insert(pairKey, nowMs);
+
+        // Карта пар не должна расти вечно: при переполнении выбрасываем
+        // записи, которые старше интервала (они уже ничего не подавляют).
+        if (m_typingForwards.size() > MaxTypingPairs) {
+            for (auto it = m_typingForwards.begin(); it != m_typingForwards.end();) {
+                if (nowMs - it.value() >= TypingForwardIntervalMs) {
+                    it = m_typingForwards.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
         QJsonObject forwardMessage;
         forwardMessage["type"] = "typing";
         forwardMessage["fromUser"] = fromUsername; // Кто печатает
-        
+
         sendJson(toSocket, forwardMessage);
         
         // Для отладки можно убрать это логирование, так как typing-событий очень много
@@ -1479,25 +4903,31 @@ void Server::handleTyping(QObject *socket, const QJsonObject &request)
  * 3. Формирует SQL-запрос для выборки сообщений:
  *    - Выбирает сообщения между двумя пользователями (в обе стороны).
  *    - Если указан `before_id`, загружает только сообщения старше этого ID.
- *    - Ограничивает выборку 20 сообщениями.
+ *    - Ограничивает выборку размером страницы (`limit`, по умолчанию 20).
  * 4. Инвертирует порядок сообщений (БД возвращает от новых к старым, клиенту нужно наоборот).
  * 5. Отправляет результат клиенту.
  * 
  * **Пример использования:**
  * - Первая загрузка чата: `before_id = 0` (или отсутствует) → возвращает последние 20 сообщений.
  * - Прокрутка вверх: `before_id = 12345` → возвращает до 20 сообщений старше ID 12345.
- * 
+ * - Синхронизация после реконнекта: `after_server_id = 67890` → возвращает только
+ *   сообщения новее ID 67890, уже отсортированные по возрастанию. Клиент хранит
+ *   историю в локальном SQLite и присылает свой максимальный server_id, поэтому
+ *   сервер не перекачивает страницы, которые у клиента и так есть.
+ *
  * @param socket Сокет клиента, запросившего историю.
  * @param request JSON-объект с полями:
  *        - `with_user`: Username собеседника (обязательно).
  *        - `before_id`: ID сообщения, старше которого нужно загрузить историю (опционально, 0 = загрузить самые новые).
+ *        - `after_server_id`: Верхняя граница локальной истории клиента — вернуть только более новые строки (опционально, 0 = полная загрузка).
+ *        - `limit`: Размер страницы, 1–100 (опционально, по умолчанию 20; для дельты — 100).
  */
 void Server::handleGetHistory(QObject* socket, const QJsonObject& request)
 {
     // -----------------------------------------------------------------------
     // 1. Извлечение параметров запроса
     // -----------------------------------------------------------------------
-    QString requestingUser = m_clientsReverse.value(socket);
+    QString requestingUser = m_sessions.usernameOf(socket);
     
     if (requestingUser.isEmpty()) {
         qWarning() << "[SERVER] History request from unauthenticated socket";
@@ -1513,103 +4943,217 @@ void Server::handleGetHistory(QObject* socket, const QJsonObject& request)
     
     qint64 beforeId = request["before_id"].toDouble(); // 0, если поле отсутствует
 
+    // Дельта-синхронизация: клиент присылает наибольший server_id, уже лежащий
+    // в его локальном SQLite, и получает только более новые строки. Реконнект
+    // перестает перекачивать страницы, которые у клиента и так есть:
+    // O(история) превращается в O(дельта).
+    qint64 afterId = request["after_server_id"].toDouble(); // 0 — полная загрузка
+
+    // Размер страницы: клиент может запросить свой (например, для предзагрузки),
+    // но в разумных пределах. По умолчанию — исторические 20 сообщений;
+    // дельта после реконнекта шире, чтобы типичная «дыра» закрывалась за один запрос.
+    int limit = request["limit"].toInt(afterId > 0 ? 100 : 20);
+    limit = qBound(1, limit, 100);
+
     qDebug() << "[SERVER] History request from" << requestingUser
              << "for chat with" << chatPartner
-             << (beforeId > 0 ? QString("(before message ID: %1)").arg(beforeId) : "(initial load)");
+             << (beforeId > 0 ? QString("(before message ID: %1)").arg(beforeId)
+                 : afterId > 0 ? QString("(delta after ID: %1)").arg(afterId)
+                               : "(initial load)");
 
     // -----------------------------------------------------------------------
-    // 2. Формирование SQL-запроса с поддержкой пагинации
+    // 1.1. Попытка выдачи из кэша последних сообщений
     // -----------------------------------------------------------------------
-    QString queryString =
-        "SELECT id, fromUser, toUser, payload, timestamp, reply_to_id, is_read, is_edited, is_delivered, file_id, file_name, file_url "
-        "FROM messages "
-        "WHERE ((fromUser = :user1 AND toUser = :user2) OR (fromUser = :user2 AND toUser = :user1)) ";
+    // Свежайшая страница активного диалога чаще всего резидентна в памяти:
+    // отвечаем сразу, не занимая очередь потока БД. Дельта-запрос обслуживается
+    // из кэша только если самая старая закэшированная строка не новее afterId —
+    // иначе часть «дыры» лежит за пределами страницы и нужна выборка из БД.
+    if (beforeId == 0) {
+        QJsonArray cachedPage;
+        if (m_recentMessages.latestPage(requestingUser, chatPartner, limit, cachedPage)) {
+            bool cacheCoversRequest = true;
+
+            if (afterId > 0) {
+                const qint64 oldestCachedId = cachedPage.isEmpty()
+                    ? 0
+                    : static_cast<qint64>(cachedPage.first().toObject()["id"].toDouble());
+                cacheCoversRequest = oldestCachedId > 0 && oldestCachedId <= afterId;
+
+                if (cacheCoversRequest) {
+                    QJsonArray deltaPage;
+                    for (const QJsonValue &value : std::as_const(cachedPage)) {
+                        if (static_cast<qint64>(value.toObject()["id"].toDouble()) > afterId) {
+                            deltaPage.append(value);
+                        }
+                    }
+                    cachedPage = deltaPage;
+                }
+            }
 
-    // Добавляем условие пагинации: загружать только сообщения старше указанного ID
-    if (beforeId > 0) {
-        queryString += "AND id < :beforeId ";
-    }
+            if (cacheCoversRequest) {
+                qDebug() << "[SERVER] History served from recent-message cache for"
+                         << requestingUser << "<->" << chatPartner
+                         << (afterId > 0 ? QString("(delta, %1 rows)").arg(cachedPage.size())
+                                         : QString());
 
-    // Сортировка: от новых к старым (DESC), чтобы взять последние 20 перед beforeId
-    queryString += "ORDER BY id DESC LIMIT 20";
+                QJsonObject response;
+                response["type"] = "history_data";
+                response["with_user"] = chatPartner;
+                response["history"] = cachedPage;
+                sendJson(socket, response);
+                return;
+            }
+        }
+    }
 
     // -----------------------------------------------------------------------
-    // 3. Подготовка и выполнение запроса
+    // 2. Формирование keyset-запроса под составной индекс
     // -----------------------------------------------------------------------
-    QSqlQuery query;
-    query.prepare(queryString);
-    query.bindValue(":user1", requestingUser);
-    query.bindValue(":user2", chatPartner);
-    
-    if (beforeId > 0) {
-        query.bindValue(":beforeId", beforeId);
-    }
-
-    if (!query.exec()) {
-        qWarning() << "[SERVER] Failed to fetch history for" << requestingUser 
-                   << "and" << chatPartner << ":" << query.lastError().text();
-        
-        // Отправляем клиенту ответ с пустой историей, чтобы он не завис в ожидании
-        QJsonObject errorResponse;
-        errorResponse["type"] = beforeId > 0 ? "old_history_data" : "history_data";
-        errorResponse["with_user"] = chatPartner;
-        errorResponse["history"] = QJsonArray(); // Пустой массив
-        sendJson(socket, errorResponse);
-        return;
-    }
+    // Диалог адресуется одним conversation_id (см. ConversationDirectory),
+    // поэтому страница — единственный range-scan по индексу
+    // (conversation_id, id), уже отсортированный по id: ни OR по двум
+    // направлениям пары, ни UNION двух подзапросов не нужны.
+    // Условие id < :beforeId присутствует всегда: для первой загрузки
+    // передается максимальный qint64, что дает один кэшируемый statement.
+    // Дельта-синхронизация — зеркальная форма того же keyset-запроса:
+    // id > :afterId, восходящий порядок, тот же составной индекс.
+    const bool deltaSync = (afterId > 0 && beforeId == 0);
+
+    const QString queryString = deltaSync
+        ? "SELECT id, fromUser, toUser, payload, timestamp, reply_to_id, chat_seq, is_read, is_edited, is_delivered, file_id, file_name, file_url "
+          "FROM messages "
+          "WHERE conversation_id = :conversationId AND id > :afterId "
+          "ORDER BY id ASC LIMIT :limit"
+        : "SELECT id, fromUser, toUser, payload, timestamp, reply_to_id, chat_seq, is_read, is_edited, is_delivered, file_id, file_name, file_url "
+          "FROM messages "
+          "WHERE conversation_id = :conversationId AND id < :beforeId "
+          "ORDER BY id DESC LIMIT :limit";
+
+    // Ключ пагинации: 0/отсутствие поля означает "с самого свежего сообщения";
+    // при дельте ключом служит верхняя граница локальной истории клиента.
+    const qint64 keysetBound = deltaSync ? afterId
+                             : (beforeId > 0) ? beforeId
+                                              : std::numeric_limits<qint64>::max();
 
     // -----------------------------------------------------------------------
-    // 4. Сборка JSON-массива из результатов запроса
+    // 3. Асинхронное выполнение запроса в пуле читателей БД
     // -----------------------------------------------------------------------
-    QJsonArray historyArray;
-    
-    while (query.next()) {
-        QSqlRecord record = query.record();
-        QJsonObject messageObject;
-        
-        // Заполняем JSON-объект данными из записи БД
-        messageObject["id"] = record.value("id").toLongLong();
-        messageObject["fromUser"] = record.value("fromUser").toString();
-        messageObject["toUser"] = record.value("toUser").toString();
-        messageObject["payload"] = record.value("payload").toString();
-        messageObject["timestamp"] = record.value("timestamp").toString();
-        messageObject["is_read"] = record.value("is_read").toInt();
-        messageObject["is_delivered"] = record.value("is_delivered").toInt();
-        messageObject["is_edited"] = record.value("is_edited").toInt();
-        messageObject["reply_to_id"] = record.value("reply_to_id").toLongLong();
-        messageObject["file_id"] = record.contains("file_id") ? record.value("file_id").toString() : "";
-        messageObject["file_name"] = record.contains("file_name") ? record.value("file_name").toString() : "";
-        messageObject["file_url"] = record.contains("file_url") ? record.value("file_url").toString() : "";
+    // Выборка и сборка JSON выполняются на читающем соединении DatabaseService:
+    // медленный диск не блокирует остальных клиентов, а сама выборка не ждет
+    // в очереди писателя за пакетными INSERT. Сокет может отключиться,
+    // пока задача в очереди, поэтому отслеживаем его через QPointer.
+    QPointer<QObject> socketGuard(socket);
+
+    m_dbService->read(
+        [queryString, requestingUser, chatPartner, keysetBound, limit, deltaSync](QSqlDatabase &db) -> QVariant {
+            QJsonArray historyArray;
+
+            // Неизвестная пара — в горячей таблице истории заведомо нет
+            // (пустой ответ; холодный ярус при необходимости дочитает коллбэк).
+            const qint64 conversationId =
+                ConversationDirectory::idFor(db, requestingUser, chatPartner);
+            if (conversationId < 0) {
+                return historyArray;
+            }
 
-        historyArray.append(messageObject);
-    }
+            QSqlQuery &query = StatementCache::get(db, queryString);
+            query.bindValue(":conversationId", conversationId);
+            query.bindValue(deltaSync ? ":afterId" : ":beforeId", keysetBound);
+            query.bindValue(":limit", limit);
 
-    qDebug() << "[SERVER] Found" << historyArray.count() << "messages for chat" 
-             << requestingUser << "<->" << chatPartner;
+            if (!query.exec()) {
+                qWarning() << "[SERVER] Failed to fetch history for" << requestingUser
+                           << "and" << chatPartner << ":" << query.lastError().text();
+                // Пустой массив: клиент получит ответ и не зависнет в ожидании
+                return historyArray;
+            }
 
-    // -----------------------------------------------------------------------
-    // 5. Инверсия порядка сообщений
-    // -----------------------------------------------------------------------
-    // SQL вернул сообщения в порядке DESC (от новых к старым), но клиенту нужно
-    // отображать их от старых к новым (снизу вверх в UI), поэтому переворачиваем массив.
-    QJsonArray reversedArray;
-    for (int i = historyArray.size() - 1; i >= 0; --i) {
-        reversedArray.append(historyArray.at(i));
-    }
+            while (query.next()) {
+                QSqlRecord record = query.record();
+                QJsonObject messageObject;
+
+                // Заполняем JSON-объект данными из записи БД
+                messageObject["id"] = record.value("id").toLongLong();
+                messageObject["fromUser"] = record.value("fromUser").toString();
+                messageObject["toUser"] = record.value("toUser").toString();
+                messageObject["payload"] = Compression::unpackText(record.value("payload"));
+                messageObject["timestamp"] = static_cast<double>(record.value("timestamp").toLongLong());
+                messageObject["is_read"] = record.value("is_read").toInt();
+                messageObject["is_delivered"] = record.value("is_delivered").toInt();
+                messageObject["is_edited"] = record.value("is_edited").toInt();
+                messageObject["reply_to_id"] = record.value("reply_to_id").toLongLong();
+                messageObject["chat_seq"] = record.value("chat_seq").toLongLong();
+                messageObject["file_id"] = record.contains("file_id") ? record.value("file_id").toString() : "";
+                messageObject["file_name"] = record.contains("file_name") ? record.value("file_name").toString() : "";
+                messageObject["file_url"] = record.contains("file_url") ? record.value("file_url").toString() : "";
+
+                historyArray.append(messageObject);
+            }
 
-    // -----------------------------------------------------------------------
-    // 6. Формирование и отправка ответа
-    // -----------------------------------------------------------------------
-    QJsonObject response;
-    
-    // Тип ответа зависит от контекста запроса:
-    // - "history_data": Первоначальная загрузка чата (beforeId = 0).
-    // - "old_history_data": Подгрузка старых сообщений при прокрутке вверх (beforeId > 0).
-    response["type"] = (beforeId > 0) ? "old_history_data" : "history_data";
-    response["with_user"] = chatPartner;
-    response["history"] = reversedArray;
-    
-    sendJson(socket, response);
+            // Дельта уже отсортирована по возрастанию; страницы пагинации SQL
+            // вернул в порядке DESC (от новых к старым), а клиенту нужно
+            // отображать их от старых к новым, поэтому переворачиваем массив.
+            if (deltaSync) {
+                return historyArray;
+            }
+
+            QJsonArray reversedArray;
+            for (int i = historyArray.size() - 1; i >= 0; --i) {
+                reversedArray.append(historyArray.at(i));
+            }
+
+            return reversedArray;
+        },
+        this,
+        [this, socketGuard, requestingUser, chatPartner, beforeId, deltaSync, limit](const QVariant &result) {
+            // Свежайшая страница из БД засевает кэш диалога: следующие
+            // запросы головы истории обслужатся из памяти. Дельта кэш не
+            // засевает: она может не быть полной свежайшей страницей.
+            if (beforeId == 0 && !deltaSync) {
+                m_recentMessages.seedLatest(requestingUser, chatPartner, result.toJsonArray());
+            }
+
+            // Клиент успел отключиться, пока запрос выполнялся — ответ не нужен
+            if (!socketGuard) return;
+
+            QJsonArray history = result.toJsonArray();
+
+            // Пользователь долистал до глубины, выгруженной в холодный ярус:
+            // страница из SQLite неполна — подклеиваем архивные строки спереди
+            // (они заведомо старше всего, что осталось в горячей таблице).
+            // Дельта-синхронизация архив не трогает: новых сообщений там нет.
+            if (!deltaSync && history.size() < limit
+                && m_coldStorage->hasChat(requestingUser, chatPartner)) {
+                const qint64 coldBound = history.isEmpty()
+                    ? beforeId
+                    : static_cast<qint64>(history.first().toObject()["id"].toDouble());
+
+                const QJsonArray coldPage = m_coldStorage->readOlder(
+                    requestingUser, chatPartner, coldBound, limit - history.size());
+
+                if (!coldPage.isEmpty()) {
+                    QJsonArray stitched = coldPage;
+                    for (const QJsonValue &value : std::as_const(history)) {
+                        stitched.append(value);
+                    }
+                    history = stitched;
+                    qDebug() << "[ARCHIVE] Stitched" << coldPage.size()
+                             << "archived row(s) into history page for"
+                             << requestingUser << "<->" << chatPartner;
+                }
+            }
+
+            QJsonObject response;
+
+            // Тип ответа зависит от контекста запроса:
+            // - "history_data": Первоначальная загрузка чата (beforeId = 0).
+            // - "old_history_data": Подгрузка старых сообщений при прокрутке вверх (beforeId > 0).
+            response["type"] = (beforeId > 0) ? "old_history_data" : "history_data";
+            response["with_user"] = chatPartner;
+            response["history"] = history;
+
+            sendJson(socketGuard.data(), response);
+        });
 }
 
 
@@ -1703,97 +5247,152 @@ void Server::handleRegister(QObject* socket, const QJsonObject& request)
     }
     
     // ═══════════════════════════════════════════════════════════════════════
-    // 4. Обработка displayname
+    // 4. Проверка занятости имени по справочнику (без обращения к БД)
+    // ═══════════════════════════════════════════════════════════════════════
+    // Занятое имя отсекается до дорогого Argon2-хеширования и INSERT.
+    // UNIQUE-ограничение таблицы остается страховкой на случай гонки.
+    if (m_userDirectory.contains(username)) {
+        response["type"] = "register_failure";
+        response["reason"] = "Username already exists";
+        sendJson(socket, response);
+        qWarning() << "[SERVER] ❌ Registration failed: username already taken" << username;
+        return;
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 5. Обработка displayname
     // ═══════════════════════════════════════════════════════════════════════
     if (displayname.isEmpty()) {
         displayname = username; // По умолчанию displayname = username
     }
     
     // ═══════════════════════════════════════════════════════════════════════
-    // 5. Валидация пароля (опционально)
+    // 6. Валидация пароля (опционально)
     // ═══════════════════════════════════════════════════════════════════════
     // Можно добавить проверку минимальной длины/сложности пароля:
     // if (password.length() < 8) { ... }
     
     // ═══════════════════════════════════════════════════════════════════════
-    // 6. Генерация уникальной соли
+    // 7. Генерация уникальной соли
     // ═══════════════════════════════════════════════════════════════════════
     // Соль делает невозможным использование rainbow tables и предвычисленных хешей.
     // Каждый пользователь имеет свою уникальную соль, даже если пароли одинаковые.
-    QByteArray serverSalt = CryptoUtils::generateSalt(16); // 16 байт = 128 бит
-    
-    qDebug() << "[SERVER] Generated salt for user:" << username;
-    
-    // ═══════════════════════════════════════════════════════════════════════
-    // 7. Хеширование пароля с помощью Argon2i
-    // ═══════════════════════════════════════════════════════════════════════
-    // Argon2i — современный алгоритм, победитель Password Hashing Competition (2015).
-    // Он медленный по дизайну, что делает брутфорс экономически нецелесообразным.
-    QString finalHashString = CryptoUtils::hashPasswordArgon2(password, serverSalt);
-    
-    if (finalHashString.isEmpty()) {
-        response["type"] = "register_failure";
-        response["reason"] = "Password hashing failed (server error)";
-        sendJson(socket, response);
-        qCritical() << "[SERVER] Argon2 hashing failed for user" << username;
-        return;
-    }
-    
-    qDebug() << "[SERVER] Password hashed successfully. Hash length:" << finalHashString.length();
-    
-    // ═══════════════════════════════════════════════════════════════════════
-    // 8. Подготовка SQL-запроса
-    // ═══════════════════════════════════════════════════════════════════════
-    QSqlQuery query;
-    query.prepare(R"(
-        INSERT INTO users (username, display_name, password_hash, salt, creation_date)
-        VALUES (:username, :display_name, :password_hash, :salt, :creation_date)
-    )");
+    QByteArray serverSalt = CryptoUtils::generateSalt(16); // 16 байт = 128 бит
     
-    query.bindValue(":username", username);
-    query.bindValue(":display_name", displayname);
-    query.bindValue(":password_hash", finalHashString); // Хеш в Hex-формате
-    query.bindValue(":salt", serverSalt.toHex());       // Соль в Hex-формате (для текстового хранения)
-    query.bindValue(":creation_date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    qDebug() << "[SERVER] Generated salt for user:" << username;
     
     // ═══════════════════════════════════════════════════════════════════════
-    // 9. Выполнение запроса и обработка результата
+    // 8. Admission control KDF-пула
     // ═══════════════════════════════════════════════════════════════════════
-    if (query.exec()) {
-        // ====================================================================
-        // УСПЕХ: Пользователь зарегистрирован
-        // ====================================================================
-        response["type"] = "register_success";
-        response["username"] = username;
-        response["displayname"] = displayname;
-        
-        qInfo() << "[SERVER] ✅ New user registered:" << username;
-        
-        // Обновляем список пользователей для всех подключенных клиентов
-        // (хотя новый пользователь еще не авторизован, но это для полноты)
-        broadcastUserList();
-        
-    } else {
-        // ====================================================================
-        // ОШИБКА: Регистрация не удалась
-        // ====================================================================
+    // Те же потолки, что и у входа: массовые регистрации — второй путь
+    // занять Argon2 целиком.
+    const QString peerIp = peerIpOf(socket);
+    if (!tryAcquireKdfSlot(peerIp)) {
         response["type"] = "register_failure";
-        
-        // Проверка на дубликат username (UNIQUE constraint)
-        if (query.lastError().text().contains("UNIQUE constraint failed")) {
-            response["reason"] = "Username already exists";
-            qWarning() << "[SERVER] ❌ Registration failed: username already taken" << username;
-        } else {
-            response["reason"] = "Database error";
-            qCritical() << "[SERVER] ❌ Registration failed for" << username
-                       << "with DB error:" << query.lastError().text();
-        }
+        response["reason"] = "Server is busy, please try again";
+        sendJson(socket, response);
+        return;
     }
-    
+
     // ═══════════════════════════════════════════════════════════════════════
-    // 10. Отправка ответа клиенту
+    // 9. Хеширование пароля с помощью Argon2i — в криптопуле
     // ═══════════════════════════════════════════════════════════════════════
-    sendJson(socket, response);
+    // Argon2i — современный алгоритм, победитель Password Hashing Competition (2015).
+    // Он медленный по дизайну, что делает брутфорс экономически нецелесообразным.
+    // Именно поэтому KDF выполняется в m_cryptoPool, а не в потоке событий:
+    // регистрация не замораживает маршрутизацию сообщений (см. handleLogin).
+    QPointer<QObject> socketGuard(socket);
+
+    m_cryptoPool.start([this, socketGuard, password, serverSalt,
+                        username, displayname, peerIp]() {
+        const QString finalHashString =
+            CryptoUtils::hashPasswordArgon2(password, serverSalt);
+
+        QMetaObject::invokeMethod(this, [this, socketGuard, finalHashString,
+                                         serverSalt, username, displayname,
+                                         peerIp]() {
+            releaseKdfSlot(peerIp);
+
+            if (socketGuard.isNull()) {
+                qDebug() << "[SERVER] Client disconnected during registration KDF for" << username;
+                return;
+            }
+            QObject* socket = socketGuard.data();
+            QJsonObject response;
+
+            if (finalHashString.isEmpty()) {
+                response["type"] = "register_failure";
+                response["reason"] = "Password hashing failed (server error)";
+                sendJson(socket, response);
+                qCritical() << "[SERVER] Argon2 hashing failed for user" << username;
+                return;
+            }
+
+            qDebug() << "[SERVER] Password hashed successfully. Hash length:" << finalHashString.length();
+
+            // Повторная проверка занятости: пока считался KDF, имя могла
+            // занять параллельная регистрация. UNIQUE-ограничение таблицы
+            // остается последней страховкой.
+            if (m_userDirectory.contains(username)) {
+                response["type"] = "register_failure";
+                response["reason"] = "Username already exists";
+                sendJson(socket, response);
+                qWarning() << "[SERVER] ❌ Registration failed: username already taken" << username;
+                return;
+            }
+
+            // ════════════════════════════════════════════════════════════════
+            // Подготовка и выполнение SQL-запроса
+            // ════════════════════════════════════════════════════════════════
+            QSqlQuery query;
+            query.prepare(R"(
+                INSERT INTO users (username, display_name, password_hash, salt, creation_date)
+                VALUES (:username, :display_name, :password_hash, :salt, :creation_date)
+            )");
+
+            query.bindValue(":username", username);
+            query.bindValue(":display_name", displayname);
+            query.bindValue(":password_hash", finalHashString); // Хеш в Hex-формате
+            query.bindValue(":salt", serverSalt.toHex());       // Соль в Hex-формате (для текстового хранения)
+            query.bindValue(":creation_date", QDateTime::currentDateTime().toString(Qt::ISODate));
+
+            if (query.exec()) {
+                // ============================================================
+                // УСПЕХ: Пользователь зарегистрирован
+                // ============================================================
+                response["type"] = "register_success";
+                response["username"] = username;
+                response["displayname"] = displayname;
+
+                qInfo() << "[SERVER] ✅ New user registered:" << username;
+
+                // Пополняем справочник имен: следующие проверки существования
+                // нового пользователя обслужатся из памяти.
+                m_userDirectory.insert(username);
+
+                // Онлайн-состав не изменился: новый пользователь еще не авторизован,
+                // поэтому события присутствия здесь не рассылаются.
+
+            } else {
+                // ============================================================
+                // ОШИБКА: Регистрация не удалась
+                // ============================================================
+                response["type"] = "register_failure";
+
+                // Проверка на дубликат username (UNIQUE constraint)
+                if (query.lastError().text().contains("UNIQUE constraint failed")) {
+                    response["reason"] = "Username already exists";
+                    qWarning() << "[SERVER] ❌ Registration failed: username already taken" << username;
+                } else {
+                    response["reason"] = "Database error";
+                    qCritical() << "[SERVER] ❌ Registration failed for" << username
+                               << "with DB error:" << query.lastError().text();
+                }
+            }
+
+            sendJson(socket, response);
+        }, Qt::QueuedConnection);
+    });
 }
 
 
@@ -1805,24 +5404,24 @@ void Server::handleRegister(QObject* socket, const QJsonObject& request)
  * 
  * **Алгоритм работы:**
  * 1. Извлекает поисковый запрос (`term`) из JSON.
- * 2. Выполняет SQL-запрос с оператором `LIKE` для частичного совпадения.
+ * 2. Выполняет префиксный запрос к FTS5-индексу users_fts по токенам слов
+ *    (или LIKE-скан, если сборка SQLite без FTS5).
  * 3. Ищет по двум полям: `username` (логин) и `display_name` (отображаемое имя).
  * 4. Исключает из результатов самого пользователя (нельзя найти себя).
  * 5. Ограничивает выдачу 20 результатами для производительности.
  * 6. Отправляет клиенту массив найденных пользователей.
- * 
+ *
  * **Примеры поиска:**
  * - Запрос `"john"` найдет: `john_doe`, `johnny`, `John Smith`.
  * - Запрос `"sm"` найдет: `smith123`, `Mike Smith`, `smolder`.
- * 
+ *
  * **Оптимизация:**
- * - Для больших баз данных (>10000 пользователей) рекомендуется добавить индексы:
- *   ```
- *   CREATE INDEX idx_username ON users(username);
- *   CREATE INDEX idx_display_name ON users(display_name);
- *   ```
- * - Или использовать полнотекстовый поиск (FTS5 в SQLite).
- * 
+ * - Typeahead дергает этот обработчик на каждое нажатие клавиши (debounce
+ *   на клиенте), поэтому поиск идет по b-tree токенов FTS5 — миллисекунды
+ *   независимо от числа пользователей. Индекс поддерживают триггеры на
+ *   users (см. initDatabase), ручной синхронизации в обработчиках
+ *   регистрации и update_profile не требуется.
+ *
  * **Формат запроса:**
  * ```
  * {
@@ -1831,20 +5430,29 @@ void Server::handleRegister(QObject* socket, const QJsonObject& request)
  * }
  * ```
  * 
- * **Формат ответа:**
+ * **Формат ответа (потоковая выдача):**
+ * Результаты уходят чанками по SearchChunkSize в порядке ранга — первый
+ * чанк клиент рендерит сразу, не дожидаясь хвоста выборки:
  * ```
  * {
  *   "type": "search_results",
  *   "users": [
  *     {"username": "john_doe", "displayname": "John Doe"},
  *     {"username": "johnny", "displayname": "Johnny Bravo"}
- *   ]
+ *   ],
+ *   "gen": 7,        // эхо поколения запроса (отбраковка устаревших чанков)
+ *   "first": true,   // первый чанк: клиент заменяет содержимое списка
+ *   "done": false    // хвост еще идет
  * }
  * ```
+ * Хвостовые чанки отправляются через очередь событий: если к моменту
+ * выполнения клиент прислал новый запрос (поколение сменилось) или
+ * отключился, устаревший хвост отменяется без отправки.
  *
  * @param socket Сокет клиента, выполнившего поиск.
- * @param request JSON-объект с полем:
+ * @param request JSON-объект с полями:
  *        - `term`: Строка для поиска (минимум 1 символ).
+ *        - `gen`: Поколение запроса (монотонный счетчик клиента).
  */
 void Server::handleSearchUsers(QObject* socket, const QJsonObject& request)
 {
@@ -1852,13 +5460,18 @@ void Server::handleSearchUsers(QObject* socket, const QJsonObject& request)
     // 1. Извлечение параметров запроса
     // ═══════════════════════════════════════════════════════════════════════
     QString searchTerm = request["term"].toString().trimmed();
-    QString currentUser = m_clientsReverse.value(socket);
+    QString currentUser = m_sessions.usernameOf(socket);
 
     if (currentUser.isEmpty()) {
         qWarning() << "[SERVER] Search request from unauthenticated socket";
         return;
     }
 
+    // Поколение запроса: каждый новый поиск этого сокета отменяет хвостовые
+    // чанки предыдущего (см. m_searchGenerations).
+    const qint64 generation = request["gen"].toVariant().toLongLong();
+    m_searchGenerations[socket] = generation;
+
     // Проверка на пустой поисковый запрос
     if (searchTerm.isEmpty()) {
         qDebug() << "[SERVER] Empty search term from user" << currentUser;
@@ -1867,6 +5480,9 @@ void Server::handleSearchUsers(QObject* socket, const QJsonObject& request)
         QJsonObject response;
         response["type"] = "search_results";
         response["users"] = QJsonArray();
+        response["gen"] = generation;
+        response["first"] = true;
+        response["done"] = true;
         sendJson(socket, response);
         return;
     }
@@ -1874,67 +5490,152 @@ void Server::handleSearchUsers(QObject* socket, const QJsonObject& request)
     qDebug() << "[SERVER] User" << currentUser << "searching for:" << searchTerm;
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 2. Подготовка SQL-запроса с частичным совпадением
+    // 2. Подготовка поискового запроса
     // ═══════════════════════════════════════════════════════════════════════
     /**
-     * SQL-запрос выполняет поиск по двум полям:
+     * Поиск идет по двум полям:
      * - username: Уникальный логин (обычно латиница).
      * - display_name: Отображаемое имя (может содержать любые символы, включая кириллицу).
-     * 
-     * Оператор LIKE:
-     * - '%term%' находит 'term' в любом месте строки.
-     * - Чувствителен к регистру в SQLite по умолчанию, но можно изменить через COLLATE NOCASE.
+     *
+     * Основной путь — префиксный MATCH по FTS5-индексу: ввод разбивается на
+     * токены слов, каждый превращается в запрос "токен"* (кавычки экранируют
+     * синтаксис FTS — пользовательский ввод не должен им интерпретироваться).
+     * "john" так находит и john_doe, и John Smith: unicode61 делит строки
+     * на слова по не-буквенным символам, как и сам поиск в UI.
      */
-    QSqlQuery query;
-    query.prepare("SELECT username, display_name FROM users "
-                  "WHERE (username LIKE :term OR display_name LIKE :term) "
-                  "AND username != :currentUser "
-                  "LIMIT 20");
-    
-    // Добавляем символы '%' для поиска подстроки в любой позиции
-    query.bindValue(":term", "%" + searchTerm + "%");
-    query.bindValue(":currentUser", currentUser); // Исключаем себя из результатов
+    QJsonArray usersFound;
+    bool executed = false;
 
-    // ═══════════════════════════════════════════════════════════════════════
-    // 3. Выполнение запроса
-    // ═══════════════════════════════════════════════════════════════════════
-    if (!query.exec()) {
-        qWarning() << "[SERVER] User search failed for term '" << searchTerm 
-                   << "':" << query.lastError().text();
-        
-        // Отправляем пустой результат при ошибке БД
-        QJsonObject errorResponse;
-        errorResponse["type"] = "search_results";
-        errorResponse["users"] = QJsonArray();
-        sendJson(socket, errorResponse);
-        return;
+    // Сборка результата общая для обоих путей поиска.
+    auto collectResults = [&usersFound](QSqlQuery &query) {
+        while (query.next()) {
+            QJsonObject userObject;
+            userObject["username"] = query.value("username").toString();
+            userObject["displayname"] = query.value("display_name").toString();
+            // Можно добавить дополнительные поля: avatar_url, status_message, last_seen
+
+            usersFound.append(userObject);
+        }
+    };
+
+    if (m_userSearchFts) {
+        const QStringList tokens = searchTerm.split(
+            QRegularExpression(QStringLiteral("[^\\p{L}\\p{N}]+")), Qt::SkipEmptyParts);
+
+        QStringList prefixQueries;
+        prefixQueries.reserve(tokens.size());
+        for (const QString &token : tokens) {
+            prefixQueries.append(QLatin1Char('"') + QString(token).replace('"', "\"\"")
+                                 + QStringLiteral("\"*"));
+        }
+
+        if (!prefixQueries.isEmpty()) {
+            QSqlQuery &ftsQuery = StatementCache::get(
+                "SELECT u.username, u.display_name "
+                "FROM users_fts f JOIN users u ON u.id = f.rowid "
+                "WHERE users_fts MATCH :match AND u.username != :currentUser "
+                "ORDER BY rank LIMIT " + QString::number(SearchResultLimit));
+            ftsQuery.bindValue(":match", prefixQueries.join(QLatin1Char(' ')));
+            ftsQuery.bindValue(":currentUser", currentUser);
+
+            executed = ftsQuery.exec();
+            if (executed) {
+                collectResults(ftsQuery);
+            } else {
+                qWarning() << "[SERVER] FTS user search failed for term '" << searchTerm
+                           << "':" << ftsQuery.lastError().text();
+                reportSubsystemFailure(QStringLiteral("search"),
+                                       CircuitBreaker::classifySqlError(ftsQuery.lastError()));
+            }
+        }
     }
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 4. Формирование JSON-массива с результатами
+    // 3. Fallback: LIKE-скан при сборке без FTS5 или вводе без единого токена
     // ═══════════════════════════════════════════════════════════════════════
-    QJsonArray usersFound;
-    
-    while (query.next()) {
-        QJsonObject userObject;
-        userObject["username"] = query.value("username").toString();
-        userObject["displayname"] = query.value("display_name").toString();
-        // Можно добавить дополнительные поля: avatar_url, status_message, last_seen
-        
-        usersFound.append(userObject);
+    // '%term%' находит подстроку в любой позиции — путь тот же, что и раньше.
+    if (!executed) {
+        QSqlQuery query;
+        query.prepare("SELECT username, display_name FROM users "
+                      "WHERE (username LIKE :term OR display_name LIKE :term) "
+                      "AND username != :currentUser "
+                      "LIMIT " + QString::number(SearchResultLimit));
+        query.bindValue(":term", "%" + searchTerm + "%");
+        query.bindValue(":currentUser", currentUser); // Исключаем себя из результатов
+
+        if (!query.exec()) {
+            qWarning() << "[SERVER] User search failed for term '" << searchTerm
+                       << "':" << query.lastError().text();
+            reportSubsystemFailure(QStringLiteral("search"),
+                                   CircuitBreaker::classifySqlError(query.lastError()));
+
+            // Отправляем пустой результат при ошибке БД
+            QJsonObject errorResponse;
+            errorResponse["type"] = "search_results";
+            errorResponse["users"] = QJsonArray();
+            errorResponse["gen"] = generation;
+            errorResponse["first"] = true;
+            errorResponse["done"] = true;
+            sendJson(socket, errorResponse);
+            return;
+        }
+
+        // ═══════════════════════════════════════════════════════════════════
+        // 4. Формирование JSON-массива с результатами
+        // ═══════════════════════════════════════════════════════════════════
+        collectResults(query);
     }
 
-    qDebug() << "[SERVER] Found" << usersFound.count() 
+    qDebug() << "[SERVER] Found" << usersFound.count()
              << "user(s) matching term '" << searchTerm << "'";
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 5. Отправка результатов клиенту
+    // 5. Потоковая отправка результатов клиенту
     // ═══════════════════════════════════════════════════════════════════════
+    // Первый чанк (верх ранжирования) уходит немедленно — popup рендерит его,
+    // пока хвост еще в пути. Остальные чанки ставятся в очередь событий по
+    // одному: новый поиск того же сокета успевает перезаписать поколение
+    // между ними, и устаревшие чанки отменяются, не занимая ни канал, ни
+    // клиентский рендер.
+    const int total = usersFound.size();
+
+    QJsonArray firstChunk;
+    for (int i = 0; i < qMin(total, SearchChunkSize); ++i) {
+        firstChunk.append(usersFound.at(i));
+    }
+
     QJsonObject response;
     response["type"] = "search_results";
-    response["users"] = usersFound;
-    
+    response["users"] = firstChunk;
+    response["gen"] = generation;
+    response["first"] = true;
+    response["done"] = total <= SearchChunkSize;
+
     sendJson(socket, response);
+
+    QPointer<QObject> socketGuard(socket);
+    for (int offset = SearchChunkSize; offset < total; offset += SearchChunkSize) {
+        QJsonArray chunk;
+        for (int i = offset; i < qMin(offset + SearchChunkSize, total); ++i) {
+            chunk.append(usersFound.at(i));
+        }
+        const bool done = offset + SearchChunkSize >= total;
+
+        QMetaObject::invokeMethod(this, [this, socketGuard, chunk, generation, done]() {
+            if (!socketGuard) return;
+            if (m_searchGenerations.value(socketGuard.data(), -1) != generation) {
+                return; // Клиент продолжил печатать — чанк устарел
+            }
+
+            QJsonObject part;
+            part["type"] = "search_results";
+            part["users"] = chunk;
+            part["gen"] = generation;
+            part["first"] = false;
+            part["done"] = done;
+            sendJson(socketGuard.data(), part);
+        }, Qt::QueuedConnection);
+    }
 }
 
 
@@ -1976,8 +5677,169 @@ void Server::handleSearchUsers(QObject* socket, const QJsonObject& request)
  * @param socket Сокет клиента, которому нужно отправить список контактов.
  * @param username Username пользователя, для которого формируется список.
  */
-void Server::sendContactList(QObject* socket, const QString& username)
+void Server::recordContactDelta(const QString& owner, const QString& contact,
+                                bool removed)
+{
+    // Глубина журнала дельт: версия старше отката получает полный список.
+    static constexpr int DeltaLogDepth = 512;
+
+    QSqlQuery bump;
+    bump.prepare("UPDATE contact_revs SET rev = rev + 1 WHERE username = :owner");
+    bump.bindValue(":owner", owner);
+    if (!bump.exec()) {
+        qWarning() << "[DB] Failed to bump contact rev for" << owner
+                   << ":" << bump.lastError().text();
+        return;
+    }
+
+    if (bump.numRowsAffected() == 0) {
+        QSqlQuery seed;
+        seed.prepare("INSERT INTO contact_revs (username, rev) VALUES (:owner, 1)");
+        seed.bindValue(":owner", owner);
+        if (!seed.exec()) {
+            qWarning() << "[DB] Failed to seed contact rev for" << owner
+                       << ":" << seed.lastError().text();
+            return;
+        }
+    }
+
+    QSqlQuery revQuery;
+    revQuery.prepare("SELECT rev FROM contact_revs WHERE username = :owner");
+    revQuery.bindValue(":owner", owner);
+    if (!revQuery.exec() || !revQuery.next()) {
+        qWarning() << "[DB] Failed to read contact rev for" << owner;
+        return;
+    }
+    const qint64 rev = revQuery.value(0).toLongLong();
+
+    QSqlQuery delta;
+    delta.prepare("INSERT OR REPLACE INTO contact_deltas (username, rev, op, contact) "
+                  "VALUES (:owner, :rev, :op, :contact)");
+    delta.bindValue(":owner", owner);
+    delta.bindValue(":rev", rev);
+    delta.bindValue(":op", removed ? QStringLiteral("remove") : QStringLiteral("upsert"));
+    delta.bindValue(":contact", contact);
+    if (!delta.exec()) {
+        qWarning() << "[DB] Failed to record contact delta for" << owner
+                   << ":" << delta.lastError().text();
+        return;
+    }
+
+    // Усечение журнала: дельты старше окна не нужны — sendContactList
+    // по недостающему покрытию откатится на полный список.
+    QSqlQuery prune;
+    prune.prepare("DELETE FROM contact_deltas WHERE username = :owner AND rev <= :floor");
+    prune.bindValue(":owner", owner);
+    prune.bindValue(":floor", rev - DeltaLogDepth);
+    prune.exec();
+
+    qDebug() << "[SERVER] Contact list of" << owner << "advanced to rev" << rev
+             << (removed ? "(remove" : "(upsert") << contact << ")";
+}
+
+
+void Server::sendContactList(QObject* socket, const QString& username, qint64 clientRev)
 {
+    // ═══════════════════════════════════════════════════════════════════════
+    // 0. Дельта-синхронизация по версии клиента
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Клиент кэширует список контактов локально и предъявляет при входе
+     * последнюю известную ему версию (contacts_rev). Если версия совпадает
+     * с текущей — уходит пустая дельта; если отстает в пределах журнала
+     * contact_deltas — только изменившиеся записи. Полный список остается
+     * запасным путем: новый клиент, чужая база или версия старше журнала.
+     */
+    qint64 currentRev = 0;
+    {
+        QSqlQuery revQuery;
+        revQuery.prepare("SELECT rev FROM contact_revs WHERE username = :username");
+        revQuery.bindValue(":username", username);
+        if (revQuery.exec() && revQuery.next()) {
+            currentRev = revQuery.value(0).toLongLong();
+        }
+    }
+
+    if (clientRev >= 0 && clientRev <= currentRev) {
+        QJsonObject deltaResponse;
+        deltaResponse["type"] = "contact_list";
+        deltaResponse["delta"] = true;
+        deltaResponse["rev"] = static_cast<double>(currentRev);
+
+        if (clientRev == currentRev) {
+            // Список не менялся — клиент остается на своем кэше.
+            deltaResponse["upserts"] = QJsonArray();
+            deltaResponse["removed"] = QJsonArray();
+            sendJson(socket, deltaResponse);
+            qDebug() << "[SERVER] Contact list of" << username
+                     << "unchanged at rev" << currentRev;
+            return;
+        }
+
+        QSqlQuery deltaQuery;
+        deltaQuery.prepare("SELECT rev, op, contact FROM contact_deltas "
+                           "WHERE username = :username AND rev > :clientRev "
+                           "ORDER BY rev");
+        deltaQuery.bindValue(":username", username);
+        deltaQuery.bindValue(":clientRev", clientRev);
+
+        if (deltaQuery.exec()) {
+            // Поздняя операция по контакту побеждает раннюю: дельты
+            // сворачиваются в одно состояние на контакт.
+            QHash<QString, bool> folded; // contact -> removed
+            qint64 covered = 0;
+            while (deltaQuery.next()) {
+                ++covered;
+                folded.insert(deltaQuery.value(2).toString(),
+                              deltaQuery.value(1).toString() == QLatin1String("remove"));
+            }
+
+            // Покрытие полное, когда журнал содержит все версии между
+            // клиентской и текущей (по строке на версию, без усечений).
+            if (covered == currentRev - clientRev) {
+                QJsonArray upserts;
+                QJsonArray removed;
+
+                QSqlQuery contactQuery;
+                contactQuery.prepare(
+                    "SELECT username, display_name, last_seen, status_message, avatar_url "
+                    "FROM users WHERE username = :contact");
+
+                for (auto it = folded.constBegin(); it != folded.constEnd(); ++it) {
+                    if (it.value()) {
+                        removed.append(it.key());
+                        continue;
+                    }
+                    contactQuery.bindValue(":contact", it.key());
+                    if (contactQuery.exec() && contactQuery.next()) {
+                        QJsonObject userObject;
+                        userObject["username"] = contactQuery.value(0).toString();
+                        userObject["displayname"] = contactQuery.value(1).toString();
+                        // Несброшенная отметка из памяти свежее значения в БД
+                        const auto pendingIt = m_pendingLastSeen.constFind(it.key());
+                        userObject["last_seen"] = pendingIt != m_pendingLastSeen.constEnd()
+                                                      ? pendingIt.value()
+                                                      : contactQuery.value(2).toString();
+                        userObject["statusmessage"] = contactQuery.value(3).toString();
+                        userObject["avatar_url"] = contactQuery.value(4).toString();
+                        upserts.append(userObject);
+                    }
+                }
+
+                deltaResponse["upserts"] = upserts;
+                deltaResponse["removed"] = removed;
+                sendJson(socket, deltaResponse);
+                qDebug() << "[SERVER] Contact delta for" << username << ": rev"
+                         << clientRev << "->" << currentRev << "," << upserts.count()
+                         << "upsert(s)," << removed.count() << "removal(s)";
+                return;
+            }
+
+            qDebug() << "[SERVER] Contact delta log does not cover rev" << clientRev
+                     << "for" << username << "- falling back to full list";
+        }
+    }
+
     // ═══════════════════════════════════════════════════════════════════════
     // 1. Получение внутреннего ID пользователя
     // ═══════════════════════════════════════════════════════════════════════
@@ -2013,13 +5875,18 @@ void Server::sendContactList(QObject* socket, const QString& username)
      * - Таблица contacts хранит пары (user_id_1, user_id_2), где всегда user_id_1 < user_id_2.
      * - Для пользователя с userId нужно найти все записи, где он упоминается:
      *   либо в user_id_1, либо в user_id_2.
-     * - Затем извлечь данные "другой стороны" этой связи.
+     * - Затем извлечь имя "другой стороны" этой связи.
      * - Условие `u.id != :userId` гарантирует, что мы не получим самого себя.
      * - Фильтр `c.status = 1` отбирает только подтверждённые контакты.
+     *
+     * Полный список облегченный: на критическом пути входа не читаются и
+     * не сериализуются детали профилей (имя для отображения, статус,
+     * аватар, последний визит) — клиент дозапрашивает их пачками
+     * get_profiles по мере отрисовки строк списка.
      */
     QSqlQuery query;
     query.prepare(
-        "SELECT u.username, u.display_name, u.last_seen, u.status_message, u.avatar_url "
+        "SELECT u.username "
         "FROM users u "
         "JOIN contacts c ON (u.id = c.user_id_1 OR u.id = c.user_id_2) "
         "WHERE (c.user_id_1 = :userId OR c.user_id_2 = :userId) "
@@ -2048,11 +5915,6 @@ void Server::sendContactList(QObject* socket, const QString& username)
     while (query.next()) {
         QJsonObject userObject;
         userObject["username"] = query.value("username").toString();
-        userObject["displayname"] = query.value("display_name").toString();
-        userObject["last_seen"] = query.value("last_seen").toString();
-        userObject["statusmessage"] = query.value("status_message").toString();
-        userObject["avatar_url"] = query.value("avatar_url").toString();
-        
         contactsArray.append(userObject);
     }
 
@@ -2064,11 +5926,84 @@ void Server::sendContactList(QObject* socket, const QString& username)
     QJsonObject message;
     message["type"] = "contact_list";
     message["users"] = contactsArray;
-    
+    message["lite"] = true; // Только имена: детали профилей — через get_profiles
+    message["rev"] = static_cast<double>(currentRev); // Клиент запомнит для дельта-синхронизации
+
     sendJson(socket, message);
 }
 
 
+/**
+ * @brief Пакетная выдача профилей по списку имен.
+ *
+ * @details Полный список контактов при входе уходит облегченным (только
+ * имена — см. sendContactList): детали профиля клиент дозапрашивает этим
+ * запросом по мере того, как строки попадают в видимую область списка.
+ * Пачка ограничена ProfileBatchLimit — защитный потолок против запроса
+ * "все сразу" одним сообщением.
+ *
+ * Формат запроса: {"type": "get_profiles", "users": ["alice", ...]}
+ * Формат ответа:  {"type": "profiles", "users": [{username, displayname,
+ *                  last_seen, statusmessage, avatar_url}, ...]}
+ */
+void Server::handleGetProfiles(QObject* socket, const QJsonObject& request)
+{
+    const QString requester = m_sessions.usernameOf(socket);
+    if (requester.isEmpty()) {
+        return; // Профили доступны только авторизованным
+    }
+
+    const QJsonArray requested = request.value("users").toArray();
+
+    QSqlQuery query;
+    query.prepare(
+        "SELECT username, display_name, last_seen, status_message, avatar_url "
+        "FROM users WHERE username = :username");
+
+    QJsonArray profiles;
+    for (const QJsonValue& val : requested) {
+        if (profiles.count() >= ProfileBatchLimit) {
+            qWarning() << "[SERVER] get_profiles batch from" << requester
+                       << "truncated to" << ProfileBatchLimit << "name(s)";
+            break;
+        }
+
+        const QString contact = val.toString();
+        if (contact.isEmpty()) {
+            continue;
+        }
+
+        query.bindValue(":username", contact);
+        if (!query.exec()) {
+            qWarning() << "[SERVER] get_profiles lookup failed for" << contact
+                       << ":" << query.lastError().text();
+            reportSubsystemFailure(QStringLiteral("avatars"),
+                                   CircuitBreaker::classifySqlError(query.lastError()));
+            break; // Остальная пачка упрется в тот же отказ
+        }
+        if (query.next()) {
+            QJsonObject userObject;
+            userObject["username"] = query.value(0).toString();
+            userObject["displayname"] = query.value(1).toString();
+            // Несброшенная отметка из памяти свежее значения в БД
+            const auto pendingIt = m_pendingLastSeen.constFind(contact);
+            userObject["last_seen"] = pendingIt != m_pendingLastSeen.constEnd()
+                                          ? pendingIt.value()
+                                          : query.value(2).toString();
+            userObject["statusmessage"] = query.value(3).toString();
+            userObject["avatar_url"] = query.value(4).toString();
+            profiles.append(userObject);
+        }
+    }
+
+    QJsonObject response;
+    response["type"] = "profiles";
+    response["users"] = profiles;
+    sendJson(socket, response);
+    qDebug() << "[SERVER] Sent" << profiles.count() << "profile(s) to" << requester;
+}
+
+
 /**
  * @brief Обрабатывает запрос на добавление пользователя в контакты (Friend Request).
  *
@@ -2131,7 +6066,7 @@ void Server::handleAddContactRequest(QObject* socket, const QJsonObject& request
     // ═══════════════════════════════════════════════════════════════════════
     // 1. Идентификация инициатора и получателя
     // ═══════════════════════════════════════════════════════════════════════
-    QString fromUsername = m_clientsReverse.value(socket);
+    QString fromUsername = m_sessions.usernameOf(socket);
     QString toUsername = request["username"].toString().trimmed();
 
     if (fromUsername.isEmpty()) {
@@ -2163,6 +6098,19 @@ void Server::handleAddContactRequest(QObject* socket, const QJsonObject& request
         return;
     }
 
+    // Проверка 3: Целевой пользователь существует — по справочнику имен.
+    // Шторм запросов к несуществующим именам гасится здесь, фильтром Блума
+    // в памяти, не превращаясь в отрицательные SELECT'ы к SQLite.
+    if (!m_userDirectory.contains(toUsername)) {
+        sendJson(socket, {
+            {"type", "add_contact_failure"},
+            {"reason", "Запрашиваемый пользователь не существует."}
+        });
+        qDebug() << "[SERVER] Contact request to unknown user" << toUsername
+                 << "rejected by directory";
+        return;
+    }
+
     // ═══════════════════════════════════════════════════════════════════════
     // 3. Получение ID и display_name обоих пользователей
     // ═══════════════════════════════════════════════════════════════════════
@@ -2259,73 +6207,333 @@ void Server::handleAddContactRequest(QObject* socket, const QJsonObject& request
             {"type", "add_contact_failure"},
             {"reason", reason}
         });
-        qDebug() << "[SERVER] Contact request rejected: existing status =" << status;
+        qDebug() << "[SERVER] Contact request rejected: existing status =" << status;
+        return;
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 6. Создание нового запроса в контакты
+    // ═══════════════════════════════════════════════════════════════════════
+    QSqlQuery insertQuery;
+    insertQuery.prepare("INSERT INTO contacts (user_id_1, user_id_2, status, creation_date) "
+                        "VALUES (:id1, :id2, 0, :date)"); // status = 0 (pending)
+    insertQuery.bindValue(":id1", userId1);
+    insertQuery.bindValue(":id2", userId2);
+    insertQuery.bindValue(":date", QDateTime::currentDateTime().toString(Qt::ISODate));
+
+    if (!insertQuery.exec()) {
+        qWarning() << "[SERVER] Failed to insert contact request:" << insertQuery.lastError().text();
+        sendJson(socket, {
+            {"type", "add_contact_failure"},
+            {"reason", "Ошибка базы данных при отправке запроса."}
+        });
+        return;
+    }
+
+    qInfo() << "[SERVER] Contact request created:" << fromUsername << "->" << toUsername;
+
+    // У получателя появился входящий запрос — его закэшированный список устарел
+    m_readCache.invalidatePendingFor(toUsername);
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 7. Отправка push-уведомления получателю (если онлайн)
+    // ═══════════════════════════════════════════════════════════════════════
+    QObject* toSocket = m_sessions.socketOf(toUsername);
+    
+    if (toSocket) {
+        QString avatarUrl = "";
+
+        // Корректный SQL-запрос: указать поля после SELECT, убрать лишнюю скобку
+        QSqlQuery query;
+        query.prepare("SELECT avatar_url FROM users WHERE username = :usernameFrom");
+        query.bindValue(":usernameFrom", fromUsername);
+
+        // Выполняем запрос
+        if (!query.exec()) {
+            qDebug() << "cannot select avatar_url";
+        } else if (query.next()) { // Переходим к первой строке результата
+            avatarUrl = query.value("avatar_url").toString();
+        } else {
+            qDebug() << "avatar_url not found for user" << fromUsername;
+        }
+
+
+        QJsonObject notification;
+        notification["type"] = "incoming_contact_request";
+        notification["fromUsername"] = fromUsername;
+        notification["fromDisplayname"] = fromDisplayName;
+        notification["fromAvatarUrl"] = avatarUrl; // передаём аватарку!
+
+        // Публичный ключ E2E инициатора: непрозрачная ретрансляция —
+        // сервер не хранит и не разбирает ключи сквозного шифрования
+        if (request.contains("e2e_key")) {
+            notification["e2e_key"] = request["e2e_key"];
+        }
+
+        sendJson(toSocket, notification);
+        qDebug() << "[SERVER] Push notification sent to" << toUsername;
+    } else {
+        qDebug() << "[SERVER] User" << toUsername << "is offline. Notification will be shown on next login.";
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 8. Отправка подтверждения инициатору
+    // ═══════════════════════════════════════════════════════════════════════
+    sendJson(socket, {
+        {"type", "add_contact_success"},
+        {"reason", "Запрос на добавление успешно отправлен пользователю " + toUsername + "."}
+    });
+}
+
+
+/**
+ * @brief Массовый импорт контактов: один запрос — одна транзакция — один ответ.
+ *
+ * @details Онбординг каталога организации через add_contact_request — это N
+ * круговых обменов, каждый со своим autocommit-INSERT и уведомлениями.
+ * Здесь весь список обрабатывается пакетом:
+ * 1. один проход валидации по справочнику имен (m_userDirectory) — дубликаты,
+ *    самодобавление и несуществующие имена отсеиваются без обращений к БД;
+ * 2. имена превращаются в ID одним SELECT ... IN (...);
+ * 3. связи вставляются одной транзакцией (один fsync на весь пакет);
+ *    уже существующие пары отсеивает UNIQUE-ограничение через
+ *    INSERT OR IGNORE, без предварительных SELECT;
+ * 4. инициатор получает один суммарный ответ и один свежий список
+ *    контактов (пакет больше глубины дельта-журнала все равно вел бы
+ *    к полному списку).
+ *
+ * Импортированные связи создаются сразу подтвержденными (status = 1):
+ * сценарий — общий каталог организации, где взаимная видимость задана
+ * политикой, а не персональным согласием. Получатели онлайн-уведомлениями
+ * не штормятся: их списки доедут дельтой (contacts_rev) при следующем входе.
+ *
+ * **Формат запроса:**
+ * ```
+ * { "type": "add_contacts_bulk", "usernames": ["alice", "bob", ...] }
+ * ```
+ *
+ * **Формат ответа:**
+ * ```
+ * { "type": "add_contacts_bulk_result",
+ *   "added": 1987, "existing": 10, "unknown": ["ghost"] }
+ * ```
+ *
+ * @param socket Сокет клиента-инициатора.
+ * @param request JSON-объект с массивом `usernames`.
+ */
+void Server::handleAddContactsBulk(QObject* socket, const QJsonObject& request)
+{
+    // Потолок одного пакета: больше — признак ошибки клиента, не каталога.
+    static constexpr int BulkContactLimit = 4096;
+
+    const QString fromUsername = m_sessions.usernameOf(socket);
+    if (fromUsername.isEmpty()) {
+        qWarning() << "[SERVER] Bulk contact import from unauthenticated socket";
+        return;
+    }
+
+    const QJsonArray usernames = request["usernames"].toArray();
+    if (usernames.isEmpty() || usernames.size() > BulkContactLimit) {
+        sendJson(socket, {
+            {"type", "add_contacts_bulk_result"},
+            {"reason", "Некорректный список пользователей."}
+        });
         return;
     }
 
+    qInfo() << "[SERVER] Bulk contact import:" << fromUsername << "->"
+            << usernames.size() << "name(s)";
+
     // ═══════════════════════════════════════════════════════════════════════
-    // 6. Создание нового запроса в контакты
+    // 1. Один проход валидации по справочнику имен
+    // ═══════════════════════════════════════════════════════════════════════
+    QSet<QString> seen;
+    QStringList candidates;
+    QJsonArray unknown;
+    for (const QJsonValue& value : usernames) {
+        const QString username = value.toString().trimmed();
+        if (username.isEmpty() || username == fromUsername) continue;
+        if (seen.contains(username)) continue;
+        seen.insert(username);
+
+        if (!m_userDirectory.contains(username)) {
+            unknown.append(username);
+            continue;
+        }
+        candidates << username;
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 2. Имена -> ID одним SELECT ... IN (...)
+    // ═══════════════════════════════════════════════════════════════════════
+    QHash<QString, qint64> ids;
+    {
+        QStringList placeholders;
+        placeholders.reserve(candidates.size() + 1);
+        for (int i = 0; i <= candidates.size(); ++i) placeholders << "?";
+
+        QSqlQuery idQuery;
+        idQuery.prepare("SELECT id, username FROM users WHERE username IN ("
+                        + placeholders.join(", ") + ")");
+        idQuery.addBindValue(fromUsername);
+        for (const QString& username : std::as_const(candidates)) {
+            idQuery.addBindValue(username);
+        }
+
+        if (!idQuery.exec()) {
+            qWarning() << "[SERVER] Bulk contact ID lookup failed:"
+                       << idQuery.lastError().text();
+            sendJson(socket, {
+                {"type", "add_contacts_bulk_result"},
+                {"reason", "Ошибка базы данных."}
+            });
+            return;
+        }
+        while (idQuery.next()) {
+            ids.insert(idQuery.value(1).toString(), idQuery.value(0).toLongLong());
+        }
+    }
+
+    const qint64 fromId = ids.value(fromUsername, -1);
+    if (fromId < 0) {
+        qWarning() << "[SERVER] Bulk contact import: initiator" << fromUsername
+                   << "not found in users table";
+        return;
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 3. Одна транзакция вставки на весь пакет
     // ═══════════════════════════════════════════════════════════════════════
+    QSqlDatabase db = QSqlDatabase::database();
+    if (!db.transaction()) {
+        qWarning() << "[SERVER] Failed to begin bulk contact transaction:"
+                   << db.lastError().text();
+    }
+
     QSqlQuery insertQuery;
-    insertQuery.prepare("INSERT INTO contacts (user_id_1, user_id_2, status, creation_date) "
-                        "VALUES (:id1, :id2, 0, :date)"); // status = 0 (pending)
-    insertQuery.bindValue(":id1", userId1);
-    insertQuery.bindValue(":id2", userId2);
-    insertQuery.bindValue(":date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    insertQuery.prepare("INSERT OR IGNORE INTO contacts (user_id_1, user_id_2, status, creation_date) "
+                        "VALUES (:id1, :id2, 1, :date)"); // status = 1 (accepted)
+    const QString creationDate = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    int added = 0;
+    int existing = 0;
+    for (const QString& username : std::as_const(candidates)) {
+        const qint64 toId = ids.value(username, -1);
+        if (toId < 0) {
+            // Справочник знал имя, а таблица users — нет (рассинхрон): в отчет.
+            unknown.append(username);
+            continue;
+        }
 
-    if (!insertQuery.exec()) {
-        qWarning() << "[SERVER] Failed to insert contact request:" << insertQuery.lastError().text();
+        insertQuery.bindValue(":id1", std::min(fromId, toId));
+        insertQuery.bindValue(":id2", std::max(fromId, toId));
+        insertQuery.bindValue(":date", creationDate);
+
+        if (!insertQuery.exec()) {
+            qWarning() << "[SERVER] Bulk contact insert failed:"
+                       << insertQuery.lastError().text();
+            db.rollback();
+            sendJson(socket, {
+                {"type", "add_contacts_bulk_result"},
+                {"reason", "Ошибка базы данных при импорте."}
+            });
+            return;
+        }
+
+        if (insertQuery.numRowsAffected() > 0) {
+            ++added;
+            // Журналы дельт обеих сторон — в той же транзакции.
+            recordContactDelta(fromUsername, username, false);
+            recordContactDelta(username, fromUsername, false);
+        } else {
+            ++existing; // Пара уже связана (любой статус) — пропускаем молча
+        }
+    }
+
+    if (!db.commit()) {
+        qWarning() << "[SERVER] Bulk contact commit failed:" << db.lastError().text();
+        db.rollback();
         sendJson(socket, {
-            {"type", "add_contact_failure"},
-            {"reason", "Ошибка базы данных при отправке запроса."}
+            {"type", "add_contacts_bulk_result"},
+            {"reason", "Ошибка базы данных при импорте."}
         });
         return;
     }
 
-    qInfo() << "[SERVER] Contact request created:" << fromUsername << "->" << toUsername;
+    qInfo() << "[SERVER] Bulk contact import done for" << fromUsername << ":"
+            << added << "added," << existing << "existing," << unknown.size()
+            << "unknown";
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 7. Отправка push-уведомления получателю (если онлайн)
+    // 4. Один суммарный ответ и один свежий список контактов
     // ═══════════════════════════════════════════════════════════════════════
-    QObject* toSocket = m_clients.value(toUsername, nullptr);
-    
-    if (toSocket) {
-        QString avatarUrl = "";
+    QJsonObject response;
+    response["type"] = "add_contacts_bulk_result";
+    response["added"] = added;
+    response["existing"] = existing;
+    response["unknown"] = unknown;
+    sendJson(socket, response);
 
-        // Корректный SQL-запрос: указать поля после SELECT, убрать лишнюю скобку
-        QSqlQuery query;
-        query.prepare("SELECT avatar_url FROM users WHERE username = :usernameFrom");
-        query.bindValue(":usernameFrom", fromUsername);
+    if (added > 0) {
+        sendContactList(socket, fromUsername, -1);
+    }
+}
 
-        // Выполняем запрос
-        if (!query.exec()) {
-            qDebug() << "cannot select avatar_url";
-        } else if (query.next()) { // Переходим к первой строке результата
-            avatarUrl = query.value("avatar_url").toString();
-        } else {
-            qDebug() << "avatar_url not found for user" << fromUsername;
-        }
 
+/**
+ * @brief Пытается занять слот KDF-задачи для указанного IP.
+ *
+ * @details Argon2 работает сотни миллисекунд по дизайну, поэтому число
+ * одновременных вычислений ограничено: общий потолок защищает пул
+ * хеширования от переполнения очереди, пер-IP потолок не дает одному
+ * источнику (credential stuffing) вытеснить честные входы. Отказ стоит
+ * ноль вычислений — клиент получает немедленный "server busy".
+ */
+bool Server::tryAcquireKdfSlot(const QString& peerIp)
+{
+    if (m_pendingKdf >= MaxPendingKdf
+        || (!peerIp.isEmpty() && m_kdfPerIp.value(peerIp) >= MaxKdfPerIp)) {
+        ++m_kdfRejected;
+        qWarning() << "[SERVER] Auth KDF rejected (pending:" << m_pendingKdf
+                   << "ip:" << peerIp << "rejected total:" << m_kdfRejected << ")";
+        return false;
+    }
+
+    ++m_pendingKdf;
+    if (!peerIp.isEmpty()) {
+        ++m_kdfPerIp[peerIp];
+    }
+    return true;
+}
 
-        QJsonObject notification;
-        notification["type"] = "incoming_contact_request";
-        notification["fromUsername"] = fromUsername;
-        notification["fromDisplayname"] = fromDisplayName;
-        notification["fromAvatarUrl"] = avatarUrl; // передаём аватарку!
-        
-        sendJson(toSocket, notification);
-        qDebug() << "[SERVER] Push notification sent to" << toUsername;
-    } else {
-        qDebug() << "[SERVER] User" << toUsername << "is offline. Notification will be shown on next login.";
+
+/**
+ * @brief Освобождает слот KDF-задачи (вызывается в основном потоке).
+ */
+void Server::releaseKdfSlot(const QString& peerIp)
+{
+    --m_pendingKdf;
+
+    if (peerIp.isEmpty()) return;
+    auto it = m_kdfPerIp.find(peerIp);
+    if (it != m_kdfPerIp.end() && --it.value() <= 0) {
+        m_kdfPerIp.erase(it); // Не копим мертвые IP в карте
     }
+}
 
-    // ═══════════════════════════════════════════════════════════════════════
-    // 8. Отправка подтверждения инициатору
-    // ═══════════════════════════════════════════════════════════════════════
-    sendJson(socket, {
-        {"type", "add_contact_success"},
-        {"reason", "Запрос на добавление успешно отправлен пользователю " + toUsername + "."}
-    });
+
+/**
+ * @brief IP-адрес клиента по объекту сокета (TCP или WebSocket).
+ */
+QString Server::peerIpOf(QObject* socket)
+{
+    if (auto *tcp = qobject_cast<QAbstractSocket*>(socket)) {
+        return tcp->peerAddress().toString();
+    }
+    if (auto *ws = qobject_cast<QWebSocket*>(socket)) {
+        return ws->peerAddress().toString();
+    }
+    return QString();
 }
 
 
@@ -2464,85 +6672,118 @@ void Server::handleLogin(QObject* socket, const QJsonObject& request)
     QByteArray saltBytes = QByteArray::fromHex(serverSalt.toLatin1());
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 7. Хеширование введённого пароля с той же солью
+    // 7. Admission control KDF-пула
     // ═══════════════════════════════════════════════════════════════════════
-    /**
-     * Критически важно: используются те же параметры (соль, NB_BLOCKS, NB_ITERATIONS),
-     * что и при регистрации. Иначе хеши не совпадут даже при правильном пароле.
-     */
-    QString computedHashString = CryptoUtils::hashPasswordArgon2(password, saltBytes);
-    
-    if (computedHashString.isEmpty()) {
+    // Argon2 дорог по дизайну; без потолков всплеск credential stuffing
+    // занял бы пул хеширования целиком и вытеснил честные входы.
+    const QString peerIp = peerIpOf(socket);
+    if (!tryAcquireKdfSlot(peerIp)) {
         response["type"] = "login_failure";
-        response["reason"] = "Server error";
+        response["reason"] = "Server is busy, please try again";
         sendJson(socket, response);
-        qCritical() << "[SERVER] Argon2 hashing failed during login for user" << username;
         return;
     }
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 8. Сравнение хешей (проверка пароля)
+    // 8. Хеширование введённого пароля с той же солью — в криптопуле
     // ═══════════════════════════════════════════════════════════════════════
-    qDebug() << "[SERVER] Computed hash:" << computedHashString;
-    qDebug() << "[SERVER] Stored hash:  " << storedHash;
-    
-    if (computedHashString == storedHash) {
-        // ====================================================================
-        // УСПЕХ: Пароль верный
-        // ====================================================================
-        qInfo() << "[SERVER] ✅ User" << username << "authenticated successfully";
-        
-        // --- 8.1. Генерация токена автологина ---
-        QString token = generateToken(username);
-        m_userTokens[username] = token; // Сохраняем в памяти для быстрой проверки
-        
-        // Сохранение токена в БД (для постоянства между перезапусками сервера)
-        QSqlQuery tokenQuery;
-        tokenQuery.prepare(R"(
-            INSERT OR REPLACE INTO tokens (username, token, expires_at)
-            VALUES (:username, :token, datetime('now', '+30 days'))
-        )");
-        tokenQuery.bindValue(":username", username);
-        tokenQuery.bindValue(":token", token);
-        
-        if (!tokenQuery.exec()) {
-            qWarning() << "[SERVER] Failed to save token to DB:" << tokenQuery.lastError().text();
+    /**
+     * Критически важно: используются те же параметры (соль, NB_BLOCKS, NB_ITERATIONS),
+     * что и при регистрации. Иначе хеши не совпадут даже при правильном пароле.
+     *
+     * KDF выполняется в m_cryptoPool (как X25519 при рукопожатии): поток
+     * событий не замирает на время хеширования, и маршрутизация сообщений
+     * не чувствует всплесков аутентификации. Результат возвращается в
+     * основной поток через очередь событий; QPointer отлавливает
+     * отключение клиента во время вычисления.
+     */
+    const qint64 contactsRev = request.contains("contacts_rev")
+                                   ? qint64(request["contacts_rev"].toDouble()) : -1;
+    QPointer<QObject> socketGuard(socket);
+
+    m_cryptoPool.start([this, socketGuard, password, saltBytes, storedHash,
+                        username, displayname, statusmessage, avatarurl,
+                        peerIp, contactsRev]() {
+        const QString computedHashString =
+            CryptoUtils::hashPasswordArgon2(password, saltBytes);
+
+        QMetaObject::invokeMethod(this, [this, socketGuard, computedHashString,
+                                         storedHash, username, displayname,
+                                         statusmessage, avatarurl, peerIp,
+                                         contactsRev]() {
+            releaseKdfSlot(peerIp);
+
+            if (socketGuard.isNull()) {
+                qDebug() << "[SERVER] Client disconnected during login KDF for" << username;
+                return;
+            }
+            QObject* socket = socketGuard.data();
+            QJsonObject response;
+
+            if (computedHashString.isEmpty()) {
+                response["type"] = "login_failure";
+                response["reason"] = "Server error";
+                sendJson(socket, response);
+                qCritical() << "[SERVER] Argon2 hashing failed during login for user" << username;
+                return;
+            }
+
+            // Сравнение хешей (проверка пароля)
+            if (computedHashString == storedHash) {
+                // ============================================================
+                // УСПЕХ: Пароль верный
+                // ============================================================
+                qInfo() << "[SERVER] ✅ User" << username << "authenticated successfully";
+
+                // --- Генерация токена автологина ---
+                // TokenStore кладет токен в кэш немедленно, а запись в БД уходит
+                // write-behind в поток DatabaseService.
+                QString token = generateToken(username);
+
+                // --- Формирование ответа ---
+                response["type"] = "login_success";
+                response["username"] = username;
+                response["displayname"] = displayname;
+                response["statusmessage"] = statusmessage;
+                response["avatar_url"] = avatarurl;
+                response["token"] = token; // Клиент сохранит для автологина
+
+                // --- Добавление в список онлайн-пользователей ---
+                m_sessions.bind(socket, username); // Привязываем имя к сессии
+
+                // --- Отправка основного ответа ---
+                sendJson(socket, response);
+
+                // --- Отправка дополнительных данных ---
+                // contacts_rev — версия локального кэша контактов клиента:
+                // совпадающая или слегка отставшая версия получает дельту.
+                sendContactList(socket, username, contactsRev);
+                sendPendingContactRequests(socket, username);   // Входящие запросы на добавление
+                sendUnreadCounts(socket, username);             // Счётчики непрочитанных сообщений
+                // Зазор обрыва мобильной сети закрывается из памяти; постраничная
+        // выдача из БД нужна, только если очередь не покрыла его целиком.
+        if (!flushOutboundQueue(socket, username)) {
+            sendOfflineMessages(socket, username);      // Потоковая выдача накопленных сообщений
         }
-        
-        // --- 8.2. Формирование ответа ---
-        response["type"] = "login_success";
-        response["username"] = username;
-        response["displayname"] = displayname;
-        response["statusmessage"] = statusmessage;
-        response["avatar_url"] = avatarurl;
-        response["token"] = token; // Клиент сохранит для автологина
-        
-        // --- 8.3. Добавление в список онлайн-пользователей ---
-        m_clients[username] = socket;         // username -> socket
-        m_clientsReverse[socket] = username;  // socket -> username
-        
-        // --- 8.4. Отправка основного ответа ---
-        sendJson(socket, response);
-        
-        // --- 8.5. Отправка дополнительных данных ---
-        sendContactList(socket, username);              // Список друзей
-        sendPendingContactRequests(socket, username);   // Входящие запросы на добавление
-        sendUnreadCounts(socket, username);             // Счётчики непрочитанных сообщений
-        
-        // --- 8.6. Оповещение всех онлайн-клиентов ---
-        broadcastUserList(); // Всем отправляем обновлённый список "кто онлайн"
-        
-    } else {
-        // ====================================================================
-        // ОШИБКА: Пароль неверный
-        // ====================================================================
-        qWarning() << "[SERVER] ❌ Login failed for" << username << ": incorrect password";
-        
-        response["type"] = "login_failure";
-        response["reason"] = "Invalid credentials"; // Generic error (не указываем, что именно пароль неверен)
-        
-        sendJson(socket, response);
-    }
+                deliverPendingGroupMessages(socket, username);  // Накопленные групповые сообщения
+
+                // --- Оповещение об изменении присутствия ---
+                sendOnlineStatusList(socket);     // Полный снимок — один раз при входе
+                broadcastPresence(username, true); // Подписчикам — только дельта
+
+            } else {
+                // ============================================================
+                // ОШИБКА: Пароль неверный
+                // ============================================================
+                qWarning() << "[SERVER] ❌ Login failed for" << username << ": incorrect password";
+
+                response["type"] = "login_failure";
+                response["reason"] = "Invalid credentials"; // Generic error (не указываем, что именно пароль неверен)
+
+                sendJson(socket, response);
+            }
+        }, Qt::QueuedConnection);
+    });
 }
 
 
@@ -2588,7 +6829,7 @@ void Server::handleLogin(QObject* socket, const QJsonObject& request)
  *   "fromUser": "alice",
  *   "toUser": "bob",
  *   "payload": "Hello, Bob!",
- *   "timestamp": "2025-11-24T14:30:00",
+ *   "timestamp": 1764000600000,
  *   "is_delivered": 0,
  *   "is_read": 0,
  *   "is_edited": 0,
@@ -2605,7 +6846,7 @@ void Server::handleLogin(QObject* socket, const QJsonObject& request)
  *   "fromUser": "alice",
  *   "toUser": "bob",
  *   "payload": "Hello, Bob!",
- *   "timestamp": "2025-11-24T14:30:00",
+ *   "timestamp": 1764000600000,
  *   "is_delivered": 0,
  *   "is_read": 0,
  *   "is_edited": 0
@@ -2627,6 +6868,10 @@ void Server::handlePrivateMessage(QObject* socket, const QJsonObject& request)
     // ═══════════════════════════════════════════════════════════════════════
     QString fromUser = request["fromUser"].toString();
     QString toUser = request["toUser"].toString();
+    // Инвариант быстрого пути: payload — непрозрачная строка. Сервер ее
+    // не разбирает, не индексирует и не пережимает, поэтому сквозное
+    // шифрование (префикс "e2e1:" у клиента) проходит здесь без единой
+    // лишней операции — двойной криптоработы на маршрутизации нет.
     QString payload = request["payload"].toString();
     qint64 replyToId = request["reply_to_id"].toVariant().toLongLong();
     QString tempId = request["temp_id"].toString();
@@ -2634,10 +6879,15 @@ void Server::handlePrivateMessage(QObject* socket, const QJsonObject& request)
     QString fileName = request.contains("file_name") ? request.value("file_name").toString() : "";
     QString fileUrl = request.contains("file_url") ? request.value("file_url").toString() : "";
 
+    // Метка приема для сквозной трассировки (см. раздел 3.1): фиксируется
+    // до любой работы обработчика, только если клиент прислал trace_id.
+    const bool traced = request.contains("trace_id");
+    const qint64 traceReceivedMs = traced ? QDateTime::currentMSecsSinceEpoch() : 0;
 
-    
-    // Генерируем серверную временную метку (единый источник правды для времени)
-    QString timestamp = QDateTime::currentDateTime().toString(Qt::ISODate);
+    // Генерируем серверную временную метку (единый источник правды для времени).
+    // Миллисекунды эпохи: клиент сортирует и сравнивает метки как int64,
+    // форматирование в текст выполняется только при отрисовке.
+    const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
 
     qDebug() << "[SERVER] Private message:" << fromUser << "->" << toUser 
              << "(temp_id:" << tempId << ")";
@@ -2650,7 +6900,7 @@ void Server::handlePrivateMessage(QObject* socket, const QJsonObject& request)
      * от имени другого пользователя. Сравниваем fromUser с username, привязанным
      * к сокету при аутентификации.
      */
-    QString authenticatedUser = m_clientsReverse.value(socket);
+    QString authenticatedUser = m_sessions.usernameOf(socket);
     
     if (fromUser != authenticatedUser) {
         qCritical() << "[SERVER] 🚨 SECURITY WARNING: User" << authenticatedUser
@@ -2665,51 +6915,50 @@ void Server::handlePrivateMessage(QObject* socket, const QJsonObject& request)
     }
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 3. Сохранение сообщения в базу данных
+    // 3. Присвоение ID и немедленный ack
     // ═══════════════════════════════════════════════════════════════════════
-    QSqlQuery query;
-    query.prepare("INSERT INTO messages (fromUser, toUser, payload, timestamp, file_id, file_name, file_url,  reply_to_id) "
-                  "VALUES (:fromUser, :toUser, :payload, :timestamp,:fileId, :fileName, :fileUrl, :reply_to_id)");
-    query.bindValue(":fromUser", fromUser);
-    query.bindValue(":toUser", toUser);
-    query.bindValue(":payload", payload);
-    query.bindValue(":timestamp", timestamp);
-    query.bindValue(":fileId", fileId);
-    query.bindValue(":fileName", fileName);
-    query.bindValue(":fileUrl", fileUrl);
-    
-    // Обрабатываем reply_to_id: если 0, сохраняем NULL в БД
-    query.bindValue(":reply_to_id", (replyToId > 0) ? QVariant(replyToId) : QVariant());
+    /**
+     * Окончательный ID присваивает сервер (MessageIdGenerator), а не SQLite:
+     * echo-ответ отправителю и пересылка получателю уходят сразу, не дожидаясь
+     * COMMIT пакетного писателя. БД убрана с критического пути задержки —
+     * запись выполняет write-behind журнал (раздел 4).
+     */
+    const qint64 messageId = m_messageIds.nextId();
 
-    if (!query.exec()) {
-        qCritical() << "[SERVER] Failed to save message to DB:" << query.lastError().text();
-        
-        // Отправляем отправителю уведомление об ошибке
-        QJsonObject errorResponse;
-        errorResponse["type"] = "message_send_failed";
-        errorResponse["temp_id"] = tempId;
-        errorResponse["reason"] = "Database error";
-        sendJson(socket, errorResponse);
-        return;
-    }
+    /**
+     * Штамп порядка внутри диалога (ChatSequencer): атомарный инкремент
+     * счетчика пары. Глобальный ID выдается в порядке обработки потоком —
+     * при многопоточной маршрутизации этого недостаточно; читатели
+     * упорядочивают сообщения по кортежу (chat_seq, id).
+     */
+    const qint64 chatSeq = m_chatSequencer.next(fromUser, toUser);
+    qInfo() << "[SERVER] Message accepted with ID:" << messageId;
+
+    // Кэш авторизации edit/delete: редактируют почти всегда свежее
+    // сообщение — его участники теперь известны без SELECT.
+    rememberOwnership(messageId, fromUser, toUser);
 
-    // ═══════════════════════════════════════════════════════════════════════
-    // 4. Получение глобального ID сообщения
-    // ═══════════════════════════════════════════════════════════════════════
     /**
-     * База данных автоматически присвоила сообщению уникальный ID.
-     * Этот ID используется для:
-     * - Идентификации сообщения в истории чата.
-     * - Отслеживания статусов доставки/прочтения.
-     * - Цитирования (reply_to_id).
+     * Сообщение принято со статусом is_read = 0 — инкрементируем
+     * материализованный счетчик непрочитанных. Счетчик ведется и для
+     * онлайн-получателя: он тоже может не прочитать сообщение до
+     * переподключения, и значения должны совпадать с COUNT(*) WHERE is_read = 0.
      */
-    quint64 messageId = query.lastInsertId().toULongLong();
-    
-    qInfo() << "[SERVER] Message saved with ID:" << messageId;
+    m_dbService->post([fromUser, toUser](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &bump = StatementCache::get(db,
+            "INSERT INTO unread_counts (toUser, fromUser, unread) "
+            "VALUES (:toUser, :fromUser, 1) "
+            "ON CONFLICT(toUser, fromUser) DO UPDATE SET unread = unread + 1");
+        bump.bindValue(":toUser", toUser);
+        bump.bindValue(":fromUser", fromUser);
+
+        if (!bump.exec()) {
+            qWarning() << "[DB] Failed to bump unread counter for" << toUser
+                       << "<-" << fromUser << ":" << bump.lastError().text();
+        }
+        return QVariant();
+    });
 
-    // ═══════════════════════════════════════════════════════════════════════
-    // 5. Формирование и отправка Echo-ответа отправителю
-    // ═══════════════════════════════════════════════════════════════════════
     /**
      * Echo-ответ позволяет отправителю:
      * 1. Узнать глобальный ID своего сообщения.
@@ -2722,48 +6971,421 @@ void Server::handlePrivateMessage(QObject* socket, const QJsonObject& request)
     echoMessage["fromUser"] = fromUser;
     echoMessage["toUser"] = toUser;
     echoMessage["payload"] = payload;
-    echoMessage["timestamp"] = timestamp;
+    echoMessage["timestamp"] = static_cast<double>(timestamp);
     echoMessage["is_delivered"] = 0; // Ещё не доставлено
     echoMessage["is_read"] = 0;
     echoMessage["is_edited"] = 0;
     echoMessage["file_id"] = fileId;
     echoMessage["file_name"] = fileName;
     echoMessage["file_url"] = fileUrl;
-    
+    echoMessage["chat_seq"] = static_cast<double>(chatSeq);
+
     if (replyToId > 0) {
         echoMessage["reply_to_id"] = static_cast<double>(replyToId);
     }
-    
-    echoMessage["temp_id"] = tempId; // Критически важно для сопоставления на клиенте
 
+    echoMessage["temp_id"] = tempId; // Критически важно для сопоставления на клиенте
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 3.1. Сквозная трассировка задержки
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Если клиент проставил trace_id (MESSENGER_TRACE у NetworkService),
+     * серверные метки времени едут обратно отправителю в echo и дальше
+     * получателю в доставке: по ним видно, где сообщение провело время —
+     * в сети, в очереди сервера или в маршрутизации. Метки добавляются
+     * на отдельные копии, чтобы кэш последних сообщений и журнал остались
+     * без служебных полей (их форма должна совпадать со строками истории).
+     */
+    auto withTrace = [&](QJsonObject message, bool routed) {
+        message["trace_id"] = request["trace_id"];
+        message["trace_sent_ms"] = request["trace_sent_ms"];
+        message["srv_received_ms"] = static_cast<double>(traceReceivedMs);
+        if (routed) {
+            message["srv_routed_ms"] =
+                static_cast<double>(QDateTime::currentMSecsSinceEpoch());
+        }
+        return message;
+    };
+
+    sendJson(socket, traced ? withTrace(echoMessage, false) : echoMessage);
+
+    // Удаляем temp_id, так как он не нужен получателю (это внутренний ID отправителя)
+    echoMessage.remove("temp_id");
+
+    // Write-through в кэш последних сообщений: форма записи должна
+    // совпадать со строками history_data, где reply_to_id есть всегда.
+    QJsonObject cachedMessage = echoMessage;
+    if (!cachedMessage.contains("reply_to_id")) {
+        cachedMessage["reply_to_id"] = 0.0;
+    }
+    m_recentMessages.append(fromUser, toUser, cachedMessage);
+
+    // Ищем сокет получателя в списке онлайн-клиентов
+    QObject* toUserSocket = m_sessions.socketOf(toUser);
+
+    if (toUserSocket) {
+        // Получатель онлайн — немедленная доставка
+        sendJson(toUserSocket, traced ? withTrace(echoMessage, true) : echoMessage);
+        qDebug() << "[SERVER] Message" << messageId << "delivered to online user" << toUser;
+    } else if (m_shardBus->enabled() && !m_shardBus->isLocal(toUser)) {
+        // Получатель живет на другом узле кластера: его сессии в нашем
+        // реестре нет в принципе. Пересылаем доставку узлу-владельцу —
+        // тот вручит сообщение, если получатель онлайн у него.
+        QJsonObject envelope;
+        envelope["kind"] = "route";
+        envelope["payload"] = echoMessage;
+        m_shardBus->send(m_shardBus->shardOf(toUser), envelope);
+        qDebug() << "[SERVER] Message" << messageId << "forwarded to shard"
+                 << m_shardBus->shardOf(toUser) << "for" << toUser;
+    } else if (m_outboundQueue.tryEnqueue(toUser, echoMessage,
+                                          QDateTime::currentMSecsSinceEpoch())) {
+        // Получатель отключился только что (обрыв мобильной сети): копия
+        // удержана в памяти и вручится мгновенно на переподключении,
+        // без постраничной выдачи из БД. Строка персистится журналом ниже.
+        qDebug() << "[SERVER] User" << toUser << "recently disconnected. Message"
+                 << messageId << "held in the grace-window queue.";
+    } else {
+        // Получатель офлайн — сообщение будет загружено через
+        // handleGetHistory при следующем входе получателя
+        qDebug() << "[SERVER] User" << toUser << "is offline. Message" << messageId
+                 << "stored for later delivery.";
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 4. Постановка сообщения в write-behind журнал
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Коллбэк журнала теперь только уведомляет об ошибке фиксации: в норме
+     * он молчит (ack уже отправлен). При ошибке компенсируем побочные
+     * эффекты немедленного ack'а — кэш и счетчик непрочитанных не должны
+     * ссылаться на строку, которой в БД нет.
+     */
+    QPointer<QObject> socketGuard(socket);
+
+    MessageJournal::PendingMessage msg;
+    msg.id = messageId;
+    msg.fromUser = fromUser;
+    msg.toUser = toUser;
+    msg.payload = payload;
+    msg.timestamp = timestamp;
+    msg.fileId = fileId;
+    msg.fileName = fileName;
+    msg.fileUrl = fileUrl;
+    msg.replyToId = replyToId;
+    msg.chatSeq = chatSeq;
+
+    msg.completion =
+        [this, socketGuard, fromUser, toUser, tempId, messageId](const QVariant &result) {
+            if (result.isValid()) return; // Зафиксировано — все уже отправлено.
+
+            qCritical() << "[SERVER] Message" << messageId
+                        << "was acked but failed to persist";
+
+            m_recentMessages.invalidate(fromUser, toUser);
+
+            m_dbService->post([fromUser, toUser](QSqlDatabase &db) -> QVariant {
+                QSqlQuery &revert = StatementCache::get(db,
+                    "UPDATE unread_counts SET unread = unread - 1 "
+                    "WHERE toUser = :toUser AND fromUser = :fromUser AND unread > 0");
+                revert.bindValue(":toUser", toUser);
+                revert.bindValue(":fromUser", fromUser);
+
+                if (!revert.exec()) {
+                    qWarning() << "[DB] Failed to revert unread counter for" << toUser
+                               << "<-" << fromUser << ":" << revert.lastError().text();
+                }
+                return QVariant();
+            });
+
+            // Отправляем отправителю уведомление об ошибке (если он еще онлайн)
+            if (socketGuard) {
+                QJsonObject errorResponse;
+                errorResponse["type"] = "message_send_failed";
+                errorResponse["temp_id"] = tempId;
+                errorResponse["reason"] = "Database error";
+                sendJson(socketGuard.data(), errorResponse);
+            }
+        };
+
+    m_messageJournal->append(std::move(msg));
+}
+
+
+/**
+ * @brief Создает новую группу с начальным составом участников.
+ *
+ * @details ID группы присваивается сервером синхронно (m_nextGroupId), состав
+ * сразу попадает в кэш m_groupMembers — ответ создателю и уведомление
+ * участникам не ждут писателя БД. Персистентность выполняется одной задачей
+ * писателя: строка группы плюс весь состав одним многострочным INSERT.
+ *
+ * @param socket Сокет создателя группы.
+ * @param request JSON-объект с полями:
+ *        - `name`: Название группы (1-64 символа).
+ *        - `members`: Массив username начальных участников (создатель
+ *          добавляется автоматически).
+ */
+void Server::handleCreateGroup(QObject* socket, const QJsonObject& request)
+{
+    // Предел состава: веерная рассылка линейна по участникам, а очередь
+    // офлайн-доставки — по offline-участникам на каждое сообщение.
+    static constexpr int MaxGroupMembers = 256;
+
+    const QString creator = m_sessions.usernameOf(socket);
+    if (creator.isEmpty()) {
+        qWarning() << "[SERVER] create_group from unauthenticated socket";
+        return;
+    }
+
+    const QString name = request["name"].toString().trimmed();
+    if (name.isEmpty() || name.size() > 64) {
+        sendJson(socket, QJsonObject{{"type", "error"},
+                                     {"reason", "Invalid group name"}});
+        return;
+    }
+
+    // Состав: создатель всегда участник, дубликаты схлопывает QSet.
+    QSet<QString> members;
+    members.insert(creator);
+
+    const QJsonArray requestedMembers = request["members"].toArray();
+    for (const QJsonValue &value : requestedMembers) {
+        const QString member = value.toString().trimmed();
+        if (!member.isEmpty()) {
+            members.insert(member);
+        }
+    }
+
+    if (members.size() > MaxGroupMembers) {
+        sendJson(socket, QJsonObject{{"type", "error"},
+                                     {"reason", "Group size limit exceeded"}});
+        return;
+    }
+
+    const qint64 groupId = m_nextGroupId++;
+    const QString createdAt = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    // Write-through: сначала память (группа сразу пригодна для рассылки),
+    // затем одна задача писателю с пакетной вставкой состава.
+    m_groupMembers.insert(groupId, members);
+
+    const QStringList memberList(members.cbegin(), members.cend());
+
+    m_dbService->post([groupId, name, creator, createdAt, memberList](QSqlDatabase &db) -> QVariant {
+        QSqlQuery insertGroup(db);
+        insertGroup.prepare("INSERT INTO groups (id, name, owner, created_at) "
+                            "VALUES (:id, :name, :owner, :createdAt)");
+        insertGroup.bindValue(":id", groupId);
+        insertGroup.bindValue(":name", name);
+        insertGroup.bindValue(":owner", creator);
+        insertGroup.bindValue(":createdAt", createdAt);
+
+        if (!insertGroup.exec()) {
+            qWarning() << "[DB] Failed to insert group" << groupId
+                       << ":" << insertGroup.lastError().text();
+            return QVariant();
+        }
+
+        // Весь состав — один многострочный INSERT вместо INSERT-на-участника
+        QStringList rows;
+        rows.reserve(memberList.size());
+        for (int i = 0; i < memberList.size(); ++i) {
+            rows << "(?, ?)";
+        }
+
+        QSqlQuery insertMembers(db);
+        insertMembers.prepare("INSERT OR IGNORE INTO group_members (group_id, username) VALUES "
+                              + rows.join(", "));
+        for (const QString &member : memberList) {
+            insertMembers.addBindValue(groupId);
+            insertMembers.addBindValue(member);
+        }
+
+        if (!insertMembers.exec()) {
+            qWarning() << "[DB] Failed to insert members of group" << groupId
+                       << ":" << insertMembers.lastError().text();
+        }
+        return QVariant();
+    });
+
+    qInfo() << "[SERVER] Group" << groupId << "(" << name << ") created by"
+            << creator << "with" << members.size() << "members";
+
+    // Уведомление уходит всем онлайн-участникам (включая создателя — для него
+    // это и есть подтверждение) одним общим буфером.
+    QJsonObject notice;
+    notice["type"] = "group_created";
+    notice["group_id"] = static_cast<double>(groupId);
+    notice["name"] = name;
+    notice["owner"] = creator;
+
+    QJsonArray membersArray;
+    for (const QString &member : memberList) {
+        membersArray.append(member);
+    }
+    notice["members"] = membersArray;
+
+    QList<QObject*> online;
+    for (const QString &member : memberList) {
+        if (QObject* memberSocket = m_sessions.socketOf(member)) {
+            online.append(memberSocket);
+        }
+    }
+    fanOutJson(online, notice);
+}
+
+
+/**
+ * @brief Маршрутизирует сообщение в группу через движок веерной рассылки.
+ *
+ * @details Горячий путь построен так, чтобы стоимость на участника была
+ * минимальной:
+ * 1. Членство проверяется по кэшу m_groupMembers — без обращения к БД.
+ * 2. Сообщение сериализуется один раз; онлайн-участники получают неявно
+ *    разделяемый буфер через fanOutJson (по-сеансовое шифрование — это
+ *    единственная работа на получателя).
+ * 3. Офлайн-участники ставятся в очередь доставки одним многострочным
+ *    INSERT вместе со строкой самого сообщения — одна задача писателя
+ *    независимо от размера группы.
+ * Наивный цикл по sendJson сериализовал бы сообщение на каждого участника
+ * и выполнял бы INSERT на каждого офлайн-участника.
+ *
+ * @param socket Сокет отправителя.
+ * @param request JSON-объект с полями:
+ *        - `group_id`: ID группы.
+ *        - `fromUser`: Username отправителя (сверяется с сессией).
+ *        - `payload`: Текст сообщения.
+ *        - `temp_id`: Временный ID клиента для сопоставления echo.
+ */
+void Server::handleGroupMessage(QObject* socket, const QJsonObject& request)
+{
+    // ═══════════════════════════════════════════════════════════════════════
+    // 1. Извлечение данных и проверки
+    // ═══════════════════════════════════════════════════════════════════════
+    const qint64 groupId = static_cast<qint64>(request["group_id"].toDouble());
+    const QString fromUser = request["fromUser"].toString();
+    const QString payload = request["payload"].toString();
+    const QString tempId = request["temp_id"].toString();
+
+    const QString authenticatedUser = m_sessions.usernameOf(socket);
+    if (fromUser != authenticatedUser) {
+        qCritical() << "[SERVER] 🚨 SECURITY WARNING: User" << authenticatedUser
+                    << "attempted to impersonate" << fromUser << "in group" << groupId;
+        sendJson(socket, QJsonObject{{"type", "error"},
+                                     {"reason", "Authentication mismatch"}});
+        return;
+    }
+
+    const auto membersIt = m_groupMembers.constFind(groupId);
+    if (membersIt == m_groupMembers.constEnd() || !membersIt->contains(fromUser)) {
+        sendJson(socket, QJsonObject{{"type", "error"},
+                                     {"reason", "Not a member of this group"}});
+        return;
+    }
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 2. Присвоение ID и немедленный ack (как у handlePrivateMessage)
+    // ═══════════════════════════════════════════════════════════════════════
+    const qint64 messageId = m_messageIds.nextId();
+    const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    QJsonObject message;
+    message["type"] = "group_message";
+    message["id"] = static_cast<double>(messageId);
+    message["group_id"] = static_cast<double>(groupId);
+    message["fromUser"] = fromUser;
+    message["payload"] = payload;
+    message["timestamp"] = static_cast<double>(timestamp);
+
+    // Echo с temp_id — единственная персональная форма, она не разделяется.
+    QJsonObject echoMessage = message;
+    echoMessage["temp_id"] = tempId;
     sendJson(socket, echoMessage);
 
     // ═══════════════════════════════════════════════════════════════════════
-    // 6. Пересылка сообщения получателю (если онлайн)
+    // 3. Сортировка участников: онлайн / другой узел / офлайн
     // ═══════════════════════════════════════════════════════════════════════
-    
-    // Удаляем temp_id, так как он не нужен получателю (это внутренний ID отправителя)
-    echoMessage.remove("temp_id");
+    QList<QObject*> online;
+    QStringList offlineMembers;
 
-    // Ищем сокет получателя в списке онлайн-клиентов
-    QObject* toUserSocket = m_clients.value(toUser, nullptr);
+    for (const QString &member : *membersIt) {
+        if (member == fromUser) {
+            continue;
+        }
 
-    if (toUserSocket) {
-        // ====================================================================
-        // СЛУЧАЙ 1: Получатель онлайн — немедленная доставка
-        // ====================================================================
-        sendJson(toUserSocket, echoMessage);
-        qDebug() << "[SERVER] Message" << messageId << "delivered to online user" << toUser;
-        
-    } else {
-        // ====================================================================
-        // СЛУЧАЙ 2: Получатель офлайн — сообщение ждёт в БД
-        // ====================================================================
-        qDebug() << "[SERVER] User" << toUser << "is offline. Message" << messageId 
-                 << "stored for later delivery.";
-        
-        // Сообщение будет загружено через handleGetHistory при следующем входе получателя
+        if (QObject* memberSocket = m_sessions.socketOf(member)) {
+            online.append(memberSocket);
+        } else if (m_shardBus->enabled() && !m_shardBus->isLocal(member)) {
+            // Участник живет на другом узле кластера: доставку выполняет
+            // узел-владелец. toUser подсказывает ему адресата маршрута.
+            QJsonObject routed = message;
+            routed["toUser"] = member;
+
+            QJsonObject envelope;
+            envelope["kind"] = "route";
+            envelope["payload"] = routed;
+            m_shardBus->send(m_shardBus->shardOf(member), envelope);
+        } else {
+            offlineMembers.append(member);
+        }
     }
+
+    fanOutJson(online, message);
+
+    qDebug() << "[SERVER] Group message" << messageId << "to group" << groupId
+             << ":" << online.size() << "online," << offlineMembers.size() << "offline";
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 4. Персистентность: строка сообщения + очередь офлайн-доставки
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Одна задача писателя на сообщение независимо от размера группы:
+     * строка в group_messages и все офлайн-участники одним многострочным
+     * INSERT в group_pending. Очередь выдается и снимается при входе
+     * участника (см. deliverPendingGroupMessages).
+     */
+    m_dbService->post([groupId, messageId, fromUser, payload, timestamp,
+                       offlineMembers](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &insertMessage = StatementCache::get(db,
+            "INSERT INTO group_messages (id, group_id, fromUser, payload, timestamp) "
+            "VALUES (:id, :groupId, :fromUser, :payload, :timestamp)");
+        insertMessage.bindValue(":id", messageId);
+        insertMessage.bindValue(":groupId", groupId);
+        insertMessage.bindValue(":fromUser", fromUser);
+        insertMessage.bindValue(":payload", Compression::packText(payload));
+        insertMessage.bindValue(":timestamp", timestamp);
+
+        if (!insertMessage.exec()) {
+            qWarning() << "[DB] Failed to persist group message" << messageId
+                       << ":" << insertMessage.lastError().text();
+            return QVariant();
+        }
+
+        if (!offlineMembers.isEmpty()) {
+            QStringList rows;
+            rows.reserve(offlineMembers.size());
+            for (int i = 0; i < offlineMembers.size(); ++i) {
+                rows << "(?, ?, ?)";
+            }
+
+            QSqlQuery insertPending(db);
+            insertPending.prepare(
+                "INSERT OR IGNORE INTO group_pending (username, message_id, group_id) VALUES "
+                + rows.join(", "));
+            for (const QString &member : offlineMembers) {
+                insertPending.addBindValue(member);
+                insertPending.addBindValue(messageId);
+                insertPending.addBindValue(groupId);
+            }
+
+            if (!insertPending.exec()) {
+                qWarning() << "[DB] Failed to enqueue group message" << messageId
+                           << "for offline members:" << insertPending.lastError().text();
+            }
+        }
+        return QVariant();
+    });
 }
 
 
@@ -2784,6 +7406,149 @@ void Server::handlePrivateMessage(QObject* socket, const QJsonObject& request)
  * @param socket Указатель на сокет получателя (`QObject*`, может быть `QTcpSocket*` или `QWebSocket*`).
  * @param response JSON-объект, который надо отправить.
  */
+/**
+ * @brief Типы, которые можно безболезненно терять под нагрузкой.
+ *
+ * @details Статусные уведомления эфемерны: следующий цикл присутствия или
+ * очередное нажатие клавиши восстановят актуальное состояние. Сообщения,
+ * квитанции и ответы на запросы в этот список попадать не должны.
+ */
+static bool isSheddableType(const QString& type)
+{
+    return type == QLatin1String("typing")
+        || type == QLatin1String("presence")
+        || type == QLatin1String("user_list");
+}
+
+QJsonObject Server::buildAdminSnapshot() const
+{
+    // Снимаем copy-on-write копии в самом начале: дальше работаем с ними,
+    // и даже если обход окажется долгим, горячий путь затронут не будет.
+    const QMap<QString, CallInfo> calls = m_activeCalls;
+    const QHash<QObject*, QByteArray> pending = m_pendingWrites;
+
+    QJsonObject snapshot;
+    snapshot["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+
+    // --- Онлайн-сессии ---
+    QJsonArray sessions;
+    const QList<QObject*> sockets = m_sessions.authenticatedSockets();
+    for (QObject *obj : sockets) {
+        QJsonObject session;
+        session["username"] = m_sessions.usernameOf(obj);
+
+        const bool pooled = m_socketWorkers.contains(obj);
+        if (auto *tcp = qobject_cast<QTcpSocket*>(obj)) {
+            session["transport"] = pooled ? QStringLiteral("tcp-pool")
+                                          : QStringLiteral("tcp");
+            // Сокеты пула живут в рабочих потоках — их состояние (адрес,
+            // bytesToWrite) отсюда не читаем, как и applySendBackpressure.
+            if (!pooled) {
+                session["peer"] = tcp->peerAddress().toString() + ":"
+                                  + QString::number(tcp->peerPort());
+                session["buffered_bytes"] = double(bufferedBytesFor(obj));
+            }
+        } else if (auto *ws = qobject_cast<QWebSocket*>(obj)) {
+            session["transport"] = QStringLiteral("websocket");
+            session["peer"] = ws->peerAddress().toString() + ":"
+                              + QString::number(ws->peerPort());
+            session["buffered_bytes"] = double(bufferedBytesFor(obj));
+        }
+        sessions.append(session);
+    }
+    snapshot["sessions"] = sessions;
+
+    // --- Активные звонки ---
+    QJsonArray activeCalls;
+    for (const CallInfo &info : calls) {
+        QJsonObject call;
+        call["call_id"] = info.callId;
+        call["from"] = info.from;
+        call["to"] = info.to;
+        call["caller_ip"] = info.callerIp;
+        activeCalls.append(call);
+    }
+    snapshot["active_calls"] = activeCalls;
+
+    // --- Очереди отложенной записи (corking) ---
+    qint64 corkedTotal = 0;
+    qint64 corkedMax = 0;
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        corkedTotal += it.value().size();
+        corkedMax = qMax(corkedMax, qint64(it.value().size()));
+    }
+    QJsonObject writeQueues;
+    writeQueues["corked_sockets"] = pending.size();
+    writeQueues["corked_bytes_total"] = double(corkedTotal);
+    writeQueues["corked_bytes_max"] = double(corkedMax);
+    snapshot["write_queues"] = writeQueues;
+
+    return snapshot;
+}
+
+
+qint64 Server::bufferedBytesFor(QObject* socket) const
+{
+    if (auto *tcp = qobject_cast<QTcpSocket*>(socket)) {
+        return tcp->bytesToWrite() + m_pendingWrites.value(socket).size();
+    }
+    if (auto *ws = qobject_cast<QWebSocket*>(socket)) {
+        return ws->bytesToWrite();
+    }
+    return 0;
+}
+
+bool Server::applySendBackpressure(QObject* socket, const QString& type)
+{
+    // Сокеты пула живут в рабочих потоках: их bytesToWrite() отсюда читать
+    // нельзя. Жесткий потолок для них контролирует сам ConnectionWorker.
+    if (m_socketWorkers.contains(socket)) {
+        return true;
+    }
+
+    const qint64 buffered = bufferedBytesFor(socket);
+
+    // Жесткий потолок: клиент не вычитывает данные настолько долго, что
+    // удерживает десятки мегабайт в RSS сервера. Дешевле разорвать
+    // соединение — после переподключения клиент доберет историю сам.
+    if (buffered > SendHardCapBytes) {
+        ++m_slowConsumersDisconnected;
+        qWarning() << "[SERVER] Slow consumer exceeded send hard cap:"
+                   << buffered << "bytes buffered, disconnecting"
+                   << m_sessions.usernameOf(socket);
+        m_pendingWrites.remove(socket);
+        if (auto *tcp = qobject_cast<QTcpSocket*>(socket)) {
+            tcp->abort();
+        } else if (auto *ws = qobject_cast<QWebSocket*>(socket)) {
+            ws->abort();
+        }
+        return false;
+    }
+
+    // Гистерезис high/low: войдя в режим сброса по верхней отметке, сокет
+    // выходит из него только отыграв ниже нижней — иначе состояние дрожало
+    // бы на каждой отправке вокруг одного порога.
+    if (m_backpressuredSockets.contains(socket)) {
+        if (buffered < SendLowWatermarkBytes) {
+            m_backpressuredSockets.remove(socket);
+        }
+    } else if (buffered > SendHighWatermarkBytes) {
+        m_backpressuredSockets.insert(socket);
+        qWarning() << "[SERVER] Send buffer above high watermark:" << buffered
+                   << "bytes, shedding non-essential traffic for"
+                   << m_sessions.usernameOf(socket);
+    }
+
+    // Под backpressure эфемерный трафик сбрасывается; существенный
+    // (сообщения, квитанции, ответы) продолжает копиться до потолка.
+    if (m_backpressuredSockets.contains(socket) && isSheddableType(type)) {
+        ++m_sendsShedBackpressure;
+        return false;
+    }
+
+    return true;
+}
+
 void Server::sendJson(QObject* socket, const QJsonObject& response)
 {
     qDebug() << "---------------------------------";
@@ -2791,17 +7556,56 @@ void Server::sendJson(QObject* socket, const QJsonObject& response)
     //qDebug() << "[SERVER] Full JSON content:" << response;
     qDebug() << "---------------------------------";
 
+    if (!applySendBackpressure(socket, response["type"].toString())) {
+        return;
+    }
+
     QByteArray jsonData = QJsonDocument(response).toJson(QJsonDocument::Compact);
 
+    // Клиентам в бинарном режиме горячие типы уходят компактной записью
+    // BinaryCodec. Подмена происходит до шифрования и фрейминга, поэтому
+    // остальной путь отправки (включая маршрутизацию в воркеры) не меняется.
+    if (m_binaryClients.contains(socket)) {
+        const QByteArray record = BinaryCodec::encode(response);
+        if (!record.isEmpty()) {
+            jsonData = record;
+        }
+    }
+
+    // Клиентам, согласовавшим сжатие, крупные нагрузки уходят deflate-записью.
+    // Та же точка подмены, что и у BinaryCodec: до шифрования и фрейминга,
+    // поэтому путь через воркеры не меняется.
+    if (m_compressedClients.contains(socket)) {
+        const QByteArray compressed = Compression::wrap(jsonData);
+        if (!compressed.isEmpty()) {
+            qDebug() << "[SERVER] Payload compressed:" << jsonData.size()
+                     << "->" << compressed.size() << "bytes";
+            jsonData = compressed;
+        }
+    }
+
+    // Сокеты из пула живут в рабочих потоках: шифрование и запись выполняет
+    // их воркер, поэтому сериализованный пакет пересылается туда через очередь.
+    if (ConnectionWorker *worker = m_socketWorkers.value(socket, nullptr)) {
+        QMetaObject::invokeMethod(worker, "writeJson", Qt::QueuedConnection,
+                                  Q_ARG(QObject*, socket),
+                                  Q_ARG(QByteArray, jsonData));
+        return;
+    }
+
     if (auto tcpSocket = qobject_cast<QTcpSocket*>(socket)) {
         if (tcpSocket->state() != QAbstractSocket::ConnectedState) {
             qWarning() << "Socket not connected, state:" << tcpSocket->state();
             return;
         }
 
-        CryptoManager* crypto = m_clientCrypto[tcpSocket];
+        auto framedSocket = qobject_cast<FramedTcpSocket*>(tcpSocket);
+        if (!framedSocket) {
+            qWarning() << "[SERVER] TCP socket without connection state in sendJson";
+            return;
+        }
 
-        if (!crypto->isEncrypted()) {
+        if (!framedSocket->crypto().isEncrypted()) {
             // --- Отправляем открытый JSON с префиксом длины ---
             QByteArray block;
             QDataStream out(&block, QIODevice::WriteOnly);
@@ -2811,61 +7615,182 @@ void Server::sendJson(QObject* socket, const QJsonObject& response)
             out.device()->seek(0);          // Возвращаемся в начало
             out << (quint32)(block.size() - sizeof(quint32)); // Записываем реальный размер
 
-            qint64 written = tcpSocket->write(block);
-            if (written == -1) {
-                qWarning() << "Write failed:" << tcpSocket->errorString();
-                return;
-            }
+            enqueueWrite(tcpSocket, block);
 
-            qDebug() << "[SERVER] JSON UNSAFE (cleartext) send:" << jsonData.size() << "bytes";
+            qDebug() << "[SERVER] JSON UNSAFE (cleartext) queued:" << jsonData.size() << "bytes";
             return;
         }
 
-        // --- ШИФРОВАНИЕ (XChaCha20-Poly1305) ---
-        uint8_t nonce[24];
-        QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(nonce), 24 / 4);
+        // --- ШИФРОВАНИЕ И ФРЕЙМИНГ (XChaCha20-Poly1305) ---
+        // Кадр [Length][Nonce][MAC+Ciphertext] собирается одним проходом:
+        // sealFrame выделяет буфер точного размера и шифрует прямо в него,
+        // без промежуточных QByteArray и повторной сериализации QDataStream.
+        const QByteArray packet = framedSocket->crypto().sealFrame(jsonData);
 
-        QByteArray encryptedData;
-        encryptedData.resize(16 + jsonData.size()); // MAC (16) + ciphertext
+        enqueueWrite(tcpSocket, packet);
+        qDebug() << "[SERVER] JSON queued (encrypted):" << packet.size() - 4 << "bytes";
 
-        // Проводим аутентифицированное шифрование
-        crypto_aead_lock(
-            reinterpret_cast<uint8_t*>(encryptedData.data()) + 16, // ciphertext (выход)
-            reinterpret_cast<uint8_t*>(encryptedData.data()),      // MAC (выход)
-            crypto->getSessionKey(),                                // ключ
-            nonce,                                                  // nonce
-            nullptr, 0,                                            // associated data (нет)
-            reinterpret_cast<const uint8_t*>(jsonData.constData()),// plaintext
-            jsonData.size()                                         // длина
-        );
+    } else if (auto wsSocket = qobject_cast<QWebSocket*>(socket)) {
+        // --- WebSocket: фреймит сообщения сам, очередь записи не нужна ---
+        // Шифрованной сессии полезная нагрузка уходит sealFrame-кадром —
+        // той же по-сеансовой работой, что и для TCP.
+        if (CryptoManager* wsCrypto = m_wsCrypto.value(socket, nullptr);
+            wsCrypto && wsCrypto->isEncrypted()) {
+            wsSocket->sendBinaryMessage(wsCrypto->sealFrame(jsonData));
+            return;
+        }
 
-        // --- ФОРМИРУЕМ ПАКЕТ TCP с префиксом длины ---
-        QByteArray packet;
-        QDataStream out(&packet, QIODevice::WriteOnly);
-        out.setVersion(QDataStream::Qt_6_2);
+        // Клиентам, согласовавшим бинарный режим или сжатие, полезная
+        // нагрузка уходит бинарным кадром как есть: приемник различает
+        // запись BinaryCodec, deflate-запись и JSON по первому байту,
+        // а текстовый путь потребовал бы перекодирования в UTF-16.
+        if (m_binaryClients.contains(socket) || m_compressedClients.contains(socket)) {
+            wsSocket->sendBinaryMessage(jsonData);
+        } else {
+            wsSocket->sendTextMessage(QString::fromUtf8(jsonData));
+        }
+    }
+}
 
-        // [Length (4 байта)][Nonce (24 байта)][MAC+Ciphertext]
-        out << (quint32)0; // резерв под длину
-        out << QByteArray(reinterpret_cast<const char*>(nonce), 24);
-        out << encryptedData;
-        out.device()->seek(0);
 
-        quint32 totalSize = packet.size() - sizeof(quint32);
-        out << totalSize;
+void Server::fanOutJson(const QList<QObject*>& recipients, const QJsonObject& message)
+{
+    if (recipients.isEmpty()) {
+        return;
+    }
+
+    const QString type = message["type"].toString();
+
+    // ═══════════════════════════════════════════════════════════════════════
+    // 1. Общие буфера: каждая форма полезной нагрузки строится один раз
+    // ═══════════════════════════════════════════════════════════════════════
+    /**
+     * Сериализация — самая дорогая разделяемая работа рассылки, она
+     * выполняется ровно один раз. Бинарная и сжатая формы нужны не всем,
+     * поэтому кодируются лениво при первом получателе соответствующего
+     * режима — и дальше тоже разделяются. QByteArray неявно разделяем
+     * с атомарным счетчиком ссылок: передача буфера в очередь воркера или
+     * очередь записи не копирует байты, даже между потоками.
+     */
+    const QByteArray jsonData = QJsonDocument(message).toJson(QJsonDocument::Compact);
+
+    QByteArray binaryRecord;
+    bool binaryTried = false;
 
-        //tcpSocket->write(packet);
+    QByteArray compressedRecord;
+    bool compressedTried = false;
 
+    for (QObject* socket : recipients) {
+        if (!socket) {
+            continue;
+        }
 
-        qint64 written = tcpSocket->write(packet);
-        if (written == -1) {
-            qWarning() << "Write failed:" << tcpSocket->errorString();
-            return;
+        if (!applySendBackpressure(socket, type)) {
+            continue; // Медленный получатель не тормозит остальных
         }
-        qDebug() << "[SERVER] JSON send (encrypted):" << totalSize << "bytes";
 
-    } else if (auto wsSocket = qobject_cast<QWebSocket*>(socket)) {
-        // --- WebSocket: просто отправляем как текстовое сообщение ---
-        wsSocket->sendTextMessage(QString::fromUtf8(jsonData));
+        // ═══════════════════════════════════════════════════════════════════
+        // 2. Выбор формы для конкретного получателя (общие буфера)
+        // ═══════════════════════════════════════════════════════════════════
+        QByteArray payload = jsonData;
+
+        if (m_binaryClients.contains(socket)) {
+            if (!binaryTried) {
+                binaryRecord = BinaryCodec::encode(message);
+                binaryTried = true;
+            }
+            if (!binaryRecord.isEmpty()) {
+                payload = binaryRecord;
+            }
+        }
+
+        // Бинарная запись и так компактна — сжатие применяется только
+        // к JSON-форме (в отличие от sendJson: здесь буфер общий, и
+        // комбинированная форма потребовала бы отдельного кодирования).
+        if (payload.constData() == jsonData.constData()
+            && m_compressedClients.contains(socket)) {
+            if (!compressedTried) {
+                compressedRecord = Compression::wrap(jsonData);
+                compressedTried = true;
+            }
+            if (!compressedRecord.isEmpty()) {
+                payload = compressedRecord;
+            }
+        }
+
+        // ═══════════════════════════════════════════════════════════════════
+        // 3. Постановка в очередь: единственная по-сеансовая работа — sealFrame
+        // ═══════════════════════════════════════════════════════════════════
+        if (ConnectionWorker *worker = m_socketWorkers.value(socket, nullptr)) {
+            QMetaObject::invokeMethod(worker, "writeJson", Qt::QueuedConnection,
+                                      Q_ARG(QObject*, socket),
+                                      Q_ARG(QByteArray, payload));
+            continue;
+        }
+
+        if (auto tcpSocket = qobject_cast<QTcpSocket*>(socket)) {
+            if (tcpSocket->state() != QAbstractSocket::ConnectedState) {
+                continue;
+            }
+
+            auto framedSocket = qobject_cast<FramedTcpSocket*>(tcpSocket);
+            if (!framedSocket || !framedSocket->crypto().isEncrypted()) {
+                // До завершения рукопожатия получатель не аутентифицирован
+                // и в рассылки не попадает; пропуск — страховка.
+                continue;
+            }
+
+            enqueueWrite(tcpSocket, framedSocket->crypto().sealFrame(payload));
+        } else if (auto wsSocket = qobject_cast<QWebSocket*>(socket)) {
+            if (CryptoManager* wsCrypto = m_wsCrypto.value(socket, nullptr);
+                wsCrypto && wsCrypto->isEncrypted()) {
+                wsSocket->sendBinaryMessage(wsCrypto->sealFrame(payload));
+            } else if (m_binaryClients.contains(socket) || m_compressedClients.contains(socket)) {
+                wsSocket->sendBinaryMessage(payload);
+            } else {
+                wsSocket->sendTextMessage(QString::fromUtf8(payload));
+            }
+        }
+    }
+
+    qDebug() << "[SERVER] Fan-out of" << type << "to" << recipients.size()
+             << "recipients (" << jsonData.size() << "bytes serialized once)";
+}
+
+
+void Server::enqueueWrite(QTcpSocket* socket, const QByteArray& packet)
+{
+    // Кадры одной итерации цикла событий склеиваются в общий буфер сокета.
+    m_pendingWrites[socket] += packet;
+
+    // Планируем один отложенный сброс на всю итерацию: queued-вызов встанет
+    // в конец очереди событий и выполнится, когда все ответы уже поставлены.
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, &Server::flushPendingWrites, Qt::QueuedConnection);
+    }
+}
+
+
+void Server::flushPendingWrites()
+{
+    m_flushScheduled = false;
+
+    // Забираем очереди целиком: sendJson() из обработчиков, вызванных ниже,
+    // начнет накапливать уже следующую партию.
+    const QHash<QObject*, QByteArray> pending = std::move(m_pendingWrites);
+    m_pendingWrites = QHash<QObject*, QByteArray>();
+
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        auto *tcpSocket = qobject_cast<QTcpSocket*>(it.key());
+        if (!tcpSocket || tcpSocket->state() != QAbstractSocket::ConnectedState) {
+            continue; // Клиент успел отключиться — буфер просто выбрасывается
+        }
+
+        // Один write() на сокет: шторм мелких ответов уходит одним сегментом.
+        if (tcpSocket->write(it.value()) == -1) {
+            qWarning() << "Write failed:" << tcpSocket->errorString();
+        }
     }
 }
 
@@ -2915,7 +7840,7 @@ void Server::sendFullUserList(QObject* socket)
  *
  * @details Метод формирует JSON-сообщение с типом "user_list", содержащим массив строк — имён
  * всех аутентифицированных и подключенных в данный момент пользователей. Затем отправляет
- * это сообщение каждому клиенту из карты `m_clients`.
+ * это сообщение каждому аутентифицированному клиенту из реестра сессий.
  * 
  * Обычно вызывается:
  * - После успешного входа нового пользователя.
@@ -2927,7 +7852,7 @@ void Server::sendFullUserList(QObject* socket)
 void Server::broadcastUserList()
 {
     // Получаем список всех имен пользователей, которые сейчас онлайн.
-    QStringList onlineUsers = m_clients.keys();
+    QStringList onlineUsers = m_sessions.onlineUsernames();
     qDebug() << "[SERVER] Broadcasting ONLINE user list:" << onlineUsers;
 
     // Формируем JSON-сообщение с массивом онлайн-имён.
@@ -2936,23 +7861,211 @@ void Server::broadcastUserList()
     message["users"] = QJsonArray::fromStringList(onlineUsers);
 
     // Отправляем сообщение каждому онлайн-клиенту.
-    for (QObject* socket : m_clients.values()) {
+    for (QObject* socket : m_sessions.authenticatedSockets()) {
         sendJson(socket, message);
     }
 }
 
 
+void Server::broadcastPresence(const QString& username, bool online)
+{
+    QJsonObject event;
+    event["type"] = "presence";
+    event["username"] = username;
+    event["online"] = online;
+
+    // В кластере подписчики этого пользователя могут жить на любом узле:
+    // дельта транслируется пирам, каждый раздает ее своим подписчикам.
+    if (m_shardBus->enabled()) {
+        QJsonObject envelope;
+        envelope["kind"] = "presence";
+        envelope["payload"] = event;
+        m_shardBus->broadcast(envelope);
+    }
+
+    // Событие уходит только подписчикам этого пользователя; если его статус
+    // здесь никто не отображает — локально не делаем вообще ничего.
+    const QSet<QObject*> subscribers = m_presenceSubscribers.value(username);
+    if (subscribers.isEmpty()) return;
+
+    for (QObject* subscriber : subscribers) {
+        sendJson(subscriber, event);
+    }
+
+    qDebug() << "[SERVER] Presence delta:" << username << (online ? "online" : "offline")
+             << "->" << subscribers.size() << "subscriber(s)";
+}
+
+
+/**
+ * @brief Обрабатывает конверт, принятый по межузловой шине.
+ *
+ * @details Конверты приходят от других узлов кластера и касаются только
+ * локальных адресатов:
+ * - kind="route": private_message для получателя, чья сессия (если он
+ *   онлайн) зарегистрирована на этом узле;
+ * - kind="presence": дельта присутствия или профиля (profile_delta)
+ *   пользователя чужого шарда — раздается локальным подписчикам по
+ *   payload["username"], без повторной трансляции пирам.
+ */
+void Server::onShardEnvelope(const QJsonObject& envelope)
+{
+    const QString kind = envelope["kind"].toString();
+    const QJsonObject payload = envelope["payload"].toObject();
+
+    if (kind == QLatin1String("route")) {
+        const QString toUser = payload["toUser"].toString();
+        if (QObject* toUserSocket = m_sessions.socketOf(toUser)) {
+            sendJson(toUserSocket, payload);
+        } else {
+            qDebug() << "[SHARD] Routed message for offline user" << toUser
+                     << "- recipient will load it from history";
+        }
+        return;
+    }
+
+    if (kind == QLatin1String("presence")) {
+        const QString username = payload["username"].toString();
+        const QSet<QObject*> subscribers = m_presenceSubscribers.value(username);
+        for (QObject* subscriber : subscribers) {
+            sendJson(subscriber, payload);
+        }
+        return;
+    }
+
+    qWarning() << "[SHARD] Unknown envelope kind:" << kind;
+}
+
+
+/**
+ * @brief Замещает набор подписок присутствия для сокета клиента.
+ *
+ * @details Клиент присылает полный список имен, которые он сейчас отображает
+ * (обычно — список контактов). Прежняя подписка сокета снимается, новая
+ * регистрируется в обоих индексах. Пустой массив `users` просто отписывает
+ * клиента от всего.
+ *
+ * @param socket Сокет клиента.
+ * @param request JSON-объект с массивом строк `users`.
+ */
+void Server::handlePresenceSubscribe(QObject* socket, const QJsonObject& request)
+{
+    // 1. Снимаем прежние подписки сокета.
+    const QSet<QString> oldWatches = m_presenceWatches.take(socket);
+    for (const QString& watched : oldWatches) {
+        auto it = m_presenceSubscribers.find(watched);
+        if (it != m_presenceSubscribers.end()) {
+            it->remove(socket);
+            if (it->isEmpty()) m_presenceSubscribers.erase(it);
+        }
+    }
+
+    // 2. Регистрируем новый набор.
+    QSet<QString> watches;
+    const QJsonArray users = request["users"].toArray();
+    for (const QJsonValue& value : users) {
+        const QString username = value.toString();
+        if (username.isEmpty()) continue;
+
+        watches.insert(username);
+        m_presenceSubscribers[username].insert(socket);
+    }
+
+    if (!watches.isEmpty()) {
+        m_presenceWatches.insert(socket, watches);
+    }
+
+    qDebug() << "[SERVER] Presence subscription updated:" << watches.size()
+             << "user(s) for" << m_sessions.usernameOf(socket, "<pre-login>");
+}
+
+
+/**
+ * @brief Запоминает участников свежего сообщения в кэше авторизации.
+ *
+ * @details Кольцо фиксированной емкости: пока оно не заполнено — записи
+ * просто добавляются, дальше новая запись вытесняет самую старую (FIFO).
+ * Редактирование и удаление почти всегда касаются недавних сообщений,
+ * поэтому даже небольшая емкость покрывает подавляющее большинство запросов.
+ */
+void Server::rememberOwnership(qint64 messageId, const QString& fromUser,
+                               const QString& toUser)
+{
+    if (m_ownershipRing.size() < OwnershipCacheCapacity) {
+        m_ownershipRing.append(messageId);
+    } else {
+        m_messageOwners.remove(m_ownershipRing[m_ownershipRingHead]);
+        m_ownershipRing[m_ownershipRingHead] = messageId;
+        m_ownershipRingHead = (m_ownershipRingHead + 1) % OwnershipCacheCapacity;
+    }
+    m_messageOwners.insert(messageId, {fromUser, toUser});
+}
+
+
+/**
+ * @brief Выполняет авторизованное редактирование сообщения.
+ *
+ * @details Авторизация свернута в условный UPDATE (`WHERE id = :id AND
+ * fromUser = :user`): даже если запись кэша устарела, чужое сообщение
+ * запрос в БД не затронет. Уведомления рассылаются сразу, не дожидаясь
+ * писателя — как и в handlePrivateMessage, БД убрана с пути задержки.
+ */
+void Server::applyMessageEdit(qint64 messageId, const QString& fromUser,
+                              const QString& toUser, const QString& newPayload)
+{
+    m_dbService->post([messageId, fromUser, newPayload](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &update = StatementCache::get(db,
+            "UPDATE messages SET payload = :payload, is_edited = 1 "
+            "WHERE id = :id AND fromUser = :user");
+        update.bindValue(":payload", Compression::packText(newPayload));
+        update.bindValue(":id", messageId);
+        update.bindValue(":user", fromUser);
+
+        if (!update.exec()) {
+            qWarning() << "[DB] Failed to update message payload:"
+                       << update.lastError().text();
+        }
+        return QVariant();
+    });
+
+    qInfo() << "[SERVER] User" << fromUser << "edited message" << messageId;
+
+    // Кэшированная страница диалога устарела — сбрасываем запись.
+    m_recentMessages.invalidate(fromUser, toUser);
+
+    // Формируем уведомление о редактировании
+    QJsonObject editCmd;
+    editCmd["type"] = "edit_message";
+    editCmd["id"] = static_cast<double>(messageId);
+    editCmd["payload"] = newPayload;
+
+    // Отправляем автору сообщения
+    QObject* fromSocket = m_sessions.socketOf(fromUser);
+    if (fromSocket) {
+        editCmd["with_user"] = toUser;
+        sendJson(fromSocket, editCmd);
+    }
+
+    // Отправляем получателю сообщения
+    QObject* toSocket = m_sessions.socketOf(toUser);
+    if (toSocket) {
+        editCmd["with_user"] = fromUser;
+        sendJson(toSocket, editCmd);
+    }
+}
+
+
 /**
  * @brief Обрабатывает запрос на редактирование ранее отправленного сообщения.
- * 
+ *
  * @details Метод выполняет полный цикл обработки:
  * 1. Определяет пользователя, сделавшего запрос, по связанному с сокетом имени.
  * 2. Получает ID редактируемого сообщения и новый текст.
- * 3. Проверяет, что пользователь аутентифицирован и является автором сообщения.
- * 4. Обновляет сообщение в базе, устанавливая флаг `is_edited`.
- * 5. Формирует JSON-уведомление о редактировании.
- * 6. Отправляет уведомление автору и получателю (если они онлайн).
- * 
+ * 3. Проверяет авторство: свежие сообщения — по кэшу владения (без обращения
+ *    к БД), остальные — асинхронным чтением участников из пула читателей.
+ * 4. Применяет условный UPDATE (авторизация в самом запросе) и рассылает
+ *    уведомление автору и получателю (см. applyMessageEdit).
+ *
  * @param clientSocket Сокет клиента, инициировавшего редактирование.
  * @param request JSON-запрос с полями:
  *        - `id`: ID сообщения.
@@ -2960,8 +8073,8 @@ void Server::broadcastUserList()
  */
 void Server::handleEditMessage(QObject* clientSocket, const QJsonObject& request)
 {
-    QString requestingUser = m_clientsReverse.value(clientSocket);
-    quint64 messageId = request["id"].toDouble();
+    QString requestingUser = m_sessions.usernameOf(clientSocket);
+    qint64 messageId = request["id"].toDouble();
 
     qDebug() << "[SERVER] Edit message request from" << requestingUser << "for message ID:" << messageId;
     if (messageId == 0) {
@@ -2975,56 +8088,103 @@ void Server::handleEditMessage(QObject* clientSocket, const QJsonObject& request
         return;
     }
 
-    // Получаем из базы авторство сообщения и получателя
-    QSqlQuery query;
-    query.prepare("SELECT fromUser, toUser FROM messages WHERE id = :id");
-    query.bindValue(":id", messageId);
-
-    if (query.exec() && query.next()) {
-        QString fromUser = query.value("fromUser").toString();
-        QString toUser = query.value("toUser").toString();
-
-        qDebug() << "[SERVER] Message author:" << fromUser << ", recipient:" << toUser;
-
-        // Проверяем, что редактирует именно автор сообщения
-        if (fromUser == requestingUser) {
-            QString newPayload = request["payload"].toString();
-
-            QSqlQuery updateQuery;
-            updateQuery.prepare("UPDATE messages SET payload = :payload, is_edited = 1 WHERE id = :id");
-            updateQuery.bindValue(":payload", newPayload);
-            updateQuery.bindValue(":id", messageId);
-
-            if (updateQuery.exec()) {
-                qInfo() << "[SERVER] User" << requestingUser << "edited message" << messageId;
-
-                // Формируем уведомление о редактировании
-                QJsonObject editCmd;
-                editCmd["type"] = "edit_message";
-                editCmd["id"] = static_cast<double>(messageId);
-                editCmd["payload"] = newPayload;
-
-                // Отправляем автору сообщения
-                QObject* fromSocket = m_clients.value(fromUser, nullptr);
-                if (fromSocket) {
-                    editCmd["with_user"] = toUser;
-                    sendJson(fromSocket, editCmd);
-                }
+    const QString newPayload = request["payload"].toString();
 
-                // Отправляем получателю сообщения
-                QObject* toSocket = m_clients.value(toUser, nullptr);
-                if (toSocket) {
-                    editCmd["with_user"] = fromUser;
-                    sendJson(toSocket, editCmd);
-                }
-            } else {
-                qWarning() << "[SERVER] Failed to update message payload in DB:" << updateQuery.lastError().text();
+    // Быстрый путь: участники свежего сообщения известны из кэша владения —
+    // SELECT авторства не нужен вовсе.
+    auto cached = m_messageOwners.constFind(messageId);
+    if (cached != m_messageOwners.constEnd()) {
+        if (cached->fromUser != requestingUser) {
+            qWarning() << "[SECURITY] User" << requestingUser
+                       << "attempted to edit message not authored by them (author:"
+                       << cached->fromUser << ")";
+            return;
+        }
+        applyMessageEdit(messageId, requestingUser, cached->toUser, newPayload);
+        return;
+    }
+
+    // Медленный путь: получатель неизвестен — дочитываем участников в пуле
+    // читателей. Авторство дополнительно проверит сам условный UPDATE.
+    m_dbService->read(
+        [messageId](QSqlDatabase &db) -> QVariant {
+            QSqlQuery &query = StatementCache::get(db,
+                "SELECT fromUser, toUser FROM messages WHERE id = :id");
+            query.bindValue(":id", messageId);
+
+            if (!query.exec() || !query.next()) {
+                return QVariant(); // Сообщение не найдено
             }
-        } else {
-            qWarning() << "[SECURITY] User" << requestingUser << "attempted to edit message not authored by them (author:" << fromUser << ")";
+            return QStringList{query.value("fromUser").toString(),
+                               query.value("toUser").toString()};
+        },
+        this,
+        [this, messageId, requestingUser, newPayload](const QVariant &result) {
+            if (!result.isValid()) {
+                qWarning() << "[SERVER] Failed to find message with ID" << messageId << "for editing.";
+                return;
+            }
+
+            const QStringList participants = result.toStringList();
+            if (participants.value(0) != requestingUser) {
+                qWarning() << "[SECURITY] User" << requestingUser
+                           << "attempted to edit message not authored by them (author:"
+                           << participants.value(0) << ")";
+                return;
+            }
+
+            applyMessageEdit(messageId, requestingUser, participants.value(1), newPayload);
+        });
+}
+
+
+/**
+ * @brief Выполняет авторизованное удаление сообщения.
+ *
+ * @details Зеркально applyMessageEdit: условный DELETE (`WHERE id = :id AND
+ * fromUser = :user`) совмещает проверку прав с самим удалением, уведомления
+ * уходят немедленно. Запись кэша владения удаляется — повторный delete или
+ * edit того же ID пойдет медленным путем и корректно не найдет сообщение.
+ */
+void Server::applyMessageDelete(qint64 messageId, const QString& fromUser,
+                                const QString& toUser)
+{
+    m_dbService->post([messageId, fromUser](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &del = StatementCache::get(db,
+            "DELETE FROM messages WHERE id = :id AND fromUser = :user");
+        del.bindValue(":id", messageId);
+        del.bindValue(":user", fromUser);
+
+        if (!del.exec()) {
+            qWarning() << "[DB] Failed to delete message:" << del.lastError().text();
         }
-    } else {
-        qWarning() << "[SERVER] Failed to find message with ID" << messageId << "for editing.";
+        return QVariant();
+    });
+
+    qInfo() << "[SERVER] User" << fromUser << "deleted message" << messageId;
+
+    // Запись кэша владения больше не описывает существующее сообщение.
+    m_messageOwners.remove(messageId);
+
+    // Кэшированная страница диалога устарела — сбрасываем запись.
+    m_recentMessages.invalidate(fromUser, toUser);
+
+    // Формирование уведомления об удалении
+    QJsonObject deleteCmd;
+    deleteCmd["type"] = "delete_message";
+    deleteCmd["id"] = static_cast<double>(messageId);
+
+    // Отправка уведомлений автору и получателю, если они онлайн
+    QObject* fromSocket = m_sessions.socketOf(fromUser);
+    if (fromSocket) {
+        deleteCmd["with_user"] = toUser;
+        sendJson(fromSocket, deleteCmd);
+    }
+
+    QObject* toSocket = m_sessions.socketOf(toUser);
+    if (toSocket) {
+        deleteCmd["with_user"] = fromUser;
+        sendJson(toSocket, deleteCmd);
     }
 }
 
@@ -3035,19 +8195,19 @@ void Server::handleEditMessage(QObject* clientSocket, const QJsonObject& request
  * @details Метод выполняет несколько шагов проверки и действий:
  * 1. Определяет пользователя, который запросил удаление, по сокету.
  * 2. Проверяет, что пользователь аутентифицирован.
- * 3. Извлекает из БД автора и получателя указанного сообщения.
- * 4. Проверяет, что запрос отправлен именно автором сообщения.
- * 5. Если проверка прошла успешно — удаляет запись из таблицы `messages`.
- * 6. Формирует и рассылает всем участникам чата уведомление типа `delete_message`.
- * 
+ * 3. Проверяет авторство: свежие сообщения — по кэшу владения, остальные —
+ *    асинхронным чтением участников из пула читателей.
+ * 4. Применяет условный DELETE и рассылает участникам чата уведомление
+ *    типа `delete_message` (см. applyMessageDelete).
+ *
  * @param clientSocket Сокет клиента, который инициировал удаление.
  * @param request JSON-запрос, содержащий поле `id` с идентификатором сообщения для удаления.
  */
 void Server::handleDeleteMessage(QObject* clientSocket, const QJsonObject& request)
 {
     // 1. Идентификация пользователя по сокету
-    QString requestingUser = m_clientsReverse.value(clientSocket);
-    quint64 messageId = request["id"].toDouble();
+    QString requestingUser = m_sessions.usernameOf(clientSocket);
+    qint64 messageId = request["id"].toDouble();
 
     qDebug() << "[SERVER] Delete message request from" << requestingUser << "for message ID:" << messageId;
     if (messageId == 0) {
@@ -3061,51 +8221,50 @@ void Server::handleDeleteMessage(QObject* clientSocket, const QJsonObject& reque
         return;
     }
 
-    // 3. Получение автора и получателя сообщения из БД
-    QSqlQuery query;
-    query.prepare("SELECT fromUser, toUser FROM messages WHERE id = :id");
-    query.bindValue(":id", messageId);
-
-    if (query.exec() && query.next()) {
-        QString fromUser = query.value("fromUser").toString();
-        QString toUser = query.value("toUser").toString();
-
-        // 4. Проверка прав: только автор может удалить свое сообщение
-        if (requestingUser == fromUser) {
-            // 5. Удаление сообщения из БД
-            QSqlQuery deleteQuery;
-            deleteQuery.prepare("DELETE FROM messages WHERE id = :id");
-            deleteQuery.bindValue(":id", messageId);
-
-            if (deleteQuery.exec()) {
-                qInfo() << "[SERVER] User" << requestingUser << "deleted message" << messageId;
-
-                // 6. Формирование уведомления об удалении
-                QJsonObject deleteCmd;
-                deleteCmd["type"] = "delete_message";
-                deleteCmd["id"] = static_cast<double>(messageId);
-
-                // 7. Отправка уведомлений автору и получателю, если они онлайн
-                QObject* fromSocket = m_clients.value(fromUser, nullptr);
-                if (fromSocket) {
-                    deleteCmd["with_user"] = toUser;
-                    sendJson(fromSocket, deleteCmd);
-                }
-
-                QObject* toSocket = m_clients.value(toUser, nullptr);
-                if (toSocket) {
-                    deleteCmd["with_user"] = fromUser;
-                    sendJson(toSocket, deleteCmd);
-                }
-            } else {
-                qWarning() << "[SERVER] Failed to delete message from DB:" << deleteQuery.lastError().text();
-            }
-        } else {
-            qWarning() << "[SECURITY] User" << requestingUser << "tried to delete a message they do not own (author:" << fromUser << ")";
+    // Быстрый путь: участники известны из кэша владения свежих сообщений.
+    auto cached = m_messageOwners.constFind(messageId);
+    if (cached != m_messageOwners.constEnd()) {
+        if (cached->fromUser != requestingUser) {
+            qWarning() << "[SECURITY] User" << requestingUser
+                       << "tried to delete a message they do not own (author:"
+                       << cached->fromUser << ")";
+            return;
         }
-    } else {
-        qWarning() << "[SERVER] Failed to find message with ID" << messageId << "for deletion.";
+        applyMessageDelete(messageId, requestingUser, cached->toUser);
+        return;
     }
+
+    // Медленный путь: участники неизвестны — дочитываем их асинхронно.
+    // Авторство дополнительно проверит сам условный DELETE.
+    m_dbService->read(
+        [messageId](QSqlDatabase &db) -> QVariant {
+            QSqlQuery &query = StatementCache::get(db,
+                "SELECT fromUser, toUser FROM messages WHERE id = :id");
+            query.bindValue(":id", messageId);
+
+            if (!query.exec() || !query.next()) {
+                return QVariant(); // Сообщение не найдено
+            }
+            return QStringList{query.value("fromUser").toString(),
+                               query.value("toUser").toString()};
+        },
+        this,
+        [this, messageId, requestingUser](const QVariant &result) {
+            if (!result.isValid()) {
+                qWarning() << "[SERVER] Failed to find message with ID" << messageId << "for deletion.";
+                return;
+            }
+
+            const QStringList participants = result.toStringList();
+            if (participants.value(0) != requestingUser) {
+                qWarning() << "[SECURITY] User" << requestingUser
+                           << "tried to delete a message they do not own (author:"
+                           << participants.value(0) << ")";
+                return;
+            }
+
+            applyMessageDelete(messageId, requestingUser, participants.value(1));
+        });
 }
 
 
@@ -3127,7 +8286,7 @@ void Server::handleContactRequestResponse(QObject* clientSocket, const QJsonObje
     qDebug() << "[SERVER] Received contact_request_response:" << request;
 
     // 1. Определяем участников: пользователь, ответивший (toUsername), и отправитель запроса (fromUsername).
-    QString toUsername = m_clientsReverse.value(clientSocket);
+    QString toUsername = m_sessions.usernameOf(clientSocket);
     QString fromUsername = request["fromUsername"].toString();
     QString response = request["response"].toString();
 
@@ -3173,9 +8332,29 @@ void Server::handleContactRequestResponse(QObject* clientSocket, const QJsonObje
         if (updateQuery.exec() && updateQuery.numRowsAffected() > 0) {
             qDebug() << "[SERVER]" << toUsername << "accepted contact request from" << fromUsername;
 
+            // Запрос перестал быть входящим — список получателя устарел
+            m_readCache.invalidatePendingFor(toUsername);
+
             // Получаем сокеты обоих пользователей
-            QObject* fromSocket = m_clients.value(fromUsername, nullptr);
-            QObject* toSocket = m_clients.value(toUsername, nullptr);
+            QObject* fromSocket = m_sessions.socketOf(fromUsername);
+            QObject* toSocket = m_sessions.socketOf(toUsername);
+
+            // Каждый появился в списке другого: версии обоих списков растут,
+            // офлайн-сторона получит изменение дельтой при следующем входе.
+            recordContactDelta(fromUsername, toUsername, false);
+            recordContactDelta(toUsername, fromUsername, false);
+
+            // Ответная половина обмена ключами E2E: публичный ключ
+            // принявшей стороны едет инициатору той же ретрансляцией,
+            // без хранения на сервере (офлайн-инициатор обменяется
+            // ключами при следующем живом контакте)
+            if (fromSocket && request.contains("e2e_key")) {
+                QJsonObject accepted;
+                accepted["type"] = "contact_accepted";
+                accepted["fromUsername"] = toUsername;
+                accepted["e2e_key"] = request["e2e_key"];
+                sendJson(fromSocket, accepted);
+            }
 
             // Отправляем обновлённые списки контактов
             if (fromSocket) sendContactList(fromSocket, fromUsername);
@@ -3194,6 +8373,7 @@ void Server::handleContactRequestResponse(QObject* clientSocket, const QJsonObje
 
         if (deleteQuery.exec()) {
             qDebug() << "[SERVER]" << toUsername << "declined contact request from" << fromUsername;
+            m_readCache.invalidatePendingFor(toUsername);
         }
     } else {
         qWarning() << "[SERVER] Unknown response value in contact request response:" << response;
@@ -3204,10 +8384,10 @@ void Server::handleContactRequestResponse(QObject* clientSocket, const QJsonObje
 /**
  * @brief Отправляет клиенту счетчики непрочитанных сообщений, сгруппированные по отправителям.
  *
- * @details Метод выполняет запрос к базе данных для подсчёта всех сообщений,
- * адресованных указанному пользователю, которые ещё не были прочитаны (`is_read = 0`).
- * Результаты группируются по полю `fromUser` (отправитель), и для каждого подсчитывается количество.
- * Затем формируется JSON-объект с результатами, который отправляется клиенту.
+ * @details Метод читает материализованные счетчики из таблицы `unread_counts`
+ * (по одному значению на отправителя), которые инкрементально поддерживаются
+ * при сохранении (`handlePrivateMessage`) и прочтении (`handleMessageRead`)
+ * сообщений. Затем формируется JSON-объект с результатами, который отправляется клиенту.
  * 
  * Это позволяет клиентскому приложению отображать индикаторы количества новых сообщений.
  * 
@@ -3218,53 +8398,47 @@ void Server::sendUnreadCounts(QObject* socket, const QString& username)
 {
     qDebug() << "[SERVER][UNREAD] Gathering unread message counts for user:" << username;
 
-    // 1. Получаем ID пользователя (хотя в основном запросе он не используется, это хорошая практика)
-    QSqlQuery idQuery;
-    idQuery.prepare("SELECT id FROM users WHERE username = :username");
-    idQuery.bindValue(":username", username);
-    if (!idQuery.exec() || !idQuery.next()) {
-        qDebug() << "[SERVER][UNREAD][ERROR] Failed to find ID for user:" << username;
-        return;
-    }
-    qint64 userId = idQuery.value(0).toLongLong();
-    Q_UNUSED(userId); // В данном запросе ID не используется
+    QPointer<QObject> socketGuard(socket);
 
-    // 2. Основной запрос: подсчитываем непрочитанные сообщения, группируя по отправителю
-    QSqlQuery query;
-    query.prepare(
-        "SELECT fromUser, COUNT(*) as unread_count "
-        "FROM messages "
-        "WHERE toUser = :username AND is_read = 0 "
-        "GROUP BY fromUser"
-    );
-    query.bindValue(":username", username);
+    // Счетчики материализованы в unread_counts (поддерживаются инкрементально
+    // при сохранении/прочтении сообщений), поэтому логин стоит один индексный
+    // SELECT по префиксу первичного ключа вместо COUNT(*) по всей истории.
+    m_dbService->read(
+        [username](QSqlDatabase &db) -> QVariant {
+            QSqlQuery &query = StatementCache::get(db,
+                "SELECT fromUser, unread AS unread_count "
+                "FROM unread_counts "
+                "WHERE toUser = :username AND unread > 0");
+            query.bindValue(":username", username);
 
-    if (!query.exec()) {
-        qDebug() << "[SERVER][UNREAD][ERROR] Database query failed:" << query.lastError().text();
-        return;
-    }
+            QJsonArray countsArray;
 
-    // 3. Формируем JSON-массив с результатами
-    QJsonArray countsArray;
-    while (query.next()) {
-        QJsonObject countObject;
-        countObject["username"] = query.value("fromUser").toString();
-        countObject["count"] = query.value("unread_count").toInt();
-        countsArray.append(countObject);
-    }
+            if (!query.exec()) {
+                qDebug() << "[SERVER][UNREAD][ERROR] Database query failed:" << query.lastError().text();
+                return countsArray;
+            }
 
-    if (countsArray.isEmpty()) {
-        qDebug() << "[SERVER][UNREAD] No unread messages found for user:" << username;
-        // Можно отправить пустой массив клиенту, если нужно
-    }
+            while (query.next()) {
+                QJsonObject countObject;
+                countObject["username"] = query.value("fromUser").toString();
+                countObject["count"] = query.value("unread_count").toInt();
+                countsArray.append(countObject);
+            }
 
-    // 4. Упаковываем и отправляем JSON-ответ клиенту
-    QJsonObject response;
-    response["type"] = "unread_counts";
-    response["counts"] = countsArray;
+            return countsArray;
+        },
+        this,
+        [this, socketGuard, username](const QVariant &result) {
+            if (!socketGuard) return;
 
-    qDebug() << "[SERVER][UNREAD] Sending unread counts to" << username << ":" << response;
-    sendJson(socket, response);
+            // Упаковываем и отправляем JSON-ответ клиенту
+            QJsonObject response;
+            response["type"] = "unread_counts";
+            response["counts"] = result.toJsonArray();
+
+            qDebug() << "[SERVER][UNREAD] Sending unread counts to" << username << ":" << response;
+            sendJson(socketGuard.data(), response);
+        });
 }
 
 
@@ -3272,7 +8446,7 @@ void Server::sendUnreadCounts(QObject* socket, const QString& username)
  * @brief Отправляет список онлайн-пользователей одному конкретному клиенту.
  *
  * @details Формирует JSON-сообщение с типом "user_list", содержащее список имен
- * всех пользователей, которые в данный момент подключены к серверу (находятся в `m_clients`).
+ * всех пользователей, которые в данный момент подключены к серверу (аутентифицированные сессии).
  * 
  * В отличие от `broadcastUserList()`, которая делает рассылку всем, этот метод
  * отправляет данные **только одному** указанному сокету.
@@ -3286,8 +8460,8 @@ void Server::sendUnreadCounts(QObject* socket, const QString& username)
  */
 void Server::sendOnlineStatusList(QObject* clientSocket)
 {
-    // 1. Получаем список всех онлайн-пользователей из ключей карты m_clients.
-    QStringList onlineUsers = m_clients.keys();
+    // 1. Получаем список всех онлайн-пользователей из реестра сессий.
+    QStringList onlineUsers = m_sessions.onlineUsernames();
 
     // 2. Создаем JSON-сообщение.
     QJsonObject message;
@@ -3301,6 +8475,219 @@ void Server::sendOnlineStatusList(QObject* clientSocket)
 }
 
 
+/**
+ * @brief Вручает сообщения, удержанные очередью доставки, из памяти.
+ *
+ * @details Сообщения, принятые в окно после обрыва соединения получателя,
+ * лежат готовыми JSON-копиями в OutboundQueue. Вручаем их в порядке приема
+ * обычными `private_message` — клиент подтвердит их штатными
+ * message_delivered, и статусы в БД сойдутся с обычной онлайн-доставкой.
+ *
+ * БД-проход можно пропустить, только если окно покрыло зазор целиком:
+ * при переполнении очереди или истекшем окне выдачу завершает прежний
+ * постраничный путь из БД.
+ */
+bool Server::flushOutboundQueue(QObject* socket, const QString& username)
+{
+    QList<QJsonObject> held;
+    bool overflowed = false;
+
+    if (!m_outboundQueue.take(username, QDateTime::currentMSecsSinceEpoch(),
+                              &held, &overflowed)) {
+        return false; // Окна не было (долгий офлайн) — обычный путь из БД
+    }
+
+    for (QJsonObject message : std::as_const(held)) {
+        message["type"] = "private_message";
+        sendJson(socket, message);
+    }
+
+    if (!held.isEmpty()) {
+        qDebug() << "[SERVER]" << held.size() << "message(s) flushed from the"
+                 << "grace-window queue to" << username
+                 << (overflowed ? "(overflowed - DB pass follows)" : "");
+    }
+
+    return !overflowed;
+}
+
+
+void Server::sendOfflineMessages(QObject* socket, const QString& username)
+{
+    // Инициализируем состояние выдачи и запрашиваем первое окно. Дальше
+    // выдачу двигают подтверждения клиента (см. handleMessageDelivered).
+    OfflineDelivery state;
+    state.username = username;
+    m_offlineDeliveries.insert(socket, state);
+
+    sendNextOfflineBatch(socket);
+}
+
+
+/**
+ * @brief Выдает клиенту следующее окно недоставленных сообщений.
+ *
+ * @details Выбирает из БД не более OfflineBatchSize сообщений с
+ * `is_delivered = 0` (в порядке возрастания ID, т.е. от старых к новым)
+ * и отправляет их клиенту обычными `private_message`. Подтвержденные ранее
+ * окна в выборку уже не попадают — их пометил handleMessageDelivered.
+ * Пустая выборка означает, что выдача завершена.
+ *
+ * @param socket Сокет клиента с активной выдачей (см. m_offlineDeliveries).
+ */
+void Server::sendNextOfflineBatch(QObject* socket)
+{
+    auto it = m_offlineDeliveries.find(socket);
+    if (it == m_offlineDeliveries.end()) return;
+
+    const QString username = it->username;
+    QPointer<QObject> socketGuard(socket);
+
+    m_dbService->read(
+        [username](QSqlDatabase &db) -> QVariant {
+            QSqlQuery &query = StatementCache::get(db,
+                "SELECT id, fromUser, toUser, payload, timestamp, reply_to_id, chat_seq, is_read, is_edited, is_delivered, file_id, file_name, file_url "
+                "FROM messages "
+                "WHERE toUser = :username AND is_delivered = 0 "
+                "ORDER BY id ASC LIMIT " + QString::number(OfflineBatchSize));
+            query.bindValue(":username", username);
+
+            QJsonArray batchArray;
+
+            if (!query.exec()) {
+                qWarning() << "[SERVER] Failed to fetch offline messages for" << username
+                           << ":" << query.lastError().text();
+                return batchArray;
+            }
+
+            while (query.next()) {
+                QSqlRecord record = query.record();
+                QJsonObject messageObject;
+
+                messageObject["id"] = record.value("id").toLongLong();
+                messageObject["fromUser"] = record.value("fromUser").toString();
+                messageObject["toUser"] = record.value("toUser").toString();
+                messageObject["payload"] = Compression::unpackText(record.value("payload"));
+                messageObject["timestamp"] = static_cast<double>(record.value("timestamp").toLongLong());
+                messageObject["is_read"] = record.value("is_read").toInt();
+                messageObject["is_delivered"] = record.value("is_delivered").toInt();
+                messageObject["is_edited"] = record.value("is_edited").toInt();
+                messageObject["reply_to_id"] = record.value("reply_to_id").toLongLong();
+                messageObject["chat_seq"] = record.value("chat_seq").toLongLong();
+                messageObject["file_id"] = record.value("file_id").toString();
+                messageObject["file_name"] = record.value("file_name").toString();
+                messageObject["file_url"] = record.value("file_url").toString();
+
+                batchArray.append(messageObject);
+            }
+
+            return batchArray;
+        },
+        this,
+        [this, socketGuard](const QVariant &result) {
+            if (!socketGuard) return;
+
+            auto it = m_offlineDeliveries.find(socketGuard.data());
+            if (it == m_offlineDeliveries.end()) return; // Выдача уже снята
+
+            const QJsonArray batch = result.toJsonArray();
+
+            if (batch.isEmpty()) {
+                // Недоставленных сообщений больше нет — выдача завершена.
+                qDebug() << "[SERVER] Offline delivery finished for" << it->username;
+                m_offlineDeliveries.erase(it);
+                return;
+            }
+
+            // Окно считается открытым, пока клиент не подтвердит все его
+            // сообщения через message_delivered.
+            it->outstanding = batch.size();
+
+            for (const QJsonValue& value : batch) {
+                QJsonObject message = value.toObject();
+                message["type"] = "private_message";
+                sendJson(socketGuard.data(), message);
+            }
+
+            qDebug() << "[SERVER] Offline window of" << batch.size()
+                     << "message(s) sent to" << it->username;
+        });
+}
+
+
+void Server::deliverPendingGroupMessages(QObject* socket, const QString& username)
+{
+    // Верхняя граница разовой выдачи: объем очереди ограничен временем
+    // офлайна и активностью групп; остаток доберется при следующем входе.
+    static constexpr int PendingGroupBatchSize = 200;
+
+    QPointer<QObject> socketGuard(socket);
+
+    m_dbService->read(
+        [username](QSqlDatabase &db) -> QVariant {
+            QSqlQuery &query = StatementCache::get(db,
+                "SELECT gm.id, gm.group_id, gm.fromUser, gm.payload, gm.timestamp "
+                "FROM group_pending gp "
+                "JOIN group_messages gm ON gm.id = gp.message_id "
+                "WHERE gp.username = :username "
+                "ORDER BY gm.id ASC LIMIT " + QString::number(PendingGroupBatchSize));
+            query.bindValue(":username", username);
+
+            QJsonArray batchArray;
+
+            if (!query.exec()) {
+                qWarning() << "[SERVER] Failed to fetch pending group messages for"
+                           << username << ":" << query.lastError().text();
+                return batchArray;
+            }
+
+            while (query.next()) {
+                QJsonObject messageObject;
+                messageObject["type"] = "group_message";
+                messageObject["id"] = query.value(0).toLongLong();
+                messageObject["group_id"] = query.value(1).toLongLong();
+                messageObject["fromUser"] = query.value(2).toString();
+                messageObject["payload"] = Compression::unpackText(query.value(3));
+                messageObject["timestamp"] = static_cast<double>(query.value(4).toLongLong());
+                batchArray.append(messageObject);
+            }
+
+            return batchArray;
+        },
+        this,
+        [this, socketGuard, username](const QVariant &result) {
+            const QJsonArray batch = result.toJsonArray();
+            if (batch.isEmpty() || !socketGuard) return;
+
+            for (const QJsonValue& value : batch) {
+                sendJson(socketGuard.data(), value.toObject());
+            }
+
+            qDebug() << "[SERVER]" << batch.size()
+                     << "pending group message(s) sent to" << username;
+
+            // Выданные строки снимаются одним DELETE; все, что новее границы
+            // выдачи, осталось в очереди и доберется при следующем входе.
+            const qint64 maxId = static_cast<qint64>(
+                batch.last().toObject()["id"].toDouble());
+
+            m_dbService->post([username, maxId](QSqlDatabase &db) -> QVariant {
+                QSqlQuery &purge = StatementCache::get(db,
+                    "DELETE FROM group_pending "
+                    "WHERE username = :username AND message_id <= :maxId");
+                purge.bindValue(":username", username);
+                purge.bindValue(":maxId", maxId);
+
+                if (!purge.exec()) {
+                    qWarning() << "[DB] Failed to purge delivered group messages for"
+                               << username << ":" << purge.lastError().text();
+                }
+                return QVariant();
+            });
+        });
+}
+
+
 /**
  * @brief Находит и отправляет пользователю список ожидающих подтверждения запросов в контакты.
  *
@@ -3318,6 +8705,20 @@ void Server::sendPendingContactRequests(QObject* socket, const QString& username
 {
     qDebug() << "[SERVER][PENDING] Checking for pending requests for user:" << username;
 
+    // 0. Быстрый путь: список уже в кэше (в том числе пустой — у
+    // большинства пользователей входящих запросов нет, и именно их входы
+    // давали основную массу запросов к БД)
+    QJsonArray cachedRequests;
+    if (m_readCache.getPendingRequests(username, &cachedRequests)) {
+        if (!cachedRequests.isEmpty()) {
+            QJsonObject response;
+            response["type"] = "pending_requests_list";
+            response["requests"] = cachedRequests;
+            sendJson(socket, response);
+        }
+        return;
+    }
+
     // 1. Получаем ID пользователя
     QSqlQuery userQuery;
     userQuery.prepare("SELECT id FROM users WHERE username = :username");
@@ -3362,6 +8763,10 @@ void Server::sendPendingContactRequests(QObject* socket, const QString& username
     }
     qDebug() << "[SERVER][PENDING] Total pending requests found:" << pendingRequests.count();
 
+    // Запоминаем результат (включая пустой): следующий вход этого
+    // пользователя обслужится из памяти до первой инвалидации
+    m_readCache.storePendingRequests(username, pendingRequests);
+
     // 4. Отправляем JSON с запросами, если есть хоть один
     if (!pendingRequests.isEmpty()) {
         qDebug() << "[SERVER] Sending" << pendingRequests.count() << "pending contact requests to" << username;
@@ -3408,7 +8813,7 @@ void Server::handleCallRequest(QObject* socket, const QJsonObject& request)
     QString callerIp = request["caller_ip"].toString();
     
     // Поиск сокета получателя
-    QObject* toUserSocket = m_clients.value(toUser, nullptr);
+    QObject* toUserSocket = m_sessions.socketOf(toUser);
 
     // Добавляем запись о звонке в БД и внутреннюю структуру сервера
     createCallRecord(callId, fromUser, toUser, callerIp, callerPort);
@@ -3425,13 +8830,20 @@ void Server::handleCallRequest(QObject* socket, const QJsonObject& request)
     // Сохраняем звонок в карте активных звонков
     m_activeCalls[callId] = callInfo;
 
-    // Формируем JSON-сообщение для получателя вызова
-    QJsonObject incomingCall;
-    incomingCall["type"] = "call_request";
+    // Открываем сессию ретрансляции: если прямые датаграммы не пройдут
+    // (симметричный NAT), обе стороны смогут говорить через relay_port.
+    m_callRelay->openSession(callId);
+
+    // Быстрый путь пересылки: получателю уходит исходный запрос с
+    // подправленными полями маршрутизации, а не пересобранный поле за полем
+    // объект. QJsonObject неявно разделяем — копия не перепарсивает тяжелые
+    // поля (SDP, кандидаты ICE), а незнакомые серверу поля доезжают до
+    // второй стороны как есть.
+    QJsonObject incomingCall = request;
     incomingCall["from"] = fromUser;
-    incomingCall["call_id"] = callId;
-    incomingCall["caller_ip"] = callerIp;
-    incomingCall["caller_port"] = static_cast<int>(callerPort);
+    if (m_callRelay->enabled()) {
+        incomingCall["relay_port"] = static_cast<int>(m_callRelay->port());
+    }
 
     // Отправляем запрос получателю, если он онлайн
     if (toUserSocket) {
@@ -3440,6 +8852,7 @@ void Server::handleCallRequest(QObject* socket, const QJsonObject& request)
     } else {
         // Если получатель офлайн, помечаем вызов пропущенным
         updateCallEnded(callId, "missed");
+        m_callRelay->closeSession(callId);
         qDebug() << "[CALL]" << toUser << "is offline - call marked as missed";
     }
 }
@@ -3465,7 +8878,7 @@ void Server::handleCallAccepted(QObject* socket, const QJsonObject& request)
     qDebug() << "[SERVER] Processing message of type: call_accepted";
 
     // Определяем пользователя, который ответил на звонок
-    QString respondingUser = m_clientsReverse.value(socket);
+    QString respondingUser = m_sessions.usernameOf(socket);
     QString callId = request.value("call_id").toString();
     quint16 calleePort = static_cast<quint16>(request.value("callee_port").toInt());
     QString calleeIp = request.value("callee_ip").toString();
@@ -3484,12 +8897,13 @@ void Server::handleCallAccepted(QObject* socket, const QJsonObject& request)
     // Отправляем уведомление инициатору звонка (caller)
     QObject* initiatorSocket = info.fromSocket;
     if (initiatorSocket) {
-        QJsonObject response;
-        response["type"] = "call_accepted";
+        // Тот же быстрый путь, что и в handleCallRequest: исходный запрос
+        // с подправленной маршрутизацией вместо пересборки объекта.
+        QJsonObject response = request;
         response["from"] = respondingUser;
-        response["call_id"] = callId;
-        response["callee_ip"] = calleeIp;
-        response["callee_port"] = static_cast<int>(calleePort);
+        if (m_callRelay->enabled()) {
+            response["relay_port"] = static_cast<int>(m_callRelay->port());
+        }
 
         sendJson(initiatorSocket, response);
         qDebug() << "[CALL] Notified caller about accepted call, call_id:" << callId;
@@ -3532,9 +8946,9 @@ void Server::handleCallRejected(QObject* socket, const QJsonObject& request)
     QObject* fromUserSocket = callInfo.fromSocket;
 
     // Проверка безопасности: отклонять звонок может только вызываемый (toUser)
-    if (toUser != m_clientsReverse.value(socket)) {
+    if (toUser != m_sessions.usernameOf(socket)) {
         qWarning() << "[SERVER] SECURITY: Unauthorized call rejection attempt from"
-                   << m_clientsReverse.value(socket) << "for call ID" << callId;
+                   << m_sessions.usernameOf(socket) << "for call ID" << callId;
         return;
     }
 
@@ -3543,6 +8957,7 @@ void Server::handleCallRejected(QObject* socket, const QJsonObject& request)
 
     // Удаляем звонок из списка активных
     m_activeCalls.remove(callId);
+    m_callRelay->closeSession(callId);
 
     // Формируем уведомление для инициатора звонка
     QJsonObject rejectionNotification;
@@ -3578,10 +8993,10 @@ void Server::handleCallRejected(QObject* socket, const QJsonObject& request)
 void Server::handleCallEnd(QObject* socket, const QJsonObject& request)
 {
     QString callId = request["call_id"].toString();
-    QString currentUser = m_clientsReverse.value(socket);
+    QString currentUser = m_sessions.usernameOf(socket);
 
-    // Обновляем статус звонка в БД
-    updateCallEnded(callId, "completed");
+    // Обновляем статус звонка в БД вместе с телеметрией качества клиента
+    updateCallEnded(callId, "completed", request["stats"].toObject());
 
     if (!m_activeCalls.contains(callId)) {
         qDebug() << "[SERVER] Active calls:" << m_activeCalls.keys();
@@ -3606,6 +9021,7 @@ void Server::handleCallEnd(QObject* socket, const QJsonObject& request)
 
     // Удаляем звонок из активных
     m_activeCalls.remove(callId);
+    m_callRelay->closeSession(callId);
 
     // Формируем уведомление о завершении звонка
     QJsonObject endNotification;
@@ -3622,6 +9038,124 @@ void Server::handleCallEnd(QObject* socket, const QJsonObject& request)
 }
 
 
+/**
+ * @brief Создает конференцию: комнату микшера и список приглашаемых.
+ *
+ * @details Комната получает выделенный поток и UDP-порт асинхронно,
+ * поэтому приглашения здесь не рассылаются — список участников
+ * откладывается в m_pendingConferences, а рассылку делает
+ * onConferenceReady, когда микшер сообщит привязанный порт.
+ *
+ * @param socket Сокет создателя конференции.
+ * @param request JSON-объект с полями:
+ *        - `members`: Массив логинов приглашаемых участников.
+ */
+void Server::handleConferenceCreate(QObject* socket, const QJsonObject& request)
+{
+    const QString fromUser = m_sessions.usernameOf(socket);
+    if (fromUser.isEmpty()) {
+        return;
+    }
+
+    QStringList members;
+    const QJsonArray rawMembers = request["members"].toArray();
+    for (const QJsonValue& value : rawMembers) {
+        const QString member = value.toString();
+        if (!member.isEmpty() && member != fromUser) {
+            members.append(member);
+        }
+    }
+    if (members.isEmpty()) {
+        QJsonObject response;
+        response["type"] = "conference_create_response";
+        response["status"] = "error";
+        response["message"] = "No members to invite";
+        sendJson(socket, response);
+        return;
+    }
+
+    const QString conferenceId =
+        QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    m_pendingConferences.insert(conferenceId, qMakePair(fromUser, members));
+    m_conferenceMixer->createConference(conferenceId);
+
+    qDebug() << "[CONF] Conference" << conferenceId << "requested by" << fromUser
+             << "with" << members.size() << "invitees";
+}
+
+
+/**
+ * @brief Комната микшера привязала UDP-порт: рассылает приглашения.
+ *
+ * @details Создатель получает `conference_created` с портом комнаты,
+ * каждый онлайн-участник — `conference_invite`. Все стороны (включая
+ * создателя) регистрируются в микшере сразу: их адреса привяжутся,
+ * когда клиенты пришлют датаграмму-приветствие на порт комнаты.
+ *
+ * @param conferenceId Идентификатор комнаты.
+ * @param udpPort Привязанный UDP-порт микса.
+ */
+void Server::onConferenceReady(const QString& conferenceId, quint16 udpPort)
+{
+    const auto pending = m_pendingConferences.take(conferenceId);
+    const QString& creator = pending.first;
+    const QStringList& members = pending.second;
+    if (creator.isEmpty()) {
+        return;
+    }
+
+    m_conferenceMixer->addParticipant(conferenceId, creator);
+
+    QJsonObject invite;
+    invite["type"] = "conference_invite";
+    invite["conf_id"] = conferenceId;
+    invite["from"] = creator;
+    invite["udp_port"] = static_cast<int>(udpPort);
+
+    for (const QString& member : members) {
+        m_conferenceMixer->addParticipant(conferenceId, member);
+        QObject* memberSocket = m_sessions.socketOf(member);
+        if (memberSocket) {
+            sendJson(memberSocket, invite);
+        }
+    }
+
+    QObject* creatorSocket = m_sessions.socketOf(creator);
+    if (creatorSocket) {
+        QJsonObject created;
+        created["type"] = "conference_created";
+        created["conf_id"] = conferenceId;
+        created["udp_port"] = static_cast<int>(udpPort);
+        sendJson(creatorSocket, created);
+    }
+
+    qDebug() << "[CONF] Invitations sent for conference" << conferenceId
+             << "port" << udpPort;
+}
+
+
+/**
+ * @brief Выводит участника из конференции.
+ *
+ * @details Кодеки участника освобождаются на потоке комнаты; когда
+ * выходит последний, воркер сообщает becameEmpty и микшер закрывает
+ * комнату вместе с ее потоком и портом.
+ *
+ * @param socket Сокет выходящего участника.
+ * @param request JSON-объект с полем `conf_id`.
+ */
+void Server::handleConferenceLeave(QObject* socket, const QJsonObject& request)
+{
+    const QString user = m_sessions.usernameOf(socket);
+    const QString conferenceId = request["conf_id"].toString();
+    if (user.isEmpty() || conferenceId.isEmpty()) {
+        return;
+    }
+    m_conferenceMixer->removeParticipant(conferenceId, user);
+}
+
+
 /**
  * @brief Создаёт новую запись звонка в базе данных при поступлении call_request.
  *
@@ -3704,8 +9238,11 @@ void Server::updateCallConnected(const QString& callId, const QString& toIp, qui
  * 
  * @param callId Уникальный идентификатор звонка.
  * @param status Новый статус звонка: например, "completed", "rejected", "missed".
+ * @param stats Телеметрия качества от клиента (jitter_ms, loss_percent,
+ *        rtt_ms, reorder_count, concealed_frames); пустой объект — без телеметрии.
  */
-void Server::updateCallEnded(const QString& callId, const QString& status)
+void Server::updateCallEnded(const QString& callId, const QString& status,
+                             const QJsonObject& stats)
 {
     QSqlQuery query;
     query.prepare(
@@ -3713,7 +9250,8 @@ void Server::updateCallEnded(const QString& callId, const QString& status)
         "SET status = :status, "
         "    end_time = :endTime, "
         "    duration_seconds = CAST((julianday(:endTime) - julianday(connect_time)) * 86400 AS INTEGER) "
-        "WHERE call_id = :callId"
+        "WHERE call_id = :callId "
+        "AND status NOT IN ('completed', 'rejected', 'missed')"
     );
 
     query.bindValue(":callId", callId);
@@ -3722,8 +9260,98 @@ void Server::updateCallEnded(const QString& callId, const QString& status)
 
     if (!query.exec()) {
         qWarning() << "[CALL] DB Error updating call ended:" << query.lastError().text();
-    } else {
-        qDebug() << "[CALL] Updated call as" << status << ":" << callId;
+        return;
+    }
+
+    // Условие на статус делает завершение идемпотентным: call_end приходит
+    // от обеих сторон звонка, а инкременты rollup'а ниже должны примениться
+    // ровно один раз — только при фактическом переходе в конечный статус.
+    if (query.numRowsAffected() == 0) {
+        qDebug() << "[CALL] Call" << callId << "already finalized, skipping";
+        return;
+    }
+
+    qDebug() << "[CALL] Updated call as" << status << ":" << callId;
+
+    // Телеметрия качества пишется отдельным UPDATE: основной запрос выше
+    // защищен идемпотентностью, а метрики приходят только от той стороны,
+    // которая успела завершить звонок первой.
+    if (!stats.isEmpty()) {
+        QSqlQuery quality;
+        quality.prepare(
+            "UPDATE call_history "
+            "SET avg_jitter_ms = :jitter, "
+            "    loss_percent = :loss, "
+            "    rtt_ms = :rtt, "
+            "    reorder_count = :reorder, "
+            "    concealed_frames = :concealed "
+            "WHERE call_id = :callId");
+        quality.bindValue(":jitter", stats["jitter_ms"].toDouble());
+        quality.bindValue(":loss", stats["loss_percent"].toInt());
+        quality.bindValue(":rtt", stats["rtt_ms"].toInt(-1));
+        quality.bindValue(":reorder", stats["reorder_count"].toInt());
+        quality.bindValue(":concealed", qlonglong(stats["concealed_frames"].toDouble()));
+        quality.bindValue(":callId", callId);
+        if (!quality.exec()) {
+            qWarning() << "[CALL] DB Error saving call quality stats:"
+                       << quality.lastError().text();
+        }
+    }
+
+    // Инкрементальный rollup call_stats: по завершенному звонку суммы обеих
+    // сторон сдвигаются на O(1), и handleGetCallStats читает одну строку
+    // вместо агрегации всей call_history.
+    QSqlQuery roles;
+    roles.prepare("SELECT caller_username, callee_username, "
+                  "COALESCE(duration_seconds, 0) "
+                  "FROM call_history WHERE call_id = :callId");
+    roles.bindValue(":callId", callId);
+
+    if (!roles.exec() || !roles.next()) {
+        qWarning() << "[CALL] Cannot load call for stats rollup:" << callId;
+        return;
+    }
+
+    const QString caller = roles.value(0).toString();
+    const QString callee = roles.value(1).toString();
+    const int duration = (status == QLatin1String("completed"))
+                             ? roles.value(2).toInt() : 0;
+    const int completed = (status == QLatin1String("completed")) ? 1 : 0;
+    const int missed = (status == QLatin1String("missed")) ? 1 : 0;
+
+    QSqlQuery upsert;
+    upsert.prepare(
+        "INSERT INTO call_stats (username, outgoing, incoming, completed, "
+        "missed, total_duration_sec) "
+        "VALUES (:user, :outgoing, :incoming, :completed, :missed, :duration) "
+        "ON CONFLICT(username) DO UPDATE SET "
+        "outgoing = outgoing + :outgoing, "
+        "incoming = incoming + :incoming, "
+        "completed = completed + :completed, "
+        "missed = missed + :missed, "
+        "total_duration_sec = total_duration_sec + :duration");
+
+    // Сторона инициатора: исходящий; пропущенные учитываются только у callee.
+    upsert.bindValue(":user", caller);
+    upsert.bindValue(":outgoing", 1);
+    upsert.bindValue(":incoming", 0);
+    upsert.bindValue(":completed", completed);
+    upsert.bindValue(":missed", 0);
+    upsert.bindValue(":duration", duration);
+    if (!upsert.exec()) {
+        qWarning() << "[CALL] Stats rollup failed for" << caller
+                   << ":" << upsert.lastError().text();
+    }
+
+    upsert.bindValue(":user", callee);
+    upsert.bindValue(":outgoing", 0);
+    upsert.bindValue(":incoming", 1);
+    upsert.bindValue(":completed", completed);
+    upsert.bindValue(":missed", missed);
+    upsert.bindValue(":duration", duration);
+    if (!upsert.exec()) {
+        qWarning() << "[CALL] Stats rollup failed for" << callee
+                   << ":" << upsert.lastError().text();
     }
 }
 
@@ -3731,40 +9359,83 @@ void Server::updateCallEnded(const QString& callId, const QString& status)
 /**
  * @brief Обрабатывает запрос на получение истории звонков пользователя.
  *
- * @details Метод извлекает из таблицы `call_history` до 50 последних звонков,
- * где указанный пользователь был либо инициатором, либо получателем звонка.
- * Результаты сортируются по времени начала звонка в порядке убывания.
- * Для каждого звонка в ответ добавляется поле `call_type`, указывающее
- * направление звонка относительно пользователя (`incoming` или `outgoing`).
- * 
- * Созданный JSON с массивом звонков отправляется клиенту.
+ * @details Отдает одну страницу истории звонков (keyset-пагинация):
+ * до `limit` (потолок — 50) последних звонков, где пользователь был
+ * инициатором или получателем, отсортированных по убыванию
+ * (start_time, call_id). Курсор составной — `before` (start_time последней
+ * строки предыдущей страницы) плюс `before_id` (ее call_id): start_time
+ * имеет секундную точность, и одиночный курсор по нему молча терял бы
+ * звонки, разделившие секунду с граничной строкой. Смещение не
+ * сканируется — каждая страница идет по индексу idx_call_start_time_id
+ * с того же места. Для каждого звонка в ответ добавляется поле
+ * `call_type`, указывающее направление звонка относительно пользователя
+ * (`incoming` или `outgoing`).
+ *
+ * Ответ содержит `has_more` — есть ли за последней строкой еще звонки
+ * (выбирается limit+1 строк, лишняя отбрасывается).
  *
  * @param socket Сокет клиента, запрашивающего историю.
- * @param request JSON-объект с полем:
+ * @param request JSON-объект с полями:
  *        - `username`: Имя пользователя, для которого выводится история.
+ *        - `before`: Курсор страницы, start_time (необязателен; пусто — первая).
+ *        - `before_id`: Вторая компонента курсора, call_id граничной строки.
+ *        - `limit`: Размер страницы (необязателен; потолок 50).
  */
 void Server::handleGetCallHistory(QObject* socket, const QJsonObject& request)
 {
     QString username = request["username"].toString();
+    const QString before = request["before"].toString();
+    const QString beforeId = request["before_id"].toString();
+
+    constexpr int PageLimit = 50;
+    int limit = request["limit"].toInt();
+    if (limit <= 0 || limit > PageLimit) {
+        limit = PageLimit;
+    }
+
+    // Составное условие курсора: строки той же секунды, что и граничная,
+    // добираются по call_id — ни одна не теряется на стыке страниц.
+    QString cursorClause;
+    if (!before.isEmpty()) {
+        cursorClause = beforeId.isEmpty()
+            ? QStringLiteral("AND start_time < :before ")
+            : QStringLiteral("AND (start_time < :before "
+                             "OR (start_time = :before AND call_id < :beforeId)) ");
+    }
 
     QSqlQuery query;
-    query.prepare(
+    query.prepare(QStringLiteral(
         "SELECT call_id, caller_username, callee_username, status, "
         "       start_time, end_time, duration_seconds "
         "FROM call_history "
-        "WHERE caller_username = :user OR callee_username = :user "
-        "ORDER BY start_time DESC LIMIT 50"
-    );
+        "WHERE (caller_username = :user OR callee_username = :user) %1"
+        "ORDER BY start_time DESC, call_id DESC LIMIT :limit")
+        .arg(cursorClause));
     query.bindValue(":user", username);
+    if (!before.isEmpty()) {
+        query.bindValue(":before", before);
+        if (!beforeId.isEmpty()) {
+            query.bindValue(":beforeId", beforeId);
+        }
+    }
+    // Лишняя строка — признак следующей страницы; клиенту не уходит
+    query.bindValue(":limit", limit + 1);
 
     if (!query.exec()) {
         qWarning() << "[CALL] Error fetching call history for user" << username << ":" << query.lastError().text();
+        reportSubsystemFailure(QStringLiteral("stats"),
+                               CircuitBreaker::classifySqlError(query.lastError()));
         sendJson(socket, {{"type", "error"}, {"reason", "Failed to fetch call history"}});
         return;
     }
 
     QJsonArray calls;
+    bool hasMore = false;
     while (query.next()) {
+        if (calls.size() >= limit) {
+            hasMore = true;
+            break;
+        }
         QJsonObject call;
         call["call_id"] = query.value("call_id").toString();
         call["caller"] = query.value("caller_username").toString();
@@ -3783,24 +9454,28 @@ void Server::handleGetCallHistory(QObject* socket, const QJsonObject& request)
     QJsonObject response;
     response["type"] = "call_history";
     response["calls"] = calls;
+    response["has_more"] = hasMore;
 
     sendJson(socket, response);
 
-    qDebug() << "[CALL] Sent call history to" << username << ":" << calls.size() << "records";
+    qDebug() << "[CALL] Sent call history page to" << username << ":"
+             << calls.size() << "records, has_more =" << hasMore;
 }
 
 
 /**
  * @brief Обрабатывает запрос на получение статистики звонков пользователя.
  *
- * @details Метод выполняет агрегатный SQL-запрос для подсчёта:
+ * @details Отдает строку rollup'а call_stats (см. updateCallEnded):
  * - Общее количество исходящих звонков.
  * - Общее количество входящих звонков.
  * - Количество завершённых звонков.
  * - Количество пропущенных вызовов (для вызываемого пользователя).
  * - Общую суммарную длительность завершённых звонков в секундах.
- * 
- * По результатам формируется JSON-объект и отправляется клиенту.
+ *
+ * Исторически счётчики агрегировались по всей call_history на каждый
+ * запрос — у пользователей с тысячами звонков это давало заметные паузы
+ * даже по индексам. Теперь запрос — чтение одной строки по ключу.
  *
  * @param socket Сокет клиента, запросившего статистику.
  * @param request JSON-объект с полем:
@@ -3810,37 +9485,52 @@ void Server::handleGetCallStats(QObject* socket, const QJsonObject& request)
 {
     QString username = request["username"].toString();
 
-    QSqlQuery query;
-    query.prepare(
-        "SELECT "
-        "   COUNT(*) FILTER (WHERE caller_username = :user) AS outgoing_count, "
-        "   COUNT(*) FILTER (WHERE callee_username = :user) AS incoming_count, "
-        "   COUNT(*) FILTER (WHERE status = 'completed') AS completed_count, "
-        "   COUNT(*) FILTER (WHERE status = 'missed' AND callee_username = :user) AS missed_count, "
-        "   SUM(CASE WHEN status = 'completed' THEN duration_seconds ELSE 0 END) AS total_duration "
-        "FROM call_history "
-        "WHERE caller_username = :user OR callee_username = :user"
-    );
+    // Суммы поддерживаются инкрементально в updateCallEnded — здесь только
+    // чтение одной строки rollup'а по первичному ключу (пул читателей).
+    QPointer<QObject> socketGuard(socket);
+    m_dbService->read([username](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &query = StatementCache::get(db,
+            "SELECT outgoing, incoming, completed, missed, total_duration_sec "
+            "FROM call_stats WHERE username = :user");
+        query.bindValue(":user", username);
 
-    query.bindValue(":user", username);
+        if (!query.exec()) {
+            qWarning() << "[CALL] Failed to fetch call stats for user" << username
+                       << ":" << query.lastError().text();
+            return QVariant();
+        }
 
-    if (!query.exec() || !query.next()) {
-        qWarning() << "[CALL] Failed to fetch call stats for user" << username << ":" << query.lastError().text();
-        sendJson(socket, {{"type", "error"}});
-        return;
-    }
+        // Нет строки — пользователь еще не завершил ни одного звонка.
+        QVariantList row{0, 0, 0, 0, 0};
+        if (query.next()) {
+            for (int i = 0; i < row.size(); ++i) {
+                row[i] = query.value(i).toInt();
+            }
+        }
+        return row;
+    },
+    this,
+    [this, socketGuard, username](const QVariant &result) {
+        if (!socketGuard) return;
+
+        if (!result.isValid()) {
+            sendJson(socketGuard.data(), {{"type", "error"}});
+            return;
+        }
 
-    QJsonObject stats;
-    stats["type"] = "call_stats";
-    stats["outgoing"] = query.value("outgoing_count").toInt();
-    stats["incoming"] = query.value("incoming_count").toInt();
-    stats["completed"] = query.value("completed_count").toInt();
-    stats["missed"] = query.value("missed_count").toInt();
-    stats["total_duration_sec"] = query.value("total_duration").toInt();
+        const QVariantList row = result.toList();
+        QJsonObject stats;
+        stats["type"] = "call_stats";
+        stats["outgoing"] = row.value(0).toInt();
+        stats["incoming"] = row.value(1).toInt();
+        stats["completed"] = row.value(2).toInt();
+        stats["missed"] = row.value(3).toInt();
+        stats["total_duration_sec"] = row.value(4).toInt();
 
-    sendJson(socket, stats);
+        sendJson(socketGuard.data(), stats);
 
-    qDebug() << "[CALL] Sent call stats to" << username << ":" << stats;
+        qDebug() << "[CALL] Sent call stats to" << username << ":" << stats;
+    });
 }
 
 
@@ -3849,65 +9539,31 @@ void Server::handleGetCallStats(QObject* socket, const QJsonObject& request)
  *
  * @details Токен используется для автоматического входа (auto-login) без повторного ввода пароля.
  * 
- * **Алгоритм:**
+ * **Алгоритм (см. TokenStore::issue):**
  * 1. Генерирует уникальную строку на основе UUID, имени пользователя и текущего времени.
  * 2. Хеширует эту строку алгоритмом SHA-256 для получения фиксированной длины и обфускации.
- * 3. Сохраняет токен в таблицу `tokens` базы данных с сроком действия **30 дней**.
- *    Используется `INSERT OR REPLACE`, чтобы у пользователя был только один активный токен (для простоты).
- * 4. Обновляет кэш токенов в оперативной памяти (`m_userTokens`) для быстрого доступа.
+ * 3. Кладет токен в hash-кэш немедленно; запись в таблицу `tokens` со сроком
+ *    действия **30 дней** уходит write-behind в поток БД. Используется
+ *    `INSERT OR REPLACE`, чтобы у пользователя был только один активный токен.
  * 
  * @param username Имя пользователя, для которого генерируется токен.
  * @return QString Сгенерированный токен (Hex-строка).
  */
 QString Server::generateToken(const QString& username)
 {
-    // 1. Генерация сырых данных для токена (энтропия)
-    QString rawToken = QUuid::createUuid().toString(QUuid::WithoutBraces) 
-                     + username 
-                     + QString::number(QDateTime::currentMSecsSinceEpoch());
-    
-    // 2. Хеширование для получения красивой строки фиксированной длины
-    QByteArray hash = QCryptographicHash::hash(
-        rawToken.toUtf8(),
-        QCryptographicHash::Sha256
-    );
-    
-    QString token = QString(hash.toHex());
-    
-    // 3. Сохранение в базу данных
-    // datetime('now', '+30 days') — функция SQLite для вычисления даты истечения
-    QSqlQuery query;
-    query.prepare(R"(
-        INSERT OR REPLACE INTO tokens (username, token, expires_at)
-        VALUES (:username, :token, datetime('now', '+30 days'))
-    )");
-    
-    query.bindValue(":username", username);
-    query.bindValue(":token", token);
-    
-    if (!query.exec()) {
-        qWarning() << "[SERVER] Failed to save token to DB for" << username 
-                   << ":" << query.lastError().text();
-    } else {
-        qDebug() << "[SERVER] Token generated and saved for user:" << username;
-    }
-    
-    // 4. Сохранение в памяти для быстрого доступа (O(1))
-    m_userTokens[username] = token;
-    
-    return token;
+    // Генерация, кэширование и write-behind запись инкапсулированы в
+    // TokenStore: ответ клиенту не ждет дисковой фиксации токена.
+    return m_tokenStore->issue(username);
 }
 
 
 /**
  * @brief Проверяет валидность токена пользователя.
  *
- * @details Проверка выполняется в два этапа:
- * 1. Сравнивается с токеном в оперативной памяти (кэш).
- * 2. Если токен в памяти отсутствует или не совпадает, проверяется БД.
- *    При этом учитывается срок действия токена `expires_at`.
- * 3. Если токен в БД валиден, он восстанавливается в кэш.
- * 4. Если токен истёк, удаляется запись из БД.
+ * @details Делегирует проверку TokenStore: все живые токены находятся в
+ * hash-кэше (прогревается из БД при старте), срок действия сравнивается с
+ * монотонными часами. Истекший токен отзывается (память + write-behind
+ * DELETE в БД).
  *
  * @param username Имя пользователя.
  * @param token Токен, который необходимо проверить.
@@ -3916,55 +9572,10 @@ QString Server::generateToken(const QString& username)
  */
 bool Server::validateToken(const QString& username, const QString& token)
 {
-    // 1. Проверяем токен в оперативном кэше
-    if (m_userTokens.contains(username) && m_userTokens[username] == token) {
-        return true;
-    }
-    
-    // 2. Если нет или не совпадает — проверяем в базе
-    QSqlQuery query;
-    query.prepare(R"(
-        SELECT token, expires_at 
-        FROM tokens 
-        WHERE username = :username
-    )");
-    query.bindValue(":username", username);
-    
-    if (!query.exec()) {
-        qWarning() << "[SERVER] Failed to validate token for user" << username << ":" << query.lastError().text();
-        return false;
-    }
-    
-    if (!query.next()) {
-        qDebug() << "[SERVER] No token found in DB for user:" << username;
-        return false;
-    }
-    
-    QString storedToken = query.value("token").toString();
-    QDateTime expiresAt = QDateTime::fromString(query.value("expires_at").toString(), Qt::ISODate);
-    
-    // 3. Проверка срока действия токена
-    if (expiresAt < QDateTime::currentDateTime()) {
-        qDebug() << "[SERVER] Token expired for user:" << username;
-        
-        // Удаляем истёкший токен из БД
-        QSqlQuery deleteQuery;
-        deleteQuery.prepare("DELETE FROM tokens WHERE username = :username");
-        deleteQuery.bindValue(":username", username);
-        deleteQuery.exec();
-        
-        return false;
-    }
-    
-    // 4. Сравниваем токены
-    if (storedToken == token) {
-        // Восстанавливаем токен в памяти для быстрого доступа
-        m_userTokens[username] = token;
-        qDebug() << "[SERVER] Token validated from DB for user:" << username;
-        return true;
-    }
-    
-    return false;
+    // Горячий путь token_login: поиск в hash-кэше TokenStore и сравнение
+    // монотонного дедлайна — без обращений к БД. До прогрева кэша после
+    // старта TokenStore сам откатывается на проверку по таблице tokens.
+    return m_tokenStore->validate(username, token);
 }
 
 
@@ -4029,16 +9640,25 @@ void Server::handleTokenLogin(QObject* socket, const QJsonObject& request)
     response["token"] = token;  // Возвращаем токен для подтверждения
 
     // Добавляем пользователя в онлайн-список
-    m_clients[username] = socket;
-    m_clientsReverse[socket] = username;
+    m_sessions.bind(socket, username); // Привязываем имя к сессии
 
     sendJson(socket, response);
 
     // Отправляем дополнительные данные клиенту
-    sendContactList(socket, username);              // Список контактов
+    sendContactList(socket, username,               // Список контактов (дельта по contacts_rev)
+                    request.contains("contacts_rev")
+                        ? qint64(request["contacts_rev"].toDouble()) : -1);
     sendPendingContactRequests(socket, username);   // Входящие запросы в друзья
     sendUnreadCounts(socket, username);              // Счётчики непрочитанных сообщений
+    // Зазор обрыва мобильной сети закрывается из памяти; постраничная
+    // выдача из БД нужна, только если очередь не покрыла его целиком.
+    if (!flushOutboundQueue(socket, username)) {
+        sendOfflineMessages(socket, username);          // Потоковая выдача накопленных сообщений
+    }
+    deliverPendingGroupMessages(socket, username);  // Накопленные групповые сообщения
 
-    // Обновляем онлайн-списки у всех клиентов
-    broadcastUserList();
+    // Оповещаем об изменении присутствия: входящему — полный снимок,
+    // подписчикам — дельта-событие.
+    sendOnlineStatusList(socket);
+    broadcastPresence(username, true);
 }
@@ -11,14 +11,48 @@
 
 // Включения для структур данных
 #include <QMap>
+#include <QHash>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QPointer>
 #include <QJsonObject>
+#include <QJsonArray>
 #include "cryptoutils.h"
+#include "sessionregistry.h" // Реестр сессий с целочисленными ID.
+#include "ratelimiter.h" // Ведра токенов на сессию перед диспетчером команд.
+#include "userdirectory.h" // Справочник имен: фильтр Блума + hash-множество.
+#include "recentmessagecache.h" // Кэш последних сообщений активных диалогов.
+#include "readcache.h" // Кэш редких читающих запросов (входящие запросы дружбы).
+#include "outboundqueue.h" // Очередь доставки для недавно отключившихся получателей.
+#include "messageidgenerator.h" // Время-упорядоченные ID сообщений.
+#include "chatsequencer.h" // Атомарные счетчики порядка по диалогам.
+#include "filetransfer.h" // Потоковая передача файлов чанками.
 #include "structures.h" // Кастомные структуры данных (User, ChatMessage).
+#include "protocolschema.h" // Реестр команд: имена -> плотные целочисленные id.
+#include "circuitbreaker.h" // Предохранители несущественных доменов.
+#include "containercensus.h" // Перепись долгоживущих контейнеров (поиск утечек).
+#include <array>
 
 // Прямые объявления (Forward Declarations) для использования указателей
 // без включения полных заголовочных файлов.
 class QTcpSocket;
 class QWebSocket;
+class QThread;
+class ConnectionWorker;
+class DatabaseService;
+class MessageJournal;
+class ReplicationService;
+class ServerMetrics;
+class DbMaintenance;
+class TokenStore;
+class HeartbeatMonitor;
+class ReplayLog;
+class ShardBus;
+class CallRelay;
+class ConferenceMixer;
+class ColdStorage;
+class ServerConfig;
 
 /**
  * @class Server
@@ -42,6 +76,11 @@ public:
      */
     explicit Server(QObject *parent = nullptr);
 
+    /**
+     * @brief Деструктор. Корректно останавливает рабочие потоки пула соединений.
+     */
+    ~Server() override;
+
     /**
      * @brief Запускает сервер для прослушивания входящих подключений.
      *
@@ -49,19 +88,67 @@ public:
      * заданные порты для TCP и WebSocket соединений.
      *
      * @param address IP-адрес для прослушивания (по умолчанию QHostAddress::Any - все интерфейсы).
-     * @param tcpPort Порт для защищенных TCP-подключений (по умолчанию 1234).
-     * @param wsPort Порт для WebSocket-подключений (по умолчанию 8080).
+     * @param tcpPort Порт для защищенных TCP-подключений (0 — взять из конфигурации, стандарт 1234).
+     * @param wsPort Порт для WebSocket-подключений (0 — взять из конфигурации, стандарт 8080).
      * @return `true`, если оба сервера (TCP и WS) успешно запущены, иначе `false`.
      */
-    bool listen(const QHostAddress &address = QHostAddress::Any, quint16 tcpPort = 1234, quint16 wsPort = 8080);
+    bool listen(const QHostAddress &address = QHostAddress::Any, quint16 tcpPort = 0, quint16 wsPort = 0);
+
+    /**
+     * @brief Воспроизводит журнал захваченного трафика вместо прослушивания.
+     *
+     * @details Режим разбора инцидентов: журнал, записанный под
+     * MESSENGER_REPLAY_CAPTURE, подается в processJsonRequest() в исходном
+     * или ускоренном темпе (MESSENGER_REPLAY_SPEED, 0 — без пауз) против
+     * заранее подложенного снимка базы. Сессии журнала представлены
+     * объектами-заглушками с напрямую привязанными псевдонимами — точное
+     * чередование запросов инцидента повторяется детерминированно.
+     * По окончании журнала приложение завершается.
+     *
+     * @param logPath Путь к файлу журнала повтора.
+     * @return `true`, если журнал загружен и воспроизведение запущено.
+     */
+    bool startReplay(const QString& logPath);
+
+    /**
+     * @brief Передает слушающий сокет и живые соединения новому процессу.
+     *
+     * @details Бесшовный рестарт (вызывается по SIGUSR2, см. Handover):
+     * прием новых соединений останавливается, воркеры дожимают очереди
+     * записи и отдают дескрипторы, криптосессии и хвосты полукадров всех
+     * установленных TCP-соединений; манифест с именами сессий и флагами
+     * протокола уходит вместе с дескрипторами через Unix-сокет. После
+     * передачи процесс завершается — соединения продолжают жить в новом.
+     * WebSocket-сессии не переносимы (QWebSocket не принимает чужой
+     * дескриптор) — браузерные клиенты переподключаются по резюм-пути.
+     *
+     * @param socketPath Путь Unix-сокета передачи (слушает новый процесс).
+     */
+    void beginHandover(const QString& socketPath);
+
+    /**
+     * @brief Принимает сокеты и состояние сессий от старого процесса.
+     *
+     * @details Вызывается при старте под MESSENGER_HANDOVER_ACCEPT: ждет
+     * передачу не дольше HandoverAcceptTimeoutMs, усыновляет слушающий
+     * TCP-сокет (очередь accept ядра не теряется) и раздает соединения
+     * воркерам по кругу; WebSocket-слушатель запускается обычным listen.
+     * Требует включенного пула воркеров. При любой неудаче вызывающий
+     * откатывается на обычный listen() — деплой деградирует до штатного
+     * рестарта с лавиной переподключений, но не падает.
+     *
+     * @param socketPath Путь Unix-сокета передачи.
+     * @return `true`, если передача принята и сервер принимает трафик.
+     */
+    bool acceptHandover(const QString& socketPath);
 
 protected:
     // --- Методы-обработчики (handlers), вынесенные в protected для наглядности ---
 
     /**
-     * @brief Инициализирует таблицу обработчиков команд (m_handlers).
-     * @details Связывает строковые названия команд (например, "LOGIN", "SEND_MESSAGE")
-     * с методами класса Server.
+     * @brief Инициализирует таблицу обработчиков команд (m_dispatch).
+     * @details Связывает имена команд (значения JSON-поля "type") с
+     * методами класса Server через реестр ProtocolSchema::Commands.
      */
     void initHandlers();
 
@@ -72,6 +159,14 @@ protected:
      */
     void handleMessageDelivered(QObject* socket, const QJsonObject& request);
 
+    /**
+     * @brief Диапазонная форма подтверждения доставки: все сообщения автора до id включительно.
+     * @param socket Сокет клиента-получателя (по нему определяется имя получателя).
+     * @param originalSender Автор подтверждаемых сообщений.
+     * @param upToId Верхняя граница диапазона id (включительно).
+     */
+    void handleMessageDeliveredUpTo(QObject* socket, const QString& originalSender, qint64 upToId);
+
     /**
      * @brief Обрабатывает уведомление о прочтении сообщения.
      * @param socket Сокет клиента.
@@ -79,6 +174,14 @@ protected:
      */
     void handleMessageRead(QObject* socket, const QJsonObject& request);
 
+    /**
+     * @brief Диапазонная форма квитанции прочтения: все сообщения автора до id включительно.
+     * @param socket Сокет клиента-получателя (по нему определяется имя получателя).
+     * @param originalSender Автор прочитанных сообщений.
+     * @param upToId Верхняя граница диапазона id (включительно).
+     */
+    void handleMessageReadUpTo(QObject* socket, const QString& originalSender, qint64 upToId);
+
     /**
      * @brief Обрабатывает запрос на выход из системы (Logout).
      * @details Удаляет сессию клиента и закрывает соединение.
@@ -87,6 +190,77 @@ protected:
      */
     void handleLogoutRequest(QObject* socket, const QJsonObject& request);
 
+    /**
+     * @brief Обрабатывает запрос клиента на включение бинарного протокола.
+     * @details Отвечает `binary_mode_ack` и помечает сокет: с этого момента
+     * горячие типы сообщений (typing, подтверждения доставки/прочтения)
+     * отправляются ему бинарными записями BinaryCodec вместо JSON.
+     * @param socket Сокет клиента.
+     * @param request JSON-объект с полем `version`.
+     */
+    void handleBinaryMode(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Обрабатывает запрос клиента на сжатие крупных ответов.
+     * @details Отвечает `compression_ack` и помечает сокет: с этого момента
+     * полезные нагрузки крупнее Compression::MinSize (история, списки
+     * контактов) сжимаются перед шифрованием.
+     * @param socket Сокет клиента.
+     * @param request JSON-объект с полем `algorithm`.
+     */
+    void handleCompression(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Начинает прием файла от клиента.
+     * @details Клиент присылает `{"type":"file_upload_begin","file_name":...,
+     * "file_size":N}`; сервер регистрирует файл в таблице `files` (status=0),
+     * открывает файл хранилища и отвечает `file_upload_ready` с transfer_id.
+     * Дальше данные идут бинарными чанками (см. FileTransfer::ChunkMagic).
+     * @param socket Сокет клиента.
+     * @param request JSON-объект с именем и размером файла.
+     */
+    void handleFileUploadBegin(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Завершает прием файла: сверяет размер и публикует file_id.
+     * @details Отвечает `file_upload_complete` с file_id/file_name/file_url —
+     * клиент подставляет их в ChatMessage исходящего сообщения.
+     * @param socket Сокет клиента.
+     * @param request JSON-объект с transfer_id.
+     */
+    void handleFileUploadFinish(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Начинает отдачу файла клиенту.
+     * @details Метаданные читаются пулом читателей БД; файл отображается в
+     * память и уходит чанками через pumpFileDownload с учетом заполненности
+     * буфера записи сокета.
+     * @param socket Сокет клиента.
+     * @param request JSON-объект с file_id (UUID файла).
+     */
+    void handleFileDownload(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Обрабатывает подписку клиента на статусы присутствия контактов.
+     * @details Клиент присылает `{"type":"presence_subscribe","users":[...]}` —
+     * полный набор имен, которые он сейчас отображает; прежняя подписка
+     * сокета замещается. Дальше клиент получает только дельта-события
+     * `presence` для этих пользователей.
+     * @param socket Сокет клиента.
+     * @param request JSON-объект с массивом `users`.
+     */
+    void handlePresenceSubscribe(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Обрабатывает ответ клиента на прикладной ping.
+     * @details Сам факт получения запроса уже продлил дедлайн соединения в
+     * HeartbeatMonitor (см. processJsonRequest), поэтому тело пустое —
+     * обработчик нужен, чтобы pong не считался неизвестной командой.
+     * @param socket Сокет клиента.
+     * @param request JSON-объект запроса (полей не содержит).
+     */
+    void handlePong(QObject* socket, const QJsonObject& request);
+
 public slots:
     // --- Слоты для обработки событий TCP-сервера ---
 
@@ -100,7 +274,7 @@ public slots:
 
     /**
      * @brief Слот для чтения данных из TCP-сокета.
-     * @details Собирает полные JSON-пакеты из потока данных, используя m_nextBlockSizes для определения границ сообщений.
+     * @details Собирает полные JSON-пакеты из потока данных через FrameBuffer сокета (см. framebuffer.h).
      */
     void onTcpReadyRead();
 
@@ -123,11 +297,60 @@ public slots:
      */
     void onWebSocketTextMessageReceived(const QString &message);
 
+    /**
+     * @brief Обрабатывает бинарные сообщения от WebSocket-клиентов.
+     * @details Разделяет с TCP-путем кодеки прикладного уровня: запись
+     * BinaryCodec, deflate-запись Compression или компактный JSON —
+     * формат различается по первому байту сообщения.
+     * @param message Входящее бинарное сообщение.
+     */
+    void onWebSocketBinaryMessageReceived(const QByteArray &message);
+
+    // --- Слоты для взаимодействия с пулом рабочих потоков ---
+
+    /**
+     * @brief Назначает новое TCP-соединение одному из воркеров (round-robin).
+     * @details Дескриптор сокета пересылается в рабочий поток, где создается
+     * QTcpSocket. После этого сокет навсегда закреплен за этим потоком.
+     * @param socketDescriptor Нативный дескриптор принятого соединения.
+     */
+    void onWorkerConnectionReady(qintptr socketDescriptor);
+
+    /**
+     * @brief Принимает распарсенный JSON-запрос от воркера (queued connection).
+     * @details Вызывается в основном потоке сервера, поэтому обработчики
+     * и доступ к БД остаются однопоточными.
+     */
+    void onWorkerJsonReceived(const QJsonObject &request, QObject *socket);
+
+    /**
+     * @brief Принимает бинарный чанк файловой передачи от воркера.
+     * @details Состояние передач (FileTransfer) живет в основном потоке,
+     * поэтому воркеры пересылают чанки сюда так же, как JSON-запросы.
+     */
+    void onWorkerFileChunk(const QByteArray &chunk, QObject *socket);
+
+    /**
+     * @brief Обрабатывает отключение клиента, обслуживаемого воркером.
+     * @details Сетевые ресурсы уже очищены на стороне воркера; здесь обновляются
+     * карты онлайн-статуса, активные звонки и last_seen в БД.
+     */
+    void onWorkerSocketDisconnected(QObject *socket);
+
+    /**
+     * @brief Регистрирует соединение, усыновленное воркером при передаче.
+     * @details Вызывается строго до первого jsonReceived усыновленного
+     * сокета (очередь событий одного потока сохраняет порядок): сессия,
+     * heartbeat и флаги протокола восстанавливаются из манифеста передачи
+     * по индексу (см. acceptHandover).
+     */
+    void onConnectionAdopted(QObject *socket, int index);
+
 
 private:
     /**
      * @brief Псевдоним для указателя на метод-обработчик команды.
-     * @details Используется в `m_handlers` для реализации паттерна "Команда".
+     * @details Используется в таблице диспетчеризации `m_dispatch`.
      * Сигнатура: void (Server::*)(QObject* socket, const QJsonObject& request)
      */
     using Handler = void (Server::*)(QObject*, const QJsonObject&);
@@ -141,6 +364,106 @@ private:
      */
     bool initDatabase();
 
+    /**
+     * @brief Поднимает состав групп из БД в память (m_groupMembers).
+     * @details Выполняется один раз при старте на синхронном соединении:
+     * проверка членства и веерная рассылка — горячий путь и не могут ждать
+     * асинхронного чтения. Дальше кэш ведется write-through.
+     */
+    void loadGroupState();
+
+    /**
+     * @brief Поднимает справочник имен пользователей из БД в память.
+     * @details Один SELECT username при старте; дальше справочник пополняется
+     * при успешной регистрации. Проверки существования в handleRegister и
+     * handleAddContactRequest обслуживаются без обращения к SQLite
+     * (см. UserDirectory).
+     */
+    void loadUserDirectory();
+
+    /**
+     * @brief Ночной проход переноса неактивных диалогов в холодный ярус.
+     * @details Находит пары, вся переписка которых старше порога
+     * m_archiveIdleMonths (граница переводится в ID по времени, зашитому
+     * в его старших битах), и переносит их историю из SQLite в сегментный
+     * архив (см. ColdStorage). За проход обрабатывается ограниченное число
+     * пар; длинные диалоги переносятся порциями за несколько ночей.
+     */
+    void archiveIdleConversations();
+
+    /** @brief Переносит порцию истории одной пары в архив и удаляет ее из БД. */
+    void archiveConversation(const QString& userA, const QString& userB);
+
+    /** @brief Пар за один ночной проход переноса. */
+    static constexpr int ArchiveBatchConversations = 32;
+
+    /** @brief Строк одной пары за проход (длинные диалоги — за несколько ночей). */
+    static constexpr int ArchiveRowsPerPass = 5000;
+
+    /**
+     * @brief Часовой проход удаления сообщений с истекшим сроком хранения.
+     * @details Диалоги с политикой retention_seconds (исчезающие сообщения,
+     * см. handleSetRetention) чистятся диапазонным DELETE по индексу
+     * (conversation_id, id): граница срока переводится в ID по времени,
+     * зашитому в его старших битах, — разбора timestamp нет. Перед
+     * удалением непрочитанные строки порции списываются со счетчиков
+     * unread_counts, чтобы бейджи не показывали призраков. Порция на
+     * диалог ограничена RetentionRowsPerPass: первый проход после
+     * включения политики на длинном диалоге растягивается на несколько
+     * часов вместо одного гигантского DELETE.
+     */
+    void pruneExpiredMessages();
+
+    /** @brief Удаляет порцию истекших строк одного диалога. */
+    void pruneConversationRetention(qint64 conversationId, const QString& userA,
+                                    const QString& userB, qint64 retentionSeconds);
+
+    /** @brief Период прохода удаления истекших сообщений, мс. */
+    static constexpr int RetentionSweepIntervalMs = 60 * 60 * 1000;
+
+    /** @brief Строк одного диалога за проход удаления. */
+    static constexpr int RetentionRowsPerPass = 5000;
+
+    /** @brief Удаленных по сроку хранения строк (метрика). */
+    qint64 m_retentionPruned = 0;
+
+    /**
+     * @brief Запускает фоновый прогрев страничного кэша SQLite.
+     *
+     * @details После ребута хоста первые минуты трафика работают по
+     * холодному кэшу: история читается в 10-50 раз медленнее, пока
+     * рабочее множество страниц не поднимется с диска. Прогрев стартует
+     * сразу после начала прослушивания: файлу БД дается readahead-подсказка
+     * ядру (posix_fadvise WILLNEED), затем databaseWarmupStep() порциями
+     * проходит горячие индексы — справочники users и tokens и страницы
+     * истории недавних диалогов (их и запрашивают первые вошедшие).
+     * Прогресс виден в /metrics (messenger_db_warmup_percent): деплой
+     * переключает трафик на узел только после 100.
+     */
+    void startDatabaseWarmup();
+
+    /**
+     * @brief Одна порция прогрева: несколько диалогов в бюджете времени.
+     * @details Выполняется в главном потоке ломтиками по WarmupSliceBudgetMs
+     * с перепостановкой через таймер нулевой задержки — живой трафик
+     * (если он уже пошел) перемежается между порциями.
+     */
+    void databaseWarmupStep();
+
+    /** @brief Недавних диалогов, чью историю прогреваем при старте. */
+    static constexpr int WarmupConversations = 256;
+
+    /** @brief Строк истории одного диалога, поднимаемых прогревом. */
+    static constexpr int WarmupRowsPerConversation = 50;
+
+    /** @brief Бюджет одной порции прогрева, мс. */
+    static constexpr int WarmupSliceBudgetMs = 5;
+
+    QList<qint64> m_warmupQueue;  ///< ID диалогов, ожидающих прогрева
+    int m_warmupTotal = 0;        ///< Всего шагов прогрева (для процента)
+    int m_warmupCompleted = 0;    ///< Выполнено шагов прогрева
+    bool m_warmupFinished = false;///< Прогрев завершен (узел готов к трафику)
+
     // --- Набор приватных методов-обработчиков для каждой команды от клиента ---
 
     /** @brief Отправляет клиенту историю сообщений с определенным пользователем. */
@@ -152,9 +475,30 @@ private:
     /** @brief Выполняет поиск пользователей по username или части имени. */
     void handleSearchUsers(QObject* socket, const QJsonObject& request);
 
+    /**
+     * @brief Пакетная выдача профилей по списку имен.
+     * @details Вход отдает список контактов облегченным (только имена,
+     * см. sendContactList) — детали профиля (имя для отображения, статус,
+     * аватар, последний визит) клиент дозапрашивает этим запросом по мере
+     * попадания строк в видимую область. Пачка ограничена
+     * ProfileBatchLimit именами.
+     */
+    void handleGetProfiles(QObject* socket, const QJsonObject& request);
+
+    /** @brief Потолок имен в одном запросе get_profiles. */
+    static constexpr int ProfileBatchLimit = 64;
+
     /** @brief Обрабатывает запрос на добавление в контакты. */
     void handleAddContactRequest(QObject* socket, const QJsonObject& request);
 
+    /**
+     * @brief Массовый импорт контактов одним запросом.
+     * @details Валидация списка по справочнику имен, одна групповая
+     * транзакция вставки и один суммарный ответ вместо N круговых
+     * обменов add_contact_request.
+     */
+    void handleAddContactsBulk(QObject* socket, const QJsonObject& request);
+
     /** @brief Производит аутентификацию пользователя по логину и паролю. */
     void handleLogin(QObject* socket, const QJsonObject& request);
 
@@ -170,12 +514,55 @@ private:
     /** @brief Обрабатывает удаление сообщения (у себя или у всех). */
     void handleDeleteMessage(QObject* socket, const QJsonObject& request);
 
+    /**
+     * @brief Выполняет авторизованное редактирование: условный UPDATE и рассылка.
+     * @details Авторизация свернута в сам запрос (`WHERE id = :id AND
+     * fromUser = :user`) — чужое сообщение UPDATE просто не затронет,
+     * отдельный SELECT авторства не нужен.
+     */
+    void applyMessageEdit(qint64 messageId, const QString& fromUser,
+                          const QString& toUser, const QString& newPayload);
+
+    /** @brief Выполняет авторизованное удаление: условный DELETE и рассылка. */
+    void applyMessageDelete(qint64 messageId, const QString& fromUser,
+                            const QString& toUser);
+
+    /**
+     * @brief Устанавливает срок хранения сообщений диалога (исчезающие сообщения).
+     * @details Политика пишется в conversations.retention_seconds и действует
+     * на обе копии диалога: серверную чистит часовой проход
+     * pruneExpiredMessages(), локальные базы обеих сторон — сами клиенты по
+     * событию retention_changed. 0 выключает политику (хранить вечно).
+     */
+    void handleSetRetention(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Запоминает владение свежим сообщением для кэша авторизации.
+     * @details При переполнении кольцо вытесняет самую старую запись (FIFO).
+     */
+    void rememberOwnership(qint64 messageId, const QString& fromUser,
+                           const QString& toUser);
+
     /** @brief Обрабатывает ответ на запрос добавления в контакты (Принять/Отклонить). */
     void handleContactRequestResponse(QObject* socket, const QJsonObject& request);
 
     /** @brief Пересылает статус "печатает..." собеседнику. */
     void handleTyping(QObject *socket, const QJsonObject &request);
 
+    // --- Групповые чаты ---
+
+    /** @brief Создает группу с начальным составом участников. */
+    void handleCreateGroup(QObject* socket, const QJsonObject& request);
+
+    /**
+     * @brief Маршрутизирует сообщение в группу.
+     * @details Онлайн-участники обслуживаются движком веерной рассылки
+     * (fanOutJson): сообщение сериализуется один раз и разделяется между
+     * очередями сокетов. Офлайн-участники ставятся в очередь доставки
+     * одним пакетным INSERT (см. deliverPendingGroupMessages).
+     */
+    void handleGroupMessage(QObject* socket, const QJsonObject& request);
+
     // --- Вспомогательные методы для отправки данных клиентам ---
 
     /**
@@ -186,18 +573,126 @@ private:
      */
     void sendJson(QObject* socket, const QJsonObject& response);
 
-    /** @brief Отправляет список контактов авторизованному пользователю. */
-    void sendContactList(QObject* socket, const QString& username);
+    /**
+     * @brief Веерная рассылка одного сообщения множеству получателей.
+     * @details Сериализация выполняется один раз на рассылку; бинарная и
+     * сжатая формы, если они кому-то нужны, кодируются лениво и тоже один
+     * раз. Каждому сокету достается неявно разделяемая копия готового
+     * буфера (атомарный счетчик ссылок QByteArray — байты не копируются
+     * ни в очередь воркера, ни в очередь записи). Единственная работа,
+     * которую разделить нельзя, — по-сеансовое шифрование: sealFrame
+     * вызывается на каждого получателя. Наивный цикл по sendJson
+     * сериализовал бы и сжимал сообщение заново на каждого участника.
+     * @param recipients Сокеты онлайн-получателей.
+     * @param message Сообщение без персональных полей (temp_id и т.п.).
+     */
+    void fanOutJson(const QList<QObject*>& recipients, const QJsonObject& message);
+
+    /**
+     * @brief Отправляет список контактов авторизованному пользователю.
+     * @details При clientRev >= 0 (клиент предъявил свою версию списка)
+     * отвечает дельтой — только добавленные/измененные/удаленные записи
+     * с момента этой версии; иначе или при устаревшей версии — полным
+     * списком. Полный список облегченный (только имена + флаг lite):
+     * детали профилей не грузятся и не сериализуются на критическом пути
+     * входа, клиент дозапрашивает их пачками get_profiles по мере
+     * отрисовки строк. Версии ведет recordContactDelta().
+     * @param socket Сокет клиента.
+     * @param username Владелец списка.
+     * @param clientRev Последняя версия списка, известная клиенту (-1 — нет).
+     */
+    void sendContactList(QObject* socket, const QString& username,
+                         qint64 clientRev = -1);
+
+    /**
+     * @brief Фиксирует изменение, видимое в списке контактов пользователя.
+     * @details Увеличивает персональную версию списка владельца
+     * (contact_revs) и дописывает строку дельты (contact_deltas) — материал
+     * для дельта-синхронизации в sendContactList(). Журнал усекается до
+     * 512 последних версий; клиент со слишком старой версией получает
+     * полный список.
+     * @param owner Владелец списка, чья версия растет.
+     * @param contact Контакт, которого касается изменение.
+     * @param removed true — контакт исчез из списка, false — добавлен/обновлен.
+     */
+    void recordContactDelta(const QString& owner, const QString& contact,
+                            bool removed);
 
     /** @brief (Устаревший) Отправляет полный список пользователей. */
     void sendFullUserList(QObject* socket);
 
-    /** @brief Рассылает всем активным клиентам обновленный список онлайн-пользователей. */
+    /** @brief Рассылает всем активным клиентам обновленный список онлайн-пользователей.
+     *  @deprecated Оставлена для отладки; горячий путь использует broadcastPresence(). */
     void broadcastUserList();
 
-    /** @brief Отправляет пользователю сообщения, полученные пока он был офлайн. */
+    /**
+     * @brief Рассылает подписчикам дельта-событие присутствия пользователя.
+     * @details Вместо полного списка онлайн (O(n²) трафика при массовых
+     * входах/выходах) уходит одно событие `{"type":"presence","username":...,
+     * "online":...}` — и только тем сокетам, которые подписались на этого
+     * пользователя через `presence_subscribe`.
+     * @param username Пользователь, чей статус изменился.
+     * @param online `true` — вошел в сеть, `false` — вышел.
+     */
+    void broadcastPresence(const QString& username, bool online);
+
+    /**
+     * @brief Сбрасывает накопленные отметки last_seen в БД одной пачкой.
+     * @details Отметка выхода пишется в m_pendingLastSeen в памяти; на диск
+     * она уходит этим периодическим проходом (точность — минуты), а не
+     * отдельным UPDATE на каждый обрыв. Читатели профилей накладывают
+     * несброшенные отметки поверх прочитанного из БД, поэтому снаружи
+     * задержка записи не видна.
+     */
+    void flushLastSeen();
+
+    /** @brief Период сброса отметок last_seen на диск. */
+    static constexpr int LastSeenFlushIntervalMs = 2 * 60 * 1000;
+
+    /**
+     * @brief Ставит готовый кадр в очередь записи сокета.
+     * @details Кадры, сформированные в одной итерации цикла событий (шторм
+     * ответов при логине: счетчики, контакты, офлайн-сообщения), склеиваются
+     * в один буфер и уходят одним системным вызовом write.
+     * @param socket TCP-сокет получателя (однопоточный режим).
+     * @param packet Полностью сформированный кадр с префиксом длины.
+     */
+    void enqueueWrite(QTcpSocket* socket, const QByteArray& packet);
+
+    /** @brief Отправляет накопленные очереди записи (конец итерации цикла событий). */
+    void flushPendingWrites();
+
+    /**
+     * @brief Запускает потоковую выдачу сообщений, полученных пока пользователь был офлайн.
+     * @details Сообщения выдаются окнами по OfflineBatchSize штук: следующее
+     * окно запрашивается из БД только после того, как клиент подтвердил
+     * (`message_delivered`) все сообщения текущего. Память на соединение
+     * ограничена размером окна, цикл событий не блокируется даже при тысячах
+     * накопившихся сообщений.
+     */
     void sendOfflineMessages(QObject* socket, const QString& username);
 
+    /**
+     * @brief Вручает сообщения, удержанные очередью доставки, из памяти.
+     * @details Вызывается на переподключении до sendOfflineMessages.
+     * @param socket Сокет переподключившегося клиента.
+     * @param username Имя пользователя.
+     * @return `true`, если очередь покрыла зазор целиком и постраничную
+     *         выдачу из БД можно пропустить.
+     */
+    bool flushOutboundQueue(QObject* socket, const QString& username);
+
+    /** @brief Выдает клиенту следующее окно недоставленных сообщений. */
+    void sendNextOfflineBatch(QObject* socket);
+
+    /**
+     * @brief Выдает групповые сообщения, накопившиеся пока пользователь был офлайн.
+     * @details Очередь ведет таблица group_pending (заполняется пакетным
+     * INSERT в handleGroupMessage); после выдачи доставленные строки
+     * снимаются одним DELETE.
+     */
+    void deliverPendingGroupMessages(QObject* socket, const QString& username);
+
     /** @brief Отправляет клиенту список статусов (онлайн/офлайн) его контактов. */
     void sendOnlineStatusList(QObject* clientSocket);
 
@@ -224,6 +719,15 @@ private:
     /** @brief Возвращает историю звонков пользователя. */
     void handleGetCallHistory(QObject* socket, const QJsonObject& request);
 
+    /** @brief Создает конференцию и рассылает приглашения участникам. */
+    void handleConferenceCreate(QObject* socket, const QJsonObject& request);
+
+    /** @brief Выводит участника из конференции (пустая комната закрывается). */
+    void handleConferenceLeave(QObject* socket, const QJsonObject& request);
+
+    /** @brief Комната привязала порт: рассылает приглашения участникам. */
+    void onConferenceReady(const QString& conferenceId, quint16 udpPort);
+
     /** @brief Возвращает статистику по звонкам (длительность, качество и т.д.). */
     void handleGetCallStats(QObject* socket, const QJsonObject& request);
 
@@ -238,14 +742,27 @@ private:
 
     /**
      * @brief Главный диспетчер входящих JSON-запросов.
-     * @details Проверяет поле "type" в JSON и вызывает соответствующий метод из `m_handlers`.
+     * @details Проверяет поле "type" в JSON и вызывает соответствующий метод из `m_dispatch`.
+     * Время выполнения обработчика и размер пакета записываются в метрики.
      * @param request Входящий JSON.
      * @param clientSocket Сокет, от которого пришел запрос.
+     * @param payloadBytes Размер входящего пакета в байтах (-1 — неизвестен).
      */
-    void processJsonRequest(const QJsonObject& request, QObject* clientSocket);
+    void processJsonRequest(const QJsonObject& request, QObject* clientSocket,
+                            qint64 payloadBytes = -1);
 
     void removeClient(QObject* clientSocket); // (Заготовка/Не используется)
 
+    /**
+     * @brief Общая логика очистки при отключении клиента (TCP, WebSocket или воркер).
+     * @details Вынесена из onClientDisconnected(), чтобы переиспользовать ее для
+     * сокетов, живущих в рабочих потоках пула.
+     * @param clientSocket Отключившийся сокет.
+     * @param ownedByWorker `true`, если сетевые ресурсы сокета (парсер, криптография,
+     *        удаление объекта) уже очищены воркером.
+     */
+    void handleClientDisconnect(QObject* clientSocket, bool ownedByWorker);
+
     /** @brief Создает запись о начале звонка в базе данных. */
     void createCallRecord(const QString& callId, const QString& from,
                           const QString& to, const QString& fromIp, quint16 fromPort);
@@ -253,8 +770,9 @@ private:
     /** @brief Обновляет запись звонка в БД при установлении соединения. */
     void updateCallConnected(const QString& callId, const QString& toIp, quint16 toPort);
 
-    /** @brief Обновляет запись звонка при его завершении (статус, время окончания). */
-    void updateCallEnded(const QString& callId, const QString& status);
+    /** @brief Обновляет запись звонка при его завершении (статус, время окончания, телеметрия качества). */
+    void updateCallEnded(const QString& callId, const QString& status,
+                         const QJsonObject& stats = QJsonObject());
 
     /** @brief Генерирует уникальный токен сессии для пользователя. */
     QString generateToken(const QString& username);
@@ -265,8 +783,14 @@ private:
     /** @brief Обрабатывает автоматический вход по токену (без пароля). */
     void handleTokenLogin(QObject* socket, const QJsonObject& request);
 
-    /** @brief Отправляет публичный ключ сервера клиенту для начала защищенного соединения. */
-    void sendServerPublicKey(QTcpSocket* socket);
+    /**
+     * @brief Отправляет публичный ключ сервера клиенту для начала защищенного соединения.
+     * @param socket Сокет клиента (QTcpSocket или QWebSocket).
+     * @param resumed `true` — рукопожатие завершило 0-RTT возобновление:
+     *        в поле `key` уходит резюм-ключ (секрет сессии уже выведен из
+     *        него), а ответ помечается `resume_ok`.
+     */
+    void sendServerPublicKey(QObject* socket, bool resumed = false);
 
 private:
     // --- Указатели на серверные объекты ---
@@ -277,16 +801,39 @@ private:
     // --- Структуры для управления состоянием онлайн-клиентов ---
 
     /**
-     * @brief Карта активных клиентов: `username` -> `указатель на сокет`.
-     * @details Используется для быстрой маршрутизации сообщений конкретному пользователю.
+     * @brief Реестр активных сессий.
+     * @details Каждому соединению выдается целочисленный ID; hash-индексы
+     * `сокет -> сессия` и `username -> сессия` делают маршрутизацию сообщений
+     * и очистку при отключении O(1) без сравнений строк (см. sessionregistry.h).
      */
-    QMap<QString, QObject*> m_clients;
+    SessionRegistry m_sessions;
 
     /**
-     * @brief Обратная карта клиентов: `указатель на сокет` -> `username`.
-     * @details Используется для быстрой идентификации, кто именно отключился или прислал запрос.
+     * @brief Лимитер запросов: ведро токенов на каждую сессию.
+     * @details Стоит перед диспетчером в processJsonRequest(); зацикленный
+     * клиент получает ответ `throttled`, упорный — разрыв соединения
+     * (см. ratelimiter.h).
      */
-    QMap<QObject*, QString> m_clientsReverse;
+    RateLimiter m_rateLimiter;
+
+    /**
+     * @brief Горячо перезагружаемая конфигурация (server_config.ini).
+     * @details Следит за файлом настроек и применяет безопасные изменения
+     * без рестарта: лимиты m_rateLimiter, размеры m_recentMessages,
+     * уровень логирования (см. serverconfig.h). Порты — только при старте.
+     */
+    ServerConfig *m_config = nullptr;
+
+    /** @brief Применяет горячие настройки текущего снимка конфигурации. */
+    void applyConfig();
+
+    /**
+     * @brief Справочник зарегистрированных имен пользователей.
+     * @details Проверки существования (регистрация, добавление контакта)
+     * отвечаются из памяти; шторм запросов к несуществующим именам гасится
+     * фильтром Блума без единого SELECT (см. userdirectory.h).
+     */
+    UserDirectory m_userDirectory;
 
     /**
      * @brief Карта активных звонков: `callId` -> `CallInfo`.
@@ -295,30 +842,623 @@ private:
     QMap<QString, CallInfo> m_activeCalls;
 
     // --- Специфично для TCP ---
+    // --- Таблица обработчиков ---
+    /**
+     * @brief Плоская таблица диспетчеризации, индексированная id команды.
+     * @details Имя команды переводится в плотный id замороженной
+     * constexpr-таблицей ProtocolSchema::commandIdFor — поиск обработчика
+     * стоит один проход хеша и индексацию массива вместо дерева строковых
+     * сравнений QMap на каждый входящий запрос.
+     */
+    std::array<Handler, ProtocolSchema::CommandCount> m_dispatch {};
+
+    /** @brief Регистрирует обработчик по имени команды (см. initHandlers). */
+    void registerHandler(const char* type, Handler handler);
+
+    /**
+     * @brief Хранилище токенов автологина.
+     * @details Hash-кэш в памяти с монотонными дедлайнами, write-behind
+     * записью в SQLite и фоновой уборкой истекших записей (см. TokenStore).
+     */
+    TokenStore *m_tokenStore = nullptr;
+
+    // Криптографический контекст соединения живет внутри самого сокета
+    // (FramedTcpSocket::crypto()): отдельной карты `сокет -> контекст`
+    // и heap-аллокации CryptoManager на клиента больше нет.
+
+    // --- Пул рабочих потоков для TCP-соединений ---
+
     /**
-     * @brief Хранит ожидаемый размер следующего TCP-пакета для каждого сокета.
-     * @details Ключ - сокет, Значение - размер блока данных (quint32).
-     * Необходимо для сборки фрагментированных пакетов в `onTcpReadyRead`.
+     * @brief Рабочие потоки пула (по одному на ConnectionWorker).
+     * @details Количество задается переменной окружения MESSENGER_WORKER_THREADS
+     * (по умолчанию — число ядер CPU, 0 — однопоточный режим).
      */
-    QMap<QTcpSocket*, quint32> m_nextBlockSizes;
+    QList<QThread*> m_workerThreads;
 
-    // --- Карта обработчиков ---
     /**
-     * @brief Карта команд, реализующая паттерн Dispatcher.
-     * @details Ключ - тип команды (строка из JSON), Значение - метод-обработчик.
+     * @brief Потоки дополнительных accept-листенеров (SO_REUSEPORT-шарды).
+     * @details Каждый поток владеет своим WorkerTcpServer, слушающим тот же
+     * порт; ядро распределяет входящие соединения между шардами, так что
+     * лавина переподключений после рестарта не упирается в один accept-поток.
+     * Пусто при network/listener_shards <= 1.
      */
-    QMap<QString, Handler> m_handlers;
+    QList<QThread*> m_listenerThreads;
+
+    /** @brief Воркеры, обслуживающие сокеты в своих потоках. */
+    QList<ConnectionWorker*> m_workers;
 
     /**
-     * @brief Хранилище активных токенов сессий (username -> token).
+     * @brief Манифест принятой передачи: записи соединений по индексам.
+     * @details Живет от acceptHandover() до регистрации последнего
+     * усыновленного сокета (onConnectionAdopted); в обычном режиме пуст.
      */
-    QMap<QString, QString> m_userTokens;
+    QJsonArray m_handoverMeta;
+
+    /** @brief Потолок ожидания передачи от старого процесса, мс. */
+    static constexpr int HandoverAcceptTimeoutMs = 30000;
+
+    /**
+     * @brief Привязка сокета к его воркеру: `сокет` -> `ConnectionWorker`.
+     * @details Заполняется и читается только в основном потоке сервера,
+     * поэтому синхронизация не требуется. Используется в sendJson() для
+     * маршрутизации исходящих пакетов в правильный рабочий поток.
+     */
+    QHash<QObject*, ConnectionWorker*> m_socketWorkers;
+
+    /** @brief Индекс следующего воркера для round-robin распределения. */
+    int m_nextWorker = 0;
+
+    /**
+     * @brief Асинхронный сервис доступа к БД (выделенный поток).
+     * @details Горячие обработчики отправляют SQL-задачи сюда и получают
+     * результаты через queued-коллбэки, поэтому дисковый I/O SQLite не
+     * блокирует основной цикл событий сервера.
+     */
+    DatabaseService *m_dbService = nullptr;
+
+    /**
+     * @brief FTS5-индекс пользователей создан и поддерживается триггерами.
+     * @details false, если сборка SQLite без модуля FTS5 — поиск тогда
+     * работает по старому пути с LIKE-сканом.
+     */
+    bool m_userSearchFts = false;
+
+    /** @brief Размер окна потоковой выдачи офлайн-сообщений. */
+    static constexpr int OfflineBatchSize = 50;
+
+    /** @brief Верхняя граница выборки глобального поиска пользователей. */
+    static constexpr int SearchResultLimit = 200;
+
+    /** @brief Размер чанка потоковой выдачи результатов поиска. */
+    static constexpr int SearchChunkSize = 20;
+
+    /**
+     * @brief Поколение последнего поискового запроса каждого сокета.
+     * @details Typeahead шлет search_users на каждое нажатие: хвостовые чанки
+     * устаревшего запроса отправлять бессмысленно. Новый запрос перезаписывает
+     * поколение, и отложенные чанки прежнего при выполнении видят расхождение
+     * и молча отменяются. Запись удаляется при отключении клиента.
+     */
+    QHash<QObject*, qint64> m_searchGenerations;
+
+    /** @brief Состояние потоковой выдачи офлайн-сообщений одному клиенту. */
+    struct OfflineDelivery {
+        QString username;    ///< Получатель выдачи.
+        int outstanding = 0; ///< Неподтвержденных сообщений в текущем окне.
+    };
+
+    /**
+     * @brief Активные потоковые выдачи: сокет -> состояние окна.
+     * @details Запись создается при логине и удаляется, когда недоставленных
+     * сообщений больше нет (или клиент отключился).
+     */
+    QHash<QObject*, OfflineDelivery> m_offlineDeliveries;
+
+    /**
+     * @brief Очереди исходящей записи: сокет -> накопленные кадры.
+     * @details sendJson() не пишет в сокет сразу, а дописывает готовый кадр
+     * сюда; flushPendingWrites() в конце итерации цикла событий отправляет
+     * всё накопленное одним write() на сокет (см. enqueueWrite()).
+     */
+    QHash<QObject*, QByteArray> m_pendingWrites;
+
+    /**
+     * @brief Переиспользуемый буфер расшифровки входящих пакетов.
+     * @details onTcpReadyRead() пишет выход crypto_aead_unlock сюда вместо
+     * свежего QByteArray на каждый пакет: буфер один раз дорастает до
+     * размера максимального пакета, после чего путь приема не аллоцирует.
+     * Обработка пакета синхронна, поэтому одного буфера на поток достаточно.
+     */
+    QByteArray m_decryptScratch;
+
+    /** @brief Отложенный сброс m_pendingWrites уже запланирован. */
+    bool m_flushScheduled = false;
+
+    /**
+     * @brief Подписчики присутствия: `username` -> сокеты, отображающие его статус.
+     * @details Заполняется обработчиком `presence_subscribe`; broadcastPresence()
+     * шлет дельта-события только этим сокетам.
+     */
+    QHash<QString, QSet<QObject*>> m_presenceSubscribers;
+
+    /**
+     * @brief Обратный индекс подписок: сокет -> набор отслеживаемых имен.
+     * @details Нужен для O(1)-очистки подписок при отключении клиента.
+     */
+    QHash<QObject*, QSet<QString>> m_presenceWatches;
+
+    /**
+     * @brief Несброшенные отметки последнего визита: `username` -> ISO-время выхода.
+     * @details Заполняется при отключении клиента; в users.last_seen уходит
+     * пачкой из flushLastSeen(). handleGetProfiles() и дельты контактов
+     * подставляют эти значения вместо устаревших из БД.
+     */
+    QHash<QString, QString> m_pendingLastSeen;
+
+    /**
+     * @brief Сокеты, согласовавшие бинарный протокол (запрос `binary_mode`).
+     * @details Для этих клиентов sendJson() пытается закодировать горячие
+     * типы через BinaryCodec, остальные уходят как JSON.
+     */
+    QSet<QObject*> m_binaryClients;
+
+    /**
+     * @brief Сокеты, согласовавшие сжатие ответов (запрос `compression`).
+     * @details Для этих клиентов sendJson() сжимает полезные нагрузки
+     * крупнее Compression::MinSize перед шифрованием.
+     */
+    QSet<QObject*> m_compressedClients;
+
+    /**
+     * @brief Крипто-сессии WebSocket-клиентов, прошедших рукопожатие.
+     * @details Паритет с TCP: у FramedTcpSocket контекст CryptoManager живет
+     * в самом сокете, QWebSocket расширить нельзя — сессии лежат в этой
+     * карте и удаляются при отключении. После завершения рукопожатия все
+     * кадры такого клиента — бинарные, в раскладке sealFrame (включая
+     * префикс длины: он избыточен при WebSocket-фрейминге, но сохраняет
+     * кадр побайтово общим с TCP). Клиенты без рукопожатия продолжают
+     * работать открытым текстом в расчете на WSS.
+     */
+    QHash<QObject*, CryptoManager*> m_wsCrypto;
+
+    // --- Коалесценция typing-индикаторов ---
+
+    /** @brief Минимальный интервал пересылки typing на пару отправитель/получатель, мс. */
+    static constexpr qint64 TypingForwardIntervalMs = 2000;
+
+    /** @brief Порог исходящего буфера получателя, после которого typing сбрасывается. */
+    static constexpr qint64 TypingBackpressureBytes = 64 * 1024;
+
+    /** @brief Предел числа отслеживаемых пар до уборки устаревших записей. */
+    static constexpr int MaxTypingPairs = 4096;
+
+    /**
+     * @brief Момент последней пересылки typing по паре "от\x1fкому".
+     * @details Монотонные миллисекунды m_typingClock; пары, не печатавшие
+     * дольше интервала, выбрасываются при переполнении карты.
+     */
+    QHash<QString, qint64> m_typingForwards;
+
+    /** @brief Монотонные часы коалесценции typing (не зависят от системного времени). */
+    QElapsedTimer m_typingClock;
+
+    /** @brief Подавлено пересылок typing ограничением частоты (для метрик). */
+    qint64 m_typingCoalesced = 0;
+
+    /** @brief Сброшено typing из-за распухшего буфера получателя (для метрик). */
+    qint64 m_typingDroppedBackpressure = 0;
+
+    // --- Backpressure исходящих буферов (медленные потребители) ---
+
+    /** @brief Верхняя отметка буфера: выше нее несущественный трафик сбрасывается. */
+    static constexpr qint64 SendHighWatermarkBytes = 1 * 1024 * 1024;
+
+    /** @brief Нижняя отметка: сброс прекращается, когда буфер отыграл ниже нее. */
+    static constexpr qint64 SendLowWatermarkBytes = 256 * 1024;
+
+    /** @brief Жесткий потолок буфера: превысивший его клиент отключается. */
+    static constexpr qint64 SendHardCapBytes = 16 * 1024 * 1024;
+
+    /**
+     * @brief Сокеты в режиме сброса несущественного трафика.
+     * @details Вход — по верхней отметке, выход — по нижней (гистерезис,
+     * чтобы не дрожать вокруг одного порога).
+     */
+    QSet<QObject*> m_backpressuredSockets;
+
+    /** @brief Сброшено несущественных отправок из-за backpressure (для метрик). */
+    qint64 m_sendsShedBackpressure = 0;
+
+    /** @brief Отключено медленных потребителей по жесткому потолку (для метрик). */
+    qint64 m_slowConsumersDisconnected = 0;
+
+    /**
+     * @brief Счетчик семплирования трассировочных логов.
+     * @details processJsonRequest() пишет строку [TRACE] для каждого 16-го
+     * запроса с клиентским trace_id (см. сквозную трассировку задержки
+     * в handlePrivateMessage).
+     */
+    quint32 m_traceLogCounter = 0;
+
+    /** @brief Исходящий буфер сокета: байты ОС-буфера плюс отложенные кадры. */
+    qint64 bufferedBytesFor(QObject* socket) const;
+
+    /**
+     * @brief Собирает JSON-снимок состояния для админ-эндпоинта `/snapshot`.
+     * @details Сессии, активные звонки и глубины очередей записи на момент
+     * запроса — то, за чем раньше приходилось лезть в gdb. Копии контейнеров
+     * Qt неявно разделяемы (copy-on-write), поэтому снимок не задерживает
+     * горячий путь даже на больших таблицах.
+     */
+    QJsonObject buildAdminSnapshot() const;
+
+    /**
+     * @brief Применяет правила backpressure к отправке.
+     * @return false, если отправку нужно подавить (сброс или отключение).
+     */
+    bool applySendBackpressure(QObject* socket, const QString& type);
+
+    // --- Файловые передачи (чанковый бинарный канал) ---
+
+    /** @brief Состояние активных загрузок и отдач файлов. */
+    FileTransfer m_fileTransfers;
+
+    /** @brief Пауза между окнами отдачи, когда буфер сокета заполнен. */
+    static constexpr int DownloadRetryMs = 5;
+
+    /** @brief Чанков за окно отдачи сокетам пула (их буфер отсюда не виден). */
+    static constexpr int DownloadWorkerWindow = 4;
+
+    /** @brief Применяет принятый чанк к активной загрузке. */
+    void handleFileChunk(QObject* socket, const QByteArray& payload);
+
+    /**
+     * @brief Начинает фактический прием файла (промах дедупликации).
+     * @details Вынесено из handleFileUploadBegin: при заявленном клиентом
+     * хеше сюда попадаем из коллбэка проверки по таблице blobs.
+     */
+    void startFileUpload(QObject* socket, const QString& username,
+                         const QString& fileName, qint64 fileSize,
+                         const QString& expectedHash);
+
+    /**
+     * @brief Регистрирует загрузку, закрытую попаданием в блоб-хранилище.
+     * @details Передачи данных не было: создается запись files со status=1,
+     * счетчик ссылок блоба увеличивается, клиенту сразу уходит
+     * `file_upload_complete` с deduplicated=true.
+     */
+    void registerDedupedUpload(QObject* socket, const QString& username,
+                               const QString& fileName, qint64 fileSize,
+                               const QString& contentHash);
+
+    /**
+     * @brief Отправляет очередное окно чанков отдачи.
+     * @details Для сокетов основного потока окно ограничено заполненностью
+     * буфера записи (верхняя отметка backpressure); продолжение
+     * планируется таймером, завершение — finishDownload и
+     * `file_download_complete`.
+     */
+    void pumpFileDownload(quint32 transferId, QObject* socket);
+
+    /**
+     * @brief Отправляет готовый бинарный кадр (чанк) в сокет.
+     * @details Тот же путь, что у sendJson после сериализации: сокеты пула —
+     * через их воркер, сокеты основного потока — sealFrame + очередь записи.
+     */
+    void sendRawFrame(QObject* socket, const QByteArray& payload);
+
+    // --- Шардированный режим (несколько процессов Server) ---
+
+    /**
+     * @brief Межузловая шина кластера (см. shardbus.h).
+     * @details В одноузловом режиме объект существует, но выключен:
+     * isLocal() всегда true, и лишних проверок на горячих путях нет.
+     */
+    ShardBus* m_shardBus = nullptr;
+
+    /**
+     * @brief Обрабатывает конверт, принятый от другого узла кластера.
+     * @details kind="route" — доставка private_message локальному получателю;
+     * kind="presence" — дельта присутствия для локальных подписчиков.
+     */
+    void onShardEnvelope(const QJsonObject& envelope);
+
+    // --- Ретрансляция аудио звонков ---
+
+    /**
+     * @brief UDP-ретранслятор для пар за симметричным NAT (см. callrelay.h).
+     * @details Сессия открывается на call_request и закрывается вместе со
+     * звонком; клиенты получают relay_port в сигналинге и используют его,
+     * когда прямые датаграммы не проходят.
+     */
+    CallRelay* m_callRelay = nullptr;
+
+    /**
+     * @brief Серверный микшер групповых звонков (см. conferencemixer.h).
+     * @details Каждая комната — свой поток и UDP-порт: сервер принимает
+     * по одному Opus-потоку от участника и возвращает каждому готовый
+     * микс остальных, вместо полносвязного p2p.
+     */
+    ConferenceMixer* m_conferenceMixer = nullptr;
+
+    /**
+     * @brief Конференции, ждущие bind порта: conf_id -> (создатель, участники).
+     * @details Приглашения уходят из обработчика conferenceReady, когда
+     * поток комнаты сообщит назначенный UDP-порт.
+     */
+    QHash<QString, QPair<QString, QStringList>> m_pendingConferences;
+
+    /**
+     * @brief Холодный ярус истории: mmap-сегменты неактивных диалогов.
+     * @details handleGetHistory прозрачно подклеивает архивные строки к
+     * страницам пагинации; перенос выполняет ночной проход
+     * archiveIdleConversations() (см. coldstorage.h).
+     */
+    ColdStorage* m_coldStorage = nullptr;
+
+    /**
+     * @brief Порог неактивности диалога в месяцах до переноса в архив.
+     * @details MESSENGER_ARCHIVE_MONTHS переопределяет значение по
+     * умолчанию (6); 0 отключает перенос полностью.
+     */
+    int m_archiveIdleMonths = 6;
+
+    /**
+     * @brief Write-behind журнал сообщений.
+     * @details Копит входящие сообщения и записывает их групповыми
+     * транзакциями (см. MessageJournal), поднимая пропускную способность
+     * записи на порядок по сравнению с одиночными autocommit-INSERT.
+     */
+    MessageJournal *m_messageJournal = nullptr;
+
+    /**
+     * @brief Горячий резерв БД: снимки и tail-журнал в каталог standby.
+     * @details Включается переменной MESSENGER_STANDBY_DIR; без нее
+     * бездействует (см. ReplicationService).
+     */
+    ReplicationService *m_replication = nullptr;
+
+    /**
+     * @brief Кэш последних сообщений активных диалогов.
+     * @details Большинство запросов истории — последняя страница активного
+     * чата; такие запросы обслуживаются из памяти без обращения к SQLite
+     * (см. RecentMessageCache).
+     */
+    RecentMessageCache m_recentMessages;
+
+    /**
+     * @brief Кэш редких читающих запросов с явной инвалидацией.
+     * @details Списки входящих запросов дружбы отдаются из памяти;
+     * записи выбиваются обработчиками add_contact_request /
+     * contact_request_response и поколением при update_profile
+     * (см. readcache.h).
+     */
+    ReadCache m_readCache;
+
+    /**
+     * @brief Очередь доставки для недавно отключившихся получателей.
+     * @details Сообщения в окно обрыва мобильной сети удерживаются в памяти
+     * и вручаются мгновенно на переподключении — без постраничной выдачи
+     * из БД (см. outboundqueue.h). Строка сообщения персистится журналом
+     * в любом случае.
+     */
+    OutboundQueue m_outboundQueue;
+
+    /**
+     * @brief Генератор время-упорядоченных ID сообщений.
+     * @details Окончательный ID присваивается в момент приема сообщения,
+     * поэтому ack отправителю и пересылка получателю не ждут COMMIT
+     * пакетного писателя (см. MessageIdGenerator).
+     */
+    MessageIdGenerator m_messageIds;
+
+    /**
+     * @brief Счетчики порядка сообщений по диалогам.
+     * @details handlePrivateMessage штампует каждое сообщение атомарным
+     * инкрементом счетчика пары (chat_seq); читатели упорядочивают по
+     * кортежу (chat_seq, id). Явная основа порядка внутри диалога для
+     * многопоточной маршрутизации (см. chatsequencer.h).
+     */
+    ChatSequencer m_chatSequencer;
+
+    /**
+     * @brief Участники одного сообщения для кэша авторизации edit/delete.
+     */
+    struct MessageOwnership {
+        QString fromUser; ///< Автор сообщения (только он может менять).
+        QString toUser;   ///< Получатель (нужен для рассылки уведомления).
+    };
+
+    /**
+     * @brief Кэш владения свежими сообщениями: ID -> участники.
+     * @details Редактируют и удаляют почти всегда только что отправленное;
+     * записи заводит handlePrivateMessage, поэтому горячий путь edit/delete
+     * обходится без SELECT авторства. Емкость ограничена кольцом
+     * m_ownershipRing (FIFO-вытеснение). Промах кэша — не отказ:
+     * участники дочитываются из БД асинхронно.
+     */
+    QHash<qint64, MessageOwnership> m_messageOwners;
+
+    /** @brief Кольцо ID для FIFO-вытеснения из m_messageOwners. */
+    QVector<qint64> m_ownershipRing;
+
+    /** @brief Позиция перезаписи в m_ownershipRing (когда кольцо заполнено). */
+    int m_ownershipRingHead = 0;
+
+    /** @brief Емкость кэша владения сообщениями. */
+    static constexpr int OwnershipCacheCapacity = 4096;
+
+    /**
+     * @brief Состав групп: ID группы -> множество username участников.
+     * @details Кэш в памяти: проверка членства и сбор получателей веерной
+     * рассылки выполняются синхронно в обработчике и не могут ждать пула
+     * читателей БД. Заполняется при старте (loadGroupState), дальше ведется
+     * write-through — сначала память, затем задача писателю.
+     */
+    QHash<qint64, QSet<QString>> m_groupMembers;
+
+    /** @brief Следующий ID группы (засеивается из MAX(id) при старте). */
+    qint64 m_nextGroupId = 1;
+
+    /**
+     * @brief Небольшой пул потоков для вычисления X25519 при рукопожатии.
+     * @details Скалярное умножение на кривой выполняется вне потока событий:
+     * при штормах переподключений сотни рукопожатий не добавляют задержку
+     * уже подключенным клиентам. Результат возвращается в основной поток
+     * через очередь событий (см. handleHandshake).
+     */
+    QThreadPool m_cryptoPool;
+
+    /**
+     * @brief Полустатическая пара ключей 0-RTT возобновления сессий.
+     * @details Живет все время процесса и рекламируется клиентам в каждом
+     * ответе-рукопожатии (`resume_key`). Клиент кэширует ключ рядом с токеном
+     * и при следующем подключении вкладывает token_login, запечатанный ключом
+     * X25519(его эфемерный секрет, этот публичный), прямо в кадр рукопожатия —
+     * вход и дельта-синхронизация уходят первым же ответом сервера вместо
+     * трех последовательных обменов. Секрет сессии при этом все равно свеж:
+     * клиентская половина ключа эфемерна, поэтому повтор перехваченного кадра
+     * не раскрывает ни токен, ни ответы сервера. После рестарта процесса ключ
+     * другой — расшифровка не сходится, и клиент входит обычным путем.
+     * См. handleHandshake().
+     */
+    CryptoManager m_resumeCrypto;
+
+    // --- Вынос Argon2 из потока событий (аутентификация) ---
+
+    /** @brief Потолок одновременно ожидающих KDF-задач (весь сервер). */
+    static constexpr int MaxPendingKdf = 64;
+
+    /** @brief Потолок одновременных KDF-задач с одного IP-адреса. */
+    static constexpr int MaxKdfPerIp = 2;
+
+    /**
+     * @brief Пытается занять слот KDF-задачи для указанного IP.
+     * @details Admission control аутентификации: Argon2 намеренно дорог,
+     * и без потолков всплеск credential stuffing занял бы пул хеширования
+     * целиком. Превышение общего или пер-IP лимита — отказ без вычислений.
+     * @param peerIp IP клиента (пустая строка — без пер-IP учета).
+     * @return `true` — слот занят, можно ставить задачу в пул.
+     */
+    bool tryAcquireKdfSlot(const QString& peerIp);
+
+    /**
+     * @brief Освобождает слот KDF-задачи (вызывается в основном потоке).
+     * @param peerIp IP, переданный в tryAcquireKdfSlot.
+     */
+    void releaseKdfSlot(const QString& peerIp);
+
+    /** @brief IP-адрес клиента по объекту сокета (TCP или WebSocket). */
+    static QString peerIpOf(QObject* socket);
+
+    /** @brief Текущее число KDF-задач в пуле и очереди. */
+    int m_pendingKdf = 0;
+
+    /** @brief KDF-задач в полете по IP-адресам (admission per-IP). */
+    QHash<QString, int> m_kdfPerIp;
+
+    /** @brief Попыток аутентификации, отклоненных потолками KDF. */
+    qint64 m_kdfRejected = 0;
+
+    /**
+     * @brief Монитор прикладных heartbeat'ов на колесе таймеров.
+     * @details Следит за дедлайнами активности всех соединений одним
+     * таймером; молчащим отправляется ping, мертвые выбраковываются
+     * (см. HeartbeatMonitor).
+     */
+    HeartbeatMonitor *m_heartbeat = nullptr;
+
+    /**
+     * @brief Журнал повтора входящего трафика (MESSENGER_REPLAY_CAPTURE).
+     * @details nullptr в обычном режиме; при захвате каждый кадр,
+     * дошедший до processJsonRequest, дописывается обезличенной строкой
+     * JSONL для последующего воспроизведения (см. ReplayLog).
+     */
+    ReplayLog *m_replayLog = nullptr;
+
+    /**
+     * @brief Метрики обработчиков и административный эндпоинт.
+     * @details Гистограммы задержек/размеров по командам и gauge-метрики,
+     * отдаваемые по локальному сокету в scrape-формате (см. ServerMetrics).
+     */
+    ServerMetrics *m_metrics = nullptr;
+
+    /**
+     * @brief Перепись долгоживущих контейнеров для атрибуции утечек.
+     * @details Зонды размеров per-socket таблиц, кэшей и очередей записи;
+     * дамп с приростом с момента старта отдается по `/census` на
+     * административном сокете (см. ContainerCensus).
+     */
+    ContainerCensus m_census;
+
+    /**
+     * @brief Планировщик фонового обслуживания БД.
+     * @details Ограниченные WAL-чекпойнты каждую минуту, incremental_vacuum
+     * и суточный ANALYZE в тихие окна трафика (см. DbMaintenance).
+     */
+    DbMaintenance *m_dbMaintenance = nullptr;
+
+    /**
+     * @brief Предохранители несущественных доменов (см. CircuitBreaker).
+     * @details Ключ — имя домена ("search", "stats", "avatars"). После
+     * серии отказов SQLite домен отвечает мгновенным отказом вместо
+     * ретраев в ту же стену; маршрутизация сообщений не шеддится никогда.
+     * Состояния видны в метриках (messenger_breaker_state_*).
+     */
+    QHash<QString, CircuitBreaker*> m_breakers;
+
+    /** @brief Команда (плотный id ProtocolSchema) -> ее предохранитель. */
+    QHash<int, CircuitBreaker*> m_breakerByCommand;
+
+    /** @brief Запросов, отклоненных открытыми предохранителями (за все время). */
+    quint64 m_breakerShed = 0;
 
     /**
-     * @brief Менеджеры шифрования для каждого подключенного TCP-клиента.
-     * @details Хранит контекст шифрования (ключи сессии, счетчики) для `QTcpSocket`.
+     * @brief Регистрирует отказ подсистемы в ее предохранителе.
+     * @details Вызывается обработчиками шеддируемых доменов из веток
+     * ошибок SQLite; класс определяет реакцию (см. CircuitBreaker).
+     * Неизвестный домен — no-op.
      */
-    QMap<QTcpSocket*, CryptoManager*> m_clientCrypto;
+    void reportSubsystemFailure(const QString& domain,
+                                CircuitBreaker::ErrorClass errorClass);
+
+    // -----------------------------------------------------------------------
+    // Две полосы обработки входящих запросов
+    // -----------------------------------------------------------------------
+    // В очереди событий Qt все запросы равноправны: шторм get_history
+    // выстраивается перед private_message, и p99 задержки сообщений растет
+    // вместе с объемным трафиком. Вторая полоса разводит их: объемные
+    // команды (история, поиск, статистика) на входе откладываются в
+    // m_bulkQueue за микросекунды, интерактивные обрабатываются сразу,
+    // а очередь осушается квантами с дедлайном — между квантами цикл
+    // событий успевает обслужить накопившиеся интерактивные запросы.
+
+    /** @brief Бюджет одного кванта осушения объемной полосы, мс. */
+    static constexpr int BulkSliceBudgetMs = 5;
+
+    /** @brief Потолок объемной очереди: дальше — быстрый отказ клиенту. */
+    static constexpr int BulkQueueMaxDepth = 4096;
+
+    /** @brief Отложенный запрос объемной полосы. */
+    struct DeferredBulkRequest {
+        QJsonObject request;
+        QPointer<QObject> socket; ///< Обнуляется при отключении клиента
+        qint64 payloadBytes = -1;
+    };
+
+    /** @brief true для объемных команд (история, поиск, статистика). */
+    static bool isBulkCommand(const QString& type);
+
+    /** @brief Взводит осушение объемной очереди (нулевой таймер, один раз). */
+    void scheduleBulkDrain();
+
+    /** @brief Осушает объемную очередь квантом BulkSliceBudgetMs. */
+    void drainBulkQueue();
+
+    QList<DeferredBulkRequest> m_bulkQueue; ///< Вторая (объемная) полоса
+    bool m_bulkDrainScheduled = false;      ///< Осушение уже взведено
+    bool m_drainingBulk = false;            ///< Повторное откладывание выключено
+    quint64 m_bulkShed = 0;                 ///< Отказов по переполнению полосы
 };
 
 #endif // SERVER_H
@@ -0,0 +1,31 @@
+#
+# server_bench — генератор нагрузки для сервера мессенджера.
+#
+# Отдельная бенч-утилита: симулирует N одновременных клиентов на реальном
+# протоколе (handshake X25519, логин, шторм сообщений, история) и печатает
+# p50/p95/p99 задержек и пропускную способность. Собирается независимо от
+# серверного проекта:
+#
+#   qmake server_bench.pro && make
+#
+
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = server_bench
+
+SOURCES += \
+    bench_main.cpp \
+    cryptoutils.cpp \
+    fasthash.cpp \
+    framebuffer.cpp \
+    monocypher.c
+
+HEADERS += \
+    cryptoutils.h \
+    fasthash.h \
+    framebuffer.h \
+    monocypher.h
@@ -0,0 +1,111 @@
+//См. "serverconfig.h"
+#include "serverconfig.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QSettings>
+
+ServerConfig::ServerConfig(const QString& configPath, QObject* parent)
+    : QObject(parent)
+    , m_configPath(configPath)
+{
+    reload(true);
+
+    // Следим за файлом; отсутствующий файл начнем отслеживать, когда
+    // админ его создаст (addPath на несуществующий путь не срабатывает,
+    // поэтому подписываемся и на директорию)
+    if (QFile::exists(m_configPath)) {
+        m_watcher.addPath(m_configPath);
+    }
+    m_watcher.addPath(QFileInfo(m_configPath).absolutePath());
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged,
+            this, &ServerConfig::onFileChanged);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged,
+            this, &ServerConfig::onFileChanged);
+}
+
+std::shared_ptr<const ServerConfig::Snapshot> ServerConfig::current() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
+void ServerConfig::onFileChanged(const QString& path)
+{
+    Q_UNUSED(path);
+
+    // Редакторы заменяют файл целиком (rename поверх): QFileSystemWatcher
+    // при этом теряет подписку — восстанавливаем ее
+    if (QFile::exists(m_configPath)
+        && !m_watcher.files().contains(m_configPath)) {
+        m_watcher.addPath(m_configPath);
+    }
+
+    reload(false);
+    emit configChanged();
+}
+
+void ServerConfig::reload(bool initial)
+{
+    auto snapshot = std::make_shared<Snapshot>();
+
+    if (QFile::exists(m_configPath)) {
+        QSettings settings(m_configPath, QSettings::IniFormat);
+        const Snapshot defaults;
+
+        snapshot->tcpPort = quint16(
+            settings.value("network/tcp_port", defaults.tcpPort).toUInt());
+        snapshot->wsPort = quint16(
+            settings.value("network/ws_port", defaults.wsPort).toUInt());
+        snapshot->listenerShards =
+            settings.value("network/listener_shards",
+                           defaults.listenerShards).toInt();
+
+        snapshot->rateCapacityTokens =
+            settings.value("rate_limit/capacity_tokens",
+                           qlonglong(defaults.rateCapacityTokens)).toLongLong();
+        snapshot->rateRefillPerSecond =
+            settings.value("rate_limit/refill_per_second",
+                           qlonglong(defaults.rateRefillPerSecond)).toLongLong();
+        snapshot->rateStrikeLimit =
+            settings.value("rate_limit/strike_limit",
+                           defaults.rateStrikeLimit).toInt();
+
+        snapshot->recentCacheConversations =
+            settings.value("recent_cache/max_conversations",
+                           defaults.recentCacheConversations).toInt();
+        snapshot->recentCacheMessagesPerConversation =
+            settings.value("recent_cache/max_messages_per_conversation",
+                           defaults.recentCacheMessagesPerConversation).toInt();
+
+        snapshot->debugLogging =
+            settings.value("logging/debug", defaults.debugLogging).toBool();
+
+        qInfo() << "[CONFIG]" << (initial ? "Loaded" : "Reloaded")
+                << m_configPath
+                << "rate:" << snapshot->rateCapacityTokens
+                << "/" << snapshot->rateRefillPerSecond << "tok/s"
+                << "cache:" << snapshot->recentCacheConversations
+                << "x" << snapshot->recentCacheMessagesPerConversation
+                << "debug:" << snapshot->debugLogging;
+    } else if (initial) {
+        qInfo() << "[CONFIG] No" << m_configPath
+                << "- using built-in defaults";
+    }
+
+    applyLogLevel(*snapshot);
+
+    // Атомарная подмена: читатели либо на старом снимке, либо на новом
+    std::atomic_store(&m_snapshot,
+                      std::shared_ptr<const Snapshot>(std::move(snapshot)));
+}
+
+void ServerConfig::applyLogLevel(const Snapshot& snapshot)
+{
+    // Единственный уровень, который имеет смысл гасить в проде: qDebug
+    // на каждый пакет заметно стоит под нагрузкой
+    QLoggingCategory::setFilterRules(
+        snapshot.debugLogging ? QStringLiteral("*.debug=true")
+                              : QStringLiteral("*.debug=false"));
+}
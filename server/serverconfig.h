@@ -0,0 +1,105 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+/**
+ * @class ServerConfig
+ * @brief Горячо перезагружаемая конфигурация сервера.
+ *
+ * @details До сих пор любая настройка (порты, лимиты, размеры кэшей) была
+ * константой в коде: изменение требовало пересборки и рестарта, который
+ * рвет все соединения и устраивает шторм переподключений. Этот класс
+ * читает server_config.ini рядом с бинарником, следит за файлом через
+ * QFileSystemWatcher и при изменении собирает новый снимок настроек.
+ *
+ * Снимок неизменяемый и подменяется атомарно (std::atomic_store на
+ * shared_ptr): горячий путь читает current() без блокировок и видит либо
+ * целиком старую, либо целиком новую конфигурацию — никогда смесь.
+ *
+ * Что применяется на лету (через сигнал configChanged): лимиты
+ * RateLimiter, размеры RecentMessageCache, уровень логирования. Порты
+ * прослушивания читаются только при старте — их смена требует rebind и
+ * объявлена намеренно не горячей.
+ *
+ * Отсутствующий файл — не ошибка: действуют значения по умолчанию,
+ * совпадающие с прежними константами.
+ */
+class ServerConfig : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Неизменяемый снимок всех настроек.
+     *
+     * Значения по умолчанию повторяют прежние константы кода, поэтому
+     * сервер без конфиг-файла ведет себя ровно как раньше.
+     */
+    struct Snapshot {
+        // --- Только при старте ---
+        quint16 tcpPort = 1234;  ///< Порт TCP-сервера
+        quint16 wsPort  = 8080;  ///< Порт WebSocket-сервера
+        int listenerShards = 1;  ///< TCP-листенеров на одном порту (SO_REUSEPORT); 1 — один accept-поток
+
+        // --- Горячие: применяются без рестарта ---
+        qint64 rateCapacityTokens   = 60; ///< Емкость ведра лимитера (всплеск)
+        qint64 rateRefillPerSecond  = 20; ///< Пополнение ведра, токенов/с
+        int    rateStrikeLimit      = 30; ///< Страйков до разрыва соединения
+
+        int recentCacheConversations = 256; ///< Диалогов в кэше последних сообщений
+        int recentCacheMessagesPerConversation = 100; ///< Сообщений на диалог
+
+        bool debugLogging = true; ///< false — qDebug-вывод подавляется
+    };
+
+    /**
+     * @brief Конструктор: читает файл и начинает следить за ним.
+     * @param configPath Путь к INI-файлу настроек.
+     * @param parent Родительский объект.
+     */
+    explicit ServerConfig(const QString& configPath, QObject* parent = nullptr);
+
+    /**
+     * @brief Текущий снимок настроек (lock-free).
+     *
+     * Снимок живет, пока жив возвращенный shared_ptr, даже если конфиг
+     * подменили параллельно — брать current() один раз на операцию.
+     *
+     * @return Неизменяемый снимок конфигурации.
+     */
+    std::shared_ptr<const Snapshot> current() const;
+
+signals:
+    /**
+     * @brief Конфигурация перечитана и снимок подменен.
+     *
+     * Получатели применяют горячие настройки (лимиты, кэши, логи).
+     */
+    void configChanged();
+
+private slots:
+    /** @brief Файл изменился: перечитать и атомарно подменить снимок. */
+    void onFileChanged(const QString& path);
+
+private:
+    /**
+     * @brief Читает файл в новый снимок.
+     * @param initial true при первом чтении (другой тон логов).
+     */
+    void reload(bool initial);
+
+    /** @brief Включает/выключает qDebug-вывод по снимку. */
+    static void applyLogLevel(const Snapshot& snapshot);
+
+    QString m_configPath;               ///< Путь к INI-файлу
+    QFileSystemWatcher m_watcher;       ///< Следит за файлом настроек
+    std::shared_ptr<const Snapshot> m_snapshot; ///< Текущий снимок (atomic_load/store)
+};
+
+#endif // SERVERCONFIG_H
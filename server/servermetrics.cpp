@@ -0,0 +1,239 @@
+/**
+ * @file servermetrics.cpp
+ * @brief Реализация гистограмм обработчиков и административного эндпоинта.
+ */
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QDebug>
+
+#include "servermetrics.h"
+
+namespace {
+
+// Верхние границы бакетов задержек в микросекундах. Последний бакет (+Inf)
+// границы не имеет — в него попадает все, что не уместилось.
+constexpr qint64 kDurationBoundsUs[ServerMetrics::DurationBuckets - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 50000
+};
+
+// Верхние границы бакетов размера входящего пакета в байтах.
+constexpr qint64 kPayloadBoundsBytes[ServerMetrics::PayloadBuckets - 1] = {
+    256, 1024, 4096, 16384, 65536, 262144, 1048576
+};
+
+} // namespace
+
+
+ServerMetrics::ServerMetrics(QObject *parent)
+    : QObject(parent)
+{
+}
+
+
+void ServerMetrics::recordHandler(const QString &command, qint64 elapsedNs, qint64 payloadBytes)
+{
+    CommandStats &stats = m_commands[command];
+
+    m_totalCalls++;
+    stats.count++;
+    stats.totalNs += quint64(elapsedNs);
+    if (quint64(elapsedNs) > stats.maxNs) {
+        stats.maxNs = quint64(elapsedNs);
+    }
+
+    // Бакет задержки: линейный поиск по 8 границам дешевле любых ухищрений.
+    const qint64 elapsedUs = elapsedNs / 1000;
+    int bucket = DurationBuckets - 1;
+    for (int i = 0; i < DurationBuckets - 1; ++i) {
+        if (elapsedUs <= kDurationBoundsUs[i]) {
+            bucket = i;
+            break;
+        }
+    }
+    stats.durations[bucket]++;
+
+    // Размер пакета известен не на всех путях (пул соединений парсит JSON
+    // в рабочем потоке и передает уже объект) — учитываем только известные.
+    if (payloadBytes >= 0) {
+        stats.payloadCount++;
+        stats.payloadTotal += quint64(payloadBytes);
+
+        int pbucket = PayloadBuckets - 1;
+        for (int i = 0; i < PayloadBuckets - 1; ++i) {
+            if (payloadBytes <= kPayloadBoundsBytes[i]) {
+                pbucket = i;
+                break;
+            }
+        }
+        stats.payloads[pbucket]++;
+    }
+}
+
+
+void ServerMetrics::registerGauge(const QString &name, const QString &help,
+                                  std::function<qint64()> provider)
+{
+    m_gauges.append({name, help, std::move(provider)});
+}
+
+
+void ServerMetrics::registerSnapshotProvider(std::function<QJsonObject()> provider)
+{
+    m_snapshotProvider = std::move(provider);
+}
+
+
+void ServerMetrics::registerCensusProvider(std::function<QJsonObject()> provider)
+{
+    m_censusProvider = std::move(provider);
+}
+
+
+void ServerMetrics::startAdminEndpoint()
+{
+    // Порт админ-сокета: переменная окружения переопределяет значение
+    // по умолчанию, 0 отключает эндпоинт целиком.
+    quint16 port = 9181;
+    const QByteArray env = qgetenv("MESSENGER_METRICS_PORT");
+    if (!env.isEmpty()) {
+        bool ok = false;
+        const uint parsed = env.toUInt(&ok);
+        if (ok && parsed <= 65535) {
+            port = quint16(parsed);
+        } else {
+            qWarning() << "[METRICS] Invalid MESSENGER_METRICS_PORT:" << env;
+        }
+    }
+
+    if (port == 0) {
+        qDebug() << "[METRICS] Admin endpoint disabled (MESSENGER_METRICS_PORT=0)";
+        return;
+    }
+
+    m_adminServer = new QTcpServer(this);
+    connect(m_adminServer, &QTcpServer::newConnection,
+            this, &ServerMetrics::onAdminConnection);
+
+    // Только loopback: метрики — внутренний интерфейс, наружу не светим.
+    if (!m_adminServer->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "[METRICS] Failed to bind admin endpoint on 127.0.0.1:" << port
+                   << "-" << m_adminServer->errorString();
+        return;
+    }
+
+    qDebug() << "[METRICS] Admin endpoint listening on 127.0.0.1:" << port;
+}
+
+
+void ServerMetrics::onAdminConnection()
+{
+    while (QTcpSocket *socket = m_adminServer->nextPendingConnection()) {
+        // Ждем первую строку запроса: путь выбирает формат ответа
+        // (`/snapshot` — JSON-снимок состояния, `/census` — перепись
+        // контейнеров, все остальное — метрики).
+        // `nc 127.0.0.1 <порт>` по-прежнему работает — достаточно нажать Enter.
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            if (!socket->canReadLine() && socket->bytesAvailable() < 1024) {
+                return; // Строка запроса еще не пришла целиком.
+            }
+            const QByteArray requestLine = socket->readLine(1024).trimmed();
+            disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+
+            QByteArray body;
+            QByteArray contentType;
+            if (requestLine.contains("/snapshot") && m_snapshotProvider) {
+                body = QJsonDocument(m_snapshotProvider()).toJson(QJsonDocument::Indented);
+                contentType = "application/json; charset=utf-8";
+            } else if (requestLine.contains("/census") && m_censusProvider) {
+                body = QJsonDocument(m_censusProvider()).toJson(QJsonDocument::Indented);
+                contentType = "application/json; charset=utf-8";
+            } else {
+                body = renderText().toUtf8();
+                contentType = "text/plain; version=0.0.4; charset=utf-8";
+            }
+
+            QByteArray response;
+            response += "HTTP/1.0 200 OK\r\n";
+            response += "Content-Type: " + contentType + "\r\n";
+            response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+            response += "Connection: close\r\n\r\n";
+            response += body;
+
+            socket->write(response);
+            socket->disconnectFromHost();
+        });
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+
+QString ServerMetrics::renderText() const
+{
+    QString out;
+    out.reserve(4096);
+
+    // --- Гистограммы задержек обработчиков ---
+    out += "# HELP messenger_handler_duration_us Handler execution time in microseconds.\n";
+    out += "# TYPE messenger_handler_duration_us histogram\n";
+    for (auto it = m_commands.constBegin(); it != m_commands.constEnd(); ++it) {
+        const QString &command = it.key();
+        const CommandStats &stats = it.value();
+
+        quint64 cumulative = 0;
+        for (int i = 0; i < DurationBuckets; ++i) {
+            cumulative += stats.durations[i];
+            const QString le = (i < DurationBuckets - 1)
+                ? QString::number(kDurationBoundsUs[i])
+                : QStringLiteral("+Inf");
+            out += QString("messenger_handler_duration_us_bucket{command=\"%1\",le=\"%2\"} %3\n")
+                       .arg(command, le, QString::number(cumulative));
+        }
+        out += QString("messenger_handler_duration_us_sum{command=\"%1\"} %2\n")
+                   .arg(command, QString::number(stats.totalNs / 1000));
+        out += QString("messenger_handler_duration_us_count{command=\"%1\"} %2\n")
+                   .arg(command, QString::number(stats.count));
+    }
+
+    out += "# HELP messenger_handler_duration_us_max Worst observed handler latency in microseconds.\n";
+    out += "# TYPE messenger_handler_duration_us_max gauge\n";
+    for (auto it = m_commands.constBegin(); it != m_commands.constEnd(); ++it) {
+        out += QString("messenger_handler_duration_us_max{command=\"%1\"} %2\n")
+                   .arg(it.key(), QString::number(it.value().maxNs / 1000));
+    }
+
+    // --- Гистограммы размеров входящих пакетов ---
+    out += "# HELP messenger_handler_payload_bytes Incoming packet size per command (where known).\n";
+    out += "# TYPE messenger_handler_payload_bytes histogram\n";
+    for (auto it = m_commands.constBegin(); it != m_commands.constEnd(); ++it) {
+        const QString &command = it.key();
+        const CommandStats &stats = it.value();
+        if (stats.payloadCount == 0) {
+            continue;
+        }
+
+        quint64 cumulative = 0;
+        for (int i = 0; i < PayloadBuckets; ++i) {
+            cumulative += stats.payloads[i];
+            const QString le = (i < PayloadBuckets - 1)
+                ? QString::number(kPayloadBoundsBytes[i])
+                : QStringLiteral("+Inf");
+            out += QString("messenger_handler_payload_bytes_bucket{command=\"%1\",le=\"%2\"} %3\n")
+                       .arg(command, le, QString::number(cumulative));
+        }
+        out += QString("messenger_handler_payload_bytes_sum{command=\"%1\"} %2\n")
+                   .arg(command, QString::number(stats.payloadTotal));
+        out += QString("messenger_handler_payload_bytes_count{command=\"%1\"} %2\n")
+                   .arg(command, QString::number(stats.payloadCount));
+    }
+
+    // --- Gauge-метрики (вычисляются в момент опроса) ---
+    for (const Gauge &gauge : m_gauges) {
+        out += QString("# HELP %1 %2\n# TYPE %1 gauge\n%1 %3\n")
+                   .arg(gauge.name, gauge.help, QString::number(gauge.provider()));
+    }
+
+    return out;
+}
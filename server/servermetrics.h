@@ -0,0 +1,143 @@
+#ifndef SERVERMETRICS_H
+#define SERVERMETRICS_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QJsonObject>
+
+#include <array>
+#include <functional>
+
+class QTcpServer;
+
+/**
+ * @class ServerMetrics
+ * @brief Встроенная наблюдаемость сервера: гистограммы по обработчикам и gauge-метрики.
+ *
+ * @details До появления этого модуля медленные команды диагностировались
+ * добавлением qDebug и передеплоем. Теперь каждый вызов обработчика в
+ * `Server::processJsonRequest` записывает в аккумулятор своей команды:
+ *
+ * - гистограмму времени выполнения (фиксированные бакеты, микросекунды);
+ * - гистограмму размера входящего пакета (там, где размер известен);
+ * - счетчик вызовов и максимальную наблюдаемую задержку.
+ *
+ * Дополнительно регистрируются gauge-метрики — функции, вычисляющие текущее
+ * значение в момент опроса (глубина очередей записи, число онлайн-сессий и т.п.).
+ *
+ * Снимок отдается через локальный административный сокет (только 127.0.0.1)
+ * в текстовом scrape-формате, совместимом с Prometheus: достаточно
+ * `curl http://127.0.0.1:<порт>/metrics`. Порт задается переменной окружения
+ * `MESSENGER_METRICS_PORT` (0 — отключить), по умолчанию 9181.
+ *
+ * Помимо агрегатов тот же сокет отдает точечный снимок состояния для разбора
+ * инцидентов: `curl http://127.0.0.1:<порт>/snapshot` возвращает JSON с
+ * перечислением сессий, активных звонков и глубин очередей записи. Содержимое
+ * снимка формирует сервер через зарегистрированный провайдер
+ * (registerSnapshotProvider) — сам модуль о структурах сервера не знает.
+ *
+ * @note Запись метрик выполняется только из основного потока сервера — там же,
+ * где живет диспетчер команд, — поэтому счетчики обходятся без блокировок
+ * и атомарных операций: инкремент стоит одно сложение.
+ */
+class ServerMetrics : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** @brief Число бакетов гистограммы задержек (последний — переполнение, +Inf). */
+    static constexpr int DurationBuckets = 9;
+
+    /** @brief Число бакетов гистограммы размеров пакетов (последний — +Inf). */
+    static constexpr int PayloadBuckets = 8;
+
+    explicit ServerMetrics(QObject *parent = nullptr);
+
+    /**
+     * @brief Записывает один вызов обработчика команды.
+     * @param command Строка команды из поля "type" запроса.
+     * @param elapsedNs Время выполнения обработчика в наносекундах.
+     * @param payloadBytes Размер входящего пакета в байтах; -1 — размер неизвестен
+     *        (например, запрос распарсен в рабочем потоке пула соединений).
+     */
+    void recordHandler(const QString &command, qint64 elapsedNs, qint64 payloadBytes);
+
+    /**
+     * @brief Суммарное число вызовов обработчиков за все время.
+     * @details Дешевый монотонный счетчик: дельта между опросами дает
+     * интенсивность трафика (используется детектором тихих окон обслуживания БД).
+     */
+    quint64 totalHandlerCalls() const { return m_totalCalls; }
+
+    /**
+     * @brief Регистрирует gauge-метрику, вычисляемую в момент опроса.
+     * @param name Имя метрики (формат Prometheus: snake_case).
+     * @param help Однострочное описание для строки `# HELP`.
+     * @param provider Функция, возвращающая текущее значение.
+     */
+    void registerGauge(const QString &name, const QString &help,
+                       std::function<qint64()> provider);
+
+    /**
+     * @brief Регистрирует провайдер точечного снимка состояния (`/snapshot`).
+     * @details Провайдер вызывается в основном потоке в момент запроса и
+     * должен вернуть готовый JSON-объект. Раньше такие вопросы («кто онлайн,
+     * какие звонки активны») решались подключением gdb к живому процессу.
+     * @param provider Функция, собирающая снимок состояния сервера.
+     */
+    void registerSnapshotProvider(std::function<QJsonObject()> provider);
+
+    /**
+     * @brief Регистрирует провайдер переписи контейнеров (`/census`).
+     * @details Дамп размеров долгоживущих контейнеров с приростом с момента
+     * старта — инструмент атрибуции утечек памяти (см. ContainerCensus).
+     * @param provider Функция, собирающая дамп переписи.
+     */
+    void registerCensusProvider(std::function<QJsonObject()> provider);
+
+    /**
+     * @brief Поднимает административный сокет для опроса метрик.
+     * @details Слушает только loopback-интерфейс. Порт берется из переменной
+     * окружения `MESSENGER_METRICS_PORT`; значение 0 отключает эндпоинт.
+     */
+    void startAdminEndpoint();
+
+    /**
+     * @brief Формирует текстовый снимок всех метрик в формате Prometheus.
+     */
+    QString renderText() const;
+
+private slots:
+    /** @brief Принимает соединение админ-сокета и ждет строку запроса. */
+    void onAdminConnection();
+
+private:
+    /** @brief Аккумулятор одной команды: гистограммы и счетчики. */
+    struct CommandStats {
+        quint64 count = 0;          ///< Число вызовов обработчика.
+        quint64 totalNs = 0;        ///< Суммарное время выполнения, нс.
+        quint64 maxNs = 0;          ///< Максимальная наблюдаемая задержка, нс.
+        quint64 payloadCount = 0;   ///< Число вызовов с известным размером пакета.
+        quint64 payloadTotal = 0;   ///< Суммарный размер пакетов, байт.
+        std::array<quint64, DurationBuckets> durations{}; ///< Бакеты задержек.
+        std::array<quint64, PayloadBuckets> payloads{};   ///< Бакеты размеров.
+    };
+
+    /** @brief Зарегистрированная gauge-метрика. */
+    struct Gauge {
+        QString name;                      ///< Имя метрики.
+        QString help;                      ///< Описание для # HELP.
+        std::function<qint64()> provider;  ///< Источник текущего значения.
+    };
+
+    QHash<QString, CommandStats> m_commands; ///< Аккумуляторы по командам.
+    quint64 m_totalCalls = 0;                ///< Всего вызовов обработчиков.
+    QList<Gauge> m_gauges;                   ///< Gauge-метрики в порядке регистрации.
+    QTcpServer *m_adminServer = nullptr;     ///< Локальный сокет для опроса.
+    std::function<QJsonObject()> m_snapshotProvider; ///< Источник снимка `/snapshot`.
+    std::function<QJsonObject()> m_censusProvider;   ///< Источник переписи `/census`.
+};
+
+#endif // SERVERMETRICS_H
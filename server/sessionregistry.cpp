@@ -0,0 +1,105 @@
+/**
+ * @file sessionregistry.cpp
+ * @brief Реализация реестра сессий.
+ */
+
+#include <QDebug>
+
+#include "sessionregistry.h"
+
+SessionId SessionRegistry::open(QObject* socket)
+{
+    const SessionId existing = m_bySocket.value(socket, 0);
+    if (existing != 0) {
+        return existing; // Соединение уже зарегистрировано
+    }
+
+    Session session;
+    session.id = m_nextId++;
+    session.socket = socket;
+
+    m_sessions.insert(session.id, session);
+    m_bySocket.insert(socket, session.id);
+
+    return session.id;
+}
+
+
+void SessionRegistry::bind(QObject* socket, const QString& username)
+{
+    const SessionId id = open(socket); // Лениво регистрируем, если нужно
+
+    Session& session = m_sessions[id];
+
+    // Замещаем прежнюю привязку имени этой сессии (повторный логин).
+    if (!session.username.isEmpty()) {
+        m_byUsername.remove(session.username);
+    }
+
+    session.username = username;
+    m_byUsername.insert(username, id);
+}
+
+
+void SessionRegistry::unbind(QObject* socket)
+{
+    const SessionId id = m_bySocket.value(socket, 0);
+    if (id == 0) return;
+
+    Session& session = m_sessions[id];
+    if (!session.username.isEmpty()) {
+        m_byUsername.remove(session.username);
+        session.username.clear();
+    }
+}
+
+
+void SessionRegistry::close(QObject* socket)
+{
+    const SessionId id = m_bySocket.take(socket);
+    if (id == 0) return;
+
+    const Session session = m_sessions.take(id);
+    if (!session.username.isEmpty()) {
+        m_byUsername.remove(session.username);
+    }
+}
+
+
+QObject* SessionRegistry::socketOf(const QString& username) const
+{
+    const SessionId id = m_byUsername.value(username, 0);
+    if (id == 0) return nullptr;
+
+    return m_sessions.value(id).socket;
+}
+
+
+QString SessionRegistry::usernameOf(QObject* socket, const QString& fallback) const
+{
+    const SessionId id = m_bySocket.value(socket, 0);
+    if (id == 0) return fallback;
+
+    const auto it = m_sessions.constFind(id);
+    if (it == m_sessions.constEnd()) return fallback;
+
+    return it->username.isEmpty() ? fallback : it->username;
+}
+
+
+QStringList SessionRegistry::onlineUsernames() const
+{
+    return m_byUsername.keys();
+}
+
+
+QList<QObject*> SessionRegistry::authenticatedSockets() const
+{
+    QList<QObject*> sockets;
+    sockets.reserve(m_byUsername.size());
+
+    for (SessionId id : m_byUsername) {
+        sockets.append(m_sessions.value(id).socket);
+    }
+    return sockets;
+}
@@ -0,0 +1,97 @@
+#ifndef SESSIONREGISTRY_H
+#define SESSIONREGISTRY_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+
+/** @brief Плотный целочисленный идентификатор сессии (соединения). */
+using SessionId = quint32;
+
+/**
+ * @class SessionRegistry
+ * @brief Реестр активных сессий с целочисленными ID и hash-индексами.
+ *
+ * @details Исторически маршрутизация шла через две QMap со строковыми и
+ * указательными ключами (`username -> сокет` и обратная) — O(log n) сравнений
+ * QString на каждую доставку сообщения. Реестр заменяет их одной таблицей
+ * сессий с тремя плоскими hash-индексами:
+ *
+ * - `SessionId -> Session` — сама таблица;
+ * - `сокет -> SessionId` — идентификация отправителя запроса;
+ * - `username -> SessionId` — маршрутизация сообщения получателю.
+ *
+ * Каждому соединению при регистрации выдается плотный целочисленный ID;
+ * логин привязывает к сессии имя пользователя (bind), логаут отвязывает
+ * (unbind), разрыв соединения удаляет сессию целиком (close). Все операции
+ * горячего пути — O(1) без сравнений строк, кроме одного хеширования
+ * username там, где адресация по имени задана протоколом.
+ *
+ * @note Используется только из основного потока сервера, синхронизация
+ * не требуется.
+ */
+class SessionRegistry
+{
+public:
+    /**
+     * @brief Регистрирует новое соединение и выдает ему ID сессии.
+     * @details Идемпотентна: повторный вызов для известного сокета вернет
+     * уже назначенный ID.
+     * @param socket Сокет соединения (QTcpSocket или QWebSocket).
+     * @return Целочисленный ID сессии.
+     */
+    SessionId open(QObject* socket);
+
+    /**
+     * @brief Привязывает имя пользователя к сессии (успешный логин).
+     * @details Если сокет еще не зарегистрирован, сессия открывается здесь же.
+     * Прежняя привязка имени (если была) замещается.
+     */
+    void bind(QObject* socket, const QString& username);
+
+    /**
+     * @brief Отвязывает имя пользователя от сессии (логаут без разрыва).
+     * @details Соединение остается открытым и может аутентифицироваться заново.
+     */
+    void unbind(QObject* socket);
+
+    /**
+     * @brief Закрывает сессию и удаляет ее из всех индексов (разрыв соединения).
+     */
+    void close(QObject* socket);
+
+    /**
+     * @brief Находит сокет пользователя по имени.
+     * @return Указатель на сокет, либо nullptr — пользователь офлайн.
+     */
+    QObject* socketOf(const QString& username) const;
+
+    /**
+     * @brief Находит имя пользователя по сокету.
+     * @param fallback Значение для неаутентифицированной или неизвестной сессии.
+     */
+    QString usernameOf(QObject* socket, const QString& fallback = QString()) const;
+
+    /** @brief Имена всех аутентифицированных (онлайн) пользователей. */
+    QStringList onlineUsernames() const;
+
+    /** @brief Сокеты всех аутентифицированных пользователей (для рассылок). */
+    QList<QObject*> authenticatedSockets() const;
+
+private:
+    /** @brief Запись об одном активном соединении. */
+    struct Session {
+        SessionId id = 0;        ///< Плотный целочисленный ID.
+        QObject* socket = nullptr; ///< Сокет соединения.
+        QString username;        ///< Имя пользователя (пустое до логина).
+    };
+
+    QHash<SessionId, Session> m_sessions;   ///< Таблица сессий.
+    QHash<QObject*, SessionId> m_bySocket;  ///< Индекс: сокет -> ID сессии.
+    QHash<QString, SessionId> m_byUsername; ///< Индекс: username -> ID сессии.
+    SessionId m_nextId = 1;                 ///< Следующий выдаваемый ID (0 — невалидный).
+};
+
+#endif // SESSIONREGISTRY_H
@@ -0,0 +1,240 @@
+#include "shardbus.h"
+#include "framebuffer.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QDebug>
+
+namespace {
+
+/**
+ * @brief Детерминированный FNV-1a (32 бита) по UTF-8 представлению имени.
+ *
+ * @details Все узлы кластера обязаны сходиться в выборе шарда-владельца,
+ * поэтому хеш не может зависеть от процесса: qHash рандомизируется seed'ом
+ * на старте и для межпроцессного распределения непригоден.
+ */
+quint32 stableHash(const QString& username)
+{
+    const QByteArray utf8 = username.toUtf8();
+    quint32 hash = 2166136261u;
+    for (char c : utf8) {
+        hash ^= static_cast<quint8>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+
+ShardBus::ShardBus(QObject* parent)
+    : QObject(parent)
+{
+    m_shardId = qEnvironmentVariableIntValue("MESSENGER_SHARD_ID");
+
+    const QString peers = QString::fromUtf8(qgetenv("MESSENGER_SHARD_PEERS"));
+    if (!peers.isEmpty()) {
+        m_peers = peers.split(QLatin1Char(','), Qt::SkipEmptyParts);
+    }
+
+    if (m_peers.size() > 1
+        && (m_shardId < 0 || m_shardId >= m_peers.size())) {
+        qCritical() << "[SHARD] MESSENGER_SHARD_ID" << m_shardId
+                    << "is outside the peer list, sharding disabled";
+        m_peers.clear();
+    }
+
+    m_reconnectTimer.setInterval(2000);
+    connect(&m_reconnectTimer, &QTimer::timeout,
+            this, &ShardBus::connectMissingPeers);
+}
+
+
+ShardBus::~ShardBus()
+{
+    qDeleteAll(m_frames);
+}
+
+
+int ShardBus::shardOf(const QString& username) const
+{
+    if (m_peers.size() < 2) return m_shardId;
+    return static_cast<int>(stableHash(username) % static_cast<quint32>(m_peers.size()));
+}
+
+
+bool ShardBus::isLocal(const QString& username) const
+{
+    return !enabled() || shardOf(username) == m_shardId;
+}
+
+
+bool ShardBus::start()
+{
+    if (!enabled()) {
+        qDebug() << "[SHARD] Single-node mode (no MESSENGER_SHARD_PEERS)";
+        return true;
+    }
+
+    // Свой адрес в списке пиров задает порт прослушивания шины.
+    const QStringList self = m_peers.at(m_shardId).split(QLatin1Char(':'));
+    const quint16 port = static_cast<quint16>(self.value(1).toUInt());
+    if (port == 0) {
+        qCritical() << "[SHARD] Invalid bus address for shard" << m_shardId
+                    << ":" << m_peers.at(m_shardId);
+        return false;
+    }
+
+    m_listener = new QTcpServer(this);
+    connect(m_listener, &QTcpServer::newConnection,
+            this, &ShardBus::onNewPeerConnection);
+
+    if (!m_listener->listen(QHostAddress::Any, port)) {
+        qCritical() << "[SHARD] Bus failed to listen on port" << port
+                    << ":" << m_listener->errorString();
+        return false;
+    }
+
+    qInfo() << "[SHARD] Node" << m_shardId << "of" << m_peers.size()
+            << "listening on bus port" << port;
+
+    connectMissingPeers();
+    m_reconnectTimer.start();
+    return true;
+}
+
+
+void ShardBus::send(int shard, const QJsonObject& envelope)
+{
+    QTcpSocket* link = m_links.value(shard, nullptr);
+    if (!link || link->state() != QAbstractSocket::ConnectedState) {
+        // Линк переустановит таймер; конверты шины эфемерны (доставка,
+        // presence) и не буферизуются — устаревшее событие хуже потерянного.
+        qWarning() << "[SHARD] No live link to shard" << shard << "- envelope dropped";
+        return;
+    }
+
+    writeEnvelope(link, envelope);
+    ++m_forwarded;
+}
+
+
+void ShardBus::broadcast(const QJsonObject& envelope)
+{
+    for (int shard = 0; shard < m_peers.size(); ++shard) {
+        if (shard == m_shardId) continue;
+        QTcpSocket* link = m_links.value(shard, nullptr);
+        if (link && link->state() == QAbstractSocket::ConnectedState) {
+            writeEnvelope(link, envelope);
+            ++m_forwarded;
+        }
+    }
+}
+
+
+void ShardBus::writeEnvelope(QTcpSocket* link, const QJsonObject& envelope)
+{
+    const QByteArray json =
+        QJsonDocument(envelope).toJson(QJsonDocument::Compact);
+
+    // Тот же фрейминг, что у клиентского протокола: FrameBuffer на приемной
+    // стороне разбирает оба потока одним кодом.
+    QByteArray block;
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_2);
+    out << (quint32)0;
+    out << json;
+    out.device()->seek(0);
+    out << (quint32)(block.size() - sizeof(quint32));
+
+    link->write(block);
+}
+
+
+void ShardBus::connectMissingPeers()
+{
+    for (int shard = 0; shard < m_peers.size(); ++shard) {
+        if (shard == m_shardId) continue;
+
+        QTcpSocket* existing = m_links.value(shard, nullptr);
+        if (existing && existing->state() != QAbstractSocket::UnconnectedState) {
+            continue; // Линк жив или уже устанавливается
+        }
+
+        if (existing) {
+            delete m_frames.take(existing);
+            existing->deleteLater();
+        }
+
+        const QStringList address = m_peers.at(shard).split(QLatin1Char(':'));
+        auto* link = new QTcpSocket(this);
+        link->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        m_links.insert(shard, link);
+        m_frames.insert(link, new FrameBuffer());
+
+        connect(link, &QTcpSocket::readyRead, this, &ShardBus::onPeerReadyRead);
+        connect(link, &QTcpSocket::connected, this, [shard]() {
+            qInfo() << "[SHARD] Link to shard" << shard << "established";
+        });
+
+        link->connectToHost(address.value(0),
+                            static_cast<quint16>(address.value(1).toUInt()));
+    }
+}
+
+
+void ShardBus::onNewPeerConnection()
+{
+    while (QTcpSocket* peer = m_listener->nextPendingConnection()) {
+        peer->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        m_frames.insert(peer, new FrameBuffer());
+
+        connect(peer, &QTcpSocket::readyRead, this, &ShardBus::onPeerReadyRead);
+        connect(peer, &QTcpSocket::disconnected, this, [this, peer]() {
+            delete m_frames.take(peer);
+            peer->deleteLater();
+        });
+
+        qDebug() << "[SHARD] Inbound bus connection from"
+                 << peer->peerAddress().toString();
+    }
+}
+
+
+void ShardBus::onPeerReadyRead()
+{
+    auto* peer = qobject_cast<QTcpSocket*>(sender());
+    FrameBuffer* framer = m_frames.value(peer, nullptr);
+    if (!peer || !framer) return;
+
+    framer->append(peer->readAll());
+
+    QByteArray frame;
+    while (framer->nextFrame(frame, FrameBuffer::SessionFrameLimit)) {
+        QDataStream in(frame);
+        in.setVersion(QDataStream::Qt_6_2);
+        QByteArray json;
+        in >> json;
+
+        const QJsonDocument doc = QJsonDocument::fromJson(json);
+        if (doc.isObject()) {
+            ++m_received;
+            emit envelopeReceived(doc.object());
+        } else {
+            qWarning() << "[SHARD] Malformed envelope from"
+                       << peer->peerAddress().toString();
+        }
+    }
+
+    // Конверты шины — килобайтные JSON; префикс за пределами лимита значит,
+    // что к порту шины подключился не шард. Рвем соединение.
+    if (framer->overflowed()) {
+        qWarning() << "[SHARD] Envelope length prefix exceeds limit from"
+                   << peer->peerAddress().toString() << "- aborting peer";
+        peer->abort();
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef SHARDBUS_H
+#define SHARDBUS_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include <QTimer>
+
+class QTcpServer;
+class QTcpSocket;
+class FrameBuffer;
+
+/**
+ * @brief Межузловая шина для шардированного режима сервера.
+ *
+ * @details Один процесс Server — потолок вертикального масштабирования.
+ * В шардированном режиме пользователи распределяются по N процессам
+ * детерминированным хешем имени: каждый клиент подключается к «своему»
+ * шарду, и реестр сессий (SessionRegistry) остается локальным для узла.
+ * Для пар собеседников с разных шардов шина пересылает между узлами
+ * легковесные конверты: маршрутизацию private_message и дельты presence.
+ *
+ * Конфигурация через окружение:
+ * - MESSENGER_SHARD_ID=K — индекс этого узла (с нуля).
+ * - MESSENGER_SHARD_PEERS=host:port,host:port,... — адреса шины всех
+ *   узлов по порядку индексов; запись с индексом K задает порт, который
+ *   слушает этот узел. Меньше двух записей — режим выключен.
+ *
+ * Транспорт: TCP между узлами, кадры `[длина][JSON]` в том же формате
+ * QDataStream, что и клиентский протокол (разбор — FrameBuffer). Шина
+ * рассчитана на доверенную внутреннюю сеть и не шифрует трафик — узлы
+ * одного кластера стоят за общим периметром.
+ *
+ * Хеш распределения — FNV-1a по UTF-8 имени: qHash не годится, потому
+ * что его значение зависит от случайного seed процесса, а все узлы
+ * должны сходиться в выборе владельца пользователя.
+ */
+class ShardBus : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ShardBus(QObject* parent = nullptr);
+    ~ShardBus() override;
+
+    /** @brief true, если узел запущен в шардированном режиме. */
+    bool enabled() const { return m_peers.size() > 1; }
+
+    /** @brief Количество узлов кластера. */
+    int shardCount() const { return m_peers.size(); }
+
+    /** @brief Индекс этого узла. */
+    int localShard() const { return m_shardId; }
+
+    /** @brief Индекс узла-владельца пользователя (детерминированный). */
+    int shardOf(const QString& username) const;
+
+    /** @brief true, если пользователь принадлежит этому узлу. */
+    bool isLocal(const QString& username) const;
+
+    /** @brief Запускает прослушивание своего порта и соединение с пирами. */
+    bool start();
+
+    /** @brief Отправляет конверт конкретному узлу (молча, если линк лежит). */
+    void send(int shard, const QJsonObject& envelope);
+
+    /** @brief Отправляет конверт всем остальным узлам кластера. */
+    void broadcast(const QJsonObject& envelope);
+
+    /** @brief Переслано конвертов другим узлам (для метрик). */
+    qint64 forwardedCount() const { return m_forwarded; }
+
+    /** @brief Принято конвертов от других узлов (для метрик). */
+    qint64 receivedCount() const { return m_received; }
+
+signals:
+    /** @brief Конверт, принятый от другого узла кластера. */
+    void envelopeReceived(const QJsonObject& envelope);
+
+private slots:
+    /** @brief Принимает входящее соединение узла-пира. */
+    void onNewPeerConnection();
+
+    /** @brief Разбирает кадры из сокета пира (входящего или исходящего). */
+    void onPeerReadyRead();
+
+    /** @brief Переустанавливает упавшие исходящие линки (по таймеру). */
+    void connectMissingPeers();
+
+private:
+    /** @brief Кадрирует и пишет конверт в установленный линк. */
+    void writeEnvelope(QTcpSocket* link, const QJsonObject& envelope);
+
+    int m_shardId = 0;
+    QStringList m_peers;
+
+    QTcpServer* m_listener = nullptr;
+
+    /** @brief Исходящие линки к пирам (индекс шарда -> сокет). */
+    QHash<int, QTcpSocket*> m_links;
+
+    /** @brief Пошаговые парсеры кадров входящих и исходящих сокетов. */
+    QHash<QTcpSocket*, FrameBuffer*> m_frames;
+
+    /** @brief Таймер восстановления исходящих линков. */
+    QTimer m_reconnectTimer;
+
+    qint64 m_forwarded = 0;
+    qint64 m_received = 0;
+};
+
+#endif // SHARDBUS_H
@@ -0,0 +1,89 @@
+#ifndef SOCKETTUNING_H
+#define SOCKETTUNING_H
+
+#include <QTcpSocket>
+
+#ifdef Q_OS_UNIX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+/**
+ * @brief Настройка TCP-сокетов клиентских соединений под профиль трафика.
+ *
+ * @details Трафик мессенджера двуликий: мелкие интерактивные кадры
+ * (typing, квитанции, сообщения), для которых важна задержка, и чанки
+ * файлового канала, для которых важна пропускная способность. Настройки
+ * обслуживают оба:
+ *
+ * - TCP_NODELAY: Nagle выключен. Батчинг мелких кадров и так выполняется
+ *   на уровне приложения (коалесинг очереди отправки — кадры одного
+ *   оборота цикла событий уходят одним write), поэтому ядру нечего
+ *   докидывать в пакет, а ждать ACK ради этого — чистая задержка.
+ * - Буферы сокета увеличены: окно файлового канала держит сотни килобайт
+ *   в полете, и дефолтных буферов не хватает на каналах с высоким BDP.
+ * - Keepalive с короткими таймерами: NAT-трансляции домашних роутеров
+ *   истекают за минуты простоя; зонды раз в минуту держат отображение
+ *   живым и обнаруживают мертвый канал быстрее системных двух часов.
+ *
+ * Применяется в обоих путях приема соединений (однопоточный сервер и
+ * пул воркеров) и симметрично на клиенте (NetworkService).
+ */
+namespace SocketTuning {
+
+/** @brief Буфер отправки: окно файлового канала плюс запас. */
+constexpr int SendBufferBytes = 512 * 1024;
+
+/** @brief Буфер приема: симметрично отправке (канал двунаправленный). */
+constexpr int ReceiveBufferBytes = 512 * 1024;
+
+/** @brief Простой до первого keepalive-зонда, сек. */
+constexpr int KeepAliveIdleSec = 60;
+
+/** @brief Интервал между зондами, сек. */
+constexpr int KeepAliveIntervalSec = 20;
+
+/** @brief Безответных зондов до признания канала мертвым. */
+constexpr int KeepAliveProbeCount = 4;
+
+/**
+ * @brief Применяет профиль к принятому (или установленному) соединению.
+ *
+ * Вызывается, когда дескриптор сокета уже существует: после
+ * nextPendingConnection/setSocketDescriptor на сервере и после
+ * connected() на клиенте.
+ */
+inline void tuneClientSocket(QTcpSocket* socket)
+{
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    socket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption,
+                            SendBufferBytes);
+    socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption,
+                            ReceiveBufferBytes);
+
+#ifdef Q_OS_UNIX
+    // Qt включает SO_KEEPALIVE, но таймеры остаются системными (первый
+    // зонд через два часа) — агрессивные значения ставятся напрямую
+    const int fd = static_cast<int>(socket->socketDescriptor());
+    if (fd >= 0) {
+#ifdef TCP_KEEPIDLE
+        const int idle = KeepAliveIdleSec;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#endif
+#ifdef TCP_KEEPINTVL
+        const int interval = KeepAliveIntervalSec;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+#endif
+#ifdef TCP_KEEPCNT
+        const int count = KeepAliveProbeCount;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+    }
+#endif
+}
+
+} // namespace SocketTuning
+
+#endif // SOCKETTUNING_H
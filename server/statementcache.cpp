@@ -0,0 +1,57 @@
+/**
+ * @file statementcache.cpp
+ * @brief Реализация реестра подготовленных SQL-запросов.
+ *
+ * @details Кэш объявлен thread_local: каждый поток (основной цикл сервера,
+ * поток DatabaseService) владеет своими QSqlQuery, что соответствует правилу
+ * Qt SQL "соединение используется только из потока-создателя" и избавляет
+ * от любой синхронизации.
+ */
+
+#include <QHash>
+#include <QSqlError>
+#include <QDebug>
+
+#include "statementcache.h"
+
+namespace {
+
+/**
+ * @brief Thread-local хранилище скомпилированных запросов.
+ * @details Ключ — имя соединения + текст SQL (разделены '\n', который не
+ * встречается в наших однострочных ключах соединений).
+ */
+thread_local QHash<QString, QSqlQuery*> t_statements;
+
+} // namespace
+
+QSqlQuery& StatementCache::get(QSqlDatabase &db, const QString &sql)
+{
+    const QString key = db.connectionName() + QLatin1Char('\n') + sql;
+
+    QSqlQuery *query = t_statements.value(key, nullptr);
+    if (query) {
+        // Освобождаем результат предыдущего выполнения; сам prepared
+        // statement при этом остается скомпилированным.
+        query->finish();
+        return *query;
+    }
+
+    // Первое обращение: компилируем statement один раз.
+    query = new QSqlQuery(db);
+    if (!query->prepare(sql)) {
+        // Ошибку увидит вызывающий код по результату exec(); здесь только лог.
+        qWarning() << "[SQL-CACHE] Failed to prepare statement:" << query->lastError().text()
+                   << "SQL:" << sql;
+    }
+
+    t_statements.insert(key, query);
+    return *query;
+}
+
+
+QSqlQuery& StatementCache::get(const QString &sql)
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    return get(db, sql);
+}
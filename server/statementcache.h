@@ -0,0 +1,52 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <QString>
+#include <QSqlQuery>
+#include <QSqlDatabase>
+
+/**
+ * @class StatementCache
+ * @brief Реестр подготовленных SQL-запросов (prepared statements).
+ *
+ * @details Обработчики сервера вызывают `query.prepare(...)` с одним и тем же
+ * текстом SQL на каждый запрос клиента. На высоких частотах сообщений повторная
+ * компиляция statement'ов в SQLite начинает доминировать в профиле CPU.
+ *
+ * Этот класс хранит по одному скомпилированному QSqlQuery на пару
+ * (соединение, текст SQL) в thread-local хранилище:
+ * - основной поток сервера и поток DatabaseService получают независимые кэши;
+ * - statement компилируется один раз, дальше только перепривязываются параметры.
+ *
+ * Использование:
+ * @code
+ * QSqlQuery &query = StatementCache::get(db, "SELECT ... WHERE id = :id");
+ * query.bindValue(":id", id);
+ * query.exec();
+ * @endcode
+ *
+ * @warning Возвращаемая ссылка валидна только в пределах текущего потока и
+ * не должна сохраняться между обработчиками.
+ */
+class StatementCache
+{
+public:
+    /**
+     * @brief Возвращает подготовленный запрос для указанного соединения.
+     * @details При первом обращении компилирует statement (prepare), при
+     * последующих — возвращает уже скомпилированный, предварительно вызвав
+     * finish(), чтобы освободить результат предыдущего выполнения.
+     * @param db Соединение с БД (должно принадлежать текущему потоку).
+     * @param sql Текст SQL-запроса (служит ключом кэша).
+     * @return Ссылка на подготовленный QSqlQuery; осталось только bindValue + exec.
+     */
+    static QSqlQuery& get(QSqlDatabase &db, const QString &sql);
+
+    /**
+     * @brief Перегрузка для соединения по умолчанию текущего потока.
+     * @param sql Текст SQL-запроса.
+     */
+    static QSqlQuery& get(const QString &sql);
+};
+
+#endif // STATEMENTCACHE_H
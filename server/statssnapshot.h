@@ -0,0 +1,77 @@
+#ifndef STATSSNAPSHOT_H
+#define STATSSNAPSHOT_H
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief Снимок статистики одного писателя: seqlock без блокировок.
+ *
+ * Счетчики реального времени (байты/пакеты аудиотракта, кадры микшера)
+ * живут обычными членами на своем потоке и инкрементируются бесплатно —
+ * ни атомиков, ни мьютексов на горячем пути. Раз в секунду поток-владелец
+ * публикует их publish() одним копированием структуры; любой другой поток
+ * (UI, выгрузка статистики в call_end, опрос метрик) читает read() без
+ * ожидания и без влияния на писателя.
+ *
+ * Протокол — классический seqlock: нечетный счетчик версии означает
+ * «запись идет», читатель перечитывает, если версия изменилась за время
+ * копирования. Публикация происходит раз в секунду и длится наносекунды,
+ * поэтому повтор чтения — событие исключительное, а не норма.
+ *
+ * Писатель ровно один (поток-владелец счетчиков); читателей — сколько
+ * угодно. Тип T обязан быть тривиально копируемым: копирование идет
+ * memcpy, без конструкторов.
+ *
+ * Используется аудиотрактом клиента (AudioEngine::CallStats) и воркерами
+ * комнат серверного микшера (ConferenceWorker::MixStats) — файл
+ * идентичен в client/core/ и server/, как protocolschema.h.
+ */
+template <typename T>
+class StatsSnapshot
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "StatsSnapshot copies with memcpy and needs a trivially copyable T");
+
+public:
+    /**
+     * @brief Публикует новое значение снимка. Только поток-писатель.
+     * @param value Текущее состояние счетчиков
+     */
+    void publish(const T& value)
+    {
+        const unsigned begin = m_version.load(std::memory_order_relaxed) + 1;
+        m_version.store(begin, std::memory_order_relaxed); // Нечетная: запись идет
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&m_value, &value, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_release);
+        m_version.store(begin + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Читает последний опубликованный снимок. Любой поток.
+     * @return Согласованная копия значения
+     */
+    T read() const
+    {
+        T out{};
+        for (;;) {
+            const unsigned before = m_version.load(std::memory_order_acquire);
+            if (before & 1u) {
+                continue; // Запись идет; она на порядки короче чтения
+            }
+            std::memcpy(&out, &m_value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_version.load(std::memory_order_relaxed) == before) {
+                return out;
+            }
+        }
+    }
+
+private:
+    std::atomic<unsigned> m_version {0}; ///< Версия: нечетная — запись идет
+    T m_value {};                        ///< Последний опубликованный снимок
+};
+
+#endif // STATSSNAPSHOT_H
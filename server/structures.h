@@ -5,6 +5,7 @@
 #include <QList>
 #include <QMetaType>
 #include <QObject> // Необходимо для QObject* в CallInfo
+#include <QSharedPointer>
 
 /**
  * @struct Chat
@@ -148,11 +149,11 @@ struct ChatMessage {
     QString fromUser;                ///< Username отправителя.
     QString toUser;                  ///< Username получателя.
     QString payload;                 ///< Текст сообщения или описание файла.
-    QString timestamp;               ///< Время создания сообщения (ISO 8601).
+    qint64 timestamp = 0;            ///< Время создания сообщения (мс эпохи).
 
     bool isEdited = false;           ///< Флаг: сообщение было изменено.
     qint64 replyToId = 0;            ///< ID сообщения, на которое это сообщение является ответом.
-    User forwardedFrom;              ///< Информация об авторе оригинала (если сообщение переслано).
+    QSharedPointer<User> forwardedFrom; ///< Информация об авторе оригинала (выделяется только для пересланных сообщений).
     MessageType messageType;         ///< Тип контента (Text, Image и т.д.).
     MessageStatus status;            ///< Текущий статус доставки.
     QString mediaUrl;                ///< Локальный путь или URL для медиа-файлов.
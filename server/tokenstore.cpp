@@ -0,0 +1,218 @@
+/**
+ * @file tokenstore.cpp
+ * @brief Реализация кэша токенов автологина с write-behind персистентностью.
+ */
+
+#include <QTimer>
+#include <QUuid>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariantList>
+#include <QDebug>
+
+#include "tokenstore.h"
+#include "databaseservice.h"
+#include "statementcache.h"
+
+namespace {
+
+/** @brief Срок действия токена в миллисекундах (для монотонных дедлайнов). */
+constexpr qint64 kTokenTtlMs = qint64(TokenStore::TokenTtlDays) * 24 * 60 * 60 * 1000;
+
+} // namespace
+
+
+TokenStore::TokenStore(DatabaseService *dbService, QObject *parent)
+    : QObject(parent)
+    , m_dbService(dbService)
+{
+    m_clock.start();
+
+    // Фоновая уборка заменяет блокирующий GC на старте: первый проход
+    // случится через SweepIntervalMs, когда сервер уже обслуживает клиентов.
+    m_sweepTimer = new QTimer(this);
+    m_sweepTimer->setInterval(SweepIntervalMs);
+    connect(m_sweepTimer, &QTimer::timeout, this, &TokenStore::sweep);
+    m_sweepTimer->start();
+}
+
+
+void TokenStore::loadFromDatabase()
+{
+    m_dbService->read(
+        [](QSqlDatabase &db) -> QVariant {
+            // Остаток срока действия считаем прямо в SQL: в память попадает
+            // количество миллисекунд до истечения, которое превращается в
+            // дедлайн монотонных часов на принимающей стороне.
+            QSqlQuery &query = StatementCache::get(db,
+                "SELECT username, token, "
+                "CAST((julianday(expires_at) - julianday('now')) * 86400000 AS INTEGER) AS ttl_ms "
+                "FROM tokens WHERE expires_at >= CURRENT_TIMESTAMP");
+
+            QVariantList rows;
+
+            if (!query.exec()) {
+                qWarning() << "[DB] Failed to load tokens:" << query.lastError().text();
+                return rows;
+            }
+
+            while (query.next()) {
+                QVariantList row;
+                row << query.value(0) << query.value(1) << query.value(2);
+                rows.append(QVariant(row));
+            }
+            return rows;
+        },
+        this,
+        [this](const QVariant &result) {
+            const QVariantList rows = result.toList();
+
+            for (const QVariant &entry : rows) {
+                const QVariantList row = entry.toList();
+                if (row.size() != 3) continue;
+
+                Entry cached;
+                cached.token = row.at(1).toString();
+                cached.deadlineMs = m_clock.elapsed() + row.at(2).toLongLong();
+                m_tokens.insert(row.at(0).toString(), cached);
+            }
+
+            m_loaded = true;
+            qInfo() << "[SERVER] Token cache warmed:" << m_tokens.size() << "active token(s)";
+        });
+}
+
+
+QString TokenStore::issue(const QString &username)
+{
+    // 1. Генерация сырых данных для токена (энтропия)
+    const QString rawToken = QUuid::createUuid().toString(QUuid::WithoutBraces)
+                           + username
+                           + QString::number(QDateTime::currentMSecsSinceEpoch());
+
+    // 2. Хеширование для получения строки фиксированной длины
+    const QString token = QString(QCryptographicHash::hash(
+        rawToken.toUtf8(), QCryptographicHash::Sha256).toHex());
+
+    // 3. Немедленное обновление кэша: проверки валидности видят токен сразу
+    Entry cached;
+    cached.token = token;
+    cached.deadlineMs = m_clock.elapsed() + kTokenTtlMs;
+    m_tokens.insert(username, cached);
+
+    // 4. Write-behind персистентность: запись уходит в очередь потока БД
+    m_dbService->post([username, token](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &query = StatementCache::get(db,
+            "INSERT OR REPLACE INTO tokens (username, token, expires_at) "
+            "VALUES (:username, :token, datetime('now', '+30 days'))");
+        query.bindValue(":username", username);
+        query.bindValue(":token", token);
+
+        if (!query.exec()) {
+            qWarning() << "[DB] Failed to persist token for" << username
+                       << ":" << query.lastError().text();
+        }
+        return QVariant();
+    });
+
+    qDebug() << "[SERVER] Token issued for user:" << username;
+    return token;
+}
+
+
+bool TokenStore::validate(const QString &username, const QString &token)
+{
+    if (m_loaded) {
+        const auto it = m_tokens.constFind(username);
+        if (it == m_tokens.constEnd()) {
+            qDebug() << "[SERVER] No token cached for user:" << username;
+            return false;
+        }
+
+        if (it->token != token) {
+            return false;
+        }
+
+        // Дедлайн сравнивается с монотонными часами: перевод системного
+        // времени не продлевает и не обрезает срок действия.
+        if (m_clock.elapsed() >= it->deadlineMs) {
+            qDebug() << "[SERVER] Token expired for user:" << username;
+            revoke(username);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Холодный путь: кэш еще прогревается после старта — проверяем по БД
+    // через соединение основного потока, как это делалось раньше.
+    QSqlQuery &query = StatementCache::get(
+        "SELECT token FROM tokens "
+        "WHERE username = :username AND expires_at >= CURRENT_TIMESTAMP");
+    query.bindValue(":username", username);
+
+    if (!query.exec()) {
+        qWarning() << "[SERVER] Failed to validate token for user" << username
+                   << ":" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.next() || query.value(0).toString() != token) {
+        return false;
+    }
+
+    qDebug() << "[SERVER] Token validated from DB (cache warming) for user:" << username;
+    return true;
+}
+
+
+void TokenStore::revoke(const QString &username)
+{
+    m_tokens.remove(username);
+
+    m_dbService->post([username](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &query = StatementCache::get(db,
+            "DELETE FROM tokens WHERE username = :username");
+        query.bindValue(":username", username);
+
+        if (!query.exec()) {
+            qWarning() << "[DB] Failed to delete token for" << username
+                       << ":" << query.lastError().text();
+        }
+        return QVariant();
+    });
+}
+
+
+void TokenStore::sweep()
+{
+    // 1. Память: удаляем записи с истекшим монотонным дедлайном
+    const qint64 now = m_clock.elapsed();
+    int purged = 0;
+
+    for (auto it = m_tokens.begin(); it != m_tokens.end();) {
+        if (now >= it->deadlineMs) {
+            it = m_tokens.erase(it);
+            ++purged;
+        } else {
+            ++it;
+        }
+    }
+
+    // 2. БД: та же уборка по календарному expires_at, в потоке БД
+    m_dbService->post([](QSqlDatabase &db) -> QVariant {
+        QSqlQuery &query = StatementCache::get(db,
+            "DELETE FROM tokens WHERE expires_at < CURRENT_TIMESTAMP");
+
+        if (!query.exec()) {
+            qWarning() << "[DB] Failed to sweep expired tokens:" << query.lastError().text();
+        }
+        return QVariant();
+    });
+
+    if (purged > 0) {
+        qDebug() << "[SERVER] Token sweep: purged" << purged << "expired token(s) from cache";
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef TOKENSTORE_H
+#define TOKENSTORE_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QElapsedTimer>
+
+class DatabaseService;
+class QTimer;
+
+/**
+ * @class TokenStore
+ * @brief Хранилище токенов автологина: hash-кэш в памяти + write-behind в SQLite.
+ *
+ * @details Исторически каждый `token_login` ходил в таблицу `tokens`, кэш
+ * `m_userTokens` терялся при перезапуске, а запуск сервера блокировался на
+ * `DELETE FROM tokens WHERE expires_at < CURRENT_TIMESTAMP` до начала
+ * прослушивания порта. TokenStore устраняет все три проблемы:
+ *
+ * - **Кэш.** Все живые токены загружаются из БД одним асинхронным запросом
+ *   при старте; дальше проверка — чистый поиск в QHash без обращений к диску.
+ * - **Монотонные дедлайны.** Срок действия в памяти хранится как дедлайн
+ *   монотонных часов (QElapsedTimer), поэтому перевод системного времени
+ *   не продлевает и не обрезает сессии. В БД по-прежнему пишется
+ *   календарное `expires_at` — оно переживает перезапуск.
+ * - **Write-behind.** Выдача и отзыв токена сначала обновляют память, а
+ *   запись в БД уходит в очередь DatabaseService и не задерживает ответ.
+ * - **Фоновая уборка.** Истекшие записи вычищаются периодическим таймером
+ *   (память + БД), а не блокирующим GC на старте.
+ *
+ * @note Все методы вызываются только из основного потока сервера;
+ * обращения к БД уходят в поток DatabaseService.
+ */
+class TokenStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** @brief Срок действия токена автологина. */
+    static constexpr int TokenTtlDays = 30;
+
+    /** @brief Интервал фоновой уборки истекших токенов (15 минут). */
+    static constexpr int SweepIntervalMs = 15 * 60 * 1000;
+
+    /**
+     * @brief Конструктор: запускает монотонные часы и таймер уборки.
+     * @param dbService Асинхронный слой доступа к БД.
+     * @param parent Родительский объект Qt.
+     */
+    explicit TokenStore(DatabaseService *dbService, QObject *parent = nullptr);
+
+    /**
+     * @brief Асинхронно загружает живые токены из БД в кэш.
+     * @details Вызывается один раз при старте. До завершения загрузки
+     * validate() использует старый путь с запросом к БД, чтобы автологин
+     * работал и в первые мгновения после запуска.
+     */
+    void loadFromDatabase();
+
+    /**
+     * @brief Генерирует и выдает новый токен для пользователя.
+     * @details Токен попадает в кэш немедленно; INSERT OR REPLACE в таблицу
+     * `tokens` уходит write-behind в поток БД. У пользователя всегда один
+     * активный токен (прежний замещается).
+     * @param username Имя пользователя.
+     * @return Hex-строка токена (SHA-256).
+     */
+    QString issue(const QString &username);
+
+    /**
+     * @brief Проверяет валидность токена.
+     * @details Горячий путь `token_login`: поиск в QHash и сравнение
+     * дедлайна с монотонными часами — без обращений к БД.
+     * @param username Имя пользователя.
+     * @param token Предъявленный токен.
+     * @return true, если токен совпадает и не истек.
+     */
+    bool validate(const QString &username, const QString &token);
+
+    /**
+     * @brief Отзывает токен пользователя (logout).
+     * @details Запись удаляется из кэша сразу, DELETE уходит write-behind.
+     */
+    void revoke(const QString &username);
+
+private slots:
+    /** @brief Периодическая уборка: чистит истекшие записи в памяти и в БД. */
+    void sweep();
+
+private:
+    /** @brief Запись кэша: токен и монотонный дедлайн истечения. */
+    struct Entry {
+        QString token;       ///< Hex-строка токена.
+        qint64 deadlineMs = 0; ///< Момент истечения по m_clock.elapsed().
+    };
+
+    DatabaseService *m_dbService = nullptr; ///< Очередь асинхронных операций БД.
+    QHash<QString, Entry> m_tokens;         ///< Кэш: username -> токен + дедлайн.
+    QElapsedTimer m_clock;                  ///< Монотонные часы процесса.
+    QTimer *m_sweepTimer = nullptr;         ///< Таймер фоновой уборки.
+    bool m_loaded = false;                  ///< Кэш прогрет из БД.
+};
+
+#endif // TOKENSTORE_H
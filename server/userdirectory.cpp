@@ -0,0 +1,70 @@
+/**
+ * @file userdirectory.cpp
+ * @brief Реализация справочника имен с фильтром Блума.
+ */
+
+#include <QHash>
+
+#include "userdirectory.h"
+
+namespace {
+
+// Независимые зерна для двойного хеширования: k проб строятся как
+// h1 + i*h2 — стандартная схема Кирша-Мицмахера, двух хешей достаточно.
+constexpr uint kSeedA = 0x9E3779B9u;
+constexpr uint kSeedB = 0x85EBCA6Bu;
+
+} // namespace
+
+
+UserDirectory::UserDirectory()
+    : m_bloom(BloomBits / 64, 0)
+{
+}
+
+
+void UserDirectory::bloomAdd(const QString& username)
+{
+    const quint32 h1 = qHash(username, kSeedA);
+    const quint32 h2 = qHash(username, kSeedB) | 1; // Нечетный шаг обходит все биты.
+
+    for (int i = 0; i < BloomProbes; ++i) {
+        const quint32 bit = (h1 + quint32(i) * h2) & (BloomBits - 1);
+        m_bloom[bit >> 6] |= quint64(1) << (bit & 63);
+    }
+}
+
+
+bool UserDirectory::bloomMightContain(const QString& username) const
+{
+    const quint32 h1 = qHash(username, kSeedA);
+    const quint32 h2 = qHash(username, kSeedB) | 1;
+
+    for (int i = 0; i < BloomProbes; ++i) {
+        const quint32 bit = (h1 + quint32(i) * h2) & (BloomBits - 1);
+        if (!(m_bloom[bit >> 6] & (quint64(1) << (bit & 63)))) {
+            return false; // Хотя бы один нулевой бит — имени точно нет.
+        }
+    }
+    return true;
+}
+
+
+void UserDirectory::insert(const QString& username)
+{
+    m_usernames.insert(username);
+    bloomAdd(username);
+}
+
+
+bool UserDirectory::contains(const QString& username) const
+{
+    // Отрицательный путь (спам-запросы к несуществующим именам) почти
+    // всегда заканчивается здесь, на пробах битовой карты.
+    if (!bloomMightContain(username)) {
+        return false;
+    }
+
+    // Ложное срабатывание фильтра перепроверяется точным множеством.
+    return m_usernames.contains(username);
+}
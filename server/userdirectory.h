@@ -0,0 +1,68 @@
+#ifndef USERDIRECTORY_H
+#define USERDIRECTORY_H
+
+#include <QString>
+#include <QSet>
+#include <QVector>
+
+/**
+ * @class UserDirectory
+ * @brief Справочник зарегистрированных имен: фильтр Блума плюс hash-множество.
+ *
+ * @details Регистрация и запрос добавления в контакты проверяют существование
+ * пользователя в таблице users. Шторм спам-запросов к несуществующим именам —
+ * это чистые отрицательные SELECT'ы: SQLite каждый раз честно ищет по индексу
+ * и ничего не находит. Справочник держит все имена в памяти, и проверка
+ * существования вообще не касается БД:
+ *
+ * - первым срабатывает фильтр Блума — 128 КБ битовой карты, k проб двойным
+ *   хешированием; для несуществующего имени почти всегда достаточно одного
+ *   промаха по битам, без обхода корзин множества;
+ * - ответ «возможно есть» перепроверяется по точному QSet — ложные
+ *   срабатывания фильтра наружу не выходят.
+ *
+ * Справочник загружается при старте одним SELECT username FROM users и
+ * пополняется при успешной регистрации. Удаления не поддерживаются — учетные
+ * записи в этой схеме не удаляются, поэтому и фильтру забывать нечего.
+ *
+ * @note Используется только из основного потока сервера, синхронизация
+ * не требуется.
+ */
+class UserDirectory
+{
+public:
+    /** @brief Размер фильтра Блума в битах (степень двойки, 128 КБ). */
+    static constexpr quint32 BloomBits = 1u << 20;
+
+    /** @brief Число проб фильтра на одно имя. */
+    static constexpr int BloomProbes = 4;
+
+    UserDirectory();
+
+    /**
+     * @brief Добавляет имя в справочник (при загрузке и регистрации).
+     */
+    void insert(const QString& username);
+
+    /**
+     * @brief Проверяет существование пользователя без обращения к БД.
+     * @details Точный ответ: фильтр Блума отсекает отрицательные запросы,
+     * положительные подтверждаются по множеству.
+     */
+    bool contains(const QString& username) const;
+
+    /** @brief Число зарегистрированных имен (для метрик и логов). */
+    int size() const { return m_usernames.size(); }
+
+private:
+    /** @brief Устанавливает биты фильтра для имени (двойное хеширование). */
+    void bloomAdd(const QString& username);
+
+    /** @brief Проверяет биты фильтра; false — имени точно нет. */
+    bool bloomMightContain(const QString& username) const;
+
+    QSet<QString> m_usernames;  ///< Точное множество имен.
+    QVector<quint64> m_bloom;   ///< Битовая карта фильтра (слова по 64 бита).
+};
+
+#endif // USERDIRECTORY_H